@@ -0,0 +1,437 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "async_log_writer.hpp"
+
+// Interval at which the writer thread checks the rings when it is idle
+#define WRITER_IDLE_INTERVAL_MS 5
+// Maximum number of records written by a single writev
+#ifdef IOV_MAX
+#define WRITER_MAX_BATCH IOV_MAX
+#else
+#define WRITER_MAX_BATCH 1024
+#endif
+// Length stored in front of the unused end of the ring when a record wraps around
+#define PADDING_RECORD UINT32_MAX
+
+namespace common::logging
+{
+    namespace
+    {
+        // Generates the ids of writers
+        std::atomic<std::uint64_t> next_writer_id_{1};
+
+        // Ring of the current thread and the writer it belongs to, retired when the thread exits
+        struct ThreadRing
+        {
+            ~ThreadRing()
+            {
+                if (ring)
+                {
+                    ring->retire();
+                }
+            }
+
+            std::uint64_t writer_id;
+            std::shared_ptr<LogRing> ring;
+        };
+        thread_local ThreadRing current_ring_{0, nullptr};
+
+        /**
+         * Space taken by a record in a ring
+         *
+         * @param[in] length Length of the record
+         * @return The size of the record including its header, aligned to 8 bytes
+         */
+        std::size_t record_size_(std::size_t const length) noexcept
+        {
+            return (sizeof(std::uint32_t) + length + 7) & ~static_cast<std::size_t>(7);
+        }
+
+        /**
+         * Rounds a ring size up to a power of two
+         *
+         * @param[in] size The requested size
+         * @return The size of the ring
+         */
+        std::size_t ring_capacity_(std::size_t const size) noexcept
+        {
+            std::size_t capacity = 64;
+            while (capacity < size)
+            {
+                capacity *= 2;
+            }
+            return capacity;
+        }
+    } // namespace
+
+    LogRing::LogRing(std::size_t const capacity)
+        : capacity_{ring_capacity_(capacity)}, buffer_{new char[capacity_]},
+          head_{0}, cached_tail_{0}, claimed_head_{0}, tail_{0}, retired_{false}
+    {
+    }
+
+    bool LogRing::push(std::string_view const record) noexcept
+    {
+        char *const slot = claim(record.size());
+        if (!slot)
+        {
+            return false;
+        }
+        std::memcpy(slot, record.data(), record.size());
+        commit();
+        return true;
+    }
+
+    char *LogRing::claim(std::size_t const length) noexcept
+    {
+        std::size_t const size = record_size_(length);
+        // Guarantees that a wrapping record always fits in an empty ring
+        if (size > capacity_ / 2)
+        {
+            return nullptr;
+        }
+        std::uint64_t head = head_.load(std::memory_order_relaxed);
+        std::size_t offset = head & (capacity_ - 1);
+        std::size_t const contiguous = capacity_ - offset;
+        std::size_t const needed = contiguous < size ? contiguous + size : size;
+        if (needed > capacity_ - (head - cached_tail_))
+        {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (needed > capacity_ - (head - cached_tail_))
+            {
+                return nullptr;
+            }
+        }
+        // Records are never split - skip the end of the ring instead
+        if (contiguous < size)
+        {
+            std::uint32_t const padding = PADDING_RECORD;
+            std::memcpy(buffer_.get() + offset, &padding, sizeof(padding));
+            head += contiguous;
+            offset = 0;
+        }
+        // Nothing past the published head is read, the record is filled in before commit()
+        std::uint32_t const header = static_cast<std::uint32_t>(length);
+        std::memcpy(buffer_.get() + offset, &header, sizeof(header));
+        claimed_head_ = head + size;
+        return buffer_.get() + offset + sizeof(header);
+    }
+
+    void LogRing::commit() noexcept
+    {
+        head_.store(claimed_head_, std::memory_order_release);
+    }
+
+    void LogRing::retire() noexcept
+    {
+        retired_.store(true, std::memory_order_release);
+    }
+
+#ifdef __linux__
+    AsyncLogWriter::AsyncLogWriter(std::filesystem::path const &file_path, std::size_t const ring_size)
+        : id_{next_writer_id_++}, ring_size_{ring_size}, fd_{STDOUT_FILENO}, owns_fd_{false},
+          dropped_{0}, stop_{false}, mutex_{}, stop_cv_{}, rings_{}, thread_{}
+    {
+        if (!file_path.empty())
+        {
+            // Appending, a previous logger still writing to the same file does not overwrite the new records
+            fd_ = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+            if (fd_ < 0)
+            {
+                throw std::runtime_error{"Failed to open logging file '" + file_path.u8string() + "' - " + std::strerror(errno)};
+            }
+            owns_fd_ = true;
+        }
+        else
+        {
+            // Anything already buffered by the synchronous logger goes out first
+            std::cout.flush();
+        }
+        thread_ = std::thread{&AsyncLogWriter::run_, this};
+    }
+
+    AsyncLogWriter::~AsyncLogWriter()
+    {
+        {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            stop_ = true;
+        }
+        stop_cv_.notify_one();
+        thread_.join();
+        if (owns_fd_)
+        {
+            close(fd_);
+        }
+    }
+
+    bool AsyncLogWriter::push(std::string_view const record) noexcept
+    {
+        char *const slot = claim(record.size());
+        if (!slot)
+        {
+            return false;
+        }
+        std::memcpy(slot, record.data(), record.size());
+        commit();
+        return true;
+    }
+
+    char *AsyncLogWriter::claim(std::size_t const length) noexcept
+    {
+        LogRing *ring = nullptr;
+        try
+        {
+            ring = thread_ring_();
+        }
+        catch (std::exception const &)
+        {
+        }
+        char *const slot = ring ? ring->claim(length) : nullptr;
+        if (!slot)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return slot;
+    }
+
+    void AsyncLogWriter::commit() noexcept
+    {
+        // The ring of the last claim - a thread only logs to one writer at a time
+        current_ring_.ring->commit();
+    }
+
+    std::uint64_t AsyncLogWriter::get_dropped() const noexcept
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    std::size_t AsyncLogWriter::get_rings() noexcept
+    {
+        std::lock_guard<std::mutex> const lock{mutex_};
+        return rings_.size();
+    }
+
+    LogRing *AsyncLogWriter::thread_ring_()
+    {
+        if (current_ring_.writer_id != id_)
+        {
+            // First record of this thread - the ring outlives the thread until it is drained
+            auto ring = std::make_shared<LogRing>(ring_size_);
+            {
+                std::lock_guard<std::mutex> const lock{mutex_};
+                rings_.push_back(ring);
+            }
+            // The ring of a previous writer is not written to anymore
+            if (current_ring_.ring)
+            {
+                current_ring_.ring->retire();
+            }
+            current_ring_.writer_id = id_;
+            current_ring_.ring = std::move(ring);
+        }
+        return current_ring_.ring.get();
+    }
+
+    void AsyncLogWriter::run_() noexcept
+    {
+        while (true)
+        {
+            // Read the flag before draining so that records pushed before the stop are written
+            bool const stopping = stop_;
+            if (drain_() > 0)
+            {
+                continue;
+            }
+            if (stopping)
+            {
+                break;
+            }
+            std::unique_lock<std::mutex> lock{mutex_};
+            stop_cv_.wait_for(lock, std::chrono::milliseconds(WRITER_IDLE_INTERVAL_MS), [this] { return stop_.load(); });
+        }
+    }
+
+    std::size_t AsyncLogWriter::drain_() noexcept
+    {
+        std::vector<std::shared_ptr<LogRing>> rings;
+        {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            rings = rings_;
+        }
+
+        iovec iov[WRITER_MAX_BATCH];
+        std::size_t records = 0;
+        std::size_t bytes = 0;
+        // Read positions to publish once the batch is written
+        std::vector<std::uint64_t> tails(rings.size());
+        // Rings of exited threads with nothing left to read
+        std::vector<LogRing *> drained;
+        for (std::size_t i = 0; i < rings.size(); ++i)
+        {
+            LogRing &ring = *rings[i];
+            // Read before the head so that no record can follow it
+            bool const retired = ring.retired_.load(std::memory_order_acquire);
+            std::uint64_t tail = ring.tail_.load(std::memory_order_relaxed);
+            std::uint64_t const head = ring.head_.load(std::memory_order_acquire);
+            while (tail < head && records < WRITER_MAX_BATCH)
+            {
+                std::size_t const offset = tail & (ring.capacity_ - 1);
+                std::uint32_t length;
+                std::memcpy(&length, ring.buffer_.get() + offset, sizeof(length));
+                if (length == PADDING_RECORD)
+                {
+                    tail += ring.capacity_ - offset;
+                    continue;
+                }
+                iov[records].iov_base = ring.buffer_.get() + offset + sizeof(length);
+                iov[records].iov_len = length;
+                ++records;
+                bytes += length;
+                tail += record_size_(length);
+            }
+            tails[i] = tail;
+            if (retired && tail == head)
+            {
+                drained.push_back(&ring);
+            }
+        }
+        if (!drained.empty())
+        {
+            // Freed with the copies of this batch
+            std::lock_guard<std::mutex> const lock{mutex_};
+            rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [&drained](std::shared_ptr<LogRing> const &ring) {
+                             return std::find(drained.begin(), drained.end(), ring.get()) != drained.end();
+                         }),
+                         rings_.end());
+        }
+        if (records == 0)
+        {
+            return 0;
+        }
+
+        // writev may write part of the batch - resume where it stopped
+        iovec *next = iov;
+        int left = static_cast<int>(records);
+        while (bytes > 0)
+        {
+            ssize_t const written = writev(fd_, next, left);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                // The sink is gone - count what is left of the batch as dropped
+                std::size_t lost = 0;
+                for (int i = 0; i < left; ++i)
+                {
+                    lost += next[i].iov_len > 0;
+                }
+                dropped_.fetch_add(lost, std::memory_order_relaxed);
+                break;
+            }
+            bytes -= static_cast<std::size_t>(written);
+            std::size_t consumed = static_cast<std::size_t>(written);
+            while (left > 0 && consumed >= next->iov_len)
+            {
+                consumed -= next->iov_len;
+                ++next;
+                --left;
+            }
+            if (left > 0)
+            {
+                next->iov_base = static_cast<char *>(next->iov_base) + consumed;
+                next->iov_len -= consumed;
+            }
+        }
+
+        for (std::size_t i = 0; i < rings.size(); ++i)
+        {
+            rings[i]->tail_.store(tails[i], std::memory_order_release);
+        }
+        return records;
+    }
+#else
+    AsyncLogWriter::AsyncLogWriter(std::filesystem::path const &, std::size_t const ring_size)
+        : id_{next_writer_id_++}, ring_size_{ring_size}, fd_{-1}, owns_fd_{false},
+          dropped_{0}, stop_{false}, mutex_{}, stop_cv_{}, rings_{}, thread_{}
+    {
+        throw std::runtime_error{"Asynchronous logging is only supported on Linux"};
+    }
+
+    AsyncLogWriter::~AsyncLogWriter()
+    {
+    }
+
+    bool AsyncLogWriter::push(std::string_view const) noexcept
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    char *AsyncLogWriter::claim(std::size_t const) noexcept
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    void AsyncLogWriter::commit() noexcept
+    {
+    }
+
+    std::uint64_t AsyncLogWriter::get_dropped() const noexcept
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    std::size_t AsyncLogWriter::get_rings() noexcept
+    {
+        return 0;
+    }
+
+    LogRing *AsyncLogWriter::thread_ring_()
+    {
+        return nullptr;
+    }
+
+    void AsyncLogWriter::run_() noexcept
+    {
+    }
+
+    std::size_t AsyncLogWriter::drain_() noexcept
+    {
+        return 0;
+    }
+#endif
+} // namespace common::logging
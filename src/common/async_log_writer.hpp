@@ -0,0 +1,171 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace common::logging
+{
+    /**
+     * Bounded single producer single consumer ring of variable sized log records.
+     *
+     * Records are stored contiguously as a 32 bit length followed by the record bytes so
+     * that the consumer can hand them to writev without copying them again.
+     */
+    class LogRing
+    {
+    public:
+        /**
+         * Allocates the ring
+         *
+         * @param[in] capacity Size of the ring in bytes (rounded up to a power of two)
+         */
+        explicit LogRing(std::size_t const capacity);
+
+        /**
+         * Copies a record into the ring - only called by the owning thread
+         *
+         * @param[in] record The formatted record
+         * @return False if the ring does not have room for the record
+         */
+        bool push(std::string_view const record) noexcept;
+        /**
+         * Reserves room for a record so that it is written in place - only called by the owning thread
+         *
+         * @param[in] length Length of the record
+         * @return Where to write the record or nullptr if the ring does not have room for it
+         */
+        char *claim(std::size_t const length) noexcept;
+        /**
+         * Publishes the record written into the room claimed last
+         */
+        void commit() noexcept;
+
+        /**
+         * Marks the ring as abandoned by its thread, the writer frees it once drained
+         */
+        void retire() noexcept;
+
+    private:
+        friend class AsyncLogWriter;
+
+        std::size_t const capacity_;
+        std::unique_ptr<char[]> buffer_;
+        // Write position, owned by the producer
+        alignas(64) std::atomic<std::uint64_t> head_;
+        // Last read position seen by the producer
+        std::uint64_t cached_tail_;
+        // Write position past the claimed record, owned by the producer
+        std::uint64_t claimed_head_;
+        // Read position, owned by the consumer
+        alignas(64) std::atomic<std::uint64_t> tail_;
+        // Set once the producer pushed its last record
+        std::atomic_bool retired_;
+    };
+
+    /**
+     * Background writer draining the log rings of every logging thread.
+     *
+     * Each thread that logs gets its own ring on its first record, so producers never
+     * contend with each other or wait on the sink. The ring is freed once drained after its
+     * thread exits. A single thread collects the pending
+     * records of all rings and writes them with one writev per batch. When a ring is full
+     * the record is dropped and counted instead of blocking the caller. Records of different
+     * threads are not ordered with respect to each other.
+     */
+    class AsyncLogWriter
+    {
+    public:
+        /**
+         * Opens the sink and starts the writer thread
+         *
+         * @param[in] file_path The file to log to (empty to log to the console)
+         * @param[in] ring_size Size in bytes of the ring of each logging thread
+         * @throw std::runtime_error If the file could not be opened or the platform is not supported
+         */
+        AsyncLogWriter(std::filesystem::path const &file_path, std::size_t const ring_size);
+        /// Writes the pending records, stops the writer thread and closes the sink
+        ~AsyncLogWriter();
+
+        AsyncLogWriter(AsyncLogWriter const &) = delete;
+        AsyncLogWriter &operator=(AsyncLogWriter const &) = delete;
+
+        /**
+         * Queues a record from the calling thread
+         *
+         * @param[in] record The formatted record including its trailing newline
+         * @return False if the record was dropped
+         */
+        bool push(std::string_view const record) noexcept;
+        /**
+         * Reserves room for a record in the ring of the calling thread, so that it is formatted in place
+         *
+         * @param[in] length Length of the record including its trailing newline
+         * @return Where to write the record or nullptr if it was dropped
+         */
+        char *claim(std::size_t const length) noexcept;
+        /**
+         * Queues the record written into the room claimed last by the calling thread
+         */
+        void commit() noexcept;
+
+        /**
+         * Number of records dropped because a ring was full or the sink failed
+         * @return The number of dropped records
+         */
+        std::uint64_t get_dropped() const noexcept;
+
+        /**
+         * Number of rings held for logging threads
+         * @return The number of rings
+         */
+        std::size_t get_rings() noexcept;
+
+    private:
+        // Returns the ring of the calling thread, creating it on first use
+        LogRing *thread_ring_();
+        // Writer thread
+        void run_() noexcept;
+        // Writes every pending record and returns the number of records written
+        std::size_t drain_() noexcept;
+
+        // Distinguishes writers so that threads notice when their cached ring is stale
+        std::uint64_t const id_;
+        std::size_t const ring_size_;
+        int fd_;
+        bool owns_fd_;
+        std::atomic<std::uint64_t> dropped_;
+        std::atomic_bool stop_;
+        // Protects rings_ and wakes the writer thread on stop
+        std::mutex mutex_;
+        std::condition_variable stop_cv_;
+        std::vector<std::shared_ptr<LogRing>> rings_;
+        std::thread thread_;
+    };
+} // namespace common::logging
@@ -0,0 +1,430 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdexcept>
+
+#include "ip_address.hpp"
+
+#define IPV4_BITS 32
+#define IPV6_BITS 128
+// Leading bits of the ::ffff:0:0/96 block holding the IPv4-mapped addresses
+#define IPV4_MAPPED_BITS (IPV6_BITS - IPV4_BITS)
+// Lowest bit of the ffff mapping marker in the low half of an address
+#define IPV4_MAPPED_MARKER_BIT (1ULL << IPV4_BITS)
+#define IPV6_GROUPS 8
+// Separator of the items of a prefix list
+#define PREFIX_LIST_SEPARATOR ','
+
+namespace common::utils
+{
+    namespace
+    {
+        /**
+         * Parses a decimal number without sign or leading zeros
+         *
+         * @param[in] str The digits
+         * @param[in] max The largest accepted value
+         * @param[out] value The parsed value
+         * @return False if the string is not a number up to max
+         */
+        bool parse_decimal_(std::string_view const str, unsigned int const max, unsigned int *value) noexcept
+        {
+            if (str.empty() || str.size() > 3 || (str.size() > 1 && str[0] == '0'))
+            {
+                return false;
+            }
+            unsigned int result = 0;
+            for (char const c : str)
+            {
+                if (c < '0' || c > '9')
+                {
+                    return false;
+                }
+                result = result * 10 + static_cast<unsigned int>(c - '0');
+            }
+            *value = result;
+            return result <= max;
+        }
+
+        /**
+         * Parses a dotted IPv4 address
+         *
+         * @param[in] str The address
+         * @param[out] addr The address in host byte order
+         * @return False if the string is not a valid IPv4 address
+         */
+        bool parse_ipv4_(std::string_view str, std::uint32_t *addr) noexcept
+        {
+            std::uint32_t result = 0;
+            for (int octet = 0; octet < 4; ++octet)
+            {
+                std::size_t const dot = str.find('.');
+                if ((octet < 3) == (dot == std::string_view::npos))
+                {
+                    return false;
+                }
+                unsigned int value = 0;
+                if (!parse_decimal_(str.substr(0, dot), 255, &value))
+                {
+                    return false;
+                }
+                result = (result << 8) | value;
+                str.remove_prefix(octet < 3 ? dot + 1 : str.size());
+            }
+            *addr = result;
+            return true;
+        }
+
+        /**
+         * Parses a group of up to 4 hex digits
+         *
+         * @param[in] str The digits
+         * @param[out] value The parsed group
+         * @return False if the string is not a valid group
+         */
+        bool parse_hex_group_(std::string_view const str, std::uint16_t *value) noexcept
+        {
+            if (str.empty() || str.size() > 4)
+            {
+                return false;
+            }
+            unsigned int result = 0;
+            for (char const c : str)
+            {
+                unsigned int digit;
+                if (c >= '0' && c <= '9')
+                {
+                    digit = static_cast<unsigned int>(c - '0');
+                }
+                else if (c >= 'a' && c <= 'f')
+                {
+                    digit = static_cast<unsigned int>(c - 'a' + 10);
+                }
+                else if (c >= 'A' && c <= 'F')
+                {
+                    digit = static_cast<unsigned int>(c - 'A' + 10);
+                }
+                else
+                {
+                    return false;
+                }
+                result = (result << 4) | digit;
+            }
+            *value = static_cast<std::uint16_t>(result);
+            return true;
+        }
+
+        /**
+         * Parses a textual IPv6 address, with '::' compression and an optional trailing dotted IPv4 part
+         *
+         * @param[in] str The address
+         * @param[out] addr The parsed address
+         * @return False if the string is not a valid IPv6 address
+         */
+        bool parse_ipv6_(std::string_view const str, IpAddress *addr) noexcept
+        {
+            std::uint16_t groups[IPV6_GROUPS] = {};
+            int count = 0;
+            // Index of the group the '::' stands in front of (-1 without compression)
+            int compress = -1;
+            std::size_t pos = 0;
+            if (str.substr(0, 2) == "::")
+            {
+                compress = 0;
+                pos = 2;
+            }
+            while (pos < str.size())
+            {
+                std::size_t end = str.find(':', pos);
+                if (end == std::string_view::npos)
+                {
+                    end = str.size();
+                }
+                std::string_view const token = str.substr(pos, end - pos);
+                // An embedded IPv4 address takes the last two groups
+                if (token.find('.') != std::string_view::npos)
+                {
+                    std::uint32_t ipv4 = 0;
+                    if (end != str.size() || count > IPV6_GROUPS - 2 || !parse_ipv4_(token, &ipv4))
+                    {
+                        return false;
+                    }
+                    groups[count++] = static_cast<std::uint16_t>(ipv4 >> 16);
+                    groups[count++] = static_cast<std::uint16_t>(ipv4);
+                    pos = end;
+                    break;
+                }
+                if (count == IPV6_GROUPS || !parse_hex_group_(token, &groups[count]))
+                {
+                    return false;
+                }
+                ++count;
+                pos = end;
+                if (pos == str.size())
+                {
+                    break;
+                }
+                // Skip the separator, a second one marks the compressed groups
+                ++pos;
+                if (pos < str.size() && str[pos] == ':')
+                {
+                    if (compress != -1)
+                    {
+                        return false;
+                    }
+                    compress = count;
+                    ++pos;
+                }
+                else if (pos == str.size())
+                {
+                    return false;
+                }
+            }
+            if (compress == -1 ? count != IPV6_GROUPS : count == IPV6_GROUPS)
+            {
+                return false;
+            }
+
+            // Move the groups following '::' to the end
+            std::uint16_t expanded[IPV6_GROUPS] = {};
+            int const tail = compress == -1 ? 0 : count - compress;
+            for (int i = 0; i < count - tail; ++i)
+            {
+                expanded[i] = groups[i];
+            }
+            for (int i = 0; i < tail; ++i)
+            {
+                expanded[IPV6_GROUPS - tail + i] = groups[compress + i];
+            }
+            IpAddress result;
+            for (int i = 0; i < IPV6_GROUPS; ++i)
+            {
+                std::uint64_t &word = i < 4 ? result.high : result.low;
+                word = (word << 16) | expanded[i];
+            }
+            *addr = result;
+            return true;
+        }
+    } // namespace
+
+    IpAddress IpAddress::from_bytes(std::array<std::uint8_t, 16> const &bytes) noexcept
+    {
+        IpAddress addr;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            addr.high = (addr.high << 8) | bytes[i];
+            addr.low = (addr.low << 8) | bytes[8 + i];
+        }
+        return addr;
+    }
+
+    std::array<std::uint8_t, 16> IpAddress::to_bytes() const noexcept
+    {
+        std::array<std::uint8_t, 16> bytes{};
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            bytes[i] = static_cast<std::uint8_t>(high >> (56 - 8 * i));
+            bytes[8 + i] = static_cast<std::uint8_t>(low >> (56 - 8 * i));
+        }
+        return bytes;
+    }
+
+    std::optional<IpPrefix> IpPrefix::create(IpAddress const &address, unsigned int const length) noexcept
+    {
+        unsigned int family_length = length;
+        // An IPv6 length on an IPv4-mapped address (::ffff:0:0/96 and longer) counts the mapping bits
+        if (address.is_ipv4() && length >= IPV4_MAPPED_BITS)
+        {
+            family_length = length - IPV4_MAPPED_BITS;
+        }
+        if (family_length > (address.is_ipv4() ? IPV4_BITS : IPV6_BITS))
+        {
+            return std::nullopt;
+        }
+        // IPv4 prefixes also cover the ::ffff: mapping bits
+        unsigned int const bits = address.is_ipv4() ? IPV4_MAPPED_BITS + family_length : family_length;
+        IpPrefix prefix;
+        prefix.length = static_cast<std::uint8_t>(family_length);
+        prefix.mask_high_ = bits >= 64 ? ~0ULL : (bits == 0 ? 0 : ~0ULL << (64 - bits));
+        prefix.mask_low_ = bits <= 64 ? 0 : (bits == IPV6_BITS ? ~0ULL : ~0ULL << (IPV6_BITS - bits));
+        prefix.address.high = address.high & prefix.mask_high_;
+        prefix.address.low = address.low & prefix.mask_low_;
+        return prefix;
+    }
+
+    IpPrefix IpPrefix::host(IpAddress const &address) noexcept
+    {
+        return *create(address, address.is_ipv4() ? IPV4_BITS : IPV6_BITS);
+    }
+
+    std::optional<IpAddress> parse_ip_addr(std::string_view const str) noexcept
+    {
+        IpAddress addr;
+        if (str.find(':') != std::string_view::npos)
+        {
+            if (!parse_ipv6_(str, &addr))
+            {
+                return std::nullopt;
+            }
+            return addr;
+        }
+        std::uint32_t ipv4 = 0;
+        if (!parse_ipv4_(str, &ipv4))
+        {
+            return std::nullopt;
+        }
+        return IpAddress::from_ipv4(ipv4);
+    }
+
+    std::optional<IpPrefix> parse_ip_prefix(std::string_view const str) noexcept
+    {
+        std::size_t const slash = str.find('/');
+        std::string_view const address = str.substr(0, slash);
+        std::optional<IpAddress> addr = parse_ip_addr(address);
+        if (!addr)
+        {
+            return std::nullopt;
+        }
+        if (slash == std::string_view::npos)
+        {
+            return IpPrefix::host(*addr);
+        }
+        unsigned int length = 0;
+        if (!parse_decimal_(str.substr(slash + 1), IPV6_BITS, &length))
+        {
+            return std::nullopt;
+        }
+        if (address.find(':') == std::string_view::npos)
+        {
+            // Dotted addresses only take IPv4 lengths
+            if (length > IPV4_BITS)
+            {
+                return std::nullopt;
+            }
+        }
+        else if (addr->is_ipv4() && length < IPV4_MAPPED_BITS)
+        {
+            // The prefix ends inside the mapping marker, so the network is wider than the IPv4 space
+            addr->low &= ~IPV4_MAPPED_MARKER_BIT;
+        }
+        return IpPrefix::create(*addr, length);
+    }
+
+    std::vector<IpPrefix> parse_ip_prefix_list(std::string_view str)
+    {
+        std::vector<IpPrefix> prefixes;
+        while (true)
+        {
+            std::size_t const separator = str.find(PREFIX_LIST_SEPARATOR);
+            std::string_view item = str.substr(0, separator);
+            // Spaces around the items are allowed
+            while (!item.empty() && item.front() == ' ')
+            {
+                item.remove_prefix(1);
+            }
+            while (!item.empty() && item.back() == ' ')
+            {
+                item.remove_suffix(1);
+            }
+            std::optional<IpPrefix> const prefix = parse_ip_prefix(item);
+            if (!prefix)
+            {
+                throw std::invalid_argument{"'" + std::string{item} + "' is not a valid IP address or CIDR range"};
+            }
+            prefixes.push_back(*prefix);
+            if (separator == std::string_view::npos)
+            {
+                break;
+            }
+            str.remove_prefix(separator + 1);
+        }
+        return prefixes;
+    }
+
+    std::string to_string(IpAddress const &addr)
+    {
+        if (addr.is_ipv4())
+        {
+            std::uint32_t const ipv4 = addr.to_ipv4();
+            return std::to_string(ipv4 >> 24) + "." + std::to_string((ipv4 >> 16) & 0xFF) + "." +
+                   std::to_string((ipv4 >> 8) & 0xFF) + "." + std::to_string(ipv4 & 0xFF);
+        }
+
+        std::uint16_t groups[IPV6_GROUPS];
+        for (int i = 0; i < IPV6_GROUPS; ++i)
+        {
+            std::uint64_t const word = i < 4 ? addr.high : addr.low;
+            groups[i] = static_cast<std::uint16_t>(word >> (48 - 16 * (i % 4)));
+        }
+        // The longest run of at least two zero groups is compressed (RFC 5952)
+        int best_start = -1;
+        int best_length = 1;
+        for (int i = 0; i < IPV6_GROUPS;)
+        {
+            int run = 0;
+            while (i + run < IPV6_GROUPS && groups[i + run] == 0)
+            {
+                ++run;
+            }
+            if (run > best_length)
+            {
+                best_start = i;
+                best_length = run;
+            }
+            i += run > 0 ? run : 1;
+        }
+
+        static char const digits[] = "0123456789abcdef";
+        std::string str;
+        for (int i = 0; i < IPV6_GROUPS; ++i)
+        {
+            if (i == best_start)
+            {
+                str += "::";
+                i += best_length - 1;
+                continue;
+            }
+            if (!str.empty() && str.back() != ':')
+            {
+                str += ':';
+            }
+            bool leading = true;
+            for (int shift = 12; shift >= 0; shift -= 4)
+            {
+                unsigned int const digit = (groups[i] >> shift) & 0xF;
+                if (digit != 0 || !leading || shift == 0)
+                {
+                    str += digits[digit];
+                    leading = false;
+                }
+            }
+        }
+        return str;
+    }
+
+    std::string to_string(IpPrefix const &prefix)
+    {
+        std::string str = to_string(prefix.address);
+        if (prefix.length != (prefix.address.is_ipv4() ? IPV4_BITS : IPV6_BITS))
+        {
+            str += "/" + std::to_string(prefix.length);
+        }
+        return str;
+    }
+} // namespace common::utils
@@ -0,0 +1,196 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace common::utils
+{
+    /**
+     * Packed IPv4 or IPv6 address.
+     *
+     * The address is kept as a 128 bit number split in two words so that comparing and
+     * masking addresses are plain integer operations. IPv4 addresses are stored as
+     * IPv4-mapped IPv6 addresses (::ffff:a.b.c.d).
+     */
+    struct IpAddress
+    {
+        // Most significant 64 bits of the address
+        std::uint64_t high = 0;
+        // Least significant 64 bits of the address
+        std::uint64_t low = 0;
+
+        /**
+         * Creates an IPv4 address
+         *
+         * @param[in] addr The address in host byte order
+         * @return The packed address
+         */
+        static constexpr IpAddress from_ipv4(std::uint32_t const addr) noexcept
+        {
+            return IpAddress{0, 0x0000FFFF00000000ULL | addr};
+        }
+        /**
+         * Creates an address from its 16 bytes in network byte order
+         *
+         * @param[in] bytes The address bytes
+         * @return The packed address
+         */
+        static IpAddress from_bytes(std::array<std::uint8_t, 16> const &bytes) noexcept;
+
+        /**
+         * Determines if the address is an IPv4 address
+         * @return True if the address is IPv4-mapped
+         */
+        constexpr bool is_ipv4() const noexcept
+        {
+            return high == 0 && (low >> 32) == 0x0000FFFF;
+        }
+        /**
+         * The IPv4 address (only meaningful if is_ipv4())
+         * @return The address in host byte order
+         */
+        constexpr std::uint32_t to_ipv4() const noexcept
+        {
+            return static_cast<std::uint32_t>(low);
+        }
+        /**
+         * The 16 bytes of the address in network byte order
+         * @return The address bytes
+         */
+        std::array<std::uint8_t, 16> to_bytes() const noexcept;
+
+        constexpr bool operator==(IpAddress const &other) const noexcept
+        {
+            return high == other.high && low == other.low;
+        }
+        constexpr bool operator!=(IpAddress const &other) const noexcept
+        {
+            return !(*this == other);
+        }
+        constexpr bool operator<(IpAddress const &other) const noexcept
+        {
+            return high != other.high ? high < other.high : low < other.low;
+        }
+    };
+
+    /**
+     * IPv4 or IPv6 network given by an address and a prefix length (CIDR notation)
+     */
+    struct IpPrefix
+    {
+        // Network address, bits past the prefix are always zero
+        IpAddress address;
+        // Prefix length in bits of the address family (0-32 for IPv4, 0-128 for IPv6)
+        std::uint8_t length = 0;
+
+        /**
+         * Creates a prefix, clearing the address bits past the prefix
+         *
+         * An IPv4 address also takes the IPv6 lengths of its mapped form (96-128, e.g. ::ffff:0:0/96 is 0.0.0.0/0).
+         *
+         * @param[in] address Any address of the network
+         * @param[in] length Prefix length in bits of the address family
+         * @return The prefix or std::nullopt if the length is too long for the family
+         */
+        static std::optional<IpPrefix> create(IpAddress const &address, unsigned int const length) noexcept;
+        /**
+         * Creates the prefix matching a single address
+         *
+         * @param[in] address The address
+         * @return The host prefix (/32 or /128)
+         */
+        static IpPrefix host(IpAddress const &address) noexcept;
+
+        /**
+         * Determines if the prefix contains an address
+         *
+         * @param[in] addr The address to check
+         * @return True if the address is part of the network
+         */
+        bool contains(IpAddress const &addr) const noexcept
+        {
+            return (addr.high & mask_high_) == address.high && (addr.low & mask_low_) == address.low;
+        }
+
+        bool operator==(IpPrefix const &other) const noexcept
+        {
+            return address == other.address && length == other.length;
+        }
+        bool operator!=(IpPrefix const &other) const noexcept
+        {
+            return !(*this == other);
+        }
+
+    private:
+        // Network mask over the 128 bit representation, kept so that matching is two AND and compares
+        std::uint64_t mask_high_ = 0;
+        std::uint64_t mask_low_ = 0;
+    };
+
+    /**
+     * Parses a dotted IPv4 or a textual IPv6 address (RFC 4291) without allocating
+     *
+     * @param[in] str The address to parse
+     * @return The address or std::nullopt if the string is not a valid address
+     */
+    std::optional<IpAddress> parse_ip_addr(std::string_view const str) noexcept;
+
+    /**
+     * Parses an address with an optional prefix length (e.g. 10.0.0.0/8 or 2001:db8::/32)
+     *
+     * An address without a prefix length is a host prefix. Bits past the prefix are cleared. IPv4-mapped
+     * addresses in IPv6 notation take IPv6 lengths, ::ffff:10.0.0.0/104 is 10.0.0.0/8.
+     *
+     * @param[in] str The prefix to parse
+     * @return The prefix or std::nullopt if the string is not a valid prefix
+     */
+    std::optional<IpPrefix> parse_ip_prefix(std::string_view const str) noexcept;
+
+    /**
+     * Parses a comma separated list of addresses and prefixes
+     *
+     * @param[in] str The list to parse
+     * @return The prefixes in the order of the list
+     * @throw std::invalid_argument If the list is empty or one of its items is not a valid prefix
+     */
+    std::vector<IpPrefix> parse_ip_prefix_list(std::string_view const str);
+
+    /**
+     * Formats an address (dotted IPv4 or RFC 5952 IPv6)
+     *
+     * @param[in] addr The address to format
+     * @return The textual address
+     */
+    std::string to_string(IpAddress const &addr);
+
+    /**
+     * Formats a prefix, omitting the length of host prefixes
+     *
+     * @param[in] prefix The prefix to format
+     * @return The textual prefix
+     */
+    std::string to_string(IpPrefix const &prefix);
+} // namespace common::utils
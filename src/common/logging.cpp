@@ -16,22 +16,33 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <time.h>
-#include <string.h>
 #include <atomic>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <stdexcept>
 #include <memory>
-#include <sstream>
-#include <chrono>
+#include <string_view>
 #include <iostream>
 #include <algorithm>
+#include <mutex>
 
-
+#include "async_log_writer.hpp"
 #include "logging.hpp"
+#include "timing.hpp"
+
+// Size in bytes of the buffer of every thread logging asynchronously
+#define ASYNC_LOG_RING_SIZE (1 << 20)
+// Room for the decimal digits of a source line number
+#define LOG_LINE_DIGITS 20
+
+// Threshold while the logger is not set - above every severity
+#define LOG_THRESHOLD_DISABLED (static_cast<int>(LogSeverity::Error) + 1)
 
 namespace common::logging
 {
+    std::atomic_int g_log_threshold{LOG_THRESHOLD_DISABLED};
+
     namespace
     {
         // Internal state of the logger
@@ -40,12 +51,53 @@ namespace common::logging
             // Keeps track of initialization state
             std::atomic_bool initialized;
             // Max severity level to log
-            LogSeverity max_severity;
+            std::atomic<LogSeverity> max_severity;
             // File stream for outputting to a file
             std::unique_ptr<std::ofstream> fstream;
+            // Serializes writes from concurrent threads and the switches of the sinks
+            std::mutex output_mutex;
+            // Background writer when logging asynchronously, only accessed with the atomic functions
+            // so that a thread logging keeps the writer alive while set_logger replaces it
+            std::shared_ptr<AsyncLogWriter> async_writer;
         } LoggerInternals;
 
-        LoggerInternals internals_{false, LogSeverity::Unknown, {}};
+        LoggerInternals internals_{false, LogSeverity::Unknown, {}, {}, {}};
+
+        /**
+         * Queues a line to the background writer when logging asynchronously
+         *
+         * The line is formatted straight into the ring of the calling thread.
+         *
+         * @param[in] pieces The pieces of the line, written one after the other
+         * @return False if there is no background writer
+         */
+        template <std::size_t N>
+        bool write_async_(std::string_view const (&pieces)[N]) noexcept
+        {
+            std::shared_ptr<AsyncLogWriter> const async_writer = std::atomic_load(&internals_.async_writer);
+            if (!async_writer)
+            {
+                return false;
+            }
+            // Trailing newline
+            std::size_t length = 1;
+            for (std::string_view const piece : pieces)
+            {
+                length += piece.size();
+            }
+            // A full ring drops the line, the writer counts it
+            if (char *slot = async_writer->claim(length))
+            {
+                for (std::string_view const piece : pieces)
+                {
+                    std::memcpy(slot, piece.data(), piece.size());
+                    slot += piece.size();
+                }
+                *slot = '\n';
+                async_writer->commit();
+            }
+            return true;
+        }
 
         /**
          * Transforms a logging severity to a string
@@ -53,28 +105,21 @@ namespace common::logging
          * @param[in] log_severity The severity to convert to a string
          * @return The string equivalent of the logging severity
          */
-        std::string
-        log_severity_to_str_(LogSeverity const &log_severity)
+        char const *log_severity_to_str_(LogSeverity const &log_severity) noexcept
         {
-            std::string log_severity_str;
             switch (log_severity)
             {
             case LogSeverity::Debug:
-                log_severity_str = "DEBUG";
-                break;
+                return "DEBUG";
             case LogSeverity::Info:
-                log_severity_str = "INFO";
-                break;
+                return "INFO";
             case LogSeverity::Warning:
-                log_severity_str = "WARNING";
-                break;
+                return "WARNING";
             case LogSeverity::Error:
-                log_severity_str = "ERROR";
-                break;
+                return "ERROR";
             default:
-                log_severity_str = "UNKNOWN";
+                return "UNKNOWN";
             }
-            return log_severity_str;
         }
 
         /**
@@ -107,17 +152,40 @@ namespace common::logging
         }
 
         /**
-         * Parses a formatted logging string into its respective file path and log severity
+         * Transforms a string to a logging mode
+         * 
+         * @param[in] log_mode_str The string to convert to a LogMode
+         * @return The LogMode equivalent of the string
+         * @throw std::invalid_argument If the string is not a logging mode
+         * @see LogMode
+         */
+        LogMode str_to_log_mode_(std::string const &log_mode_str)
+        {
+            if (log_mode_str == "sync")
+            {
+                return LogMode::Synchronous;
+            }
+            else if (log_mode_str == "async")
+            {
+                return LogMode::Asynchronous;
+            }
+            throw std::invalid_argument{"Invalid logging mode '" + log_mode_str + "' - Expected 'sync' or 'async'"};
+        }
+
+        /**
+         * Parses a formatted logging string into its respective file path, log severity and log mode
          * 
          * @param[in] formatted_logging_str The string to convert to a LogSeverity
          * @param[out] file_path The file path parsed from the formatted logging string
          * @param[out] log_severity The logging severity parsed from the formatted logging string
+         * @param[out] log_mode The logging mode parsed from the formatted logging string
          * @throw std::invalid_argument If the logging string is formatted incorrectly
          */
-        void parse_formatted_log_string_(std::string const &formatted_logging_str, std::filesystem::path *file_path, LogSeverity *log_severity)
+        void parse_formatted_log_string_(std::string const &formatted_logging_str, std::filesystem::path *file_path,
+                                         LogSeverity *log_severity, LogMode *log_mode)
         {
             // This should never happen unless the developer makes a mistake
-            if (!file_path || !log_severity)
+            if (!file_path || !log_severity || !log_mode)
             {
                 throw std::invalid_argument{"At least one logging parameter must not be null"};
             }
@@ -125,7 +193,7 @@ namespace common::logging
             size_t delimiter_index = formatted_logging_str.find(":");
             if (delimiter_index == std::string::npos)
             {
-                throw std::invalid_argument{"Logging string formatted incorrectly - Expected '<optional_logging_path>:<logging_severity>'"};
+                throw std::invalid_argument{"Logging string formatted incorrectly - Expected '<optional_logging_path>:<logging_severity>[:<sync|async>]'"};
             }
             // First index is the logging file, second index is the severity
             if (delimiter_index > 0)
@@ -135,12 +203,22 @@ namespace common::logging
             std::string log_severity_str = formatted_logging_str.substr(delimiter_index + 1, formatted_logging_str.size());
             std::transform(log_severity_str.begin(), log_severity_str.end(),
                            log_severity_str.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+            // Optional third field selects the logging mode
+            std::string log_mode_str = "sync";
+            size_t const mode_delimiter_index = log_severity_str.find(":");
+            if (mode_delimiter_index != std::string::npos)
+            {
+                log_mode_str = log_severity_str.substr(mode_delimiter_index + 1);
+                log_severity_str.resize(mode_delimiter_index);
+            }
 
             LOG_DEBUG << "[LOGGING] = " << formatted_logging_str
                       << "; [FILE_PATH] = " << file_path->u8string()
-                      << "; [SEVERITY] = " << log_severity_str;
+                      << "; [SEVERITY] = " << log_severity_str
+                      << "; [MODE] = " << log_mode_str;
 
             *log_severity = str_to_log_severity_(log_severity_str);
+            *log_mode = str_to_log_mode_(log_mode_str);
         }
     } // namespace
 
@@ -151,7 +229,7 @@ namespace common::logging
     }
 #else
     LogEntry::LogEntry(LogSeverity const &entry_severity,
-                       long const &line, std::string const &function)
+                       long const &line, char const *function)
         : entry_severity_{entry_severity}, entry_{""}, line_{line}, function_{function}
     {
     }
@@ -165,40 +243,42 @@ namespace common::logging
         }
     }
 
-    #define TIME_SIZE 26
     void LogEntry::log_entry_()
     {
         if (entry_severity_ >= internals_.max_severity)
         {
-            std::stringstream fmt;
-            time_t const sys_time = std::chrono::system_clock::to_time_t(
-                std::chrono::system_clock::now());
-            char time[TIME_SIZE];
-            ctime_s(time, sizeof(time), &sys_time);
-            // Remove the \n
-            time[strlen(time) - 1] = '\0';
-            fmt << "[" << time;
+            std::string_view const timestamp = timing::local_timestamp();
+            std::string_view const severity = log_severity_to_str_(entry_severity_);
 #ifdef NDEBUG
             // "[%TimeStamp%] %LogSeverity% - %Message%"
-            fmt << "] ";
+            std::string_view const pieces[] = {"[", timestamp, "] ", severity, " - ", entry_};
 #else
             // "[%TimeStamp%:%Function%:%Line%] %LogSeverity% - %Message%"
-            fmt << ":" << function_ << "():" << line_ << "] ";
+            char line_digits[LOG_LINE_DIGITS];
+            char const *const line_end = std::to_chars(line_digits, line_digits + sizeof(line_digits), line_).ptr;
+            std::string_view const pieces[] = {"[", timestamp, ":", function_, "():",
+                                               std::string_view{line_digits, static_cast<std::size_t>(line_end - line_digits)},
+                                               "] ", severity, " - ", entry_};
 #endif
-            fmt << log_severity_to_str_(entry_severity_) << " - " << entry_;
 
-            // Log to file
-            if (internals_.fstream)
-            {
-                *internals_.fstream << fmt.str() << std::endl;
-            }
-            // Log to console
-            else
+            // Queue to the background writer
+            if (!write_async_(pieces))
             {
-                std::cout << fmt.str() << std::endl;
+                std::lock_guard<std::mutex> const lock{internals_.output_mutex};
+                // The logger may have switched to a background writer since the check above
+                if (!write_async_(pieces))
+                {
+                    // Log to file or to console
+                    std::ostream &out = internals_.fstream ? *internals_.fstream : std::cout;
+                    for (std::string_view const piece : pieces)
+                    {
+                        out << piece;
+                    }
+                    out << std::endl;
+                }
             }
         }
-        entry_ = "";
+        entry_.clear();
     }
 
     LogEntry &LogEntry::operator<<(std::string const &str)
@@ -213,21 +293,9 @@ namespace common::logging
         return *this;
     }
 
-    LogEntry &LogEntry::operator<<(int const &num)
-    {
-        entry_.append(std::to_string(num));
-        return *this;
-    }
-
-    LogEntry &LogEntry::operator<<(double const &num)
-    {
-        entry_.append(std::to_string(num));
-        return *this;
-    }
-
-    LogEntry &LogEntry::operator<<(float const &num)
+    LogEntry &LogEntry::operator<<(char const *str)
     {
-        entry_.append(std::to_string(num));
+        entry_.append(str);
         return *this;
     }
 
@@ -248,7 +316,13 @@ namespace common::logging
         return internals_.initialized;
     }
 
-    void set_logger(std::filesystem::path const &file_path, LogSeverity const &max_severity)
+    std::uint64_t dropped_log_entries() noexcept
+    {
+        std::shared_ptr<AsyncLogWriter> const async_writer = std::atomic_load(&internals_.async_writer);
+        return async_writer ? async_writer->get_dropped() : 0;
+    }
+
+    void set_logger(std::filesystem::path const &file_path, LogSeverity const &max_severity, LogMode const &mode)
     {
         std::string file_path_str;
         try
@@ -276,29 +350,45 @@ namespace common::logging
         }
 
         internals_.max_severity = max_severity;
-        // File path means logging to a file
+        g_log_threshold = static_cast<int>(max_severity);
+        // The new sink is built completely before it replaces the current one
+        std::shared_ptr<AsyncLogWriter> async_writer;
+        std::unique_ptr<std::ofstream> fstream;
         if (!file_path.empty())
         {
             LOG_DEBUG << "Creating directories for " << file_path_str;
             std::filesystem::create_directories(file_path.parent_path());
+        }
+        if (mode == LogMode::Asynchronous)
+        {
+            async_writer = std::make_shared<AsyncLogWriter>(file_path, ASYNC_LOG_RING_SIZE);
+        }
+        // File path means logging to a file
+        else if (!file_path.empty())
+        {
             if (!std::filesystem::exists(file_path))
             {
                 LOG_DEBUG << "File at path '" << file_path_str << "' does not exist... Creating!";
-                std::ofstream empty_file;
-                empty_file.open(file_path, std::ios::out);
-                internals_.fstream = std::make_unique<std::ofstream>(std::move(empty_file));
             }
             else
             {
-                internals_.fstream = std::make_unique<std::ofstream>(file_path);
+                std::filesystem::resize_file(file_path, 0);
             }
+            // Appending, the lines the current sink writes to the same file until the switch stay in order
+            fstream = std::make_unique<std::ofstream>(file_path, std::ios::app);
         }
-        // No file path means log to console
-        else if (internals_.fstream)
+        // No file path and no background writer means log to console
+
+        // Both sinks are swapped at once so that every line goes to either the current or the new one
+        std::shared_ptr<AsyncLogWriter> previous;
         {
-            // Explicitly delete the internal raw pointer to log to console
-            internals_.fstream.reset();
+            std::lock_guard<std::mutex> const lock{internals_.output_mutex};
+            internals_.fstream.swap(fstream);
+            previous = std::atomic_exchange(&internals_.async_writer, std::move(async_writer));
         }
+        // Pending entries of a previous asynchronous logger are written now - by the last thread
+        // still pushing to it if any
+        previous.reset();
         internals_.initialized = true;
     }
 
@@ -308,8 +398,9 @@ namespace common::logging
         {
             std::filesystem::path path;
             LogSeverity severity = LogSeverity::Unknown;
-            parse_formatted_log_string_(formatted_log_str, &path, &severity);
-            set_logger(path, severity);
+            LogMode mode = LogMode::Synchronous;
+            parse_formatted_log_string_(formatted_log_str, &path, &severity, &mode);
+            set_logger(path, severity, mode);
         }
         catch (std::runtime_error const &e)
         {
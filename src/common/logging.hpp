@@ -18,21 +18,33 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <filesystem>
+#include <type_traits>
 
+// Lowest severity compiled into the binary (0: debug, 1: info, 2: warning, 3: error), see OVERWATCH_LOG_LEVEL
+#ifndef LOG_MIN_SEVERITY
+#define LOG_MIN_SEVERITY 0
+#endif
+
+// The severity is checked before the entry is built, so the streamed arguments of a
+// discarded entry are never evaluated
 #ifdef NDEBUG
-#define LOG_DEBUG common::logging::LogEntry(common::logging::LogSeverity::Debug)
-#define LOG_INFO common::logging::LogEntry(common::logging::LogSeverity::Info)
-#define LOG_WARNING common::logging::LogEntry(common::logging::LogSeverity::Warning)
-#define LOG_ERROR common::logging::LogEntry(common::logging::LogSeverity::Error)
+#define LOG_AT_(severity)                                           \
+    !common::logging::should_log(severity) ? static_cast<void>(0) \
+                                           : common::logging::LogVoidify{} & common::logging::LogEntry(severity)
 #else
 // Adding the line and function to debug logging output
-#define LOG_DEBUG common::logging::LogEntry(common::logging::LogSeverity::Debug, __LINE__, __func__)
-#define LOG_INFO common::logging::LogEntry(common::logging::LogSeverity::Info, __LINE__, __func__)
-#define LOG_WARNING common::logging::LogEntry(common::logging::LogSeverity::Warning, __LINE__, __func__)
-#define LOG_ERROR common::logging::LogEntry(common::logging::LogSeverity::Error, __LINE__, __func__)
+#define LOG_AT_(severity)                                           \
+    !common::logging::should_log(severity) ? static_cast<void>(0) \
+                                           : common::logging::LogVoidify{} & common::logging::LogEntry(severity, __LINE__, __func__)
 #endif
+#define LOG_DEBUG LOG_AT_(common::logging::LogSeverity::Debug)
+#define LOG_INFO LOG_AT_(common::logging::LogSeverity::Info)
+#define LOG_WARNING LOG_AT_(common::logging::LogSeverity::Warning)
+#define LOG_ERROR LOG_AT_(common::logging::LogSeverity::Error)
 
 namespace common::logging
 {
@@ -50,6 +62,36 @@ namespace common::logging
         Error
     };
 
+    /**
+     * Output modes of the logger.
+     * 
+     * Synchronous entries are written by the logging thread, asynchronous entries are
+     * queued and written by a background thread.
+     */
+    enum class LogMode
+    {
+        Synchronous,
+        Asynchronous
+    };
+
+    /**
+     * Lowest severity the logger currently outputs - read through should_log.
+     * Nothing is output until the logger is set.
+     */
+    extern std::atomic_int g_log_threshold;
+
+    /**
+     * Determines if entries of a severity are output, without building the entry.
+     * 
+     * @param[in] severity The severity of the entry
+     * @return True if the entry would be output
+     */
+    inline bool should_log(LogSeverity const severity) noexcept
+    {
+        return static_cast<int>(severity) >= LOG_MIN_SEVERITY &&
+               static_cast<int>(severity) >= g_log_threshold.load(std::memory_order_relaxed);
+    }
+
     typedef std::ostream &(*ostream_function)(std::ostream &);
     /**
      * Implementation of a logging entry for the logger.
@@ -73,9 +115,9 @@ namespace common::logging
          * 
          * @param[in] entry_severity The severity level that the log entry is associated with.
          * @param[in] line The current line where the log was written from.
-         * @param[in] func The function that the log is contained in.
+         * @param[in] function The function that the log is contained in (must outlive the entry).
          */
-        LogEntry(LogSeverity const &entry_severity, long const &line, std::string const &function);
+        LogEntry(LogSeverity const &entry_severity, long const &line, char const *function);
 #endif
         /// Destructor for log entry - Used to determine when the log entry is complete
         ~LogEntry();
@@ -96,27 +138,33 @@ namespace common::logging
          */
         LogEntry &operator<<(char const &c);
         /**
-         * Appends an int value to the log entry.
-         * 
-         * @param[in] num The int to append.
-         * @overload
-         */
-        LogEntry &operator<<(int const &num);
-        /**
-         * Appends a double value to the log entry.
+         * Appends a C string to the log entry.
          * 
-         * @param[in] num The double to append.
+         * @param[in] str The string to append.
          * @returns the ongoing LogEntry instance
          * @overload
          */
-        LogEntry &operator<<(double const &num);
+        LogEntry &operator<<(char const *str);
         /**
-         * Appends a float value to the log entry.
+         * Appends a numeric value of any arithmetic type to the log entry.
          * 
-         * @param[in] num The float to append.
+         * @param[in] num The number to append.
+         * @returns the ongoing LogEntry instance
          * @overload
          */
-        LogEntry &operator<<(float const &num);
+        template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+        LogEntry &operator<<(T const num)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                entry_.append(num ? "true" : "false");
+            }
+            else
+            {
+                entry_.append(std::to_string(num));
+            }
+            return *this;
+        }
         /**
          * Converts the log severity to a string
          * and appends a log severity to the log entry.
@@ -148,10 +196,19 @@ namespace common::logging
         // Line number of function call (used only in debug)
         long const line_;
         // Function name (used only in debug)
-        std::string const function_;
+        char const *const function_;
 #endif
     };
 
+    /**
+     * Gives the streamed log entry expression the void type of the other branch of LOG_AT_.
+     * Binds looser than operator<< so that the whole entry is streamed first.
+     */
+    struct LogVoidify
+    {
+        void operator&(LogEntry const &) const noexcept {}
+    };
+
     /**
      * Determines if the logger has been initialized.
      * 
@@ -161,9 +218,10 @@ namespace common::logging
     /**
      * Sets the logger to the specified formatter string
      * 
-     * @param[in] formatted_log_str A string that specifies the logging severity and file
+     * @param[in] formatted_log_str A string that specifies the logging severity, file and optional mode
      * @throw std::invalid_argument if the logger could not be initialized due to incorrect arguments
      * @example /path/to/file:severity
+     * @example /path/to/file:severity:async
      */
     void set_logger(std::string const &formatted_log_str);
     /**
@@ -171,7 +229,15 @@ namespace common::logging
      * 
      * @param[in] file_path A path to the file to output the logs
      * @param[in] max_severity The max severity of logs to output
+     * @param[in] mode Whether entries are written by the logging thread or in the background
      * @throw std::invalid_argument if the logger could not be initialized due to incorrect arguments
      */
-    void set_logger(std::filesystem::path const &file_path, LogSeverity const &max_severity);
+    void set_logger(std::filesystem::path const &file_path, LogSeverity const &max_severity,
+                    LogMode const &mode = LogMode::Synchronous);
+    /**
+     * Number of entries the asynchronous logger dropped because its buffers were full
+     * 
+     * @returns The number of dropped entries since the logger was set
+     */
+    std::uint64_t dropped_log_entries() noexcept;
 } // namespace common::logging
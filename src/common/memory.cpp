@@ -0,0 +1,319 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "memory.hpp"
+
+// Page size assumed where the system cannot be asked, and the largest alignment an arena grants
+#define MIN_PAGE_SIZE 4096
+// Size of the huge pages requested with MAP_HUGETLB (the default size on x86-64 and arm64)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+// Blocks of the per-thread arenas
+#define THREAD_ARENA_BLOCK_SIZE (256 * 1024)
+
+namespace common::memory
+{
+    namespace
+    {
+        /**
+         * Rounds a size up to a multiple of a power of two
+         *
+         * @param[in] size The size to round
+         * @param[in] multiple The power of two
+         * @return The rounded size
+         */
+        std::size_t round_up_(std::size_t const size, std::size_t const multiple) noexcept
+        {
+            return (size + multiple - 1) & ~(multiple - 1);
+        }
+
+        /**
+         * Size of the regular pages
+         *
+         * @return The page size in bytes
+         */
+        std::size_t page_size_() noexcept
+        {
+#ifdef _WIN32
+            return MIN_PAGE_SIZE;
+#else
+            static std::size_t const page_size = std::max<std::size_t>(MIN_PAGE_SIZE, static_cast<std::size_t>(sysconf(_SC_PAGESIZE)));
+            return page_size;
+#endif
+        }
+    } // namespace
+
+    Region::Region(std::size_t const size, bool const huge_pages) : data_{nullptr}, size_{0}, huge_pages_{false}
+    {
+        if (size == 0)
+        {
+            throw std::invalid_argument{"Memory regions must not be empty"};
+        }
+#ifdef _WIN32
+        (void)huge_pages;
+        size_ = round_up_(size, page_size_());
+        data_ = static_cast<std::uint8_t *>(::operator new(size_, std::align_val_t{MIN_PAGE_SIZE}));
+        std::memset(data_, 0, size_);
+#else
+#ifdef MAP_HUGETLB
+        if (huge_pages)
+        {
+            // Fails unless huge pages were reserved (vm.nr_hugepages)
+            std::size_t const huge_size = round_up_(size, HUGE_PAGE_SIZE);
+            void *data = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (data != MAP_FAILED)
+            {
+                data_ = static_cast<std::uint8_t *>(data);
+                size_ = huge_size;
+                huge_pages_ = true;
+                return;
+            }
+        }
+#endif
+        std::size_t const page_size = round_up_(size, page_size_());
+        void *data = mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            throw std::runtime_error{"Failed to map " + std::to_string(page_size) + " bytes - " + std::strerror(errno)};
+        }
+#ifdef MADV_HUGEPAGE
+        if (huge_pages && page_size >= HUGE_PAGE_SIZE)
+        {
+            // Let the kernel promote the region to transparent huge pages instead
+            madvise(data, page_size, MADV_HUGEPAGE);
+        }
+#endif
+        data_ = static_cast<std::uint8_t *>(data);
+        size_ = page_size;
+#endif
+    }
+
+    Region::~Region()
+    {
+        release_();
+    }
+
+    Region::Region(Region &&other) noexcept : data_{other.data_}, size_{other.size_}, huge_pages_{other.huge_pages_}
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    Region &Region::operator=(Region &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release_();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            huge_pages_ = other.huge_pages_;
+        }
+        return *this;
+    }
+
+    std::uint8_t *Region::data() const noexcept
+    {
+        return data_;
+    }
+
+    std::size_t Region::size() const noexcept
+    {
+        return size_;
+    }
+
+    bool Region::huge_pages() const noexcept
+    {
+        return huge_pages_;
+    }
+
+    void Region::release_() noexcept
+    {
+        if (data_)
+        {
+#ifdef _WIN32
+            ::operator delete(data_, std::align_val_t{MIN_PAGE_SIZE});
+#else
+            munmap(data_, size_);
+#endif
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    Arena::Arena(std::size_t const block_size, bool const huge_pages)
+        : block_size_{block_size}, huge_pages_{huge_pages}, current_{0}, offset_{0}, used_before_{0}, high_water_{0}
+    {
+        if (block_size == 0)
+        {
+            throw std::invalid_argument{"Arena blocks must not be empty"};
+        }
+    }
+
+    void *Arena::allocate(std::size_t const size, std::size_t const alignment)
+    {
+        if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > MIN_PAGE_SIZE)
+        {
+            throw std::invalid_argument{"Unsupported arena alignment " + std::to_string(alignment)};
+        }
+        if (current_ < blocks_.size())
+        {
+            std::size_t const start = round_up_(offset_, alignment);
+            if (start <= blocks_[current_].size() && size <= blocks_[current_].size() - start)
+            {
+                offset_ = start + size;
+                high_water_ = std::max(high_water_, used_before_ + offset_);
+                return blocks_[current_].data() + start;
+            }
+        }
+
+        // Blocks start on a page, so the allocation opens the next block whatever its alignment
+        std::size_t next = current_;
+        if (!blocks_.empty())
+        {
+            used_before_ += offset_;
+            ++next;
+        }
+        if (next == blocks_.size() || blocks_[next].size() < size)
+        {
+            blocks_.insert(blocks_.begin() + static_cast<std::ptrdiff_t>(next), Region{std::max(block_size_, size), huge_pages_});
+        }
+        current_ = next;
+        offset_ = size;
+        high_water_ = std::max(high_water_, used_before_ + offset_);
+        return blocks_[current_].data();
+    }
+
+    void Arena::reset() noexcept
+    {
+        current_ = 0;
+        offset_ = 0;
+        used_before_ = 0;
+    }
+
+    void Arena::release() noexcept
+    {
+        blocks_.clear();
+        reset();
+    }
+
+    Usage Arena::get_usage() const noexcept
+    {
+        std::size_t reserved = 0;
+        for (Region const &block : blocks_)
+        {
+            reserved += block.size();
+        }
+        return Usage{used_before_ + offset_, high_water_, reserved};
+    }
+
+    std::size_t Arena::get_blocks() const noexcept
+    {
+        return blocks_.size();
+    }
+
+    Arena &thread_arena()
+    {
+        thread_local Arena arena{THREAD_ARENA_BLOCK_SIZE};
+        return arena;
+    }
+
+    SlabPool::SlabPool(std::size_t const slot_size, std::size_t const slots_per_slab, std::size_t const max_slots,
+                       bool const huge_pages)
+        : slot_size_{round_up_(std::max(slot_size, sizeof(FreeSlot)), DEFAULT_ALIGNMENT)}, slots_per_slab_{slots_per_slab},
+          max_slots_{max_slots}, huge_pages_{huge_pages}, free_{nullptr}, fresh_{0}, slots_{0}, high_water_{0}, exhausted_{0}
+    {
+        if (slot_size == 0 || slots_per_slab == 0)
+        {
+            throw std::invalid_argument{"Slab pool slots and slabs must not be empty"};
+        }
+    }
+
+    void *SlabPool::allocate()
+    {
+        if (max_slots_ != 0 && slots_ >= max_slots_)
+        {
+            ++exhausted_;
+            return nullptr;
+        }
+        void *slot = nullptr;
+        if (free_)
+        {
+            slot = free_;
+            free_ = free_->next;
+        }
+        else
+        {
+            if (fresh_ == 0)
+            {
+                slabs_.emplace_back(slot_size_ * slots_per_slab_, huge_pages_);
+                // Rounding the slab to whole pages may leave room for a few more slots
+                fresh_ = slabs_.back().size() / slot_size_;
+            }
+            std::size_t const capacity = slabs_.back().size() / slot_size_;
+            slot = slabs_.back().data() + (capacity - fresh_) * slot_size_;
+            --fresh_;
+        }
+        ++slots_;
+        high_water_ = std::max(high_water_, slots_);
+        return slot;
+    }
+
+    void SlabPool::deallocate(void *const slot) noexcept
+    {
+        if (slot)
+        {
+            free_ = new (slot) FreeSlot{free_};
+            --slots_;
+        }
+    }
+
+    std::size_t SlabPool::get_slot_size() const noexcept
+    {
+        return slot_size_;
+    }
+
+    Usage SlabPool::get_usage() const noexcept
+    {
+        std::size_t reserved = 0;
+        for (Region const &slab : slabs_)
+        {
+            reserved += slab.size();
+        }
+        return Usage{slots_ * slot_size_, high_water_ * slot_size_, reserved};
+    }
+
+    std::size_t SlabPool::get_slots() const noexcept
+    {
+        return slots_;
+    }
+
+    std::uint64_t SlabPool::get_exhausted() const noexcept
+    {
+        return exhausted_;
+    }
+} // namespace common::memory
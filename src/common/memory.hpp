@@ -0,0 +1,405 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace common::memory
+{
+    // Alignment of allocations that do not ask for one
+    constexpr std::size_t DEFAULT_ALIGNMENT = alignof(std::max_align_t);
+
+    /**
+     * Memory accounting of an allocator
+     */
+    struct Usage
+    {
+        // Bytes handed out and not given back (or not reset)
+        std::size_t used;
+        // Highest value of used since the allocator was created
+        std::size_t high_water;
+        // Bytes obtained from the system
+        std::size_t reserved;
+    };
+
+    /**
+     * Contiguous block of memory mapped from the system, backed by huge pages when possible.
+     *
+     * Huge pages cut TLB misses on large, randomly accessed tables (flow tables, packet rings).
+     * Explicit huge pages (MAP_HUGETLB) are only available once the administrator reserved some,
+     * so mapping falls back to regular pages, which the kernel may still promote to transparent
+     * huge pages. The memory is zeroed and released with the region.
+     */
+    class Region
+    {
+    public:
+        /**
+         * Maps a region
+         *
+         * @param[in] size Bytes to map (rounded up to a whole number of pages)
+         * @param[in] huge_pages Try explicit huge pages first
+         * @throw std::invalid_argument If the size is zero
+         * @throw std::runtime_error If the memory could not be mapped
+         */
+        explicit Region(std::size_t const size, bool const huge_pages = true);
+        ~Region();
+
+        Region(Region &&other) noexcept;
+        Region &operator=(Region &&other) noexcept;
+        Region(Region const &) = delete;
+        Region &operator=(Region const &) = delete;
+
+        /**
+         * Start of the region (aligned on a page)
+         * @return The first byte
+         */
+        std::uint8_t *data() const noexcept;
+        /**
+         * Size of the region
+         * @return The size in bytes, a multiple of the page size
+         */
+        std::size_t size() const noexcept;
+        /**
+         * Determines if the region is backed by explicit huge pages
+         * @return True if MAP_HUGETLB succeeded
+         */
+        bool huge_pages() const noexcept;
+
+    private:
+        void release_() noexcept;
+
+        std::uint8_t *data_;
+        std::size_t size_;
+        bool huge_pages_;
+    };
+
+    /**
+     * Bump allocator.
+     *
+     * Allocating advances a cursor in the current block and freeing individual allocations is
+     * not possible: everything is given back at once by reset, which keeps the blocks for the
+     * next round. Suited to objects that live as long as a batch, a flow or a report.
+     *
+     * Not thread safe - every thread uses its own arena (see thread_arena).
+     */
+    class Arena
+    {
+    public:
+        /**
+         * Creates an arena, blocks are mapped on first use
+         *
+         * @param[in] block_size Size of the blocks requested from the system
+         * @param[in] huge_pages Back the blocks with huge pages when possible
+         * @throw std::invalid_argument If the block size is zero
+         */
+        explicit Arena(std::size_t const block_size, bool const huge_pages = false);
+
+        Arena(Arena &&) noexcept = default;
+        Arena &operator=(Arena &&) noexcept = default;
+        Arena(Arena const &) = delete;
+        Arena &operator=(Arena const &) = delete;
+
+        /**
+         * Allocates memory that stays valid until the next reset
+         *
+         * @param[in] size Bytes to allocate (allocations larger than a block get a block of their own)
+         * @param[in] alignment Alignment of the allocation (a power of two up to the page size)
+         * @return The allocation
+         * @throw std::invalid_argument If the alignment is not supported
+         * @throw std::runtime_error If a block could not be mapped
+         */
+        void *allocate(std::size_t const size, std::size_t const alignment = DEFAULT_ALIGNMENT);
+
+        /**
+         * Constructs an object in the arena.
+         *
+         * Destructors never run, so only trivially destructible types are accepted.
+         *
+         * @param[in] args Arguments of the constructor
+         * @return The object
+         */
+        template <typename T, typename... Args>
+        T *create(Args &&...args)
+        {
+            static_assert(std::is_trivially_destructible_v<T>, "Arena objects are never destroyed");
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        /**
+         * Gives every allocation back, keeping the blocks for the next allocations
+         */
+        void reset() noexcept;
+        /**
+         * Gives every allocation and every block back
+         */
+        void release() noexcept;
+
+        /**
+         * Memory accounting of the arena
+         * @return The bytes used (including alignment padding), their high-water mark and the bytes mapped
+         */
+        Usage get_usage() const noexcept;
+        /**
+         * Number of blocks mapped
+         * @return The number of blocks
+         */
+        std::size_t get_blocks() const noexcept;
+
+    private:
+        std::size_t block_size_;
+        bool huge_pages_;
+        std::vector<Region> blocks_;
+        // Block allocations are carved from, and the offset of its first free byte
+        std::size_t current_;
+        std::size_t offset_;
+        // Bytes used in the blocks before the current one
+        std::size_t used_before_;
+        std::size_t high_water_;
+    };
+
+    /**
+     * Arena of the calling thread, created on first use and released when the thread exits
+     *
+     * @return The arena
+     */
+    Arena &thread_arena();
+
+    /**
+     * Standard allocator carving from an arena, so containers can live in one.
+     *
+     * Deallocating is a no-op: the memory comes back when the arena is reset, which must not
+     * happen while a container still uses it.
+     *
+     * @tparam T Type of the allocated objects
+     */
+    template <typename T>
+    class ArenaAllocator
+    {
+    public:
+        using value_type = T;
+
+        explicit ArenaAllocator(Arena &arena) noexcept : arena_{&arena}
+        {
+        }
+
+        template <typename U>
+        ArenaAllocator(ArenaAllocator<U> const &other) noexcept : arena_{&other.get_arena()}
+        {
+        }
+
+        T *allocate(std::size_t const count)
+        {
+            if (count > static_cast<std::size_t>(-1) / sizeof(T))
+            {
+                throw std::bad_array_new_length{};
+            }
+            return static_cast<T *>(arena_->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *, std::size_t) noexcept
+        {
+        }
+
+        Arena &get_arena() const noexcept
+        {
+            return *arena_;
+        }
+
+        template <typename U>
+        bool operator==(ArenaAllocator<U> const &other) const noexcept
+        {
+            return arena_ == &other.get_arena();
+        }
+
+        template <typename U>
+        bool operator!=(ArenaAllocator<U> const &other) const noexcept
+        {
+            return !(*this == other);
+        }
+
+    private:
+        Arena *arena_;
+    };
+
+    /**
+     * Pool of fixed size slots.
+     *
+     * Slots are carved from slabs mapped from the system and recycled through a free list, so
+     * allocating and freeing are a few instructions and never reach malloc once the pool is warm.
+     * The number of slots can be capped to bound the memory of a subsystem.
+     *
+     * Not thread safe - every thread uses its own pool.
+     */
+    class SlabPool
+    {
+    public:
+        /**
+         * Creates a pool, slabs are mapped on first use
+         *
+         * @param[in] slot_size Size of every slot (rounded up to a multiple of DEFAULT_ALIGNMENT)
+         * @param[in] slots_per_slab Slots mapped at once
+         * @param[in] max_slots Slots the pool may hand out at once (0 for no limit)
+         * @param[in] huge_pages Back the slabs with huge pages when possible
+         * @throw std::invalid_argument If the slot size or the slots per slab is zero
+         */
+        SlabPool(std::size_t const slot_size, std::size_t const slots_per_slab, std::size_t const max_slots = 0,
+                 bool const huge_pages = false);
+
+        SlabPool(SlabPool &&) noexcept = default;
+        SlabPool &operator=(SlabPool &&) noexcept = default;
+        SlabPool(SlabPool const &) = delete;
+        SlabPool &operator=(SlabPool const &) = delete;
+
+        /**
+         * Takes a slot out of the pool
+         *
+         * @return The slot (aligned on DEFAULT_ALIGNMENT) or nullptr if the pool is at its limit
+         * @throw std::runtime_error If a slab could not be mapped
+         */
+        void *allocate();
+        /**
+         * Gives a slot back to the pool
+         *
+         * @param[in] slot A slot allocated from this pool (nullptr is ignored)
+         */
+        void deallocate(void *const slot) noexcept;
+
+        /**
+         * Size of the slots
+         * @return The size in bytes
+         */
+        std::size_t get_slot_size() const noexcept;
+        /**
+         * Memory accounting of the pool
+         * @return The bytes of the slots in use, their high-water mark and the bytes mapped
+         */
+        Usage get_usage() const noexcept;
+        /**
+         * Number of slots in use
+         * @return The number of slots
+         */
+        std::size_t get_slots() const noexcept;
+        /**
+         * Number of allocations refused because the pool was at its limit
+         * @return The number of refused allocations
+         */
+        std::uint64_t get_exhausted() const noexcept;
+
+    private:
+        // Free slots are linked through their first bytes
+        struct FreeSlot
+        {
+            FreeSlot *next;
+        };
+
+        std::size_t slot_size_;
+        std::size_t slots_per_slab_;
+        std::size_t max_slots_;
+        bool huge_pages_;
+        std::vector<Region> slabs_;
+        FreeSlot *free_;
+        // Slots of the last slab never handed out
+        std::size_t fresh_;
+        std::size_t slots_;
+        std::size_t high_water_;
+        std::uint64_t exhausted_;
+    };
+
+    /**
+     * Typed front of a slab pool constructing and destroying the objects in their slots
+     *
+     * @tparam T Type of the objects
+     */
+    template <typename T>
+    class ObjectPool
+    {
+        static_assert(alignof(T) <= DEFAULT_ALIGNMENT, "Slots are only aligned on DEFAULT_ALIGNMENT");
+
+    public:
+        /**
+         * Creates a pool
+         *
+         * @param[in] objects_per_slab Objects mapped at once
+         * @param[in] max_objects Objects alive at once (0 for no limit)
+         * @param[in] huge_pages Back the slabs with huge pages when possible
+         * @throw std::invalid_argument If the objects per slab is zero
+         */
+        explicit ObjectPool(std::size_t const objects_per_slab, std::size_t const max_objects = 0, bool const huge_pages = false)
+            : pool_{sizeof(T), objects_per_slab, max_objects, huge_pages}
+        {
+        }
+
+        /**
+         * Constructs an object in a free slot
+         *
+         * @param[in] args Arguments of the constructor
+         * @return The object or nullptr if the pool is at its limit
+         */
+        template <typename... Args>
+        T *create(Args &&...args)
+        {
+            void *const slot = pool_.allocate();
+            if (!slot)
+            {
+                return nullptr;
+            }
+            try
+            {
+                return new (slot) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                pool_.deallocate(slot);
+                throw;
+            }
+        }
+
+        /**
+         * Destroys an object and gives its slot back
+         *
+         * @param[in] object An object created by this pool (nullptr is ignored)
+         */
+        void destroy(T *const object) noexcept
+        {
+            if (object)
+            {
+                object->~T();
+                pool_.deallocate(object);
+            }
+        }
+
+        /**
+         * Slab pool underneath, for its accounting
+         * @return The pool
+         */
+        SlabPool const &get_pool() const noexcept
+        {
+            return pool_;
+        }
+
+    private:
+        SlabPool pool_;
+    };
+} // namespace common::memory
@@ -0,0 +1,504 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace common::queue
+{
+    // Indices written by different threads are kept this far apart so they never share a cache line
+    constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    /**
+     * Bounded single producer single consumer queue.
+     *
+     * Items live in a ring indexed by two ever increasing positions, each written by one side
+     * only. Every side keeps a private copy of the other side's position and only reads the
+     * shared one when its copy says the ring is full (or empty), so a steady stream costs one
+     * cache line transfer per batch rather than per item. Batch operations publish their items
+     * with a single store.
+     *
+     * Exactly one thread may push and one thread may pop at a time.
+     *
+     * @tparam T Type of the items (at least move constructible)
+     */
+    template <typename T>
+    class SpscQueue
+    {
+    public:
+        /**
+         * Allocates the ring
+         *
+         * @param[in] capacity Maximum number of queued items (rounded up to a power of two)
+         * @throw std::invalid_argument If the capacity is zero
+         */
+        explicit SpscQueue(std::size_t const capacity)
+            : capacity_{round_capacity_(capacity)}, mask_{capacity_ - 1}, slots_{std::make_unique<Slot[]>(capacity_)},
+              head_{0}, cached_tail_{0}, tail_{0}, cached_head_{0}
+        {
+        }
+
+        ~SpscQueue()
+        {
+            for (std::uint64_t position = tail_.load(std::memory_order_relaxed); position != head_.load(std::memory_order_relaxed);
+                 ++position)
+            {
+                item_(position)->~T();
+            }
+        }
+
+        SpscQueue(SpscQueue const &) = delete;
+        SpscQueue &operator=(SpscQueue const &) = delete;
+
+        /**
+         * Constructs an item at the back of the queue - producer only
+         *
+         * @param[in] args Arguments of the item's constructor
+         * @return False if the queue is full
+         */
+        template <typename... Args>
+        bool try_emplace(Args &&...args)
+        {
+            std::uint64_t const head = head_.load(std::memory_order_relaxed);
+            if (head - cached_tail_ == capacity_)
+            {
+                cached_tail_ = tail_.load(std::memory_order_acquire);
+                if (head - cached_tail_ == capacity_)
+                {
+                    return false;
+                }
+            }
+            new (slots_[head & mask_].bytes) T(std::forward<Args>(args)...);
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Adds an item at the back of the queue - producer only
+         *
+         * @param[in] item The item
+         * @return False if the queue is full
+         */
+        bool try_push(T const &item)
+        {
+            return try_emplace(item);
+        }
+
+        /**
+         * Moves an item at the back of the queue - producer only
+         *
+         * @param[in] item The item, left untouched if the queue is full
+         * @return False if the queue is full
+         */
+        bool try_push(T &&item)
+        {
+            return try_emplace(std::move(item));
+        }
+
+        /**
+         * Moves as many items as there is room for at the back of the queue - producer only
+         *
+         * @param[in] first First of the items
+         * @param[in] count Number of items
+         * @return Number of items queued (the first ones), the others are left untouched
+         */
+        template <typename InputIt>
+        std::size_t push_batch(InputIt first, std::size_t const count)
+        {
+            std::uint64_t const head = head_.load(std::memory_order_relaxed);
+            if (capacity_ - (head - cached_tail_) < count)
+            {
+                cached_tail_ = tail_.load(std::memory_order_acquire);
+            }
+            std::size_t const pushed = std::min<std::size_t>(count, capacity_ - (head - cached_tail_));
+            for (std::size_t i = 0; i < pushed; ++i, ++first)
+            {
+                new (slots_[(head + i) & mask_].bytes) T(std::move(*first));
+            }
+            if (pushed > 0)
+            {
+                head_.store(head + pushed, std::memory_order_release);
+            }
+            return pushed;
+        }
+
+        /**
+         * Takes the item at the front of the queue - consumer only
+         *
+         * @param[out] item Receives the item
+         * @return False if the queue is empty
+         */
+        bool try_pop(T &item)
+        {
+            std::uint64_t const tail = tail_.load(std::memory_order_relaxed);
+            if (tail == cached_head_)
+            {
+                cached_head_ = head_.load(std::memory_order_acquire);
+                if (tail == cached_head_)
+                {
+                    return false;
+                }
+            }
+            T *const front = item_(tail);
+            item = std::move(*front);
+            front->~T();
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Takes up to a number of items from the front of the queue - consumer only
+         *
+         * @param[out] out Receives the items in order
+         * @param[in] max Maximum number of items to take
+         * @return Number of items taken
+         */
+        template <typename OutputIt>
+        std::size_t pop_batch(OutputIt out, std::size_t const max)
+        {
+            std::uint64_t const tail = tail_.load(std::memory_order_relaxed);
+            if (cached_head_ - tail < max)
+            {
+                cached_head_ = head_.load(std::memory_order_acquire);
+            }
+            std::size_t const popped = std::min<std::size_t>(max, cached_head_ - tail);
+            for (std::size_t i = 0; i < popped; ++i, ++out)
+            {
+                T *const item = item_(tail + i);
+                *out = std::move(*item);
+                item->~T();
+            }
+            if (popped > 0)
+            {
+                tail_.store(tail + popped, std::memory_order_release);
+            }
+            return popped;
+        }
+
+        /**
+         * Number of queued items, only exact when neither side is running
+         * @return The number of items
+         */
+        std::size_t size() const noexcept
+        {
+            std::uint64_t const tail = tail_.load(std::memory_order_acquire);
+            return static_cast<std::size_t>(head_.load(std::memory_order_acquire) - tail);
+        }
+
+        /**
+         * Determines if the queue is empty, only exact when neither side is running
+         * @return True if no item is queued
+         */
+        bool empty() const noexcept
+        {
+            return size() == 0;
+        }
+
+        /**
+         * Maximum number of queued items
+         * @return The capacity
+         */
+        std::size_t capacity() const noexcept
+        {
+            return capacity_;
+        }
+
+    private:
+        struct Slot
+        {
+            alignas(T) unsigned char bytes[sizeof(T)];
+        };
+
+        static std::size_t round_capacity_(std::size_t const capacity)
+        {
+            if (capacity == 0)
+            {
+                throw std::invalid_argument{"Queue capacity must not be zero"};
+            }
+            std::size_t rounded = 1;
+            while (rounded < capacity)
+            {
+                rounded <<= 1;
+            }
+            return rounded;
+        }
+
+        T *item_(std::uint64_t const position) noexcept
+        {
+            return std::launder(reinterpret_cast<T *>(slots_[position & mask_].bytes));
+        }
+
+        std::size_t const capacity_;
+        std::size_t const mask_;
+        std::unique_ptr<Slot[]> slots_;
+        // Write position and last read position seen, owned by the producer
+        alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> head_;
+        std::uint64_t cached_tail_;
+        // Read position and last write position seen, owned by the consumer
+        alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> tail_;
+        std::uint64_t cached_head_;
+    };
+
+    /**
+     * Bounded multiple producer single consumer queue.
+     *
+     * Producers reserve a range of positions with a compare and swap on the write position,
+     * fill their slots and publish each one through its sequence number, so producers only
+     * contend on the reservation and never wait on each other's copies. The consumer takes
+     * published slots in order without any atomic read-modify-write. A producer stalled
+     * between its reservation and its publication holds back the items queued after it.
+     *
+     * Any number of threads may push, exactly one thread may pop at a time.
+     *
+     * @tparam T Type of the items (at least move constructible)
+     */
+    template <typename T>
+    class MpscQueue
+    {
+    public:
+        /**
+         * Allocates the ring
+         *
+         * @param[in] capacity Maximum number of queued items (rounded up to a power of two)
+         * @throw std::invalid_argument If the capacity is zero
+         */
+        explicit MpscQueue(std::size_t const capacity)
+            : capacity_{round_capacity_(capacity)}, mask_{capacity_ - 1}, slots_{std::make_unique<Slot[]>(capacity_)},
+              head_{0}, tail_{0}
+        {
+            for (std::size_t i = 0; i < capacity_; ++i)
+            {
+                slots_[i].sequence.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        ~MpscQueue()
+        {
+            for (std::uint64_t position = tail_.load(std::memory_order_relaxed); position != head_.load(std::memory_order_relaxed);
+                 ++position)
+            {
+                item_(position)->~T();
+            }
+        }
+
+        MpscQueue(MpscQueue const &) = delete;
+        MpscQueue &operator=(MpscQueue const &) = delete;
+
+        /**
+         * Constructs an item at the back of the queue
+         *
+         * @param[in] args Arguments of the item's constructor
+         * @return False if the queue is full
+         */
+        template <typename... Args>
+        bool try_emplace(Args &&...args)
+        {
+            std::uint64_t position = 0;
+            if (reserve_(1, position) == 0)
+            {
+                return false;
+            }
+            Slot &slot = slots_[position & mask_];
+            new (slot.bytes) T(std::forward<Args>(args)...);
+            slot.sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Adds an item at the back of the queue
+         *
+         * @param[in] item The item
+         * @return False if the queue is full
+         */
+        bool try_push(T const &item)
+        {
+            return try_emplace(item);
+        }
+
+        /**
+         * Moves an item at the back of the queue
+         *
+         * @param[in] item The item, left untouched if the queue is full
+         * @return False if the queue is full
+         */
+        bool try_push(T &&item)
+        {
+            return try_emplace(std::move(item));
+        }
+
+        /**
+         * Moves as many items as there is room for at the back of the queue, contiguously
+         *
+         * @param[in] first First of the items
+         * @param[in] count Number of items
+         * @return Number of items queued (the first ones), the others are left untouched
+         */
+        template <typename InputIt>
+        std::size_t push_batch(InputIt first, std::size_t const count)
+        {
+            std::uint64_t position = 0;
+            std::size_t const pushed = reserve_(count, position);
+            for (std::size_t i = 0; i < pushed; ++i, ++first)
+            {
+                Slot &slot = slots_[(position + i) & mask_];
+                new (slot.bytes) T(std::move(*first));
+                slot.sequence.store(position + i + 1, std::memory_order_release);
+            }
+            return pushed;
+        }
+
+        /**
+         * Takes the item at the front of the queue - consumer only
+         *
+         * @param[out] item Receives the item
+         * @return False if the queue is empty (or its front is not published yet)
+         */
+        bool try_pop(T &item)
+        {
+            return pop_batch(&item, 1) == 1;
+        }
+
+        /**
+         * Takes up to a number of published items from the front of the queue - consumer only
+         *
+         * @param[out] out Receives the items in order
+         * @param[in] max Maximum number of items to take
+         * @return Number of items taken
+         */
+        template <typename OutputIt>
+        std::size_t pop_batch(OutputIt out, std::size_t const max)
+        {
+            std::uint64_t const tail = tail_.load(std::memory_order_relaxed);
+            std::size_t popped = 0;
+            for (; popped < max; ++popped, ++out)
+            {
+                Slot &slot = slots_[(tail + popped) & mask_];
+                if (slot.sequence.load(std::memory_order_acquire) != tail + popped + 1)
+                {
+                    break;
+                }
+                T *const item = item_(tail + popped);
+                *out = std::move(*item);
+                item->~T();
+            }
+            if (popped > 0)
+            {
+                tail_.store(tail + popped, std::memory_order_release);
+            }
+            return popped;
+        }
+
+        /**
+         * Number of reserved items, only exact when no side is running
+         * @return The number of items
+         */
+        std::size_t size() const noexcept
+        {
+            std::uint64_t const tail = tail_.load(std::memory_order_acquire);
+            return static_cast<std::size_t>(head_.load(std::memory_order_acquire) - tail);
+        }
+
+        /**
+         * Determines if the queue is empty, only exact when no side is running
+         * @return True if no item is queued
+         */
+        bool empty() const noexcept
+        {
+            return size() == 0;
+        }
+
+        /**
+         * Maximum number of queued items
+         * @return The capacity
+         */
+        std::size_t capacity() const noexcept
+        {
+            return capacity_;
+        }
+
+    private:
+        struct Slot
+        {
+            // Position + 1 of the item once it is published
+            std::atomic<std::uint64_t> sequence;
+            alignas(T) unsigned char bytes[sizeof(T)];
+        };
+
+        static std::size_t round_capacity_(std::size_t const capacity)
+        {
+            if (capacity == 0)
+            {
+                throw std::invalid_argument{"Queue capacity must not be zero"};
+            }
+            std::size_t rounded = 1;
+            while (rounded < capacity)
+            {
+                rounded <<= 1;
+            }
+            return rounded;
+        }
+
+        /**
+         * Reserves free positions for a producer
+         *
+         * @param[in] count Positions wanted
+         * @param[out] position Receives the first reserved position
+         * @return Number of positions reserved (at most count, 0 if the queue is full)
+         */
+        std::size_t reserve_(std::size_t const count, std::uint64_t &position) noexcept
+        {
+            position = head_.load(std::memory_order_relaxed);
+            while (true)
+            {
+                // The consumer emptied every slot before the read position it published
+                std::uint64_t const tail = tail_.load(std::memory_order_acquire);
+                std::size_t const reserved = std::min<std::size_t>(count, capacity_ - (position - tail));
+                if (reserved == 0)
+                {
+                    return 0;
+                }
+                if (head_.compare_exchange_weak(position, position + reserved, std::memory_order_relaxed))
+                {
+                    return reserved;
+                }
+            }
+        }
+
+        T *item_(std::uint64_t const position) noexcept
+        {
+            return std::launder(reinterpret_cast<T *>(slots_[position & mask_].bytes));
+        }
+
+        std::size_t const capacity_;
+        std::size_t const mask_;
+        std::unique_ptr<Slot[]> slots_;
+        // Next position to reserve, shared by the producers
+        alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> head_;
+        // Read position, owned by the consumer
+        alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> tail_;
+    };
+} // namespace common::queue
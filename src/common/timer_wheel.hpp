@@ -0,0 +1,178 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace common::timing
+{
+    /**
+     * Hashed timer wheel.
+     *
+     * Time is cut in ticks and every tick maps to one slot of a fixed size ring. Scheduling
+     * appends to the slot of the deadline and advancing only visits the slots of the ticks
+     * that passed, so both are O(1) per timer regardless of how many timers are pending.
+     * Timers further away than one lap of the wheel stay in their slot until their deadline.
+     *
+     * Not thread safe - meant to be driven by the thread that owns it.
+     *
+     * @tparam T Value handed back when a timer fires
+     */
+    template <typename T>
+    class TimerWheel
+    {
+    public:
+        /**
+         * Creates an empty wheel
+         *
+         * @param[in] slot_count Number of slots (rounded up to a power of two)
+         * @param[in] tick_ns Resolution of the wheel
+         * @param[in] now_ns Current time, the first tick starts here
+         * @throw std::invalid_argument If the slot count or tick is zero
+         */
+        TimerWheel(std::size_t const slot_count, std::uint64_t const tick_ns, std::uint64_t const now_ns)
+            : tick_ns_{tick_ns}, start_ns_{now_ns}, current_tick_{0}, size_{0}
+        {
+            if (slot_count == 0 || tick_ns == 0)
+            {
+                throw std::invalid_argument{"Timer wheel slot count and tick must not be zero"};
+            }
+            std::size_t slots = 1;
+            while (slots < slot_count)
+            {
+                slots <<= 1;
+            }
+            slots_.resize(slots);
+            mask_ = slots - 1;
+        }
+
+        /**
+         * Schedules a timer
+         *
+         * @param[in] delay_ns Time from the current tick after which the timer fires (at least one tick)
+         * @param[in] value Value handed to the callback when the timer fires
+         */
+        void schedule(std::uint64_t const delay_ns, T value)
+        {
+            std::uint64_t ticks = (delay_ns + tick_ns_ - 1) / tick_ns_;
+            ticks = ticks == 0 ? 1 : ticks;
+            std::uint64_t const deadline = current_tick_ + ticks;
+            slots_[deadline & mask_].push_back(Entry{deadline, std::move(value)});
+            ++size_;
+        }
+
+        /**
+         * Fires every timer whose deadline passed.
+         *
+         * The callback may schedule new timers, they fire on a later tick at the earliest.
+         *
+         * @param[in] now_ns Current time
+         * @param[in] callback Called with the value of every expired timer
+         * @return Number of timers fired
+         */
+        template <typename Callback>
+        std::size_t advance(std::uint64_t const now_ns, Callback &&callback)
+        {
+            std::uint64_t const target = now_ns <= start_ns_ ? 0 : (now_ns - start_ns_) / tick_ns_;
+            std::size_t fired = 0;
+            while (current_tick_ < target)
+            {
+                ++current_tick_;
+                std::vector<Entry> &slot = slots_[current_tick_ & mask_];
+                if (slot.empty())
+                {
+                    continue;
+                }
+                // Swap the slot out so the callback can schedule into it while it is walked
+                due_.swap(slot);
+                for (Entry &entry : due_)
+                {
+                    if (entry.deadline <= current_tick_)
+                    {
+                        --size_;
+                        ++fired;
+                        callback(std::move(entry.value));
+                    }
+                    else
+                    {
+                        slots_[entry.deadline & mask_].push_back(std::move(entry));
+                    }
+                }
+                due_.clear();
+            }
+            return fired;
+        }
+
+        /**
+         * Time at which the next tick is due
+         * @return The time in nanoseconds
+         */
+        std::uint64_t next_tick_ns() const noexcept
+        {
+            return start_ns_ + (current_tick_ + 1) * tick_ns_;
+        }
+
+        /**
+         * Number of pending timers
+         * @return The number of timers
+         */
+        std::size_t size() const noexcept
+        {
+            return size_;
+        }
+
+        /**
+         * Determines if no timer is pending
+         * @return True if the wheel is empty
+         */
+        bool empty() const noexcept
+        {
+            return size_ == 0;
+        }
+
+    private:
+        struct Entry
+        {
+            // Absolute tick at which the timer fires
+            std::uint64_t deadline;
+            T value;
+        };
+
+        // One list of timers per slot
+        std::vector<std::vector<Entry>> slots_;
+        // Timers of the slot being fired (kept to reuse its allocation)
+        std::vector<Entry> due_;
+        // Slot count - 1
+        std::size_t mask_;
+        // Resolution of the wheel
+        std::uint64_t const tick_ns_;
+        // Time of tick zero
+        std::uint64_t const start_ns_;
+        // Last tick that was processed
+        std::uint64_t current_tick_;
+        // Number of pending timers
+        std::size_t size_;
+    };
+} // namespace common::timing
@@ -0,0 +1,187 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+#include <chrono>
+#include <ctime>
+
+#include "timing.hpp"
+
+// Period over which the TSC frequency is measured against the steady clock
+#define TSC_CALIBRATION_MS 10
+// Format of the cached timestamp, identical to ctime without the newline
+#define TIMESTAMP_FORMAT "%a %b %e %H:%M:%S %Y"
+
+// The TSC clock needs a 64x64 -> 128 bit multiply
+#if (defined(__x86_64__) || defined(_M_X64)) && defined(__SIZEOF_INT128__)
+#define TSC_CLOCK_SUPPORTED
+#endif
+
+namespace common::timing
+{
+    namespace
+    {
+        // Conversion from TSC ticks to nanoseconds, fixed at startup
+        struct TscCalibration
+        {
+            bool usable;
+            std::uint64_t base_tsc;
+            std::uint64_t base_ns;
+            // Nanoseconds per tick as a 32.32 fixed point number
+            std::uint64_t ns_per_tick;
+        };
+
+        // Cached timestamp of the current thread
+        struct TimestampCache
+        {
+            std::time_t second;
+            char text[32];
+            std::size_t length;
+        };
+        thread_local TimestampCache timestamp_cache_{-1, {}, 0};
+
+        /**
+         * Reads the steady clock
+         *
+         * @return The steady clock in nanoseconds
+         */
+        std::uint64_t steady_ns_() noexcept
+        {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                  std::chrono::steady_clock::now().time_since_epoch())
+                                                  .count());
+        }
+
+#ifdef TSC_CLOCK_SUPPORTED
+        /**
+         * Determines if the TSC ticks at a constant rate in every power state
+         *
+         * @return True if the CPU reports an invariant TSC
+         */
+        bool invariant_tsc_() noexcept
+        {
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+            {
+                return false;
+            }
+            __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+            return (edx & (1u << 8)) != 0;
+        }
+
+        /**
+         * Measures the TSC frequency against the steady clock
+         *
+         * @return The calibration (unusable if the TSC is not invariant)
+         */
+        TscCalibration calibrate_() noexcept
+        {
+            if (!invariant_tsc_())
+            {
+                return TscCalibration{false, 0, 0, 0};
+            }
+            std::uint64_t const start_ns = steady_ns_();
+            std::uint64_t const start_tsc = __rdtsc();
+            std::uint64_t end_ns = start_ns;
+            // Busy wait - sleeping could be cut short or stretched by the scheduler
+            while (end_ns - start_ns < TSC_CALIBRATION_MS * 1000000ULL)
+            {
+                end_ns = steady_ns_();
+            }
+            std::uint64_t const end_tsc = __rdtsc();
+            if (end_tsc <= start_tsc)
+            {
+                return TscCalibration{false, 0, 0, 0};
+            }
+            std::uint64_t const ns_per_tick = static_cast<std::uint64_t>(
+                (static_cast<unsigned __int128>(end_ns - start_ns) << 32) / (end_tsc - start_tsc));
+            return TscCalibration{true, end_tsc, end_ns, ns_per_tick};
+        }
+#else
+        TscCalibration calibrate_() noexcept
+        {
+            return TscCalibration{false, 0, 0, 0};
+        }
+#endif
+
+        /**
+         * Calibrates the TSC on first use
+         *
+         * @return The process wide calibration
+         */
+        TscCalibration const &calibration_() noexcept
+        {
+            static TscCalibration const calibration = calibrate_();
+            return calibration;
+        }
+    } // namespace
+
+    std::uint64_t monotonic_ns() noexcept
+    {
+#ifdef TSC_CLOCK_SUPPORTED
+        TscCalibration const &calibration = calibration_();
+        if (calibration.usable)
+        {
+            std::uint64_t const ticks = __rdtsc() - calibration.base_tsc;
+            return calibration.base_ns +
+                   static_cast<std::uint64_t>((static_cast<unsigned __int128>(ticks) * calibration.ns_per_tick) >> 32);
+        }
+#endif
+        return steady_ns_();
+    }
+
+    bool tsc_clock() noexcept
+    {
+        return calibration_().usable;
+    }
+
+    std::uint64_t cycles() noexcept
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+        return __rdtsc();
+#else
+        return steady_ns_();
+#endif
+    }
+
+    std::string_view local_timestamp() noexcept
+    {
+        std::time_t const now = std::time(nullptr);
+        TimestampCache &cache = timestamp_cache_;
+        if (now != cache.second)
+        {
+            std::tm local{};
+#ifdef _WIN32
+            localtime_s(&local, &now);
+#else
+            localtime_r(&now, &local);
+#endif
+            cache.length = std::strftime(cache.text, sizeof(cache.text), TIMESTAMP_FORMAT, &local);
+            cache.second = now;
+        }
+        return std::string_view{cache.text, cache.length};
+    }
+} // namespace common::timing
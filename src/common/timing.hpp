@@ -0,0 +1,60 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace common::timing
+{
+    /**
+     * Monotonic time in nanoseconds since an arbitrary epoch.
+     *
+     * Derived from the invariant TSC when the CPU has one (a few nanoseconds per call,
+     * no system call), otherwise from std::chrono::steady_clock. Meant for durations,
+     * timeouts and packet timestamps - not for wall clock time.
+     *
+     * @return The current monotonic time
+     */
+    std::uint64_t monotonic_ns() noexcept;
+
+    /**
+     * Determines if monotonic_ns is derived from the TSC
+     *
+     * @return True if the TSC is used
+     */
+    bool tsc_clock() noexcept;
+
+    /**
+     * Raw CPU cycle counter, for measuring short sections of code
+     *
+     * @return The TSC, or monotonic_ns on platforms without one
+     */
+    std::uint64_t cycles() noexcept;
+
+    /**
+     * Local wall clock time formatted like ctime (e.g. "Sat Oct 17 01:59:47 2026").
+     *
+     * The string is cached per thread and only formatted again once the second changes.
+     *
+     * @return A view of the timestamp, valid until the next call on the same thread
+     */
+    std::string_view local_timestamp() noexcept;
+} // namespace common::timing
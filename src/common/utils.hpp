@@ -23,7 +23,7 @@
 namespace common::utils
 {
     /**
-     * Given an IP address string, determine if it is valid using regex
+     * Given an IP address string, determine if it is a valid IPv4 or IPv6 address
      * @param[in] ip_addr IP address string
      * @return True if the ip address string is in a valid format
      */
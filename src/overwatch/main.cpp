@@ -16,42 +16,587 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#ifdef _WIN32
-#include "windows.hpp"
-#else
-#include <unistd.h>
-#endif
 #include <signal.h>
+#include <atomic>
+#include <csignal>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 #include "config.hpp"
+#include "event.hpp"
+#include "flow_exporter.hpp"
+#include "identifier.hpp"
 #include "logging.hpp"
+#include "matcher.hpp"
 #include "argument_parser.hpp"
+#include "arp_spoofer.hpp"
+#include "bpf_filter.hpp"
+#include "lpm_table.hpp"
+#include "packet_recorder.hpp"
+#include "packet_source.hpp"
+#include "pipeline.hpp"
+#include "pcap_reader.hpp"
+#include "ring_capture.hpp"
+#include "rule_set.hpp"
+#include "stats_reporter.hpp"
+#include "target_summary.hpp"
+#include "tcp_reassembler.hpp"
+#include "worker.hpp"
+
+// Link type of Ethernet captures
+#define LINK_TYPE_ETHERNET 1
+// Concurrent flows tracked by every worker
+#define MAX_FLOWS_PER_WORKER (1 << 18)
+// Flows idle for this long are evicted and exported
+#define FLOW_IDLE_TIMEOUT_NS (60ULL * 1000 * 1000 * 1000)
+// Long lived flows are checkpointed (exported with their counters so far) this often
+#define FLOW_ACTIVE_TIMEOUT_NS (300ULL * 1000 * 1000 * 1000)
+// Exported flow records are held back at most this long before they are written
+#define EXPORT_FLUSH_INTERVAL_NS (1ULL * 1000 * 1000 * 1000)
+#define MILLISECONDS_PER_SECOND 1000
+#define NANOSECONDS_PER_SECOND (1000ULL * 1000 * 1000)
+#define BYTES_PER_MIB (1ULL << 20)
 
 namespace
 {
+    // Last signal received (0 if none) - logged by the main thread, handlers must not log.
+    // Atomic rather than volatile since the handler may run on any thread of the process.
+    std::atomic_int g_received_signal{0};
+    static_assert(std::atomic_int::is_always_lock_free, "Signal handlers may only use lock-free atomics");
+
     /**
      * Clean up the overwatch instance once a signal is fired
+     *
+     * Runs in signal context: it only records the signal and triggers the shutdown event,
+     * everything else (logging included) happens on the main thread once it wakes up.
      * 
      * @param[in] The signal
      */
-    void cleanup_(int) noexcept
+    void cleanup_(int const signal) noexcept
     {
-        LOG_DEBUG << "Received external shutdown signal";
+        g_received_signal.store(signal, std::memory_order_relaxed);
         overwatch::core::g_config.signal_shutdown();
     }
 
     /**
-     * Waits for the external shutdown
+     * Compiles the filter that drops every frame unrelated to the watched hosts
+     *
+     * @return The filter accepting the targets' (and the arpspoof host's) traffic or std::nullopt
+     *         if there are too many targets for a socket filter
      */
-    void sleep_() noexcept
+    std::optional<overwatch::capture::BpfFilter> compile_filter_()
     {
-        LOG_INFO << "Waiting for external shutdown signal...";
-        while (!overwatch::core::g_config.is_shutdown())
+        std::vector<common::utils::IpPrefix> hosts = overwatch::core::g_config.get_targets();
+        std::optional<common::utils::IpAddress> const arpspoof_host_ip = overwatch::core::g_config.get_arpspoof_host_ip();
+        if (arpspoof_host_ip)
+        {
+            hosts.push_back(common::utils::IpPrefix::host(*arpspoof_host_ip));
+        }
+        try
+        {
+            overwatch::capture::BpfFilter filter{hosts};
+            LOG_DEBUG << "Compiled capture filter with " << filter.get_program().size() << " instructions";
+            return filter;
+        }
+        catch (std::logic_error const &e)
+        {
+            // The filter grows with every target, the lookup table does not
+            LOG_WARNING << "Capturing without a socket filter (" << e.what() << ")";
+            return std::nullopt;
+        }
+    }
+
+    /**
+     * Builds the lookup table attributing packets to the targets
+     *
+     * @return The table indexed like the configured targets
+     */
+    std::shared_ptr<overwatch::core::LpmTable const> build_target_table_()
+    {
+        auto table = std::make_shared<overwatch::core::LpmTable const>(overwatch::core::g_config.get_targets());
+        LOG_DEBUG << "Built lookup table of " << table->size() << " targets (" << table->memory_usage() << " bytes reserved)";
+        return table;
+    }
+
+    /**
+     * Logs a flow evicted from a worker's flow table
+     *
+     * @param[in] flow The evicted flow
+     */
+    void export_flow_(overwatch::core::ExpiredFlow const &flow)
+    {
+        LOG_DEBUG << "Flow " << common::utils::to_string(common::utils::IpAddress::from_bytes(flow.key.src_addr)) << ":"
+                  << flow.key.src_port << " <-> "
+                  << common::utils::to_string(common::utils::IpAddress::from_bytes(flow.key.dst_addr)) << ":"
+                  << flow.key.dst_port << " (protocol " << flow.key.protocol << ") - "
+                  << flow.record.packets[0] + flow.record.packets[1] << " packets, "
+                  << flow.record.bytes[0] + flow.record.bytes[1] << " bytes";
+    }
+
+    /**
+     * Logs what the traffic of a target revealed about the services it uses
+     *
+     * @param[in] identification The identification
+     */
+    void report_identification_(overwatch::identify::Identification const &identification)
+    {
+        std::string const client = common::utils::to_string(common::utils::IpAddress::from_bytes(identification.key.src_addr)) +
+                                   ":" + std::to_string(identification.key.src_port);
+        std::string const server = common::utils::to_string(common::utils::IpAddress::from_bytes(identification.key.dst_addr)) +
+                                   ":" + std::to_string(identification.key.dst_port);
+        std::string details;
+        switch (identification.protocol)
+        {
+        case overwatch::identify::Protocol::Dns:
+            details = std::string{identification.dns_response ? "response" : "query"} + " '" + identification.name + "' type " +
+                      std::to_string(identification.dns_type);
+            if (identification.dns_response)
+            {
+                details += " rcode " + std::to_string(identification.dns_rcode);
+                for (std::uint8_t i = 0; i < identification.answer_count; ++i)
+                {
+                    details += " " + common::utils::to_string(identification.answers[i]);
+                }
+            }
+            break;
+        case overwatch::identify::Protocol::Http:
+            details = std::string{"host '"} + identification.name + "' user-agent '" + identification.user_agent + "'";
+            break;
+        default:
+            details = std::string{"server name '"} + identification.name + "' alpn '" + identification.alpn + "' ja3 " +
+                      identification.ja3 + " ja4 " + identification.ja4;
+            break;
+        }
+        LOG_INFO << overwatch::identify::to_string(identification.protocol) << " " << client << " -> " << server << " "
+                 << details << (identification.complete ? "" : " (partial)");
+    }
+
+    /**
+     * Compiles the rules matched against the targets' traffic
+     *
+     * @return The rules shared by every worker or nullptr if no rules are matched
+     * @throw std::invalid_argument If the rules file is unreadable or a rule is invalid
+     */
+    std::shared_ptr<overwatch::rules::RuleSet const> load_rules_()
+    {
+        std::optional<std::string> const rules_file = overwatch::core::g_config.get_rules_file();
+        if (!rules_file)
+        {
+            return nullptr;
+        }
+        auto rules = std::make_shared<overwatch::rules::RuleSet const>(overwatch::rules::read_rules(*rules_file));
+        LOG_INFO << "Compiled " << rules->size() << " rules into " << rules->get_states() << " states ("
+                 << rules->memory_usage() << " bytes)";
+        return rules;
+    }
+
+    /**
+     * Logs a rule matching the traffic of a target
+     *
+     * @param[in] rules The rules
+     * @param[in] match The match
+     */
+    void report_match_(overwatch::rules::RuleSet const &rules, overwatch::rules::Match const &match)
+    {
+        LOG_WARNING << "Rule '" << rules.get_rule(match.rule).name << "' matched "
+                    << common::utils::to_string(common::utils::IpAddress::from_bytes(match.key.src_addr)) << ":"
+                    << match.key.src_port << " -> "
+                    << common::utils::to_string(common::utils::IpAddress::from_bytes(match.key.dst_addr)) << ":"
+                    << match.key.dst_port << " (protocol " << match.key.protocol << ") at offset " << match.offset;
+    }
+
+    /**
+     * Logs the summary of a target's traffic over a window
+     *
+     * @param[in] targets The configured targets
+     * @param[in] summary The summary
+     */
+    void report_summary_(std::vector<common::utils::IpPrefix> const &targets, overwatch::sketch::TargetSummary const &summary)
+    {
+        std::string peers;
+        for (overwatch::sketch::PeerBytes const &peer : summary.top_peers)
+        {
+            peers += " " + common::utils::to_string(common::utils::IpAddress::from_bytes(peer.address)) + " (" +
+                     std::to_string(peer.bytes) + " bytes)";
+        }
+        std::string ports;
+        for (overwatch::sketch::PortBytes const &port : summary.top_ports)
+        {
+            ports += std::string{port.protocol == overwatch::decode::PROTOCOL_TCP ? " tcp/" : " udp/"} + std::to_string(port.port) +
+                     " (" + std::to_string(port.bytes) + " bytes)";
+        }
+        LOG_INFO << "Target " << common::utils::to_string(targets[summary.target]) << " over the last "
+                 << (summary.end_ns - summary.start_ns) / NANOSECONDS_PER_SECOND << "s: " << summary.packets << " packets ("
+                 << summary.bytes << " bytes), ~" << summary.peers << " peers, ~" << summary.ports << " ports - top peers:"
+                 << (peers.empty() ? " none" : peers) << " - top ports:" << (ports.empty() ? " none" : ports);
+    }
+
+    /**
+     * Creates the summarizer of the targets' traffic if the summaries are enabled
+     *
+     * @return The summarizer or nullptr if the traffic is not summarized
+     */
+    std::unique_ptr<overwatch::sketch::Summarizer> open_summarizer_()
+    {
+        std::size_t const interval = overwatch::core::g_config.get_summary_interval();
+        if (interval == 0)
+        {
+            return nullptr;
+        }
+        std::vector<common::utils::IpPrefix> const targets = overwatch::core::g_config.get_targets();
+        return std::make_unique<overwatch::sketch::Summarizer>(
+            targets.size(), interval * NANOSECONDS_PER_SECOND, SUMMARY_WINDOWS,
+            [targets](overwatch::sketch::TargetSummary const &summary) { report_summary_(targets, summary); });
+    }
+
+    /**
+     * Summarizes the last interval once the workers are joined
+     *
+     * @param[in] summarizer The summarizer (may be null)
+     */
+    void stop_summarizer_(overwatch::sketch::Summarizer *summarizer) noexcept
+    {
+        if (!summarizer)
+        {
+            return;
+        }
+        try
+        {
+            summarizer->finish();
+        }
+        catch (std::exception const &e)
+        {
+            LOG_ERROR << "Failed to summarize the targets' traffic: " << e.what();
+        }
+        if (summarizer->get_late() > 0)
+        {
+            LOG_WARNING << "Dropped " << summarizer->get_late() << " traffic sketches handed over after their window";
+        }
+    }
+
+    /**
+     * Opens the flow exporter if the flow records should be exported
+     *
+     * @return The running exporter or nullptr if flows are only logged
+     */
+    std::unique_ptr<overwatch::exporter::FlowExporter> open_exporter_()
+    {
+        std::optional<std::string> const destination = overwatch::core::g_config.get_export();
+        if (!destination)
+        {
+            return nullptr;
+        }
+        LOG_INFO << "Exporting flow records to '" << *destination << "'";
+        return std::make_unique<overwatch::exporter::FlowExporter>(overwatch::exporter::open_collector(*destination));
+    }
+
+    /**
+     * Writes the remaining flow records and logs the totals of the export
+     *
+     * @param[in] exporter The running exporter (may be null)
+     */
+    void stop_exporter_(overwatch::exporter::FlowExporter *exporter) noexcept
+    {
+        if (!exporter)
+        {
+            return;
+        }
+        exporter->stop();
+        overwatch::exporter::ExporterCounters const counters = exporter->get_counters();
+        LOG_INFO << "Exported " << counters.bytes << " bytes of flow records in " << counters.buffers << " writes";
+        if (counters.errors > 0)
+        {
+            LOG_WARNING << "Failed to export " << counters.errors << " buffers of flow records";
+        }
+    }
+
+    /**
+     * Opens the packet recorder if the targets' packets should be recorded
+     *
+     * @return The running recorder or nullptr if no packets are recorded
+     */
+    std::unique_ptr<overwatch::recorder::PacketRecorder> open_recorder_()
+    {
+        std::optional<std::string> const directory = overwatch::core::g_config.get_write_dir();
+        if (!directory)
+        {
+            return nullptr;
+        }
+        overwatch::recorder::RecorderOptions options;
+        options.max_file_size = overwatch::core::g_config.get_write_size() * BYTES_PER_MIB;
+        options.max_file_age_ns = overwatch::core::g_config.get_write_interval() * NANOSECONDS_PER_SECOND;
+        LOG_INFO << "Recording the targets' packets to '" << *directory << "'";
+        return std::make_unique<overwatch::recorder::PacketRecorder>(*directory, options);
+    }
+
+    /**
+     * Writes the remaining recorded packets and logs the totals of the recording
+     *
+     * @param[in] recorder The running recorder (may be null)
+     */
+    void stop_recorder_(overwatch::recorder::PacketRecorder *recorder) noexcept
+    {
+        if (!recorder)
+        {
+            return;
+        }
+        recorder->stop();
+        overwatch::recorder::RecorderCounters const counters = recorder->get_counters();
+        LOG_INFO << "Recorded " << counters.bytes << " bytes of packets to " << counters.files << " files";
+        if (counters.errors > 0)
+        {
+            LOG_WARNING << "Failed to record " << counters.errors << " buffers of packets";
+        }
+    }
+
+    /**
+     * Creates the factory of the workers' pipelines
+     * (decode -> classify -> record -> flow update -> summarize -> identify -> match -> export)
+     *
+     * @param[in] exporter Exporter of the flow records or nullptr to log them (must outlive the pipelines)
+     * @param[in] recorder Recorder of the targets' packets or nullptr (must outlive the pipelines)
+     * @param[in] summarizer Summarizer of the targets' traffic or nullptr (must outlive the pipelines)
+     * @return The factory creating the pipeline of a worker
+     */
+    overwatch::core::PipelineFactory pipeline_factory_(overwatch::exporter::FlowExporter *exporter,
+                                                       overwatch::recorder::PacketRecorder *recorder,
+                                                       overwatch::sketch::Summarizer *summarizer)
+    {
+        std::shared_ptr<overwatch::core::LpmTable const> const targets = build_target_table_();
+        std::shared_ptr<overwatch::rules::RuleSet const> const rules = load_rules_();
+        return [targets, rules, exporter, recorder, summarizer](std::size_t const worker_id) {
+            auto pipeline = std::make_unique<overwatch::core::Pipeline>();
+            pipeline->add_stage(std::make_unique<overwatch::core::DecodeStage>());
+            pipeline->add_stage(std::make_unique<overwatch::core::ClassifyStage>(targets));
+            if (recorder)
+            {
+                pipeline->add_stage(std::make_unique<overwatch::recorder::RecordStage>(
+                    recorder->open_channel(static_cast<std::uint32_t>(worker_id))));
+            }
+            pipeline->add_stage(std::make_unique<overwatch::core::FlowStage>(MAX_FLOWS_PER_WORKER, FLOW_IDLE_TIMEOUT_NS,
+                                                                             FLOW_ACTIVE_TIMEOUT_NS));
+            if (summarizer)
+            {
+                pipeline->add_stage(std::make_unique<overwatch::sketch::SummaryStage>(*summarizer));
+            }
+            pipeline->add_stage(std::make_unique<overwatch::identify::IdentifyStage>(report_identification_));
+            std::vector<std::unique_ptr<overwatch::reassembly::StreamAnalyzer>> analyzers;
+            analyzers.push_back(std::make_unique<overwatch::identify::StreamIdentifier>(report_identification_));
+            if (rules)
+            {
+                overwatch::rules::MatchSink const sink = [rules](overwatch::rules::Match const &match) {
+                    report_match_(*rules, match);
+                };
+                pipeline->add_stage(std::make_unique<overwatch::rules::MatchStage>(rules, sink));
+                analyzers.push_back(std::make_unique<overwatch::rules::StreamMatcher>(rules, sink));
+            }
+            // TCP streams are reassembled once for every analyzer
+            pipeline->add_stage(std::make_unique<overwatch::reassembly::ReassemblyStage>(
+                std::make_unique<overwatch::reassembly::AnalyzerChain>(std::move(analyzers))));
+            if (exporter)
+            {
+                // Every worker is its own observation domain with its own sequence numbers
+                pipeline->add_stage(std::make_unique<overwatch::exporter::FlowExportStage>(
+                    exporter->open_channel(static_cast<std::uint32_t>(worker_id)), EXPORT_FLUSH_INTERVAL_NS));
+            }
+            else
+            {
+                pipeline->add_stage(std::make_unique<overwatch::core::ExportStage>(export_flow_));
+            }
+            return pipeline;
+        };
+    }
+
+    /**
+     * Opens the packet sources selected by the configuration
+     *
+     * @return A capture file reader if a file should be read, else one live capture ring per worker
+     */
+    std::vector<std::unique_ptr<overwatch::capture::PacketSource>> open_sources_()
+    {
+        std::vector<std::unique_ptr<overwatch::capture::PacketSource>> sources;
+        std::optional<overwatch::capture::BpfFilter> const filter = compile_filter_();
+        std::optional<std::string> const read_file = overwatch::core::g_config.get_read_file();
+        if (read_file)
+        {
+            overwatch::capture::ReplayMode const mode =
+                overwatch::core::g_config.get_replay_mode() == REPLAY_MODE_ORIGINAL
+                    ? overwatch::capture::ReplayMode::OriginalTimestamps
+                    : overwatch::capture::ReplayMode::Fast;
+            auto reader = std::make_unique<overwatch::capture::PcapReader>(*read_file, mode, filter);
+            if (reader->get_link_type() != LINK_TYPE_ETHERNET)
+            {
+                LOG_WARNING << "Capture file '" << *read_file << "' is not an Ethernet capture";
+            }
+            if (overwatch::core::g_config.get_workers() != 1)
+            {
+                LOG_WARNING << "A capture file is always read by a single worker";
+            }
+            LOG_INFO << "Reading packets from '" << *read_file << "'...";
+            sources.push_back(std::move(reader));
+            return sources;
+        }
+
+        std::size_t num_workers = overwatch::core::g_config.get_workers();
+        if (num_workers == 0)
+        {
+            num_workers = overwatch::core::available_cpus().size();
+        }
+        overwatch::capture::RingOptions options;
+        options.filter = filter;
+        // Intercepted frames are forwarded by this host - only count them once, on the way in
+        options.ignore_outgoing = overwatch::core::g_config.get_arpspoof_host_ip().has_value();
+        // A single ring owns the whole interface - fanout is only needed to split traffic
+        if (num_workers > 1)
+        {
+            options.fanout_mode = overwatch::core::g_config.get_fanout_mode() == FANOUT_MODE_CPU
+                                      ? overwatch::capture::FanoutMode::Cpu
+                                      : overwatch::capture::FanoutMode::Hash;
+            // Fanout group ids are global to the host - keep concurrent instances apart
+            options.fanout_group = static_cast<std::uint16_t>(std::random_device{}());
+        }
+        for (std::size_t i = 0; i < num_workers; ++i)
+        {
+            sources.push_back(std::make_unique<overwatch::capture::RingCapture>(
+                overwatch::core::g_config.get_interface(), options));
+        }
+        LOG_INFO << "Capturing on interface '" << overwatch::core::g_config.get_interface() << "' with "
+                 << num_workers << " worker(s)...";
+        return sources;
+    }
+
+    /**
+     * Starts intercepting the targets' traffic if ARP spoofing is configured
+     *
+     * @return The running spoofer or nullptr if ARP spoofing is disabled
+     */
+    std::unique_ptr<overwatch::intercept::ArpSpoofer> start_arpspoof_()
+    {
+        std::optional<common::utils::IpAddress> const gateway = overwatch::core::g_config.get_arpspoof_host_ip();
+        if (!gateway)
+        {
+            return nullptr;
+        }
+        std::vector<common::utils::IpAddress> hosts;
+        for (common::utils::IpPrefix const &target : overwatch::core::g_config.get_targets())
+        {
+            if (target.address.is_ipv4() && target.length == 32)
+            {
+                hosts.push_back(target.address);
+            }
+            else
+            {
+                LOG_WARNING << "Not intercepting " << common::utils::to_string(target) << " - only single IPv4 hosts can be ARP spoofed";
+            }
+        }
+        auto spoofer = std::make_unique<overwatch::intercept::ArpSpoofer>(overwatch::core::g_config.get_interface(), hosts, *gateway);
+        spoofer->start();
+        return spoofer;
+    }
+
+    /**
+     * Stops intercepting and restores the hosts' ARP caches
+     *
+     * @param[in] spoofer The running spoofer (may be null)
+     */
+    void stop_arpspoof_(overwatch::intercept::ArpSpoofer *spoofer) noexcept
+    {
+        if (!spoofer)
+        {
+            return;
+        }
+        spoofer->stop();
+        overwatch::intercept::SpoofCounters const counters = spoofer->get_counters();
+        LOG_INFO << "Sent " << counters.poison_replies << " poisoned ARP replies and forwarded "
+                 << counters.forwarded_frames << " intercepted frames (" << counters.forward_failures << " failed, "
+                 << counters.send_failures << " ARP frames dropped)";
+    }
+
+    /**
+     * Starts reporting the runtime statistics if enabled
+     *
+     * @return The running reporter or nullptr if the reports are disabled
+     */
+    std::unique_ptr<overwatch::stats::Reporter> start_stats_reporter_()
+    {
+        std::size_t const interval = overwatch::core::g_config.get_stats_interval();
+        if (interval == 0)
+        {
+            return nullptr;
+        }
+        auto reporter = std::make_unique<overwatch::stats::Reporter>(
+            overwatch::stats::default_registry(), static_cast<std::uint32_t>(interval * MILLISECONDS_PER_SECOND),
+            overwatch::core::g_config.get_stats_output());
+        reporter->start();
+        return reporter;
+    }
+
+    /**
+     * Stops reporting and issues a final report with the totals of the run
+     *
+     * @param[in] reporter The running reporter (may be null)
+     */
+    void stop_stats_reporter_(overwatch::stats::Reporter *reporter) noexcept
+    {
+        if (!reporter)
+        {
+            return;
+        }
+        reporter->stop();
+        try
+        {
+            reporter->report();
+        }
+        catch (std::exception const &e)
+        {
+            LOG_ERROR << "Failed to report stats: " << e.what();
+        }
+    }
+
+    /**
+     * Waits for the workers to finish (source exhausted or external shutdown) and joins them
+     *
+     * @param[in] pool The running worker pool
+     */
+    void wait_on_threads_(overwatch::core::WorkerPool &pool)
+    {
+        overwatch::core::Event::wait_any({&overwatch::core::g_config.get_shutdown_event(), &pool.get_finished_event()}, -1);
+        int const received = g_received_signal.load(std::memory_order_relaxed);
+        if (received != 0)
+        {
+            LOG_DEBUG << "Received external shutdown signal " << received;
+        }
+        // Wakes the workers that are still capturing - they drain their rings and flush their pipelines
+        overwatch::core::g_config.signal_shutdown();
+        pool.join();
+
+        overwatch::core::WorkerCounters const counters = pool.get_counters();
+        LOG_INFO << "Captured " << counters.packets << " packets (" << counters.bytes << " bytes) in "
+                 << counters.batches << " batches";
+        if (counters.drops > 0)
+        {
+            LOG_WARNING << "The kernel dropped " << counters.drops << " packets the workers could not keep up with";
+        }
+        std::vector<common::utils::IpPrefix> const targets = overwatch::core::g_config.get_targets();
+        std::vector<overwatch::core::TargetCounters> const target_counters = pool.get_target_counters();
+        for (std::size_t i = 0; i < target_counters.size(); ++i)
+        {
+            if (target_counters[i].packets > 0)
+            {
+                LOG_INFO << "Target " << common::utils::to_string(targets[i]) << ": " << target_counters[i].packets
+                         << " packets (" << target_counters[i].bytes << " bytes)";
+            }
+        }
+        std::uint64_t const dropped_entries = common::logging::dropped_log_entries();
+        if (dropped_entries > 0)
         {
-            LOG_DEBUG << "Shutdown signal is not set";
-            sleep(1);
+            LOG_WARNING << "Dropped " << dropped_entries << " log entries";
         }
     }
 
@@ -87,6 +632,19 @@ namespace
                     arg_parser.get<std::string>(ARG_INTERFACE),
                     arg_parser.get<std::string>(ARG_LOGGING),
                     arg_parser.present<std::string>(ARG_ARPSPOOF_HOST));
+            overwatch::core::g_config.set_targets_file(arg_parser.present<std::string>(ARG_TARGETS));
+            overwatch::core::g_config.set_read_file(arg_parser.present<std::string>(ARG_READ));
+            overwatch::core::g_config.set_replay_mode(arg_parser.get<std::string>(ARG_REPLAY));
+            overwatch::core::g_config.set_workers(arg_parser.get<std::size_t>(ARG_WORKERS));
+            overwatch::core::g_config.set_fanout_mode(arg_parser.get<std::string>(ARG_FANOUT));
+            overwatch::core::g_config.set_stats_interval(arg_parser.get<std::size_t>(ARG_STATS_INTERVAL));
+            overwatch::core::g_config.set_stats_output(arg_parser.present<std::string>(ARG_STATS_OUTPUT));
+            overwatch::core::g_config.set_export(arg_parser.present<std::string>(ARG_EXPORT));
+            overwatch::core::g_config.set_write_dir(arg_parser.present<std::string>(ARG_WRITE));
+            overwatch::core::g_config.set_write_size(arg_parser.get<std::size_t>(ARG_WRITE_SIZE));
+            overwatch::core::g_config.set_write_interval(arg_parser.get<std::size_t>(ARG_WRITE_INTERVAL));
+            overwatch::core::g_config.set_rules_file(arg_parser.present<std::string>(ARG_RULES));
+            overwatch::core::g_config.set_summary_interval(arg_parser.get<std::size_t>(ARG_SUMMARY_INTERVAL));
             // Validate the newly generate config values
             overwatch::core::g_config.validate();
             // Set the logger to log at the specified output
@@ -94,9 +652,21 @@ namespace
             LOG_INFO << overwatch::core::g_config.to_string();
             LOG_INFO << "Running overwatch...";
             init_signals_();
-            // @TODO: Main execution
-            sleep_();
-            //wait_on_threads_();
+            // Declared before the pool - the workers' stages must not outlive the exporter, recorder and summarizer
+            std::unique_ptr<overwatch::exporter::FlowExporter> const exporter = open_exporter_();
+            std::unique_ptr<overwatch::recorder::PacketRecorder> const recorder = open_recorder_();
+            std::unique_ptr<overwatch::sketch::Summarizer> const summarizer = open_summarizer_();
+            overwatch::core::WorkerPool pool{open_sources_(), true,
+                                             pipeline_factory_(exporter.get(), recorder.get(), summarizer.get())};
+            std::unique_ptr<overwatch::intercept::ArpSpoofer> const spoofer = start_arpspoof_();
+            std::unique_ptr<overwatch::stats::Reporter> const reporter = start_stats_reporter_();
+            pool.start();
+            wait_on_threads_(pool);
+            stop_summarizer_(summarizer.get());
+            stop_exporter_(exporter.get());
+            stop_recorder_(recorder.get());
+            stop_arpspoof_(spoofer.get());
+            stop_stats_reporter_(reporter.get());
         }
         catch (std::exception const &e)
         {
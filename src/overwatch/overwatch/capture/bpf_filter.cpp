@@ -0,0 +1,536 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef __linux__
+#include <linux/filter.h>
+#include <sys/socket.h>
+#endif
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+#include "bpf_filter.hpp"
+
+// Largest program accepted by the kernel
+#define MAX_PROGRAM_SIZE 4096
+// Snap length returned by the program for accepted frames (whole frame)
+#define ACCEPT_SNAPLEN 0x40000
+#define DROP 0
+// Frame layout
+#define ETHER_TYPE_OFFSET 12
+#define ETHERNET_HEADER_SIZE 14
+#define VLAN_TAG_SIZE 4
+// Stacked tags skipped before the network layer (like the decoder)
+#define MAX_VLAN_TAGS 2
+#define ETHER_TYPE_IPV4 0x0800
+#define ETHER_TYPE_ARP 0x0806
+#define ETHER_TYPE_IPV6 0x86DD
+#define ETHER_TYPE_VLAN 0x8100
+#define ETHER_TYPE_QINQ 0x88A8
+#define IPV4_SRC_OFFSET 12
+#define IPV4_DST_OFFSET 16
+#define ARP_SENDER_IP_OFFSET 14
+#define ARP_TARGET_IP_OFFSET 24
+#define IPV6_SRC_OFFSET 8
+#define IPV6_DST_OFFSET 24
+#define IPV4_BITS 32u
+
+namespace overwatch::capture
+{
+    namespace
+    {
+        // Classic BPF opcodes supported by the compiler and the interpreter
+        constexpr std::uint16_t LD_W_ABS = 0x20;
+        constexpr std::uint16_t LD_H_ABS = 0x28;
+        constexpr std::uint16_t LD_B_ABS = 0x30;
+        constexpr std::uint16_t LD_W_IND = 0x40;
+        constexpr std::uint16_t LD_H_IND = 0x48;
+        constexpr std::uint16_t LD_B_IND = 0x50;
+        constexpr std::uint16_t LD_IMM = 0x00;
+        constexpr std::uint16_t LDX_IMM = 0x01;
+        constexpr std::uint16_t LDX_B_MSH = 0xB1;
+        constexpr std::uint16_t ALU_ADD_K = 0x04;
+        constexpr std::uint16_t ALU_AND_K = 0x54;
+        constexpr std::uint16_t JMP_JA = 0x05;
+        constexpr std::uint16_t JMP_JEQ_K = 0x15;
+        constexpr std::uint16_t JMP_JGT_K = 0x25;
+        constexpr std::uint16_t JMP_JGE_K = 0x35;
+        constexpr std::uint16_t JMP_JSET_K = 0x45;
+        constexpr std::uint16_t RET_K = 0x06;
+        constexpr std::uint16_t RET_A = 0x16;
+        constexpr std::uint16_t MISC_TAX = 0x07;
+        constexpr std::uint16_t MISC_TXA = 0x87;
+
+        /**
+         * Minimal assembler resolving forward jumps to labels
+         */
+        struct ProgramBuilder
+        {
+            struct Fixup
+            {
+                std::size_t index;
+                std::size_t label;
+            };
+
+            std::vector<BpfInstruction> program;
+            std::vector<std::optional<std::size_t>> labels;
+            std::vector<Fixup> fixups;
+
+            std::size_t new_label()
+            {
+                labels.emplace_back();
+                return labels.size() - 1;
+            }
+
+            void bind(std::size_t const label)
+            {
+                labels[label] = program.size();
+            }
+
+            void emit(std::uint16_t const code, std::uint32_t const k, std::uint8_t const jt = 0, std::uint8_t const jf = 0)
+            {
+                program.push_back(BpfInstruction{code, jt, jf, k});
+            }
+
+            // Jumps to the label if A == k, falls through otherwise
+            void jump_if_equal(std::uint32_t const k, std::size_t const label)
+            {
+                fixups.push_back(Fixup{program.size(), label});
+                emit(JMP_JEQ_K, k);
+            }
+
+            // Jumps to the label unconditionally (32 bit offset)
+            void jump(std::size_t const label)
+            {
+                fixups.push_back(Fixup{program.size(), label});
+                emit(JMP_JA, 0);
+            }
+
+            std::vector<BpfInstruction> finish()
+            {
+                for (Fixup const &fixup : fixups)
+                {
+                    std::size_t const offset = *labels[fixup.label] - fixup.index - 1;
+                    BpfInstruction &insn = program[fixup.index];
+                    if (insn.code == JMP_JA)
+                    {
+                        insn.k = static_cast<std::uint32_t>(offset);
+                    }
+                    else if (offset <= UINT8_MAX)
+                    {
+                        insn.jt = static_cast<std::uint8_t>(offset);
+                    }
+                    else
+                    {
+                        throw std::logic_error{"Conditional BPF jump out of range"};
+                    }
+                }
+                return program;
+            }
+        };
+
+        /**
+         * Mask of the leading bits of a 32 bit word
+         *
+         * @param[in] bits Number of leading bits (0-32)
+         * @return The mask
+         */
+        std::uint32_t prefix_mask_(unsigned int const bits) noexcept
+        {
+            return bits == 0 ? 0 : (bits >= IPV4_BITS ? UINT32_MAX : UINT32_MAX << (IPV4_BITS - bits));
+        }
+
+        /**
+         * Emits a block accepting the frame if the IPv4 address at either offset is in one of the prefixes
+         *
+         * Every match returns directly so the block never needs a jump further than one instruction.
+         * Addresses are loaded relative to X, which holds the size of the VLAN tags.
+         *
+         * @param[in,out] builder The program being built
+         * @param[in] first_offset Offset of the first address in an untagged frame
+         * @param[in] second_offset Offset of the second address in an untagged frame
+         * @param[in] prefixes The IPv4 prefixes to accept
+         */
+        void emit_ipv4_match_(ProgramBuilder &builder, std::uint32_t const first_offset, std::uint32_t const second_offset,
+                              std::vector<common::utils::IpPrefix> const &prefixes)
+        {
+            for (std::uint32_t const offset : {first_offset, second_offset})
+            {
+                // Hosts share a single load of the address
+                bool loaded = false;
+                for (common::utils::IpPrefix const &prefix : prefixes)
+                {
+                    if (prefix.length == IPV4_BITS)
+                    {
+                        if (!loaded)
+                        {
+                            builder.emit(LD_W_IND, offset);
+                            loaded = true;
+                        }
+                        builder.emit(JMP_JEQ_K, prefix.address.to_ipv4(), 0, 1);
+                        builder.emit(RET_K, ACCEPT_SNAPLEN);
+                    }
+                }
+                // Ranges mask the address, so it is loaded again for each of them
+                for (common::utils::IpPrefix const &prefix : prefixes)
+                {
+                    if (prefix.length < IPV4_BITS)
+                    {
+                        builder.emit(LD_W_IND, offset);
+                        builder.emit(ALU_AND_K, prefix_mask_(prefix.length));
+                        builder.emit(JMP_JEQ_K, prefix.address.to_ipv4(), 0, 1);
+                        builder.emit(RET_K, ACCEPT_SNAPLEN);
+                    }
+                }
+            }
+            builder.emit(RET_K, DROP);
+        }
+
+        /**
+         * Emits a block accepting the frame if the IPv6 address at either offset is in one of the prefixes
+         *
+         * Addresses are compared 32 bits at a time, a mismatch skips to the next prefix. Like for
+         * IPv4, addresses are loaded relative to X.
+         *
+         * @param[in,out] builder The program being built
+         * @param[in] first_offset Offset of the first address in an untagged frame
+         * @param[in] second_offset Offset of the second address in an untagged frame
+         * @param[in] prefixes The IPv6 prefixes to accept
+         */
+        void emit_ipv6_match_(ProgramBuilder &builder, std::uint32_t const first_offset, std::uint32_t const second_offset,
+                              std::vector<common::utils::IpPrefix> const &prefixes)
+        {
+            for (std::uint32_t const offset : {first_offset, second_offset})
+            {
+                for (common::utils::IpPrefix const &prefix : prefixes)
+                {
+                    std::uint32_t const words[4] = {static_cast<std::uint32_t>(prefix.address.high >> 32),
+                                                    static_cast<std::uint32_t>(prefix.address.high),
+                                                    static_cast<std::uint32_t>(prefix.address.low >> 32),
+                                                    static_cast<std::uint32_t>(prefix.address.low)};
+                    unsigned int const num_words = (prefix.length + IPV4_BITS - 1) / IPV4_BITS;
+                    // Instructions needed to compare each word (load, optional mask, compare)
+                    unsigned int sizes[4] = {};
+                    for (unsigned int word = 0; word < num_words; ++word)
+                    {
+                        sizes[word] = prefix.length >= (word + 1) * IPV4_BITS ? 2 : 3;
+                    }
+                    for (unsigned int word = 0; word < num_words; ++word)
+                    {
+                        builder.emit(LD_W_IND, offset + word * 4);
+                        if (sizes[word] == 3)
+                        {
+                            builder.emit(ALU_AND_K, prefix_mask_(prefix.length - word * IPV4_BITS));
+                        }
+                        // Skips the remaining words and the accept on a mismatch
+                        unsigned int skip = 1;
+                        for (unsigned int next = word + 1; next < num_words; ++next)
+                        {
+                            skip += sizes[next];
+                        }
+                        builder.emit(JMP_JEQ_K, words[word], 0, static_cast<std::uint8_t>(skip));
+                    }
+                    builder.emit(RET_K, ACCEPT_SNAPLEN);
+                }
+            }
+            builder.emit(RET_K, DROP);
+        }
+
+        /**
+         * Parses the textual hosts of a filter
+         *
+         * @param[in] hosts Addresses or CIDR ranges
+         * @return The parsed prefixes
+         * @throw std::invalid_argument If a host is not a valid address or range
+         */
+        std::vector<common::utils::IpPrefix> parse_hosts_(std::vector<std::string> const &hosts)
+        {
+            std::vector<common::utils::IpPrefix> prefixes;
+            for (std::string const &host : hosts)
+            {
+                std::optional<common::utils::IpPrefix> const prefix = common::utils::parse_ip_prefix(host);
+                if (!prefix)
+                {
+                    throw std::invalid_argument{"'" + host + "' is not a valid IP address or CIDR range"};
+                }
+                prefixes.push_back(*prefix);
+            }
+            return prefixes;
+        }
+
+        /**
+         * Loads a big endian value from the frame
+         *
+         * @param[in] frame Start of the frame
+         * @param[in] caplen Bytes available in the frame
+         * @param[in] offset Offset of the value
+         * @param[in] size Size of the value in bytes
+         * @param[out] value The loaded value
+         * @return False if the value lies outside of the frame
+         */
+        bool load_(std::uint8_t const *frame, std::uint32_t const caplen, std::uint64_t const offset,
+                   std::uint32_t const size, std::uint32_t *value) noexcept
+        {
+            if (offset + size > caplen)
+            {
+                return false;
+            }
+            std::uint32_t result = 0;
+            for (std::uint32_t i = 0; i < size; ++i)
+            {
+                result = (result << 8) | frame[offset + i];
+            }
+            *value = result;
+            return true;
+        }
+    } // namespace
+
+    BpfFilter::BpfFilter(std::vector<std::string> const &hosts)
+        : BpfFilter{parse_hosts_(hosts)}
+    {
+    }
+
+    BpfFilter::BpfFilter(std::vector<common::utils::IpPrefix> const &hosts)
+    {
+        if (hosts.empty())
+        {
+            throw std::invalid_argument{"A capture filter needs at least one host"};
+        }
+        std::vector<common::utils::IpPrefix> ipv4_hosts;
+        std::vector<common::utils::IpPrefix> ipv6_hosts;
+        for (common::utils::IpPrefix const &host : hosts)
+        {
+            (host.address.is_ipv4() ? ipv4_hosts : ipv6_hosts).push_back(host);
+        }
+
+        ProgramBuilder builder;
+        std::size_t const dispatch = builder.new_label();
+        std::size_t const to_ipv4 = builder.new_label();
+        std::size_t const to_arp = builder.new_label();
+        std::size_t const to_ipv6 = builder.new_label();
+        std::size_t const ipv4 = builder.new_label();
+        std::size_t const arp = builder.new_label();
+        std::size_t const ipv6 = builder.new_label();
+
+        // Skip the VLAN tags (usually stripped into metadata on live sockets, but inline in
+        // capture files), single or stacked 802.1ad/802.1Q. Programs only jump forward, so the
+        // walk is unrolled and leaves the size of the tags in X for the match blocks.
+        for (std::uint32_t tags = 0; tags < MAX_VLAN_TAGS; ++tags)
+        {
+            std::size_t const tagged = builder.new_label();
+            builder.emit(LD_H_ABS, ETHER_TYPE_OFFSET + tags * VLAN_TAG_SIZE);
+            builder.jump_if_equal(ETHER_TYPE_VLAN, tagged);
+            builder.jump_if_equal(ETHER_TYPE_QINQ, tagged);
+            builder.emit(LDX_IMM, tags * VLAN_TAG_SIZE);
+            builder.jump(dispatch);
+            builder.bind(tagged);
+        }
+        // Deeper stacks are left with a tag as ethertype and dropped by the dispatch
+        builder.emit(LD_H_ABS, ETHER_TYPE_OFFSET + MAX_VLAN_TAGS * VLAN_TAG_SIZE);
+        builder.emit(LDX_IMM, MAX_VLAN_TAGS * VLAN_TAG_SIZE);
+
+        // Dispatch on the ethertype
+        builder.bind(dispatch);
+        builder.jump_if_equal(ETHER_TYPE_IPV4, to_ipv4);
+        builder.jump_if_equal(ETHER_TYPE_ARP, to_arp);
+        builder.jump_if_equal(ETHER_TYPE_IPV6, to_ipv6);
+        builder.emit(RET_K, DROP);
+
+        // Trampolines - the match blocks grow with the number of hosts and are out of reach of conditional jumps
+        builder.bind(to_ipv4);
+        builder.jump(ipv4);
+        builder.bind(to_arp);
+        builder.jump(arp);
+        builder.bind(to_ipv6);
+        builder.jump(ipv6);
+
+        std::uint32_t const l3 = ETHERNET_HEADER_SIZE;
+        builder.bind(ipv4);
+        emit_ipv4_match_(builder, l3 + IPV4_SRC_OFFSET, l3 + IPV4_DST_OFFSET, ipv4_hosts);
+        builder.bind(arp);
+        emit_ipv4_match_(builder, l3 + ARP_SENDER_IP_OFFSET, l3 + ARP_TARGET_IP_OFFSET, ipv4_hosts);
+        builder.bind(ipv6);
+        emit_ipv6_match_(builder, l3 + IPV6_SRC_OFFSET, l3 + IPV6_DST_OFFSET, ipv6_hosts);
+
+        program_ = builder.finish();
+        validate_();
+    }
+
+    BpfFilter::BpfFilter(std::vector<BpfInstruction> program)
+        : program_{std::move(program)}
+    {
+        validate_();
+    }
+
+    bool BpfFilter::matches(std::uint8_t const *frame, std::uint32_t const caplen) const noexcept
+    {
+        std::uint32_t a = 0;
+        std::uint32_t x = 0;
+        std::size_t pc = 0;
+        // Jumps only go forward, so the program always terminates
+        while (pc < program_.size())
+        {
+            BpfInstruction const &insn = program_[pc++];
+            switch (insn.code)
+            {
+            case LD_W_ABS:
+            case LD_H_ABS:
+            case LD_B_ABS:
+            case LD_W_IND:
+            case LD_H_IND:
+            case LD_B_IND:
+            {
+                std::uint32_t const size = (insn.code & 0x18) == 0x00 ? 4 : ((insn.code & 0x18) == 0x08 ? 2 : 1);
+                std::uint64_t const offset = insn.k + ((insn.code & 0xE0) == 0x40 ? static_cast<std::uint64_t>(x) : 0);
+                // Out of bounds loads abort the program like in the kernel
+                if (!load_(frame, caplen, offset, size, &a))
+                {
+                    return false;
+                }
+                break;
+            }
+            case LD_IMM:
+                a = insn.k;
+                break;
+            case LDX_IMM:
+                x = insn.k;
+                break;
+            case LDX_B_MSH:
+                if (insn.k >= caplen)
+                {
+                    return false;
+                }
+                x = static_cast<std::uint32_t>(frame[insn.k] & 0x0F) * 4;
+                break;
+            case ALU_ADD_K:
+                a += insn.k;
+                break;
+            case ALU_AND_K:
+                a &= insn.k;
+                break;
+            case JMP_JA:
+                pc += insn.k;
+                break;
+            case JMP_JEQ_K:
+                pc += a == insn.k ? insn.jt : insn.jf;
+                break;
+            case JMP_JGT_K:
+                pc += a > insn.k ? insn.jt : insn.jf;
+                break;
+            case JMP_JGE_K:
+                pc += a >= insn.k ? insn.jt : insn.jf;
+                break;
+            case JMP_JSET_K:
+                pc += (a & insn.k) ? insn.jt : insn.jf;
+                break;
+            case RET_K:
+                return insn.k != 0;
+            case RET_A:
+                return a != 0;
+            case MISC_TAX:
+                x = a;
+                break;
+            case MISC_TXA:
+                a = x;
+                break;
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    void BpfFilter::attach(int const fd) const
+    {
+#ifdef __linux__
+        static_assert(sizeof(BpfInstruction) == sizeof(sock_filter), "BpfInstruction must match struct sock_filter");
+        sock_fprog prog{};
+        prog.len = static_cast<unsigned short>(program_.size());
+        prog.filter = reinterpret_cast<sock_filter *>(const_cast<BpfInstruction *>(program_.data()));
+        if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+        {
+            throw std::runtime_error{std::string{"Failed to attach the capture filter - "} + std::strerror(errno)};
+        }
+#else
+        (void)fd;
+        throw std::runtime_error{"Socket filters are only supported on Linux"};
+#endif
+    }
+
+    std::vector<BpfInstruction> const &BpfFilter::get_program() const noexcept
+    {
+        return program_;
+    }
+
+    void BpfFilter::validate_() const
+    {
+        if (program_.empty() || program_.size() > MAX_PROGRAM_SIZE)
+        {
+            throw std::invalid_argument{"Capture filter must have between 1 and " + std::to_string(MAX_PROGRAM_SIZE) +
+                                        " instructions (got " + std::to_string(program_.size()) + ")"};
+        }
+        for (std::size_t pc = 0; pc < program_.size(); ++pc)
+        {
+            BpfInstruction const &insn = program_[pc];
+            std::size_t const remaining = program_.size() - pc - 1;
+            switch (insn.code)
+            {
+            case JMP_JA:
+                if (insn.k >= remaining)
+                {
+                    throw std::invalid_argument{"Capture filter jumps out of bounds"};
+                }
+                break;
+            case JMP_JEQ_K:
+            case JMP_JGT_K:
+            case JMP_JGE_K:
+            case JMP_JSET_K:
+                if (insn.jt >= remaining || insn.jf >= remaining)
+                {
+                    throw std::invalid_argument{"Capture filter jumps out of bounds"};
+                }
+                break;
+            case LD_W_ABS:
+            case LD_H_ABS:
+            case LD_B_ABS:
+            case LD_W_IND:
+            case LD_H_IND:
+            case LD_B_IND:
+            case LD_IMM:
+            case LDX_IMM:
+            case LDX_B_MSH:
+            case ALU_ADD_K:
+            case ALU_AND_K:
+            case RET_K:
+            case RET_A:
+            case MISC_TAX:
+            case MISC_TXA:
+                break;
+            default:
+                throw std::invalid_argument{"Capture filter uses an unsupported instruction"};
+            }
+        }
+        BpfInstruction const &last = program_.back();
+        if (last.code != RET_K && last.code != RET_A)
+        {
+            throw std::invalid_argument{"Capture filter must end with a return"};
+        }
+    }
+} // namespace overwatch::capture
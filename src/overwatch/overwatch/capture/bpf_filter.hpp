@@ -0,0 +1,104 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ip_address.hpp"
+
+namespace overwatch::capture
+{
+    /**
+     * A classic BPF instruction (same layout as the kernel's struct sock_filter)
+     */
+    struct BpfInstruction
+    {
+        std::uint16_t code;
+        std::uint8_t jt;
+        std::uint8_t jf;
+        std::uint32_t k;
+    };
+
+    /**
+     * Classic BPF socket filter that only lets the watched hosts' traffic through.
+     *
+     * Attached to a capture socket the program runs in the kernel before a frame is
+     * copied into the ring, so traffic of other hosts never wakes user space. The same
+     * program is interpreted in user space to filter frames replayed from a file.
+     */
+    class BpfFilter
+    {
+    public:
+        /**
+         * Compiles a filter that accepts IPv4 and IPv6 frames sent from or to one of the hosts
+         * and ARP frames whose sender or target is one of the IPv4 hosts (untagged or 802.1Q tagged)
+         *
+         * @param[in] hosts Addresses or CIDR ranges of the hosts to keep
+         * @throw std::invalid_argument If no host is given
+         */
+        explicit BpfFilter(std::vector<common::utils::IpPrefix> const &hosts);
+        /**
+         * Compiles a filter from textual hosts
+         *
+         * @param[in] hosts Addresses or CIDR ranges of the hosts to keep
+         * @throw std::invalid_argument If no host is given or a host is not a valid address or range
+         */
+        explicit BpfFilter(std::vector<std::string> const &hosts);
+        /**
+         * Wraps an already compiled program
+         *
+         * @param[in] program The classic BPF program
+         * @throw std::invalid_argument If the program uses unsupported instructions or jumps out of bounds
+         */
+        explicit BpfFilter(std::vector<BpfInstruction> program);
+
+        /**
+         * Runs the program over a frame in user space
+         *
+         * @param[in] frame Start of the link layer frame
+         * @param[in] caplen Number of bytes available at frame
+         * @return True if the program accepts the frame
+         */
+        bool matches(std::uint8_t const *frame, std::uint32_t const caplen) const noexcept;
+
+        /**
+         * Attaches the program to a socket (SO_ATTACH_FILTER)
+         *
+         * @param[in] fd The socket file descriptor
+         * @throw std::runtime_error If the kernel rejects the program
+         */
+        void attach(int const fd) const;
+
+        /**
+         * The compiled program
+         * @return The instructions of the program
+         */
+        std::vector<BpfInstruction> const &get_program() const noexcept;
+
+    private:
+        // Checks that the program only uses instructions the interpreter understands
+        void validate_() const;
+
+        std::vector<BpfInstruction> program_;
+    };
+} // namespace overwatch::capture
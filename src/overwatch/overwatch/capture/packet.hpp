@@ -0,0 +1,65 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace overwatch::capture
+{
+    // Maximum number of packets handed out by a packet source in a single batch
+    constexpr std::size_t MAX_BATCH_SIZE = 256;
+
+    /**
+     * Non-owning view of a single captured frame.
+     *
+     * The data pointer refers directly into the memory of the packet source
+     * (e.g. the kernel ring) and is only valid until the next batch is requested.
+     */
+    struct PacketView
+    {
+        // Start of the link layer frame
+        std::uint8_t const *data;
+        // Number of bytes available at data
+        std::uint32_t caplen;
+        // Original length of the frame on the wire
+        std::uint32_t wire_len;
+        // Capture timestamp in nanoseconds since the epoch
+        std::uint64_t timestamp_ns;
+    };
+
+    /**
+     * Fixed capacity batch of packet views filled by a packet source
+     */
+    struct PacketBatch
+    {
+        std::array<PacketView, MAX_BATCH_SIZE> packets;
+        std::size_t size = 0;
+
+        void clear() noexcept { size = 0; }
+        bool empty() const noexcept { return size == 0; }
+        bool full() const noexcept { return size == packets.size(); }
+        void push_back(PacketView const &packet) noexcept { packets[size++] = packet; }
+
+        PacketView const *begin() const noexcept { return packets.data(); }
+        PacketView const *end() const noexcept { return packets.data() + size; }
+    };
+} // namespace overwatch::capture
@@ -0,0 +1,93 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include "packet.hpp"
+
+namespace overwatch::capture
+{
+    /**
+     * Interface of anything that produces packets for the analysis pipeline.
+     *
+     * Live capture and offline replay both hand out batches of packet views through
+     * this interface so that the rest of the pipeline does not care where frames come from.
+     */
+    class PacketSource
+    {
+    public:
+        virtual ~PacketSource() = default;
+
+        /**
+         * Fills the batch with the next packets of the source.
+         *
+         * Views handed out by the previous call are invalidated.
+         *
+         * @param[out] batch The batch to fill
+         * @param[in] timeout_ms Maximum time to wait for packets
+         * @return True if at least one packet was added to the batch
+         */
+        virtual bool next_batch(PacketBatch &batch, int const timeout_ms) = 0;
+
+        /**
+         * Determines if the source will never produce packets again
+         * @return True once a finite source (e.g. a file) has been fully consumed
+         */
+        virtual bool exhausted() const noexcept
+        {
+            return false;
+        }
+
+        /**
+         * Sets a descriptor that cuts waits in next_batch short as soon as it is readable
+         * (e.g. the shutdown event). Sources that never block may ignore it.
+         *
+         * @param[in] fd The descriptor to watch or -1 to wait for the full timeout again
+         */
+        virtual void set_wakeup_fd(int const fd) noexcept
+        {
+            (void)fd;
+        }
+
+        /**
+         * Takes the number of packets the source dropped since the previous call
+         * (e.g. because the kernel found the capture ring full)
+         *
+         * @return The number of dropped packets
+         */
+        virtual std::uint64_t take_drops() noexcept
+        {
+            return 0;
+        }
+
+        /**
+         * Current time in the clock of the packet timestamps, so that time passes while no
+         * packet arrives
+         *
+         * @return The time or std::nullopt if time only advances with the packets (e.g. a replay)
+         */
+        virtual std::optional<std::uint64_t> now_ns() const noexcept
+        {
+            return std::nullopt;
+        }
+    };
+} // namespace overwatch::capture
@@ -0,0 +1,466 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "logging.hpp"
+#include "pcap_reader.hpp"
+
+#define PCAP_MAGIC_USEC 0xA1B2C3D4U
+#define PCAP_MAGIC_NSEC 0xA1B23C4DU
+#define PCAP_FILE_HEADER_SIZE 24
+#define PCAP_RECORD_HEADER_SIZE 16
+#define PCAPNG_SECTION_HEADER_BLOCK 0x0A0D0D0AU
+#define PCAPNG_INTERFACE_DESCRIPTION_BLOCK 0x00000001U
+#define PCAPNG_SIMPLE_PACKET_BLOCK 0x00000003U
+#define PCAPNG_ENHANCED_PACKET_BLOCK 0x00000006U
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4DU
+#define PCAPNG_MIN_BLOCK_SIZE 12
+#define PCAPNG_OPTION_IF_TSRESOL 9
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+#define MICROSECONDS_PER_SECOND 1000000ULL
+// Largest resolution whose sub-second part times NANOSECONDS_PER_SECOND fits in 64 bits
+#define MAX_EXACT_TS_UNITS (1ULL << 34)
+#define UNKNOWN_LINK_TYPE std::numeric_limits<std::uint32_t>::max()
+
+namespace overwatch::capture
+{
+    namespace
+    {
+        /**
+         * Reverses the byte order of a 32 bit integer
+         *
+         * @param[in] value The value to swap
+         * @return The byte swapped value
+         */
+        std::uint32_t bswap32_(std::uint32_t const value) noexcept
+        {
+            return (value >> 24) | ((value >> 8) & 0x0000FF00U) | ((value << 8) & 0x00FF0000U) | (value << 24);
+        }
+
+        /**
+         * Reads a 32 bit integer in host byte order from unaligned memory
+         *
+         * @param[in] ptr Memory to read from
+         * @return The integer
+         */
+        std::uint32_t load32_(std::uint8_t const *ptr) noexcept
+        {
+            std::uint32_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        /**
+         * Converts a timestamp in arbitrary units to nanoseconds
+         *
+         * @param[in] timestamp The timestamp
+         * @param[in] units_per_second Resolution of the timestamp
+         * @return The timestamp in nanoseconds
+         */
+        std::uint64_t to_nanoseconds_(std::uint64_t timestamp, std::uint64_t units_per_second) noexcept
+        {
+            if (units_per_second == NANOSECONDS_PER_SECOND)
+            {
+                return timestamp;
+            }
+            else if (units_per_second > NANOSECONDS_PER_SECOND)
+            {
+                if (units_per_second % NANOSECONDS_PER_SECOND == 0)
+                {
+                    return timestamp / (units_per_second / NANOSECONDS_PER_SECOND);
+                }
+                // Powers of two (the powers of ten are multiples of a nanosecond): the bits dropped
+                // by the shift are far below a nanosecond
+                while (units_per_second > MAX_EXACT_TS_UNITS)
+                {
+                    timestamp >>= 1;
+                    units_per_second >>= 1;
+                }
+            }
+            // Split to avoid overflowing the intermediate product
+            return (timestamp / units_per_second) * NANOSECONDS_PER_SECOND +
+                   (timestamp % units_per_second) * NANOSECONDS_PER_SECOND / units_per_second;
+        }
+    } // namespace
+
+    PcapReader::PcapReader(std::filesystem::path const &file_path, ReplayMode const mode,
+                           std::optional<BpfFilter> filter)
+        : mode_{mode}, filter_{std::move(filter)}, data_{nullptr}, size_{0}, offset_{0}, pcapng_{false}, swapped_{false},
+          ts_units_{MICROSECONDS_PER_SECOND}, link_type_{UNKNOWN_LINK_TYPE}, pending_{},
+          has_pending_{false}, first_timestamp_ns_{0}, replay_start_{}, wakeup_fd_{-1}
+    {
+        map_(file_path);
+        try
+        {
+            std::uint32_t const magic = size_ >= sizeof(std::uint32_t) ? load32_(data_) : 0;
+            if (magic == PCAPNG_SECTION_HEADER_BLOCK)
+            {
+                pcapng_ = true;
+            }
+            else if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC ||
+                     magic == bswap32_(PCAP_MAGIC_USEC) || magic == bswap32_(PCAP_MAGIC_NSEC))
+            {
+                if (size_ < PCAP_FILE_HEADER_SIZE)
+                {
+                    throw std::runtime_error{"Capture file '" + file_path.u8string() + "' has a truncated header"};
+                }
+                swapped_ = magic == bswap32_(PCAP_MAGIC_USEC) || magic == bswap32_(PCAP_MAGIC_NSEC);
+                ts_units_ = (magic == PCAP_MAGIC_NSEC || magic == bswap32_(PCAP_MAGIC_NSEC))
+                                ? NANOSECONDS_PER_SECOND
+                                : MICROSECONDS_PER_SECOND;
+                link_type_ = read32_(data_ + 20) & 0xFFFFU;
+                offset_ = PCAP_FILE_HEADER_SIZE;
+            }
+            else
+            {
+                throw std::runtime_error{"'" + file_path.u8string() + "' is not a pcap or pcapng file"};
+            }
+            // Always keep the next packet parsed so that exhaustion and pacing are known upfront
+            has_pending_ = read_record_();
+        }
+        catch (std::exception const &)
+        {
+            unmap_();
+            throw;
+        }
+        LOG_DEBUG << "Opened capture file '" << file_path.u8string() << "' (" << (pcapng_ ? "pcapng" : "pcap")
+                  << ", " << size_ << " bytes)";
+    }
+
+    PcapReader::~PcapReader()
+    {
+        unmap_();
+    }
+
+    bool PcapReader::next_batch(PacketBatch &batch, int const timeout_ms)
+    {
+        batch.clear();
+        if (mode_ == ReplayMode::Fast)
+        {
+            while (has_pending_ && !batch.full())
+            {
+                batch.push_back(pending_);
+                has_pending_ = read_record_();
+            }
+            return !batch.empty();
+        }
+
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (has_pending_ && !batch.full())
+        {
+            auto const now = std::chrono::steady_clock::now();
+            if (replay_start_ == std::chrono::steady_clock::time_point{})
+            {
+                replay_start_ = now;
+                first_timestamp_ns_ = pending_.timestamp_ns;
+            }
+            std::uint64_t const offset_ns = pending_.timestamp_ns > first_timestamp_ns_
+                                                ? pending_.timestamp_ns - first_timestamp_ns_
+                                                : 0;
+            auto const due = replay_start_ + std::chrono::nanoseconds(offset_ns);
+            if (due > now)
+            {
+                // Hand out what is due now rather than holding packets back for later ones
+                if (!batch.empty() || now >= deadline)
+                {
+                    break;
+                }
+#ifndef _WIN32
+                if (wakeup_fd_ >= 0)
+                {
+                    auto const wait = std::chrono::ceil<std::chrono::milliseconds>(std::min(due, deadline) - now);
+                    pollfd pfd{wakeup_fd_, POLLIN, 0};
+                    if (poll(&pfd, 1, static_cast<int>(wait.count())) > 0)
+                    {
+                        break;
+                    }
+                    continue;
+                }
+#endif
+                std::this_thread::sleep_until(std::min(due, deadline));
+                continue;
+            }
+            batch.push_back(pending_);
+            has_pending_ = read_record_();
+        }
+        return !batch.empty();
+    }
+
+    bool PcapReader::exhausted() const noexcept
+    {
+        return !has_pending_;
+    }
+
+    void PcapReader::set_wakeup_fd(int const fd) noexcept
+    {
+        wakeup_fd_ = fd;
+    }
+
+    std::uint32_t PcapReader::get_link_type() const noexcept
+    {
+        return link_type_;
+    }
+
+    void PcapReader::map_(std::filesystem::path const &file_path)
+    {
+        std::string const file_path_str = file_path.u8string();
+#ifdef _WIN32
+        std::ifstream file{file_path, std::ios::binary};
+        if (!file)
+        {
+            throw std::runtime_error{"Failed to open capture file '" + file_path_str + "'"};
+        }
+        buffer_.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+#else
+        int const fd = open(file_path_str.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error{"Failed to open capture file '" + file_path_str + "' - " + std::strerror(errno)};
+        }
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode))
+        {
+            close(fd);
+            throw std::runtime_error{"'" + file_path_str + "' is not a regular file"};
+        }
+        size_ = static_cast<std::size_t>(file_stat.st_size);
+        if (size_ > 0)
+        {
+            void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                int const error = errno;
+                close(fd);
+                size_ = 0;
+                throw std::runtime_error{"Failed to map capture file '" + file_path_str + "' - " + std::strerror(error)};
+            }
+            // Records are walked front to back - let the kernel read ahead aggressively
+            madvise(data, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<std::uint8_t const *>(data);
+        }
+        // The mapping stays valid after the descriptor is closed
+        close(fd);
+#endif
+        if (size_ == 0)
+        {
+            throw std::runtime_error{"Capture file '" + file_path_str + "' is empty"};
+        }
+    }
+
+    void PcapReader::unmap_() noexcept
+    {
+#ifndef _WIN32
+        if (data_)
+        {
+            munmap(const_cast<std::uint8_t *>(data_), size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    bool PcapReader::read_record_()
+    {
+        while (pcapng_ ? read_pcapng_block_() : read_pcap_record_())
+        {
+            if (!filter_ || filter_->matches(pending_.data, pending_.caplen))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool PcapReader::read_pcap_record_()
+    {
+        if (offset_ + PCAP_RECORD_HEADER_SIZE > size_)
+        {
+            if (offset_ != size_)
+            {
+                LOG_WARNING << "Capture file ends with a truncated record header";
+            }
+            return false;
+        }
+        std::uint8_t const *record = data_ + offset_;
+        std::uint32_t const caplen = read32_(record + 8);
+        if (caplen > size_ - offset_ - PCAP_RECORD_HEADER_SIZE)
+        {
+            LOG_WARNING << "Capture file ends with a truncated record";
+            return false;
+        }
+        std::uint64_t const timestamp = static_cast<std::uint64_t>(read32_(record)) * ts_units_ + read32_(record + 4);
+        pending_ = PacketView{record + PCAP_RECORD_HEADER_SIZE, caplen, read32_(record + 12),
+                              to_nanoseconds_(timestamp, ts_units_)};
+        offset_ += PCAP_RECORD_HEADER_SIZE + caplen;
+        return true;
+    }
+
+    bool PcapReader::read_pcapng_block_()
+    {
+        while (offset_ + PCAPNG_MIN_BLOCK_SIZE <= size_)
+        {
+            std::uint8_t const *block = data_ + offset_;
+            std::uint32_t const raw_type = load32_(block);
+            // A new section may switch the byte order, which is only known from its magic
+            if (raw_type == PCAPNG_SECTION_HEADER_BLOCK)
+            {
+                std::uint32_t const byte_order_magic = load32_(block + 8);
+                if (byte_order_magic != PCAPNG_BYTE_ORDER_MAGIC && byte_order_magic != bswap32_(PCAPNG_BYTE_ORDER_MAGIC))
+                {
+                    LOG_WARNING << "Capture file contains a corrupt pcapng section header";
+                    return false;
+                }
+                swapped_ = byte_order_magic != PCAPNG_BYTE_ORDER_MAGIC;
+            }
+            std::uint32_t const type = read32_(block);
+            std::uint32_t const length = read32_(block + 4);
+            if (length < PCAPNG_MIN_BLOCK_SIZE || length % 4 != 0 || length > size_ - offset_)
+            {
+                LOG_WARNING << "Capture file ends with a truncated pcapng block";
+                return false;
+            }
+            offset_ += length;
+
+            switch (type)
+            {
+            case PCAPNG_SECTION_HEADER_BLOCK:
+                // Interface ids are scoped to their section
+                interfaces_.clear();
+                break;
+            case PCAPNG_INTERFACE_DESCRIPTION_BLOCK:
+                read_pcapng_interface_(block, length);
+                break;
+            case PCAPNG_ENHANCED_PACKET_BLOCK:
+            {
+                std::uint32_t const interface_id = length >= 32 ? read32_(block + 8) : UNKNOWN_LINK_TYPE;
+                std::uint32_t const caplen = length >= 32 ? read32_(block + 20) : 0;
+                if (interface_id >= interfaces_.size() || interfaces_[interface_id].link_type == UNKNOWN_LINK_TYPE ||
+                    caplen > length - 32)
+                {
+                    LOG_DEBUG << "Skipping malformed enhanced packet block";
+                    break;
+                }
+                std::uint64_t const timestamp = (static_cast<std::uint64_t>(read32_(block + 12)) << 32) | read32_(block + 16);
+                pending_ = PacketView{block + 28, caplen, read32_(block + 24),
+                                      to_nanoseconds_(timestamp, interfaces_[interface_id].ts_units)};
+                return true;
+            }
+            case PCAPNG_SIMPLE_PACKET_BLOCK:
+            {
+                if (interfaces_.empty() || interfaces_.front().link_type == UNKNOWN_LINK_TYPE || length < 16)
+                {
+                    LOG_DEBUG << "Skipping malformed simple packet block";
+                    break;
+                }
+                std::uint32_t const wire_len = read32_(block + 8);
+                std::uint32_t caplen = std::min(wire_len, length - 16);
+                if (interfaces_.front().snaplen > 0)
+                {
+                    caplen = std::min(caplen, interfaces_.front().snaplen);
+                }
+                // Simple packet blocks carry no timestamp
+                pending_ = PacketView{block + 12, caplen, wire_len, 0};
+                return true;
+            }
+            default:
+                // Statistics, name resolution, custom blocks... are not needed for replay
+                break;
+            }
+        }
+        if (offset_ != size_)
+        {
+            LOG_WARNING << "Capture file ends with a truncated pcapng block";
+        }
+        return false;
+    }
+
+    void PcapReader::read_pcapng_interface_(std::uint8_t const *block, std::uint32_t const length)
+    {
+        if (length < 20)
+        {
+            // Still takes its id so that the following interfaces keep theirs, its packets are skipped
+            LOG_DEBUG << "Skipping malformed interface description block";
+            interfaces_.push_back(Interface{UNKNOWN_LINK_TYPE, 0, MICROSECONDS_PER_SECOND});
+            return;
+        }
+        Interface iface{read16_(block + 8), read32_(block + 12), MICROSECONDS_PER_SECOND};
+
+        // Options are TLVs padded to 32 bits, terminated by the trailing block length
+        std::size_t option = 16;
+        while (option + 4 <= length - 4)
+        {
+            std::uint16_t const code = read16_(block + option);
+            std::uint16_t const option_length = read16_(block + option + 2);
+            if (code == 0 || option + 4 + option_length > length - 4)
+            {
+                break;
+            }
+            if (code == PCAPNG_OPTION_IF_TSRESOL && option_length >= 1)
+            {
+                std::uint8_t const resolution = block[option + 4];
+                std::uint8_t const exponent = resolution & 0x7F;
+                iface.ts_units = 1;
+                for (std::uint8_t i = 0; i < exponent && iface.ts_units <= std::numeric_limits<std::uint64_t>::max() / 10; ++i)
+                {
+                    // High bit set means a power of two resolution, else a power of ten
+                    iface.ts_units *= (resolution & 0x80) ? 2 : 10;
+                }
+            }
+            option += 4 + ((option_length + 3U) & ~3U);
+        }
+
+        if (link_type_ == UNKNOWN_LINK_TYPE)
+        {
+            link_type_ = iface.link_type;
+        }
+        interfaces_.push_back(iface);
+    }
+
+    std::uint16_t PcapReader::read16_(std::uint8_t const *ptr) const noexcept
+    {
+        std::uint16_t value;
+        std::memcpy(&value, ptr, sizeof(value));
+        return swapped_ ? static_cast<std::uint16_t>((value >> 8) | (value << 8)) : value;
+    }
+
+    std::uint32_t PcapReader::read32_(std::uint8_t const *ptr) const noexcept
+    {
+        std::uint32_t const value = load32_(ptr);
+        return swapped_ ? bswap32_(value) : value;
+    }
+} // namespace overwatch::capture
@@ -0,0 +1,136 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "bpf_filter.hpp"
+#include "packet.hpp"
+#include "packet_source.hpp"
+
+namespace overwatch::capture
+{
+    /**
+     * Pacing of packets replayed from a capture file
+     */
+    enum class ReplayMode
+    {
+        // Hand out packets as fast as the pipeline consumes them
+        Fast,
+        // Hand out packets spaced by their original capture timestamps
+        OriginalTimestamps
+    };
+
+    /**
+     * Memory mapped reader for pcap and pcapng capture files.
+     *
+     * The whole file is mapped read-only and frames are handed out as views into the
+     * mapping, so replaying a capture costs no more than walking its record headers.
+     * Classic pcap (micro and nanosecond, either byte order) and pcapng (enhanced and
+     * simple packet blocks, multiple sections and interfaces) are supported.
+     */
+    class PcapReader : public PacketSource
+    {
+    public:
+        /**
+         * Maps the capture file and parses its file header
+         *
+         * @param[in] file_path Path to the pcap or pcapng file
+         * @param[in] mode Pacing of the replayed packets
+         * @param[in] filter Only packets accepted by the filter are replayed
+         * @throw std::runtime_error If the file cannot be mapped or is not a capture file
+         */
+        PcapReader(std::filesystem::path const &file_path, ReplayMode const mode = ReplayMode::Fast,
+                   std::optional<BpfFilter> filter = std::nullopt);
+        ~PcapReader() override;
+
+        PcapReader(PcapReader const &) = delete;
+        PcapReader &operator=(PcapReader const &) = delete;
+
+        bool next_batch(PacketBatch &batch, int const timeout_ms) override;
+        bool exhausted() const noexcept override;
+        void set_wakeup_fd(int const fd) noexcept override;
+
+        /**
+         * Link type of the first interface of the capture (1 is Ethernet)
+         * @return The link type of the capture file
+         */
+        std::uint32_t get_link_type() const noexcept;
+
+    private:
+        // Per interface information of a pcapng section
+        struct Interface
+        {
+            std::uint32_t link_type;
+            std::uint32_t snaplen;
+            // Timestamp units per second
+            std::uint64_t ts_units;
+        };
+
+        // Maps the file into memory
+        void map_(std::filesystem::path const &file_path);
+        // Releases the mapping
+        void unmap_() noexcept;
+        // Parses the next record accepted by the filter into the pending packet (returns false at the end of the file)
+        bool read_record_();
+        bool read_pcap_record_();
+        bool read_pcapng_block_();
+        // Parses a pcapng interface description block (a malformed one registers an interface whose packets are skipped)
+        void read_pcapng_interface_(std::uint8_t const *block, std::uint32_t const length);
+        // Reads integers in the byte order of the current file/section
+        std::uint16_t read16_(std::uint8_t const *ptr) const noexcept;
+        std::uint32_t read32_(std::uint8_t const *ptr) const noexcept;
+
+        // Pacing of the replay
+        ReplayMode const mode_;
+        // Filter applied to every record
+        std::optional<BpfFilter> const filter_;
+        // Start and size of the memory mapped file
+        std::uint8_t const *data_;
+        std::size_t size_;
+        // Backing storage on platforms without mmap
+        std::vector<std::uint8_t> buffer_;
+        // Offset of the next record to parse
+        std::size_t offset_;
+        // Format of the file
+        bool pcapng_;
+        // File/section byte order differs from the host byte order
+        bool swapped_;
+        // Timestamp units per second of a classic pcap file
+        std::uint64_t ts_units_;
+        // Link type of the first interface
+        std::uint32_t link_type_;
+        // Interfaces of the current pcapng section
+        std::vector<Interface> interfaces_;
+        // Packet parsed from the file but not handed out yet
+        PacketView pending_;
+        bool has_pending_;
+        // Timestamp of the first packet and the time it was replayed (used for pacing)
+        std::uint64_t first_timestamp_ns_;
+        std::chrono::steady_clock::time_point replay_start_;
+        // Descriptor that interrupts the pacing of a replay (-1 if none)
+        int wakeup_fd_;
+    };
+} // namespace overwatch::capture
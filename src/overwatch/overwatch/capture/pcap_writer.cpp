@@ -0,0 +1,88 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "pcap_writer.hpp"
+
+// Size of the stdio buffer, large enough to write whole batches at once
+#define PCAP_WRITE_BUFFER_SIZE (1 << 20)
+
+namespace overwatch::capture
+{
+    PcapWriter::PcapWriter(std::filesystem::path const &file_path, std::uint32_t const snaplen, std::uint32_t const link_type)
+        : file_{std::fopen(file_path.string().c_str(), "wb")}, buffer_(PCAP_WRITE_BUFFER_SIZE), snaplen_{snaplen}, packets_{0}
+    {
+        if (!file_)
+        {
+            throw std::runtime_error{"Failed to create '" + file_path.string() + "' - " + std::strerror(errno)};
+        }
+        std::setvbuf(file_, buffer_.data(), _IOFBF, buffer_.size());
+        PcapFileHeader const header{PCAP_MAGIC_NSEC, PCAP_VERSION_MAJOR, PCAP_VERSION_MINOR, 0, 0, snaplen_, link_type};
+        try
+        {
+            write_(&header, sizeof(header));
+        }
+        catch (...)
+        {
+            std::fclose(file_);
+            throw;
+        }
+    }
+
+    PcapWriter::~PcapWriter()
+    {
+        std::fclose(file_);
+    }
+
+    void PcapWriter::write(PacketView const &packet)
+    {
+        std::uint32_t const caplen = std::min(packet.caplen, snaplen_);
+        PcapRecordHeader const header = make_pcap_record_header(packet, caplen);
+        write_(&header, sizeof(header));
+        write_(packet.data, caplen);
+        ++packets_;
+    }
+
+    void PcapWriter::flush()
+    {
+        if (std::fflush(file_) != 0)
+        {
+            throw std::runtime_error{std::string{"Failed to flush the capture file - "} + std::strerror(errno)};
+        }
+    }
+
+    std::uint64_t PcapWriter::get_packets() const noexcept
+    {
+        return packets_;
+    }
+
+    void PcapWriter::write_(void const *data, std::size_t const size)
+    {
+        if (std::fwrite(data, 1, size, file_) != size)
+        {
+            throw std::runtime_error{std::string{"Failed to write the capture file - "} + std::strerror(errno)};
+        }
+    }
+} // namespace overwatch::capture
@@ -0,0 +1,126 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+#include "packet.hpp"
+
+// Pcap magic of files with nanosecond timestamps (written in host byte order)
+#define PCAP_MAGIC_NSEC 0xA1B23C4DU
+#define PCAP_VERSION_MAJOR 2
+#define PCAP_VERSION_MINOR 4
+
+namespace overwatch::capture
+{
+    /**
+     * Header at the start of a classic pcap file
+     */
+    struct PcapFileHeader
+    {
+        std::uint32_t magic;
+        std::uint16_t version_major;
+        std::uint16_t version_minor;
+        std::int32_t thiszone;
+        std::uint32_t sigfigs;
+        std::uint32_t snaplen;
+        std::uint32_t link_type;
+    };
+    static_assert(sizeof(PcapFileHeader) == 24, "PcapFileHeader must stay packed");
+
+    /**
+     * Header in front of every frame of a classic pcap file (nanosecond timestamps)
+     */
+    struct PcapRecordHeader
+    {
+        std::uint32_t ts_sec;
+        std::uint32_t ts_nsec;
+        std::uint32_t caplen;
+        std::uint32_t len;
+    };
+    static_assert(sizeof(PcapRecordHeader) == 16, "PcapRecordHeader must stay packed");
+
+    /**
+     * Builds the header of a frame
+     *
+     * @param[in] packet The frame
+     * @param[in] caplen Number of bytes of the frame stored in the file
+     * @return The record header
+     */
+    inline PcapRecordHeader make_pcap_record_header(PacketView const &packet, std::uint32_t const caplen) noexcept
+    {
+        return PcapRecordHeader{static_cast<std::uint32_t>(packet.timestamp_ns / 1000000000ULL),
+                                static_cast<std::uint32_t>(packet.timestamp_ns % 1000000000ULL), caplen, packet.wire_len};
+    }
+
+    /**
+     * Buffered writer of classic pcap files with nanosecond timestamps
+     */
+    class PcapWriter
+    {
+    public:
+        /**
+         * Creates (or truncates) the file and writes its header
+         *
+         * @param[in] file_path Path of the capture file
+         * @param[in] snaplen Frames are cut to this many bytes
+         * @param[in] link_type Link type of the frames (1 is Ethernet)
+         * @throw std::runtime_error If the file cannot be created
+         */
+        explicit PcapWriter(std::filesystem::path const &file_path, std::uint32_t const snaplen = 65535,
+                            std::uint32_t const link_type = 1);
+        ~PcapWriter();
+
+        PcapWriter(PcapWriter const &) = delete;
+        PcapWriter &operator=(PcapWriter const &) = delete;
+
+        /**
+         * Appends a frame to the file
+         *
+         * @param[in] packet The frame (cut to the snaplen of the file)
+         * @throw std::runtime_error If writing fails
+         */
+        void write(PacketView const &packet);
+        /**
+         * Writes the buffered frames to the file
+         * @throw std::runtime_error If writing fails
+         */
+        void flush();
+        /**
+         * Number of frames written
+         * @return The number of frames
+         */
+        std::uint64_t get_packets() const noexcept;
+
+    private:
+        // Writes a block of bytes through the stdio buffer
+        void write_(void const *data, std::size_t const size);
+
+        std::FILE *file_;
+        // Backing storage of the stdio buffer
+        std::vector<char> buffer_;
+        std::uint32_t const snaplen_;
+        std::uint64_t packets_;
+    };
+} // namespace overwatch::capture
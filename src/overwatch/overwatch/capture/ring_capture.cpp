@@ -0,0 +1,345 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "logging.hpp"
+#include "ring_capture.hpp"
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+// Added in Linux 4.20, older headers lack it
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+namespace overwatch::capture
+{
+#ifdef __linux__
+    namespace
+    {
+        /**
+         * Builds an exception out of the current errno
+         *
+         * @param[in] what Description of the failed operation
+         * @return The exception to throw
+         */
+        std::runtime_error system_error_(std::string const &what)
+        {
+            return std::runtime_error{what + " - " + std::strerror(errno)};
+        }
+
+        /**
+         * Gets the descriptor of a block in the ring
+         *
+         * @param[in] ring Start of the ring
+         * @param[in] block_size Size of a single block
+         * @param[in] index Index of the block
+         * @return The block descriptor
+         */
+        tpacket_block_desc *block_desc_(std::uint8_t *ring, std::uint32_t const block_size,
+                                        std::uint32_t const index) noexcept
+        {
+            return reinterpret_cast<tpacket_block_desc *>(ring + static_cast<std::size_t>(block_size) * index);
+        }
+    } // namespace
+
+    RingCapture::RingCapture(std::string const &iface, RingOptions const &options)
+        : iface_{iface}, options_{options}, fd_{-1}, ring_{nullptr}, ring_size_{0},
+          block_index_{0}, next_frame_{nullptr}, frames_left_{0}, wakeup_fd_{-1}
+    {
+        try
+        {
+            open_();
+        }
+        catch (std::exception const &)
+        {
+            close_();
+            throw;
+        }
+    }
+
+    RingCapture::~RingCapture()
+    {
+        close_();
+    }
+
+    bool RingCapture::next_batch(PacketBatch &batch, int const timeout_ms)
+    {
+        batch.clear();
+        // Every frame of the current block was handed out by the previous batch
+        if (next_frame_ && frames_left_ == 0)
+        {
+            release_block_();
+        }
+        if (!next_frame_)
+        {
+            if (!wait_for_block_(timeout_ms))
+            {
+                return false;
+            }
+            tpacket_block_desc const *desc = block_desc_(ring_, options_.block_size, block_index_);
+            frames_left_ = desc->hdr.bh1.num_pkts;
+            next_frame_ = reinterpret_cast<std::uint8_t const *>(desc) + desc->hdr.bh1.offset_to_first_pkt;
+        }
+
+        // Walk the frames in place - the views point straight into the ring
+        while (frames_left_ > 0 && !batch.full())
+        {
+            tpacket3_hdr const *hdr = reinterpret_cast<tpacket3_hdr const *>(next_frame_);
+            batch.push_back(PacketView{next_frame_ + hdr->tp_mac, hdr->tp_snaplen, hdr->tp_len,
+                                       hdr->tp_sec * NANOSECONDS_PER_SECOND + hdr->tp_nsec});
+            next_frame_ += hdr->tp_next_offset;
+            --frames_left_;
+        }
+        return !batch.empty();
+    }
+
+    void RingCapture::set_wakeup_fd(int const fd) noexcept
+    {
+        wakeup_fd_ = fd;
+    }
+
+    std::uint64_t RingCapture::take_drops() noexcept
+    {
+        tpacket_stats_v3 stats{};
+        socklen_t len = sizeof(stats);
+        if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0)
+        {
+            return 0;
+        }
+        return stats.tp_drops;
+    }
+
+    std::optional<std::uint64_t> RingCapture::now_ns() const noexcept
+    {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    int RingCapture::get_fd() const noexcept
+    {
+        return fd_;
+    }
+
+    std::string const &RingCapture::get_interface() const noexcept
+    {
+        return iface_;
+    }
+
+    void RingCapture::open_()
+    {
+        std::uint32_t const page_size = static_cast<std::uint32_t>(sysconf(_SC_PAGESIZE));
+        if (options_.block_count == 0 || options_.block_size == 0 || options_.block_size % page_size != 0)
+        {
+            throw std::invalid_argument{"Capture ring block size must be a non-zero multiple of the page size"};
+        }
+        else if (options_.frame_size < TPACKET3_HDRLEN || options_.frame_size % TPACKET_ALIGNMENT != 0 ||
+                 options_.block_size % options_.frame_size != 0)
+        {
+            throw std::invalid_argument{"Capture ring frame size must be aligned and divide the block size"};
+        }
+
+        unsigned int const ifindex = if_nametoindex(iface_.c_str());
+        if (ifindex == 0)
+        {
+            throw std::runtime_error{"Interface '" + iface_ + "' does not exist"};
+        }
+
+        // No protocol until the ring is bound so frames are not queued on the slow path
+        fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+        if (fd_ < 0)
+        {
+            throw system_error_("Failed to open capture socket on '" + iface_ + "'");
+        }
+
+        int const version = TPACKET_V3;
+        if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+        {
+            throw system_error_("Failed to enable TPACKET_V3 on '" + iface_ + "'");
+        }
+
+        // Filter before binding so that unwanted frames never reach the ring
+        if (options_.filter)
+        {
+            options_.filter->attach(fd_);
+        }
+
+        tpacket_req3 req{};
+        req.tp_block_size = options_.block_size;
+        req.tp_block_nr = options_.block_count;
+        req.tp_frame_size = options_.frame_size;
+        req.tp_frame_nr = (options_.block_size / options_.frame_size) * options_.block_count;
+        req.tp_retire_blk_tov = options_.block_timeout_ms;
+        req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+        if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+        {
+            throw system_error_("Failed to allocate the capture ring on '" + iface_ + "'");
+        }
+
+        ring_size_ = static_cast<std::size_t>(options_.block_size) * options_.block_count;
+        void *ring = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+        if (ring == MAP_FAILED)
+        {
+            ring_size_ = 0;
+            throw system_error_("Failed to map the capture ring on '" + iface_ + "'");
+        }
+        ring_ = static_cast<std::uint8_t *>(ring);
+
+        sockaddr_ll addr{};
+        addr.sll_family = AF_PACKET;
+        addr.sll_protocol = htons(ETH_P_ALL);
+        addr.sll_ifindex = static_cast<int>(ifindex);
+        if (bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            throw system_error_("Failed to bind the capture socket to '" + iface_ + "'");
+        }
+
+        // Joining a fanout group is only allowed once the socket is bound
+        if (options_.fanout_mode != FanoutMode::None)
+        {
+            int const type = options_.fanout_mode == FanoutMode::Hash
+                                 ? (PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG)
+                                 : PACKET_FANOUT_CPU;
+            int const fanout = options_.fanout_group | (type << 16);
+            if (setsockopt(fd_, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0)
+            {
+                throw system_error_("Failed to join fanout group " + std::to_string(options_.fanout_group) +
+                                    " on '" + iface_ + "'");
+            }
+        }
+
+        if (options_.ignore_outgoing)
+        {
+            int const ignore = 1;
+            if (setsockopt(fd_, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore, sizeof(ignore)) < 0)
+            {
+                throw system_error_("Failed to ignore outgoing frames on '" + iface_ + "'");
+            }
+        }
+
+        if (options_.promiscuous)
+        {
+            packet_mreq mreq{};
+            mreq.mr_ifindex = static_cast<int>(ifindex);
+            mreq.mr_type = PACKET_MR_PROMISC;
+            if (setsockopt(fd_, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+            {
+                throw system_error_("Failed to enable promiscuous mode on '" + iface_ + "'");
+            }
+        }
+        LOG_DEBUG << "Opened capture ring on '" << iface_ << "' (" << options_.block_count
+                  << " blocks of " << options_.block_size << " bytes)";
+    }
+
+    void RingCapture::close_() noexcept
+    {
+        if (ring_)
+        {
+            munmap(ring_, ring_size_);
+            ring_ = nullptr;
+            ring_size_ = 0;
+        }
+        if (fd_ >= 0)
+        {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    void RingCapture::release_block_() noexcept
+    {
+        tpacket_block_desc *desc = block_desc_(ring_, options_.block_size, block_index_);
+        __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        block_index_ = (block_index_ + 1) % options_.block_count;
+        next_frame_ = nullptr;
+        frames_left_ = 0;
+    }
+
+    bool RingCapture::wait_for_block_(int const timeout_ms)
+    {
+        tpacket_block_desc *desc = block_desc_(ring_, options_.block_size, block_index_);
+        if (__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)
+        {
+            return true;
+        }
+
+        pollfd pfds[2] = {{fd_, POLLIN | POLLERR, 0}, {wakeup_fd_, POLLIN, 0}};
+        if (poll(pfds, wakeup_fd_ >= 0 ? 2 : 1, timeout_ms) < 0 && errno != EINTR)
+        {
+            throw system_error_("Failed to poll the capture ring on '" + iface_ + "'");
+        }
+        return (__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) != 0;
+    }
+#else
+    RingCapture::RingCapture(std::string const &iface, RingOptions const &options)
+        : iface_{iface}, options_{options}, fd_{-1}, ring_{nullptr}, ring_size_{0},
+          block_index_{0}, next_frame_{nullptr}, frames_left_{0}, wakeup_fd_{-1}
+    {
+        throw std::runtime_error{"Live capture is only supported on Linux"};
+    }
+
+    RingCapture::~RingCapture()
+    {
+    }
+
+    bool RingCapture::next_batch(PacketBatch &batch, int const)
+    {
+        batch.clear();
+        return false;
+    }
+
+    void RingCapture::set_wakeup_fd(int const fd) noexcept
+    {
+        wakeup_fd_ = fd;
+    }
+
+    std::uint64_t RingCapture::take_drops() noexcept
+    {
+        return 0;
+    }
+
+    std::optional<std::uint64_t> RingCapture::now_ns() const noexcept
+    {
+        return std::nullopt;
+    }
+
+    int RingCapture::get_fd() const noexcept
+    {
+        return fd_;
+    }
+
+    std::string const &RingCapture::get_interface() const noexcept
+    {
+        return iface_;
+    }
+#endif
+} // namespace overwatch::capture
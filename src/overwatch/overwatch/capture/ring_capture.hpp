@@ -0,0 +1,158 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "bpf_filter.hpp"
+#include "packet.hpp"
+#include "packet_source.hpp"
+
+namespace overwatch::capture
+{
+    /**
+     * Distribution of frames between the sockets of a fanout group
+     */
+    enum class FanoutMode
+    {
+        // The socket is not part of a fanout group
+        None,
+        // Frames are spread by a symmetric flow hash (both directions of a flow land on the same socket)
+        Hash,
+        // Frames are handled by the socket of the CPU that received them (pairs with RSS/IRQ affinity)
+        Cpu
+    };
+
+    /**
+     * Tuning of the memory mapped receive ring
+     */
+    struct RingOptions
+    {
+        // Size of a single block in bytes (must be a multiple of the page size)
+        std::uint32_t block_size = 1U << 22;
+        // Number of blocks in the ring
+        std::uint32_t block_count = 32;
+        // Nominal frame size used by the kernel to size the ring
+        std::uint32_t frame_size = 2048;
+        // Time after which the kernel retires a partially filled block
+        std::uint32_t block_timeout_ms = 10;
+        // Puts the interface in promiscuous mode while capturing
+        bool promiscuous = true;
+        // Fanout group the socket joins to share the interface with other rings
+        FanoutMode fanout_mode = FanoutMode::None;
+        std::uint16_t fanout_group = 0;
+        // Skips the frames sent by the host itself (only received frames reach the ring)
+        bool ignore_outgoing = false;
+        // Socket filter run by the kernel before frames reach the ring
+        std::optional<BpfFilter> filter = std::nullopt;
+    };
+
+    /**
+     * Zero-copy packet capture from a network interface.
+     *
+     * Opens an AF_PACKET socket with a memory mapped TPACKET_V3 receive ring. The kernel
+     * fills whole blocks of frames and hands them over at once, so a single poll() serves
+     * many packets. Frames are walked in place and handed out as views into the ring;
+     * a block is only returned to the kernel once every frame in it was consumed.
+     */
+    class RingCapture : public PacketSource
+    {
+    public:
+        /**
+         * Opens the capture ring on the interface
+         *
+         * @param[in] iface Name of the interface to capture on
+         * @param[in] options Tuning of the receive ring
+         * @throw std::invalid_argument If the ring options are invalid
+         * @throw std::runtime_error If the socket or ring could not be set up
+         */
+        RingCapture(std::string const &iface, RingOptions const &options = RingOptions{});
+        ~RingCapture() override;
+
+        RingCapture(RingCapture const &) = delete;
+        RingCapture &operator=(RingCapture const &) = delete;
+
+        /**
+         * Fills the batch with the next frames of the ring.
+         *
+         * Views handed out by the previous call are invalidated.
+         *
+         * @param[out] batch The batch to fill
+         * @param[in] timeout_ms Time to wait for the kernel to retire a block
+         * @return True if at least one packet was added to the batch
+         * @throw std::runtime_error If polling the socket fails
+         */
+        bool next_batch(PacketBatch &batch, int const timeout_ms) override;
+        void set_wakeup_fd(int const fd) noexcept override;
+        /**
+         * Reads the drop counter of the socket (PACKET_STATISTICS), which the kernel resets on every read
+         * @return The number of packets dropped since the previous call
+         */
+        std::uint64_t take_drops() noexcept override;
+        /**
+         * Wall clock time, the clock the kernel stamps the frames with
+         * @return The current time
+         */
+        std::optional<std::uint64_t> now_ns() const noexcept override;
+
+        /**
+         * Underlying socket descriptor of the ring
+         * @return The socket file descriptor
+         */
+        int get_fd() const noexcept;
+        /**
+         * Name of the interface being captured
+         * @return The interface name
+         */
+        std::string const &get_interface() const noexcept;
+
+    private:
+        // Creates the socket, maps the ring and binds it to the interface
+        void open_();
+        // Releases the socket and the ring mapping
+        void close_() noexcept;
+        // Hands the current block back to the kernel and moves to the next one
+        void release_block_() noexcept;
+        // Waits until the current block is owned by user space
+        bool wait_for_block_(int const timeout_ms);
+
+        // Name of the captured interface
+        std::string const iface_;
+        // Ring configuration
+        RingOptions const options_;
+        // AF_PACKET socket
+        int fd_;
+        // Start of the memory mapped ring
+        std::uint8_t *ring_;
+        // Size of the memory mapped ring in bytes
+        std::size_t ring_size_;
+        // Index of the block currently walked
+        std::uint32_t block_index_;
+        // Next frame within the current block (null if the block has not been opened yet)
+        std::uint8_t const *next_frame_;
+        // Frames left to walk in the current block
+        std::uint32_t frames_left_;
+        // Descriptor that interrupts the wait for a block (-1 if none)
+        int wakeup_fd_;
+    };
+} // namespace overwatch::capture
@@ -0,0 +1,283 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "logging.hpp"
+#include "tx_ring.hpp"
+
+namespace overwatch::capture
+{
+#ifdef __linux__
+    namespace
+    {
+        // Offset of the frame within a slot
+        constexpr std::size_t FRAME_OFFSET = TPACKET2_HDRLEN - sizeof(sockaddr_ll);
+
+        /**
+         * Builds an exception out of the current errno
+         *
+         * @param[in] what Description of the failed operation
+         * @return The exception to throw
+         */
+        std::runtime_error system_error_(std::string const &what)
+        {
+            return std::runtime_error{what + " - " + std::strerror(errno)};
+        }
+    } // namespace
+
+    TxRing::TxRing(std::string const &iface, TxRingOptions const &options)
+        : iface_{iface}, options_{options}, fd_{-1}, ring_{nullptr}, ring_size_{0}, slot_index_{0}, pending_{0}
+    {
+        try
+        {
+            open_();
+        }
+        catch (std::exception const &)
+        {
+            close_();
+            throw;
+        }
+    }
+
+    TxRing::~TxRing()
+    {
+        close_();
+    }
+
+    std::uint8_t *TxRing::claim() noexcept
+    {
+        tpacket2_hdr *hdr = reinterpret_cast<tpacket2_hdr *>(ring_ + static_cast<std::size_t>(options_.frame_size) * slot_index_);
+        std::uint32_t const status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+        // Malformed frames are dropped by the kernel (PACKET_LOSS) and leave their slot reusable
+        if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT)
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<std::uint8_t *>(hdr) + FRAME_OFFSET;
+    }
+
+    void TxRing::commit(std::size_t const length) noexcept
+    {
+        tpacket2_hdr *hdr = reinterpret_cast<tpacket2_hdr *>(ring_ + static_cast<std::size_t>(options_.frame_size) * slot_index_);
+        hdr->tp_len = static_cast<std::uint32_t>(length);
+        hdr->tp_snaplen = static_cast<std::uint32_t>(length);
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+        slot_index_ = (slot_index_ + 1) % options_.frame_count;
+        ++pending_;
+    }
+
+    bool TxRing::send(std::uint8_t const *frame, std::size_t const length) noexcept
+    {
+        if (length > max_frame_size())
+        {
+            return false;
+        }
+        std::uint8_t *slot = claim();
+        if (!slot)
+        {
+            return false;
+        }
+        std::memcpy(slot, frame, length);
+        commit(length);
+        return true;
+    }
+
+    std::size_t TxRing::flush()
+    {
+        std::size_t const flushed = pending_;
+        if (flushed == 0)
+        {
+            return 0;
+        }
+        pending_ = 0;
+        // The kernel walks the ring from its own position and sends every requested slot
+        if (::send(fd_, nullptr, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS && errno != EINTR)
+        {
+            throw system_error_("Failed to flush the transmit ring on '" + iface_ + "'");
+        }
+        return flushed;
+    }
+
+    std::size_t TxRing::max_frame_size() const noexcept
+    {
+        return options_.frame_size - FRAME_OFFSET;
+    }
+
+    std::size_t TxRing::pending() const noexcept
+    {
+        return pending_;
+    }
+
+    int TxRing::get_fd() const noexcept
+    {
+        return fd_;
+    }
+
+    void TxRing::open_()
+    {
+        std::uint32_t const page_size = static_cast<std::uint32_t>(sysconf(_SC_PAGESIZE));
+        if (options_.frame_count == 0 || options_.frame_size < TPACKET2_HDRLEN + ETH_HLEN ||
+            options_.frame_size % TPACKET_ALIGNMENT != 0 ||
+            (page_size % options_.frame_size != 0 && options_.frame_size % page_size != 0))
+        {
+            throw std::invalid_argument{"Transmit ring frame size must be aligned and divide or be a multiple of the page size"};
+        }
+
+        unsigned int const ifindex = if_nametoindex(iface_.c_str());
+        if (ifindex == 0)
+        {
+            throw std::runtime_error{"Interface '" + iface_ + "' does not exist"};
+        }
+
+        // No protocol - the socket only sends and never queues received frames
+        fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+        if (fd_ < 0)
+        {
+            throw system_error_("Failed to open transmit socket on '" + iface_ + "'");
+        }
+
+        int const version = TPACKET_V2;
+        if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+        {
+            throw system_error_("Failed to enable TPACKET_V2 on '" + iface_ + "'");
+        }
+        // Drop malformed frames instead of stalling the ring on them
+        int const loss = 1;
+        if (setsockopt(fd_, SOL_PACKET, PACKET_LOSS, &loss, sizeof(loss)) < 0)
+        {
+            throw system_error_("Failed to set the transmit loss mode on '" + iface_ + "'");
+        }
+        // Frames are already shaped by their sender - skip the queueing discipline when possible
+        int const bypass = 1;
+        if (setsockopt(fd_, SOL_PACKET, PACKET_QDISC_BYPASS, &bypass, sizeof(bypass)) < 0)
+        {
+            LOG_DEBUG << "Transmit ring on '" << iface_ << "' goes through the queueing discipline";
+        }
+
+        // Blocks hold whole frames and are made of whole pages
+        std::uint32_t const block_size = options_.frame_size < page_size ? page_size : options_.frame_size;
+        std::uint32_t const frames_per_block = block_size / options_.frame_size;
+        std::uint32_t const block_count = (options_.frame_count + frames_per_block - 1) / frames_per_block;
+        tpacket_req req{};
+        req.tp_block_size = block_size;
+        req.tp_block_nr = block_count;
+        req.tp_frame_size = options_.frame_size;
+        req.tp_frame_nr = block_count * frames_per_block;
+        if (req.tp_frame_nr != options_.frame_count)
+        {
+            throw std::invalid_argument{"Transmit ring frame count must fill whole pages"};
+        }
+        if (setsockopt(fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+        {
+            throw system_error_("Failed to allocate the transmit ring on '" + iface_ + "'");
+        }
+
+        ring_size_ = static_cast<std::size_t>(block_size) * block_count;
+        void *ring = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+        if (ring == MAP_FAILED)
+        {
+            ring_size_ = 0;
+            throw system_error_("Failed to map the transmit ring on '" + iface_ + "'");
+        }
+        ring_ = static_cast<std::uint8_t *>(ring);
+
+        sockaddr_ll addr{};
+        addr.sll_family = AF_PACKET;
+        addr.sll_ifindex = static_cast<int>(ifindex);
+        if (bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            throw system_error_("Failed to bind the transmit socket to '" + iface_ + "'");
+        }
+        LOG_DEBUG << "Opened transmit ring on '" << iface_ << "' (" << options_.frame_count << " frames of "
+                  << options_.frame_size << " bytes)";
+    }
+
+    void TxRing::close_() noexcept
+    {
+        if (ring_)
+        {
+            munmap(ring_, ring_size_);
+            ring_ = nullptr;
+            ring_size_ = 0;
+        }
+        if (fd_ >= 0)
+        {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+#else
+    TxRing::TxRing(std::string const &iface, TxRingOptions const &options)
+        : iface_{iface}, options_{options}, fd_{-1}, ring_{nullptr}, ring_size_{0}, slot_index_{0}, pending_{0}
+    {
+        throw std::runtime_error{"Frame injection is only supported on Linux"};
+    }
+
+    TxRing::~TxRing()
+    {
+    }
+
+    std::uint8_t *TxRing::claim() noexcept
+    {
+        return nullptr;
+    }
+
+    void TxRing::commit(std::size_t const) noexcept
+    {
+    }
+
+    bool TxRing::send(std::uint8_t const *, std::size_t const) noexcept
+    {
+        return false;
+    }
+
+    std::size_t TxRing::flush()
+    {
+        return 0;
+    }
+
+    std::size_t TxRing::max_frame_size() const noexcept
+    {
+        return 0;
+    }
+
+    std::size_t TxRing::pending() const noexcept
+    {
+        return pending_;
+    }
+
+    int TxRing::get_fd() const noexcept
+    {
+        return fd_;
+    }
+#endif
+} // namespace overwatch::capture
@@ -0,0 +1,132 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace overwatch::capture
+{
+    /**
+     * Tuning of the memory mapped transmit ring
+     */
+    struct TxRingOptions
+    {
+        // Size of a single frame slot in bytes (header included)
+        std::uint32_t frame_size = 2048;
+        // Number of frame slots in the ring
+        std::uint32_t frame_count = 512;
+    };
+
+    /**
+     * Batched frame injection into a network interface.
+     *
+     * Opens an AF_PACKET socket with a memory mapped TPACKET_V2 transmit ring. Frames are
+     * written straight into the slots shared with the kernel and a single flush() hands
+     * every queued slot over at once, so a burst costs one system call instead of one
+     * per frame.
+     */
+    class TxRing
+    {
+    public:
+        /**
+         * Opens the transmit ring on the interface
+         *
+         * @param[in] iface Name of the interface to send on
+         * @param[in] options Tuning of the transmit ring
+         * @throw std::invalid_argument If the ring options are invalid
+         * @throw std::runtime_error If the socket or ring could not be set up
+         */
+        TxRing(std::string const &iface, TxRingOptions const &options = TxRingOptions{});
+        ~TxRing();
+
+        TxRing(TxRing const &) = delete;
+        TxRing &operator=(TxRing const &) = delete;
+
+        /**
+         * Claims the next free slot to build a frame in place.
+         *
+         * The frame is only queued once commit() is called.
+         *
+         * @return The start of the slot's frame buffer (max_frame_size() bytes) or nullptr if the ring is full
+         */
+        std::uint8_t *claim() noexcept;
+        /**
+         * Queues the frame built in the slot returned by the last claim()
+         *
+         * @param[in] length Length of the frame in bytes
+         */
+        void commit(std::size_t const length) noexcept;
+        /**
+         * Copies a frame into the next free slot and queues it
+         *
+         * @param[in] frame The frame starting at the Ethernet header
+         * @param[in] length Length of the frame in bytes
+         * @return False if the frame is too large or the ring is full
+         */
+        bool send(std::uint8_t const *frame, std::size_t const length) noexcept;
+        /**
+         * Hands every queued frame to the kernel without waiting for them to be sent
+         *
+         * @return Number of frames handed over
+         * @throw std::runtime_error If the kernel refuses the frames
+         */
+        std::size_t flush();
+
+        /**
+         * Largest frame a slot can hold
+         * @return The size in bytes
+         */
+        std::size_t max_frame_size() const noexcept;
+        /**
+         * Number of frames queued since the last flush
+         * @return The number of frames
+         */
+        std::size_t pending() const noexcept;
+        /**
+         * Underlying socket descriptor of the ring
+         * @return The socket file descriptor
+         */
+        int get_fd() const noexcept;
+
+    private:
+        // Creates the socket, maps the ring and binds it to the interface
+        void open_();
+        // Releases the socket and the ring mapping
+        void close_() noexcept;
+
+        // Name of the interface frames are sent on
+        std::string const iface_;
+        // Ring configuration
+        TxRingOptions const options_;
+        // AF_PACKET socket
+        int fd_;
+        // Start of the memory mapped ring
+        std::uint8_t *ring_;
+        // Size of the memory mapped ring in bytes
+        std::size_t ring_size_;
+        // Index of the next slot to fill
+        std::uint32_t slot_index_;
+        // Frames queued since the last flush
+        std::size_t pending_;
+    };
+} // namespace overwatch::capture
@@ -1,10 +1,16 @@
 #include <ostream>
+#include <stdexcept>
+#include <string>
 
 #include "argument_parser.hpp"
+#include "config.hpp"
 
 #define ARG_ARPSPOOF_HOST_ABRV "-a"
 #define ARG_INTERFACE_ABRV "-i"
 #define ARG_LOGGING_ABRV "-l"
+#define ARG_READ_ABRV "-r"
+#define ARG_TARGETS_ABRV "-t"
+#define ARG_WORKERS_ABRV "-w"
 
 namespace overwatch::core
 {
@@ -17,21 +23,65 @@ namespace overwatch::core
     void ArgumentParser::parse_args(int const argc, char const *const *const argv)
     {
         internal_parser_.parse_args(argc, argv);
+        // The target may only be left out if the targets are listed in a file
+        if (internal_parser_.get<std::string>(ARG_TARGET).empty() && !internal_parser_.present<std::string>(ARG_TARGETS))
+        {
+            throw std::runtime_error{ARG_TARGET ": required unless " ARG_TARGETS " is given."};
+        }
     }
 
     void ArgumentParser::init_parser_args_() noexcept
     {
         internal_parser_.add_argument(ARG_ARPSPOOF_HOST_ABRV, ARG_ARPSPOOF_HOST)
             .help("IP of host to intercept packets for (HOST is usually the local gateway)");
+        internal_parser_.add_argument(ARG_EXPORT)
+            .help("Export the flow records in the IPFIX format to a file or a collector (fmt: '<path>' or '" EXPORT_UDP_PREFIX "<ip>[:<port>]')");
         internal_parser_.add_argument(ARG_INTERFACE_ABRV, ARG_INTERFACE)
             .help("The interface to watch for network traffic")
             .default_value(std::string{ "eth0" });
         internal_parser_.add_argument(ARG_LOGGING_ABRV, ARG_LOGGING)
-            .help("Logging (fmt: '<optional_logging_path>:<logging_severity>')")
+            .help("Logging (fmt: '<optional_logging_path>:<logging_severity>[:<sync|async>]')")
             .default_value(static_cast<std::string>(":info"));
+        internal_parser_.add_argument(ARG_READ_ABRV, ARG_READ)
+            .help("Pcap/pcapng file to analyze instead of watching the interface");
+        internal_parser_.add_argument(ARG_REPLAY)
+            .help("Pacing of packets read from a file (fmt: '" REPLAY_MODE_FAST "' or '" REPLAY_MODE_ORIGINAL "')")
+            .default_value(std::string{ REPLAY_MODE_FAST });
+        internal_parser_.add_argument(ARG_RULES)
+            .help("File of signatures to match against the targets' traffic (one '<name> \"<literal>\"' or '<name> /<regex>/' per line, 'i' after the pattern ignores case)");
+        internal_parser_.add_argument(ARG_STATS_INTERVAL)
+            .help("Seconds between two reports of the runtime statistics (0 disables the reports)")
+            .default_value(std::size_t{ 0 })
+            .scan<'u', std::size_t>();
+        internal_parser_.add_argument(ARG_STATS_OUTPUT)
+            .help("Also write the statistics in the Prometheus text format to a file or serve them on a UNIX socket (fmt: '<path>' or '" STATS_SOCKET_PREFIX "<path>')");
+        internal_parser_.add_argument(ARG_SUMMARY_INTERVAL)
+            .help("Seconds between two summaries of every target's heaviest peers and ports and of its number of distinct peers and ports, over the last " +
+                  std::to_string(SUMMARY_WINDOWS) + " intervals (0 disables the summaries)")
+            .default_value(std::size_t{ 0 })
+            .scan<'u', std::size_t>();
+        internal_parser_.add_argument(ARG_TARGETS_ABRV, ARG_TARGETS)
+            .help("File listing additional targets to overwatch (one IP address or CIDR range per line, '#' starts a comment)");
+        internal_parser_.add_argument(ARG_WORKERS_ABRV, ARG_WORKERS)
+            .help("Number of capture workers, each pinned to its own core (0 uses every available core)")
+            .default_value(std::size_t{ 1 })
+            .scan<'u', std::size_t>();
+        internal_parser_.add_argument(ARG_WRITE)
+            .help("Directory to record the targets' packets to, in pcap files rotated by size and age");
+        internal_parser_.add_argument(ARG_WRITE_SIZE)
+            .help("Size in MiB after which a recorded file is rotated")
+            .default_value(std::size_t{ DEFAULT_WRITE_SIZE })
+            .scan<'u', std::size_t>();
+        internal_parser_.add_argument(ARG_WRITE_INTERVAL)
+            .help("Seconds after which a recorded file is rotated")
+            .default_value(std::size_t{ DEFAULT_WRITE_INTERVAL })
+            .scan<'u', std::size_t>();
+        internal_parser_.add_argument(ARG_FANOUT)
+            .help("Distribution of packets between workers (fmt: '" FANOUT_MODE_HASH "' or '" FANOUT_MODE_CPU "')")
+            .default_value(std::string{ FANOUT_MODE_HASH });
         internal_parser_.add_argument(ARG_TARGET)
-            .help("Target IP to overwatch")
-            .required();
+            .help("Target IP address, CIDR range or comma separated list of them to overwatch (optional with --targets)")
+            .default_value(std::string{ "" });
     }
 
     std::string ArgumentParser::get_usage() noexcept
@@ -24,8 +24,21 @@
 #define ARG_TARGET "target"
 // Optional args
 #define ARG_ARPSPOOF_HOST "--arpspoof"
+#define ARG_EXPORT "--export"
+#define ARG_FANOUT "--fanout"
 #define ARG_INTERFACE "--interface"
 #define ARG_LOGGING "--logging"
+#define ARG_READ "--read"
+#define ARG_REPLAY "--replay"
+#define ARG_RULES "--rules"
+#define ARG_STATS_INTERVAL "--stats-interval"
+#define ARG_STATS_OUTPUT "--stats-output"
+#define ARG_SUMMARY_INTERVAL "--summary-interval"
+#define ARG_TARGETS "--targets"
+#define ARG_WORKERS "--workers"
+#define ARG_WRITE "--write"
+#define ARG_WRITE_INTERVAL "--write-interval"
+#define ARG_WRITE_SIZE "--write-size"
 
 namespace overwatch::core
 {
@@ -43,6 +56,7 @@ namespace overwatch::core
          * Parses arguments from the user
          * @param[in] argc Number of arguments
          * @param[in] argv Argument values
+         * @throw std::runtime_error If the arguments are invalid or neither a target nor a targets file is given
          */
         void parse_args(int const argc, char const *const *const argv);
         /**
@@ -0,0 +1,181 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace overwatch::core
+{
+    /**
+     * Background thread writing the buffers filled by the workers.
+     *
+     * Workers fill their own buffers without locking and hand full ones over with submit. A
+     * single thread writes them in submission order, so a worker can keep filling its next
+     * buffer while the previous one goes out. Each buffer is handed back through the release
+     * handler once written.
+     *
+     * The owner decides what a buffer is and how it is written and recycled. The bookkeeping
+     * the handlers share with the workers (free lists, in flight flags) is protected by the
+     * writer's lock: the release handler runs with it held and workers take it with locked.
+     *
+     * @tparam Buffer Type of the buffers
+     */
+    template <typename Buffer>
+    class BufferWriter
+    {
+    public:
+        using Handler = std::function<void(Buffer &)>;
+
+        /**
+         * Creates the writer, its thread only runs once started
+         *
+         * @param[in] write Writes a buffer, called on the writer thread without the lock
+         * @param[in] release Recycles a buffer once written, or when submitted after stop, with the lock held
+         */
+        BufferWriter(Handler write, Handler release)
+            : write_{std::move(write)}, release_{std::move(release)}, mutex_{}, submitted_{}, written_{}, queue_{},
+              stopping_{false}, thread_{}
+        {
+        }
+
+        ~BufferWriter()
+        {
+            stop();
+        }
+
+        BufferWriter(BufferWriter const &) = delete;
+        BufferWriter &operator=(BufferWriter const &) = delete;
+
+        /**
+         * Starts the writer thread
+         */
+        void start()
+        {
+            if (!thread_.joinable())
+            {
+                thread_ = std::thread{&BufferWriter::run_, this};
+            }
+        }
+
+        /**
+         * Writes the buffers submitted so far and stops the writer thread
+         */
+        void stop() noexcept
+        {
+            {
+                std::lock_guard<std::mutex> const lock{mutex_};
+                stopping_ = true;
+            }
+            submitted_.notify_one();
+            if (thread_.joinable())
+            {
+                thread_.join();
+            }
+        }
+
+        /**
+         * Hands a buffer over to the writer thread
+         *
+         * @param[in] buffer The buffer, owned by the writer until it is released
+         * @return False if the writer stopped, the buffer was released without being written
+         */
+        bool submit(Buffer &buffer)
+        {
+            {
+                std::lock_guard<std::mutex> const lock{mutex_};
+                if (stopping_)
+                {
+                    release_(buffer);
+                    return false;
+                }
+                queue_.push_back(&buffer);
+            }
+            submitted_.notify_one();
+            return true;
+        }
+
+        /**
+         * Runs a function with the lock held
+         *
+         * @param[in] fn The function
+         * @return What the function returns
+         */
+        template <typename Fn>
+        decltype(auto) locked(Fn &&fn)
+        {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            return std::forward<Fn>(fn)();
+        }
+
+        /**
+         * Waits for buffers to be released until a condition holds
+         *
+         * @param[in] predicate The condition, checked with the lock held
+         */
+        template <typename Predicate>
+        void wait(Predicate &&predicate)
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            written_.wait(lock, std::forward<Predicate>(predicate));
+        }
+
+    private:
+        // Main loop of the writer thread
+        void run_() noexcept
+        {
+            for (;;)
+            {
+                Buffer *buffer;
+                {
+                    std::unique_lock<std::mutex> lock{mutex_};
+                    submitted_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+                    // Stopping only once every submitted buffer is written
+                    if (queue_.empty())
+                    {
+                        return;
+                    }
+                    buffer = queue_.front();
+                    queue_.pop_front();
+                }
+                write_(*buffer);
+                {
+                    std::lock_guard<std::mutex> const lock{mutex_};
+                    release_(*buffer);
+                }
+                written_.notify_all();
+            }
+        }
+
+        Handler const write_;
+        Handler const release_;
+        std::mutex mutex_;
+        // Signaled when a buffer is submitted and when a buffer is released
+        std::condition_variable submitted_;
+        std::condition_variable written_;
+        std::deque<Buffer *> queue_;
+        bool stopping_;
+        std::thread thread_;
+    };
+} // namespace overwatch::core
@@ -17,40 +17,83 @@
  */
 
 #include <algorithm>
+#include <fstream>
 #include <stdexcept>
+#include <string_view>
 
 #include "config.hpp"
-#include "utils.hpp"
 
 namespace overwatch::core
 {
+    Event Config::shutdown_;
     Config g_config;
-    bool Config::shutdown_{false};
 
     Config::Config()
-        : target_ip_{""}, iface_{""}, logging_{""},
-          arpspoof_host_ip_{std::nullopt}
+        : targets_{}, iface_{""}, logging_{""},
+          arpspoof_host_ip_{std::nullopt}, targets_file_{std::nullopt}, read_file_{std::nullopt},
+          replay_mode_{REPLAY_MODE_FAST}, workers_{1}, fanout_mode_{FANOUT_MODE_HASH},
+          stats_interval_{0}, stats_output_{std::nullopt}, export_{std::nullopt},
+          write_dir_{std::nullopt}, write_size_{DEFAULT_WRITE_SIZE}, write_interval_{DEFAULT_WRITE_INTERVAL},
+          rules_file_{std::nullopt}, summary_interval_{0}
     {
     }
 
     Config::Config(std::string target_ip, std::string iface,
                    std::string logging, std::optional<std::string> arpspoof_host_ip)
-        : target_ip_{target_ip}, iface_{iface},
-          logging_{logging}, arpspoof_host_ip_{arpspoof_host_ip}
+        : targets_{}, iface_{iface},
+          logging_{logging}, arpspoof_host_ip_{std::nullopt}, targets_file_{std::nullopt},
+          read_file_{std::nullopt}, replay_mode_{REPLAY_MODE_FAST},
+          workers_{1}, fanout_mode_{FANOUT_MODE_HASH},
+          stats_interval_{0}, stats_output_{std::nullopt}, export_{std::nullopt},
+          write_dir_{std::nullopt}, write_size_{DEFAULT_WRITE_SIZE}, write_interval_{DEFAULT_WRITE_INTERVAL},
+          rules_file_{std::nullopt}, summary_interval_{0}
     {
+        // Targets may also come from a file only
+        if (!target_ip.empty())
+        {
+            try
+            {
+                targets_ = common::utils::parse_ip_prefix_list(target_ip);
+            }
+            catch (std::invalid_argument const &e)
+            {
+                throw std::invalid_argument{std::string{"'target' must be an IP address, a CIDR range or a list of them - "} + e.what()};
+            }
+        }
+        if (arpspoof_host_ip)
+        {
+            arpspoof_host_ip_ = common::utils::parse_ip_addr(*arpspoof_host_ip);
+            if (!arpspoof_host_ip_)
+            {
+                throw std::invalid_argument{"'arpspoof' address is not a valid IP format"};
+            }
+        }
     }
 
     void Config::operator=(Config const &&config)
     {
-        target_ip_ = config.target_ip_;
+        targets_ = config.targets_;
         iface_ = config.iface_;
         logging_ = config.logging_;
         arpspoof_host_ip_ = config.arpspoof_host_ip_;
+        targets_file_ = config.targets_file_;
+        read_file_ = config.read_file_;
+        replay_mode_ = config.replay_mode_;
+        workers_ = config.workers_;
+        fanout_mode_ = config.fanout_mode_;
+        stats_interval_ = config.stats_interval_;
+        stats_output_ = config.stats_output_;
+        export_ = config.export_;
+        write_dir_ = config.write_dir_;
+        write_size_ = config.write_size_;
+        write_interval_ = config.write_interval_;
+        rules_file_ = config.rules_file_;
+        summary_interval_ = config.summary_interval_;
     }
 
-    std::string Config::get_target_ip() noexcept
+    std::vector<common::utils::IpPrefix> Config::get_targets() noexcept
     {
-        return target_ip_;
+        return targets_;
     }
 
     std::string Config::get_interface() noexcept
@@ -63,38 +106,242 @@ namespace overwatch::core
         return logging_;
     }
 
-    std::optional<std::string> Config::get_arpspoof_host_ip() noexcept
+    std::optional<common::utils::IpAddress> Config::get_arpspoof_host_ip() noexcept
     {
         return arpspoof_host_ip_;
     }
 
+    std::optional<std::string> Config::get_targets_file() noexcept
+    {
+        return targets_file_;
+    }
+
+    void Config::set_targets_file(std::optional<std::string> targets_file)
+    {
+        if (!targets_file)
+        {
+            return;
+        }
+        std::ifstream file{*targets_file};
+        if (!file)
+        {
+            throw std::invalid_argument{"'targets' file '" + *targets_file + "' cannot be read"};
+        }
+        std::string line;
+        for (std::size_t line_number = 1; std::getline(file, line); ++line_number)
+        {
+            std::string_view target{line};
+            target = target.substr(0, target.find('#'));
+            std::size_t const start = target.find_first_not_of(" \t\r");
+            if (start == std::string_view::npos)
+            {
+                continue;
+            }
+            target = target.substr(start, target.find_last_not_of(" \t\r") - start + 1);
+            std::optional<common::utils::IpPrefix> const prefix = common::utils::parse_ip_prefix(target);
+            if (!prefix)
+            {
+                throw std::invalid_argument{"'targets' file '" + *targets_file + "' line " + std::to_string(line_number) +
+                                            " - '" + std::string{target} + "' is not a valid IP address or CIDR range"};
+            }
+            targets_.push_back(*prefix);
+        }
+        targets_file_ = targets_file;
+    }
+
+    std::optional<std::string> Config::get_read_file() noexcept
+    {
+        return read_file_;
+    }
+
+    void Config::set_read_file(std::optional<std::string> read_file) noexcept
+    {
+        read_file_ = read_file;
+    }
+
+    std::string Config::get_replay_mode() noexcept
+    {
+        return replay_mode_;
+    }
+
+    void Config::set_replay_mode(std::string replay_mode) noexcept
+    {
+        replay_mode_ = replay_mode;
+    }
+
+    std::size_t Config::get_workers() noexcept
+    {
+        return workers_;
+    }
+
+    void Config::set_workers(std::size_t workers) noexcept
+    {
+        workers_ = workers;
+    }
+
+    std::string Config::get_fanout_mode() noexcept
+    {
+        return fanout_mode_;
+    }
+
+    void Config::set_fanout_mode(std::string fanout_mode) noexcept
+    {
+        fanout_mode_ = fanout_mode;
+    }
+
+    std::size_t Config::get_stats_interval() noexcept
+    {
+        return stats_interval_;
+    }
+
+    void Config::set_stats_interval(std::size_t stats_interval) noexcept
+    {
+        stats_interval_ = stats_interval;
+    }
+
+    std::optional<std::string> Config::get_stats_output() noexcept
+    {
+        return stats_output_;
+    }
+
+    void Config::set_stats_output(std::optional<std::string> stats_output) noexcept
+    {
+        stats_output_ = stats_output;
+    }
+
+    std::optional<std::string> Config::get_export() noexcept
+    {
+        return export_;
+    }
+
+    void Config::set_export(std::optional<std::string> export_destination) noexcept
+    {
+        export_ = export_destination;
+    }
+
+    std::optional<std::string> Config::get_write_dir() noexcept
+    {
+        return write_dir_;
+    }
+
+    void Config::set_write_dir(std::optional<std::string> write_dir) noexcept
+    {
+        write_dir_ = write_dir;
+    }
+
+    std::size_t Config::get_write_size() noexcept
+    {
+        return write_size_;
+    }
+
+    void Config::set_write_size(std::size_t write_size) noexcept
+    {
+        write_size_ = write_size;
+    }
+
+    std::size_t Config::get_write_interval() noexcept
+    {
+        return write_interval_;
+    }
+
+    void Config::set_write_interval(std::size_t write_interval) noexcept
+    {
+        write_interval_ = write_interval;
+    }
+
+    std::size_t Config::get_summary_interval() noexcept
+    {
+        return summary_interval_;
+    }
+
+    void Config::set_summary_interval(std::size_t summary_interval) noexcept
+    {
+        summary_interval_ = summary_interval;
+    }
+
+    std::optional<std::string> Config::get_rules_file() noexcept
+    {
+        return rules_file_;
+    }
+
+    void Config::set_rules_file(std::optional<std::string> rules_file) noexcept
+    {
+        rules_file_ = rules_file;
+    }
+
     bool Config::is_shutdown() noexcept
     {
-        return shutdown_;
+        return shutdown_.triggered();
     }
 
     void Config::signal_shutdown() noexcept
     {
-        shutdown_ = true;
+        shutdown_.trigger();
+    }
+
+    void Config::reset_shutdown() noexcept
+    {
+        shutdown_.reset();
+    }
+
+    Event const &Config::get_shutdown_event() noexcept
+    {
+        return shutdown_;
     }
 
     void Config::validate()
     {
-        if (iface_.empty())
+        if (iface_.empty() && !read_file_)
         {
             throw std::invalid_argument{"Missing configuration data - 'interface' not set"};
         }
+        else if (read_file_ && read_file_->empty())
+        {
+            throw std::invalid_argument{"Missing configuration data - 'read' file not set"};
+        }
+        else if (replay_mode_ != REPLAY_MODE_FAST && replay_mode_ != REPLAY_MODE_ORIGINAL)
+        {
+            throw std::invalid_argument{"'replay' mode must be either '" REPLAY_MODE_FAST "' or '" REPLAY_MODE_ORIGINAL "'"};
+        }
+        else if (fanout_mode_ != FANOUT_MODE_HASH && fanout_mode_ != FANOUT_MODE_CPU)
+        {
+            throw std::invalid_argument{"'fanout' mode must be either '" FANOUT_MODE_HASH "' or '" FANOUT_MODE_CPU "'"};
+        }
         else if (logging_.empty())
         {
             throw std::invalid_argument{"Missing configuration data - 'logging' not set"};
         }
-        else if (target_ip_.empty() || !common::utils::is_valid_ip_addr(target_ip_))
+        else if (targets_.empty())
+        {
+            throw std::invalid_argument{"Missing configuration data - neither 'target' nor 'targets' set"};
+        }
+        else if (arpspoof_host_ip_ && !arpspoof_host_ip_->is_ipv4())
         {
-            throw std::invalid_argument{"'target' address is not a valid IP format"};
+            throw std::invalid_argument{"'arpspoof' address must be an IPv4 address"};
         }
-        else if (arpspoof_host_ip_ && !common::utils::is_valid_ip_addr(*arpspoof_host_ip_))
+        else if (arpspoof_host_ip_ && read_file_)
         {
-            throw std::invalid_argument{"'arpspoof' address is not a valid IP format"};
+            throw std::invalid_argument{"'arpspoof' cannot be used while reading packets from a file"};
+        }
+        else if (stats_output_ && (stats_output_->empty() || stats_interval_ == 0))
+        {
+            throw std::invalid_argument{"'stats-output' requires a file and a non-zero 'stats-interval'"};
+        }
+        else if (export_ && export_->empty())
+        {
+            throw std::invalid_argument{"Missing configuration data - 'export' file or collector not set"};
+        }
+        else if (write_dir_ && write_dir_->empty())
+        {
+            throw std::invalid_argument{"Missing configuration data - 'write' directory not set"};
+        }
+        else if (write_size_ == 0 || write_interval_ == 0)
+        {
+            throw std::invalid_argument{"'write-size' and 'write-interval' must not be 0"};
+        }
+        else if (rules_file_ && rules_file_->empty())
+        {
+            throw std::invalid_argument{"Missing configuration data - 'rules' file not set"};
         }
     }
 
@@ -102,16 +349,27 @@ namespace overwatch::core
 #define BANNER_TITLE " ( OVERWATCH CONFIGURATION ) "
 #define BANNER_SYMBOL '='
 #define MIN_BANNER_SYMBOLS 24UL
+#define MAX_BANNER_TARGETS 8UL
 
     std::string const Config::to_string() noexcept
     {
         // Get all string values from the arguments map
         std::string config_str = "";
+        std::string targets_str = "";
+        for (std::size_t i = 0; i < std::min(targets_.size(), MAX_BANNER_TARGETS); ++i)
+        {
+            targets_str += (targets_str.empty() ? "" : ", ") + common::utils::to_string(targets_[i]);
+        }
+        if (targets_.size() > MAX_BANNER_TARGETS)
+        {
+            targets_str += " (+" + std::to_string(targets_.size() - MAX_BANNER_TARGETS) + " more)";
+        }
+        std::string const arpspoof_host_ip_str = arpspoof_host_ip_ ? common::utils::to_string(*arpspoof_host_ip_) : OPTIONAL_DISABLED;
         // Determine which value given is the largest
         size_t const max_value_size =
-            std::max({target_ip_.length(), (arpspoof_host_ip_ ? (*arpspoof_host_ip_).length() : 0),
-                      iface_.length(), logging_.length()});
-        size_t const total_banner_symbols = std::max(static_cast<size_t const>(MIN_BANNER_SYMBOLS), max_value_size);
+            std::max({targets_str.length(), arpspoof_host_ip_str.length(), (targets_file_ ? (*targets_file_).length() : 0),
+                      iface_.length(), logging_.length(), (read_file_ ? (*read_file_).length() : 0)});
+        size_t const total_banner_symbols = std::max(static_cast<size_t>(MIN_BANNER_SYMBOLS), max_value_size);
 
         // Display banner with current configuration for overwatch
         std::string const padding{10, ' '};
@@ -119,9 +377,25 @@ namespace overwatch::core
                                      std::string(total_banner_symbols / 2, BANNER_SYMBOL)};
         std::string const bottom_banner{std::string(top_banner.length(), BANNER_SYMBOL)};
         config_str += "\n\t\t" + top_banner + "\n";
-        config_str += "\t\t\tTarget IP: \t\t" + target_ip_ + "\n";
-        config_str += "\t\t\tArpspoof Host IP: \t" + (arpspoof_host_ip_ ? *arpspoof_host_ip_ : OPTIONAL_DISABLED) + "\n";
-        config_str += "\t\t\tInterface: \t\t" + iface_ + "\n";
+        config_str += "\t\t\tTarget IP: \t\t" + targets_str + "\n";
+        config_str += "\t\t\tTargets File: \t\t" + (targets_file_ ? *targets_file_ : OPTIONAL_DISABLED) + "\n";
+        config_str += "\t\t\tArpspoof Host IP: \t" + arpspoof_host_ip_str + "\n";
+        config_str += "\t\t\tInterface: \t\t" + (read_file_ ? OPTIONAL_DISABLED : iface_) + "\n";
+        config_str += "\t\t\tRead File: \t\t" + (read_file_ ? *read_file_ + " (" + replay_mode_ + ")" : OPTIONAL_DISABLED) + "\n";
+        config_str += "\t\t\tWorkers: \t\t" + (workers_ ? std::to_string(workers_) : "auto") + " (" + fanout_mode_ + ")\n";
+        config_str += "\t\t\tStats: \t\t\t" +
+                      (stats_interval_ ? "every " + std::to_string(stats_interval_) + "s" + (stats_output_ ? " to " + *stats_output_ : "")
+                                       : OPTIONAL_DISABLED) + "\n";
+        config_str += "\t\t\tFlow Export: \t\t" + (export_ ? *export_ : OPTIONAL_DISABLED) + "\n";
+        config_str += "\t\t\tWrite Dir: \t\t" +
+                      (write_dir_ ? *write_dir_ + " (rotated every " + std::to_string(write_size_) + " MiB or " +
+                                        std::to_string(write_interval_) + "s)"
+                                  : OPTIONAL_DISABLED) + "\n";
+        config_str += "\t\t\tRules File: \t\t" + (rules_file_ ? *rules_file_ : OPTIONAL_DISABLED) + "\n";
+        config_str += "\t\t\tSummaries: \t\t" +
+                      (summary_interval_ ? "every " + std::to_string(summary_interval_) + "s over " +
+                                               std::to_string(summary_interval_ * SUMMARY_WINDOWS) + "s"
+                                         : OPTIONAL_DISABLED) + "\n";
         config_str += "\t\t\tLogging: \t\t" + logging_ + "\n";
         config_str += "\t\t" + bottom_banner;
         return config_str;
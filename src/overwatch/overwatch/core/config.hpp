@@ -18,8 +18,29 @@
 
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <optional>
+#include <vector>
+
+#include "event.hpp"
+#include "ip_address.hpp"
+
+// Replay modes of a capture file
+#define REPLAY_MODE_FAST "fast"
+#define REPLAY_MODE_ORIGINAL "original"
+// Distribution of packets between capture workers
+#define FANOUT_MODE_HASH "hash"
+#define FANOUT_MODE_CPU "cpu"
+// Rotation of the recorded capture files (MiB and seconds)
+#define DEFAULT_WRITE_SIZE 128
+#define DEFAULT_WRITE_INTERVAL 300
+// Intervals covered by a traffic summary
+#define SUMMARY_WINDOWS 6
+// Statistics outputs starting with this prefix are served on a UNIX socket instead of written to a file
+#define STATS_SOCKET_PREFIX "unix:"
+// Export destinations starting with this prefix are IPFIX collectors listening on UDP (fmt: 'udp:<ip>[:<port>]')
+#define EXPORT_UDP_PREFIX "udp:"
 
 namespace overwatch::core
 {
@@ -31,6 +52,7 @@ namespace overwatch::core
     public:
         /**
          * Constructors for overwatch configurations
+         * @throw std::invalid_argument If the target or arpspoof host is not a valid address
          */
         Config();
         Config(std::string target_ip, std::string iface,
@@ -44,12 +66,55 @@ namespace overwatch::core
         void operator=(Config const &&config);
 
         // Getters and setters for config
-        std::string get_target_ip() noexcept;
+        std::vector<common::utils::IpPrefix> get_targets() noexcept;
         std::string get_interface() noexcept;
         std::string get_logging() noexcept;
-        std::optional<std::string> get_arpspoof_host_ip() noexcept;
+        std::optional<common::utils::IpAddress> get_arpspoof_host_ip() noexcept;
+        std::optional<std::string> get_targets_file() noexcept;
+        /**
+         * Adds the targets listed in a file (one address or CIDR range per line)
+         * @param[in] targets_file The file to load, nothing is added if empty
+         * @throw std::invalid_argument If the file cannot be read or lists an invalid target
+         */
+        void set_targets_file(std::optional<std::string> targets_file);
+        std::optional<std::string> get_read_file() noexcept;
+        void set_read_file(std::optional<std::string> read_file) noexcept;
+        std::string get_replay_mode() noexcept;
+        void set_replay_mode(std::string replay_mode) noexcept;
+        std::size_t get_workers() noexcept;
+        void set_workers(std::size_t workers) noexcept;
+        std::string get_fanout_mode() noexcept;
+        void set_fanout_mode(std::string fanout_mode) noexcept;
+        std::size_t get_stats_interval() noexcept;
+        void set_stats_interval(std::size_t stats_interval) noexcept;
+        std::optional<std::string> get_stats_output() noexcept;
+        void set_stats_output(std::optional<std::string> stats_output) noexcept;
+        std::optional<std::string> get_export() noexcept;
+        void set_export(std::optional<std::string> export_destination) noexcept;
+        std::optional<std::string> get_write_dir() noexcept;
+        void set_write_dir(std::optional<std::string> write_dir) noexcept;
+        std::size_t get_write_size() noexcept;
+        void set_write_size(std::size_t write_size) noexcept;
+        std::size_t get_write_interval() noexcept;
+        void set_write_interval(std::size_t write_interval) noexcept;
+        std::optional<std::string> get_rules_file() noexcept;
+        void set_rules_file(std::optional<std::string> rules_file) noexcept;
+        std::size_t get_summary_interval() noexcept;
+        void set_summary_interval(std::size_t summary_interval) noexcept;
         bool is_shutdown() noexcept;
+        /**
+         * Signals every thread of the instance to shut down (async-signal-safe)
+         */
         void signal_shutdown() noexcept;
+        /**
+         * Re-arms the shutdown signal, e.g. before an instance is started again within the same process
+         */
+        void reset_shutdown() noexcept;
+        /**
+         * Event triggered on shutdown - its descriptor can be polled to wake up on shutdown
+         * @return The shutdown event
+         */
+        Event const &get_shutdown_event() noexcept;
 
         /**
          * Validates the config items
@@ -64,8 +129,8 @@ namespace overwatch::core
 
     private:
         //////////////// REQUIRED ////////////////
-        // Target IP address to watch for networking activies
-        std::string target_ip_;
+        // Target addresses and CIDR ranges to watch for networking activies
+        std::vector<common::utils::IpPrefix> targets_;
         // Interface to be listening for networking activies
         std::string iface_;
         // Logging format
@@ -74,11 +139,36 @@ namespace overwatch::core
 
         //////////////// OPTIONAL ////////////////
         // Arpspoof IP to mimic the host and redirect network packets
-        std::optional<std::string> arpspoof_host_ip_;
+        std::optional<common::utils::IpAddress> arpspoof_host_ip_;
+        // File the additional targets were loaded from
+        std::optional<std::string> targets_file_;
+        // Capture file to replay instead of watching the interface
+        std::optional<std::string> read_file_;
+        // Pacing of the replayed capture file ('fast' or 'original')
+        std::string replay_mode_;
+        // Number of capture workers (0 means one per available core)
+        std::size_t workers_;
+        // Distribution of packets between the workers ('hash' or 'cpu')
+        std::string fanout_mode_;
+        // Seconds between two stats reports (0 disables the reports)
+        std::size_t stats_interval_;
+        // File or UNIX socket the stats are published to in the Prometheus text format
+        std::optional<std::string> stats_output_;
+        // File or UDP collector the flow records are exported to in the IPFIX format
+        std::optional<std::string> export_;
+        // Directory the targets' packets are recorded to
+        std::optional<std::string> write_dir_;
+        // Recorded files are rotated after this many MiB or seconds
+        std::size_t write_size_;
+        std::size_t write_interval_;
+        // File of the signatures matched against the targets' traffic
+        std::optional<std::string> rules_file_;
+        // Seconds between two summaries of the targets' traffic (0 disables the summaries)
+        std::size_t summary_interval_;
         //////////////////////////////////////////
 
         // Static shutdown signal for the entire instance
-        static bool shutdown_;
+        static Event shutdown_;
     };
 
     // The global config for overwatch
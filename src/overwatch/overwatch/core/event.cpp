@@ -0,0 +1,184 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "event.hpp"
+
+// Resolution of waits on platforms without a descriptor to block on
+#define EVENT_FALLBACK_POLL_MS 10
+
+namespace overwatch::core
+{
+    static_assert(std::atomic_bool::is_always_lock_free, "Events are triggered from signal handlers");
+
+    namespace
+    {
+        /**
+         * Waits for any of the events by checking their flags at a fixed resolution
+         *
+         * @param[in] events The events to wait on
+         * @param[in] timeout_ms Longest time to wait (negative waits forever)
+         * @return True if an event was triggered
+         */
+        bool sleep_until_any_(std::vector<Event const *> const &events, int const timeout_ms) noexcept
+        {
+            auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            while (true)
+            {
+                for (Event const *event : events)
+                {
+                    if (event->triggered())
+                    {
+                        return true;
+                    }
+                }
+                if (timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline)
+                {
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(EVENT_FALLBACK_POLL_MS));
+            }
+        }
+    } // namespace
+
+#ifdef __linux__
+    Event::Event() : triggered_{false}, fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+    {
+    }
+
+    Event::~Event()
+    {
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+    }
+
+    void Event::trigger() noexcept
+    {
+        triggered_.store(true, std::memory_order_release);
+        if (fd_ >= 0)
+        {
+            // The code a signal handler interrupted may be about to check errno
+            int const saved_errno = errno;
+            std::uint64_t const one = 1;
+            // Only fails if the counter would overflow - it is readable then anyway
+            ssize_t const written = write(fd_, &one, sizeof(one));
+            (void)written;
+            errno = saved_errno;
+        }
+    }
+
+    void Event::reset() noexcept
+    {
+        triggered_.store(false, std::memory_order_release);
+        if (fd_ >= 0)
+        {
+            std::uint64_t count = 0;
+            ssize_t const drained = read(fd_, &count, sizeof(count));
+            (void)drained;
+        }
+    }
+
+    bool Event::wait_any(std::vector<Event const *> const &events, int const timeout_ms) noexcept
+    {
+        std::vector<pollfd> pfds;
+        for (Event const *event : events)
+        {
+            if (event->triggered())
+            {
+                return true;
+            }
+            else if (event->fd_ < 0)
+            {
+                return sleep_until_any_(events, timeout_ms);
+            }
+            pfds.push_back(pollfd{event->fd_, POLLIN, 0});
+        }
+
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        int remaining_ms = timeout_ms;
+        // Signals interrupt the wait - go back to sleep for what is left of the timeout
+        while (poll(pfds.data(), pfds.size(), remaining_ms) < 0 && errno == EINTR)
+        {
+            if (timeout_ms >= 0)
+            {
+                auto const left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                remaining_ms = left.count() > 0 ? static_cast<int>(left.count()) : 0;
+            }
+        }
+        for (Event const *event : events)
+        {
+            if (event->triggered())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+#else
+    Event::Event() : triggered_{false}, fd_{-1}
+    {
+    }
+
+    Event::~Event()
+    {
+    }
+
+    void Event::trigger() noexcept
+    {
+        triggered_.store(true, std::memory_order_release);
+    }
+
+    void Event::reset() noexcept
+    {
+        triggered_.store(false, std::memory_order_release);
+    }
+
+    bool Event::wait_any(std::vector<Event const *> const &events, int const timeout_ms) noexcept
+    {
+        return sleep_until_any_(events, timeout_ms);
+    }
+#endif
+
+    bool Event::triggered() const noexcept
+    {
+        return triggered_.load(std::memory_order_acquire);
+    }
+
+    int Event::get_fd() const noexcept
+    {
+        return fd_;
+    }
+
+    bool Event::wait(int const timeout_ms) const noexcept
+    {
+        return wait_any({this}, timeout_ms);
+    }
+} // namespace overwatch::core
@@ -0,0 +1,90 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+namespace overwatch::core
+{
+    /**
+     * One-shot event threads can block on.
+     *
+     * Backed by an eventfd on Linux: the descriptor turns readable once the event is
+     * triggered and stays readable until it is reset, so it can be polled next to
+     * sockets to cut their waits short. Without a descriptor, waits fall back to
+     * checking the flag every few milliseconds. Triggering only stores a flag and writes to the
+     * descriptor, which makes it safe to call from a signal handler.
+     */
+    class Event
+    {
+    public:
+        /**
+         * Creates an event that is not triggered (without a descriptor if none can be created)
+         */
+        Event();
+        ~Event();
+
+        Event(Event const &) = delete;
+        Event &operator=(Event const &) = delete;
+
+        /**
+         * Triggers the event and wakes every waiter (async-signal-safe)
+         */
+        void trigger() noexcept;
+        /**
+         * Re-arms the event
+         */
+        void reset() noexcept;
+        /**
+         * Determines if the event was triggered
+         * @return True once triggered
+         */
+        bool triggered() const noexcept;
+        /**
+         * Descriptor that is readable while the event is triggered
+         * @return The descriptor or -1 if the platform has none
+         */
+        int get_fd() const noexcept;
+        /**
+         * Blocks until the event is triggered
+         *
+         * @param[in] timeout_ms Longest time to wait (negative waits forever)
+         * @return True if the event was triggered
+         */
+        bool wait(int const timeout_ms) const noexcept;
+
+        /**
+         * Blocks until any of the events is triggered
+         *
+         * @param[in] events The events to wait on
+         * @param[in] timeout_ms Longest time to wait (negative waits forever)
+         * @return True if an event was triggered
+         */
+        static bool wait_any(std::vector<Event const *> const &events, int const timeout_ms) noexcept;
+
+    private:
+        // Set once triggered
+        std::atomic_bool triggered_;
+        // Readable while triggered
+        int fd_;
+    };
+} // namespace overwatch::core
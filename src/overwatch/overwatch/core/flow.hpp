@@ -0,0 +1,146 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+
+namespace overwatch::core
+{
+    /**
+     * Packed 5-tuple identifying a flow.
+     *
+     * Addresses are stored as 16 bytes in network byte order, IPv4 addresses as IPv4-mapped
+     * IPv6 addresses (::ffff:a.b.c.d), so that both families share one fixed size key.
+     * The key has no implicit padding and is compared and hashed as raw bytes.
+     */
+    struct FlowKey
+    {
+        std::array<std::uint8_t, 16> src_addr{};
+        std::array<std::uint8_t, 16> dst_addr{};
+        std::uint16_t src_port = 0;
+        std::uint16_t dst_port = 0;
+        std::uint8_t protocol = 0;
+        std::uint8_t padding[3] = {0, 0, 0};
+
+        bool operator==(FlowKey const &other) const noexcept
+        {
+            return std::memcmp(this, &other, sizeof(FlowKey)) == 0;
+        }
+        bool operator!=(FlowKey const &other) const noexcept
+        {
+            return !(*this == other);
+        }
+    };
+    static_assert(sizeof(FlowKey) == 40, "FlowKey must stay packed");
+
+    /**
+     * Builds the key of an IPv4 flow
+     *
+     * @param[in] src_addr Source address (host byte order)
+     * @param[in] dst_addr Destination address (host byte order)
+     * @param[in] src_port Source port
+     * @param[in] dst_port Destination port
+     * @param[in] protocol IP protocol number
+     * @return The flow key
+     */
+    inline FlowKey make_ipv4_flow_key(std::uint32_t const src_addr, std::uint32_t const dst_addr, std::uint16_t const src_port,
+                                      std::uint16_t const dst_port, std::uint8_t const protocol) noexcept
+    {
+        FlowKey key;
+        key.src_addr[10] = key.src_addr[11] = 0xFF;
+        key.dst_addr[10] = key.dst_addr[11] = 0xFF;
+        for (int i = 0; i < 4; ++i)
+        {
+            key.src_addr[12 + i] = static_cast<std::uint8_t>(src_addr >> (24 - 8 * i));
+            key.dst_addr[12 + i] = static_cast<std::uint8_t>(dst_addr >> (24 - 8 * i));
+        }
+        key.src_port = src_port;
+        key.dst_port = dst_port;
+        key.protocol = protocol;
+        return key;
+    }
+
+    /**
+     * Orders the endpoints of a key so that both directions of a flow share one key
+     *
+     * @param[in,out] key The key to canonicalize
+     * @return True if the endpoints were swapped (the packet travels in the reverse direction)
+     */
+    inline bool canonicalize(FlowKey &key) noexcept
+    {
+        if (std::tie(key.src_addr, key.src_port) <= std::tie(key.dst_addr, key.dst_port))
+        {
+            return false;
+        }
+        std::swap(key.src_addr, key.dst_addr);
+        std::swap(key.src_port, key.dst_port);
+        return true;
+    }
+
+    /**
+     * Hashes a flow key
+     *
+     * @param[in] key The key to hash
+     * @return The 64 bit hash of the key
+     */
+    inline std::uint64_t hash_flow_key(FlowKey const &key) noexcept
+    {
+        std::uint64_t words[sizeof(FlowKey) / sizeof(std::uint64_t)];
+        std::memcpy(words, &key, sizeof(words));
+        std::uint64_t hash = 0x9E3779B97F4A7C15ULL;
+        for (std::uint64_t const word : words)
+        {
+            hash = (hash ^ word) * 0xBF58476D1CE4E5B9ULL;
+            hash ^= hash >> 31;
+        }
+        hash *= 0x94D049BB133111EBULL;
+        return hash ^ (hash >> 29);
+    }
+
+    /**
+     * Fixed size state kept for every flow
+     */
+    struct FlowRecord
+    {
+        std::uint64_t first_seen_ns;
+        std::uint64_t last_seen_ns;
+        // Indexed by direction (0: src -> dst of the key, 1: dst -> src)
+        std::uint64_t packets[2];
+        std::uint64_t bytes[2];
+        // Union of the TCP flags seen in the flow
+        std::uint8_t tcp_flags;
+    };
+
+    /**
+     * Why a flow record left the flow table (values of the IPFIX flowEndReason element)
+     */
+    enum class FlowEndReason : std::uint8_t
+    {
+        // The flow saw no packet for the idle timeout
+        IdleTimeout = 1,
+        // Checkpoint of a long lived flow, the flow stays in the table with reset counters
+        ActiveTimeout = 2,
+        // The worker shut down
+        ForcedEnd = 4
+    };
+} // namespace overwatch::core
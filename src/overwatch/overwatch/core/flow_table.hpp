@@ -0,0 +1,572 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "flow.hpp"
+
+namespace overwatch::core
+{
+    namespace flow_table
+    {
+        // Control byte of a slot that was never used
+        constexpr std::int8_t CTRL_EMPTY = -128;
+        // Control byte of an erased slot that probes must continue past
+        constexpr std::int8_t CTRL_DELETED = -2;
+        // Full slots store the low 7 bits of the hash as control byte (0..127)
+
+#if defined(__AVX2__)
+        constexpr std::size_t GROUP_WIDTH = 32;
+#elif defined(__SSE2__) || defined(_M_X64)
+        constexpr std::size_t GROUP_WIDTH = 16;
+#else
+        constexpr std::size_t GROUP_WIDTH = 8;
+#endif
+
+        /**
+         * Index of the lowest set bit
+         *
+         * @param[in] value A non-zero value
+         * @return The number of trailing zero bits
+         */
+        inline unsigned int trailing_zeros(std::uint64_t const value) noexcept
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward64(&index, value);
+            return static_cast<unsigned int>(index);
+#else
+            return static_cast<unsigned int>(__builtin_ctzll(value));
+#endif
+        }
+
+        /**
+         * Set of slots within a group, iterated from the lowest slot
+         */
+        class BitMask
+        {
+        public:
+            // shift converts a bit index to a slot index (SWAR groups use the top bit of every byte)
+            BitMask(std::uint64_t const mask, unsigned int const shift) noexcept : mask_{mask}, shift_{shift} {}
+
+            explicit operator bool() const noexcept { return mask_ != 0; }
+            std::size_t lowest() const noexcept { return trailing_zeros(mask_) >> shift_; }
+            void clear_lowest() noexcept { mask_ &= mask_ - 1; }
+
+        private:
+            std::uint64_t mask_;
+            unsigned int shift_;
+        };
+
+        /**
+         * Control bytes of a group of slots, matched against a tag all at once
+         */
+        class Group
+        {
+        public:
+#if defined(__AVX2__)
+            explicit Group(std::int8_t const *ctrl) noexcept
+                : ctrl_{_mm256_loadu_si256(reinterpret_cast<__m256i const *>(ctrl))} {}
+
+            BitMask match(std::int8_t const tag) const noexcept
+            {
+                return movemask_(_mm256_cmpeq_epi8(_mm256_set1_epi8(tag), ctrl_));
+            }
+            BitMask match_empty() const noexcept
+            {
+                return match(CTRL_EMPTY);
+            }
+            BitMask match_empty_or_deleted() const noexcept
+            {
+                // Empty and deleted are the only control bytes below -1
+                return movemask_(_mm256_cmpgt_epi8(_mm256_set1_epi8(-1), ctrl_));
+            }
+
+        private:
+            static BitMask movemask_(__m256i const value) noexcept
+            {
+                return BitMask{static_cast<std::uint32_t>(_mm256_movemask_epi8(value)), 0};
+            }
+            __m256i ctrl_;
+#elif defined(__SSE2__) || defined(_M_X64)
+            explicit Group(std::int8_t const *ctrl) noexcept
+                : ctrl_{_mm_loadu_si128(reinterpret_cast<__m128i const *>(ctrl))} {}
+
+            BitMask match(std::int8_t const tag) const noexcept
+            {
+                return movemask_(_mm_cmpeq_epi8(_mm_set1_epi8(tag), ctrl_));
+            }
+            BitMask match_empty() const noexcept
+            {
+                return match(CTRL_EMPTY);
+            }
+            BitMask match_empty_or_deleted() const noexcept
+            {
+                // Empty and deleted are the only control bytes below -1
+                return movemask_(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl_));
+            }
+
+        private:
+            static BitMask movemask_(__m128i const value) noexcept
+            {
+                return BitMask{static_cast<std::uint32_t>(_mm_movemask_epi8(value)), 0};
+            }
+            __m128i ctrl_;
+#else
+            // Portable fallback matching 8 control bytes packed in a word
+            explicit Group(std::int8_t const *ctrl) noexcept
+            {
+                std::memcpy(&ctrl_, ctrl, sizeof(ctrl_));
+            }
+
+            BitMask match(std::int8_t const tag) const noexcept
+            {
+                // May report false positives for bytes following a match - keys are always compared afterwards
+                std::uint64_t const x = ctrl_ ^ (LSBS * static_cast<std::uint8_t>(tag));
+                return BitMask{(x - LSBS) & ~x & MSBS, 3};
+            }
+            BitMask match_empty() const noexcept
+            {
+                return BitMask{(ctrl_ & (~ctrl_ << 6)) & MSBS, 3};
+            }
+            BitMask match_empty_or_deleted() const noexcept
+            {
+                return BitMask{(ctrl_ & (~ctrl_ << 7)) & MSBS, 3};
+            }
+
+        private:
+            static constexpr std::uint64_t LSBS = 0x0101010101010101ULL;
+            static constexpr std::uint64_t MSBS = 0x8080808080808080ULL;
+            std::uint64_t ctrl_;
+#endif
+        };
+
+        /**
+         * Issues a read prefetch for an address
+         *
+         * @param[in] addr The address to prefetch
+         */
+        inline void prefetch(void const *addr) noexcept
+        {
+#if defined(__GNUC__)
+            __builtin_prefetch(addr);
+#elif defined(_M_X64)
+            _mm_prefetch(static_cast<char const *>(addr), _MM_HINT_T0);
+#else
+            (void)addr;
+#endif
+        }
+    } // namespace flow_table
+
+    /**
+     * Open addressing hash table of flows with a fixed capacity.
+     *
+     * The table follows the layout of a Swiss table: one control byte per slot holding 7 bits
+     * of the hash, scanned a whole group at a time with SIMD compares, so a lookup usually
+     * touches one cache line of control bytes and one slot. All memory is allocated upfront
+     * and records are stored inline, so inserting never allocates. The table is meant to be
+     * owned by a single worker and does not synchronize.
+     *
+     * @tparam Value Trivially copyable record stored per flow, exposing a last_seen_ns timestamp
+     */
+    template <typename Value>
+    class FlowTable
+    {
+        static_assert(std::is_trivially_copyable_v<Value>, "Flow records must be trivially copyable");
+
+    public:
+        /**
+         * Allocates a table able to hold at least max_flows flows
+         *
+         * @param[in] max_flows Number of concurrent flows the table must hold
+         * @throw std::invalid_argument If max_flows is 0
+         */
+        explicit FlowTable(std::size_t const max_flows);
+
+        /**
+         * Looks up a flow
+         *
+         * @param[in] key The key of the flow
+         * @param[in] hash The hash of the key (see hash_flow_key)
+         * @return The record of the flow or nullptr if the flow is unknown
+         */
+        Value *find(FlowKey const &key, std::uint64_t const hash) noexcept;
+        Value *find(FlowKey const &key) noexcept
+        {
+            return find(key, hash_flow_key(key));
+        }
+
+        /**
+         * Looks up a flow and inserts a zeroed record if the flow is unknown
+         *
+         * @param[in] key The key of the flow
+         * @param[in] hash The hash of the key (see hash_flow_key)
+         * @param[out] inserted Set to true if the flow was inserted (optional)
+         * @return The record of the flow or nullptr if the table is full
+         */
+        Value *insert(FlowKey const &key, std::uint64_t const hash, bool *inserted = nullptr) noexcept;
+        Value *insert(FlowKey const &key, bool *inserted = nullptr) noexcept
+        {
+            return insert(key, hash_flow_key(key), inserted);
+        }
+
+        /**
+         * Removes a flow
+         *
+         * @param[in] key The key of the flow
+         * @return True if the flow was removed
+         */
+        bool erase(FlowKey const &key) noexcept;
+
+        /**
+         * Prefetches the memory a lookup of the hash will touch first
+         *
+         * @param[in] hash The hash of the key that will be looked up
+         */
+        void prefetch(std::uint64_t const hash) const noexcept;
+
+        /**
+         * Evicts idle flows, scanning a bounded number of slots from where the previous call stopped
+         *
+         * @param[in] now_ns The current time
+         * @param[in] idle_timeout_ns Flows not seen for this long are evicted
+         * @param[in] max_slots Maximum number of slots to scan
+         * @param[in] on_expire Called with the key and record of every evicted flow
+         * @return The number of evicted flows
+         */
+        template <typename OnExpire>
+        std::size_t expire(std::uint64_t const now_ns, std::uint64_t const idle_timeout_ns, std::size_t max_slots,
+                           OnExpire &&on_expire);
+
+        /**
+         * Calls a function for every flow in the table
+         *
+         * @param[in] fn Called with the key and record of every flow
+         */
+        template <typename Fn>
+        void for_each(Fn &&fn);
+
+        /**
+         * Number of flows in the table
+         * @return The number of flows
+         */
+        std::size_t size() const noexcept
+        {
+            return size_;
+        }
+        /**
+         * Maximum number of flows the table holds before inserts fail
+         * @return The maximum number of flows
+         */
+        std::size_t max_size() const noexcept
+        {
+            return max_load_;
+        }
+        /**
+         * Number of slots of the table
+         * @return The number of slots
+         */
+        std::size_t capacity() const noexcept
+        {
+            return ctrl_.size();
+        }
+
+    private:
+        struct Slot
+        {
+            FlowKey key;
+            Value value;
+        };
+
+        // First group probed for a hash
+        std::size_t probe_start_(std::uint64_t const hash) const noexcept
+        {
+            return static_cast<std::size_t>(hash >> 7) & group_mask_;
+        }
+        // Control byte stored for a hash
+        static std::int8_t tag_(std::uint64_t const hash) noexcept
+        {
+            return static_cast<std::int8_t>(hash & 0x7F);
+        }
+        // Slot holding a key or capacity() if the key is unknown
+        std::size_t find_index_(FlowKey const &key, std::uint64_t const hash) const noexcept;
+        // First empty or deleted slot in the probe sequence of a hash
+        std::size_t find_insert_slot_(std::uint64_t const hash) const noexcept;
+        // Frees a full slot
+        void erase_at_(std::size_t const index) noexcept;
+        // Reclaims deleted slots without allocating
+        void rehash_in_place_() noexcept;
+
+        std::vector<std::int8_t> ctrl_;
+        std::vector<Slot> slots_;
+        std::size_t group_mask_;
+        std::size_t size_;
+        // Maximum number of full slots (7/8 load factor)
+        std::size_t max_load_;
+        // Empty slots that can still be consumed before deleted slots must be reclaimed
+        std::size_t growth_left_;
+        // Slot where the next expiration scan starts
+        std::size_t expire_cursor_;
+    };
+
+    template <typename Value>
+    FlowTable<Value>::FlowTable(std::size_t const max_flows)
+        : ctrl_{}, slots_{}, group_mask_{0}, size_{0}, max_load_{0}, growth_left_{0}, expire_cursor_{0}
+    {
+        if (max_flows == 0)
+        {
+            throw std::invalid_argument{"Flow table must hold at least one flow"};
+        }
+        std::size_t capacity = flow_table::GROUP_WIDTH;
+        while (capacity / 8 * 7 < max_flows)
+        {
+            capacity *= 2;
+        }
+        // Touch all memory now rather than page faulting on the packet path
+        ctrl_.assign(capacity, flow_table::CTRL_EMPTY);
+        slots_.assign(capacity, Slot{});
+        group_mask_ = capacity / flow_table::GROUP_WIDTH - 1;
+        max_load_ = capacity / 8 * 7;
+        growth_left_ = max_load_;
+    }
+
+    template <typename Value>
+    Value *FlowTable<Value>::find(FlowKey const &key, std::uint64_t const hash) noexcept
+    {
+        std::size_t const index = find_index_(key, hash);
+        return index < capacity() ? &slots_[index].value : nullptr;
+    }
+
+    template <typename Value>
+    Value *FlowTable<Value>::insert(FlowKey const &key, std::uint64_t const hash, bool *inserted) noexcept
+    {
+        if (inserted)
+        {
+            *inserted = false;
+        }
+        Value *value = find(key, hash);
+        if (value)
+        {
+            return value;
+        }
+
+        std::size_t index = find_insert_slot_(hash);
+        if (ctrl_[index] == flow_table::CTRL_EMPTY && growth_left_ == 0)
+        {
+            if (size_ >= max_load_)
+            {
+                return nullptr;
+            }
+            // The table is clogged with deleted slots rather than full
+            rehash_in_place_();
+            index = find_insert_slot_(hash);
+        }
+        if (ctrl_[index] == flow_table::CTRL_EMPTY)
+        {
+            --growth_left_;
+        }
+        ctrl_[index] = tag_(hash);
+        slots_[index].key = key;
+        slots_[index].value = Value{};
+        ++size_;
+        if (inserted)
+        {
+            *inserted = true;
+        }
+        return &slots_[index].value;
+    }
+
+    template <typename Value>
+    bool FlowTable<Value>::erase(FlowKey const &key) noexcept
+    {
+        std::size_t const index = find_index_(key, hash_flow_key(key));
+        if (index == capacity())
+        {
+            return false;
+        }
+        erase_at_(index);
+        return true;
+    }
+
+    template <typename Value>
+    void FlowTable<Value>::prefetch(std::uint64_t const hash) const noexcept
+    {
+        std::size_t const base = probe_start_(hash) * flow_table::GROUP_WIDTH;
+        flow_table::prefetch(ctrl_.data() + base);
+        flow_table::prefetch(slots_.data() + base);
+    }
+
+    template <typename Value>
+    template <typename OnExpire>
+    std::size_t FlowTable<Value>::expire(std::uint64_t const now_ns, std::uint64_t const idle_timeout_ns, std::size_t max_slots,
+                                         OnExpire &&on_expire)
+    {
+        std::size_t expired = 0;
+        max_slots = std::min(max_slots, capacity());
+        for (; max_slots > 0; --max_slots)
+        {
+            std::size_t const index = expire_cursor_;
+            expire_cursor_ = (expire_cursor_ + 1) & (capacity() - 1);
+            if (ctrl_[index] < 0)
+            {
+                continue;
+            }
+            Slot &slot = slots_[index];
+            if (slot.value.last_seen_ns + idle_timeout_ns > now_ns)
+            {
+                continue;
+            }
+            on_expire(static_cast<FlowKey const &>(slot.key), slot.value);
+            erase_at_(index);
+            ++expired;
+        }
+        return expired;
+    }
+
+    template <typename Value>
+    template <typename Fn>
+    void FlowTable<Value>::for_each(Fn &&fn)
+    {
+        for (std::size_t index = 0; index < capacity(); ++index)
+        {
+            if (ctrl_[index] >= 0)
+            {
+                fn(static_cast<FlowKey const &>(slots_[index].key), slots_[index].value);
+            }
+        }
+    }
+
+    template <typename Value>
+    std::size_t FlowTable<Value>::find_index_(FlowKey const &key, std::uint64_t const hash) const noexcept
+    {
+        std::int8_t const tag = tag_(hash);
+        std::size_t group = probe_start_(hash);
+        for (std::size_t step = 1; step <= group_mask_ + 1; ++step)
+        {
+            std::size_t const base = group * flow_table::GROUP_WIDTH;
+            flow_table::Group const ctrl{ctrl_.data() + base};
+            for (flow_table::BitMask match = ctrl.match(tag); match; match.clear_lowest())
+            {
+                std::size_t const index = base + match.lowest();
+                if (slots_[index].key == key)
+                {
+                    return index;
+                }
+            }
+            // An empty slot ends every probe sequence going through this group
+            if (ctrl.match_empty())
+            {
+                return capacity();
+            }
+            // Triangular probing visits every group once
+            group = (group + step) & group_mask_;
+        }
+        return capacity();
+    }
+
+    template <typename Value>
+    std::size_t FlowTable<Value>::find_insert_slot_(std::uint64_t const hash) const noexcept
+    {
+        std::size_t group = probe_start_(hash);
+        for (std::size_t step = 1;; ++step)
+        {
+            std::size_t const base = group * flow_table::GROUP_WIDTH;
+            flow_table::BitMask const free = flow_table::Group{ctrl_.data() + base}.match_empty_or_deleted();
+            // The load factor guarantees a free slot somewhere in the sequence
+            if (free)
+            {
+                return base + free.lowest();
+            }
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    template <typename Value>
+    void FlowTable<Value>::erase_at_(std::size_t const index) noexcept
+    {
+        std::size_t const base = index / flow_table::GROUP_WIDTH * flow_table::GROUP_WIDTH;
+        // No probe sequence ever continued past a group that still has an empty slot,
+        // so the slot can go back to empty instead of leaving a tombstone
+        if (flow_table::Group{ctrl_.data() + base}.match_empty())
+        {
+            ctrl_[index] = flow_table::CTRL_EMPTY;
+            ++growth_left_;
+        }
+        else
+        {
+            ctrl_[index] = flow_table::CTRL_DELETED;
+        }
+        --size_;
+    }
+
+    template <typename Value>
+    void FlowTable<Value>::rehash_in_place_() noexcept
+    {
+        // Deleted slots become empty and full slots are marked deleted until they are placed again
+        for (std::int8_t &ctrl : ctrl_)
+        {
+            ctrl = ctrl >= 0 ? flow_table::CTRL_DELETED : flow_table::CTRL_EMPTY;
+        }
+        for (std::size_t index = 0; index < capacity(); ++index)
+        {
+            if (ctrl_[index] != flow_table::CTRL_DELETED)
+            {
+                continue;
+            }
+            std::uint64_t const hash = hash_flow_key(slots_[index].key);
+            std::size_t const target = find_insert_slot_(hash);
+            if (target / flow_table::GROUP_WIDTH == index / flow_table::GROUP_WIDTH)
+            {
+                // Already in the first group with room along its probe sequence
+                ctrl_[index] = tag_(hash);
+            }
+            else if (ctrl_[target] == flow_table::CTRL_EMPTY)
+            {
+                slots_[target] = slots_[index];
+                ctrl_[target] = tag_(hash);
+                ctrl_[index] = flow_table::CTRL_EMPTY;
+            }
+            else
+            {
+                // The target holds another flow waiting to be placed - swap and place that one next
+                std::swap(slots_[target], slots_[index]);
+                ctrl_[target] = tag_(hash);
+                --index;
+            }
+        }
+        growth_left_ = max_load_ - size_;
+    }
+} // namespace overwatch::core
@@ -0,0 +1,144 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+
+#include "lpm_table.hpp"
+
+// Entries in a group extending a table entry by one byte
+#define GROUP_SIZE 256
+// Marks the root table while walking down the groups
+#define ROOT_GROUP SIZE_MAX
+
+namespace overwatch::core
+{
+    namespace
+    {
+        /**
+         * Allocates a zeroed table
+         *
+         * Large allocations are served by fresh zero pages, so entries that are never written
+         * cost no physical memory.
+         *
+         * @param[in] bits Number of bits indexing the table
+         * @return The table
+         * @throw std::bad_alloc If the table cannot be allocated
+         */
+        std::uint32_t *allocate_table_(unsigned int const bits)
+        {
+            void *const table = std::calloc(std::size_t{1} << bits, sizeof(std::uint32_t));
+            if (!table)
+            {
+                throw std::bad_alloc{};
+            }
+            return static_cast<std::uint32_t *>(table);
+        }
+    } // namespace
+
+    LpmTable::LpmTable(std::vector<common::utils::IpPrefix> const &prefixes)
+        : size_{prefixes.size()}, ipv4_root_{}, ipv4_groups_{}, ipv6_root_{}, ipv6_groups_{}
+    {
+        if (prefixes.size() >= EXTENDED - 1)
+        {
+            throw std::length_error{"Too many prefixes for a lookup table"};
+        }
+        // Shortest prefixes first so that longer ones overwrite them, duplicates keep the first index
+        std::vector<std::uint32_t> order(prefixes.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&prefixes](std::uint32_t const lhs, std::uint32_t const rhs) {
+            return prefixes[lhs].length != prefixes[rhs].length ? prefixes[lhs].length < prefixes[rhs].length : lhs > rhs;
+        });
+
+        for (std::uint32_t const index : order)
+        {
+            common::utils::IpPrefix const &prefix = prefixes[index];
+            if (prefix.address.is_ipv4())
+            {
+                if (!ipv4_root_)
+                {
+                    ipv4_root_.reset(allocate_table_(IPV4_ROOT_BITS));
+                }
+                common::utils::IpAddress const key{static_cast<std::uint64_t>(prefix.address.to_ipv4()) << 32, 0};
+                insert_(ipv4_root_.get(), IPV4_ROOT_BITS, ipv4_groups_, key, prefix.length, index + 1);
+            }
+            else
+            {
+                if (!ipv6_root_)
+                {
+                    ipv6_root_.reset(allocate_table_(IPV6_ROOT_BITS));
+                }
+                insert_(ipv6_root_.get(), IPV6_ROOT_BITS, ipv6_groups_, prefix.address, prefix.length, index + 1);
+            }
+        }
+    }
+
+    std::size_t LpmTable::size() const noexcept
+    {
+        return size_;
+    }
+
+    std::size_t LpmTable::memory_usage() const noexcept
+    {
+        std::size_t usage = (ipv4_groups_.size() + ipv6_groups_.size()) * sizeof(std::uint32_t);
+        if (ipv4_root_)
+        {
+            usage += (std::size_t{1} << IPV4_ROOT_BITS) * sizeof(std::uint32_t);
+        }
+        if (ipv6_root_)
+        {
+            usage += (std::size_t{1} << IPV6_ROOT_BITS) * sizeof(std::uint32_t);
+        }
+        return usage;
+    }
+
+    void LpmTable::insert_(std::uint32_t *const root, unsigned int const root_bits, std::vector<std::uint32_t> &groups,
+                           common::utils::IpAddress const &key, unsigned int const length, std::uint32_t const entry)
+    {
+        std::size_t group = ROOT_GROUP;
+        std::size_t index = static_cast<std::size_t>(key.high >> (64 - root_bits));
+        unsigned int consumed = root_bits;
+        // Walks down to the level holding the last bit of the prefix, extending entries on the way
+        while (length > consumed)
+        {
+            std::size_t const position = group == ROOT_GROUP ? index : group * GROUP_SIZE + index;
+            std::uint32_t current = group == ROOT_GROUP ? root[position] : groups[position];
+            if (!(current & EXTENDED))
+            {
+                std::size_t const next = groups.size() / GROUP_SIZE;
+                if (next >= EXTENDED)
+                {
+                    throw std::length_error{"Too many prefixes for a lookup table"};
+                }
+                // The new group inherits the shorter prefix the entry was matching (leaf pushing)
+                groups.resize(groups.size() + GROUP_SIZE, current);
+                current = EXTENDED | static_cast<std::uint32_t>(next);
+                (group == ROOT_GROUP ? root[position] : groups[position]) = current;
+            }
+            group = current & ~EXTENDED;
+            index = byte_at_(key, consumed);
+            consumed += 8;
+        }
+        // The prefix covers every entry of the level that shares its leading bits
+        std::size_t const span = std::size_t{1} << (consumed - length);
+        std::uint32_t *const table = group == ROOT_GROUP ? root : groups.data() + group * GROUP_SIZE;
+        std::fill(table + index, table + index + span, entry);
+    }
+} // namespace overwatch::core
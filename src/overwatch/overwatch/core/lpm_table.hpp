@@ -0,0 +1,154 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "ip_address.hpp"
+
+namespace overwatch::core
+{
+    /**
+     * Longest prefix match table over IPv4 and IPv6 prefixes (DIR-24-8 style).
+     *
+     * Prefixes are expanded into direct indexed tables with leaf pushing, so a lookup
+     * is a fixed walk whatever the number of prefixes:
+     *  - IPv4 addresses index a table of 2^24 entries with their first 24 bits, longer
+     *    prefixes extend an entry into a group of 256 entries indexed by the last byte
+     *    (at most 2 memory accesses).
+     *  - IPv6 addresses index a table of 2^16 entries with their first 16 bits, then one
+     *    group of 256 entries per following byte the longest overlapping prefix needs.
+     *
+     * The table is immutable once built and can be shared by any number of threads.
+     */
+    class LpmTable
+    {
+    public:
+        // Result of a lookup that no prefix matches
+        static constexpr std::uint32_t NO_MATCH = UINT32_MAX;
+
+        /**
+         * Builds the table
+         *
+         * @param[in] prefixes The prefixes, a lookup returns the index of the longest matching one
+         *                     (the first one if a prefix is listed more than once)
+         */
+        explicit LpmTable(std::vector<common::utils::IpPrefix> const &prefixes);
+
+        /**
+         * Finds the longest prefix containing an address
+         *
+         * @param[in] addr The address to look up
+         * @return The index of the prefix or NO_MATCH
+         */
+        std::uint32_t lookup(common::utils::IpAddress const &addr) const noexcept
+        {
+            std::uint32_t entry;
+            if (addr.is_ipv4())
+            {
+                if (!ipv4_root_)
+                {
+                    return NO_MATCH;
+                }
+                std::uint32_t const ipv4 = addr.to_ipv4();
+                entry = ipv4_root_[ipv4 >> 8];
+                if (entry & EXTENDED)
+                {
+                    entry = ipv4_groups_[((entry & ~EXTENDED) << 8) | (ipv4 & 0xFF)];
+                }
+            }
+            else
+            {
+                if (!ipv6_root_)
+                {
+                    return NO_MATCH;
+                }
+                entry = ipv6_root_[addr.high >> 48];
+                for (unsigned int bit = IPV6_ROOT_BITS; entry & EXTENDED; bit += 8)
+                {
+                    entry = ipv6_groups_[((entry & ~EXTENDED) << 8) | byte_at_(addr, bit)];
+                }
+            }
+            // Empty entries (0) wrap around to NO_MATCH
+            return entry - 1;
+        }
+
+        /**
+         * Number of prefixes the table was built from
+         * @return The number of prefixes
+         */
+        std::size_t size() const noexcept;
+        /**
+         * Memory reserved by the table (pages of the IPv4 root no prefix was written to are never touched)
+         * @return The size of all tables in bytes
+         */
+        std::size_t memory_usage() const noexcept;
+
+    private:
+        // Entries are either empty (0), a prefix index + 1 or a group index flagged as extended
+        static constexpr std::uint32_t EXTENDED = 0x80000000;
+        static constexpr unsigned int IPV4_ROOT_BITS = 24;
+        static constexpr unsigned int IPV6_ROOT_BITS = 16;
+
+        struct FreeDeleter
+        {
+            void operator()(std::uint32_t *table) const noexcept { std::free(table); }
+        };
+
+        /**
+         * Byte of an address at a bit offset
+         *
+         * @param[in] addr The address
+         * @param[in] bit Offset of the byte from the most significant bit (multiple of 8)
+         * @return The byte
+         */
+        static std::uint32_t byte_at_(common::utils::IpAddress const &addr, unsigned int const bit) noexcept
+        {
+            return static_cast<std::uint32_t>(bit < 64 ? addr.high >> (56 - bit) : addr.low >> (120 - bit)) & 0xFF;
+        }
+
+        /**
+         * Writes a prefix into a root table and its groups
+         *
+         * Prefixes must be inserted from the shortest to the longest so that longer prefixes
+         * overwrite the entries they share with shorter ones.
+         *
+         * @param[in,out] root The root table
+         * @param[in] root_bits Number of leading bits indexing the root table
+         * @param[in,out] groups The groups of 256 entries extending the root table
+         * @param[in] key The prefix address aligned to the most significant bit
+         * @param[in] length The prefix length
+         * @param[in] entry The entry to store for the prefix
+         */
+        static void insert_(std::uint32_t *root, unsigned int const root_bits, std::vector<std::uint32_t> &groups,
+                            common::utils::IpAddress const &key, unsigned int const length, std::uint32_t const entry);
+
+        std::size_t size_;
+        // IPv4 root indexed by the first 24 bits (only allocated if there are IPv4 prefixes)
+        std::unique_ptr<std::uint32_t[], FreeDeleter> ipv4_root_;
+        std::vector<std::uint32_t> ipv4_groups_;
+        // IPv6 root indexed by the first 16 bits (only allocated if there are IPv6 prefixes)
+        std::unique_ptr<std::uint32_t[], FreeDeleter> ipv6_root_;
+        std::vector<std::uint32_t> ipv6_groups_;
+    };
+} // namespace overwatch::core
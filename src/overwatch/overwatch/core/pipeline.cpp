@@ -0,0 +1,325 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "pipeline.hpp"
+
+// Packets between the one being accounted and the one whose flow bucket is prefetched
+#define FLOW_PREFETCH_DISTANCE 8
+// Flow table slots scanned for idle flows per burst (on top of one slot per packet)
+#define FLOW_EXPIRE_SLOTS_PER_BURST 64
+
+namespace overwatch::core
+{
+    namespace
+    {
+        /**
+         * Builds the flow key of a decoded IP packet
+         *
+         * @param[in] packet The frame
+         * @param[in] decoded The decoded headers of the frame (must have an IP layer)
+         * @return The key, with zero ports for transports without ports and non-first fragments
+         */
+        FlowKey make_flow_key_(capture::PacketView const &packet, decode::DecodedPacket const &decoded) noexcept
+        {
+            FlowKey key;
+            std::uint8_t const *const header = packet.data + decoded.l3_offset;
+            if (decoded.has(decode::LAYER_IPV4))
+            {
+                key.src_addr[10] = key.src_addr[11] = 0xFF;
+                key.dst_addr[10] = key.dst_addr[11] = 0xFF;
+                std::memcpy(key.src_addr.data() + 12, header + 12, 4);
+                std::memcpy(key.dst_addr.data() + 12, header + 16, 4);
+            }
+            else
+            {
+                std::memcpy(key.src_addr.data(), header + 8, 16);
+                std::memcpy(key.dst_addr.data(), header + 24, 16);
+            }
+            key.src_port = decoded.src_port;
+            key.dst_port = decoded.dst_port;
+            key.protocol = decoded.protocol;
+            return key;
+        }
+    } // namespace
+
+    void Stage::flush(PacketBurst &)
+    {
+    }
+
+    void Stage::publish(stats::Registry &, stats::Labels const &, std::vector<stats::Registration> &) const
+    {
+    }
+
+    char const *DecodeStage::name() const noexcept
+    {
+        return "decode";
+    }
+
+    void DecodeStage::process(PacketBurst &burst)
+    {
+        std::uint64_t errors = 0;
+        for (std::size_t i = 0; i < burst.size; ++i)
+        {
+            burst.decoded[i] = decode::decode(burst.packets[i]);
+            errors += (burst.decoded[i].flags & (decode::FLAG_TRUNCATED | decode::FLAG_MALFORMED)) != 0;
+        }
+        errors_.add(errors);
+    }
+
+    void DecodeStage::publish(stats::Registry &registry, stats::Labels const &labels,
+                              std::vector<stats::Registration> &registrations) const
+    {
+        registrations.push_back(registry.add_counter("overwatch_decode_errors_total", "Truncated or malformed packets", labels, errors_));
+    }
+
+    std::uint64_t DecodeStage::get_errors() const noexcept
+    {
+        return errors_.load();
+    }
+
+    ClassifyStage::ClassifyStage(std::shared_ptr<LpmTable const> targets)
+        : targets_{std::move(targets)}, counters_(targets_->size())
+    {
+    }
+
+    char const *ClassifyStage::name() const noexcept
+    {
+        return "classify";
+    }
+
+    void ClassifyStage::process(PacketBurst &burst)
+    {
+        for (std::size_t i = 0; i < burst.size; ++i)
+        {
+            capture::PacketView const &packet = burst.packets[i];
+            decode::DecodedPacket const &decoded = burst.decoded[i];
+            if (!decoded.is_ip())
+            {
+                burst.src_targets[i] = burst.dst_targets[i] = LpmTable::NO_MATCH;
+                continue;
+            }
+            std::uint32_t const src_target = targets_->lookup(decode::src_address(packet, decoded));
+            std::uint32_t const dst_target = targets_->lookup(decode::dst_address(packet, decoded));
+            burst.src_targets[i] = src_target;
+            burst.dst_targets[i] = dst_target;
+            if (src_target != LpmTable::NO_MATCH)
+            {
+                ++counters_[src_target].packets;
+                counters_[src_target].bytes += packet.wire_len;
+            }
+            // Traffic within a target is only counted once
+            if (dst_target != LpmTable::NO_MATCH && dst_target != src_target)
+            {
+                ++counters_[dst_target].packets;
+                counters_[dst_target].bytes += packet.wire_len;
+            }
+        }
+    }
+
+    std::vector<TargetCounters> const &ClassifyStage::get_counters() const noexcept
+    {
+        return counters_;
+    }
+
+    FlowStage::FlowStage(std::size_t const max_flows, std::uint64_t const idle_timeout_ns, std::uint64_t const active_timeout_ns)
+        : flows_{max_flows}, idle_timeout_ns_{idle_timeout_ns}, active_timeout_ns_{active_timeout_ns}, dropped_{}, active_{}
+    {
+    }
+
+    char const *FlowStage::name() const noexcept
+    {
+        return "flow";
+    }
+
+    void FlowStage::process(PacketBurst &burst)
+    {
+        // Keys and hashes first, so that buckets can be prefetched ahead of the lookups
+        for (std::size_t i = 0; i < burst.size; ++i)
+        {
+            burst.has_flow[i] = burst.decoded[i].is_ip();
+            if (burst.has_flow[i])
+            {
+                burst.flow_keys[i] = make_flow_key_(burst.packets[i], burst.decoded[i]);
+                burst.flow_directions[i] = canonicalize(burst.flow_keys[i]);
+                burst.flow_hashes[i] = hash_flow_key(burst.flow_keys[i]);
+            }
+        }
+        for (std::size_t i = 0; i < std::min<std::size_t>(burst.size, FLOW_PREFETCH_DISTANCE); ++i)
+        {
+            if (burst.has_flow[i])
+            {
+                flows_.prefetch(burst.flow_hashes[i]);
+            }
+        }
+
+        std::uint64_t dropped = 0;
+        for (std::size_t i = 0; i < burst.size; ++i)
+        {
+            std::size_t const ahead = i + FLOW_PREFETCH_DISTANCE;
+            if (ahead < burst.size && burst.has_flow[ahead])
+            {
+                flows_.prefetch(burst.flow_hashes[ahead]);
+            }
+            if (!burst.has_flow[i])
+            {
+                continue;
+            }
+            capture::PacketView const &packet = burst.packets[i];
+            bool inserted;
+            FlowRecord *const record = flows_.insert(burst.flow_keys[i], burst.flow_hashes[i], &inserted);
+            if (!record)
+            {
+                burst.has_flow[i] = false;
+                ++dropped;
+                continue;
+            }
+            if (inserted)
+            {
+                record->first_seen_ns = packet.timestamp_ns;
+            }
+            else if (active_timeout_ns_ != 0 && packet.timestamp_ns >= record->first_seen_ns + active_timeout_ns_)
+            {
+                burst.expired.push_back(ExpiredFlow{burst.flow_keys[i], *record, FlowEndReason::ActiveTimeout});
+                *record = FlowRecord{};
+                record->first_seen_ns = packet.timestamp_ns;
+            }
+            std::uint8_t const direction = burst.flow_directions[i];
+            record->last_seen_ns = std::max(record->last_seen_ns, packet.timestamp_ns);
+            ++record->packets[direction];
+            record->bytes[direction] += packet.wire_len;
+            record->tcp_flags |= burst.decoded[i].tcp_flags;
+        }
+        dropped_.add(dropped);
+
+        // The empty bursts of idle ticks have the worker to themselves - they sweep the whole table
+        std::size_t const expire_slots = burst.size == 0 ? flows_.capacity() : FLOW_EXPIRE_SLOTS_PER_BURST + burst.size;
+        flows_.expire(burst.now_ns, idle_timeout_ns_, expire_slots,
+                      [&burst](FlowKey const &key, FlowRecord const &record) {
+                          burst.expired.push_back(ExpiredFlow{key, record});
+                      });
+        active_.set(flows_.size());
+    }
+
+    void FlowStage::flush(PacketBurst &burst)
+    {
+        // Every flow is idle at the end of time
+        flows_.expire(UINT64_MAX, 0, flows_.capacity(), [&burst](FlowKey const &key, FlowRecord const &record) {
+            burst.expired.push_back(ExpiredFlow{key, record, FlowEndReason::ForcedEnd});
+        });
+        active_.set(flows_.size());
+    }
+
+    void FlowStage::publish(stats::Registry &registry, stats::Labels const &labels,
+                            std::vector<stats::Registration> &registrations) const
+    {
+        registrations.push_back(registry.add_counter("overwatch_flow_table_drops_total",
+                                                     "Packets not accounted to a flow because the flow table was full", labels, dropped_));
+        registrations.push_back(registry.add("overwatch_flows_active", "Flows tracked in the flow table", stats::MetricType::Gauge,
+                                             labels, [this]() { return active_.load(); }));
+    }
+
+    FlowTable<FlowRecord> const &FlowStage::get_flows() const noexcept
+    {
+        return flows_;
+    }
+
+    std::uint64_t FlowStage::get_dropped() const noexcept
+    {
+        return dropped_.load();
+    }
+
+    ExportStage::ExportStage(FlowSink sink)
+        : sink_{std::move(sink)}
+    {
+    }
+
+    char const *ExportStage::name() const noexcept
+    {
+        return "export";
+    }
+
+    void ExportStage::process(PacketBurst &burst)
+    {
+        for (ExpiredFlow const &flow : burst.expired)
+        {
+            sink_(flow);
+        }
+    }
+
+    void ExportStage::flush(PacketBurst &burst)
+    {
+        process(burst);
+    }
+
+    void Pipeline::add_stage(std::unique_ptr<Stage> stage)
+    {
+        stages_.push_back(std::move(stage));
+    }
+
+    void Pipeline::process(capture::PacketBatch const &batch)
+    {
+        reset_burst_(batch.begin(), batch.size);
+        for (capture::PacketView const &packet : batch)
+        {
+            burst_->now_ns = std::max(burst_->now_ns, packet.timestamp_ns);
+        }
+        for (std::unique_ptr<Stage> const &stage : stages_)
+        {
+            stage->process(*burst_);
+        }
+    }
+
+    void Pipeline::tick(std::uint64_t const now_ns)
+    {
+        reset_burst_(nullptr, 0);
+        // Never back in time, a packet may carry a timestamp ahead of the clock
+        burst_->now_ns = std::max(burst_->now_ns, now_ns);
+        for (std::unique_ptr<Stage> const &stage : stages_)
+        {
+            stage->process(*burst_);
+        }
+    }
+
+    void Pipeline::flush()
+    {
+        reset_burst_(nullptr, 0);
+        for (std::unique_ptr<Stage> const &stage : stages_)
+        {
+            stage->flush(*burst_);
+        }
+    }
+
+    void Pipeline::publish(stats::Registry &registry, stats::Labels const &labels,
+                           std::vector<stats::Registration> &registrations) const
+    {
+        for (std::unique_ptr<Stage> const &stage : stages_)
+        {
+            stage->publish(registry, labels, registrations);
+        }
+    }
+
+    void Pipeline::reset_burst_(capture::PacketView const *packets, std::size_t const size) noexcept
+    {
+        burst_->packets = packets;
+        burst_->size = size;
+        burst_->expired.clear();
+    }
+} // namespace overwatch::core
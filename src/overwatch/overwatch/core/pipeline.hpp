@@ -0,0 +1,314 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "decoder.hpp"
+#include "flow.hpp"
+#include "flow_table.hpp"
+#include "lpm_table.hpp"
+#include "packet.hpp"
+#include "stats_registry.hpp"
+
+namespace overwatch::core
+{
+    /**
+     * Traffic of a single target (packets sent from or to any address of the target)
+     */
+    struct TargetCounters
+    {
+        std::uint64_t packets = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    /**
+     * A flow evicted or checkpointed by the flow table, handed to the stages following the flow stage
+     */
+    struct ExpiredFlow
+    {
+        FlowKey key;
+        FlowRecord record;
+        FlowEndReason reason = FlowEndReason::IdleTimeout;
+    };
+
+    /**
+     * Working set of a burst of packets.
+     *
+     * Every stage runs over the whole burst before the next stage starts and stores its
+     * results in per-packet arrays indexed like packets, so later stages never redo the
+     * work of earlier ones.
+     */
+    struct PacketBurst
+    {
+        // Packets of the burst (views into the packet source, valid until the next burst)
+        capture::PacketView const *packets = nullptr;
+        std::size_t size = 0;
+        // Latest capture timestamp of the burst, or the clock for the empty bursts of idle ticks
+        std::uint64_t now_ns = 0;
+
+        // Filled by the decode stage
+        std::array<decode::DecodedPacket, capture::MAX_BATCH_SIZE> decoded;
+        // Filled by the classify stage (LpmTable::NO_MATCH if the address is not a target)
+        std::array<std::uint32_t, capture::MAX_BATCH_SIZE> src_targets;
+        std::array<std::uint32_t, capture::MAX_BATCH_SIZE> dst_targets;
+        // Filled by the flow stage, has_flow is false for packets without a flow (non IP or table full)
+        std::array<FlowKey, capture::MAX_BATCH_SIZE> flow_keys;
+        std::array<std::uint64_t, capture::MAX_BATCH_SIZE> flow_hashes;
+        // Direction of the packet within its flow (0: src -> dst of the key, 1: dst -> src)
+        std::array<std::uint8_t, capture::MAX_BATCH_SIZE> flow_directions;
+        std::array<bool, capture::MAX_BATCH_SIZE> has_flow;
+        // Flows evicted while processing the burst
+        std::vector<ExpiredFlow> expired;
+    };
+
+    /**
+     * A step of the packet pipeline.
+     *
+     * Stages are owned by the pipeline of a single worker and never run concurrently,
+     * they need no synchronization as long as they only touch their own state.
+     */
+    class Stage
+    {
+    public:
+        virtual ~Stage() = default;
+
+        /**
+         * Name of the stage (for logging)
+         * @return The name
+         */
+        virtual char const *name() const noexcept = 0;
+        /**
+         * Processes a burst of packets
+         *
+         * @param[in,out] burst The burst, with the results of the previous stages
+         */
+        virtual void process(PacketBurst &burst) = 0;
+        /**
+         * Flushes the state of the stage once the packet source is exhausted or shut down
+         *
+         * @param[in,out] burst An empty burst, used to pass flushed flows to the following stages
+         */
+        virtual void flush(PacketBurst &burst);
+        /**
+         * Publishes the counters of the stage (none by default)
+         *
+         * @param[in] registry The registry to publish to
+         * @param[in] labels Labels of the worker owning the stage
+         * @param[out] registrations Receives the registrations (they must not outlive the stage)
+         */
+        virtual void publish(stats::Registry &registry, stats::Labels const &labels,
+                             std::vector<stats::Registration> &registrations) const;
+    };
+
+    /**
+     * Decodes the headers of every packet
+     */
+    class DecodeStage : public Stage
+    {
+    public:
+        char const *name() const noexcept override;
+        void process(PacketBurst &burst) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        /**
+         * Number of truncated or malformed packets
+         * @return The number of decode errors
+         */
+        std::uint64_t get_errors() const noexcept;
+
+    private:
+        stats::Counter errors_;
+    };
+
+    /**
+     * Looks up the targets of the source and destination address of every packet and counts their traffic
+     */
+    class ClassifyStage : public Stage
+    {
+    public:
+        /**
+         * Creates the stage
+         *
+         * @param[in] targets Lookup table of the targets shared by all workers
+         */
+        explicit ClassifyStage(std::shared_ptr<LpmTable const> targets);
+
+        char const *name() const noexcept override;
+        void process(PacketBurst &burst) override;
+
+        /**
+         * Traffic of every target, indexed like the lookup table's prefixes
+         * @return The counters of the targets
+         */
+        std::vector<TargetCounters> const &get_counters() const noexcept;
+
+    private:
+        std::shared_ptr<LpmTable const> const targets_;
+        std::vector<TargetCounters> counters_;
+    };
+
+    /**
+     * Accounts every IP packet to its bidirectional flow and evicts idle flows
+     *
+     * Flows active for longer than the active timeout are checkpointed when their next
+     * packet arrives: the record accumulated so far is handed on and its counters restart,
+     * so that long lived flows are reported before they end.
+     *
+     * Every burst scans a bounded share of the table for idle flows. The idle ticks of the
+     * worker sweep all of it, so flows expire on time even once the traffic stops.
+     *
+     * Keys and hashes of the whole burst are computed first, then the table bucket of a
+     * packet a few positions ahead is prefetched while the current packet is accounted.
+     */
+    class FlowStage : public Stage
+    {
+    public:
+        /**
+         * Creates the stage
+         *
+         * @param[in] max_flows Number of concurrent flows tracked by the worker
+         * @param[in] idle_timeout_ns Flows not seen for this long are evicted
+         * @param[in] active_timeout_ns Flows are checkpointed every this long (0 disables the checkpoints)
+         * @throw std::invalid_argument If max_flows is 0
+         */
+        FlowStage(std::size_t const max_flows, std::uint64_t const idle_timeout_ns, std::uint64_t const active_timeout_ns = 0);
+
+        char const *name() const noexcept override;
+        void process(PacketBurst &burst) override;
+        void flush(PacketBurst &burst) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        /**
+         * Flow table of the worker
+         * @return The flow table
+         */
+        FlowTable<FlowRecord> const &get_flows() const noexcept;
+        /**
+         * Number of packets that could not be accounted because the flow table was full
+         * @return The number of dropped packets
+         */
+        std::uint64_t get_dropped() const noexcept;
+
+    private:
+        FlowTable<FlowRecord> flows_;
+        std::uint64_t const idle_timeout_ns_;
+        std::uint64_t const active_timeout_ns_;
+        stats::Counter dropped_;
+        // Flows in the table as of the last burst (read by the stats reporter)
+        stats::Counter active_;
+    };
+
+    /**
+     * Hands the flows evicted by the flow stage over to a sink
+     */
+    class ExportStage : public Stage
+    {
+    public:
+        using FlowSink = std::function<void(ExpiredFlow const &)>;
+
+        /**
+         * Creates the stage
+         *
+         * @param[in] sink Called with every evicted flow
+         */
+        explicit ExportStage(FlowSink sink);
+
+        char const *name() const noexcept override;
+        void process(PacketBurst &burst) override;
+        void flush(PacketBurst &burst) override;
+
+    private:
+        FlowSink const sink_;
+    };
+
+    /**
+     * Ordered stages run over bursts of packets (decode -> classify -> flow update -> export
+     * and any analyzer plugged in between)
+     */
+    class Pipeline
+    {
+    public:
+        /**
+         * Appends a stage, stages run in the order they were added
+         *
+         * @param[in] stage The stage
+         */
+        void add_stage(std::unique_ptr<Stage> stage);
+
+        /**
+         * Runs every stage over a batch of packets
+         *
+         * @param[in] batch The packets (at most capture::MAX_BATCH_SIZE)
+         */
+        void process(capture::PacketBatch const &batch);
+        /**
+         * Runs every stage over an empty burst, so that the work driven by time (idle expiry,
+         * periodic flushes) goes on while no packet arrives
+         *
+         * @param[in] now_ns Current time in the clock of the packet timestamps
+         */
+        void tick(std::uint64_t const now_ns);
+        /**
+         * Flushes every stage in order
+         */
+        void flush();
+        /**
+         * Publishes the counters of every stage
+         *
+         * @param[in] registry The registry to publish to
+         * @param[in] labels Labels of the worker owning the pipeline
+         * @param[out] registrations Receives the registrations (they must not outlive the pipeline)
+         */
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const;
+
+        /**
+         * Finds the first stage of a type
+         * @return The stage or nullptr if the pipeline has no stage of the type
+         */
+        template <typename T>
+        T const *find_stage() const noexcept
+        {
+            for (std::unique_ptr<Stage> const &stage : stages_)
+            {
+                if (T const *const found = dynamic_cast<T const *>(stage.get()))
+                {
+                    return found;
+                }
+            }
+            return nullptr;
+        }
+
+    private:
+        // Resets the burst for a new batch of packets
+        void reset_burst_(capture::PacketView const *packets, std::size_t const size) noexcept;
+
+        std::vector<std::unique_ptr<Stage>> stages_;
+        // Reused for every burst so that processing never allocates
+        std::unique_ptr<PacketBurst> burst_ = std::make_unique<PacketBurst>();
+    };
+} // namespace overwatch::core
@@ -0,0 +1,367 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <algorithm>
+#include <utility>
+
+#include "config.hpp"
+#include "logging.hpp"
+#include "timing.hpp"
+#include "worker.hpp"
+
+// Longest wait for packets - sources woken by the shutdown event return earlier
+#define WORKER_IDLE_TIMEOUT_MS 1000
+// Longest time a worker spends processing what its source still holds after a shutdown
+#define SHUTDOWN_DRAIN_TIMEOUT_MS 1000
+// The drain ends early once the source stayed empty for this long
+#define DRAIN_IDLE_TIMEOUT_MS 20
+// Interval between two reads of the kernel drop counter of a source
+#define DROP_POLL_INTERVAL_MS 1000
+#define NANOSECONDS_PER_MILLISECOND 1000000ULL
+
+namespace overwatch::core
+{
+    namespace
+    {
+        /**
+         * Pins the calling thread to a single CPU
+         *
+         * @param[in] cpu The CPU to pin the thread to
+         * @return True if the thread was pinned
+         */
+        bool pin_current_thread_(int const cpu) noexcept
+        {
+#ifdef __linux__
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu, &cpu_set);
+            return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+            (void)cpu;
+            return false;
+#endif
+        }
+    } // namespace
+
+    Worker::Worker(std::size_t const id, std::unique_ptr<capture::PacketSource> source, std::optional<int> const cpu,
+                   std::unique_ptr<Pipeline> pipeline)
+        : id_{id}, source_{std::move(source)}, cpu_{cpu}, counters_{}, pipeline_{std::move(pipeline)},
+          thread_{}, finished_{false}, error_{}, on_exit_{}, next_drop_poll_ns_{0}, registrations_{}
+    {
+        stats::Registry &registry = stats::default_registry();
+        stats::Labels const labels{{"worker", std::to_string(id_)}};
+        registrations_.push_back(registry.add_counter("overwatch_rx_packets_total", "Packets received", labels, counters_.packets));
+        registrations_.push_back(registry.add_counter("overwatch_rx_bytes_total", "Bytes received (on the wire)", labels, counters_.bytes));
+        registrations_.push_back(registry.add_counter("overwatch_rx_batches_total", "Batches of packets received", labels, counters_.batches));
+        registrations_.push_back(registry.add_counter("overwatch_rx_drops_total", "Packets dropped by the kernel before capture", labels, counters_.drops));
+        if (pipeline_)
+        {
+            pipeline_->publish(registry, labels, registrations_);
+        }
+    }
+
+    Worker::~Worker()
+    {
+        if (thread_.joinable())
+        {
+            // Never leave a detached thread behind a destroyed worker
+            g_config.signal_shutdown();
+            thread_.join();
+        }
+    }
+
+    void Worker::start(std::function<void()> on_exit)
+    {
+        on_exit_ = std::move(on_exit);
+        thread_ = std::thread{&Worker::run_, this};
+    }
+
+    void Worker::join()
+    {
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+        if (error_)
+        {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    bool Worker::finished() const noexcept
+    {
+        return finished_;
+    }
+
+    WorkerCounters Worker::get_counters() const noexcept
+    {
+        return WorkerCounters{counters_.packets.load(), counters_.bytes.load(), counters_.batches.load(), counters_.drops.load()};
+    }
+
+    Pipeline const *Worker::get_pipeline() const noexcept
+    {
+        return pipeline_.get();
+    }
+
+    void Worker::run_() noexcept
+    {
+        try
+        {
+            if (cpu_ && !pin_current_thread_(*cpu_))
+            {
+                LOG_WARNING << "Failed to pin worker " << id_ << " to CPU " << *cpu_;
+            }
+            LOG_DEBUG << "Worker " << id_ << " started" << (cpu_ ? " on CPU " + std::to_string(*cpu_) : "");
+
+            capture::PacketBatch batch;
+            source_->set_wakeup_fd(g_config.get_shutdown_event().get_fd());
+            while (!g_config.is_shutdown() && !source_->exhausted())
+            {
+                if (source_->next_batch(batch, WORKER_IDLE_TIMEOUT_MS))
+                {
+                    process_(batch);
+                }
+                else
+                {
+                    tick_();
+                }
+                if (common::timing::monotonic_ns() >= next_drop_poll_ns_)
+                {
+                    poll_drops_();
+                }
+            }
+            drain_(batch);
+            poll_drops_();
+            if (pipeline_)
+            {
+                pipeline_->flush();
+            }
+        }
+        catch (...)
+        {
+            error_ = std::current_exception();
+            // A failed worker takes the whole instance down rather than silently losing its share of traffic
+            g_config.signal_shutdown();
+        }
+        LOG_DEBUG << "Worker " << id_ << " stopped";
+        finished_ = true;
+        if (on_exit_)
+        {
+            on_exit_();
+        }
+    }
+
+    void Worker::process_(capture::PacketBatch const &batch)
+    {
+        std::uint64_t bytes = 0;
+        for (capture::PacketView const &packet : batch)
+        {
+            bytes += packet.wire_len;
+        }
+        counters_.bytes.add(bytes);
+        counters_.packets.add(batch.size);
+        counters_.batches.add();
+        if (pipeline_)
+        {
+            pipeline_->process(batch);
+        }
+    }
+
+    void Worker::tick_()
+    {
+        // Idle flows expire and pending records go out even when the traffic stops
+        std::optional<std::uint64_t> const now_ns = source_->now_ns();
+        if (pipeline_ && now_ns)
+        {
+            pipeline_->tick(*now_ns);
+        }
+    }
+
+    void Worker::drain_(capture::PacketBatch &batch)
+    {
+        // Waits must run their course now that the shutdown event is readable for good
+        source_->set_wakeup_fd(-1);
+        std::uint64_t const deadline = common::timing::monotonic_ns() + SHUTDOWN_DRAIN_TIMEOUT_MS * NANOSECONDS_PER_MILLISECOND;
+        std::uint64_t drained = 0;
+        while (!source_->exhausted() && common::timing::monotonic_ns() < deadline &&
+               source_->next_batch(batch, DRAIN_IDLE_TIMEOUT_MS))
+        {
+            drained += batch.size;
+            process_(batch);
+        }
+        if (drained > 0)
+        {
+            LOG_DEBUG << "Worker " << id_ << " drained " << drained << " packets on shutdown";
+        }
+    }
+
+    void Worker::poll_drops_() noexcept
+    {
+        counters_.drops.add(source_->take_drops());
+        next_drop_poll_ns_ = common::timing::monotonic_ns() + DROP_POLL_INTERVAL_MS * NANOSECONDS_PER_MILLISECOND;
+    }
+
+    WorkerPool::WorkerPool(std::vector<std::unique_ptr<capture::PacketSource>> sources, bool const pin_threads,
+                           PipelineFactory const &make_pipeline)
+        : running_{0}
+    {
+        std::vector<int> const cpus = available_cpus();
+        for (std::size_t i = 0; i < sources.size(); ++i)
+        {
+            std::optional<int> cpu;
+            if (pin_threads && !cpus.empty())
+            {
+                cpu = cpus[i % cpus.size()];
+            }
+            workers_.push_back(std::make_unique<Worker>(i, std::move(sources[i]), cpu,
+                                                        make_pipeline ? make_pipeline(i) : nullptr));
+        }
+    }
+
+    void WorkerPool::start()
+    {
+        running_ = workers_.size();
+        if (workers_.empty())
+        {
+            finished_.trigger();
+        }
+        for (std::unique_ptr<Worker> &worker : workers_)
+        {
+            worker->start([this]() {
+                if (running_.fetch_sub(1) == 1)
+                {
+                    finished_.trigger();
+                }
+            });
+        }
+    }
+
+    void WorkerPool::join()
+    {
+        std::exception_ptr error;
+        for (std::unique_ptr<Worker> &worker : workers_)
+        {
+            try
+            {
+                worker->join();
+            }
+            catch (...)
+            {
+                // Keep joining the remaining workers before reporting the first failure
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    bool WorkerPool::finished() const noexcept
+    {
+        for (std::unique_ptr<Worker> const &worker : workers_)
+        {
+            if (!worker->finished())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Event const &WorkerPool::get_finished_event() const noexcept
+    {
+        return finished_;
+    }
+
+    WorkerCounters WorkerPool::get_counters() const noexcept
+    {
+        WorkerCounters total;
+        for (std::unique_ptr<Worker> const &worker : workers_)
+        {
+            WorkerCounters const counters = worker->get_counters();
+            total.packets += counters.packets;
+            total.bytes += counters.bytes;
+            total.batches += counters.batches;
+            total.drops += counters.drops;
+        }
+        return total;
+    }
+
+    std::vector<TargetCounters> WorkerPool::get_target_counters() const noexcept
+    {
+        std::vector<TargetCounters> total;
+        for (std::unique_ptr<Worker> const &worker : workers_)
+        {
+            ClassifyStage const *const classify = worker->get_pipeline() ? worker->get_pipeline()->find_stage<ClassifyStage>() : nullptr;
+            if (!classify)
+            {
+                continue;
+            }
+            std::vector<TargetCounters> const &counters = classify->get_counters();
+            total.resize(std::max(total.size(), counters.size()));
+            for (std::size_t i = 0; i < counters.size(); ++i)
+            {
+                total[i].packets += counters[i].packets;
+                total[i].bytes += counters[i].bytes;
+            }
+        }
+        return total;
+    }
+
+    std::size_t WorkerPool::size() const noexcept
+    {
+        return workers_.size();
+    }
+
+    std::vector<int> available_cpus()
+    {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &cpu_set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        if (cpus.empty())
+        {
+            unsigned int const num_cpus = std::max(1U, std::thread::hardware_concurrency());
+            for (unsigned int cpu = 0; cpu < num_cpus; ++cpu)
+            {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+        return cpus;
+    }
+} // namespace overwatch::core
@@ -0,0 +1,228 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "event.hpp"
+#include "packet_source.hpp"
+#include "pipeline.hpp"
+#include "stats_registry.hpp"
+
+namespace overwatch::core
+{
+    /**
+     * Snapshot of the counters of one or more workers
+     */
+    struct WorkerCounters
+    {
+        std::uint64_t packets = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t batches = 0;
+        // Packets the kernel dropped because the worker fell behind
+        std::uint64_t drops = 0;
+    };
+
+    /**
+     * Creates the pipeline of a worker
+     *
+     * @param[in] id Index of the worker within its pool
+     * @return The pipeline processing the packets of the worker
+     */
+    using PipelineFactory = std::function<std::unique_ptr<Pipeline>(std::size_t const id)>;
+
+    /**
+     * A capture thread that drains its own packet source.
+     *
+     * Everything a worker touches while processing packets is owned by the worker,
+     * so workers scale with the number of cores without synchronizing with each other.
+     * Its counters (and those of its pipeline) are published in the default stats registry
+     * with a 'worker' label for as long as the worker lives.
+     */
+    class Worker
+    {
+    public:
+        /**
+         * Creates a worker for a packet source
+         *
+         * @param[in] id Index of the worker within its pool
+         * @param[in] source The packet source drained by the worker
+         * @param[in] cpu CPU the worker thread is pinned to (not pinned if empty)
+         * @param[in] pipeline Pipeline the packets are run through (packets are only counted if null)
+         */
+        Worker(std::size_t const id, std::unique_ptr<capture::PacketSource> source, std::optional<int> const cpu,
+               std::unique_ptr<Pipeline> pipeline = nullptr);
+        ~Worker();
+
+        Worker(Worker const &) = delete;
+        Worker &operator=(Worker const &) = delete;
+
+        /**
+         * Starts the worker thread
+         *
+         * @param[in] on_exit Called from the worker thread right before it exits (optional)
+         */
+        void start(std::function<void()> on_exit = nullptr);
+        /**
+         * Waits for the worker thread to exit
+         * @throw The exception that terminated the worker, if any
+         */
+        void join();
+        /**
+         * Determines if the worker thread has exited
+         * @return True once the worker stopped processing packets
+         */
+        bool finished() const noexcept;
+        /**
+         * Counters of the worker (safe to call while the worker runs)
+         * @return A snapshot of the counters of the worker
+         */
+        WorkerCounters get_counters() const noexcept;
+        /**
+         * Pipeline of the worker (only stable once the worker has been joined)
+         * @return The pipeline or nullptr if the worker only counts packets
+         */
+        Pipeline const *get_pipeline() const noexcept;
+
+    private:
+        // Main loop of the worker thread
+        void run_() noexcept;
+        // Counts a batch and runs it through the pipeline
+        void process_(capture::PacketBatch const &batch);
+        // Runs the pipeline over an empty burst at the time of the source when no packet arrived
+        void tick_();
+        // Processes what the source still holds after a shutdown, within a bounded time
+        void drain_(capture::PacketBatch &batch);
+        // Picks up the packets the kernel dropped since the last poll
+        void poll_drops_() noexcept;
+
+        /**
+         * Live counters of a worker, only ever written by the worker thread.
+         *
+         * Aligned to a cache line so that workers never share a line on the hot path.
+         */
+        struct alignas(64) LiveCounters
+        {
+            stats::Counter packets;
+            stats::Counter bytes;
+            stats::Counter batches;
+            stats::Counter drops;
+        };
+
+        // Index of the worker within its pool
+        std::size_t const id_;
+        // Packet source owned by the worker
+        std::unique_ptr<capture::PacketSource> source_;
+        // CPU to pin the worker thread to
+        std::optional<int> const cpu_;
+        // Counters owned by the worker
+        LiveCounters counters_;
+        // Stages the packets of the worker run through
+        std::unique_ptr<Pipeline> pipeline_;
+        // Underlying thread
+        std::thread thread_;
+        // Set once the worker thread exits
+        std::atomic_bool finished_;
+        // Error that terminated the worker thread
+        std::exception_ptr error_;
+        // Called right before the worker thread exits
+        std::function<void()> on_exit_;
+        // Next time the kernel drop counter of the source is polled
+        std::uint64_t next_drop_poll_ns_;
+        // Keeps the counters published (declared last to be withdrawn before the counters go away)
+        std::vector<stats::Registration> registrations_;
+    };
+
+    /**
+     * Pool of workers with one worker per packet source, each pinned to its own core.
+     *
+     * On shutdown every worker is woken from its wait right away, hands what its source
+     * already captured to its pipeline (bounded in time) and flushes the pipeline.
+     */
+    class WorkerPool
+    {
+    public:
+        /**
+         * Creates one worker per packet source
+         *
+         * @param[in] sources The packet sources (e.g. the sockets of a fanout group)
+         * @param[in] pin_threads Pin every worker to its own CPU
+         * @param[in] make_pipeline Creates the pipeline of every worker (packets are only counted if empty)
+         */
+        WorkerPool(std::vector<std::unique_ptr<capture::PacketSource>> sources, bool const pin_threads = true,
+                   PipelineFactory const &make_pipeline = nullptr);
+
+        /**
+         * Starts all workers
+         */
+        void start();
+        /**
+         * Waits for all workers to exit
+         * @throw The first exception that terminated a worker, if any
+         */
+        void join();
+        /**
+         * Determines if all workers have exited
+         * @return True once no worker is processing packets anymore
+         */
+        bool finished() const noexcept;
+        /**
+         * Event triggered once all workers have exited
+         * @return The event
+         */
+        Event const &get_finished_event() const noexcept;
+        /**
+         * Sums up the counters of all workers (safe to call while the workers run)
+         * @return The total of all worker counters
+         */
+        WorkerCounters get_counters() const noexcept;
+        /**
+         * Sums up the target counters of the classify stages of all workers (only stable once the pool has been joined)
+         * @return The total of every target, indexed like the lookup table's prefixes
+         */
+        std::vector<TargetCounters> get_target_counters() const noexcept;
+        /**
+         * Number of workers in the pool
+         * @return The number of workers
+         */
+        std::size_t size() const noexcept;
+
+    private:
+        std::vector<std::unique_ptr<Worker>> workers_;
+        // Workers whose thread has not exited yet
+        std::atomic<std::size_t> running_;
+        // Triggered by the last worker to exit
+        Event finished_;
+    };
+
+    /**
+     * Lists the CPUs the process is allowed to run on
+     * @return The CPU indices available to the process
+     */
+    std::vector<int> available_cpus();
+} // namespace overwatch::core
@@ -0,0 +1,304 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "decoder.hpp"
+
+// Frame layout
+#define ETHERNET_HEADER_SIZE 14
+#define ETHER_TYPE_OFFSET 12
+#define VLAN_TAG_SIZE 4
+#define ETHER_TYPE_IPV4 0x0800
+#define ETHER_TYPE_IPV6 0x86DD
+#define ETHER_TYPE_VLAN 0x8100
+#define ETHER_TYPE_QINQ 0x88A8
+#define VLAN_ID_MASK 0x0FFF
+// IPv4 header
+#define IPV4_MIN_HEADER_SIZE 20
+#define IPV4_TOTAL_LENGTH_OFFSET 2
+#define IPV4_FRAGMENT_OFFSET 6
+#define IPV4_PROTOCOL_OFFSET 9
+#define IPV4_MORE_FRAGMENTS 0x2000
+#define IPV4_FRAGMENT_OFFSET_MASK 0x1FFF
+// IPv6 header and extension headers
+#define IPV6_HEADER_SIZE 40
+#define IPV6_PAYLOAD_LENGTH_OFFSET 4
+#define IPV6_NEXT_HEADER_OFFSET 6
+#define IPV6_HOP_BY_HOP 0
+#define IPV6_ROUTING 43
+#define IPV6_FRAGMENT 44
+#define IPV6_ESP 50
+#define IPV6_AUTHENTICATION 51
+#define IPV6_DESTINATION_OPTIONS 60
+#define IPV6_FRAGMENT_HEADER_SIZE 8
+#define IPV6_MORE_FRAGMENTS 0x0001
+#define IPV6_FRAGMENT_OFFSET_MASK 0xFFF8
+// Transport headers
+#define TCP_MIN_HEADER_SIZE 20
+#define TCP_DATA_OFFSET 12
+#define TCP_FLAGS_OFFSET 13
+#define UDP_HEADER_SIZE 8
+#define ICMP_HEADER_SIZE 8
+
+namespace overwatch::decode
+{
+    namespace
+    {
+        /**
+         * Walks the IPv6 extension headers
+         *
+         * @param[in] data Start of the frame
+         * @param[in] caplen Bytes available in the frame
+         * @param[in,out] offset Start of the first extension header, set to the start of the transport header
+         * @param[in,out] decoded The packet, protocol is set to the first header that is not an extension
+         * @return False if the transport header cannot be decoded
+         */
+        bool skip_ipv6_extensions_(std::uint8_t const *const data, std::uint32_t const caplen, std::uint32_t &offset,
+                                   DecodedPacket &decoded) noexcept
+        {
+            std::uint8_t next_header = decoded.protocol;
+            for (std::size_t i = 0; i < MAX_IPV6_EXTENSION_HEADERS; ++i)
+            {
+                std::uint32_t length;
+                switch (next_header)
+                {
+                case IPV6_HOP_BY_HOP:
+                case IPV6_ROUTING:
+                case IPV6_DESTINATION_OPTIONS:
+                    if (offset + 2 > caplen)
+                    {
+                        decoded.flags |= FLAG_TRUNCATED;
+                        return false;
+                    }
+                    length = (data[offset + 1] + 1u) * 8;
+                    break;
+                case IPV6_AUTHENTICATION:
+                    if (offset + 2 > caplen)
+                    {
+                        decoded.flags |= FLAG_TRUNCATED;
+                        return false;
+                    }
+                    length = (data[offset + 1] + 2u) * 4;
+                    break;
+                case IPV6_FRAGMENT:
+                {
+                    if (offset + IPV6_FRAGMENT_HEADER_SIZE > caplen)
+                    {
+                        decoded.flags |= FLAG_TRUNCATED;
+                        return false;
+                    }
+                    std::uint16_t const fragment = load_be16(data + offset + 2);
+                    decoded.flags |= FLAG_FRAGMENT;
+                    if (fragment & IPV6_FRAGMENT_OFFSET_MASK)
+                    {
+                        // Only the first fragment carries the transport header
+                        decoded.protocol = data[offset];
+                        return false;
+                    }
+                    length = IPV6_FRAGMENT_HEADER_SIZE;
+                    break;
+                }
+                case IPV6_ESP:
+                    decoded.flags |= FLAG_UNSUPPORTED;
+                    decoded.protocol = next_header;
+                    return false;
+                default:
+                    decoded.protocol = next_header;
+                    return true;
+                }
+                if (offset + length > caplen)
+                {
+                    decoded.flags |= FLAG_TRUNCATED;
+                    return false;
+                }
+                next_header = data[offset];
+                offset += length;
+            }
+            decoded.flags |= FLAG_UNSUPPORTED;
+            decoded.protocol = next_header;
+            return false;
+        }
+    } // namespace
+
+    DecodedPacket decode(capture::PacketView const &packet) noexcept
+    {
+        DecodedPacket decoded{};
+        std::uint8_t const *const data = packet.data;
+        // Headers are looked for within the first 64KiB, offsets are 16 bits
+        std::uint32_t const caplen = std::min<std::uint32_t>(packet.caplen, UINT16_MAX);
+        if (caplen < ETHERNET_HEADER_SIZE)
+        {
+            decoded.flags = FLAG_TRUNCATED;
+            return decoded;
+        }
+        decoded.layers = LAYER_ETHERNET;
+
+        // Link layer
+        std::uint32_t offset = ETHER_TYPE_OFFSET;
+        std::uint16_t ether_type = load_be16(data + offset);
+        while (ether_type == ETHER_TYPE_VLAN || ether_type == ETHER_TYPE_QINQ)
+        {
+            if (decoded.vlan_count == MAX_VLAN_TAGS)
+            {
+                decoded.flags |= FLAG_UNSUPPORTED;
+                return decoded;
+            }
+            if (offset + VLAN_TAG_SIZE + 2 > caplen)
+            {
+                decoded.flags |= FLAG_TRUNCATED;
+                return decoded;
+            }
+            decoded.vlan_ids[decoded.vlan_count++] = load_be16(data + offset + 2) & VLAN_ID_MASK;
+            decoded.layers |= LAYER_VLAN;
+            offset += VLAN_TAG_SIZE;
+            ether_type = load_be16(data + offset);
+        }
+        offset += 2;
+        decoded.ether_type = ether_type;
+
+        // Network layer, end is the end of the IP packet on the wire (Ethernet padding excluded)
+        std::uint32_t end;
+        if (ether_type == ETHER_TYPE_IPV4)
+        {
+            if (offset + IPV4_MIN_HEADER_SIZE > caplen)
+            {
+                decoded.flags |= FLAG_TRUNCATED;
+                return decoded;
+            }
+            std::uint8_t const *const header = data + offset;
+            std::uint32_t const header_size = (header[0] & 0x0F) * 4u;
+            std::uint32_t const total_length = load_be16(header + IPV4_TOTAL_LENGTH_OFFSET);
+            if ((header[0] >> 4) != 4 || header_size < IPV4_MIN_HEADER_SIZE || total_length < header_size)
+            {
+                decoded.flags |= FLAG_MALFORMED;
+                return decoded;
+            }
+            decoded.layers |= LAYER_IPV4;
+            decoded.l3_offset = static_cast<std::uint16_t>(offset);
+            decoded.protocol = header[IPV4_PROTOCOL_OFFSET];
+            std::uint16_t const fragment = load_be16(header + IPV4_FRAGMENT_OFFSET);
+            if (fragment & (IPV4_MORE_FRAGMENTS | IPV4_FRAGMENT_OFFSET_MASK))
+            {
+                decoded.flags |= FLAG_FRAGMENT;
+                // Only the first fragment carries the transport header
+                if (fragment & IPV4_FRAGMENT_OFFSET_MASK)
+                {
+                    return decoded;
+                }
+            }
+            end = offset + total_length;
+            offset += header_size;
+            if (offset > caplen)
+            {
+                decoded.flags |= FLAG_TRUNCATED;
+                return decoded;
+            }
+        }
+        else if (ether_type == ETHER_TYPE_IPV6)
+        {
+            if (offset + IPV6_HEADER_SIZE > caplen)
+            {
+                decoded.flags |= FLAG_TRUNCATED;
+                return decoded;
+            }
+            std::uint8_t const *const header = data + offset;
+            if ((header[0] >> 4) != 6)
+            {
+                decoded.flags |= FLAG_MALFORMED;
+                return decoded;
+            }
+            decoded.layers |= LAYER_IPV6;
+            decoded.l3_offset = static_cast<std::uint16_t>(offset);
+            decoded.protocol = header[IPV6_NEXT_HEADER_OFFSET];
+            std::uint32_t const payload_length = load_be16(header + IPV6_PAYLOAD_LENGTH_OFFSET);
+            offset += IPV6_HEADER_SIZE;
+            // A zero payload length announces a jumbogram, its length is only known from the capture
+            end = payload_length ? offset + payload_length : std::max<std::uint32_t>(packet.wire_len, offset);
+            if (!skip_ipv6_extensions_(data, caplen, offset, decoded))
+            {
+                return decoded;
+            }
+        }
+        else
+        {
+            return decoded;
+        }
+        if (offset > end)
+        {
+            decoded.flags |= FLAG_MALFORMED;
+            return decoded;
+        }
+
+        // Transport layer
+        decoded.l4_offset = static_cast<std::uint16_t>(offset);
+        std::uint8_t layer;
+        std::uint32_t header_size;
+        switch (decoded.protocol)
+        {
+        case PROTOCOL_TCP:
+            if (offset + TCP_MIN_HEADER_SIZE > caplen)
+            {
+                decoded.flags |= FLAG_TRUNCATED;
+                return decoded;
+            }
+            layer = LAYER_TCP;
+            header_size = (data[offset + TCP_DATA_OFFSET] >> 4) * 4u;
+            break;
+        case PROTOCOL_UDP:
+            layer = LAYER_UDP;
+            header_size = UDP_HEADER_SIZE;
+            break;
+        case PROTOCOL_ICMP:
+        case PROTOCOL_ICMPV6:
+            layer = LAYER_ICMP;
+            header_size = ICMP_HEADER_SIZE;
+            break;
+        default:
+            // Unknown transports only keep the offset of their header
+            return decoded;
+        }
+        if (offset + std::min<std::uint32_t>(header_size, TCP_MIN_HEADER_SIZE) > caplen)
+        {
+            decoded.flags |= FLAG_TRUNCATED;
+            return decoded;
+        }
+        if ((layer == LAYER_TCP && header_size < TCP_MIN_HEADER_SIZE) || offset + header_size > end)
+        {
+            decoded.flags |= FLAG_MALFORMED;
+            return decoded;
+        }
+        decoded.layers |= layer;
+        if (layer != LAYER_ICMP)
+        {
+            decoded.src_port = load_be16(data + offset);
+            decoded.dst_port = load_be16(data + offset + 2);
+        }
+        decoded.tcp_flags = layer == LAYER_TCP ? data[offset + TCP_FLAGS_OFFSET] : 0;
+        offset += header_size;
+        if (offset > caplen)
+        {
+            // TCP options past the end of the capture
+            decoded.flags |= FLAG_TRUNCATED;
+            return decoded;
+        }
+        decoded.payload_offset = static_cast<std::uint16_t>(offset);
+        decoded.payload_length = static_cast<std::uint16_t>(std::min<std::uint32_t>(end - offset, UINT16_MAX));
+        return decoded;
+    }
+} // namespace overwatch::decode
@@ -0,0 +1,191 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+
+#include "ip_address.hpp"
+#include "packet.hpp"
+
+namespace overwatch::decode
+{
+    // VLAN tags decoded in front of the network layer (802.1Q or QinQ)
+    constexpr std::size_t MAX_VLAN_TAGS = 2;
+    // IPv6 extension headers walked before giving up on the transport layer
+    constexpr std::size_t MAX_IPV6_EXTENSION_HEADERS = 8;
+
+    // Layers found in a frame (DecodedPacket::layers)
+    constexpr std::uint8_t LAYER_ETHERNET = 1 << 0;
+    constexpr std::uint8_t LAYER_VLAN = 1 << 1;
+    constexpr std::uint8_t LAYER_IPV4 = 1 << 2;
+    constexpr std::uint8_t LAYER_IPV6 = 1 << 3;
+    constexpr std::uint8_t LAYER_TCP = 1 << 4;
+    constexpr std::uint8_t LAYER_UDP = 1 << 5;
+    constexpr std::uint8_t LAYER_ICMP = 1 << 6;
+
+    // Anomalies found while decoding (DecodedPacket::flags)
+    // The capture ends within a header
+    constexpr std::uint8_t FLAG_TRUNCATED = 1 << 0;
+    // A header contradicts itself or the headers around it
+    constexpr std::uint8_t FLAG_MALFORMED = 1 << 1;
+    // The packet is an IP fragment (the transport layer is only decoded for the first fragment)
+    constexpr std::uint8_t FLAG_FRAGMENT = 1 << 2;
+    // More VLAN tags or IPv6 extension headers than decoded, or an encrypted (ESP) payload
+    constexpr std::uint8_t FLAG_UNSUPPORTED = 1 << 3;
+
+    // Protocol numbers of the transport layers
+    constexpr std::uint8_t PROTOCOL_ICMP = 1;
+    constexpr std::uint8_t PROTOCOL_TCP = 6;
+    constexpr std::uint8_t PROTOCOL_UDP = 17;
+    constexpr std::uint8_t PROTOCOL_ICMPV6 = 58;
+
+    /**
+     * Offsets and fields of the headers of a frame.
+     *
+     * The decoder never copies the frame, later stages read the headers they need straight
+     * from the frame through the offsets. Offsets are relative to the start of the frame and
+     * only meaningful for the layers flagged in layers.
+     */
+    struct DecodedPacket
+    {
+        // VLAN identifiers, outermost first
+        std::uint16_t vlan_ids[MAX_VLAN_TAGS];
+        // EtherType of the network layer (after the VLAN tags)
+        std::uint16_t ether_type;
+        // Start of the IPv4 or IPv6 header
+        std::uint16_t l3_offset;
+        // Start of the transport header (after the IPv6 extension headers)
+        std::uint16_t l4_offset;
+        // Start of the transport payload
+        std::uint16_t payload_offset;
+        // Length of the transport payload on the wire according to the IP header (may exceed the capture)
+        std::uint16_t payload_length;
+        // Transport ports in host byte order (TCP and UDP only)
+        std::uint16_t src_port;
+        std::uint16_t dst_port;
+        // LAYER_* bits
+        std::uint8_t layers;
+        // FLAG_* bits
+        std::uint8_t flags;
+        // Number of VLAN tags in vlan_ids
+        std::uint8_t vlan_count;
+        // Transport protocol (IPv4 protocol or the next header ending the IPv6 extension headers)
+        std::uint8_t protocol;
+        // TCP flags (FIN 0x01 to CWR 0x80)
+        std::uint8_t tcp_flags;
+
+        bool has(std::uint8_t const layer) const noexcept { return (layers & layer) != 0; }
+        bool is_ip() const noexcept { return has(LAYER_IPV4 | LAYER_IPV6); }
+    };
+
+    static_assert(sizeof(DecodedPacket) <= 32, "Decoded packets are kept per packet of a batch");
+
+    /**
+     * Loads big endian values from a frame (no alignment required)
+     *
+     * @param[in] bytes The first byte of the value
+     * @return The value in host byte order
+     */
+    inline std::uint16_t load_be16(std::uint8_t const *const bytes) noexcept
+    {
+        std::uint16_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return value;
+#else
+        return static_cast<std::uint16_t>(value << 8 | value >> 8);
+#endif
+    }
+
+    inline std::uint32_t load_be32(std::uint8_t const *const bytes) noexcept
+    {
+        std::uint32_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return value;
+#elif defined(_MSC_VER)
+        return _byteswap_ulong(value);
+#else
+        return __builtin_bswap32(value);
+#endif
+    }
+
+    inline std::uint64_t load_be64(std::uint8_t const *const bytes) noexcept
+    {
+        std::uint64_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return value;
+#elif defined(_MSC_VER)
+        return _byteswap_uint64(value);
+#else
+        return __builtin_bswap64(value);
+#endif
+    }
+
+    /**
+     * Decodes the headers of an Ethernet frame in place
+     *
+     * Decoding stops at the first layer that is not supported or does not fit in the
+     * capture, the layers decoded up to there stay valid.
+     *
+     * @param[in] packet The frame
+     * @return The offsets and fields of the decoded headers
+     */
+    DecodedPacket decode(capture::PacketView const &packet) noexcept;
+
+    /**
+     * Source address of a decoded IPv4 or IPv6 packet
+     *
+     * @param[in] packet The frame
+     * @param[in] decoded The decoded headers of the frame (must have an IP layer)
+     * @return The source address
+     */
+    inline common::utils::IpAddress src_address(capture::PacketView const &packet, DecodedPacket const &decoded) noexcept
+    {
+        std::uint8_t const *const header = packet.data + decoded.l3_offset;
+        if (decoded.has(LAYER_IPV4))
+        {
+            return common::utils::IpAddress::from_ipv4(load_be32(header + 12));
+        }
+        return common::utils::IpAddress{load_be64(header + 8), load_be64(header + 16)};
+    }
+
+    /**
+     * Destination address of a decoded IPv4 or IPv6 packet
+     *
+     * @param[in] packet The frame
+     * @param[in] decoded The decoded headers of the frame (must have an IP layer)
+     * @return The destination address
+     */
+    inline common::utils::IpAddress dst_address(capture::PacketView const &packet, DecodedPacket const &decoded) noexcept
+    {
+        std::uint8_t const *const header = packet.data + decoded.l3_offset;
+        if (decoded.has(LAYER_IPV4))
+        {
+            return common::utils::IpAddress::from_ipv4(load_be32(header + 16));
+        }
+        return common::utils::IpAddress{load_be64(header + 24), load_be64(header + 32)};
+    }
+} // namespace overwatch::decode
@@ -0,0 +1,233 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+#include "collector.hpp"
+#include "ipfix.hpp"
+
+// Messages sent over UDP stay below the common path MTU so that they are never fragmented
+#define UDP_MESSAGE_SIZE 1400
+// Datagrams handed to the kernel per system call
+#define UDP_SEND_BATCH 64
+
+namespace
+{
+    /**
+     * Parses the port of a UDP destination
+     *
+     * @param[in] port The port
+     * @return The port or 0 if it is not a valid port number
+     */
+    std::uint16_t parse_port_(std::string const &port) noexcept
+    {
+        if (port.empty() || port.size() > 5 || !std::all_of(port.begin(), port.end(), [](char const c) { return c >= '0' && c <= '9'; }))
+        {
+            return 0;
+        }
+        unsigned long const value = std::stoul(port);
+        return value > UINT16_MAX ? 0 : static_cast<std::uint16_t>(value);
+    }
+} // namespace
+
+namespace overwatch::exporter
+{
+    FileCollector::FileCollector(std::filesystem::path const &file_path)
+        : file_{std::fopen(file_path.c_str(), "wb")}
+    {
+        if (!file_)
+        {
+            throw std::runtime_error{"Failed to create '" + file_path.string() + "' - " + std::strerror(errno)};
+        }
+        // The exporter hands over large blocks - a stdio buffer would only add a copy
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+    }
+
+    FileCollector::~FileCollector()
+    {
+        std::fclose(file_);
+    }
+
+    std::size_t FileCollector::max_message_size() const noexcept
+    {
+        return IPFIX_MAX_MESSAGE_SIZE;
+    }
+
+    void FileCollector::write(std::uint8_t const *data, std::size_t const size)
+    {
+        if (std::fwrite(data, 1, size, file_) != size)
+        {
+            throw std::runtime_error{std::string{"Failed to write the flow export file - "} + std::strerror(errno)};
+        }
+    }
+
+#ifdef __linux__
+    UdpCollector::UdpCollector(common::utils::IpAddress const &address, std::uint16_t const port)
+        : fd_{-1}
+    {
+        sockaddr_storage storage{};
+        socklen_t length;
+        if (address.is_ipv4())
+        {
+            sockaddr_in &ipv4 = reinterpret_cast<sockaddr_in &>(storage);
+            ipv4.sin_family = AF_INET;
+            ipv4.sin_port = htons(port);
+            ipv4.sin_addr.s_addr = htonl(address.to_ipv4());
+            length = sizeof(sockaddr_in);
+        }
+        else
+        {
+            sockaddr_in6 &ipv6 = reinterpret_cast<sockaddr_in6 &>(storage);
+            ipv6.sin6_family = AF_INET6;
+            ipv6.sin6_port = htons(port);
+            std::array<std::uint8_t, 16> const bytes = address.to_bytes();
+            std::memcpy(&ipv6.sin6_addr, bytes.data(), bytes.size());
+            length = sizeof(sockaddr_in6);
+        }
+        fd_ = socket(storage.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0)
+        {
+            throw std::runtime_error{std::string{"Failed to open the flow export socket - "} + std::strerror(errno)};
+        }
+        // Connected, so that the datagrams need no address and the collector's errors are reported
+        if (connect(fd_, reinterpret_cast<sockaddr const *>(&storage), length) != 0)
+        {
+            int const error = errno;
+            close(fd_);
+            throw std::runtime_error{"Failed to connect the flow export socket to " + common::utils::to_string(address) + " - " +
+                                     std::strerror(error)};
+        }
+    }
+
+    UdpCollector::~UdpCollector()
+    {
+        close(fd_);
+    }
+
+    std::size_t UdpCollector::max_message_size() const noexcept
+    {
+        return UDP_MESSAGE_SIZE;
+    }
+
+    void UdpCollector::write(std::uint8_t const *data, std::size_t const size)
+    {
+        mmsghdr messages[UDP_SEND_BATCH];
+        iovec vectors[UDP_SEND_BATCH];
+        std::size_t offset = 0;
+        while (offset < size)
+        {
+            // Every IPFIX message becomes its own datagram
+            unsigned int count = 0;
+            for (; count < UDP_SEND_BATCH && size - offset >= IPFIX_MESSAGE_HEADER_SIZE; ++count)
+            {
+                std::size_t const length = (static_cast<std::size_t>(data[offset + 2]) << 8) | data[offset + 3];
+                if (length < IPFIX_MESSAGE_HEADER_SIZE || length > size - offset)
+                {
+                    throw std::runtime_error{"Invalid IPFIX message in the flow export buffer"};
+                }
+                vectors[count] = iovec{const_cast<std::uint8_t *>(data + offset), length};
+                messages[count] = mmsghdr{};
+                messages[count].msg_hdr.msg_iov = &vectors[count];
+                messages[count].msg_hdr.msg_iovlen = 1;
+                offset += length;
+            }
+            if (count == 0)
+            {
+                throw std::runtime_error{"Truncated IPFIX message in the flow export buffer"};
+            }
+            for (unsigned int sent = 0; sent < count;)
+            {
+                int const result = sendmmsg(fd_, messages + sent, count - sent, 0);
+                if (result < 0 && errno != EINTR)
+                {
+                    throw std::runtime_error{std::string{"Failed to send flow records - "} + std::strerror(errno)};
+                }
+                sent += result > 0 ? static_cast<unsigned int>(result) : 0;
+            }
+        }
+    }
+#else
+    UdpCollector::UdpCollector(common::utils::IpAddress const &, std::uint16_t const)
+        : fd_{-1}
+    {
+        throw std::runtime_error{"Exporting flows over UDP is only supported on Linux"};
+    }
+
+    UdpCollector::~UdpCollector()
+    {
+    }
+
+    std::size_t UdpCollector::max_message_size() const noexcept
+    {
+        return UDP_MESSAGE_SIZE;
+    }
+
+    void UdpCollector::write(std::uint8_t const *, std::size_t const)
+    {
+    }
+#endif
+
+    std::unique_ptr<Collector> open_collector(std::string const &destination)
+    {
+        if (destination.rfind(EXPORT_UDP_PREFIX, 0) != 0)
+        {
+            return std::make_unique<FileCollector>(destination);
+        }
+        std::string const target = destination.substr(std::strlen(EXPORT_UDP_PREFIX));
+        std::string host = target;
+        std::uint16_t port = IPFIX_DEFAULT_PORT;
+        if (!target.empty() && target.front() == '[')
+        {
+            // [<ipv6>]:<port>
+            std::size_t const end = target.find(']');
+            host = target.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+            if (end == std::string::npos || (end + 1 < target.size() && target[end + 1] != ':'))
+            {
+                port = 0;
+            }
+            else if (end + 1 < target.size())
+            {
+                port = parse_port_(target.substr(end + 2));
+            }
+        }
+        else if (std::count(target.begin(), target.end(), ':') == 1)
+        {
+            // <ipv4>:<port>, a bare IPv6 address has more than one colon
+            std::size_t const colon = target.find(':');
+            host = target.substr(0, colon);
+            port = parse_port_(target.substr(colon + 1));
+        }
+        std::optional<common::utils::IpAddress> const address = common::utils::parse_ip_addr(host);
+        if (!address || port == 0)
+        {
+            throw std::invalid_argument{"Invalid flow collector '" + target + "' (fmt: '<ip>[:<port>]' or '[<ipv6>]:<port>')"};
+        }
+        return std::make_unique<UdpCollector>(*address, port);
+    }
+} // namespace overwatch::exporter
@@ -0,0 +1,121 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include "config.hpp"
+#include "ip_address.hpp"
+
+// IANA port of IPFIX collectors
+#define IPFIX_DEFAULT_PORT 4739
+
+namespace overwatch::exporter
+{
+    /**
+     * Destination of the encoded flow records
+     */
+    class Collector
+    {
+    public:
+        virtual ~Collector() = default;
+
+        /**
+         * Size limit of a single IPFIX message for this destination
+         * @return The size in bytes
+         */
+        virtual std::size_t max_message_size() const noexcept = 0;
+        /**
+         * Writes a block of complete IPFIX messages
+         *
+         * @param[in] data The messages
+         * @param[in] size Size of the messages in bytes
+         * @throw std::runtime_error If the messages could not be written
+         */
+        virtual void write(std::uint8_t const *data, std::size_t const size) = 0;
+    };
+
+    /**
+     * Appends the messages to a file (the IPFIX file format of RFC 5655 is the plain sequence of messages)
+     */
+    class FileCollector : public Collector
+    {
+    public:
+        /**
+         * Creates (or truncates) the file
+         *
+         * @param[in] file_path Path of the file
+         * @throw std::runtime_error If the file cannot be created
+         */
+        explicit FileCollector(std::filesystem::path const &file_path);
+        ~FileCollector() override;
+
+        FileCollector(FileCollector const &) = delete;
+        FileCollector &operator=(FileCollector const &) = delete;
+
+        std::size_t max_message_size() const noexcept override;
+        void write(std::uint8_t const *data, std::size_t const size) override;
+
+    private:
+        // Unbuffered, every block is written by a single call
+        std::FILE *file_;
+    };
+
+    /**
+     * Sends every message as a datagram to a collector listening on UDP
+     */
+    class UdpCollector : public Collector
+    {
+    public:
+        /**
+         * Creates the socket sending to the collector
+         *
+         * @param[in] address Address of the collector
+         * @param[in] port UDP port of the collector
+         * @throw std::runtime_error If the socket cannot be created
+         */
+        UdpCollector(common::utils::IpAddress const &address, std::uint16_t const port);
+        ~UdpCollector() override;
+
+        UdpCollector(UdpCollector const &) = delete;
+        UdpCollector &operator=(UdpCollector const &) = delete;
+
+        std::size_t max_message_size() const noexcept override;
+        void write(std::uint8_t const *data, std::size_t const size) override;
+
+    private:
+        int fd_;
+    };
+
+    /**
+     * Opens the collector of a destination
+     *
+     * @param[in] destination Path of a file or EXPORT_UDP_PREFIX followed by the address (and port) of a collector
+     * @return The collector
+     * @throw std::invalid_argument If the address of a UDP collector is invalid
+     * @throw std::runtime_error If the collector cannot be opened
+     */
+    std::unique_ptr<Collector> open_collector(std::string const &destination);
+} // namespace overwatch::exporter
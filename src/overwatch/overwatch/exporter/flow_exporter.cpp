@@ -0,0 +1,222 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "flow_exporter.hpp"
+#include "logging.hpp"
+
+namespace overwatch::exporter
+{
+    FlowExporter::FlowExporter(std::unique_ptr<Collector> collector, std::size_t const buffer_size)
+        : collector_{std::move(collector)}, buffer_size_{buffer_size}, buffers_{}, bytes_{}, errors_{},
+          writer_{[this](Buffer &buffer) { write_(buffer); },
+                  [](Buffer &buffer) {
+                      buffer.data.clear();
+                      buffer.in_flight = false;
+                  }}
+    {
+        // Also checks that the collector's messages can hold a record
+        IpfixEncoder const encoder{0, collector_->max_message_size()};
+        if (buffer_size_ < encoder.max_append_size())
+        {
+            throw std::invalid_argument{"Flow export buffers must hold at least " + std::to_string(encoder.max_append_size()) + " bytes"};
+        }
+        writer_.start();
+    }
+
+    FlowExporter::~FlowExporter()
+    {
+        stop();
+    }
+
+    std::unique_ptr<ExportChannel> FlowExporter::open_channel(std::uint32_t const observation_domain)
+    {
+        return std::make_unique<ExportChannel>(*this, observation_domain);
+    }
+
+    void FlowExporter::stop() noexcept
+    {
+        writer_.stop();
+    }
+
+    ExporterCounters FlowExporter::get_counters() const noexcept
+    {
+        return ExporterCounters{buffers_.load(), bytes_.load(), errors_.load()};
+    }
+
+    void FlowExporter::submit_(Buffer &buffer)
+    {
+        std::size_t const size = buffer.data.size();
+        writer_.locked([&buffer]() { buffer.in_flight = true; });
+        if (!writer_.submit(buffer))
+        {
+            // Only the writer thread updates the counters - the buffer is dropped without being counted
+            LOG_WARNING << "Dropped " << size << " bytes of flow records handed over after the exporter stopped";
+        }
+    }
+
+    void FlowExporter::wait_(Buffer &buffer)
+    {
+        writer_.wait([&buffer]() { return !buffer.in_flight; });
+    }
+
+    void FlowExporter::write_(Buffer &buffer) noexcept
+    {
+        try
+        {
+            collector_->write(buffer.data.data(), buffer.data.size());
+            buffers_.add(1);
+            bytes_.add(buffer.data.size());
+        }
+        catch (std::exception const &e)
+        {
+            // A collector that is down fails every write - only report the first failure
+            if (errors_.load() == 0)
+            {
+                LOG_ERROR << "Failed to export flow records: " << e.what();
+            }
+            errors_.add(1);
+        }
+    }
+
+    ExportChannel::ExportChannel(FlowExporter &exporter, std::uint32_t const observation_domain)
+        : exporter_{exporter}, encoder_{observation_domain, exporter.collector_->max_message_size()}, buffers_{}, current_{0},
+          records_{}, stalls_{}
+    {
+        for (FlowExporter::Buffer &buffer : buffers_)
+        {
+            buffer.data.reserve(exporter_.buffer_size_);
+        }
+    }
+
+    ExportChannel::~ExportChannel()
+    {
+        for (FlowExporter::Buffer &buffer : buffers_)
+        {
+            exporter_.wait_(buffer);
+        }
+    }
+
+    void ExportChannel::add(core::ExpiredFlow const &flow)
+    {
+        if (buffers_[current_].data.size() + encoder_.max_append_size() > exporter_.buffer_size_)
+        {
+            swap_buffers_();
+        }
+        encoder_.add(buffers_[current_].data, flow);
+        records_.add(1);
+    }
+
+    void ExportChannel::flush()
+    {
+        if (pending())
+        {
+            swap_buffers_();
+        }
+    }
+
+    bool ExportChannel::pending() const noexcept
+    {
+        return !buffers_[current_].data.empty();
+    }
+
+    std::uint64_t ExportChannel::get_records() const noexcept
+    {
+        return records_.load();
+    }
+
+    std::uint64_t ExportChannel::get_stalls() const noexcept
+    {
+        return stalls_.load();
+    }
+
+    void ExportChannel::swap_buffers_()
+    {
+        encoder_.finish(buffers_[current_].data);
+        exporter_.submit_(buffers_[current_]);
+        current_ ^= 1;
+        FlowExporter::Buffer &next = buffers_[current_];
+        if (!exporter_.writer_.locked([&next]() { return next.in_flight; }))
+        {
+            return;
+        }
+        // The writer thread is still busy with the previous buffer
+        stalls_.add(1);
+        exporter_.wait_(next);
+    }
+
+    FlowExportStage::FlowExportStage(std::unique_ptr<ExportChannel> channel, std::uint64_t const flush_interval_ns)
+        : channel_{std::move(channel)}, flush_interval_ns_{flush_interval_ns}, pending_since_ns_{0}
+    {
+    }
+
+    char const *FlowExportStage::name() const noexcept
+    {
+        return "flow-export";
+    }
+
+    void FlowExportStage::process(core::PacketBurst &burst)
+    {
+        for (core::ExpiredFlow const &flow : burst.expired)
+        {
+            channel_->add(flow);
+        }
+        if (!channel_->pending())
+        {
+            pending_since_ns_ = 0;
+        }
+        else if (pending_since_ns_ == 0)
+        {
+            pending_since_ns_ = std::max<std::uint64_t>(burst.now_ns, 1);
+        }
+        else if (burst.now_ns >= pending_since_ns_ + flush_interval_ns_)
+        {
+            channel_->flush();
+            pending_since_ns_ = 0;
+        }
+    }
+
+    void FlowExportStage::flush(core::PacketBurst &burst)
+    {
+        for (core::ExpiredFlow const &flow : burst.expired)
+        {
+            channel_->add(flow);
+        }
+        channel_->flush();
+        pending_since_ns_ = 0;
+    }
+
+    void FlowExportStage::publish(stats::Registry &registry, stats::Labels const &labels,
+                                  std::vector<stats::Registration> &registrations) const
+    {
+        ExportChannel const *const channel = channel_.get();
+        registrations.push_back(registry.add("overwatch_flows_exported_total", "Flow records handed to the exporter",
+                                             stats::MetricType::Counter, labels, [channel]() { return channel->get_records(); }));
+        registrations.push_back(registry.add("overwatch_export_stalls_total", "Times the worker waited for the exporter to free a buffer",
+                                             stats::MetricType::Counter, labels, [channel]() { return channel->get_stalls(); }));
+    }
+
+    ExportChannel const &FlowExportStage::get_channel() const noexcept
+    {
+        return *channel_;
+    }
+} // namespace overwatch::exporter
@@ -0,0 +1,212 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "buffer_writer.hpp"
+#include "collector.hpp"
+#include "ipfix.hpp"
+#include "pipeline.hpp"
+#include "stats_registry.hpp"
+
+// Size of every buffer of an export channel
+#define EXPORT_BUFFER_SIZE (1 << 20)
+
+namespace overwatch::exporter
+{
+    /**
+     * Totals of an exporter
+     */
+    struct ExporterCounters
+    {
+        // Buffers and bytes handed to the collector
+        std::uint64_t buffers = 0;
+        std::uint64_t bytes = 0;
+        // Buffers the collector failed to take
+        std::uint64_t errors = 0;
+    };
+
+    class ExportChannel;
+
+    /**
+     * Streams the flow records of every worker to a collector.
+     *
+     * Every worker encodes its records into the buffers of its own channel without any
+     * locking. Full buffers are handed to a single writer thread, which passes them to the
+     * collector in one large write while the worker keeps filling the channel's other buffer.
+     */
+    class FlowExporter
+    {
+    public:
+        /**
+         * Creates the exporter and starts its writer thread
+         *
+         * @param[in] collector Destination of the records
+         * @param[in] buffer_size Size of the buffers of every channel
+         * @throw std::invalid_argument If the buffers cannot hold a message
+         */
+        explicit FlowExporter(std::unique_ptr<Collector> collector, std::size_t const buffer_size = EXPORT_BUFFER_SIZE);
+        ~FlowExporter();
+
+        FlowExporter(FlowExporter const &) = delete;
+        FlowExporter &operator=(FlowExporter const &) = delete;
+
+        /**
+         * Opens the channel of a worker
+         *
+         * @param[in] observation_domain IPFIX observation domain of the worker's records
+         * @return The channel (must not outlive the exporter)
+         */
+        std::unique_ptr<ExportChannel> open_channel(std::uint32_t const observation_domain);
+        /**
+         * Writes the buffers handed over so far and stops the writer thread
+         *
+         * The channels must be flushed before, later buffers are dropped.
+         */
+        void stop() noexcept;
+        /**
+         * Totals of the exporter
+         * @return The counters
+         */
+        ExporterCounters get_counters() const noexcept;
+
+    private:
+        friend class ExportChannel;
+
+        // Buffer of a channel, owned by the writer thread while in flight
+        struct Buffer
+        {
+            std::vector<std::uint8_t> data;
+            bool in_flight = false;
+        };
+
+        // Hands a buffer over to the writer thread
+        void submit_(Buffer &buffer);
+        // Waits until the writer thread is done with a buffer
+        void wait_(Buffer &buffer);
+        // Passes a buffer to the collector, on the writer thread
+        void write_(Buffer &buffer) noexcept;
+
+        std::unique_ptr<Collector> const collector_;
+        std::size_t const buffer_size_;
+        stats::Counter buffers_;
+        stats::Counter bytes_;
+        stats::Counter errors_;
+        // Last, so that its thread stops before the rest goes away
+        core::BufferWriter<Buffer> writer_;
+    };
+
+    /**
+     * Double buffered IPFIX encoder of a single worker
+     */
+    class ExportChannel
+    {
+    public:
+        /**
+         * Creates the channel, use FlowExporter::open_channel
+         *
+         * @param[in] exporter The exporter writing the buffers
+         * @param[in] observation_domain IPFIX observation domain of the records
+         */
+        ExportChannel(FlowExporter &exporter, std::uint32_t const observation_domain);
+        ~ExportChannel();
+
+        ExportChannel(ExportChannel const &) = delete;
+        ExportChannel &operator=(ExportChannel const &) = delete;
+
+        /**
+         * Encodes a flow record, handing the buffer over first if it is full
+         *
+         * @param[in] flow The flow
+         */
+        void add(core::ExpiredFlow const &flow);
+        /**
+         * Hands the records encoded so far over to the writer thread
+         */
+        void flush();
+        /**
+         * Whether records are waiting to be handed over
+         * @return True if the current buffer holds records
+         */
+        bool pending() const noexcept;
+        /**
+         * Number of records encoded
+         * @return The number of records
+         */
+        std::uint64_t get_records() const noexcept;
+        /**
+         * Number of times the worker had to wait for the writer thread to free a buffer
+         * @return The number of stalls
+         */
+        std::uint64_t get_stalls() const noexcept;
+
+    private:
+        // Hands the current buffer over and switches to the other one
+        void swap_buffers_();
+
+        FlowExporter &exporter_;
+        IpfixEncoder encoder_;
+        std::array<FlowExporter::Buffer, 2> buffers_;
+        std::size_t current_;
+        stats::Counter records_;
+        stats::Counter stalls_;
+    };
+
+    /**
+     * Streams the flows evicted or checkpointed by the flow stage to an export channel
+     *
+     * The records of a worker are handed over once a buffer is full, at the latest after
+     * the flush interval (in capture time) and when the worker shuts down.
+     */
+    class FlowExportStage : public core::Stage
+    {
+    public:
+        /**
+         * Creates the stage
+         *
+         * @param[in] channel Channel of the worker
+         * @param[in] flush_interval_ns Longest time records are held back
+         */
+        FlowExportStage(std::unique_ptr<ExportChannel> channel, std::uint64_t const flush_interval_ns);
+
+        char const *name() const noexcept override;
+        void process(core::PacketBurst &burst) override;
+        void flush(core::PacketBurst &burst) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        /**
+         * Channel of the worker
+         * @return The channel
+         */
+        ExportChannel const &get_channel() const noexcept;
+
+    private:
+        std::unique_ptr<ExportChannel> const channel_;
+        std::uint64_t const flush_interval_ns_;
+        // Capture time of the oldest record held back (0 if none)
+        std::uint64_t pending_since_ns_;
+    };
+} // namespace overwatch::exporter
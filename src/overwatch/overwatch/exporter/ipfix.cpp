@@ -0,0 +1,534 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+#include "ipfix.hpp"
+
+// Offset of the open message or set when there is none
+#define NO_OFFSET SIZE_MAX
+// Enterprise number of the RFC 5103 reverse information elements
+#define REVERSE_ENTERPRISE_NUMBER 29305U
+#define ENTERPRISE_BIT 0x8000U
+// Seconds between the NTP (1900) and UNIX (1970) epochs
+#define NTP_UNIX_EPOCH_OFFSET 2208988800ULL
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+// Sequence numbers further ahead than this are taken for reordered messages rather than losses
+#define MAX_SEQUENCE_GAP 0x80000000U
+
+namespace
+{
+    // Information elements of the flow records (RFC 7012 / RFC 5103)
+    enum InformationElement : std::uint16_t
+    {
+        IE_OCTET_DELTA_COUNT = 1,
+        IE_PACKET_DELTA_COUNT = 2,
+        IE_PROTOCOL_IDENTIFIER = 4,
+        IE_TCP_CONTROL_BITS = 6,
+        IE_SOURCE_TRANSPORT_PORT = 7,
+        IE_SOURCE_IPV4_ADDRESS = 8,
+        IE_DESTINATION_TRANSPORT_PORT = 11,
+        IE_DESTINATION_IPV4_ADDRESS = 12,
+        IE_SOURCE_IPV6_ADDRESS = 27,
+        IE_DESTINATION_IPV6_ADDRESS = 28,
+        IE_FLOW_END_REASON = 136,
+        IE_FLOW_START_NANOSECONDS = 156,
+        IE_FLOW_END_NANOSECONDS = 157
+    };
+
+    struct TemplateField
+    {
+        std::uint16_t id;
+        std::uint16_t length;
+        bool reverse;
+    };
+
+    // Layout of the records, in the order the encoder writes their fields
+    constexpr std::array<TemplateField, 13> IPV4_FIELDS{{{IE_SOURCE_IPV4_ADDRESS, 4, false},
+                                                         {IE_DESTINATION_IPV4_ADDRESS, 4, false},
+                                                         {IE_SOURCE_TRANSPORT_PORT, 2, false},
+                                                         {IE_DESTINATION_TRANSPORT_PORT, 2, false},
+                                                         {IE_PROTOCOL_IDENTIFIER, 1, false},
+                                                         {IE_TCP_CONTROL_BITS, 1, false},
+                                                         {IE_FLOW_END_REASON, 1, false},
+                                                         {IE_FLOW_START_NANOSECONDS, 8, false},
+                                                         {IE_FLOW_END_NANOSECONDS, 8, false},
+                                                         {IE_PACKET_DELTA_COUNT, 8, false},
+                                                         {IE_OCTET_DELTA_COUNT, 8, false},
+                                                         {IE_PACKET_DELTA_COUNT, 8, true},
+                                                         {IE_OCTET_DELTA_COUNT, 8, true}}};
+    constexpr std::array<TemplateField, 13> IPV6_FIELDS{{{IE_SOURCE_IPV6_ADDRESS, 16, false},
+                                                         {IE_DESTINATION_IPV6_ADDRESS, 16, false},
+                                                         {IE_SOURCE_TRANSPORT_PORT, 2, false},
+                                                         {IE_DESTINATION_TRANSPORT_PORT, 2, false},
+                                                         {IE_PROTOCOL_IDENTIFIER, 1, false},
+                                                         {IE_TCP_CONTROL_BITS, 1, false},
+                                                         {IE_FLOW_END_REASON, 1, false},
+                                                         {IE_FLOW_START_NANOSECONDS, 8, false},
+                                                         {IE_FLOW_END_NANOSECONDS, 8, false},
+                                                         {IE_PACKET_DELTA_COUNT, 8, false},
+                                                         {IE_OCTET_DELTA_COUNT, 8, false},
+                                                         {IE_PACKET_DELTA_COUNT, 8, true},
+                                                         {IE_OCTET_DELTA_COUNT, 8, true}}};
+
+    template <std::size_t N>
+    constexpr std::size_t record_size_(std::array<TemplateField, N> const &fields) noexcept
+    {
+        std::size_t size = 0;
+        for (TemplateField const &field : fields)
+        {
+            size += field.length;
+        }
+        return size;
+    }
+    static_assert(record_size_(IPV4_FIELDS) == overwatch::exporter::IPFIX_RECORD_SIZE_IPV4, "IPv4 record layout changed");
+    static_assert(record_size_(IPV6_FIELDS) == overwatch::exporter::IPFIX_RECORD_SIZE_IPV6, "IPv6 record layout changed");
+
+    template <std::size_t N>
+    constexpr std::size_t template_size_(std::array<TemplateField, N> const &fields) noexcept
+    {
+        // Template id and field count, then id and length of every field and the enterprise number of the reverse ones
+        std::size_t size = 4;
+        for (TemplateField const &field : fields)
+        {
+            size += field.reverse ? 8 : 4;
+        }
+        return size;
+    }
+    constexpr std::size_t TEMPLATE_SET_SIZE =
+        overwatch::exporter::IPFIX_SET_HEADER_SIZE + template_size_(IPV4_FIELDS) + template_size_(IPV6_FIELDS);
+
+    inline std::uint8_t *put_u16_(std::uint8_t *out, std::uint16_t const value) noexcept
+    {
+        out[0] = static_cast<std::uint8_t>(value >> 8);
+        out[1] = static_cast<std::uint8_t>(value);
+        return out + 2;
+    }
+
+    inline std::uint8_t *put_u32_(std::uint8_t *out, std::uint32_t const value) noexcept
+    {
+        return put_u16_(put_u16_(out, static_cast<std::uint16_t>(value >> 16)), static_cast<std::uint16_t>(value));
+    }
+
+    inline std::uint8_t *put_u64_(std::uint8_t *out, std::uint64_t const value) noexcept
+    {
+        return put_u32_(put_u32_(out, static_cast<std::uint32_t>(value >> 32)), static_cast<std::uint32_t>(value));
+    }
+
+    // Reads a big endian unsigned integer of 1 to 8 bytes (reduced size encoding)
+    inline std::uint64_t get_uint_(std::uint8_t const *in, std::size_t const length) noexcept
+    {
+        std::uint64_t value = 0;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            value = (value << 8) | in[i];
+        }
+        return value;
+    }
+
+    // Converts nanoseconds since the UNIX epoch to the NTP format of dateTimeNanoseconds
+    inline std::uint64_t to_ntp_(std::uint64_t const ns) noexcept
+    {
+        std::uint64_t const seconds = ns / NANOSECONDS_PER_SECOND + NTP_UNIX_EPOCH_OFFSET;
+        std::uint64_t const fraction = (((ns % NANOSECONDS_PER_SECOND) << 32) + NANOSECONDS_PER_SECOND / 2) / NANOSECONDS_PER_SECOND;
+        return (seconds << 32) + fraction;
+    }
+
+    inline std::uint64_t from_ntp_(std::uint64_t const ntp) noexcept
+    {
+        std::uint64_t const seconds = (ntp >> 32) - NTP_UNIX_EPOCH_OFFSET;
+        std::uint64_t const fraction = ((ntp & 0xFFFFFFFFULL) * NANOSECONDS_PER_SECOND + (1ULL << 31)) >> 32;
+        return seconds * NANOSECONDS_PER_SECOND + fraction;
+    }
+
+    inline bool is_ipv4_mapped_(std::array<std::uint8_t, 16> const &addr) noexcept
+    {
+        static constexpr std::uint8_t PREFIX[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+        return std::memcmp(addr.data(), PREFIX, sizeof(PREFIX)) == 0;
+    }
+
+    inline void set_ipv4_mapped_(std::array<std::uint8_t, 16> &addr, std::uint8_t const *ipv4) noexcept
+    {
+        addr.fill(0);
+        addr[10] = addr[11] = 0xFF;
+        std::memcpy(addr.data() + 12, ipv4, 4);
+    }
+
+    template <std::size_t N>
+    std::uint8_t *put_template_(std::uint8_t *out, std::uint16_t const template_id, std::array<TemplateField, N> const &fields) noexcept
+    {
+        out = put_u16_(out, template_id);
+        out = put_u16_(out, static_cast<std::uint16_t>(fields.size()));
+        for (TemplateField const &field : fields)
+        {
+            out = put_u16_(out, static_cast<std::uint16_t>(field.id | (field.reverse ? ENTERPRISE_BIT : 0)));
+            out = put_u16_(out, field.length);
+            if (field.reverse)
+            {
+                out = put_u32_(out, REVERSE_ENTERPRISE_NUMBER);
+            }
+        }
+        return out;
+    }
+
+    // Grows the buffer by size bytes and returns the first of them
+    inline std::uint8_t *extend_(std::vector<std::uint8_t> &buffer, std::size_t const size)
+    {
+        std::size_t const offset = buffer.size();
+        buffer.resize(offset + size);
+        return buffer.data() + offset;
+    }
+} // namespace
+
+namespace overwatch::exporter
+{
+    IpfixEncoder::IpfixEncoder(std::uint32_t const observation_domain, std::size_t const max_message_size)
+        : observation_domain_{observation_domain}, max_message_size_{max_message_size}, message_offset_{NO_OFFSET},
+          set_offset_{NO_OFFSET}, set_template_{0}, records_{0}, message_records_{0}
+    {
+        if (max_message_size_ > IPFIX_MAX_MESSAGE_SIZE || max_message_size_ < max_append_size())
+        {
+            throw std::invalid_argument{"IPFIX messages must hold between " + std::to_string(max_append_size()) + " and " +
+                                        std::to_string(IPFIX_MAX_MESSAGE_SIZE) + " bytes"};
+        }
+    }
+
+    void IpfixEncoder::add(std::vector<std::uint8_t> &buffer, core::ExpiredFlow const &flow)
+    {
+        bool const ipv4 = is_ipv4_mapped_(flow.key.src_addr) && is_ipv4_mapped_(flow.key.dst_addr);
+        std::uint16_t const template_id = ipv4 ? IPFIX_TEMPLATE_IPV4 : IPFIX_TEMPLATE_IPV6;
+        std::size_t const record_size = ipv4 ? IPFIX_RECORD_SIZE_IPV4 : IPFIX_RECORD_SIZE_IPV6;
+
+        if (message_offset_ == NO_OFFSET)
+        {
+            open_message_(buffer);
+        }
+        bool new_set = set_offset_ == NO_OFFSET || set_template_ != template_id;
+        if (buffer.size() - message_offset_ + (new_set ? IPFIX_SET_HEADER_SIZE : 0) + record_size > max_message_size_)
+        {
+            finish(buffer);
+            open_message_(buffer);
+            new_set = true;
+        }
+        if (new_set)
+        {
+            close_set_(buffer);
+            open_set_(buffer, template_id);
+        }
+
+        std::uint8_t *out = extend_(buffer, record_size);
+        if (ipv4)
+        {
+            out = std::copy_n(flow.key.src_addr.data() + 12, 4, out);
+            out = std::copy_n(flow.key.dst_addr.data() + 12, 4, out);
+        }
+        else
+        {
+            out = std::copy_n(flow.key.src_addr.data(), 16, out);
+            out = std::copy_n(flow.key.dst_addr.data(), 16, out);
+        }
+        out = put_u16_(out, flow.key.src_port);
+        out = put_u16_(out, flow.key.dst_port);
+        *out++ = flow.key.protocol;
+        *out++ = flow.record.tcp_flags;
+        *out++ = static_cast<std::uint8_t>(flow.reason);
+        out = put_u64_(out, to_ntp_(flow.record.first_seen_ns));
+        out = put_u64_(out, to_ntp_(flow.record.last_seen_ns));
+        out = put_u64_(out, flow.record.packets[0]);
+        out = put_u64_(out, flow.record.bytes[0]);
+        out = put_u64_(out, flow.record.packets[1]);
+        put_u64_(out, flow.record.bytes[1]);
+        ++message_records_;
+    }
+
+    void IpfixEncoder::finish(std::vector<std::uint8_t> &buffer) noexcept
+    {
+        if (message_offset_ == NO_OFFSET)
+        {
+            return;
+        }
+        close_set_(buffer);
+        std::uint8_t *out = buffer.data() + message_offset_;
+        out = put_u16_(out, IPFIX_VERSION);
+        out = put_u16_(out, static_cast<std::uint16_t>(buffer.size() - message_offset_));
+        out = put_u32_(out, static_cast<std::uint32_t>(std::time(nullptr)));
+        // The sequence number counts the data records sent before the message, modulo 2^32
+        out = put_u32_(out, static_cast<std::uint32_t>(records_));
+        put_u32_(out, observation_domain_);
+        records_ += message_records_;
+        message_records_ = 0;
+        message_offset_ = NO_OFFSET;
+    }
+
+    std::size_t IpfixEncoder::max_append_size() const noexcept
+    {
+        return IPFIX_MESSAGE_HEADER_SIZE + TEMPLATE_SET_SIZE + IPFIX_SET_HEADER_SIZE + IPFIX_RECORD_SIZE_IPV6;
+    }
+
+    std::uint64_t IpfixEncoder::get_records() const noexcept
+    {
+        return records_ + message_records_;
+    }
+
+    void IpfixEncoder::open_message_(std::vector<std::uint8_t> &buffer)
+    {
+        bool const first = buffer.empty();
+        message_offset_ = buffer.size();
+        // The header is written once the message is complete
+        extend_(buffer, IPFIX_MESSAGE_HEADER_SIZE);
+        if (first)
+        {
+            std::uint8_t *out = extend_(buffer, TEMPLATE_SET_SIZE);
+            out = put_u16_(out, IPFIX_TEMPLATE_SET_ID);
+            out = put_u16_(out, static_cast<std::uint16_t>(TEMPLATE_SET_SIZE));
+            out = put_template_(out, IPFIX_TEMPLATE_IPV4, IPV4_FIELDS);
+            put_template_(out, IPFIX_TEMPLATE_IPV6, IPV6_FIELDS);
+        }
+    }
+
+    void IpfixEncoder::open_set_(std::vector<std::uint8_t> &buffer, std::uint16_t const template_id)
+    {
+        set_offset_ = buffer.size();
+        set_template_ = template_id;
+        put_u16_(extend_(buffer, IPFIX_SET_HEADER_SIZE), template_id);
+    }
+
+    void IpfixEncoder::close_set_(std::vector<std::uint8_t> &buffer) noexcept
+    {
+        if (set_offset_ == NO_OFFSET)
+        {
+            return;
+        }
+        put_u16_(buffer.data() + set_offset_ + 2, static_cast<std::uint16_t>(buffer.size() - set_offset_));
+        set_offset_ = NO_OFFSET;
+    }
+
+    std::size_t IpfixDecoder::decode(std::uint8_t const *data, std::size_t const size, std::vector<ExportedFlow> &flows)
+    {
+        std::size_t offset = 0;
+        while (size - offset >= IPFIX_MESSAGE_HEADER_SIZE)
+        {
+            std::uint8_t const *const message = data + offset;
+            std::size_t const length = get_uint_(message + 2, 2);
+            if (get_uint_(message, 2) != IPFIX_VERSION)
+            {
+                throw std::invalid_argument{"Not an IPFIX message (version " + std::to_string(get_uint_(message, 2)) + ")"};
+            }
+            if (length < IPFIX_MESSAGE_HEADER_SIZE)
+            {
+                throw std::invalid_argument{"IPFIX message length " + std::to_string(length) + " is too short"};
+            }
+            if (length > size - offset)
+            {
+                break;
+            }
+            std::uint32_t const sequence = static_cast<std::uint32_t>(get_uint_(message + 8, 4));
+            std::uint32_t const domain = static_cast<std::uint32_t>(get_uint_(message + 12, 4));
+
+            std::uint32_t records = 0;
+            for (std::size_t set = IPFIX_MESSAGE_HEADER_SIZE; set < length;)
+            {
+                if (length - set < IPFIX_SET_HEADER_SIZE)
+                {
+                    throw std::invalid_argument{"IPFIX message ends within a set header"};
+                }
+                std::uint16_t const set_id = static_cast<std::uint16_t>(get_uint_(message + set, 2));
+                std::size_t const set_length = get_uint_(message + set + 2, 2);
+                if (set_length < IPFIX_SET_HEADER_SIZE || set_length > length - set)
+                {
+                    throw std::invalid_argument{"IPFIX set length " + std::to_string(set_length) + " is out of bounds"};
+                }
+                std::uint8_t const *const body = message + set + IPFIX_SET_HEADER_SIZE;
+                std::size_t const body_size = set_length - IPFIX_SET_HEADER_SIZE;
+                if (set_id == IPFIX_TEMPLATE_SET_ID)
+                {
+                    decode_templates_(domain, body, body_size);
+                }
+                else if (set_id >= IPFIX_TEMPLATE_IPV4)
+                {
+                    auto const found = templates_.find({domain, set_id});
+                    if (found == templates_.end())
+                    {
+                        ++unknown_sets_;
+                    }
+                    else
+                    {
+                        records += static_cast<std::uint32_t>(decode_records_(domain, found->second, body, body_size, flows));
+                    }
+                }
+                // Options templates and reserved sets are skipped
+                set += set_length;
+            }
+
+            auto const expected = sequences_.find(domain);
+            if (expected != sequences_.end())
+            {
+                std::uint32_t const gap = sequence - expected->second;
+                if (gap != 0 && gap < MAX_SEQUENCE_GAP)
+                {
+                    lost_records_ += gap;
+                }
+            }
+            sequences_[domain] = sequence + records;
+            offset += length;
+        }
+        return offset;
+    }
+
+    std::uint64_t IpfixDecoder::get_lost_records() const noexcept
+    {
+        return lost_records_;
+    }
+
+    std::uint64_t IpfixDecoder::get_unknown_sets() const noexcept
+    {
+        return unknown_sets_;
+    }
+
+    void IpfixDecoder::decode_templates_(std::uint32_t const domain, std::uint8_t const *data, std::size_t const size)
+    {
+        std::size_t offset = 0;
+        // Anything shorter than a template header is padding
+        while (size - offset >= 4)
+        {
+            std::uint16_t const template_id = static_cast<std::uint16_t>(get_uint_(data + offset, 2));
+            std::size_t const count = get_uint_(data + offset + 2, 2);
+            offset += 4;
+            if (template_id < IPFIX_TEMPLATE_IPV4)
+            {
+                throw std::invalid_argument{"Invalid IPFIX template id " + std::to_string(template_id)};
+            }
+            std::vector<Field> fields;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (size - offset < 4)
+                {
+                    throw std::invalid_argument{"IPFIX template " + std::to_string(template_id) + " is truncated"};
+                }
+                Field field{static_cast<std::uint16_t>(get_uint_(data + offset, 2)), static_cast<std::uint16_t>(get_uint_(data + offset + 2, 2)), 0};
+                offset += 4;
+                if (field.id & ENTERPRISE_BIT)
+                {
+                    if (size - offset < 4)
+                    {
+                        throw std::invalid_argument{"IPFIX template " + std::to_string(template_id) + " is truncated"};
+                    }
+                    field.id &= ~ENTERPRISE_BIT;
+                    field.enterprise = static_cast<std::uint32_t>(get_uint_(data + offset, 4));
+                    offset += 4;
+                }
+                if (field.length == 0 || field.length == 0xFFFF)
+                {
+                    throw std::invalid_argument{"IPFIX template " + std::to_string(template_id) + " has variable length fields"};
+                }
+                fields.push_back(field);
+            }
+            // A template without fields withdraws the template
+            if (fields.empty())
+            {
+                templates_.erase({domain, template_id});
+            }
+            else
+            {
+                templates_[{domain, template_id}] = std::move(fields);
+            }
+        }
+    }
+
+    std::size_t IpfixDecoder::decode_records_(std::uint32_t const domain, std::vector<Field> const &fields, std::uint8_t const *data,
+                                              std::size_t const size, std::vector<ExportedFlow> &flows) const
+    {
+        std::size_t record_size = 0;
+        for (Field const &field : fields)
+        {
+            record_size += field.length;
+        }
+        std::size_t records = 0;
+        // Anything shorter than a record is padding
+        for (std::size_t offset = 0; size - offset >= record_size; offset += record_size, ++records)
+        {
+            ExportedFlow flow{domain, core::FlowKey{}, core::FlowRecord{}, core::FlowEndReason::IdleTimeout};
+            std::uint8_t const *in = data + offset;
+            for (Field const &field : fields)
+            {
+                std::size_t const direction = field.enterprise == REVERSE_ENTERPRISE_NUMBER ? 1 : 0;
+                if (field.enterprise != 0 && direction == 0)
+                {
+                    in += field.length;
+                    continue;
+                }
+                bool const integer = field.length <= 8;
+                switch (field.id)
+                {
+                case IE_SOURCE_IPV4_ADDRESS:
+                case IE_DESTINATION_IPV4_ADDRESS:
+                    if (field.length == 4 && direction == 0)
+                    {
+                        set_ipv4_mapped_(field.id == IE_SOURCE_IPV4_ADDRESS ? flow.key.src_addr : flow.key.dst_addr, in);
+                    }
+                    break;
+                case IE_SOURCE_IPV6_ADDRESS:
+                case IE_DESTINATION_IPV6_ADDRESS:
+                    if (field.length == 16 && direction == 0)
+                    {
+                        std::copy_n(in, 16, (field.id == IE_SOURCE_IPV6_ADDRESS ? flow.key.src_addr : flow.key.dst_addr).begin());
+                    }
+                    break;
+                case IE_SOURCE_TRANSPORT_PORT:
+                    flow.key.src_port = integer ? static_cast<std::uint16_t>(get_uint_(in, field.length)) : 0;
+                    break;
+                case IE_DESTINATION_TRANSPORT_PORT:
+                    flow.key.dst_port = integer ? static_cast<std::uint16_t>(get_uint_(in, field.length)) : 0;
+                    break;
+                case IE_PROTOCOL_IDENTIFIER:
+                    flow.key.protocol = integer ? static_cast<std::uint8_t>(get_uint_(in, field.length)) : 0;
+                    break;
+                case IE_TCP_CONTROL_BITS:
+                    flow.record.tcp_flags = integer ? static_cast<std::uint8_t>(get_uint_(in, field.length)) : 0;
+                    break;
+                case IE_FLOW_END_REASON:
+                    flow.reason = static_cast<core::FlowEndReason>(integer ? get_uint_(in, field.length) : 0);
+                    break;
+                case IE_FLOW_START_NANOSECONDS:
+                    flow.record.first_seen_ns = field.length == 8 ? from_ntp_(get_uint_(in, 8)) : 0;
+                    break;
+                case IE_FLOW_END_NANOSECONDS:
+                    flow.record.last_seen_ns = field.length == 8 ? from_ntp_(get_uint_(in, 8)) : 0;
+                    break;
+                case IE_PACKET_DELTA_COUNT:
+                    flow.record.packets[direction] = integer ? get_uint_(in, field.length) : 0;
+                    break;
+                case IE_OCTET_DELTA_COUNT:
+                    flow.record.bytes[direction] = integer ? get_uint_(in, field.length) : 0;
+                    break;
+                default:
+                    break;
+                }
+                in += field.length;
+            }
+            flows.push_back(flow);
+        }
+        return records;
+    }
+} // namespace overwatch::exporter
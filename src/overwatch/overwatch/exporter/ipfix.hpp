@@ -0,0 +1,178 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "flow.hpp"
+#include "pipeline.hpp"
+
+namespace overwatch::exporter
+{
+    // IPFIX (RFC 7011) message version
+    constexpr std::uint16_t IPFIX_VERSION = 10;
+    constexpr std::size_t IPFIX_MESSAGE_HEADER_SIZE = 16;
+    constexpr std::size_t IPFIX_SET_HEADER_SIZE = 4;
+    // Largest message the 16 bit length field can describe
+    constexpr std::size_t IPFIX_MAX_MESSAGE_SIZE = 65535;
+    constexpr std::uint16_t IPFIX_TEMPLATE_SET_ID = 2;
+    // Templates of the flow records, one per address family
+    constexpr std::uint16_t IPFIX_TEMPLATE_IPV4 = 256;
+    constexpr std::uint16_t IPFIX_TEMPLATE_IPV6 = 257;
+    // Fixed size of an encoded flow record
+    constexpr std::size_t IPFIX_RECORD_SIZE_IPV4 = 63;
+    constexpr std::size_t IPFIX_RECORD_SIZE_IPV6 = 87;
+
+    /**
+     * A flow record read back from IPFIX messages
+     */
+    struct ExportedFlow
+    {
+        // Observation domain of the exporting worker
+        std::uint32_t observation_domain;
+        core::FlowKey key;
+        core::FlowRecord record;
+        core::FlowEndReason reason;
+    };
+
+    /**
+     * Encodes flow records into IPFIX messages.
+     *
+     * Every record has a fixed layout (5-tuple, TCP flags, end reason, start and end in
+     * nanoseconds and the packet and byte counts of both directions, the reverse ones as
+     * RFC 5103 biflow elements), described by one template per address family. Records are
+     * appended to the message under construction until it reaches the maximum message size,
+     * the templates are repeated at the start of every buffer so that a collector joining
+     * late (or reading a single file chunk) can decode it.
+     */
+    class IpfixEncoder
+    {
+    public:
+        /**
+         * Creates the encoder
+         *
+         * @param[in] observation_domain Observation domain written to every message
+         * @param[in] max_message_size Size limit of a message (e.g. to fit into a datagram)
+         * @throw std::invalid_argument If the limit cannot hold the templates and a record
+         */
+        IpfixEncoder(std::uint32_t const observation_domain, std::size_t const max_message_size = IPFIX_MAX_MESSAGE_SIZE);
+
+        /**
+         * Appends a flow record to a buffer, opening a new message if needed
+         *
+         * @param[in,out] buffer The buffer (grows by at most max_append_size() bytes)
+         * @param[in] flow The flow
+         */
+        void add(std::vector<std::uint8_t> &buffer, core::ExpiredFlow const &flow);
+        /**
+         * Completes the message under construction, the buffer then only holds complete messages
+         *
+         * @param[in,out] buffer The buffer
+         */
+        void finish(std::vector<std::uint8_t> &buffer) noexcept;
+        /**
+         * Upper bound of the bytes a single add appends
+         * @return The number of bytes
+         */
+        std::size_t max_append_size() const noexcept;
+        /**
+         * Number of records encoded
+         * @return The number of records
+         */
+        std::uint64_t get_records() const noexcept;
+
+    private:
+        // Opens a message (starting with the templates if it is the first of the buffer)
+        void open_message_(std::vector<std::uint8_t> &buffer);
+        // Opens a data set of a template
+        void open_set_(std::vector<std::uint8_t> &buffer, std::uint16_t const template_id);
+        // Writes the length of the open data set
+        void close_set_(std::vector<std::uint8_t> &buffer) noexcept;
+
+        std::uint32_t const observation_domain_;
+        std::size_t const max_message_size_;
+        // Offsets of the open message and data set in the buffer (SIZE_MAX if none)
+        std::size_t message_offset_;
+        std::size_t set_offset_;
+        // Template of the open data set
+        std::uint16_t set_template_;
+        // Records encoded before the open message (the IPFIX sequence number)
+        std::uint64_t records_;
+        std::uint32_t message_records_;
+    };
+
+    /**
+     * Decodes the flow records of a stream of IPFIX messages (a collector stand-in).
+     *
+     * Templates are learned from the messages, so data sets may use any subset of the
+     * elements written by the encoder. Missing records are detected from the sequence
+     * numbers of every observation domain.
+     */
+    class IpfixDecoder
+    {
+    public:
+        /**
+         * Decodes the complete messages at the start of a block of bytes
+         *
+         * @param[in] data The messages
+         * @param[in] size Size of the messages in bytes
+         * @param[out] flows Receives the decoded flow records
+         * @return The number of bytes decoded (a trailing partial message is left over)
+         * @throw std::invalid_argument If a message is malformed
+         */
+        std::size_t decode(std::uint8_t const *data, std::size_t const size, std::vector<ExportedFlow> &flows);
+        /**
+         * Number of records the sequence numbers announced but that were never decoded
+         * @return The number of lost records
+         */
+        std::uint64_t get_lost_records() const noexcept;
+        /**
+         * Number of data sets skipped because their template was unknown
+         * @return The number of sets
+         */
+        std::uint64_t get_unknown_sets() const noexcept;
+
+    private:
+        // Element of a learned template
+        struct Field
+        {
+            std::uint16_t id;
+            std::uint16_t length;
+            std::uint32_t enterprise;
+        };
+
+        // Decodes the messages of a template set
+        void decode_templates_(std::uint32_t const domain, std::uint8_t const *data, std::size_t const size);
+        // Decodes the records of a data set, returns the number of records
+        std::size_t decode_records_(std::uint32_t const domain, std::vector<Field> const &fields, std::uint8_t const *data,
+                                    std::size_t const size, std::vector<ExportedFlow> &flows) const;
+
+        // Templates by observation domain and template id
+        std::map<std::pair<std::uint32_t, std::uint16_t>, std::vector<Field>> templates_;
+        // Sequence number expected next by observation domain
+        std::map<std::uint32_t, std::uint32_t> sequences_;
+        std::uint64_t lost_records_ = 0;
+        std::uint64_t unknown_sets_ = 0;
+    };
+} // namespace overwatch::exporter
@@ -0,0 +1,403 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+
+#include "crypto.hpp"
+
+#define MD5_BLOCK_SIZE 64
+#define HMAC_INNER_PAD 0x36
+#define HMAC_OUTER_PAD 0x5C
+#define TLS13_LABEL_PREFIX "tls13 "
+#define MAX_LABEL_SIZE 32
+
+namespace
+{
+    std::uint32_t rotl_(std::uint32_t const value, unsigned const bits) noexcept
+    {
+        return value << bits | value >> (32 - bits);
+    }
+
+    std::uint32_t rotr_(std::uint32_t const value, unsigned const bits) noexcept
+    {
+        return value >> bits | value << (32 - bits);
+    }
+
+    std::uint32_t load_le32_(std::uint8_t const *const bytes) noexcept
+    {
+        return static_cast<std::uint32_t>(bytes[0]) | static_cast<std::uint32_t>(bytes[1]) << 8 |
+               static_cast<std::uint32_t>(bytes[2]) << 16 | static_cast<std::uint32_t>(bytes[3]) << 24;
+    }
+
+    std::uint32_t load_be32_(std::uint8_t const *const bytes) noexcept
+    {
+        return static_cast<std::uint32_t>(bytes[0]) << 24 | static_cast<std::uint32_t>(bytes[1]) << 16 |
+               static_cast<std::uint32_t>(bytes[2]) << 8 | static_cast<std::uint32_t>(bytes[3]);
+    }
+
+    void store_be32_(std::uint32_t const value, std::uint8_t *const bytes) noexcept
+    {
+        bytes[0] = static_cast<std::uint8_t>(value >> 24);
+        bytes[1] = static_cast<std::uint8_t>(value >> 16);
+        bytes[2] = static_cast<std::uint8_t>(value >> 8);
+        bytes[3] = static_cast<std::uint8_t>(value);
+    }
+
+    // Per-round shifts and sines of MD5 (RFC 1321)
+    constexpr std::uint32_t MD5_SHIFTS[64] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+                                              5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+                                              4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+                                              6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+    constexpr std::uint32_t MD5_SINES[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+
+    void md5_compress_(std::uint32_t (&state)[4], std::uint8_t const *const block) noexcept
+    {
+        std::uint32_t words[16];
+        for (std::size_t i = 0; i < 16; ++i)
+        {
+            words[i] = load_le32_(block + i * 4);
+        }
+        std::uint32_t a = state[0];
+        std::uint32_t b = state[1];
+        std::uint32_t c = state[2];
+        std::uint32_t d = state[3];
+        for (std::uint32_t i = 0; i < 64; ++i)
+        {
+            std::uint32_t f;
+            std::uint32_t g;
+            if (i < 16)
+            {
+                f = (b & c) | (~b & d);
+                g = i;
+            }
+            else if (i < 32)
+            {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            }
+            else if (i < 48)
+            {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            }
+            else
+            {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+            std::uint32_t const rotated = rotl_(a + f + MD5_SINES[i] + words[g], MD5_SHIFTS[i]);
+            a = d;
+            d = c;
+            c = b;
+            b += rotated;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+
+    constexpr std::uint32_t SHA256_ROUNDS[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    constexpr std::uint8_t AES_SBOX[256] = {
+        0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9,
+        0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f,
+        0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15, 0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07,
+        0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3,
+        0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58,
+        0xcf, 0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3,
+        0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec, 0x5f,
+        0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73, 0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+        0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac,
+        0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a,
+        0xae, 0x08, 0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a, 0x70,
+        0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11,
+        0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf, 0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42,
+        0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16};
+
+    std::uint8_t xtime_(std::uint8_t const value) noexcept
+    {
+        return static_cast<std::uint8_t>(value << 1 ^ (value & 0x80 ? 0x1b : 0));
+    }
+} // namespace
+
+namespace overwatch::identify
+{
+    void md5(std::uint8_t const *const data, std::size_t const size, std::uint8_t (&digest)[MD5_SIZE]) noexcept
+    {
+        std::uint32_t state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+        std::size_t offset = 0;
+        for (; offset + MD5_BLOCK_SIZE <= size; offset += MD5_BLOCK_SIZE)
+        {
+            md5_compress_(state, data + offset);
+        }
+        // The remaining bytes, the 0x80 terminator and the bit length, over one or two blocks
+        std::uint8_t tail[2 * MD5_BLOCK_SIZE] = {};
+        std::size_t const remaining = size - offset;
+        std::memcpy(tail, data + offset, remaining);
+        tail[remaining] = 0x80;
+        std::size_t const tail_size = remaining + 9 <= MD5_BLOCK_SIZE ? MD5_BLOCK_SIZE : 2 * MD5_BLOCK_SIZE;
+        std::uint64_t const bits = static_cast<std::uint64_t>(size) * 8;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            tail[tail_size - 8 + i] = static_cast<std::uint8_t>(bits >> (8 * i));
+        }
+        for (std::size_t block = 0; block < tail_size; block += MD5_BLOCK_SIZE)
+        {
+            md5_compress_(state, tail + block);
+        }
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            for (std::size_t byte = 0; byte < 4; ++byte)
+            {
+                digest[i * 4 + byte] = static_cast<std::uint8_t>(state[i] >> (8 * byte));
+            }
+        }
+    }
+
+    Sha256::Sha256() noexcept
+        : state_{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19},
+          block_{}, length_{0}
+    {
+    }
+
+    void Sha256::update(std::uint8_t const *data, std::size_t size) noexcept
+    {
+        std::size_t used = length_ % SHA256_BLOCK_SIZE;
+        length_ += size;
+        if (used > 0)
+        {
+            std::size_t const copied = std::min(size, SHA256_BLOCK_SIZE - used);
+            std::memcpy(block_ + used, data, copied);
+            data += copied;
+            size -= copied;
+            used += copied;
+            if (used < SHA256_BLOCK_SIZE)
+            {
+                return;
+            }
+            compress_(block_);
+        }
+        for (; size >= SHA256_BLOCK_SIZE; data += SHA256_BLOCK_SIZE, size -= SHA256_BLOCK_SIZE)
+        {
+            compress_(data);
+        }
+        std::memcpy(block_, data, size);
+    }
+
+    void Sha256::finish(std::uint8_t (&digest)[SHA256_SIZE]) noexcept
+    {
+        std::uint64_t const bits = length_ * 8;
+        std::uint8_t padding[SHA256_BLOCK_SIZE + 8] = {0x80};
+        std::size_t const used = length_ % SHA256_BLOCK_SIZE;
+        std::size_t const padding_size = (used < 56 ? 56 - used : 120 - used);
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            padding[padding_size + i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+        }
+        update(padding, padding_size + 8);
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            store_be32_(state_[i], digest + i * 4);
+        }
+    }
+
+    void Sha256::compress_(std::uint8_t const *const block) noexcept
+    {
+        std::uint32_t words[64];
+        for (std::size_t i = 0; i < 16; ++i)
+        {
+            words[i] = load_be32_(block + i * 4);
+        }
+        for (std::size_t i = 16; i < 64; ++i)
+        {
+            std::uint32_t const s0 = rotr_(words[i - 15], 7) ^ rotr_(words[i - 15], 18) ^ words[i - 15] >> 3;
+            std::uint32_t const s1 = rotr_(words[i - 2], 17) ^ rotr_(words[i - 2], 19) ^ words[i - 2] >> 10;
+            words[i] = words[i - 16] + s0 + words[i - 7] + s1;
+        }
+        std::uint32_t s[8];
+        std::memcpy(s, state_, sizeof(s));
+        for (std::size_t i = 0; i < 64; ++i)
+        {
+            std::uint32_t const sum1 = rotr_(s[4], 6) ^ rotr_(s[4], 11) ^ rotr_(s[4], 25);
+            std::uint32_t const choice = (s[4] & s[5]) ^ (~s[4] & s[6]);
+            std::uint32_t const first = s[7] + sum1 + choice + SHA256_ROUNDS[i] + words[i];
+            std::uint32_t const sum0 = rotr_(s[0], 2) ^ rotr_(s[0], 13) ^ rotr_(s[0], 22);
+            std::uint32_t const majority = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+            std::memmove(s + 1, s, 7 * sizeof(std::uint32_t));
+            s[4] += first;
+            s[0] = first + sum0 + majority;
+        }
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            state_[i] += s[i];
+        }
+    }
+
+    void sha256(std::uint8_t const *const data, std::size_t const size, std::uint8_t (&digest)[SHA256_SIZE]) noexcept
+    {
+        Sha256 hash;
+        hash.update(data, size);
+        hash.finish(digest);
+    }
+
+    void hmac_sha256(std::uint8_t const *const key, std::size_t const key_size, std::uint8_t const *const data,
+                     std::size_t const size, std::uint8_t (&mac)[SHA256_SIZE]) noexcept
+    {
+        std::uint8_t block[SHA256_BLOCK_SIZE] = {};
+        if (key_size > SHA256_BLOCK_SIZE)
+        {
+            std::uint8_t digest[SHA256_SIZE];
+            sha256(key, key_size, digest);
+            std::memcpy(block, digest, SHA256_SIZE);
+        }
+        else
+        {
+            std::memcpy(block, key, key_size);
+        }
+        std::uint8_t pad[SHA256_BLOCK_SIZE];
+        for (std::size_t i = 0; i < SHA256_BLOCK_SIZE; ++i)
+        {
+            pad[i] = block[i] ^ HMAC_INNER_PAD;
+        }
+        Sha256 inner;
+        inner.update(pad, SHA256_BLOCK_SIZE);
+        inner.update(data, size);
+        std::uint8_t inner_digest[SHA256_SIZE];
+        inner.finish(inner_digest);
+        for (std::size_t i = 0; i < SHA256_BLOCK_SIZE; ++i)
+        {
+            pad[i] = block[i] ^ HMAC_OUTER_PAD;
+        }
+        Sha256 outer;
+        outer.update(pad, SHA256_BLOCK_SIZE);
+        outer.update(inner_digest, SHA256_SIZE);
+        outer.finish(mac);
+    }
+
+    void hkdf_extract(std::uint8_t const *const salt, std::size_t const salt_size, std::uint8_t const *const ikm,
+                      std::size_t const ikm_size, std::uint8_t (&prk)[SHA256_SIZE]) noexcept
+    {
+        hmac_sha256(salt, salt_size, ikm, ikm_size, prk);
+    }
+
+    void hkdf_expand_label(std::uint8_t const (&secret)[SHA256_SIZE], char const *const label, std::uint8_t *const out,
+                           std::size_t const size) noexcept
+    {
+        // HkdfLabel (length, "tls13 " label, empty context) followed by the block counter of HKDF-Expand
+        std::uint8_t info[2 + 1 + sizeof(TLS13_LABEL_PREFIX) - 1 + MAX_LABEL_SIZE + 1 + 1];
+        std::size_t const label_size = std::min<std::size_t>(std::strlen(label), MAX_LABEL_SIZE);
+        std::size_t const full_label_size = sizeof(TLS13_LABEL_PREFIX) - 1 + label_size;
+        std::size_t offset = 0;
+        info[offset++] = static_cast<std::uint8_t>(size >> 8);
+        info[offset++] = static_cast<std::uint8_t>(size);
+        info[offset++] = static_cast<std::uint8_t>(full_label_size);
+        std::memcpy(info + offset, TLS13_LABEL_PREFIX, sizeof(TLS13_LABEL_PREFIX) - 1);
+        offset += sizeof(TLS13_LABEL_PREFIX) - 1;
+        std::memcpy(info + offset, label, label_size);
+        offset += label_size;
+        info[offset++] = 0;
+        info[offset++] = 1;
+        std::uint8_t block[SHA256_SIZE];
+        hmac_sha256(secret, SHA256_SIZE, info, offset, block);
+        std::memcpy(out, block, std::min(size, SHA256_SIZE));
+    }
+
+    Aes128::Aes128(std::uint8_t const *const key) noexcept
+    {
+        std::memcpy(round_keys_, key, AES128_KEY_SIZE);
+        std::uint8_t round_constant = 1;
+        for (std::size_t offset = AES128_KEY_SIZE; offset < sizeof(round_keys_); offset += 4)
+        {
+            std::uint8_t word[4];
+            std::memcpy(word, round_keys_ + offset - 4, 4);
+            if (offset % AES128_KEY_SIZE == 0)
+            {
+                // RotWord, SubWord and the round constant
+                std::uint8_t const first = word[0];
+                word[0] = static_cast<std::uint8_t>(AES_SBOX[word[1]] ^ round_constant);
+                word[1] = AES_SBOX[word[2]];
+                word[2] = AES_SBOX[word[3]];
+                word[3] = AES_SBOX[first];
+                round_constant = xtime_(round_constant);
+            }
+            for (std::size_t i = 0; i < 4; ++i)
+            {
+                round_keys_[offset + i] = round_keys_[offset - AES128_KEY_SIZE + i] ^ word[i];
+            }
+        }
+    }
+
+    void Aes128::encrypt(std::uint8_t const *const in, std::uint8_t *const out) const noexcept
+    {
+        std::uint8_t state[AES_BLOCK_SIZE];
+        for (std::size_t i = 0; i < AES_BLOCK_SIZE; ++i)
+        {
+            state[i] = in[i] ^ round_keys_[i];
+        }
+        for (std::size_t round = 1; round <= 10; ++round)
+        {
+            // SubBytes and ShiftRows (the state is column major)
+            std::uint8_t shifted[AES_BLOCK_SIZE];
+            for (std::size_t column = 0; column < 4; ++column)
+            {
+                for (std::size_t row = 0; row < 4; ++row)
+                {
+                    shifted[column * 4 + row] = AES_SBOX[state[(column + row) % 4 * 4 + row]];
+                }
+            }
+            if (round < 10)
+            {
+                // MixColumns
+                for (std::size_t column = 0; column < 4; ++column)
+                {
+                    std::uint8_t *const c = shifted + column * 4;
+                    std::uint8_t const all = c[0] ^ c[1] ^ c[2] ^ c[3];
+                    std::uint8_t const first = c[0];
+                    c[0] ^= all ^ xtime_(c[0] ^ c[1]);
+                    c[1] ^= all ^ xtime_(c[1] ^ c[2]);
+                    c[2] ^= all ^ xtime_(c[2] ^ c[3]);
+                    c[3] ^= all ^ xtime_(c[3] ^ first);
+                }
+            }
+            for (std::size_t i = 0; i < AES_BLOCK_SIZE; ++i)
+            {
+                state[i] = shifted[i] ^ round_keys_[round * AES_BLOCK_SIZE + i];
+            }
+        }
+        std::memcpy(out, state, AES_BLOCK_SIZE);
+    }
+} // namespace overwatch::identify
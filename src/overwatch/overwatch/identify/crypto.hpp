@@ -0,0 +1,142 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace overwatch::identify
+{
+    constexpr std::size_t MD5_SIZE = 16;
+    constexpr std::size_t SHA256_SIZE = 32;
+    constexpr std::size_t SHA256_BLOCK_SIZE = 64;
+    constexpr std::size_t AES_BLOCK_SIZE = 16;
+    constexpr std::size_t AES128_KEY_SIZE = 16;
+
+    /**
+     * Computes the MD5 digest of a buffer (JA3 fingerprints, not for security)
+     *
+     * @param[in] data The bytes
+     * @param[in] size Number of bytes
+     * @param[out] digest The digest
+     */
+    void md5(std::uint8_t const *data, std::size_t const size, std::uint8_t (&digest)[MD5_SIZE]) noexcept;
+
+    /**
+     * Incremental SHA-256
+     */
+    class Sha256
+    {
+    public:
+        Sha256() noexcept;
+
+        /**
+         * Hashes more bytes
+         *
+         * @param[in] data The bytes
+         * @param[in] size Number of bytes
+         */
+        void update(std::uint8_t const *data, std::size_t size) noexcept;
+
+        /**
+         * Pads the hashed bytes and computes the digest (the hash must not be updated afterwards)
+         *
+         * @param[out] digest The digest
+         */
+        void finish(std::uint8_t (&digest)[SHA256_SIZE]) noexcept;
+
+    private:
+        void compress_(std::uint8_t const *block) noexcept;
+
+        std::uint32_t state_[8];
+        std::uint8_t block_[SHA256_BLOCK_SIZE];
+        std::uint64_t length_;
+    };
+
+    /**
+     * Computes the SHA-256 digest of a buffer
+     *
+     * @param[in] data The bytes
+     * @param[in] size Number of bytes
+     * @param[out] digest The digest
+     */
+    void sha256(std::uint8_t const *data, std::size_t const size, std::uint8_t (&digest)[SHA256_SIZE]) noexcept;
+
+    /**
+     * Computes the HMAC-SHA256 of a buffer (RFC 2104)
+     *
+     * @param[in] key The key
+     * @param[in] key_size Number of bytes of the key
+     * @param[in] data The bytes
+     * @param[in] size Number of bytes
+     * @param[out] mac The authentication code
+     */
+    void hmac_sha256(std::uint8_t const *key, std::size_t const key_size, std::uint8_t const *data, std::size_t const size,
+                     std::uint8_t (&mac)[SHA256_SIZE]) noexcept;
+
+    /**
+     * HKDF-Extract with SHA-256 (RFC 5869)
+     *
+     * @param[in] salt The salt
+     * @param[in] salt_size Number of bytes of the salt
+     * @param[in] ikm The input keying material
+     * @param[in] ikm_size Number of bytes of the input keying material
+     * @param[out] prk The pseudorandom key
+     */
+    void hkdf_extract(std::uint8_t const *salt, std::size_t const salt_size, std::uint8_t const *ikm, std::size_t const ikm_size,
+                      std::uint8_t (&prk)[SHA256_SIZE]) noexcept;
+
+    /**
+     * HKDF-Expand-Label of TLS 1.3 with SHA-256 and an empty context (RFC 8446 section 7.1)
+     *
+     * @param[in] secret The secret to expand
+     * @param[in] label The label without the "tls13 " prefix (at most 32 characters)
+     * @param[out] out The derived bytes
+     * @param[in] size Number of bytes to derive (at most SHA256_SIZE)
+     */
+    void hkdf_expand_label(std::uint8_t const (&secret)[SHA256_SIZE], char const *label, std::uint8_t *out,
+                           std::size_t const size) noexcept;
+
+    /**
+     * AES-128 block encryption (FIPS 197), all the QUIC Initial protection needs
+     *
+     * The decryption of the AEAD payload only needs the counter mode keystream and the header
+     * protection is a single block encryption, so there is no block decryption.
+     */
+    class Aes128
+    {
+    public:
+        /**
+         * @param[in] key The key (AES128_KEY_SIZE bytes)
+         */
+        explicit Aes128(std::uint8_t const *key) noexcept;
+
+        /**
+         * Encrypts a block
+         *
+         * @param[in] in The plaintext block
+         * @param[out] out The ciphertext block (may be the plaintext block)
+         */
+        void encrypt(std::uint8_t const *in, std::uint8_t *out) const noexcept;
+
+    private:
+        std::uint8_t round_keys_[11 * AES_BLOCK_SIZE];
+    };
+} // namespace overwatch::identify
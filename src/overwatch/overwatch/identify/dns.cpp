@@ -0,0 +1,169 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+
+#include "decoder.hpp"
+#include "dns.hpp"
+
+#define DNS_HEADER_SIZE 12
+#define DNS_FLAG_RESPONSE 0x8000
+#define DNS_OPCODE_MASK 0x7800
+#define DNS_RCODE_MASK 0x000F
+#define DNS_POINTER_MASK 0xC0
+#define DNS_MAX_LABEL_SIZE 63
+// Compression pointers followed before a name is rejected (loops would never end)
+#define DNS_MAX_POINTERS 16
+// Type and class of a question, type, class, TTL and data length of a record
+#define DNS_QUESTION_FIELDS_SIZE 4
+#define DNS_RECORD_FIELDS_SIZE 10
+#define DNS_IPV4_SIZE 4
+#define DNS_IPV6_SIZE 16
+
+namespace
+{
+    /**
+     * Reads a possibly compressed domain name
+     *
+     * @param[in] data The DNS message
+     * @param[in] size Number of bytes of the message
+     * @param[in,out] offset Offset of the name, moved past it
+     * @param[out] name The name in presentation format (NUL terminated) or nullptr to skip it
+     * @return False if the name is malformed
+     */
+    bool read_name_(std::uint8_t const *const data, std::size_t const size, std::size_t &offset, char *const name) noexcept
+    {
+        std::size_t position = offset;
+        std::size_t length = 0;
+        std::size_t pointers = 0;
+        bool jumped = false;
+        while (true)
+        {
+            if (position >= size)
+            {
+                return false;
+            }
+            std::uint8_t const label = data[position];
+            if ((label & DNS_POINTER_MASK) == DNS_POINTER_MASK)
+            {
+                if (position + 1 >= size || ++pointers > DNS_MAX_POINTERS)
+                {
+                    return false;
+                }
+                if (!jumped)
+                {
+                    offset = position + 2;
+                    jumped = true;
+                }
+                position = static_cast<std::size_t>(label & ~DNS_POINTER_MASK) << 8 | data[position + 1];
+                continue;
+            }
+            if (label > DNS_MAX_LABEL_SIZE)
+            {
+                return false;
+            }
+            ++position;
+            if (label == 0)
+            {
+                break;
+            }
+            if (position + label > size || length + (length > 0) + label > overwatch::identify::MAX_NAME_SIZE)
+            {
+                return false;
+            }
+            if (name)
+            {
+                if (length > 0)
+                {
+                    name[length] = '.';
+                }
+                std::memcpy(name + length + (length > 0), data + position, label);
+            }
+            length += (length > 0) + label;
+            position += label;
+        }
+        if (!jumped)
+        {
+            offset = position;
+        }
+        if (name)
+        {
+            name[length] = '\0';
+        }
+        return true;
+    }
+} // namespace
+
+namespace overwatch::identify
+{
+    bool parse_dns(std::uint8_t const *const data, std::size_t const size, DnsMessage &message) noexcept
+    {
+        if (size < DNS_HEADER_SIZE)
+        {
+            return false;
+        }
+        std::uint16_t const flags = decode::load_be16(data + 2);
+        std::uint16_t const questions = decode::load_be16(data + 4);
+        std::uint16_t const answers = decode::load_be16(data + 6);
+        if ((flags & DNS_OPCODE_MASK) != 0 || questions != 1)
+        {
+            return false;
+        }
+        message.id = decode::load_be16(data);
+        message.response = (flags & DNS_FLAG_RESPONSE) != 0;
+        message.rcode = static_cast<std::uint8_t>(flags & DNS_RCODE_MASK);
+        message.answer_count = 0;
+        std::size_t offset = DNS_HEADER_SIZE;
+        if (!read_name_(data, size, offset, message.name) || offset + DNS_QUESTION_FIELDS_SIZE > size)
+        {
+            return false;
+        }
+        message.type = decode::load_be16(data + offset);
+        offset += DNS_QUESTION_FIELDS_SIZE;
+        if (!message.response)
+        {
+            return true;
+        }
+        for (std::uint16_t i = 0; i < answers && message.answer_count < MAX_DNS_ANSWERS; ++i)
+        {
+            if (!read_name_(data, size, offset, nullptr) || offset + DNS_RECORD_FIELDS_SIZE > size)
+            {
+                break;
+            }
+            std::uint16_t const type = decode::load_be16(data + offset);
+            std::uint16_t const length = decode::load_be16(data + offset + 8);
+            offset += DNS_RECORD_FIELDS_SIZE;
+            if (offset + length > size)
+            {
+                break;
+            }
+            if (type == DNS_TYPE_A && length == DNS_IPV4_SIZE)
+            {
+                message.answers[message.answer_count++] = common::utils::IpAddress::from_ipv4(decode::load_be32(data + offset));
+            }
+            else if (type == DNS_TYPE_AAAA && length == DNS_IPV6_SIZE)
+            {
+                message.answers[message.answer_count++] =
+                    common::utils::IpAddress{decode::load_be64(data + offset), decode::load_be64(data + offset + 8)};
+            }
+            offset += length;
+        }
+        return true;
+    }
+} // namespace overwatch::identify
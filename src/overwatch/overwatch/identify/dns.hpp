@@ -0,0 +1,65 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ip_address.hpp"
+
+namespace overwatch::identify
+{
+    // Longest domain name in presentation format (RFC 1035 section 3.1)
+    constexpr std::size_t MAX_NAME_SIZE = 255;
+    // Addresses kept from the answers of a response
+    constexpr std::size_t MAX_DNS_ANSWERS = 8;
+
+    constexpr std::uint16_t DNS_TYPE_A = 1;
+    constexpr std::uint16_t DNS_TYPE_AAAA = 28;
+
+    /**
+     * The question of a DNS message and, for responses, the addresses it resolved to
+     */
+    struct DnsMessage
+    {
+        // Queried name without the trailing dot, NUL terminated
+        char name[MAX_NAME_SIZE + 1];
+        std::uint16_t id;
+        std::uint16_t type;
+        bool response;
+        std::uint8_t rcode;
+        // A and AAAA records of the answer section
+        std::uint8_t answer_count;
+        common::utils::IpAddress answers[MAX_DNS_ANSWERS];
+    };
+
+    /**
+     * Parses a DNS message carried over UDP
+     *
+     * Only standard queries and their responses with a single question are parsed, anything
+     * else is rejected after looking at the 12 bytes of the header.
+     *
+     * @param[in] data The UDP payload
+     * @param[in] size Number of bytes of the payload
+     * @param[out] message The parsed message (the answers may be incomplete if the message was truncated)
+     * @return False if the payload is not a DNS message with a question
+     */
+    bool parse_dns(std::uint8_t const *data, std::size_t const size, DnsMessage &message) noexcept;
+} // namespace overwatch::identify
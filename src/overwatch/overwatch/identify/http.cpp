@@ -0,0 +1,235 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+
+#include "http.hpp"
+
+// Bytes of a request head parsed at most, the values are final once it is exceeded
+#define HTTP_MAX_HEAD_SIZE 8192
+#define HTTP_VERSION_PREFIX "HTTP/1."
+// "HTTP/1." and the minor version
+#define HTTP_VERSION_SIZE 8
+
+namespace
+{
+    constexpr char const *HTTP_METHODS[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "OPTIONS", "PATCH", "CONNECT", "TRACE"};
+
+    // Determines if the start of a method could still become a known method
+    bool is_method_prefix_(char const *const token, std::size_t const size, bool const whole) noexcept
+    {
+        for (char const *const method : HTTP_METHODS)
+        {
+            std::size_t const length = std::strlen(method);
+            if ((whole ? size == length : size <= length) && std::memcmp(method, token, size) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+} // namespace
+
+namespace overwatch::identify
+{
+    HttpRequestParser::HttpRequestParser() noexcept
+    {
+        reset();
+    }
+
+    void HttpRequestParser::reset() noexcept
+    {
+        state_ = State::Method;
+        field_ = Field::Other;
+        result_ = Result::NeedMore;
+        consumed_ = 0;
+        token_size_ = 0;
+        value_size_ = 0;
+        host_[0] = '\0';
+        user_agent_[0] = '\0';
+    }
+
+    HttpRequestParser::Result HttpRequestParser::feed(std::uint8_t const *const data, std::size_t const size) noexcept
+    {
+        std::size_t i = 0;
+        while (i < size && result_ == Result::NeedMore)
+        {
+            char const c = static_cast<char>(data[i]);
+            std::size_t step = 1;
+            switch (state_)
+            {
+            case State::Method:
+                if (c == ' ' && is_method_prefix_(token_, token_size_, true))
+                {
+                    state_ = State::Target;
+                }
+                else if (token_size_ < sizeof(token_) && c >= 'A' && c <= 'Z')
+                {
+                    token_[token_size_++] = c;
+                    if (!is_method_prefix_(token_, token_size_, false))
+                    {
+                        result_ = Result::NotHttp;
+                    }
+                }
+                else
+                {
+                    result_ = Result::NotHttp;
+                }
+                break;
+            case State::Target:
+            {
+                // The target is skipped whole
+                void const *const end = std::memchr(data + i, ' ', size - i);
+                if (!end)
+                {
+                    step = size - i;
+                    if (std::memchr(data + i, '\n', size - i))
+                    {
+                        result_ = Result::NotHttp;
+                    }
+                    break;
+                }
+                step = static_cast<std::size_t>(static_cast<std::uint8_t const *>(end) - (data + i)) + 1;
+                if (std::memchr(data + i, '\n', step))
+                {
+                    result_ = Result::NotHttp;
+                }
+                token_size_ = 0;
+                state_ = State::Version;
+                break;
+            }
+            case State::Version:
+                if (c == '\n')
+                {
+                    bool const valid = token_size_ == HTTP_VERSION_SIZE &&
+                                       std::memcmp(token_, HTTP_VERSION_PREFIX, sizeof(HTTP_VERSION_PREFIX) - 1) == 0;
+                    result_ = valid ? Result::NeedMore : Result::NotHttp;
+                    state_ = State::LineStart;
+                }
+                else if (c != '\r')
+                {
+                    if (token_size_ == sizeof(token_))
+                    {
+                        result_ = Result::NotHttp;
+                        break;
+                    }
+                    token_[token_size_++] = c;
+                }
+                break;
+            case State::LineStart:
+                if (c == '\n')
+                {
+                    // The empty line ending the head
+                    state_ = State::Finished;
+                    result_ = Result::Done;
+                }
+                else if (c != '\r')
+                {
+                    token_size_ = 0;
+                    state_ = State::Name;
+                    step = 0;
+                }
+                break;
+            case State::Name:
+                if (c == ':')
+                {
+                    bool const host = token_size_ == 4 && std::memcmp(token_, "host", 4) == 0;
+                    bool const user_agent = token_size_ == 10 && std::memcmp(token_, "user-agent", 10) == 0;
+                    field_ = host ? Field::Host : user_agent ? Field::UserAgent : Field::Other;
+                    value_size_ = 0;
+                    if (field_ != Field::Other)
+                    {
+                        // A repeated header replaces the value of the first one
+                        (host ? host_ : user_agent_)[0] = '\0';
+                    }
+                    state_ = State::Value;
+                }
+                else if (c == '\n')
+                {
+                    // A line without a colon is skipped
+                    state_ = State::LineStart;
+                }
+                else if (token_size_ < sizeof(token_))
+                {
+                    // Names longer than the token match none of the names looked for
+                    token_[token_size_++] = static_cast<char>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+                }
+                break;
+            case State::Value:
+                if (field_ == Field::Other)
+                {
+                    void const *const end = std::memchr(data + i, '\n', size - i);
+                    step = end ? static_cast<std::size_t>(static_cast<std::uint8_t const *>(end) - (data + i)) + 1 : size - i;
+                    if (end)
+                    {
+                        state_ = State::LineStart;
+                    }
+                }
+                else if (c == '\n')
+                {
+                    end_value_();
+                    state_ = State::LineStart;
+                }
+                else if (value_size_ > 0 || (c != ' ' && c != '\t'))
+                {
+                    char *const value = field_ == Field::Host ? host_ : user_agent_;
+                    std::size_t const capacity = field_ == Field::Host ? MAX_NAME_SIZE : MAX_USER_AGENT_SIZE;
+                    if (value_size_ < capacity)
+                    {
+                        // Terminated as it grows, the stream may end in the middle of the value
+                        value[value_size_++] = c;
+                        value[value_size_] = '\0';
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+            i += step;
+            consumed_ += static_cast<std::uint32_t>(step);
+            if (consumed_ >= HTTP_MAX_HEAD_SIZE && result_ == Result::NeedMore)
+            {
+                // A request line this long is no request, headers this long keep what was found
+                bool const in_request_line = state_ == State::Method || state_ == State::Target || state_ == State::Version;
+                result_ = in_request_line ? Result::NotHttp : Result::Done;
+            }
+        }
+        return result_;
+    }
+
+    char const *HttpRequestParser::get_host() const noexcept
+    {
+        return host_;
+    }
+
+    char const *HttpRequestParser::get_user_agent() const noexcept
+    {
+        return user_agent_;
+    }
+
+    void HttpRequestParser::end_value_() noexcept
+    {
+        char *const value = field_ == Field::Host ? host_ : user_agent_;
+        while (value_size_ > 0 && (value[value_size_ - 1] == '\r' || value[value_size_ - 1] == ' ' || value[value_size_ - 1] == '\t'))
+        {
+            --value_size_;
+        }
+        value[value_size_] = '\0';
+    }
+} // namespace overwatch::identify
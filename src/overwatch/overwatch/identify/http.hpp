@@ -0,0 +1,104 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "dns.hpp"
+
+namespace overwatch::identify
+{
+    // Longest User-Agent kept (longer ones are truncated)
+    constexpr std::size_t MAX_USER_AGENT_SIZE = 255;
+
+    /**
+     * Incremental parser of the head of an HTTP/1.x request, extracting its Host and User-Agent
+     *
+     * The request is fed in whatever pieces the stream delivers and never buffered, the parser
+     * only keeps the header name being read and the two values it extracts. Anything that is
+     * not a request line with a known method is rejected within its first bytes.
+     */
+    class HttpRequestParser
+    {
+    public:
+        enum class Result : std::uint8_t
+        {
+            NeedMore,
+            // The request head ended (or exceeded its limit), the values are final
+            Done,
+            NotHttp
+        };
+
+        HttpRequestParser() noexcept;
+
+        /**
+         * Starts parsing a new request
+         */
+        void reset() noexcept;
+
+        /**
+         * Parses more bytes of the request
+         *
+         * @param[in] data The bytes
+         * @param[in] size Number of bytes
+         * @return NeedMore until the request head ended, then the final result
+         */
+        Result feed(std::uint8_t const *data, std::size_t const size) noexcept;
+
+        // The Host and User-Agent values, NUL terminated (empty if absent)
+        char const *get_host() const noexcept;
+        char const *get_user_agent() const noexcept;
+
+    private:
+        enum class State : std::uint8_t
+        {
+            Method,
+            Target,
+            Version,
+            LineStart,
+            Name,
+            Value,
+            LineEnd,
+            Finished
+        };
+
+        // Which header the value being read belongs to
+        enum class Field : std::uint8_t
+        {
+            Other,
+            Host,
+            UserAgent
+        };
+
+        void end_value_() noexcept;
+
+        State state_;
+        Field field_;
+        Result result_;
+        std::uint32_t consumed_;
+        std::uint8_t token_size_;
+        // Method, version or header name being read (lowercased for names)
+        char token_[16];
+        std::uint16_t value_size_;
+        char host_[MAX_NAME_SIZE + 1];
+        char user_agent_[MAX_USER_AGENT_SIZE + 1];
+    };
+} // namespace overwatch::identify
@@ -0,0 +1,563 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "decoder.hpp"
+#include "identifier.hpp"
+#include "lpm_table.hpp"
+
+// Streams whose ClientHello or request head is assembled over several segments at the same time
+#define IDENTIFY_MAX_SESSIONS 256
+// Longest ClientHello assembled, the rest of a longer one is not parsed
+#define IDENTIFY_TLS_MESSAGE_SIZE 8192
+// QUIC connections whose ClientHello is assembled at the same time
+#define IDENTIFY_QUIC_CONNECTIONS 32
+#define DNS_PORT 53
+// TLS records of the handshake carry a 3.x legacy version
+#define TLS_MAJOR_VERSION 3
+
+namespace
+{
+    using overwatch::identify::Identification;
+    using overwatch::identify::Protocol;
+
+    /**
+     * Starts an identification with empty fields
+     *
+     * @param[out] identification The identification
+     * @param[in] key Canonical key of the flow
+     * @param[in] client_is_src True if the client is the source of the key
+     * @param[in] protocol The protocol
+     */
+    void start_identification_(Identification &identification, overwatch::core::FlowKey const &key,
+                               bool const client_is_src, Protocol const protocol) noexcept
+    {
+        identification.key = key;
+        if (!client_is_src)
+        {
+            std::swap(identification.key.src_addr, identification.key.dst_addr);
+            std::swap(identification.key.src_port, identification.key.dst_port);
+        }
+        identification.protocol = protocol;
+        identification.complete = true;
+        identification.name[0] = '\0';
+        identification.user_agent[0] = '\0';
+        identification.alpn[0] = '\0';
+        identification.ja3[0] = '\0';
+        identification.ja4[0] = '\0';
+        identification.dns_type = 0;
+        identification.dns_response = false;
+        identification.dns_rcode = 0;
+        identification.answer_count = 0;
+    }
+
+    void fill_client_hello_(Identification &identification, overwatch::identify::ClientHello const &hello,
+                            char const transport) noexcept
+    {
+        std::memcpy(identification.name, hello.server_name, sizeof(hello.server_name));
+        std::memcpy(identification.alpn, hello.alpn, sizeof(hello.alpn));
+        overwatch::identify::ja3(hello, identification.ja3);
+        overwatch::identify::ja4(hello, transport, identification.ja4);
+    }
+
+    void copy_string_(char *const out, char const *const text, std::size_t const capacity) noexcept
+    {
+        std::size_t const length = std::min(std::strlen(text), capacity);
+        std::memcpy(out, text, length);
+        out[length] = '\0';
+    }
+
+    void publish_identified_(overwatch::stats::Registry &registry, overwatch::stats::Labels const &labels,
+                             std::vector<overwatch::stats::Registration> &registrations,
+                             overwatch::stats::Counter const (&identified)[overwatch::identify::PROTOCOL_COUNT],
+                             std::initializer_list<Protocol> const protocols)
+    {
+        for (Protocol const protocol : protocols)
+        {
+            overwatch::stats::Labels protocol_labels = labels;
+            protocol_labels.emplace_back("protocol", overwatch::identify::to_string(protocol));
+            registrations.push_back(registry.add_counter("overwatch_identifications_total",
+                                                         "Clients and DNS messages identified in the targets' traffic",
+                                                         std::move(protocol_labels),
+                                                         identified[static_cast<std::size_t>(protocol)]));
+        }
+    }
+} // namespace
+
+namespace overwatch::identify
+{
+    char const *to_string(Protocol const protocol) noexcept
+    {
+        switch (protocol)
+        {
+        case Protocol::Dns:
+            return "dns";
+        case Protocol::Tls:
+            return "tls";
+        case Protocol::Quic:
+            return "quic";
+        case Protocol::Http:
+            return "http";
+        }
+        return "unknown";
+    }
+
+    struct StreamIdentifier::Session
+    {
+        HttpRequestParser http;
+        // Header of the TLS record being read and the bytes left in the record
+        std::uint8_t record_header[TLS_RECORD_HEADER_SIZE];
+        std::uint8_t record_header_size = 0;
+        std::uint16_t record_left = 0;
+        // The handshake message without its record headers
+        std::uint16_t size = 0;
+        std::uint8_t message[IDENTIFY_TLS_MESSAGE_SIZE];
+    };
+
+    StreamIdentifier::StreamIdentifier(IdentificationSink sink)
+        : sink_{std::move(sink)}, sessions_(IDENTIFY_MAX_SESSIONS), http_{}, hello_{}, identification_{}, identified_{},
+          session_drops_{}
+    {
+        free_sessions_.reserve(IDENTIFY_MAX_SESSIONS);
+        for (std::size_t i = IDENTIFY_MAX_SESSIONS; i > 0; --i)
+        {
+            free_sessions_.push_back(static_cast<std::uint16_t>(i - 1));
+        }
+    }
+
+    StreamIdentifier::~StreamIdentifier() = default;
+
+    bool StreamIdentifier::on_data(reassembly::StreamInfo const &stream, std::uint8_t const direction,
+                                   std::uint8_t const *const data, std::size_t const size)
+    {
+        if (stream.id >= streams_.size())
+        {
+            streams_.resize(stream.id + 1);
+        }
+        StreamState &state = streams_[stream.id];
+        if (state.state == State::Done)
+        {
+            return false;
+        }
+        if (direction != stream.initiator)
+        {
+            // The server speaks first (or answered a message cut short), the client is not identifiable
+            give_up_(stream, state);
+            return false;
+        }
+        if (state.state == State::New)
+        {
+            return start_(stream, state, data, size);
+        }
+        if (state.state == State::Tls)
+        {
+            return feed_tls_(stream, state, data, size);
+        }
+        HttpRequestParser &parser = sessions_[state.session].http;
+        HttpRequestParser::Result const result = parser.feed(data, size);
+        if (result == HttpRequestParser::Result::NeedMore)
+        {
+            return true;
+        }
+        if (result == HttpRequestParser::Result::Done)
+        {
+            report_http_(stream, parser, true);
+        }
+        finish_(state);
+        return false;
+    }
+
+    void StreamIdentifier::on_gap(reassembly::StreamInfo const &stream, std::uint8_t const direction, std::size_t const)
+    {
+        if (stream.id < streams_.size() && direction == stream.initiator)
+        {
+            give_up_(stream, streams_[stream.id]);
+        }
+    }
+
+    void StreamIdentifier::on_end(reassembly::StreamInfo const &stream, reassembly::StreamEnd const)
+    {
+        if (stream.id < streams_.size())
+        {
+            give_up_(stream, streams_[stream.id]);
+            // The ID is reused by a later stream
+            streams_[stream.id].state = State::New;
+        }
+    }
+
+    void StreamIdentifier::publish(stats::Registry &registry, stats::Labels const &labels,
+                                   std::vector<stats::Registration> &registrations) const
+    {
+        publish_identified_(registry, labels, registrations, identified_, {Protocol::Tls, Protocol::Http});
+        registrations.push_back(registry.add_counter("overwatch_identify_session_drops_total",
+                                                     "TCP streams left unidentified because every session was in use",
+                                                     labels, session_drops_));
+    }
+
+    std::uint64_t StreamIdentifier::get_identified(Protocol const protocol) const noexcept
+    {
+        return identified_[static_cast<std::size_t>(protocol)].load();
+    }
+
+    std::uint64_t StreamIdentifier::get_session_drops() const noexcept
+    {
+        return session_drops_.load();
+    }
+
+    bool StreamIdentifier::start_(reassembly::StreamInfo const &stream, StreamState &state, std::uint8_t const *const data,
+                                  std::size_t const size)
+    {
+        if (data[0] == TLS_CONTENT_HANDSHAKE)
+        {
+            if (size >= 2 && data[1] != TLS_MAJOR_VERSION)
+            {
+                state.state = State::Done;
+                return false;
+            }
+            // Usually the ClientHello fits in the first record and segment: parsed in place
+            if (size >= TLS_RECORD_HEADER_SIZE + TLS_HANDSHAKE_HEADER_SIZE)
+            {
+                std::size_t const record_size = decode::load_be16(data + 3);
+                std::uint8_t const *const message = data + TLS_RECORD_HEADER_SIZE;
+                std::size_t const message_size =
+                    TLS_HANDSHAKE_HEADER_SIZE + (static_cast<std::size_t>(message[1]) << 16 | decode::load_be16(message + 2));
+                if (message_size <= record_size && TLS_RECORD_HEADER_SIZE + message_size <= size)
+                {
+                    if (parse_client_hello(message, message_size, hello_) == ParseResult::Complete)
+                    {
+                        report_tls_(stream, true);
+                    }
+                    state.state = State::Done;
+                    return false;
+                }
+            }
+            state.state = State::Tls;
+        }
+        else
+        {
+            // Most requests fit in their first segment and need no session either
+            http_.reset();
+            HttpRequestParser::Result const result = http_.feed(data, size);
+            if (result != HttpRequestParser::Result::NeedMore)
+            {
+                if (result == HttpRequestParser::Result::Done)
+                {
+                    report_http_(stream, http_, true);
+                }
+                state.state = State::Done;
+                return false;
+            }
+            state.state = State::Http;
+        }
+
+        if (free_sessions_.empty())
+        {
+            session_drops_.add();
+            // What the first bytes reveal is still worth reporting
+            if (state.state == State::Tls)
+            {
+                if (size > TLS_RECORD_HEADER_SIZE &&
+                    parse_client_hello(data + TLS_RECORD_HEADER_SIZE, size - TLS_RECORD_HEADER_SIZE, hello_) !=
+                        ParseResult::Invalid &&
+                    hello_.server_name[0])
+                {
+                    report_tls_(stream, false);
+                }
+            }
+            else if (http_.get_host()[0])
+            {
+                report_http_(stream, http_, false);
+            }
+            state.state = State::Done;
+            return false;
+        }
+        state.session = free_sessions_.back();
+        free_sessions_.pop_back();
+        Session &session = sessions_[state.session];
+        if (state.state == State::Http)
+        {
+            session.http = http_;
+            return true;
+        }
+        session.record_header_size = 0;
+        session.record_left = 0;
+        session.size = 0;
+        return feed_tls_(stream, state, data, size);
+    }
+
+    bool StreamIdentifier::feed_tls_(reassembly::StreamInfo const &stream, StreamState &state, std::uint8_t const *data,
+                                     std::size_t size)
+    {
+        Session &session = sessions_[state.session];
+        while (size > 0)
+        {
+            if (session.record_left == 0)
+            {
+                // Record headers are stripped, the handshake message may span several records
+                std::size_t const copied = std::min<std::size_t>(size, TLS_RECORD_HEADER_SIZE - session.record_header_size);
+                std::memcpy(session.record_header + session.record_header_size, data, copied);
+                session.record_header_size = static_cast<std::uint8_t>(session.record_header_size + copied);
+                data += copied;
+                size -= copied;
+                if (session.record_header_size < TLS_RECORD_HEADER_SIZE)
+                {
+                    return true;
+                }
+                session.record_header_size = 0;
+                session.record_left = decode::load_be16(session.record_header + 3);
+                if (session.record_header[0] != TLS_CONTENT_HANDSHAKE || session.record_header[1] != TLS_MAJOR_VERSION ||
+                    session.record_left == 0)
+                {
+                    give_up_(stream, state);
+                    return false;
+                }
+                continue;
+            }
+            std::size_t const taken = std::min<std::size_t>(size, session.record_left);
+            std::size_t const copied = std::min<std::size_t>(taken, IDENTIFY_TLS_MESSAGE_SIZE - session.size);
+            std::memcpy(session.message + session.size, data, copied);
+            session.size = static_cast<std::uint16_t>(session.size + copied);
+            session.record_left = static_cast<std::uint16_t>(session.record_left - taken);
+            data += taken;
+            size -= taken;
+
+            ParseResult const result = parse_client_hello(session.message, session.size, hello_);
+            if (result == ParseResult::Complete)
+            {
+                report_tls_(stream, true);
+                finish_(state);
+                return false;
+            }
+            if (result == ParseResult::Invalid || session.size == IDENTIFY_TLS_MESSAGE_SIZE)
+            {
+                give_up_(stream, state);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void StreamIdentifier::give_up_(reassembly::StreamInfo const &stream, StreamState &state)
+    {
+        if (state.session != NO_SESSION)
+        {
+            Session const &session = sessions_[state.session];
+            if (state.state == State::Tls)
+            {
+                if (parse_client_hello(session.message, session.size, hello_) != ParseResult::Invalid && hello_.server_name[0])
+                {
+                    report_tls_(stream, false);
+                }
+            }
+            else if (session.http.get_host()[0])
+            {
+                report_http_(stream, session.http, false);
+            }
+        }
+        finish_(state);
+    }
+
+    void StreamIdentifier::finish_(StreamState &state) noexcept
+    {
+        if (state.session != NO_SESSION)
+        {
+            free_sessions_.push_back(state.session);
+            state.session = NO_SESSION;
+        }
+        state.state = State::Done;
+    }
+
+    void StreamIdentifier::report_tls_(reassembly::StreamInfo const &stream, bool const complete)
+    {
+        start_identification_(identification_, stream.key, stream.initiator == 0, Protocol::Tls);
+        identification_.complete = complete;
+        fill_client_hello_(identification_, hello_, 't');
+        identified_[static_cast<std::size_t>(Protocol::Tls)].add();
+        sink_(identification_);
+    }
+
+    void StreamIdentifier::report_http_(reassembly::StreamInfo const &stream, HttpRequestParser const &parser, bool const complete)
+    {
+        start_identification_(identification_, stream.key, stream.initiator == 0, Protocol::Http);
+        identification_.complete = complete;
+        copy_string_(identification_.name, parser.get_host(), MAX_NAME_SIZE);
+        copy_string_(identification_.user_agent, parser.get_user_agent(), MAX_USER_AGENT_SIZE);
+        identified_[static_cast<std::size_t>(Protocol::Http)].add();
+        sink_(identification_);
+    }
+
+    IdentifyStage::IdentifyStage(IdentificationSink sink)
+        : sink_{std::move(sink)}, connections_(IDENTIFY_QUIC_CONNECTIONS), dns_{}, hello_{}, identification_{}, identified_{}
+    {
+    }
+
+    char const *IdentifyStage::name() const noexcept
+    {
+        return "identify";
+    }
+
+    void IdentifyStage::process(core::PacketBurst &burst)
+    {
+        for (std::size_t i = 0; i < burst.size; ++i)
+        {
+            decode::DecodedPacket const &decoded = burst.decoded[i];
+            if (!burst.has_flow[i] || !decoded.has(decode::LAYER_UDP) || decoded.payload_offset == 0)
+            {
+                continue;
+            }
+            if (burst.src_targets[i] == core::LpmTable::NO_MATCH && burst.dst_targets[i] == core::LpmTable::NO_MATCH)
+            {
+                continue;
+            }
+            capture::PacketView const &packet = burst.packets[i];
+            if (packet.caplen <= decoded.payload_offset)
+            {
+                continue;
+            }
+            std::uint8_t const *const payload = packet.data + decoded.payload_offset;
+            std::size_t const size = std::min<std::size_t>(packet.caplen - decoded.payload_offset, decoded.payload_length);
+            if (decoded.src_port == DNS_PORT || decoded.dst_port == DNS_PORT)
+            {
+                identify_dns_(burst, i, payload, size);
+            }
+            else if (is_quic_initial(payload, size))
+            {
+                identify_quic_(burst, i, payload, size);
+            }
+        }
+    }
+
+    void IdentifyStage::flush(core::PacketBurst &)
+    {
+        for (QuicConnection &connection : connections_)
+        {
+            if (connection.used && !connection.done)
+            {
+                report_quic_(connection);
+            }
+            connection.used = false;
+        }
+    }
+
+    void IdentifyStage::publish(stats::Registry &registry, stats::Labels const &labels,
+                                std::vector<stats::Registration> &registrations) const
+    {
+        publish_identified_(registry, labels, registrations, identified_, {Protocol::Dns, Protocol::Quic});
+    }
+
+    std::uint64_t IdentifyStage::get_identified(Protocol const protocol) const noexcept
+    {
+        return identified_[static_cast<std::size_t>(protocol)].load();
+    }
+
+    void IdentifyStage::identify_dns_(core::PacketBurst const &burst, std::size_t const index, std::uint8_t const *const payload,
+                                      std::size_t const size)
+    {
+        if (!parse_dns(payload, size, dns_))
+        {
+            return;
+        }
+        // The client sends the queries and receives the responses
+        bool const client_is_src = (burst.flow_directions[index] == 0) != dns_.response;
+        start_identification_(identification_, burst.flow_keys[index], client_is_src, Protocol::Dns);
+        std::memcpy(identification_.name, dns_.name, sizeof(dns_.name));
+        identification_.dns_type = dns_.type;
+        identification_.dns_response = dns_.response;
+        identification_.dns_rcode = dns_.rcode;
+        identification_.answer_count = dns_.answer_count;
+        std::copy(dns_.answers, dns_.answers + dns_.answer_count, identification_.answers);
+        identified_[static_cast<std::size_t>(Protocol::Dns)].add();
+        sink_(identification_);
+    }
+
+    void IdentifyStage::identify_quic_(core::PacketBurst const &burst, std::size_t const index, std::uint8_t const *const payload,
+                                       std::size_t const size)
+    {
+        // Only clients pad their Initial packets, the packet's source is the client
+        start_identification_(identification_, burst.flow_keys[index], burst.flow_directions[index] == 0, Protocol::Quic);
+        QuicConnection &connection = find_connection_(identification_.key, burst.packets[index].timestamp_ns);
+        if (connection.done)
+        {
+            return;
+        }
+        connection.crypto.add_initial(payload, size);
+        if (connection.crypto.empty())
+        {
+            // Not a client's Initial (or not one carrying the ClientHello), the connection is not kept
+            connection.used = false;
+            return;
+        }
+        ParseResult const result = parse_client_hello(connection.crypto.data(), connection.crypto.contiguous(), hello_);
+        if (result == ParseResult::Complete)
+        {
+            report_quic_(connection);
+        }
+        else if (result == ParseResult::Invalid)
+        {
+            connection.done = true;
+        }
+    }
+
+    IdentifyStage::QuicConnection &IdentifyStage::find_connection_(core::FlowKey const &key, std::uint64_t const now_ns)
+    {
+        QuicConnection *oldest = &connections_.front();
+        for (QuicConnection &connection : connections_)
+        {
+            if (connection.used && connection.key == key)
+            {
+                connection.last_seen_ns = now_ns;
+                return connection;
+            }
+            if (!connection.used || (oldest->used && connection.last_seen_ns < oldest->last_seen_ns))
+            {
+                oldest = &connection;
+            }
+        }
+        if (oldest->used && !oldest->done)
+        {
+            report_quic_(*oldest);
+        }
+        oldest->key = key;
+        oldest->last_seen_ns = now_ns;
+        oldest->used = true;
+        oldest->done = false;
+        oldest->crypto.reset();
+        return *oldest;
+    }
+
+    void IdentifyStage::report_quic_(QuicConnection &connection)
+    {
+        connection.done = true;
+        ParseResult const result = parse_client_hello(connection.crypto.data(), connection.crypto.contiguous(), hello_);
+        if (result == ParseResult::Invalid || (result == ParseResult::Incomplete && !hello_.server_name[0]))
+        {
+            return;
+        }
+        // The identification of the packet being processed may be in use, the connection's key is the oriented one
+        start_identification_(identification_, connection.key, true, Protocol::Quic);
+        identification_.complete = result == ParseResult::Complete;
+        fill_client_hello_(identification_, hello_, 'q');
+        identified_[static_cast<std::size_t>(Protocol::Quic)].add();
+        sink_(identification_);
+    }
+} // namespace overwatch::identify
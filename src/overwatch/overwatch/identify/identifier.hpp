@@ -0,0 +1,212 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "dns.hpp"
+#include "flow.hpp"
+#include "http.hpp"
+#include "pipeline.hpp"
+#include "quic.hpp"
+#include "stats_registry.hpp"
+#include "tcp_reassembler.hpp"
+#include "tls.hpp"
+
+namespace overwatch::identify
+{
+    /**
+     * Application protocol an identification was taken from
+     */
+    enum class Protocol : std::uint8_t
+    {
+        Dns,
+        Tls,
+        Quic,
+        Http
+    };
+    constexpr std::size_t PROTOCOL_COUNT = 4;
+
+    /**
+     * Name of a protocol (for logging and labels)
+     *
+     * @param[in] protocol The protocol
+     * @return The lowercase name
+     */
+    char const *to_string(Protocol const protocol) noexcept;
+
+    /**
+     * What a target's traffic revealed about the service it talked to
+     *
+     * Fixed size so that identifying never allocates, the fields a protocol does not have are empty.
+     */
+    struct Identification
+    {
+        // Flow of the traffic with the client as source
+        core::FlowKey key;
+        Protocol protocol;
+        // False if the message was cut short (bytes lost, limits reached) and only its start was parsed
+        bool complete;
+        // TLS or QUIC server name, HTTP Host or DNS query name, NUL terminated like every string below
+        char name[MAX_NAME_SIZE + 1];
+        char user_agent[MAX_USER_AGENT_SIZE + 1];
+        char alpn[MAX_ALPN_SIZE + 1];
+        char ja3[JA3_HASH_SIZE + 1];
+        char ja4[JA4_SIZE + 1];
+        std::uint16_t dns_type;
+        bool dns_response;
+        std::uint8_t dns_rcode;
+        std::uint8_t answer_count;
+        common::utils::IpAddress answers[MAX_DNS_ANSWERS];
+    };
+
+    // Called on the worker's thread with every identification (only valid during the call)
+    using IdentificationSink = std::function<void(Identification const &)>;
+
+    /**
+     * Identifies TLS and HTTP clients from the start of the reassembled TCP streams
+     *
+     * Only the first bytes the initiator sends are looked at: streams whose first byte is
+     * neither a TLS handshake record nor an HTTP method, or where the server speaks first,
+     * are dropped right away and no longer reassembled. A ClientHello or request head that
+     * arrives whole in its first segment is parsed in place, only the ones spread over
+     * several segments are assembled in one of a fixed number of sessions.
+     */
+    class StreamIdentifier : public reassembly::StreamAnalyzer
+    {
+    public:
+        /**
+         * @param[in] sink Receives the identifications
+         */
+        explicit StreamIdentifier(IdentificationSink sink);
+        ~StreamIdentifier() override;
+
+        bool on_data(reassembly::StreamInfo const &stream, std::uint8_t const direction, std::uint8_t const *data,
+                     std::size_t const size) override;
+        void on_gap(reassembly::StreamInfo const &stream, std::uint8_t const direction, std::size_t const size) override;
+        void on_end(reassembly::StreamInfo const &stream, reassembly::StreamEnd const reason) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        std::uint64_t get_identified(Protocol const protocol) const noexcept;
+        // Streams left unidentified because every session was in use
+        std::uint64_t get_session_drops() const noexcept;
+
+    private:
+        static constexpr std::uint16_t NO_SESSION = UINT16_MAX;
+
+        enum class State : std::uint8_t
+        {
+            // Nothing received yet
+            New,
+            Tls,
+            Http,
+            // Identified or not identifiable
+            Done
+        };
+
+        struct StreamState
+        {
+            State state = State::New;
+            std::uint16_t session = NO_SESSION;
+        };
+
+        struct Session;
+
+        bool start_(reassembly::StreamInfo const &stream, StreamState &state, std::uint8_t const *data, std::size_t const size);
+        bool feed_tls_(reassembly::StreamInfo const &stream, StreamState &state, std::uint8_t const *data, std::size_t size);
+        // Reports what the partial message of a stream revealed and stops looking at the stream
+        void give_up_(reassembly::StreamInfo const &stream, StreamState &state);
+        void finish_(StreamState &state) noexcept;
+        void report_tls_(reassembly::StreamInfo const &stream, bool const complete);
+        void report_http_(reassembly::StreamInfo const &stream, HttpRequestParser const &parser, bool const complete);
+
+        IdentificationSink const sink_;
+        // Indexed by stream ID
+        std::vector<StreamState> streams_;
+        std::vector<Session> sessions_;
+        std::vector<std::uint16_t> free_sessions_;
+        // Scratch space of the message being parsed
+        HttpRequestParser http_;
+        ClientHello hello_;
+        Identification identification_;
+        // Read by the stats reporter
+        stats::Counter identified_[PROTOCOL_COUNT];
+        stats::Counter session_drops_;
+    };
+
+    /**
+     * Identifies the targets' DNS queries and answers and the clients of QUIC connections
+     *
+     * DNS messages are recognized by their port, QUIC by the long header of the client's
+     * Initial packets, whose ClientHello is decrypted with the keys every observer can derive.
+     * The ClientHello may span several Initial packets, the CRYPTO bytes of a fixed number of
+     * connections are reassembled until it is complete.
+     */
+    class IdentifyStage : public core::Stage
+    {
+    public:
+        /**
+         * @param[in] sink Receives the identifications
+         */
+        explicit IdentifyStage(IdentificationSink sink);
+
+        char const *name() const noexcept override;
+        void process(core::PacketBurst &burst) override;
+        void flush(core::PacketBurst &burst) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        std::uint64_t get_identified(Protocol const protocol) const noexcept;
+
+    private:
+        struct QuicConnection
+        {
+            // Key with the client as source
+            core::FlowKey key;
+            std::uint64_t last_seen_ns = 0;
+            bool used = false;
+            // The ClientHello was reported, later Initial packets are ignored
+            bool done = false;
+            QuicCryptoStream crypto;
+        };
+
+        void identify_dns_(core::PacketBurst const &burst, std::size_t const index, std::uint8_t const *payload,
+                           std::size_t const size);
+        void identify_quic_(core::PacketBurst const &burst, std::size_t const index, std::uint8_t const *payload,
+                            std::size_t const size);
+        // Finds the connection of a client or reuses the least recently seen one
+        QuicConnection &find_connection_(core::FlowKey const &key, std::uint64_t const now_ns);
+        // Reports the ClientHello of a connection, partial ones only if they named the server
+        void report_quic_(QuicConnection &connection);
+
+        IdentificationSink const sink_;
+        std::vector<QuicConnection> connections_;
+        // Scratch space of the message being parsed
+        DnsMessage dns_;
+        ClientHello hello_;
+        Identification identification_;
+        // Read by the stats reporter
+        stats::Counter identified_[PROTOCOL_COUNT];
+    };
+} // namespace overwatch::identify
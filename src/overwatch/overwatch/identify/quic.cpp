@@ -0,0 +1,270 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+
+#include "decoder.hpp"
+#include "quic.hpp"
+
+#define QUIC_LONG_HEADER 0x80
+#define QUIC_FIXED_BIT 0x40
+#define QUIC_PACKET_TYPE_MASK 0x30
+#define QUIC_PACKET_TYPE_INITIAL 0x00
+#define QUIC_VERSION_1 0x00000001
+// First byte, version and the length of the destination connection ID
+#define QUIC_LONG_HEADER_SIZE 6
+#define QUIC_MAX_PACKET_NUMBER_SIZE 4
+#define QUIC_SAMPLE_SIZE 16
+#define QUIC_TAG_SIZE 16
+
+#define QUIC_FRAME_PADDING 0x00
+#define QUIC_FRAME_PING 0x01
+#define QUIC_FRAME_ACK 0x02
+#define QUIC_FRAME_ACK_ECN 0x03
+#define QUIC_FRAME_CRYPTO 0x06
+#define QUIC_FRAME_CONNECTION_CLOSE 0x1C
+
+namespace
+{
+    // Salt of the Initial secrets of QUIC version 1 (RFC 9001 section 5.2)
+    constexpr std::uint8_t QUIC_V1_INITIAL_SALT[] = {0x38, 0x76, 0x2c, 0xf7, 0xf5, 0x59, 0x34, 0xb3, 0x4d, 0x17,
+                                                     0x9a, 0xe6, 0xa4, 0xc8, 0x0c, 0xad, 0xcc, 0xbb, 0x7f, 0x0a};
+
+    /**
+     * Reads a variable-length integer (RFC 9000 section 16)
+     *
+     * @param[in] data The bytes
+     * @param[in] size Number of bytes
+     * @param[in,out] offset Offset of the integer, moved past it
+     * @param[out] value The integer
+     * @return False if the integer runs past the bytes
+     */
+    bool read_varint_(std::uint8_t const *const data, std::size_t const size, std::size_t &offset, std::uint64_t &value) noexcept
+    {
+        if (offset >= size)
+        {
+            return false;
+        }
+        std::size_t const length = std::size_t{1} << (data[offset] >> 6);
+        if (size - offset < length)
+        {
+            return false;
+        }
+        value = data[offset] & 0x3F;
+        for (std::size_t i = 1; i < length; ++i)
+        {
+            value = value << 8 | data[offset + i];
+        }
+        offset += length;
+        return true;
+    }
+} // namespace
+
+namespace overwatch::identify
+{
+    void derive_initial_keys(std::uint8_t const *const dcid, std::size_t const size, QuicInitialKeys &keys) noexcept
+    {
+        std::uint8_t initial_secret[SHA256_SIZE];
+        hkdf_extract(QUIC_V1_INITIAL_SALT, sizeof(QUIC_V1_INITIAL_SALT), dcid, size, initial_secret);
+        std::uint8_t client_secret[SHA256_SIZE];
+        hkdf_expand_label(initial_secret, "client in", client_secret, SHA256_SIZE);
+        hkdf_expand_label(client_secret, "quic key", keys.key, sizeof(keys.key));
+        hkdf_expand_label(client_secret, "quic iv", keys.iv, sizeof(keys.iv));
+        hkdf_expand_label(client_secret, "quic hp", keys.hp, sizeof(keys.hp));
+    }
+
+    bool is_quic_initial(std::uint8_t const *const data, std::size_t const size) noexcept
+    {
+        return size >= QUIC_MIN_INITIAL_SIZE && (data[0] & (QUIC_LONG_HEADER | QUIC_FIXED_BIT | QUIC_PACKET_TYPE_MASK)) ==
+                                                    (QUIC_LONG_HEADER | QUIC_FIXED_BIT | QUIC_PACKET_TYPE_INITIAL) &&
+               decode::load_be32(data + 1) == QUIC_VERSION_1;
+    }
+
+    QuicCryptoStream::QuicCryptoStream() noexcept
+    {
+        reset();
+    }
+
+    void QuicCryptoStream::reset() noexcept
+    {
+        std::memset(received_, 0, sizeof(received_));
+        contiguous_ = 0;
+        empty_ = true;
+    }
+
+    bool QuicCryptoStream::add_initial(std::uint8_t const *const datagram, std::size_t const size) noexcept
+    {
+        // Long header: connection IDs, token and the length of the packet number and payload
+        std::size_t offset = QUIC_LONG_HEADER_SIZE - 1;
+        std::size_t const dcid_size = datagram[offset++];
+        if (dcid_size > QUIC_MAX_CID_SIZE || offset + dcid_size >= size)
+        {
+            return false;
+        }
+        std::uint8_t const *const dcid = datagram + offset;
+        offset += dcid_size;
+        std::size_t const scid_size = datagram[offset++];
+        offset += scid_size;
+        std::uint64_t token_size = 0;
+        std::uint64_t length = 0;
+        if (scid_size > QUIC_MAX_CID_SIZE || !read_varint_(datagram, size, offset, token_size) || token_size > size - offset)
+        {
+            return false;
+        }
+        offset += token_size;
+        if (!read_varint_(datagram, size, offset, length) || length > size - offset ||
+            length < QUIC_MAX_PACKET_NUMBER_SIZE + QUIC_SAMPLE_SIZE || length > MAX_QUIC_PACKET_SIZE)
+        {
+            return false;
+        }
+        std::size_t const packet_number_offset = offset;
+
+        // Header protection: the sample after the longest packet number masks the packet number (RFC 9001 section 5.4)
+        QuicInitialKeys keys;
+        derive_initial_keys(dcid, dcid_size, keys);
+        std::uint8_t mask[AES_BLOCK_SIZE];
+        Aes128{keys.hp}.encrypt(datagram + packet_number_offset + QUIC_MAX_PACKET_NUMBER_SIZE, mask);
+        std::size_t const packet_number_size = ((datagram[0] ^ mask[0]) & 0x03) + 1;
+        std::uint8_t nonce[AES_BLOCK_SIZE] = {};
+        std::memcpy(nonce, keys.iv, QUIC_IV_SIZE);
+        for (std::size_t i = 0; i < packet_number_size; ++i)
+        {
+            nonce[QUIC_IV_SIZE - packet_number_size + i] ^= datagram[packet_number_offset + i] ^ mask[1 + i];
+        }
+        std::size_t const payload_offset = packet_number_offset + packet_number_size;
+        if (length < packet_number_size + QUIC_TAG_SIZE)
+        {
+            return false;
+        }
+        std::size_t const payload_size = length - packet_number_size - QUIC_TAG_SIZE;
+
+        // AES-128-GCM encrypts with the counter mode keystream starting at counter 2, the tag is not checked
+        Aes128 const cipher{keys.key};
+        std::uint8_t counter[AES_BLOCK_SIZE];
+        std::memcpy(counter, nonce, QUIC_IV_SIZE);
+        std::uint8_t keystream[AES_BLOCK_SIZE];
+        for (std::size_t block = 0; block * AES_BLOCK_SIZE < payload_size; ++block)
+        {
+            std::uint32_t const count = static_cast<std::uint32_t>(block + 2);
+            counter[12] = static_cast<std::uint8_t>(count >> 24);
+            counter[13] = static_cast<std::uint8_t>(count >> 16);
+            counter[14] = static_cast<std::uint8_t>(count >> 8);
+            counter[15] = static_cast<std::uint8_t>(count);
+            cipher.encrypt(counter, keystream);
+            std::size_t const start = block * AES_BLOCK_SIZE;
+            std::size_t const end = std::min(start + AES_BLOCK_SIZE, payload_size);
+            for (std::size_t i = start; i < end; ++i)
+            {
+                plaintext_[i] = datagram[payload_offset + i] ^ keystream[i - start];
+            }
+        }
+
+        // The frames an Initial packet may carry (RFC 9000 section 12.4), anything else means garbage
+        std::size_t position = 0;
+        while (position < payload_size)
+        {
+            std::uint64_t type = 0;
+            if (!read_varint_(plaintext_, payload_size, position, type))
+            {
+                return false;
+            }
+            switch (type)
+            {
+            case QUIC_FRAME_PADDING:
+            case QUIC_FRAME_PING:
+                break;
+            case QUIC_FRAME_ACK:
+            case QUIC_FRAME_ACK_ECN:
+            {
+                // Largest acknowledged, delay, range count and first range, then the ranges and ECN counts
+                std::uint64_t value = 0;
+                std::uint64_t ranges = 0;
+                bool valid = read_varint_(plaintext_, payload_size, position, value) &&
+                             read_varint_(plaintext_, payload_size, position, value) &&
+                             read_varint_(plaintext_, payload_size, position, ranges) &&
+                             read_varint_(plaintext_, payload_size, position, value) && ranges <= payload_size;
+                std::uint64_t const fields = ranges * 2 + (type == QUIC_FRAME_ACK_ECN ? 3 : 0);
+                for (std::uint64_t i = 0; valid && i < fields; ++i)
+                {
+                    valid = read_varint_(plaintext_, payload_size, position, value);
+                }
+                if (!valid)
+                {
+                    return false;
+                }
+                break;
+            }
+            case QUIC_FRAME_CRYPTO:
+            {
+                std::uint64_t crypto_offset = 0;
+                std::uint64_t crypto_size = 0;
+                if (!read_varint_(plaintext_, payload_size, position, crypto_offset) ||
+                    !read_varint_(plaintext_, payload_size, position, crypto_size) || crypto_size > payload_size - position)
+                {
+                    return false;
+                }
+                add_crypto_(crypto_offset, plaintext_ + position, crypto_size);
+                position += crypto_size;
+                break;
+            }
+            case QUIC_FRAME_CONNECTION_CLOSE:
+                return true;
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::uint8_t const *QuicCryptoStream::data() const noexcept
+    {
+        return data_;
+    }
+
+    std::size_t QuicCryptoStream::contiguous() const noexcept
+    {
+        return contiguous_;
+    }
+
+    bool QuicCryptoStream::empty() const noexcept
+    {
+        return empty_;
+    }
+
+    void QuicCryptoStream::add_crypto_(std::uint64_t const offset, std::uint8_t const *const data, std::uint64_t const size) noexcept
+    {
+        if (size == 0 || offset >= MAX_QUIC_CRYPTO_SIZE)
+        {
+            return;
+        }
+        std::size_t const start = static_cast<std::size_t>(offset);
+        std::size_t const end = static_cast<std::size_t>(std::min<std::uint64_t>(offset + size, MAX_QUIC_CRYPTO_SIZE));
+        std::memcpy(data_ + start, data, end - start);
+        for (std::size_t i = start; i < end; ++i)
+        {
+            received_[i / 64] |= std::uint64_t{1} << (i % 64);
+        }
+        empty_ = false;
+        while (contiguous_ < MAX_QUIC_CRYPTO_SIZE && (received_[contiguous_ / 64] >> (contiguous_ % 64) & 1))
+        {
+            ++contiguous_;
+        }
+    }
+} // namespace overwatch::identify
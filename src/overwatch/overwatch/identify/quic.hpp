@@ -0,0 +1,123 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "crypto.hpp"
+
+namespace overwatch::identify
+{
+    // CRYPTO stream bytes of a client's Initial packets kept, enough for ClientHellos spanning several packets
+    constexpr std::size_t MAX_QUIC_CRYPTO_SIZE = 4096;
+    // Largest Initial packet decrypted
+    constexpr std::size_t MAX_QUIC_PACKET_SIZE = 2048;
+    // Clients pad the datagrams of their Initial packets to at least this size (RFC 9000 section 14.1)
+    constexpr std::size_t QUIC_MIN_INITIAL_SIZE = 1200;
+    constexpr std::size_t QUIC_MAX_CID_SIZE = 20;
+    constexpr std::size_t QUIC_IV_SIZE = 12;
+
+    /**
+     * Keys protecting a client's Initial packets (RFC 9001 section 5.2)
+     */
+    struct QuicInitialKeys
+    {
+        std::uint8_t key[AES128_KEY_SIZE];
+        std::uint8_t iv[QUIC_IV_SIZE];
+        std::uint8_t hp[AES128_KEY_SIZE];
+    };
+
+    /**
+     * Derives the keys of a client's Initial packets from the destination connection ID the client chose
+     *
+     * @param[in] dcid The destination connection ID of the client's first Initial packet
+     * @param[in] size Number of bytes of the connection ID
+     * @param[out] keys The client's keys
+     */
+    void derive_initial_keys(std::uint8_t const *dcid, std::size_t const size, QuicInitialKeys &keys) noexcept;
+
+    /**
+     * Determines if a UDP payload may be a client's QUIC version 1 Initial packet
+     *
+     * Only looks at the first byte, the version and the size, nothing is decrypted.
+     *
+     * @param[in] data The UDP payload
+     * @param[in] size Number of bytes of the payload
+     * @return True if the payload starts with an Initial packet in a datagram a client could send
+     */
+    bool is_quic_initial(std::uint8_t const *data, std::size_t const size) noexcept;
+
+    /**
+     * CRYPTO stream of a client's Initial packets, reassembled by offset
+     *
+     * The packets are decrypted without verifying their authentication tag: a forged packet can
+     * only make the ClientHello fail to parse, nothing is acted upon.
+     */
+    class QuicCryptoStream
+    {
+    public:
+        QuicCryptoStream() noexcept;
+
+        /**
+         * Forgets the bytes of the previous connection
+         */
+        void reset() noexcept;
+
+        /**
+         * Decrypts the first packet of a datagram and keeps the bytes of its CRYPTO frames
+         *
+         * @param[in] datagram The UDP payload (is_quic_initial() must be true for it)
+         * @param[in] size Number of bytes of the payload
+         * @return False if the packet could not be decrypted into the frames an Initial packet carries
+         */
+        bool add_initial(std::uint8_t const *datagram, std::size_t const size) noexcept;
+
+        /**
+         * The reassembled bytes from the start of the stream
+         * @return The bytes, contiguous() of them are valid
+         */
+        std::uint8_t const *data() const noexcept;
+
+        /**
+         * Number of bytes from the start of the stream received without a hole
+         * @return The number of bytes
+         */
+        std::size_t contiguous() const noexcept;
+
+        /**
+         * Determines if any CRYPTO byte was received
+         * @return True if at least one byte was received
+         */
+        bool empty() const noexcept;
+
+    private:
+        // Copies the bytes of a CRYPTO frame, those beyond the kept size are dropped
+        void add_crypto_(std::uint64_t const offset, std::uint8_t const *data, std::uint64_t const size) noexcept;
+
+        std::uint8_t data_[MAX_QUIC_CRYPTO_SIZE];
+        // One bit per byte of data_ received
+        std::uint64_t received_[MAX_QUIC_CRYPTO_SIZE / 64];
+        std::size_t contiguous_;
+        bool empty_;
+        // Decrypted payload of the packet being added
+        std::uint8_t plaintext_[MAX_QUIC_PACKET_SIZE];
+    };
+} // namespace overwatch::identify
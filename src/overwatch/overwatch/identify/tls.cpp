@@ -0,0 +1,430 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "crypto.hpp"
+#include "decoder.hpp"
+#include "tls.hpp"
+
+#define TLS_RANDOM_SIZE 32
+#define TLS_EXTENSION_SERVER_NAME 0x0000
+#define TLS_EXTENSION_SUPPORTED_GROUPS 0x000A
+#define TLS_EXTENSION_POINT_FORMATS 0x000B
+#define TLS_EXTENSION_SIGNATURE_ALGORITHMS 0x000D
+#define TLS_EXTENSION_ALPN 0x0010
+#define TLS_EXTENSION_SUPPORTED_VERSIONS 0x002B
+#define TLS_SERVER_NAME_HOST 0
+// Hex digits of the truncated SHA-256 parts of JA4
+#define JA4_HASH_SIZE 12
+#define JA4_MAX_COUNT 99
+
+namespace
+{
+    using overwatch::identify::ParseResult;
+
+    // RFC 8701 reserves 0x0A0A, 0x1A1A, ... 0xFAFA
+    bool is_grease_(std::uint16_t const value) noexcept
+    {
+        return (value & 0x0F0F) == 0x0A0A && (value >> 8) == (value & 0xFF);
+    }
+
+    /**
+     * Bounds checked reads of a message that may be cut short
+     */
+    class Reader
+    {
+    public:
+        Reader(std::uint8_t const *const data, std::size_t const size) noexcept : data_{data}, size_{size}, offset_{0}
+        {
+        }
+
+        bool has(std::size_t const count) const noexcept
+        {
+            return size_ - offset_ >= count;
+        }
+
+        std::uint8_t const *skip(std::size_t const count) noexcept
+        {
+            std::uint8_t const *const position = data_ + offset_;
+            offset_ += count;
+            return position;
+        }
+
+        std::size_t remaining() const noexcept
+        {
+            return size_ - offset_;
+        }
+
+    private:
+        std::uint8_t const *const data_;
+        std::size_t const size_;
+        std::size_t offset_;
+    };
+
+    // Copies the values of a list of 16 bit values, GREASE left out
+    template <std::size_t N>
+    void read_list_(std::uint8_t const *const data, std::size_t const size, std::uint16_t (&values)[N],
+                    std::uint8_t &count) noexcept
+    {
+        for (std::size_t offset = 0; offset + 2 <= size && count < N; offset += 2)
+        {
+            std::uint16_t const value = overwatch::decode::load_be16(data + offset);
+            if (!is_grease_(value))
+            {
+                values[count++] = value;
+            }
+        }
+    }
+
+    // Copies a length prefixed string, truncated to fit
+    void read_string_(std::uint8_t const *const data, std::size_t const size, char *const out, std::size_t const capacity) noexcept
+    {
+        std::size_t const copied = std::min(size, capacity);
+        std::memcpy(out, data, copied);
+        out[copied] = '\0';
+    }
+
+    void read_extension_(std::uint16_t const type, std::uint8_t const *const data, std::size_t const size,
+                         overwatch::identify::ClientHello &hello) noexcept
+    {
+        switch (type)
+        {
+        case TLS_EXTENSION_SERVER_NAME:
+            // A list of names of which only host names are defined
+            if (size >= 5 && data[2] == TLS_SERVER_NAME_HOST)
+            {
+                std::size_t const length = overwatch::decode::load_be16(data + 3);
+                if (5 + length <= size)
+                {
+                    read_string_(data + 5, length, hello.server_name, overwatch::identify::MAX_NAME_SIZE);
+                }
+            }
+            break;
+        case TLS_EXTENSION_SUPPORTED_GROUPS:
+            if (size >= 2)
+            {
+                read_list_(data + 2, std::min<std::size_t>(overwatch::decode::load_be16(data), size - 2), hello.groups,
+                           hello.group_count);
+            }
+            break;
+        case TLS_EXTENSION_POINT_FORMATS:
+            if (size >= 1)
+            {
+                std::size_t const length = std::min<std::size_t>(data[0], size - 1);
+                for (std::size_t i = 0; i < length && hello.point_format_count < overwatch::identify::MAX_TLS_POINT_FORMATS; ++i)
+                {
+                    hello.point_formats[hello.point_format_count++] = data[1 + i];
+                }
+            }
+            break;
+        case TLS_EXTENSION_SIGNATURE_ALGORITHMS:
+            if (size >= 2)
+            {
+                read_list_(data + 2, std::min<std::size_t>(overwatch::decode::load_be16(data), size - 2),
+                           hello.signature_algorithms, hello.signature_algorithm_count);
+            }
+            break;
+        case TLS_EXTENSION_ALPN:
+            if (size >= 3 && 3 + static_cast<std::size_t>(data[2]) <= size)
+            {
+                read_string_(data + 3, data[2], hello.alpn, overwatch::identify::MAX_ALPN_SIZE);
+            }
+            break;
+        case TLS_EXTENSION_SUPPORTED_VERSIONS:
+            for (std::size_t offset = 1; size >= 1 && offset + 2 <= std::min<std::size_t>(1 + data[0], size); offset += 2)
+            {
+                std::uint16_t const version = overwatch::decode::load_be16(data + offset);
+                if (!is_grease_(version))
+                {
+                    hello.supported_version = std::max(hello.supported_version, version);
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Appends text to a bounded buffer, keeping it NUL terminated
+    void append_(char *const buffer, std::size_t const size, std::size_t &length, char const *const text, std::size_t const count) noexcept
+    {
+        std::size_t const copied = std::min(count, size - 1 - length);
+        std::memcpy(buffer + length, text, copied);
+        length += copied;
+        buffer[length] = '\0';
+    }
+
+    template <typename T>
+    void append_values_(char *const buffer, std::size_t const size, std::size_t &length, T const *const values,
+                        std::size_t const count) noexcept
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            char number[8];
+            int const written = std::snprintf(number, sizeof(number), i == 0 ? "%u" : "-%u", static_cast<unsigned>(values[i]));
+            append_(buffer, size, length, number, static_cast<std::size_t>(written));
+        }
+    }
+
+    // Hashes the 4 digit hex values of a list separated by commas
+    void hash_hex_list_(overwatch::identify::Sha256 &hash, std::uint16_t const *const values, std::size_t const count) noexcept
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            char hex[6];
+            std::snprintf(hex, sizeof(hex), i == 0 ? "%04x" : ",%04x", static_cast<unsigned>(values[i]));
+            hash.update(reinterpret_cast<std::uint8_t const *>(hex), i == 0 ? 4 : 5);
+        }
+    }
+
+    // Writes the first JA4_HASH_SIZE hex digits of a digest, or zeros if nothing was hashed
+    void write_truncated_hash_(overwatch::identify::Sha256 &hash, bool const empty, char *const out) noexcept
+    {
+        if (empty)
+        {
+            std::memset(out, '0', JA4_HASH_SIZE);
+            return;
+        }
+        std::uint8_t digest[overwatch::identify::SHA256_SIZE];
+        hash.finish(digest);
+        for (std::size_t i = 0; i < JA4_HASH_SIZE / 2; ++i)
+        {
+            std::snprintf(out + i * 2, 3, "%02x", digest[i]);
+        }
+    }
+
+    char const *ja4_version_(std::uint16_t const version) noexcept
+    {
+        switch (version)
+        {
+        case 0x0304:
+            return "13";
+        case 0x0303:
+            return "12";
+        case 0x0302:
+            return "11";
+        case 0x0301:
+            return "10";
+        case 0x0300:
+            return "s3";
+        case 0x0002:
+            return "s2";
+        case 0xFEFF:
+            return "d1";
+        case 0xFEFD:
+            return "d2";
+        case 0xFEFC:
+            return "d3";
+        default:
+            return "00";
+        }
+    }
+
+    bool is_alphanumeric_(char const c) noexcept
+    {
+        return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+    }
+} // namespace
+
+namespace overwatch::identify
+{
+    ParseResult parse_client_hello(std::uint8_t const *const message, std::size_t const size, ClientHello &hello) noexcept
+    {
+        hello.version = 0;
+        hello.supported_version = 0;
+        hello.cipher_count = hello.extension_count = hello.group_count = 0;
+        hello.signature_algorithm_count = hello.point_format_count = 0;
+        hello.server_name[0] = hello.alpn[0] = '\0';
+        if (size >= 1 && message[0] != TLS_HANDSHAKE_CLIENT_HELLO)
+        {
+            return ParseResult::Invalid;
+        }
+        if (size < TLS_HANDSHAKE_HEADER_SIZE)
+        {
+            return ParseResult::Incomplete;
+        }
+        std::size_t const length = static_cast<std::size_t>(message[1]) << 16 | decode::load_be16(message + 2);
+        bool const truncated = size - TLS_HANDSHAKE_HEADER_SIZE < length;
+        // Running out of bytes before the end of the message only means more are to come
+        ParseResult const short_result = truncated ? ParseResult::Incomplete : ParseResult::Invalid;
+        Reader reader{message + TLS_HANDSHAKE_HEADER_SIZE, std::min(size - TLS_HANDSHAKE_HEADER_SIZE, length)};
+
+        if (!reader.has(2 + TLS_RANDOM_SIZE + 1))
+        {
+            return short_result;
+        }
+        hello.version = decode::load_be16(reader.skip(2));
+        reader.skip(TLS_RANDOM_SIZE);
+        std::size_t const session_id_size = *reader.skip(1);
+        if (!reader.has(session_id_size + 2))
+        {
+            return short_result;
+        }
+        reader.skip(session_id_size);
+        std::size_t const ciphers_size = decode::load_be16(reader.skip(2));
+        // The cipher list is read even if cut short, a partial ClientHello still names its ciphers
+        std::size_t const available = std::min(ciphers_size, reader.remaining());
+        read_list_(reader.skip(available), available, hello.ciphers, hello.cipher_count);
+        if (available < ciphers_size || !reader.has(1))
+        {
+            return short_result;
+        }
+        std::size_t const compressions_size = *reader.skip(1);
+        if (!reader.has(compressions_size))
+        {
+            return short_result;
+        }
+        reader.skip(compressions_size);
+        if (reader.remaining() == 0)
+        {
+            // Extensions are optional
+            return truncated ? ParseResult::Incomplete : ParseResult::Complete;
+        }
+        if (!reader.has(2))
+        {
+            return short_result;
+        }
+        std::size_t extensions_left = decode::load_be16(reader.skip(2));
+        while (extensions_left > 0)
+        {
+            if (extensions_left < 4)
+            {
+                return ParseResult::Invalid;
+            }
+            if (!reader.has(4))
+            {
+                return short_result;
+            }
+            std::uint16_t const type = decode::load_be16(reader.skip(2));
+            std::size_t const extension_size = decode::load_be16(reader.skip(2));
+            if (extension_size > extensions_left - 4)
+            {
+                return ParseResult::Invalid;
+            }
+            if (!reader.has(extension_size))
+            {
+                return short_result;
+            }
+            std::uint8_t const *const data = reader.skip(extension_size);
+            extensions_left -= 4 + extension_size;
+            if (is_grease_(type))
+            {
+                continue;
+            }
+            if (hello.extension_count < MAX_TLS_EXTENSIONS)
+            {
+                hello.extensions[hello.extension_count++] = type;
+            }
+            read_extension_(type, data, extension_size, hello);
+        }
+        return truncated ? ParseResult::Incomplete : ParseResult::Complete;
+    }
+
+    std::size_t format_ja3(ClientHello const &hello, char *const buffer, std::size_t const size) noexcept
+    {
+        std::size_t length = 0;
+        if (size == 0)
+        {
+            return 0;
+        }
+        buffer[0] = '\0';
+        char version[8];
+        int const written = std::snprintf(version, sizeof(version), "%u,", static_cast<unsigned>(hello.version));
+        append_(buffer, size, length, version, static_cast<std::size_t>(written));
+        append_values_(buffer, size, length, hello.ciphers, hello.cipher_count);
+        append_(buffer, size, length, ",", 1);
+        append_values_(buffer, size, length, hello.extensions, hello.extension_count);
+        append_(buffer, size, length, ",", 1);
+        append_values_(buffer, size, length, hello.groups, hello.group_count);
+        append_(buffer, size, length, ",", 1);
+        append_values_(buffer, size, length, hello.point_formats, hello.point_format_count);
+        return length;
+    }
+
+    void ja3(ClientHello const &hello, char (&fingerprint)[JA3_HASH_SIZE + 1]) noexcept
+    {
+        char text[JA3_MAX_SIZE + 1];
+        std::size_t const length = format_ja3(hello, text, sizeof(text));
+        std::uint8_t digest[MD5_SIZE];
+        md5(reinterpret_cast<std::uint8_t const *>(text), length, digest);
+        for (std::size_t i = 0; i < MD5_SIZE; ++i)
+        {
+            std::snprintf(fingerprint + i * 2, 3, "%02x", digest[i]);
+        }
+    }
+
+    void ja4(ClientHello const &hello, char const transport, char (&fingerprint)[JA4_SIZE + 1]) noexcept
+    {
+        // ja4_a: transport, version, SNI or IP, number of ciphers and extensions, first ALPN
+        char alpn[3] = {'0', '0', '\0'};
+        std::size_t const alpn_size = std::strlen(hello.alpn);
+        if (alpn_size > 0)
+        {
+            char const first = hello.alpn[0];
+            char const last = hello.alpn[alpn_size - 1];
+            if (is_alphanumeric_(first) && is_alphanumeric_(last))
+            {
+                alpn[0] = first;
+                alpn[1] = last;
+            }
+            else
+            {
+                char const *const digits = "0123456789abcdef";
+                alpn[0] = digits[static_cast<std::uint8_t>(first) >> 4];
+                alpn[1] = digits[static_cast<std::uint8_t>(last) & 0x0F];
+            }
+        }
+        std::snprintf(fingerprint, sizeof(fingerprint), "%c%s%c%02u%02u%s_", transport,
+                      ja4_version_(hello.supported_version ? hello.supported_version : hello.version),
+                      hello.server_name[0] ? 'd' : 'i', std::min<unsigned>(hello.cipher_count, JA4_MAX_COUNT),
+                      std::min<unsigned>(hello.extension_count, JA4_MAX_COUNT), alpn);
+
+        // ja4_b: the sorted ciphers
+        std::uint16_t sorted[std::max(MAX_TLS_CIPHERS, MAX_TLS_EXTENSIONS)];
+        std::copy(hello.ciphers, hello.ciphers + hello.cipher_count, sorted);
+        std::sort(sorted, sorted + hello.cipher_count);
+        Sha256 ciphers;
+        hash_hex_list_(ciphers, sorted, hello.cipher_count);
+        write_truncated_hash_(ciphers, hello.cipher_count == 0, fingerprint + 11);
+        fingerprint[11 + JA4_HASH_SIZE] = '_';
+
+        // ja4_c: the sorted extensions without SNI and ALPN, then the signature algorithms in their order
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < hello.extension_count; ++i)
+        {
+            if (hello.extensions[i] != TLS_EXTENSION_SERVER_NAME && hello.extensions[i] != TLS_EXTENSION_ALPN)
+            {
+                sorted[count++] = hello.extensions[i];
+            }
+        }
+        std::sort(sorted, sorted + count);
+        Sha256 extensions;
+        hash_hex_list_(extensions, sorted, count);
+        if (hello.signature_algorithm_count > 0)
+        {
+            extensions.update(reinterpret_cast<std::uint8_t const *>("_"), 1);
+            hash_hex_list_(extensions, hello.signature_algorithms, hello.signature_algorithm_count);
+        }
+        write_truncated_hash_(extensions, count == 0, fingerprint + 12 + JA4_HASH_SIZE);
+        fingerprint[JA4_SIZE] = '\0';
+    }
+} // namespace overwatch::identify
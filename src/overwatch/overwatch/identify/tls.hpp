@@ -0,0 +1,123 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "dns.hpp"
+
+namespace overwatch::identify
+{
+    constexpr std::size_t MAX_TLS_CIPHERS = 128;
+    constexpr std::size_t MAX_TLS_EXTENSIONS = 64;
+    constexpr std::size_t MAX_TLS_GROUPS = 64;
+    constexpr std::size_t MAX_TLS_POINT_FORMATS = 16;
+    constexpr std::size_t MAX_TLS_SIGNATURE_ALGORITHMS = 64;
+    // Longest ALPN protocol kept (longer ones are truncated)
+    constexpr std::size_t MAX_ALPN_SIZE = 31;
+
+    constexpr std::size_t TLS_RECORD_HEADER_SIZE = 5;
+    constexpr std::size_t TLS_HANDSHAKE_HEADER_SIZE = 4;
+    constexpr std::uint8_t TLS_CONTENT_HANDSHAKE = 22;
+    constexpr std::uint8_t TLS_HANDSHAKE_CLIENT_HELLO = 1;
+
+    // Lengths of the fingerprints in hex, without the NUL terminator
+    constexpr std::size_t JA3_HASH_SIZE = 32;
+    constexpr std::size_t JA4_SIZE = 36;
+    // Longest JA3 string of a ClientHello whose lists fit in the arrays above
+    constexpr std::size_t JA3_MAX_SIZE =
+        5 + 4 + 6 * (MAX_TLS_CIPHERS + MAX_TLS_EXTENSIONS + MAX_TLS_GROUPS) + 4 * MAX_TLS_POINT_FORMATS;
+
+    /**
+     * Fields of a ClientHello needed to name and fingerprint the client
+     *
+     * GREASE values (RFC 8701) are left out of every list, the fingerprints ignore them.
+     * Lists longer than their arrays are truncated.
+     */
+    struct ClientHello
+    {
+        std::uint16_t version;
+        // Highest version of the supported_versions extension, 0 without the extension
+        std::uint16_t supported_version;
+        std::uint16_t ciphers[MAX_TLS_CIPHERS];
+        std::uint16_t extensions[MAX_TLS_EXTENSIONS];
+        std::uint16_t groups[MAX_TLS_GROUPS];
+        std::uint16_t signature_algorithms[MAX_TLS_SIGNATURE_ALGORITHMS];
+        std::uint8_t point_formats[MAX_TLS_POINT_FORMATS];
+        std::uint8_t cipher_count;
+        std::uint8_t extension_count;
+        std::uint8_t group_count;
+        std::uint8_t signature_algorithm_count;
+        std::uint8_t point_format_count;
+        // Server name indication and first ALPN protocol, NUL terminated (empty if absent)
+        char server_name[MAX_NAME_SIZE + 1];
+        char alpn[MAX_ALPN_SIZE + 1];
+    };
+
+    /**
+     * How much of a message could be parsed
+     */
+    enum class ParseResult : std::uint8_t
+    {
+        Complete,
+        // The message continues past the given bytes, the fields before the cut were parsed
+        Incomplete,
+        // Not the expected message
+        Invalid
+    };
+
+    /**
+     * Parses a ClientHello handshake message
+     *
+     * @param[in] message The handshake message, starting at its 4 byte header (record headers removed)
+     * @param[in] size Number of bytes available, possibly fewer than the message
+     * @param[out] hello The parsed fields
+     * @return Whether the message was complete
+     */
+    ParseResult parse_client_hello(std::uint8_t const *message, std::size_t const size, ClientHello &hello) noexcept;
+
+    /**
+     * Formats the JA3 string of a ClientHello (version,ciphers,extensions,groups,point formats)
+     *
+     * @param[in] hello The ClientHello
+     * @param[out] buffer Receives the NUL terminated string (JA3_MAX_SIZE + 1 bytes always suffice)
+     * @param[in] size Size of the buffer (the string is truncated to fit)
+     * @return Length of the string
+     */
+    std::size_t format_ja3(ClientHello const &hello, char *buffer, std::size_t const size) noexcept;
+
+    /**
+     * Computes the JA3 fingerprint of a ClientHello (MD5 of its JA3 string)
+     *
+     * @param[in] hello The ClientHello
+     * @param[out] fingerprint The lowercase hex digest, NUL terminated
+     */
+    void ja3(ClientHello const &hello, char (&fingerprint)[JA3_HASH_SIZE + 1]) noexcept;
+
+    /**
+     * Computes the JA4 fingerprint of a ClientHello
+     *
+     * @param[in] hello The ClientHello
+     * @param[in] transport 't' for TLS over TCP, 'q' for QUIC
+     * @param[out] fingerprint The a_b_c fingerprint, NUL terminated
+     */
+    void ja4(ClientHello const &hello, char const transport, char (&fingerprint)[JA4_SIZE + 1]) noexcept;
+} // namespace overwatch::identify
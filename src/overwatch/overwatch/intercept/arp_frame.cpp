@@ -0,0 +1,111 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <cstdio>
+#include <cstring>
+
+#include "arp_frame.hpp"
+#include "decoder.hpp"
+
+#define ETHER_TYPE_ARP 0x0806
+#define ETHERNET_HEADER_SIZE 14
+#define ARP_PAYLOAD_SIZE 28
+#define ARP_HARDWARE_ETHERNET 1
+#define ARP_PROTOCOL_IPV4 0x0800
+
+namespace overwatch::intercept
+{
+    namespace
+    {
+        /**
+         * Stores a 16 bit value in network byte order
+         *
+         * @param[out] out Destination of the value
+         * @param[in] value The value
+         */
+        void store_be16_(std::uint8_t *out, std::uint16_t const value) noexcept
+        {
+            out[0] = static_cast<std::uint8_t>(value >> 8);
+            out[1] = static_cast<std::uint8_t>(value);
+        }
+
+        /**
+         * Stores a 32 bit value in network byte order
+         *
+         * @param[out] out Destination of the value
+         * @param[in] value The value
+         */
+        void store_be32_(std::uint8_t *out, std::uint32_t const value) noexcept
+        {
+            store_be16_(out, static_cast<std::uint16_t>(value >> 16));
+            store_be16_(out + 2, static_cast<std::uint16_t>(value));
+        }
+    } // namespace
+
+    std::size_t build_arp_frame(ArpMessage const &message, MacAddress const &destination, MacAddress const &source,
+                                std::uint8_t *frame) noexcept
+    {
+        std::memset(frame, 0, ARP_FRAME_SIZE);
+        std::memcpy(frame, destination.data(), destination.size());
+        std::memcpy(frame + 6, source.data(), source.size());
+        store_be16_(frame + 12, ETHER_TYPE_ARP);
+
+        std::uint8_t *arp = frame + ETHERNET_HEADER_SIZE;
+        store_be16_(arp, ARP_HARDWARE_ETHERNET);
+        store_be16_(arp + 2, ARP_PROTOCOL_IPV4);
+        arp[4] = 6;
+        arp[5] = 4;
+        store_be16_(arp + 6, message.operation);
+        std::memcpy(arp + 8, message.sender_mac.data(), message.sender_mac.size());
+        store_be32_(arp + 14, message.sender_ip);
+        std::memcpy(arp + 18, message.target_mac.data(), message.target_mac.size());
+        store_be32_(arp + 24, message.target_ip);
+        return ARP_FRAME_SIZE;
+    }
+
+    std::optional<ArpMessage> parse_arp_frame(std::uint8_t const *frame, std::size_t const length) noexcept
+    {
+        if (length < ETHERNET_HEADER_SIZE + ARP_PAYLOAD_SIZE || decode::load_be16(frame + 12) != ETHER_TYPE_ARP)
+        {
+            return std::nullopt;
+        }
+        std::uint8_t const *arp = frame + ETHERNET_HEADER_SIZE;
+        if (decode::load_be16(arp) != ARP_HARDWARE_ETHERNET || decode::load_be16(arp + 2) != ARP_PROTOCOL_IPV4 ||
+            arp[4] != 6 || arp[5] != 4)
+        {
+            return std::nullopt;
+        }
+
+        ArpMessage message;
+        message.operation = decode::load_be16(arp + 6);
+        std::memcpy(message.sender_mac.data(), arp + 8, message.sender_mac.size());
+        message.sender_ip = decode::load_be32(arp + 14);
+        std::memcpy(message.target_mac.data(), arp + 18, message.target_mac.size());
+        message.target_ip = decode::load_be32(arp + 24);
+        return message;
+    }
+
+    std::string to_string(MacAddress const &mac)
+    {
+        char buffer[18];
+        std::snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        return buffer;
+    }
+} // namespace overwatch::intercept
@@ -0,0 +1,85 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace overwatch::intercept
+{
+    // Size of an ARP frame padded to the minimum Ethernet frame size
+    constexpr std::size_t ARP_FRAME_SIZE = 60;
+    // ARP operations
+    constexpr std::uint16_t ARP_REQUEST = 1;
+    constexpr std::uint16_t ARP_REPLY = 2;
+
+    /**
+     * Ethernet hardware address
+     */
+    using MacAddress = std::array<std::uint8_t, 6>;
+
+    // Destination of frames meant for every host of the segment
+    constexpr MacAddress BROADCAST_MAC{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+    /**
+     * Ethernet/IPv4 ARP message (addresses in host byte order)
+     */
+    struct ArpMessage
+    {
+        std::uint16_t operation = ARP_REQUEST;
+        MacAddress sender_mac{};
+        std::uint32_t sender_ip = 0;
+        MacAddress target_mac{};
+        std::uint32_t target_ip = 0;
+    };
+
+    /**
+     * Builds an ARP frame
+     *
+     * @param[in] message The ARP message
+     * @param[in] destination Destination of the Ethernet frame
+     * @param[in] source Source of the Ethernet frame
+     * @param[out] frame Buffer of at least ARP_FRAME_SIZE bytes
+     * @return The size of the frame (ARP_FRAME_SIZE)
+     */
+    std::size_t build_arp_frame(ArpMessage const &message, MacAddress const &destination, MacAddress const &source,
+                                std::uint8_t *frame) noexcept;
+
+    /**
+     * Parses an untagged Ethernet/IPv4 ARP frame
+     *
+     * @param[in] frame The frame starting at the Ethernet header
+     * @param[in] length Captured length of the frame
+     * @return The ARP message or std::nullopt if the frame is not an Ethernet/IPv4 ARP frame
+     */
+    std::optional<ArpMessage> parse_arp_frame(std::uint8_t const *frame, std::size_t const length) noexcept;
+
+    /**
+     * Converts a hardware address to its string representation (e.g. "02:00:00:00:00:01")
+     *
+     * @param[in] mac The address
+     * @return The string representation
+     */
+    std::string to_string(MacAddress const &mac);
+} // namespace overwatch::intercept
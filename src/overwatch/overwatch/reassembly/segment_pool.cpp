@@ -0,0 +1,70 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#include "segment_pool.hpp"
+
+namespace overwatch::reassembly
+{
+    SegmentPool::SegmentPool(std::size_t const max_bytes)
+        : max_segments_{max_bytes / SEGMENT_SIZE}, slots_{SEGMENT_SIZE, SEGMENTS_PER_SLAB, max_bytes / SEGMENT_SIZE}
+    {
+        if (max_segments_ < SEGMENTS_PER_SLAB)
+        {
+            throw std::invalid_argument{"The reassembly memory must hold at least " +
+                                        std::to_string(SEGMENTS_PER_SLAB * SEGMENT_SIZE) + " bytes"};
+        }
+    }
+
+    Segment *SegmentPool::allocate() noexcept
+    {
+        try
+        {
+            return static_cast<Segment *>(slots_.allocate());
+        }
+        catch (std::exception const &)
+        {
+            // A slab that could not be mapped is a full pool to the reassembly
+            return nullptr;
+        }
+    }
+
+    void SegmentPool::release(Segment *const segment) noexcept
+    {
+        slots_.deallocate(segment);
+    }
+
+    std::size_t SegmentPool::available() const noexcept
+    {
+        return max_segments_ - slots_.get_slots();
+    }
+
+    std::size_t SegmentPool::in_use() const noexcept
+    {
+        return slots_.get_slots();
+    }
+
+    std::size_t SegmentPool::reserved_bytes() const noexcept
+    {
+        return slots_.get_usage().reserved;
+    }
+} // namespace overwatch::reassembly
@@ -0,0 +1,108 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "memory.hpp"
+
+// Bytes of a pooled segment, its header included
+#define SEGMENT_SIZE 2048
+// Segments allocated at once whenever the pool grows
+#define SEGMENTS_PER_SLAB 64
+
+namespace overwatch::reassembly
+{
+    /**
+     * Bytes of a TCP stream received ahead of a hole, kept in a sorted list per direction
+     */
+    struct Segment
+    {
+        Segment *next;
+        // Sequence number of the first byte
+        std::uint32_t seq;
+        std::uint32_t size;
+        std::uint8_t data[SEGMENT_SIZE - sizeof(Segment *) - 2 * sizeof(std::uint32_t)];
+    };
+    static_assert(sizeof(Segment) == SEGMENT_SIZE, "Segments must fill their slab slots exactly");
+
+    // Payload bytes held by a single segment
+    constexpr std::size_t SEGMENT_CAPACITY = sizeof(Segment::data);
+
+    /**
+     * Fixed size allocator of segments with a hard cap, on top of a slab pool.
+     *
+     * Segments are carved from slabs mapped on demand until the cap is reached, freed
+     * segments are handed out again first, so once the pool has grown to the working set
+     * the reassembly never touches the system allocator. Slabs are only returned with the
+     * pool. The pool is owned by a single worker and does not synchronize.
+     */
+    class SegmentPool
+    {
+    public:
+        /**
+         * Creates an empty pool
+         *
+         * @param[in] max_bytes Memory the segments of the pool may use at most
+         * @throw std::invalid_argument If max_bytes does not hold a single slab
+         */
+        explicit SegmentPool(std::size_t const max_bytes);
+
+        SegmentPool(SegmentPool const &) = delete;
+        SegmentPool &operator=(SegmentPool const &) = delete;
+
+        /**
+         * Takes a segment (its content is undefined)
+         *
+         * @return The segment or nullptr if the cap is reached
+         */
+        Segment *allocate() noexcept;
+
+        /**
+         * Gives a segment back to the pool
+         *
+         * @param[in] segment A segment allocated by this pool
+         */
+        void release(Segment *segment) noexcept;
+
+        /**
+         * Number of segments that can still be allocated before the cap is reached
+         * @return The number of available segments
+         */
+        std::size_t available() const noexcept;
+
+        /**
+         * Number of segments currently allocated
+         * @return The number of segments in use
+         */
+        std::size_t in_use() const noexcept;
+
+        /**
+         * Memory held by the slabs of the pool
+         * @return The reserved bytes
+         */
+        std::size_t reserved_bytes() const noexcept;
+
+    private:
+        std::size_t const max_segments_;
+        common::memory::SlabPool slots_;
+    };
+} // namespace overwatch::reassembly
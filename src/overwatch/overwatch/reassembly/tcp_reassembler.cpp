@@ -0,0 +1,793 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "lpm_table.hpp"
+#include "tcp_reassembler.hpp"
+
+#define TCP_SEQ_OFFSET 4
+#define TCP_ACK_OFFSET 8
+#define TCP_OPTIONS_OFFSET 20
+#define TCP_OPTION_END 0
+#define TCP_OPTION_NOP 1
+#define TCP_OPTION_SACK 5
+#define TCP_SACK_BLOCK_SIZE 8
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+namespace
+{
+    // Sequence numbers compared modulo 2^32
+    bool seq_before_(std::uint32_t const lhs, std::uint32_t const rhs) noexcept
+    {
+        return static_cast<std::int32_t>(lhs - rhs) < 0;
+    }
+
+    bool seq_after_(std::uint32_t const lhs, std::uint32_t const rhs) noexcept
+    {
+        return seq_before_(rhs, lhs);
+    }
+
+    /**
+     * Reads the SACK blocks of a TCP header
+     *
+     * @param[in] packet The frame
+     * @param[in] decoded The decoded headers of the frame
+     * @param[out] sacks The left and right edges of the blocks
+     * @return The number of blocks read
+     */
+    std::uint8_t parse_sacks_(overwatch::capture::PacketView const &packet, overwatch::decode::DecodedPacket const &decoded,
+                              std::uint32_t (&sacks)[4][2]) noexcept
+    {
+        std::uint32_t offset = decoded.l4_offset + TCP_OPTIONS_OFFSET;
+        std::uint32_t const end = std::min<std::uint32_t>(decoded.payload_offset, packet.caplen);
+        std::uint8_t count = 0;
+        while (offset < end)
+        {
+            std::uint8_t const kind = packet.data[offset];
+            if (kind == TCP_OPTION_END)
+            {
+                break;
+            }
+            if (kind == TCP_OPTION_NOP)
+            {
+                ++offset;
+                continue;
+            }
+            if (offset + 1 >= end || packet.data[offset + 1] < 2 || offset + packet.data[offset + 1] > end)
+            {
+                break;
+            }
+            std::uint32_t const option_end = offset + packet.data[offset + 1];
+            if (kind == TCP_OPTION_SACK)
+            {
+                for (std::uint32_t block = offset + 2; block + TCP_SACK_BLOCK_SIZE <= option_end && count < 4;
+                     block += TCP_SACK_BLOCK_SIZE)
+                {
+                    sacks[count][0] = overwatch::decode::load_be32(packet.data + block);
+                    sacks[count][1] = overwatch::decode::load_be32(packet.data + block + 4);
+                    ++count;
+                }
+            }
+            offset = option_end;
+        }
+        return count;
+    }
+} // namespace
+
+namespace overwatch::reassembly
+{
+    void StreamAnalyzer::on_gap(StreamInfo const &, std::uint8_t const, std::size_t const)
+    {
+    }
+
+    void StreamAnalyzer::on_end(StreamInfo const &, StreamEnd const)
+    {
+    }
+
+    void StreamAnalyzer::publish(stats::Registry &, stats::Labels const &, std::vector<stats::Registration> &) const
+    {
+    }
+
+    AnalyzerChain::AnalyzerChain(std::vector<std::unique_ptr<StreamAnalyzer>> analyzers)
+        : analyzers_{std::move(analyzers)}, done_{}
+    {
+        if (analyzers_.empty() || analyzers_.size() > MAX_CHAINED_ANALYZERS)
+        {
+            throw std::invalid_argument{"A chain needs 1 to " + std::to_string(MAX_CHAINED_ANALYZERS) + " analyzers"};
+        }
+    }
+
+    bool AnalyzerChain::on_data(StreamInfo const &stream, std::uint8_t const direction, std::uint8_t const *data,
+                                std::size_t const size)
+    {
+        if (stream.id >= done_.size())
+        {
+            done_.resize(stream.id + 1, 0);
+        }
+        std::uint8_t &done = done_[stream.id];
+        for (std::size_t i = 0; i < analyzers_.size(); ++i)
+        {
+            std::uint8_t const bit = static_cast<std::uint8_t>(1U << i);
+            if (!(done & bit) && !analyzers_[i]->on_data(stream, direction, data, size))
+            {
+                done |= bit;
+            }
+        }
+        return done != static_cast<std::uint8_t>((1U << analyzers_.size()) - 1);
+    }
+
+    void AnalyzerChain::on_gap(StreamInfo const &stream, std::uint8_t const direction, std::size_t const size)
+    {
+        std::uint8_t const done = stream.id < done_.size() ? done_[stream.id] : 0;
+        for (std::size_t i = 0; i < analyzers_.size(); ++i)
+        {
+            if (!(done & (1U << i)))
+            {
+                analyzers_[i]->on_gap(stream, direction, size);
+            }
+        }
+    }
+
+    void AnalyzerChain::on_end(StreamInfo const &stream, StreamEnd const reason)
+    {
+        for (std::unique_ptr<StreamAnalyzer> const &analyzer : analyzers_)
+        {
+            analyzer->on_end(stream, reason);
+        }
+        if (stream.id < done_.size())
+        {
+            done_[stream.id] = 0;
+        }
+    }
+
+    void AnalyzerChain::publish(stats::Registry &registry, stats::Labels const &labels,
+                                std::vector<stats::Registration> &registrations) const
+    {
+        for (std::unique_ptr<StreamAnalyzer> const &analyzer : analyzers_)
+        {
+            analyzer->publish(registry, labels, registrations);
+        }
+    }
+
+    std::vector<std::unique_ptr<StreamAnalyzer>> const &AnalyzerChain::get_analyzers() const noexcept
+    {
+        return analyzers_;
+    }
+
+    TcpReassembler::TcpReassembler(StreamAnalyzer &analyzer, ReassemblerOptions const &options)
+        : analyzer_{analyzer}, options_{options}, pool_{options.max_memory}, index_{options.max_streams}, streams_{},
+          free_streams_{}, recent_{}, buffering_{}, active_{0}, started_{}, out_of_order_{}, retransmitted_{},
+          overlapping_{}, gaps_{}, evictions_{}
+    {
+        if (options_.max_streams >= NONE || options_.max_window == 0 || options_.max_window > INT32_MAX ||
+            options_.idle_timeout_ns == 0)
+        {
+            throw std::invalid_argument{"Invalid TCP reassembly limits"};
+        }
+        // References to streams stay valid while new streams start
+        streams_.reserve(options_.max_streams);
+    }
+
+    TcpReassembler::~TcpReassembler() = default;
+
+    void TcpReassembler::process(capture::PacketView const &packet, decode::DecodedPacket const &decoded,
+                                 core::FlowKey const &key, std::uint64_t const hash, std::uint8_t const direction)
+    {
+        // The TCP options did not fit in the capture
+        if (decoded.payload_offset <= decoded.l4_offset)
+        {
+            return;
+        }
+        std::uint8_t const flags = decoded.tcp_flags;
+        Stream *const found = find_or_start_(key, hash, direction, flags, decoded.payload_length > 0);
+        if (!found)
+        {
+            return;
+        }
+        Stream &stream = *found;
+        stream.last_seen_ns = std::max(stream.last_seen_ns, packet.timestamp_ns);
+        unlink_(recent_, &Stream::recent, stream.info.id);
+        link_front_(recent_, &Stream::recent, stream.info.id);
+        if (stream.is_buffering)
+        {
+            unlink_(buffering_, &Stream::buffering, stream.info.id);
+            link_front_(buffering_, &Stream::buffering, stream.info.id);
+        }
+        if (flags & TCP_RST)
+        {
+            end_(stream, StreamEnd::Reset);
+            return;
+        }
+
+        std::uint8_t const *const tcp = packet.data + decoded.l4_offset;
+        HalfStream &half = stream.halves[direction];
+        std::uint32_t seq = decode::load_be32(tcp + TCP_SEQ_OFFSET);
+        if (flags & TCP_SYN)
+        {
+            if (!half.synced)
+            {
+                half.synced = true;
+                half.next_seq = seq + 1;
+            }
+            // Data carried by a SYN (TCP Fast Open) follows the SYN's sequence number
+            ++seq;
+        }
+        std::uint32_t const length = decoded.payload_length;
+        std::uint32_t const captured =
+            packet.caplen > decoded.payload_offset ? std::min(packet.caplen - decoded.payload_offset, length) : 0;
+        if (!half.synced && (length > 0 || (flags & TCP_FIN)))
+        {
+            // The handshake was missed, the direction starts with the first byte seen
+            half.synced = true;
+            half.next_seq = seq;
+        }
+        if (half.synced && !half.closed)
+        {
+            if (captured > 0 && !stream.ignored)
+            {
+                add_data_(stream, direction, seq, packet.data + decoded.payload_offset, captured, length);
+            }
+            if ((flags & TCP_FIN) && !half.fin)
+            {
+                half.fin = true;
+                half.fin_seq = seq + length;
+            }
+        }
+        HalfStream &peer = stream.halves[direction ^ 1];
+        if ((flags & TCP_ACK) && peer.synced)
+        {
+            std::uint32_t const ack = decode::load_be32(tcp + TCP_ACK_OFFSET);
+            if (!peer.acked_valid || seq_after_(ack, peer.acked))
+            {
+                peer.acked = ack;
+                peer.acked_valid = true;
+            }
+            // Every acknowledgement carries the receiver's current SACK blocks
+            peer.sack_count = parse_sacks_(packet, decoded, peer.sacks);
+        }
+        if (stream.ignored)
+        {
+            discard_(stream);
+            // Without bytes a direction closes with its FIN
+            for (HalfStream &ended : stream.halves)
+            {
+                ended.closed = ended.closed || ended.fin;
+            }
+        }
+        else
+        {
+            deliver_(stream, direction);
+            deliver_(stream, direction ^ 1);
+        }
+        if (stream.halves[0].closed && stream.halves[1].closed)
+        {
+            end_(stream, StreamEnd::Closed);
+        }
+    }
+
+    void TcpReassembler::expire(std::uint64_t const now_ns)
+    {
+        // The least recently used streams are the ones idle the longest
+        while (recent_.tail != NONE && streams_[recent_.tail].last_seen_ns + options_.idle_timeout_ns <= now_ns)
+        {
+            end_(streams_[recent_.tail], StreamEnd::IdleTimeout);
+        }
+    }
+
+    void TcpReassembler::flush()
+    {
+        while (recent_.head != NONE)
+        {
+            end_(streams_[recent_.head], StreamEnd::Flushed);
+        }
+    }
+
+    std::size_t TcpReassembler::get_streams() const noexcept
+    {
+        return active_;
+    }
+
+    std::size_t TcpReassembler::get_buffered_bytes() const noexcept
+    {
+        return pool_.in_use() * SEGMENT_SIZE;
+    }
+
+    ReassemblyCounters TcpReassembler::get_counters() const noexcept
+    {
+        return ReassemblyCounters{started_.load(), out_of_order_.load(), retransmitted_.load(),
+                                  overlapping_.load(), gaps_.load(),         evictions_.load()};
+    }
+
+    TcpReassembler::Stream *TcpReassembler::find_or_start_(core::FlowKey const &key, std::uint64_t const hash,
+                                                           std::uint8_t const direction, std::uint8_t const tcp_flags,
+                                                           bool const has_payload)
+    {
+        if (std::uint32_t const *const found = index_.find(key, hash))
+        {
+            return &streams_[*found];
+        }
+        // Only a handshake or data starts a stream, not the acknowledgements and resets trailing an ended one
+        if ((tcp_flags & TCP_RST) || (!(tcp_flags & TCP_SYN) && !has_payload))
+        {
+            return nullptr;
+        }
+        if (active_ == options_.max_streams)
+        {
+            evictions_.add(1);
+            end_(streams_[recent_.tail], StreamEnd::Evicted);
+        }
+        std::uint32_t *const slot = index_.insert(key, hash);
+        if (!slot)
+        {
+            return nullptr;
+        }
+        std::uint32_t index;
+        if (!free_streams_.empty())
+        {
+            index = free_streams_.back();
+            free_streams_.pop_back();
+        }
+        else
+        {
+            index = static_cast<std::uint32_t>(streams_.size());
+            streams_.emplace_back();
+        }
+        *slot = index;
+
+        Stream &stream = streams_[index];
+        stream = Stream{};
+        stream.info.key = key;
+        stream.info.id = index;
+        // A SYN-ACK comes from the side that did not open the connection
+        bool const reply = (tcp_flags & TCP_SYN) && (tcp_flags & TCP_ACK);
+        stream.info.initiator = reply ? direction ^ 1 : direction;
+        stream.info.offsets[0] = stream.info.offsets[1] = 0;
+        link_front_(recent_, &Stream::recent, index);
+        ++active_;
+        started_.add(1);
+        return &stream;
+    }
+
+    void TcpReassembler::end_(Stream &stream, StreamEnd const reason)
+    {
+        for (std::uint8_t direction = 0; direction < 2; ++direction)
+        {
+            HalfStream const &half = stream.halves[direction];
+            if (half.tail)
+            {
+                skip_to_(stream, direction, half.tail->seq + half.tail->size);
+            }
+        }
+        analyzer_.on_end(stream.info, reason);
+        update_buffering_(stream);
+        unlink_(recent_, &Stream::recent, stream.info.id);
+        index_.erase(stream.info.key);
+        free_streams_.push_back(stream.info.id);
+        --active_;
+    }
+
+    void TcpReassembler::add_data_(Stream &stream, std::uint8_t const direction, std::uint32_t seq, std::uint8_t const *data,
+                                   std::uint32_t captured, std::uint32_t length)
+    {
+        HalfStream &half = stream.halves[direction];
+        // A direction never buffers more than the window past its next byte
+        if (seq_after_(seq + captured, half.next_seq + options_.max_window))
+        {
+            skip_to_(stream, direction, seq + captured - options_.max_window);
+        }
+        // Drops the bytes delivered already, false if nothing is left
+        auto const trim = [this, &half, &seq, &data, &captured, &length]() {
+            if (!seq_before_(seq, half.next_seq))
+            {
+                return true;
+            }
+            std::uint32_t const delivered = std::min(half.next_seq - seq, captured);
+            retransmitted_.add(delivered);
+            seq += delivered;
+            data += delivered;
+            captured -= delivered;
+            length -= delivered;
+            return captured > 0;
+        };
+        if (!trim())
+        {
+            return;
+        }
+        if (seq != half.next_seq)
+        {
+            // Room for the copy comes from the buffers of other streams first, then from this stream's holes
+            std::size_t const needed = (captured + SEGMENT_CAPACITY - 1) / SEGMENT_CAPACITY;
+            while (pool_.available() < needed && evict_buffers_(stream))
+            {
+            }
+            if (pool_.available() >= needed && insert_(half, seq, data, captured))
+            {
+                out_of_order_.add(1);
+                update_buffering_(stream);
+                return;
+            }
+            evictions_.add(1);
+            skip_to_(stream, direction, seq);
+            if (!trim())
+            {
+                return;
+            }
+        }
+
+        // In order - delivered straight from the frame up to the first buffered byte
+        std::uint32_t direct = captured;
+        if (half.head && seq_before_(half.head->seq, seq + captured))
+        {
+            direct = half.head->seq - seq;
+        }
+        emit_data_(stream, direction, data, direct);
+        if (direct < captured)
+        {
+            // The overlap with the buffered bytes is resolved by the overlap policy
+            insert_(half, seq + direct, data + direct, captured - direct);
+            update_buffering_(stream);
+        }
+        else if (length > captured && !half.head)
+        {
+            // The end of the segment was cut by the snapshot length
+            emit_gap_(stream, direction, length - captured);
+        }
+    }
+
+    bool TcpReassembler::insert_(HalfStream &half, std::uint32_t const seq, std::uint8_t const *data, std::uint32_t const size)
+    {
+        std::uint32_t const end = seq + size;
+        Segment **link = &half.head;
+        // Segments mostly arrive in order behind the hole, append without walking the list
+        if (half.tail && !seq_before_(seq, half.tail->seq + half.tail->size))
+        {
+            link = &half.tail->next;
+        }
+        std::uint32_t current = seq;
+        while (seq_before_(current, end))
+        {
+            Segment *const segment = *link;
+            if (segment && !seq_after_(segment->seq + segment->size, current))
+            {
+                link = &segment->next;
+                continue;
+            }
+            if (segment && !seq_after_(segment->seq, current))
+            {
+                std::uint32_t const overlap_end =
+                    seq_before_(segment->seq + segment->size, end) ? segment->seq + segment->size : end;
+                std::uint32_t const overlap = overlap_end - current;
+                if (options_.overlap == OverlapPolicy::Last)
+                {
+                    std::memcpy(segment->data + (current - segment->seq), data + (current - seq), overlap);
+                }
+                overlapping_.add(overlap);
+                current = overlap_end;
+                link = &segment->next;
+                continue;
+            }
+            std::uint32_t const limit = segment && seq_before_(segment->seq, end) ? segment->seq : end;
+            std::uint32_t const chunk = std::min<std::uint32_t>(limit - current, SEGMENT_CAPACITY);
+            Segment *const added = pool_.allocate();
+            if (!added)
+            {
+                return false;
+            }
+            added->next = segment;
+            added->seq = current;
+            added->size = chunk;
+            std::memcpy(added->data, data + (current - seq), chunk);
+            *link = added;
+            if (!segment)
+            {
+                half.tail = added;
+            }
+            link = &added->next;
+            current += chunk;
+        }
+        return true;
+    }
+
+    void TcpReassembler::deliver_(Stream &stream, std::uint8_t const direction)
+    {
+        HalfStream &half = stream.halves[direction];
+        if (!half.synced || half.closed)
+        {
+            return;
+        }
+        for (;;)
+        {
+            Segment *const segment = half.head;
+            if (segment && !seq_after_(segment->seq, half.next_seq))
+            {
+                std::uint32_t const end = segment->seq + segment->size;
+                if (seq_after_(end, half.next_seq))
+                {
+                    emit_data_(stream, direction, segment->data + (half.next_seq - segment->seq), end - half.next_seq);
+                }
+                half.head = segment->next;
+                if (!half.head)
+                {
+                    half.tail = nullptr;
+                }
+                pool_.release(segment);
+                continue;
+            }
+            // A hole is skipped once the receiver acknowledged bytes past its start, the capture missed them
+            std::uint32_t limit = half.next_seq;
+            if (half.acked_valid && seq_after_(half.acked, limit))
+            {
+                limit = half.acked;
+            }
+            for (std::uint8_t i = 0; i < half.sack_count; ++i)
+            {
+                if (!seq_after_(half.sacks[i][0], half.next_seq) && seq_after_(half.sacks[i][1], limit))
+                {
+                    limit = half.sacks[i][1];
+                }
+            }
+            if (half.fin && seq_after_(limit, half.fin_seq))
+            {
+                limit = half.fin_seq;
+            }
+            if (segment && seq_before_(segment->seq, limit))
+            {
+                limit = segment->seq;
+            }
+            // Acknowledgements further ahead than the window are bogus
+            if (!seq_after_(limit, half.next_seq) || seq_after_(limit, half.next_seq + options_.max_window))
+            {
+                break;
+            }
+            emit_gap_(stream, direction, limit - half.next_seq);
+        }
+        if (half.fin && !seq_after_(half.fin_seq, half.next_seq))
+        {
+            half.closed = true;
+        }
+        update_buffering_(stream);
+    }
+
+    void TcpReassembler::skip_to_(Stream &stream, std::uint8_t const direction, std::uint32_t const seq)
+    {
+        HalfStream &half = stream.halves[direction];
+        while (seq_before_(half.next_seq, seq))
+        {
+            Segment *const segment = half.head;
+            if (!segment || !seq_before_(segment->seq, seq))
+            {
+                emit_gap_(stream, direction, seq - half.next_seq);
+                break;
+            }
+            if (seq_after_(segment->seq, half.next_seq))
+            {
+                emit_gap_(stream, direction, segment->seq - half.next_seq);
+            }
+            std::uint32_t const end = segment->seq + segment->size;
+            if (seq_after_(end, half.next_seq))
+            {
+                emit_data_(stream, direction, segment->data + (half.next_seq - segment->seq), end - half.next_seq);
+            }
+            half.head = segment->next;
+            if (!half.head)
+            {
+                half.tail = nullptr;
+            }
+            pool_.release(segment);
+        }
+        update_buffering_(stream);
+    }
+
+    void TcpReassembler::discard_(Stream &stream) noexcept
+    {
+        for (HalfStream &half : stream.halves)
+        {
+            while (Segment *const segment = half.head)
+            {
+                half.head = segment->next;
+                pool_.release(segment);
+            }
+            half.tail = nullptr;
+        }
+        update_buffering_(stream);
+    }
+
+    bool TcpReassembler::evict_buffers_(Stream const &keep)
+    {
+        std::uint32_t index = buffering_.tail;
+        if (index != NONE && index == keep.info.id)
+        {
+            index = streams_[index].buffering.prev;
+        }
+        if (index == NONE)
+        {
+            return false;
+        }
+        evictions_.add(1);
+        Stream &stream = streams_[index];
+        for (std::uint8_t direction = 0; direction < 2; ++direction)
+        {
+            HalfStream const &half = stream.halves[direction];
+            if (half.tail)
+            {
+                skip_to_(stream, direction, half.tail->seq + half.tail->size);
+                deliver_(stream, direction);
+            }
+        }
+        if (stream.halves[0].closed && stream.halves[1].closed)
+        {
+            end_(stream, StreamEnd::Closed);
+        }
+        return true;
+    }
+
+    void TcpReassembler::emit_data_(Stream &stream, std::uint8_t const direction, std::uint8_t const *data,
+                                    std::uint32_t const size)
+    {
+        if (size > 0 && !stream.ignored)
+        {
+            stream.ignored = !analyzer_.on_data(stream.info, direction, data, size);
+        }
+        stream.info.offsets[direction] += size;
+        stream.halves[direction].next_seq += size;
+    }
+
+    void TcpReassembler::emit_gap_(Stream &stream, std::uint8_t const direction, std::uint32_t const size)
+    {
+        gaps_.add(size);
+        if (!stream.ignored)
+        {
+            analyzer_.on_gap(stream.info, direction, size);
+        }
+        stream.info.offsets[direction] += size;
+        stream.halves[direction].next_seq += size;
+    }
+
+    void TcpReassembler::update_buffering_(Stream &stream) noexcept
+    {
+        bool const buffering = stream.halves[0].head || stream.halves[1].head;
+        if (buffering && !stream.is_buffering)
+        {
+            link_front_(buffering_, &Stream::buffering, stream.info.id);
+        }
+        else if (!buffering && stream.is_buffering)
+        {
+            unlink_(buffering_, &Stream::buffering, stream.info.id);
+        }
+        stream.is_buffering = buffering;
+    }
+
+    void TcpReassembler::link_front_(List &list, Links Stream::*const links, std::uint32_t const index) noexcept
+    {
+        Links &linked = streams_[index].*links;
+        linked.prev = NONE;
+        linked.next = list.head;
+        if (list.head != NONE)
+        {
+            (streams_[list.head].*links).prev = index;
+        }
+        list.head = index;
+        if (list.tail == NONE)
+        {
+            list.tail = index;
+        }
+    }
+
+    void TcpReassembler::unlink_(List &list, Links Stream::*const links, std::uint32_t const index) noexcept
+    {
+        Links &linked = streams_[index].*links;
+        if (linked.prev != NONE)
+        {
+            (streams_[linked.prev].*links).next = linked.next;
+        }
+        else
+        {
+            list.head = linked.next;
+        }
+        if (linked.next != NONE)
+        {
+            (streams_[linked.next].*links).prev = linked.prev;
+        }
+        else
+        {
+            list.tail = linked.prev;
+        }
+        linked.prev = linked.next = NONE;
+    }
+
+    ReassemblyStage::ReassemblyStage(std::unique_ptr<StreamAnalyzer> analyzer, ReassemblerOptions const &options)
+        : analyzer_{std::move(analyzer)}, reassembler_{*analyzer_, options}, streams_{}, buffered_bytes_{}
+    {
+    }
+
+    char const *ReassemblyStage::name() const noexcept
+    {
+        return "reassembly";
+    }
+
+    void ReassemblyStage::process(core::PacketBurst &burst)
+    {
+        for (std::size_t i = 0; i < burst.size; ++i)
+        {
+            if (!burst.has_flow[i] || !burst.decoded[i].has(decode::LAYER_TCP))
+            {
+                continue;
+            }
+            if (burst.src_targets[i] == core::LpmTable::NO_MATCH && burst.dst_targets[i] == core::LpmTable::NO_MATCH)
+            {
+                continue;
+            }
+            reassembler_.process(burst.packets[i], burst.decoded[i], burst.flow_keys[i], burst.flow_hashes[i],
+                                 burst.flow_directions[i]);
+        }
+        reassembler_.expire(burst.now_ns);
+        streams_.set(reassembler_.get_streams());
+        buffered_bytes_.set(reassembler_.get_buffered_bytes());
+    }
+
+    void ReassemblyStage::flush(core::PacketBurst &)
+    {
+        reassembler_.flush();
+        streams_.set(reassembler_.get_streams());
+        buffered_bytes_.set(reassembler_.get_buffered_bytes());
+    }
+
+    void ReassemblyStage::publish(stats::Registry &registry, stats::Labels const &labels,
+                                  std::vector<stats::Registration> &registrations) const
+    {
+        TcpReassembler const *const reassembler = &reassembler_;
+        registrations.push_back(registry.add("overwatch_tcp_streams_active", "TCP streams being reassembled",
+                                             stats::MetricType::Gauge, labels, [this]() { return streams_.load(); }));
+        registrations.push_back(registry.add("overwatch_tcp_reassembly_buffered_bytes", "Memory of the TCP bytes buffered ahead of holes",
+                                             stats::MetricType::Gauge, labels, [this]() { return buffered_bytes_.load(); }));
+        registrations.push_back(registry.add("overwatch_tcp_out_of_order_segments_total", "TCP segments buffered ahead of a hole",
+                                             stats::MetricType::Counter, labels,
+                                             [reassembler]() { return reassembler->get_counters().out_of_order; }));
+        registrations.push_back(registry.add("overwatch_tcp_retransmitted_bytes_total", "TCP bytes received again after their delivery",
+                                             stats::MetricType::Counter, labels,
+                                             [reassembler]() { return reassembler->get_counters().retransmitted; }));
+        registrations.push_back(registry.add("overwatch_tcp_gap_bytes_total", "TCP bytes skipped because they were never captured",
+                                             stats::MetricType::Counter, labels,
+                                             [reassembler]() { return reassembler->get_counters().gaps; }));
+        registrations.push_back(registry.add("overwatch_tcp_reassembly_evictions_total",
+                                             "TCP streams whose buffers were released or which were ended to free resources",
+                                             stats::MetricType::Counter, labels,
+                                             [reassembler]() { return reassembler->get_counters().evictions; }));
+        analyzer_->publish(registry, labels, registrations);
+    }
+
+    TcpReassembler const &ReassemblyStage::get_reassembler() const noexcept
+    {
+        return reassembler_;
+    }
+
+    StreamAnalyzer const &ReassemblyStage::get_analyzer() const noexcept
+    {
+        return *analyzer_;
+    }
+} // namespace overwatch::reassembly
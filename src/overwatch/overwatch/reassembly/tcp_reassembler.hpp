@@ -0,0 +1,380 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "decoder.hpp"
+#include "flow.hpp"
+#include "flow_table.hpp"
+#include "packet.hpp"
+#include "pipeline.hpp"
+#include "segment_pool.hpp"
+#include "stats_registry.hpp"
+
+namespace overwatch::reassembly
+{
+    /**
+     * Which bytes win when a segment overlaps bytes buffered before it
+     */
+    enum class OverlapPolicy : std::uint8_t
+    {
+        // The bytes received first are kept (BSD and Windows stacks)
+        First,
+        // The bytes received last replace them (Linux and Solaris stacks)
+        Last
+    };
+
+    /**
+     * Why a stream stopped being reassembled
+     */
+    enum class StreamEnd : std::uint8_t
+    {
+        // Both directions sent their FIN and every byte before it was delivered
+        Closed,
+        // Either side sent a RST
+        Reset,
+        // No segment for the idle timeout
+        IdleTimeout,
+        // The least recently used stream made room for a new one
+        Evicted,
+        // The reassembler was flushed
+        Flushed
+    };
+
+    struct ReassemblerOptions
+    {
+        // Streams tracked at once, the least recently used one is evicted for a new one
+        std::size_t max_streams = 65536;
+        // Memory of the bytes buffered ahead of holes across all streams
+        std::size_t max_memory = 64 << 20;
+        // Bytes a direction may buffer past a hole before the hole is skipped
+        std::uint32_t max_window = 1 << 20;
+        // Streams without a segment for this long are ended
+        std::uint64_t idle_timeout_ns = 120ULL * 1000 * 1000 * 1000;
+        OverlapPolicy overlap = OverlapPolicy::First;
+    };
+
+    /**
+     * A reassembled connection as seen by the analyzers
+     */
+    struct StreamInfo
+    {
+        // Canonical key of the connection (see core::canonicalize)
+        core::FlowKey key;
+        // Index of the stream below max_streams, reused once the stream ended
+        std::uint32_t id;
+        // Direction that sent the SYN, or of the first segment if the handshake was missed
+        std::uint8_t initiator;
+        // Bytes delivered or skipped so far per direction (the offset of the bytes being delivered)
+        std::uint64_t offsets[2];
+    };
+
+    /**
+     * Consumer of the reassembled bytes of the streams.
+     *
+     * Callbacks run on the worker feeding the reassembler and must not call back into it.
+     */
+    class StreamAnalyzer
+    {
+    public:
+        virtual ~StreamAnalyzer() = default;
+
+        /**
+         * Bytes of a direction of a stream, in order and without duplicates
+         *
+         * @param[in] stream The stream
+         * @param[in] direction Direction of the bytes (0: src -> dst of the key, 1: dst -> src)
+         * @param[in] data The bytes, only valid during the call
+         * @param[in] size Number of bytes
+         * @return False if the analyzer is done with the stream, its bytes are then no longer reassembled
+         */
+        virtual bool on_data(StreamInfo const &stream, std::uint8_t const direction, std::uint8_t const *data,
+                             std::size_t const size) = 0;
+
+        /**
+         * Bytes of a direction of a stream that were never captured and are skipped
+         *
+         * @param[in] stream The stream
+         * @param[in] direction Direction of the missing bytes
+         * @param[in] size Number of missing bytes
+         */
+        virtual void on_gap(StreamInfo const &stream, std::uint8_t const direction, std::size_t const size);
+
+        /**
+         * The stream ended, no more bytes will be delivered for it
+         *
+         * @param[in] stream The stream
+         * @param[in] reason Why the stream ended
+         */
+        virtual void on_end(StreamInfo const &stream, StreamEnd const reason);
+
+        /**
+         * Publishes the counters of the analyzer along with those of its stage (none by default)
+         *
+         * @param[in] registry The registry to publish to
+         * @param[in] labels Labels of the worker owning the stage
+         * @param[out] registrations Receives the registrations (they must not outlive the analyzer)
+         */
+        virtual void publish(stats::Registry &registry, stats::Labels const &labels,
+                             std::vector<stats::Registration> &registrations) const;
+    };
+
+    // Analyzers a stream can be handed to at once
+    constexpr std::size_t MAX_CHAINED_ANALYZERS = 8;
+
+    /**
+     * Hands the streams to several analyzers in turn.
+     *
+     * A stream stays reassembled while any of the analyzers wants more of it, an analyzer done
+     * with a stream gets nothing but its end.
+     */
+    class AnalyzerChain : public StreamAnalyzer
+    {
+    public:
+        /**
+         * @param[in] analyzers The analyzers, called in this order
+         * @throw std::invalid_argument If there is no analyzer or more than MAX_CHAINED_ANALYZERS
+         */
+        explicit AnalyzerChain(std::vector<std::unique_ptr<StreamAnalyzer>> analyzers);
+
+        bool on_data(StreamInfo const &stream, std::uint8_t const direction, std::uint8_t const *data,
+                     std::size_t const size) override;
+        void on_gap(StreamInfo const &stream, std::uint8_t const direction, std::size_t const size) override;
+        void on_end(StreamInfo const &stream, StreamEnd const reason) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        std::vector<std::unique_ptr<StreamAnalyzer>> const &get_analyzers() const noexcept;
+
+    private:
+        std::vector<std::unique_ptr<StreamAnalyzer>> const analyzers_;
+        // Indexed by stream ID, one bit per analyzer done with the stream
+        std::vector<std::uint8_t> done_;
+    };
+
+    struct ReassemblyCounters
+    {
+        // Streams started
+        std::uint64_t streams = 0;
+        // Segments buffered because they arrived ahead of a hole
+        std::uint64_t out_of_order = 0;
+        // Bytes received again after they were delivered
+        std::uint64_t retransmitted = 0;
+        // Bytes received again while they were buffered
+        std::uint64_t overlapping = 0;
+        // Bytes skipped because they were never captured
+        std::uint64_t gaps = 0;
+        // Streams whose buffered bytes were released or which were ended to free resources
+        std::uint64_t evictions = 0;
+    };
+
+    /**
+     * Reassembles the TCP streams of a worker into contiguous bytes per direction.
+     *
+     * Segments arriving in order are handed to the analyzer straight from the frame without
+     * copying. Segments arriving ahead of a hole are copied into pooled segments, sorted per
+     * direction and delivered once the hole is filled. A hole is skipped (and reported as a
+     * gap) when the receiver acknowledges bytes past it, cumulatively or through a SACK block,
+     * since the capture then missed bytes the host did receive, or when the direction buffers
+     * more than the window. When the pool runs out the buffered bytes of the least recently
+     * used streams are released with their holes skipped, so memory stays under the cap
+     * without dropping captured bytes. Once the analyzer is done with a stream its segments
+     * are no longer looked at beyond the TCP flags.
+     */
+    class TcpReassembler
+    {
+    public:
+        /**
+         * Creates a reassembler without streams
+         *
+         * @param[in] analyzer Consumer of the reassembled bytes (must outlive the reassembler)
+         * @param[in] options Limits and policies of the reassembly
+         * @throw std::invalid_argument If a limit is zero or the memory does not hold a single slab
+         */
+        explicit TcpReassembler(StreamAnalyzer &analyzer, ReassemblerOptions const &options = ReassemblerOptions{});
+        ~TcpReassembler();
+
+        TcpReassembler(TcpReassembler const &) = delete;
+        TcpReassembler &operator=(TcpReassembler const &) = delete;
+
+        /**
+         * Feeds a TCP segment
+         *
+         * @param[in] packet The frame
+         * @param[in] decoded The decoded headers of the frame (must have a TCP layer)
+         * @param[in] key Canonical key of the segment's flow
+         * @param[in] hash Hash of the key
+         * @param[in] direction Direction of the segment within the flow (0: src -> dst of the key, 1: dst -> src)
+         */
+        void process(capture::PacketView const &packet, decode::DecodedPacket const &decoded, core::FlowKey const &key,
+                     std::uint64_t const hash, std::uint8_t const direction);
+
+        /**
+         * Ends the streams idle since before the timeout
+         *
+         * @param[in] now_ns The current time
+         */
+        void expire(std::uint64_t const now_ns);
+
+        /**
+         * Ends every stream, delivering the buffered bytes and skipping their holes
+         */
+        void flush();
+
+        /**
+         * Number of streams being reassembled
+         * @return The number of streams
+         */
+        std::size_t get_streams() const noexcept;
+
+        /**
+         * Memory held by the bytes buffered ahead of holes
+         * @return The buffered bytes, segment headers and slack included
+         */
+        std::size_t get_buffered_bytes() const noexcept;
+
+        ReassemblyCounters get_counters() const noexcept;
+
+    private:
+        static constexpr std::uint32_t NONE = UINT32_MAX;
+
+        struct HalfStream
+        {
+            // Buffered segments sorted by sequence number, none of them starts at or before next_seq
+            Segment *head = nullptr;
+            Segment *tail = nullptr;
+            // Sequence number of the next byte to deliver
+            std::uint32_t next_seq = 0;
+            std::uint32_t fin_seq = 0;
+            // Highest cumulative acknowledgement and the SACK blocks of the last acknowledgement of the peer
+            std::uint32_t acked = 0;
+            std::uint32_t sacks[4][2] = {};
+            std::uint8_t sack_count = 0;
+            bool synced = false;
+            bool acked_valid = false;
+            bool fin = false;
+            // Every byte up to the FIN was delivered
+            bool closed = false;
+        };
+
+        struct Links
+        {
+            std::uint32_t prev = NONE;
+            std::uint32_t next = NONE;
+        };
+
+        struct List
+        {
+            std::uint32_t head = NONE;
+            std::uint32_t tail = NONE;
+        };
+
+        struct Stream
+        {
+            StreamInfo info;
+            HalfStream halves[2];
+            std::uint64_t last_seen_ns = 0;
+            // Position in the list of all streams and, while holding segments, in the list of buffering streams
+            Links recent;
+            Links buffering;
+            bool is_buffering = false;
+            // The analyzer is done with the stream, only its end is still tracked
+            bool ignored = false;
+        };
+
+        // Finds the stream of a key or starts one, nullptr if no stream can be started
+        Stream *find_or_start_(core::FlowKey const &key, std::uint64_t const hash, std::uint8_t const direction,
+                               std::uint8_t const tcp_flags, bool const has_payload);
+        // Ends a stream after delivering its buffered bytes
+        void end_(Stream &stream, StreamEnd const reason);
+        // Adds the payload of a segment to a direction
+        void add_data_(Stream &stream, std::uint8_t const direction, std::uint32_t seq, std::uint8_t const *data,
+                       std::uint32_t captured, std::uint32_t length);
+        // Buffers bytes ahead of a hole, returns false if the pool ran out
+        bool insert_(HalfStream &half, std::uint32_t const seq, std::uint8_t const *data, std::uint32_t const size);
+        // Delivers the buffered bytes that became contiguous and skips the holes the peer acknowledged
+        void deliver_(Stream &stream, std::uint8_t const direction);
+        // Delivers the buffered bytes below a sequence number, skipping the holes in between
+        void skip_to_(Stream &stream, std::uint8_t const direction, std::uint32_t const seq);
+        // Drops the buffered bytes of a stream without delivering them
+        void discard_(Stream &stream) noexcept;
+        // Releases the buffered bytes of the least recently used buffering stream other than the given one
+        bool evict_buffers_(Stream const &keep);
+        // Delivers bytes or a gap to the analyzer and advances the direction
+        void emit_data_(Stream &stream, std::uint8_t const direction, std::uint8_t const *data, std::uint32_t const size);
+        void emit_gap_(Stream &stream, std::uint8_t const direction, std::uint32_t const size);
+        // Updates the membership of a stream in the list of buffering streams
+        void update_buffering_(Stream &stream) noexcept;
+
+        void link_front_(List &list, Links Stream::*links, std::uint32_t const index) noexcept;
+        void unlink_(List &list, Links Stream::*links, std::uint32_t const index) noexcept;
+
+        StreamAnalyzer &analyzer_;
+        ReassemblerOptions const options_;
+        SegmentPool pool_;
+        core::FlowTable<std::uint32_t> index_;
+        std::vector<Stream> streams_;
+        std::vector<std::uint32_t> free_streams_;
+        // Most recently used first
+        List recent_;
+        List buffering_;
+        std::size_t active_;
+        stats::Counter started_;
+        stats::Counter out_of_order_;
+        stats::Counter retransmitted_;
+        stats::Counter overlapping_;
+        stats::Counter gaps_;
+        stats::Counter evictions_;
+    };
+
+    /**
+     * Reassembles the TCP streams to or from a target (needs the classify and flow stages before it)
+     */
+    class ReassemblyStage : public core::Stage
+    {
+    public:
+        /**
+         * @param[in] analyzer Consumer of the reassembled bytes
+         * @param[in] options Limits and policies of the reassembly
+         * @throw std::invalid_argument If the options are invalid
+         */
+        explicit ReassemblyStage(std::unique_ptr<StreamAnalyzer> analyzer, ReassemblerOptions const &options = ReassemblerOptions{});
+
+        char const *name() const noexcept override;
+        void process(core::PacketBurst &burst) override;
+        void flush(core::PacketBurst &burst) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        TcpReassembler const &get_reassembler() const noexcept;
+        StreamAnalyzer const &get_analyzer() const noexcept;
+
+    private:
+        std::unique_ptr<StreamAnalyzer> const analyzer_;
+        TcpReassembler reassembler_;
+        // Read by the stats reporter
+        stats::Counter streams_;
+        stats::Counter buffered_bytes_;
+    };
+} // namespace overwatch::reassembly
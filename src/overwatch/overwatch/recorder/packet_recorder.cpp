@@ -0,0 +1,426 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include "logging.hpp"
+#include "packet_recorder.hpp"
+#include "pcap_writer.hpp"
+
+// Link type of Ethernet captures
+#define LINK_TYPE_ETHERNET 1
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+namespace
+{
+    /**
+     * Name of a capture file
+     *
+     * @param[in] worker_id Id of the worker writing the file
+     * @param[in] timestamp_ns Capture time of the first frame
+     * @param[in] sequence Number of the file within the worker's series
+     * @return The file name
+     */
+    std::string file_name_(std::uint32_t const worker_id, std::uint64_t const timestamp_ns, std::uint64_t const sequence)
+    {
+        std::time_t const seconds = static_cast<std::time_t>(timestamp_ns / NANOSECONDS_PER_SECOND);
+        std::tm time{};
+        gmtime_r(&seconds, &time);
+        char formatted[32];
+        std::strftime(formatted, sizeof(formatted), "%Y%m%dT%H%M%S", &time);
+        return "overwatch-" + std::to_string(worker_id) + "-" + formatted + "-" + std::to_string(sequence) + ".pcap";
+    }
+} // namespace
+
+namespace overwatch::recorder
+{
+    PacketRecorder::PacketRecorder(std::filesystem::path directory, RecorderOptions const &options)
+        : directory_{std::move(directory)}, options_{options}, files_{}, bytes_{}, errors_{},
+          writer_{[this](Buffer &buffer) { write_(buffer); }, [](Buffer &buffer) { buffer.owner->free_.push_back(&buffer); }}
+    {
+        if (options_.buffer_size == 0 || options_.buffer_size % RECORD_ALIGNMENT != 0)
+        {
+            throw std::invalid_argument{"Recording buffers must be a multiple of " + std::to_string(RECORD_ALIGNMENT) + " bytes"};
+        }
+        // A frame spans at most two buffers
+        if (options_.buffers < 2 || options_.buffer_size < sizeof(capture::PcapRecordHeader) + options_.snaplen)
+        {
+            throw std::invalid_argument{"Every worker needs at least two recording buffers larger than a frame"};
+        }
+        if (options_.max_file_size == 0 || options_.max_file_age_ns == 0)
+        {
+            throw std::invalid_argument{"Recorded files must be rotated after a non-zero size and age"};
+        }
+        if (std::filesystem::exists(directory_) && !std::filesystem::is_directory(directory_))
+        {
+            throw std::invalid_argument{"'" + directory_.string() + "' is not a valid recording directory"};
+        }
+        LOG_DEBUG << "Creating directories for " << directory_.string();
+        std::filesystem::create_directories(directory_);
+        writer_.start();
+    }
+
+    PacketRecorder::~PacketRecorder()
+    {
+        stop();
+    }
+
+    std::unique_ptr<RecordChannel> PacketRecorder::open_channel(std::uint32_t const worker_id)
+    {
+        return std::make_unique<RecordChannel>(*this, worker_id);
+    }
+
+    void PacketRecorder::stop() noexcept
+    {
+        writer_.stop();
+    }
+
+    RecorderCounters PacketRecorder::get_counters() const noexcept
+    {
+        return RecorderCounters{files_.load(), bytes_.load(), errors_.load()};
+    }
+
+    std::filesystem::path const &PacketRecorder::get_directory() const noexcept
+    {
+        return directory_;
+    }
+
+    PacketRecorder::Buffer *PacketRecorder::acquire_(RecordChannel &channel) noexcept
+    {
+        Buffer *const buffer = writer_.locked([&channel]() -> Buffer * {
+            if (channel.free_.empty())
+            {
+                return nullptr;
+            }
+            Buffer *const free = channel.free_.back();
+            channel.free_.pop_back();
+            return free;
+        });
+        if (!buffer)
+        {
+            return nullptr;
+        }
+        buffer->size = 0;
+        buffer->opens_file.clear();
+        buffer->closes_file = false;
+        return buffer;
+    }
+
+#ifdef __linux__
+    namespace
+    {
+        // Ends a file, cutting the padding of its last direct write
+        void close_record_file_(RecordFile &state) noexcept
+        {
+            if (state.fd < 0)
+            {
+                return;
+            }
+            if (state.direct && ftruncate(state.fd, static_cast<off_t>(state.offset)) != 0)
+            {
+                LOG_WARNING << "Failed to truncate '" << state.path.string() << "' - " << std::strerror(errno);
+            }
+            close(state.fd);
+            state.fd = -1;
+        }
+    } // namespace
+
+    void PacketRecorder::write_(Buffer &buffer) noexcept
+    {
+        RecordFile &state = buffer.owner->file_;
+        if (!buffer.opens_file.empty())
+        {
+            close_record_file_(state);
+            state.path = directory_ / buffer.opens_file;
+            state.offset = 0;
+            // Direct I/O bypasses the page cache, so a slow disk never stalls on dirty page writeback
+            state.direct = true;
+            state.fd = open(state.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+            if (state.fd < 0 && errno == EINVAL)
+            {
+                state.direct = false;
+                state.fd = open(state.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            }
+            if (state.fd < 0)
+            {
+                if (errors_.load() == 0)
+                {
+                    LOG_ERROR << "Failed to create '" << state.path.string() << "' - " << std::strerror(errno);
+                }
+                errors_.add(1);
+                return;
+            }
+            files_.add(1);
+            LOG_DEBUG << "Recording to '" << state.path.string() << "'" << (state.direct ? " (direct I/O)" : "");
+        }
+        if (state.fd >= 0 && buffer.size > 0)
+        {
+            std::size_t length = buffer.size;
+            if (state.direct)
+            {
+                // Only the last buffer of a file is partial - its padding is cut when the file is closed
+                length = (buffer.size + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+                std::memset(buffer.data.get() + buffer.size, 0, length - buffer.size);
+            }
+            for (std::size_t written = 0; written < length;)
+            {
+                ssize_t const result = ::write(state.fd, buffer.data.get() + written, length - written);
+                if (result < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (result < 0 && errno == EINVAL && state.direct && written == 0)
+                {
+                    // The file system accepted O_DIRECT on open but not the write
+                    fcntl(state.fd, F_SETFL, fcntl(state.fd, F_GETFL) & ~O_DIRECT);
+                    state.direct = false;
+                    length = buffer.size;
+                    continue;
+                }
+                if (result <= 0)
+                {
+                    if (errors_.load() == 0)
+                    {
+                        LOG_ERROR << "Failed to write '" << state.path.string() << "' - " << std::strerror(errno);
+                    }
+                    errors_.add(1);
+                    // The rest of the file is lost, it would not be a valid capture anymore
+                    state.offset += written;
+                    close_record_file_(state);
+                    return;
+                }
+                written += static_cast<std::size_t>(result);
+            }
+            state.offset += buffer.size;
+            bytes_.add(buffer.size);
+        }
+        if (buffer.closes_file)
+        {
+            close_record_file_(state);
+        }
+    }
+#else
+    namespace
+    {
+        void close_record_file_(RecordFile &) noexcept
+        {
+        }
+    } // namespace
+
+    void PacketRecorder::write_(Buffer &) noexcept
+    {
+        if (errors_.load() == 0)
+        {
+            LOG_ERROR << "Recording packets is only supported on Linux";
+        }
+        errors_.add(1);
+    }
+#endif
+
+    RecordChannel::RecordChannel(PacketRecorder &recorder, std::uint32_t const worker_id)
+        : recorder_{recorder}, worker_id_{worker_id}, buffers_(recorder.options_.buffers), free_{}, current_{nullptr},
+          spare_{nullptr}, file_open_{false}, file_start_ns_{0}, file_size_{0}, file_sequence_{0}, file_{},
+          packets_{}, drops_{}
+    {
+        for (PacketRecorder::Buffer &buffer : buffers_)
+        {
+            buffer.data.reset(static_cast<std::uint8_t *>(std::aligned_alloc(RECORD_ALIGNMENT, recorder_.options_.buffer_size)));
+            if (!buffer.data)
+            {
+                throw std::bad_alloc{};
+            }
+            // Touched now so that the capture path never takes a page fault on them
+            std::memset(buffer.data.get(), 0, recorder_.options_.buffer_size);
+            buffer.owner = this;
+            free_.push_back(&buffer);
+        }
+    }
+
+    RecordChannel::~RecordChannel()
+    {
+        recorder_.writer_.wait([this]() { return free_.size() + (current_ ? 1 : 0) + (spare_ ? 1 : 0) == buffers_.size(); });
+        close_record_file_(file_);
+    }
+
+    bool RecordChannel::record(capture::PacketView const &packet)
+    {
+        std::uint32_t const caplen = std::min(packet.caplen, recorder_.options_.snaplen);
+        std::size_t const record_size = sizeof(capture::PcapRecordHeader) + caplen;
+        if (file_open_ && file_size_ > sizeof(capture::PcapFileHeader) &&
+            (file_size_ + record_size > recorder_.options_.max_file_size ||
+             packet.timestamp_ns >= file_start_ns_ + recorder_.options_.max_file_age_ns))
+        {
+            close_file_();
+        }
+        if (!file_open_ && !open_file_(packet.timestamp_ns))
+        {
+            drops_.add(1);
+            return false;
+        }
+        // The frame must fit into the current buffer, or continue in a spare one
+        if (!current_)
+        {
+            current_ = recorder_.acquire_(*this);
+        }
+        if (current_ && !spare_ && current_->size + record_size > recorder_.options_.buffer_size)
+        {
+            spare_ = recorder_.acquire_(*this);
+        }
+        if (!current_ || (!spare_ && current_->size + record_size > recorder_.options_.buffer_size))
+        {
+            drops_.add(1);
+            return false;
+        }
+        capture::PcapRecordHeader const header = capture::make_pcap_record_header(packet, caplen);
+        append_(&header, sizeof(header));
+        append_(packet.data, caplen);
+        file_size_ += record_size;
+        packets_.add(1);
+        return true;
+    }
+
+    void RecordChannel::poll(std::uint64_t const now_ns) noexcept
+    {
+        if (file_open_ && now_ns >= file_start_ns_ + recorder_.options_.max_file_age_ns)
+        {
+            close_file_();
+        }
+    }
+
+    void RecordChannel::flush() noexcept
+    {
+        close_file_();
+    }
+
+    std::uint64_t RecordChannel::get_packets() const noexcept
+    {
+        return packets_.load();
+    }
+
+    std::uint64_t RecordChannel::get_drops() const noexcept
+    {
+        return drops_.load();
+    }
+
+    bool RecordChannel::open_file_(std::uint64_t const timestamp_ns)
+    {
+        if (!current_)
+        {
+            current_ = spare_ ? spare_ : recorder_.acquire_(*this);
+            spare_ = current_ == spare_ ? nullptr : spare_;
+        }
+        if (!current_)
+        {
+            return false;
+        }
+        current_->opens_file = file_name_(worker_id_, timestamp_ns, file_sequence_++);
+        capture::PcapFileHeader const header{PCAP_MAGIC_NSEC, PCAP_VERSION_MAJOR, PCAP_VERSION_MINOR, 0, 0,
+                                             recorder_.options_.snaplen, LINK_TYPE_ETHERNET};
+        append_(&header, sizeof(header));
+        file_open_ = true;
+        file_start_ns_ = timestamp_ns;
+        file_size_ = sizeof(header);
+        return true;
+    }
+
+    void RecordChannel::close_file_() noexcept
+    {
+        if (!file_open_)
+        {
+            return;
+        }
+        file_open_ = false;
+        // Without a partial buffer the file is closed when the worker's next file is opened
+        if (current_)
+        {
+            current_->closes_file = true;
+            recorder_.writer_.submit(*current_);
+            current_ = nullptr;
+        }
+    }
+
+    void RecordChannel::append_(void const *data, std::size_t size) noexcept
+    {
+        std::uint8_t const *bytes = static_cast<std::uint8_t const *>(data);
+        while (size > 0)
+        {
+            std::size_t const length = std::min(size, recorder_.options_.buffer_size - current_->size);
+            std::memcpy(current_->data.get() + current_->size, bytes, length);
+            current_->size += length;
+            bytes += length;
+            size -= length;
+            if (current_->size == recorder_.options_.buffer_size)
+            {
+                recorder_.writer_.submit(*current_);
+                current_ = spare_;
+                spare_ = nullptr;
+            }
+        }
+    }
+
+    RecordStage::RecordStage(std::unique_ptr<RecordChannel> channel)
+        : channel_{std::move(channel)}
+    {
+    }
+
+    char const *RecordStage::name() const noexcept
+    {
+        return "record";
+    }
+
+    void RecordStage::process(core::PacketBurst &burst)
+    {
+        for (std::size_t i = 0; i < burst.size; ++i)
+        {
+            if (burst.src_targets[i] != core::LpmTable::NO_MATCH || burst.dst_targets[i] != core::LpmTable::NO_MATCH)
+            {
+                channel_->record(burst.packets[i]);
+            }
+        }
+        channel_->poll(burst.now_ns);
+    }
+
+    void RecordStage::flush(core::PacketBurst &)
+    {
+        channel_->flush();
+    }
+
+    void RecordStage::publish(stats::Registry &registry, stats::Labels const &labels,
+                              std::vector<stats::Registration> &registrations) const
+    {
+        RecordChannel const *const channel = channel_.get();
+        registrations.push_back(registry.add("overwatch_recorded_packets_total", "Frames written to the capture files",
+                                             stats::MetricType::Counter, labels, [channel]() { return channel->get_packets(); }));
+        registrations.push_back(registry.add("overwatch_record_drops_total", "Frames not recorded because no buffer was free",
+                                             stats::MetricType::Counter, labels, [channel]() { return channel->get_drops(); }));
+    }
+
+    RecordChannel const &RecordStage::get_channel() const noexcept
+    {
+        return *channel_;
+    }
+} // namespace overwatch::recorder
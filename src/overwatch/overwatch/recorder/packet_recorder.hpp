@@ -0,0 +1,275 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "buffer_writer.hpp"
+#include "packet.hpp"
+#include "pipeline.hpp"
+#include "stats_registry.hpp"
+
+// Alignment of the buffers, their sizes and the file offsets required by direct I/O
+#define RECORD_ALIGNMENT 4096
+
+namespace overwatch::recorder
+{
+    /**
+     * Rotation and buffering of the recorded capture files
+     */
+    struct RecorderOptions
+    {
+        // A file is closed before it grows beyond this size
+        std::uint64_t max_file_size = 128ULL << 20;
+        // A file is closed once its first packet is this old (in capture time)
+        std::uint64_t max_file_age_ns = 300ULL * 1000 * 1000 * 1000;
+        // Size of every buffer (a multiple of RECORD_ALIGNMENT)
+        std::size_t buffer_size = 4 << 20;
+        // Buffers preallocated for every worker
+        std::size_t buffers = 4;
+        // Frames are cut to this many bytes
+        std::uint32_t snaplen = 65535;
+    };
+
+    /**
+     * Totals of a recorder
+     */
+    struct RecorderCounters
+    {
+        // Capture files created and bytes written to them
+        std::uint64_t files = 0;
+        std::uint64_t bytes = 0;
+        // Buffers that could not be written
+        std::uint64_t errors = 0;
+    };
+
+    class RecordChannel;
+
+    /**
+     * Capture file a channel's buffers are written to
+     */
+    struct RecordFile
+    {
+        int fd = -1;
+        std::filesystem::path path;
+        // Bytes of frames written (without the padding of direct I/O)
+        std::uint64_t offset = 0;
+        bool direct = false;
+    };
+
+    /**
+     * Writes the frames of every worker to rolling pcap files in a directory.
+     *
+     * Every worker copies its frames into preallocated, page aligned buffers of its own
+     * channel. Full buffers are handed to a single writer thread which writes them with
+     * direct I/O (falling back to buffered writes where the file system does not support
+     * it), so the page cache never makes a worker wait on the disk. A worker that runs
+     * out of free buffers drops frames rather than block.
+     *
+     * Every worker writes its own series of files, named after the worker, the capture
+     * time of the first frame and a sequence number, e.g. overwatch-0-20240101T120000-3.pcap.
+     */
+    class PacketRecorder
+    {
+    public:
+        /**
+         * Creates the directory and starts the writer thread
+         *
+         * @param[in] directory Directory of the capture files (created if missing)
+         * @param[in] options Rotation and buffering of the files
+         * @throw std::invalid_argument If the directory is a file or the options are invalid
+         * @throw std::filesystem::filesystem_error If the directory cannot be created
+         */
+        explicit PacketRecorder(std::filesystem::path directory, RecorderOptions const &options = RecorderOptions{});
+        ~PacketRecorder();
+
+        PacketRecorder(PacketRecorder const &) = delete;
+        PacketRecorder &operator=(PacketRecorder const &) = delete;
+
+        /**
+         * Opens the channel of a worker and preallocates its buffers
+         *
+         * @param[in] worker_id Id of the worker, part of the file names
+         * @return The channel (must not outlive the recorder)
+         */
+        std::unique_ptr<RecordChannel> open_channel(std::uint32_t const worker_id);
+        /**
+         * Writes the buffers handed over so far and stops the writer thread
+         *
+         * The channels must be flushed before, later buffers are dropped.
+         */
+        void stop() noexcept;
+        /**
+         * Totals of the recorder
+         * @return The counters
+         */
+        RecorderCounters get_counters() const noexcept;
+        /**
+         * Directory of the capture files
+         * @return The directory
+         */
+        std::filesystem::path const &get_directory() const noexcept;
+
+    private:
+        friend class RecordChannel;
+
+        struct FreeDeleter
+        {
+            void operator()(std::uint8_t *data) const noexcept { std::free(data); }
+        };
+
+        // Buffer of a channel, owned by the writer thread while in flight
+        struct Buffer
+        {
+            std::unique_ptr<std::uint8_t[], FreeDeleter> data;
+            std::size_t size = 0;
+            // Name of the file starting with this buffer (empty if it continues the open file)
+            std::string opens_file;
+            // Whether the file ends with this buffer
+            bool closes_file = false;
+            RecordChannel *owner = nullptr;
+        };
+
+        // Takes a free buffer of a channel, returns nullptr if there is none
+        Buffer *acquire_(RecordChannel &channel) noexcept;
+        // Writes a buffer to the file of its channel, on the writer thread
+        void write_(Buffer &buffer) noexcept;
+
+        std::filesystem::path const directory_;
+        RecorderOptions const options_;
+        stats::Counter files_;
+        stats::Counter bytes_;
+        stats::Counter errors_;
+        // Last, so that its thread stops before the rest goes away
+        core::BufferWriter<Buffer> writer_;
+    };
+
+    /**
+     * Rolling capture files of a single worker
+     */
+    class RecordChannel
+    {
+    public:
+        /**
+         * Creates the channel, use PacketRecorder::open_channel
+         *
+         * @param[in] recorder The recorder writing the buffers
+         * @param[in] worker_id Id of the worker
+         */
+        RecordChannel(PacketRecorder &recorder, std::uint32_t const worker_id);
+        ~RecordChannel();
+
+        RecordChannel(RecordChannel const &) = delete;
+        RecordChannel &operator=(RecordChannel const &) = delete;
+
+        /**
+         * Copies a frame into the current file, rotating the file first if needed
+         *
+         * @param[in] packet The frame
+         * @return False if the frame was dropped because no buffer was free
+         */
+        bool record(capture::PacketView const &packet);
+        /**
+         * Closes the current file if it is older than the rotation age
+         *
+         * @param[in] now_ns Current capture time, also given by the idle ticks of the worker
+         */
+        void poll(std::uint64_t const now_ns) noexcept;
+        /**
+         * Closes the current file and hands its last buffer over to the writer thread
+         */
+        void flush() noexcept;
+        /**
+         * Number of frames recorded
+         * @return The number of frames
+         */
+        std::uint64_t get_packets() const noexcept;
+        /**
+         * Number of frames dropped because the writer thread could not keep up
+         * @return The number of frames
+         */
+        std::uint64_t get_drops() const noexcept;
+
+    private:
+        friend class PacketRecorder;
+
+        // Starts a new file with its pcap header
+        bool open_file_(std::uint64_t const timestamp_ns);
+        // Ends the current file
+        void close_file_() noexcept;
+        // Copies bytes into the current buffer, continuing in the spare buffer when it is full
+        void append_(void const *data, std::size_t size) noexcept;
+
+        PacketRecorder &recorder_;
+        std::uint32_t const worker_id_;
+        std::vector<PacketRecorder::Buffer> buffers_;
+        // Buffers not in flight and not in use, protected by the lock of the recorder's writer
+        std::vector<PacketRecorder::Buffer *> free_;
+        // Buffer being filled and the one taken to continue a frame that does not fit
+        PacketRecorder::Buffer *current_;
+        PacketRecorder::Buffer *spare_;
+        bool file_open_;
+        std::uint64_t file_start_ns_;
+        std::uint64_t file_size_;
+        std::uint64_t file_sequence_;
+        // Only touched by the writer thread
+        RecordFile file_;
+        stats::Counter packets_;
+        stats::Counter drops_;
+    };
+
+    /**
+     * Records the frames sent from or to any target
+     *
+     * Every burst also closes a file past the rotation age, including the empty bursts of the
+     * idle ticks, so that a file is complete on disk soon after the traffic stops.
+     */
+    class RecordStage : public core::Stage
+    {
+    public:
+        /**
+         * Creates the stage, it must follow the classify stage
+         *
+         * @param[in] channel Channel of the worker
+         */
+        explicit RecordStage(std::unique_ptr<RecordChannel> channel);
+
+        char const *name() const noexcept override;
+        void process(core::PacketBurst &burst) override;
+        void flush(core::PacketBurst &burst) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        /**
+         * Channel of the worker
+         * @return The channel
+         */
+        RecordChannel const &get_channel() const noexcept;
+
+    private:
+        std::unique_ptr<RecordChannel> const channel_;
+    };
+} // namespace overwatch::recorder
@@ -0,0 +1,309 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "automaton.hpp"
+
+// The prefilter is not used if more than this share of random positions would be candidates
+#define PREFILTER_MAX_CANDIDATE_RATE 0.1
+
+namespace
+{
+    /**
+     * Lowercases an ASCII letter
+     *
+     * @param[in] byte The byte
+     * @return The lowercase letter or the byte unchanged
+     */
+    std::uint8_t fold_case_(std::uint8_t const byte) noexcept
+    {
+        return byte >= 'A' && byte <= 'Z' ? static_cast<std::uint8_t>(byte + ('a' - 'A')) : byte;
+    }
+
+    /**
+     * Bytes matching a byte of a literal
+     *
+     * @param[in] byte The byte
+     * @param[in] nocase True if either case of a letter matches
+     * @return The byte and, ignoring case, its other case
+     */
+    overwatch::rules::ByteSet literal_byte_(std::uint8_t const byte, bool const nocase) noexcept
+    {
+        overwatch::rules::ByteSet bytes;
+        bytes.set(byte);
+        if (nocase && fold_case_(byte) >= 'a' && fold_case_(byte) <= 'z')
+        {
+            bytes.set(fold_case_(byte));
+            bytes.set(fold_case_(byte) - ('a' - 'A'));
+        }
+        return bytes;
+    }
+} // namespace
+
+namespace overwatch::rules
+{
+    DfaDefinition build_literal_dfa(std::vector<Literal> const &literals, bool const nocase)
+    {
+        std::array<bool, 256> used{};
+        for (Literal const &literal : literals)
+        {
+            if (literal.bytes.empty())
+            {
+                throw std::invalid_argument{"Literals must not be empty"};
+            }
+            for (char const byte : literal.bytes)
+            {
+                std::uint8_t const value = static_cast<std::uint8_t>(byte);
+                used[nocase ? fold_case_(value) : value] = true;
+            }
+        }
+
+        // Every byte of a literal has its own class, the others share the last one
+        DfaDefinition dfa;
+        std::array<std::uint8_t, 256> folded_classes{};
+        std::size_t used_count = 0;
+        for (std::size_t byte = 0; byte < 256; ++byte)
+        {
+            if (used[byte])
+            {
+                folded_classes[byte] = static_cast<std::uint8_t>(used_count++);
+            }
+        }
+        dfa.class_count = used_count + (used_count < 256 ? 1 : 0);
+        for (std::size_t byte = 0; byte < 256; ++byte)
+        {
+            std::uint8_t const folded = nocase ? fold_case_(static_cast<std::uint8_t>(byte)) : static_cast<std::uint8_t>(byte);
+            dfa.classes[byte] = used[folded] ? folded_classes[folded] : static_cast<std::uint8_t>(used_count);
+        }
+        std::size_t const classes = dfa.class_count;
+
+        // Trie of the literals, missing edges are filled in below
+        constexpr std::uint32_t NONE = UINT32_MAX;
+        dfa.next.assign(classes, NONE);
+        dfa.matches.resize(1);
+        for (Literal const &literal : literals)
+        {
+            std::uint32_t state = 0;
+            for (char const byte : literal.bytes)
+            {
+                std::uint32_t &edge = dfa.next[state * classes + dfa.classes[static_cast<std::uint8_t>(byte)]];
+                if (edge == NONE)
+                {
+                    edge = static_cast<std::uint32_t>(dfa.matches.size());
+                    dfa.next.resize(dfa.next.size() + classes, NONE);
+                    dfa.matches.emplace_back();
+                }
+                // The reference may have moved with the resize
+                state = dfa.next[state * classes + dfa.classes[static_cast<std::uint8_t>(byte)]];
+            }
+            dfa.matches[state].push_back(literal.rule);
+        }
+
+        // Breadth first, so the failure state of a state (a shorter suffix) is complete before the state
+        std::vector<std::uint32_t> failure(dfa.matches.size(), 0);
+        std::vector<std::uint32_t> queue;
+        queue.reserve(dfa.matches.size());
+        for (std::size_t cls = 0; cls < classes; ++cls)
+        {
+            std::uint32_t &edge = dfa.next[cls];
+            if (edge == NONE)
+            {
+                edge = 0;
+            }
+            else
+            {
+                queue.push_back(edge);
+            }
+        }
+        for (std::size_t head = 0; head < queue.size(); ++head)
+        {
+            std::uint32_t const state = queue[head];
+            for (std::size_t cls = 0; cls < classes; ++cls)
+            {
+                std::uint32_t const fallback = dfa.next[failure[state] * classes + cls];
+                std::uint32_t &edge = dfa.next[state * classes + cls];
+                if (edge == NONE)
+                {
+                    edge = fallback;
+                    continue;
+                }
+                failure[edge] = fallback;
+                std::vector<std::uint32_t> &matches = dfa.matches[edge];
+                matches.insert(matches.end(), dfa.matches[fallback].begin(), dfa.matches[fallback].end());
+                queue.push_back(edge);
+            }
+        }
+        for (std::vector<std::uint32_t> &matches : dfa.matches)
+        {
+            std::sort(matches.begin(), matches.end());
+            matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+        }
+
+        // Leading bytes of the literals, sorted so that similar ones share buckets
+        std::vector<std::string> windows;
+        windows.reserve(literals.size());
+        for (Literal const &literal : literals)
+        {
+            std::string window = literal.bytes.substr(0, PREFILTER_WINDOW_SIZE);
+            if (nocase)
+            {
+                std::transform(window.begin(), window.end(), window.begin(),
+                               [](char const byte) { return static_cast<char>(fold_case_(static_cast<std::uint8_t>(byte))); });
+            }
+            windows.push_back(std::move(window));
+        }
+        std::sort(windows.begin(), windows.end());
+        windows.erase(std::unique(windows.begin(), windows.end()), windows.end());
+        for (std::string const &window : windows)
+        {
+            std::vector<ByteSet> prefix;
+            for (char const byte : window)
+            {
+                prefix.push_back(literal_byte_(static_cast<std::uint8_t>(byte), nocase));
+            }
+            dfa.prefixes.push_back(std::move(prefix));
+        }
+        return dfa;
+    }
+
+    Automaton::Automaton(DfaDefinition const &definition)
+        : classes_{definition.classes}, class_count_{static_cast<std::uint32_t>(definition.class_count)},
+          next_{}, match_offsets_{}, match_rules_{}, start_{0}, idle_{0}, prefilter_{}
+    {
+        std::size_t const states = definition.matches.size();
+        if (definition.class_count == 0 || definition.class_count > 256 || states == 0 ||
+            definition.next.size() != states * definition.class_count ||
+            definition.start >= states || definition.idle >= states)
+        {
+            throw std::invalid_argument{"Inconsistent DFA definition"};
+        }
+        if (definition.next.size() >= MATCH_FLAG)
+        {
+            throw std::invalid_argument{"DFA of " + std::to_string(states) + " states is too large"};
+        }
+        for (std::uint8_t const cls : classes_)
+        {
+            if (cls >= class_count_)
+            {
+                throw std::invalid_argument{"Inconsistent DFA definition"};
+            }
+        }
+
+        next_.reserve(definition.next.size());
+        for (std::uint32_t const target : definition.next)
+        {
+            if (target >= states)
+            {
+                throw std::invalid_argument{"Inconsistent DFA definition"};
+            }
+            next_.push_back(target * class_count_ | (definition.matches[target].empty() ? 0 : MATCH_FLAG));
+        }
+        match_offsets_.reserve(states + 1);
+        for (std::vector<std::uint32_t> const &matches : definition.matches)
+        {
+            match_offsets_.push_back(static_cast<std::uint32_t>(match_rules_.size()));
+            match_rules_.insert(match_rules_.end(), matches.begin(), matches.end());
+        }
+        match_offsets_.push_back(static_cast<std::uint32_t>(match_rules_.size()));
+        start_ = definition.start * class_count_;
+        idle_ = definition.idle * class_count_;
+
+        if (!definition.prefixes.empty())
+        {
+            Prefilter prefilter{definition.prefixes};
+            if (prefilter.get_candidate_rate() <= PREFILTER_MAX_CANDIDATE_RATE)
+            {
+                prefilter_.emplace(prefilter);
+            }
+        }
+    }
+
+    std::uint32_t Automaton::get_start() const noexcept
+    {
+        return start_;
+    }
+
+    std::uint32_t Automaton::get_idle() const noexcept
+    {
+        return idle_;
+    }
+
+    bool Automaton::scan(std::uint32_t &state, std::uint8_t const *const data, std::size_t const size,
+                         std::size_t &offset) const noexcept
+    {
+        std::uint32_t const *const next = next_.data();
+        std::uint32_t current = state;
+        std::size_t position = offset;
+        // The prefilter is asked again once the bytes up to its last candidate were consumed
+        std::size_t filtered = position;
+        while (position < size)
+        {
+            if (current == idle_ && prefilter_ && position >= filtered)
+            {
+                std::size_t const candidate = position + prefilter_->find(data + position, size - position);
+                if (candidate >= size)
+                {
+                    position = size;
+                    break;
+                }
+                // A pattern may have started in the window before the candidate without matching the whole window
+                std::size_t const lookback = prefilter_->get_window() - 1;
+                position = std::max(position, candidate > lookback ? candidate - lookback : 0);
+                filtered = candidate + 1;
+            }
+            std::uint32_t const target = next[current + classes_[data[position]]];
+            ++position;
+            if (target & MATCH_FLAG)
+            {
+                state = target & ~MATCH_FLAG;
+                offset = position;
+                return true;
+            }
+            current = target;
+        }
+        state = current;
+        offset = size;
+        return false;
+    }
+
+    std::uint32_t const *Automaton::get_matches(std::uint32_t const state, std::size_t &size) const noexcept
+    {
+        std::uint32_t const index = state / class_count_;
+        size = match_offsets_[index + 1] - match_offsets_[index];
+        return match_rules_.data() + match_offsets_[index];
+    }
+
+    std::size_t Automaton::get_states() const noexcept
+    {
+        return match_offsets_.size() - 1;
+    }
+
+    std::size_t Automaton::memory_usage() const noexcept
+    {
+        return next_.capacity() * sizeof(std::uint32_t) + match_offsets_.capacity() * sizeof(std::uint32_t) +
+               match_rules_.capacity() * sizeof(std::uint32_t) + (prefilter_ ? sizeof(Prefilter) : 0);
+    }
+
+    bool Automaton::has_prefilter() const noexcept
+    {
+        return prefilter_.has_value();
+    }
+} // namespace overwatch::rules
@@ -0,0 +1,156 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "prefilter.hpp"
+
+namespace overwatch::rules
+{
+    /**
+     * Transition table of a DFA as built by the compilers
+     */
+    struct DfaDefinition
+    {
+        // Equivalence class of every byte, the bytes of a class lead every state to the same state
+        std::array<std::uint8_t, 256> classes{};
+        std::size_t class_count = 1;
+        // State reached from each state on each class (next[state * class_count + class])
+        std::vector<std::uint32_t> next;
+        // Rules matching when each state is entered
+        std::vector<std::vector<std::uint32_t>> matches;
+        // State of a stream before its first byte
+        std::uint32_t start = 0;
+        // State the DFA stays in while no pattern has started (the start state unless rules are anchored)
+        std::uint32_t idle = 0;
+        // Byte windows leaving the idle state (see Prefilter), empty if the idle state is never skipped
+        std::vector<std::vector<ByteSet>> prefixes;
+    };
+
+    /**
+     * A literal to search for
+     */
+    struct Literal
+    {
+        std::string bytes;
+        // Index of the rule matching with the literal
+        std::uint32_t rule;
+    };
+
+    /**
+     * Builds the Aho-Corasick automaton of a set of literals
+     *
+     * @param[in] literals The literals (not empty)
+     * @param[in] nocase True if the literals match regardless of ASCII case
+     * @return The DFA finding every occurrence of every literal
+     * @throw std::invalid_argument If a literal is empty
+     */
+    DfaDefinition build_literal_dfa(std::vector<Literal> const &literals, bool const nocase);
+
+    /**
+     * A compiled DFA run over streams of bytes.
+     *
+     * Transitions are kept in a flat table indexed by the row of the state plus the class of
+     * the byte, with the rows premultiplied and the states that complete a match flagged in
+     * the high bit, so a byte costs a class lookup, a table load and a test. While the DFA is
+     * idle the prefilter skips the bytes that cannot start a pattern.
+     */
+    class Automaton
+    {
+    public:
+        /**
+         * Compiles a DFA
+         *
+         * @param[in] definition The DFA
+         * @throw std::invalid_argument If the table is inconsistent or too large to be indexed
+         */
+        explicit Automaton(DfaDefinition const &definition);
+
+        /**
+         * State of a stream before its first byte
+         * @return The start state
+         */
+        std::uint32_t get_start() const noexcept;
+
+        /**
+         * State of a stream while no pattern has started, no anchored pattern can match from there
+         * @return The idle state
+         */
+        std::uint32_t get_idle() const noexcept;
+
+        /**
+         * Runs the DFA over bytes until their end or the first byte completing a match
+         *
+         * @param[in,out] state State of the stream before the byte at offset, then after the last byte consumed
+         * @param[in] data The bytes
+         * @param[in] size Number of bytes
+         * @param[in,out] offset The first byte to consume, then the byte following the last one consumed
+         * @return True if the last byte consumed completed the matches of the state, false if every byte was consumed
+         */
+        bool scan(std::uint32_t &state, std::uint8_t const *data, std::size_t const size, std::size_t &offset) const noexcept;
+
+        /**
+         * Rules matching when a state is entered
+         *
+         * @param[in] state The state (as returned by scan)
+         * @param[out] size Number of rules
+         * @return The indexes of the rules
+         */
+        std::uint32_t const *get_matches(std::uint32_t const state, std::size_t &size) const noexcept;
+
+        /**
+         * Number of states
+         * @return The number of states
+         */
+        std::size_t get_states() const noexcept;
+
+        /**
+         * Memory held by the tables
+         * @return The number of bytes
+         */
+        std::size_t memory_usage() const noexcept;
+
+        /**
+         * Whether idle bytes are skipped with the prefilter
+         * @return True if the DFA has a prefilter
+         */
+        bool has_prefilter() const noexcept;
+
+    private:
+        static constexpr std::uint32_t MATCH_FLAG = 1U << 31;
+
+        std::array<std::uint8_t, 256> classes_;
+        std::uint32_t class_count_;
+        // Premultiplied rows, flagged if the state has matches
+        std::vector<std::uint32_t> next_;
+        // Rules of every state (match_rules_[match_offsets_[state]] to match_rules_[match_offsets_[state + 1]])
+        std::vector<std::uint32_t> match_offsets_;
+        std::vector<std::uint32_t> match_rules_;
+        std::uint32_t start_;
+        std::uint32_t idle_;
+        std::optional<Prefilter> prefilter_;
+    };
+} // namespace overwatch::rules
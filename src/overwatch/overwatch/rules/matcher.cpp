@@ -0,0 +1,205 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <utility>
+
+#include "decoder.hpp"
+#include "lpm_table.hpp"
+#include "matcher.hpp"
+
+namespace
+{
+    /**
+     * Orients the key of a flow with the sender of some bytes as source
+     *
+     * @param[out] match The match to fill
+     * @param[in] key Canonical key of the flow
+     * @param[in] direction Direction of the bytes within the flow (0: src -> dst of the key)
+     */
+    void set_sender_(overwatch::rules::Match &match, overwatch::core::FlowKey const &key, std::uint8_t const direction) noexcept
+    {
+        match.key = key;
+        if (direction != 0)
+        {
+            std::swap(match.key.src_addr, match.key.dst_addr);
+            std::swap(match.key.src_port, match.key.dst_port);
+        }
+    }
+
+    void publish_counters_(overwatch::stats::Registry &registry, overwatch::stats::Labels const &labels,
+                           std::vector<overwatch::stats::Registration> &registrations, char const *const transport,
+                           overwatch::stats::Counter const &matches, overwatch::stats::Counter const &scanned_bytes)
+    {
+        overwatch::stats::Labels transport_labels = labels;
+        transport_labels.emplace_back("transport", transport);
+        registrations.push_back(registry.add_counter("overwatch_rule_matches_total", "Rules matching the targets' traffic",
+                                                     transport_labels, matches));
+        registrations.push_back(registry.add_counter("overwatch_rule_scanned_bytes_total",
+                                                     "Bytes of the targets' traffic matched against the rules",
+                                                     std::move(transport_labels), scanned_bytes));
+    }
+} // namespace
+
+namespace overwatch::rules
+{
+    StreamMatcher::StreamMatcher(std::shared_ptr<RuleSet const> rules, MatchSink sink)
+        : rules_{std::move(rules)}, sink_{std::move(sink)}, streams_{}, match_{}
+    {
+    }
+
+    bool StreamMatcher::on_data(reassembly::StreamInfo const &stream, std::uint8_t const direction, std::uint8_t const *const data,
+                                std::size_t const size)
+    {
+        if (stream.id >= streams_.size())
+        {
+            streams_.resize(stream.id + 1);
+        }
+        StreamState &state = streams_[stream.id];
+        if (!state.started)
+        {
+            rules_->start(state.scans[0]);
+            rules_->start(state.scans[1]);
+            state.started = true;
+            state.match_count = 0;
+        }
+        bool more = true;
+        rules_->scan(state.scans[direction], data, size, [&](std::uint32_t const rule, std::size_t const offset) {
+            more = more && report_(stream, state, direction, rule, stream.offsets[direction] + offset);
+        });
+        scanned_bytes_.add(size);
+        return more;
+    }
+
+    void StreamMatcher::on_gap(reassembly::StreamInfo const &stream, std::uint8_t const direction, std::size_t const)
+    {
+        if (stream.id < streams_.size() && streams_[stream.id].started)
+        {
+            rules_->restart(streams_[stream.id].scans[direction]);
+        }
+    }
+
+    void StreamMatcher::on_end(reassembly::StreamInfo const &stream, reassembly::StreamEnd const)
+    {
+        if (stream.id < streams_.size())
+        {
+            streams_[stream.id].started = false;
+        }
+    }
+
+    void StreamMatcher::publish(stats::Registry &registry, stats::Labels const &labels,
+                                std::vector<stats::Registration> &registrations) const
+    {
+        publish_counters_(registry, labels, registrations, "tcp", matches_, scanned_bytes_);
+    }
+
+    std::uint64_t StreamMatcher::get_matches() const noexcept
+    {
+        return matches_.load();
+    }
+
+    std::uint64_t StreamMatcher::get_scanned_bytes() const noexcept
+    {
+        return scanned_bytes_.load();
+    }
+
+    bool StreamMatcher::report_(reassembly::StreamInfo const &stream, StreamState &state, std::uint8_t const direction,
+                                std::uint32_t const rule, std::uint64_t const offset)
+    {
+        if (std::find(state.matched, state.matched + state.match_count, rule) != state.matched + state.match_count)
+        {
+            return true;
+        }
+        state.matched[state.match_count++] = rule;
+        set_sender_(match_, stream.key, direction);
+        match_.rule = rule;
+        match_.offset = offset;
+        matches_.add(1);
+        sink_(match_);
+        return state.match_count < MAX_STREAM_MATCHES;
+    }
+
+    MatchStage::MatchStage(std::shared_ptr<RuleSet const> rules, MatchSink sink)
+        : rules_{std::move(rules)}, sink_{std::move(sink)}, scan_{}, matched_{}, match_count_{0}, match_{}
+    {
+    }
+
+    char const *MatchStage::name() const noexcept
+    {
+        return "match";
+    }
+
+    void MatchStage::process(core::PacketBurst &burst)
+    {
+        for (std::size_t i = 0; i < burst.size; ++i)
+        {
+            decode::DecodedPacket const &decoded = burst.decoded[i];
+            if (!burst.has_flow[i] || !decoded.has(decode::LAYER_UDP) || decoded.payload_offset == 0)
+            {
+                continue;
+            }
+            if (burst.src_targets[i] == core::LpmTable::NO_MATCH && burst.dst_targets[i] == core::LpmTable::NO_MATCH)
+            {
+                continue;
+            }
+            capture::PacketView const &packet = burst.packets[i];
+            if (packet.caplen <= decoded.payload_offset)
+            {
+                continue;
+            }
+            std::size_t const size = std::min<std::size_t>(packet.caplen - decoded.payload_offset, decoded.payload_length);
+            rules_->start(scan_);
+            match_count_ = 0;
+            rules_->scan(scan_, packet.data + decoded.payload_offset, size,
+                         [&](std::uint32_t const rule, std::size_t const offset) { report_(burst, i, rule, offset); });
+            scanned_bytes_.add(size);
+        }
+    }
+
+    void MatchStage::publish(stats::Registry &registry, stats::Labels const &labels,
+                             std::vector<stats::Registration> &registrations) const
+    {
+        publish_counters_(registry, labels, registrations, "udp", matches_, scanned_bytes_);
+    }
+
+    std::uint64_t MatchStage::get_matches() const noexcept
+    {
+        return matches_.load();
+    }
+
+    std::uint64_t MatchStage::get_scanned_bytes() const noexcept
+    {
+        return scanned_bytes_.load();
+    }
+
+    void MatchStage::report_(core::PacketBurst const &burst, std::size_t const index, std::uint32_t const rule,
+                             std::uint64_t const offset)
+    {
+        if (match_count_ == MAX_STREAM_MATCHES || std::find(matched_, matched_ + match_count_, rule) != matched_ + match_count_)
+        {
+            return;
+        }
+        matched_[match_count_++] = rule;
+        set_sender_(match_, burst.flow_keys[index], burst.flow_directions[index]);
+        match_.rule = rule;
+        match_.offset = offset;
+        matches_.add(1);
+        sink_(match_);
+    }
+} // namespace overwatch::rules
@@ -0,0 +1,140 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "flow.hpp"
+#include "pipeline.hpp"
+#include "rule_set.hpp"
+#include "stats_registry.hpp"
+#include "tcp_reassembler.hpp"
+
+namespace overwatch::rules
+{
+    // Distinct rules reported per stream or datagram, a stream is no longer scanned once it matched that many
+    constexpr std::size_t MAX_STREAM_MATCHES = 8;
+
+    /**
+     * A rule matching the targets' traffic
+     */
+    struct Match
+    {
+        // Flow of the matching bytes with their sender as source
+        core::FlowKey key;
+        // Index of the rule in the rule set
+        std::uint32_t rule;
+        // Offset of the byte following the match within the bytes sent in the stream (or the datagram)
+        std::uint64_t offset;
+    };
+
+    // Called on the worker's thread with every match (only valid during the call)
+    using MatchSink = std::function<void(Match const &)>;
+
+    /**
+     * Matches the rules against both directions of the reassembled TCP streams
+     *
+     * Each direction is scanned as its bytes arrive, so patterns match across segments. A rule is
+     * reported once per stream and a stream that matched MAX_STREAM_MATCHES rules is dropped.
+     * Missing bytes restart the scan of their direction.
+     */
+    class StreamMatcher : public reassembly::StreamAnalyzer
+    {
+    public:
+        /**
+         * @param[in] rules The compiled rules
+         * @param[in] sink Receives the matches
+         */
+        StreamMatcher(std::shared_ptr<RuleSet const> rules, MatchSink sink);
+
+        bool on_data(reassembly::StreamInfo const &stream, std::uint8_t const direction, std::uint8_t const *data,
+                     std::size_t const size) override;
+        void on_gap(reassembly::StreamInfo const &stream, std::uint8_t const direction, std::size_t const size) override;
+        void on_end(reassembly::StreamInfo const &stream, reassembly::StreamEnd const reason) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        std::uint64_t get_matches() const noexcept;
+        std::uint64_t get_scanned_bytes() const noexcept;
+
+    private:
+        struct StreamState
+        {
+            ScanState scans[2];
+            bool started = false;
+            std::uint8_t match_count = 0;
+            std::uint32_t matched[MAX_STREAM_MATCHES];
+        };
+
+        // Reports a rule unless it matched the stream before, returns false once the stream matched too many rules
+        bool report_(reassembly::StreamInfo const &stream, StreamState &state, std::uint8_t const direction,
+                     std::uint32_t const rule, std::uint64_t const offset);
+
+        std::shared_ptr<RuleSet const> const rules_;
+        MatchSink const sink_;
+        // Indexed by stream ID
+        std::vector<StreamState> streams_;
+        Match match_;
+        // Read by the stats reporter
+        stats::Counter matches_;
+        stats::Counter scanned_bytes_;
+    };
+
+    /**
+     * Matches the rules against the payload of the targets' UDP datagrams, each on its own
+     */
+    class MatchStage : public core::Stage
+    {
+    public:
+        /**
+         * @param[in] rules The compiled rules
+         * @param[in] sink Receives the matches
+         */
+        MatchStage(std::shared_ptr<RuleSet const> rules, MatchSink sink);
+
+        char const *name() const noexcept override;
+        void process(core::PacketBurst &burst) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        std::uint64_t get_matches() const noexcept;
+        std::uint64_t get_scanned_bytes() const noexcept;
+
+    private:
+        // Reports a rule unless it matched the datagram before
+        void report_(core::PacketBurst const &burst, std::size_t const index, std::uint32_t const rule,
+                     std::uint64_t const offset);
+
+        std::shared_ptr<RuleSet const> const rules_;
+        MatchSink const sink_;
+        ScanState scan_;
+        // Rules reported for the datagram being scanned
+        std::uint32_t matched_[MAX_STREAM_MATCHES];
+        std::size_t match_count_;
+        Match match_;
+        // Read by the stats reporter
+        stats::Counter matches_;
+        stats::Counter scanned_bytes_;
+    };
+} // namespace overwatch::rules
@@ -0,0 +1,202 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "prefilter.hpp"
+
+namespace
+{
+    /**
+     * Index of the lowest set bit
+     *
+     * @param[in] value A non-zero value
+     * @return The number of trailing zero bits
+     */
+    inline unsigned int trailing_zeros_(std::uint32_t const value) noexcept
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return static_cast<unsigned int>(index);
+#else
+        return static_cast<unsigned int>(__builtin_ctz(value));
+#endif
+    }
+} // namespace
+
+namespace overwatch::rules
+{
+    Prefilter::Prefilter(std::vector<std::vector<ByteSet>> const &prefixes)
+        : buckets_{}, window_{0}, candidate_rate_{0}
+    {
+        if (prefixes.empty())
+        {
+            throw std::invalid_argument{"A prefilter needs at least one prefix"};
+        }
+        for (std::vector<ByteSet> const &prefix : prefixes)
+        {
+            if (prefix.empty() || prefix.size() > PREFILTER_WINDOW_SIZE)
+            {
+                throw std::invalid_argument{"Prefilter prefixes must have 1 to " + std::to_string(PREFILTER_WINDOW_SIZE) +
+                                            " positions"};
+            }
+            window_ = std::max(window_, prefix.size());
+        }
+        for (std::size_t i = 0; i < prefixes.size(); ++i)
+        {
+            // Neighbouring prefixes share a bucket
+            std::uint8_t const bucket = static_cast<std::uint8_t>(1U << (i * PREFILTER_BUCKETS / prefixes.size()));
+            for (std::size_t position = 0; position < window_; ++position)
+            {
+                for (std::size_t byte = 0; byte < 256; ++byte)
+                {
+                    if (position >= prefixes[i].size() || prefixes[i][position].test(byte))
+                    {
+                        buckets_[position][byte] |= bucket;
+                    }
+                }
+            }
+        }
+
+        // Nibble tables of the shuffles, a byte matches the buckets allowing both its nibbles
+        std::uint8_t low[PREFILTER_WINDOW_SIZE][16] = {};
+        std::uint8_t high[PREFILTER_WINDOW_SIZE][16] = {};
+        for (std::size_t position = 0; position < window_; ++position)
+        {
+            for (std::size_t byte = 0; byte < 256; ++byte)
+            {
+                low[position][byte & 0x0f] |= buckets_[position][byte];
+                high[position][byte >> 4] |= buckets_[position][byte];
+            }
+        }
+        for (std::size_t bucket = 0; bucket < PREFILTER_BUCKETS; ++bucket)
+        {
+            double rate = 1;
+            for (std::size_t position = 0; position < window_; ++position)
+            {
+                std::size_t allowed = 0;
+                for (std::size_t byte = 0; byte < 256; ++byte)
+                {
+#if defined(__AVX2__) || defined(__SSSE3__)
+                    std::uint8_t const buckets = low[position][byte & 0x0f] & high[position][byte >> 4];
+#else
+                    std::uint8_t const buckets = buckets_[position][byte];
+#endif
+                    allowed += (buckets >> bucket) & 1;
+                }
+                rate *= static_cast<double>(allowed) / 256;
+            }
+            candidate_rate_ += rate;
+        }
+        candidate_rate_ = std::min(candidate_rate_, 1.0);
+
+#if defined(__AVX2__)
+        for (std::size_t position = 0; position < window_; ++position)
+        {
+            __m128i const low_mask = _mm_loadu_si128(reinterpret_cast<__m128i const *>(low[position]));
+            __m128i const high_mask = _mm_loadu_si128(reinterpret_cast<__m128i const *>(high[position]));
+            // Shuffles look up within each 128 bit lane
+            low_masks_[position] = _mm256_broadcastsi128_si256(low_mask);
+            high_masks_[position] = _mm256_broadcastsi128_si256(high_mask);
+        }
+#elif defined(__SSSE3__)
+        for (std::size_t position = 0; position < window_; ++position)
+        {
+            low_masks_[position] = _mm_loadu_si128(reinterpret_cast<__m128i const *>(low[position]));
+            high_masks_[position] = _mm_loadu_si128(reinterpret_cast<__m128i const *>(high[position]));
+        }
+#endif
+    }
+
+    std::size_t Prefilter::find(std::uint8_t const *const data, std::size_t const size) const noexcept
+    {
+        std::size_t offset = 0;
+#if defined(__AVX2__)
+        __m256i const nibble = _mm256_set1_epi8(0x0f);
+        for (; offset + 32 + window_ - 1 <= size; offset += 32)
+        {
+            __m256i buckets = _mm256_set1_epi8(-1);
+            for (std::size_t position = 0; position < window_; ++position)
+            {
+                __m256i const bytes = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + offset + position));
+                __m256i const low = _mm256_and_si256(bytes, nibble);
+                __m256i const high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble);
+                buckets = _mm256_and_si256(buckets, _mm256_and_si256(_mm256_shuffle_epi8(low_masks_[position], low),
+                                                                     _mm256_shuffle_epi8(high_masks_[position], high)));
+            }
+            std::uint32_t const candidates =
+                ~static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(buckets, _mm256_setzero_si256())));
+            if (candidates != 0)
+            {
+                return offset + trailing_zeros_(candidates);
+            }
+        }
+#elif defined(__SSSE3__)
+        __m128i const nibble = _mm_set1_epi8(0x0f);
+        for (; offset + 16 + window_ - 1 <= size; offset += 16)
+        {
+            __m128i buckets = _mm_set1_epi8(-1);
+            for (std::size_t position = 0; position < window_; ++position)
+            {
+                __m128i const bytes = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + offset + position));
+                __m128i const low = _mm_and_si128(bytes, nibble);
+                __m128i const high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+                buckets = _mm_and_si128(buckets, _mm_and_si128(_mm_shuffle_epi8(low_masks_[position], low),
+                                                               _mm_shuffle_epi8(high_masks_[position], high)));
+            }
+            std::uint32_t const candidates =
+                ~static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(buckets, _mm_setzero_si128()))) & 0xffff;
+            if (candidates != 0)
+            {
+                return offset + trailing_zeros_(candidates);
+            }
+        }
+#endif
+        // Remaining positions (every position without SSSE3)
+        for (; offset + window_ <= size; ++offset)
+        {
+            std::uint8_t buckets = buckets_[0][data[offset]];
+            for (std::size_t position = 1; position < window_ && buckets != 0; ++position)
+            {
+                buckets &= buckets_[position][data[offset + position]];
+            }
+            if (buckets != 0)
+            {
+                return offset;
+            }
+        }
+        return std::min(offset, size);
+    }
+
+    std::size_t Prefilter::get_window() const noexcept
+    {
+        return window_;
+    }
+
+    double Prefilter::get_candidate_rate() const noexcept
+    {
+        return candidate_rate_;
+    }
+} // namespace overwatch::rules
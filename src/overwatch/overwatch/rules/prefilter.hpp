@@ -0,0 +1,102 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace overwatch::rules
+{
+    // Set of byte values
+    using ByteSet = std::bitset<256>;
+
+    // Leading bytes of a pattern the prefilter compares at once
+    constexpr std::size_t PREFILTER_WINDOW_SIZE = 3;
+    // Patterns are spread over this many buckets, one bit of the masks each
+    constexpr std::size_t PREFILTER_BUCKETS = 8;
+
+    /**
+     * Finds the positions where any of a set of patterns may start (Teddy style).
+     *
+     * Every pattern is reduced to the bytes allowed at each of its first positions and the
+     * patterns are grouped into 8 buckets. For every position of the window two 16 entry
+     * tables map the low and the high nibble of a byte to the buckets with a pattern allowing
+     * that nibble there, so a byte shuffle looks up the buckets of 16 (SSSE3) or 32 (AVX2)
+     * input bytes at once. A position is a candidate if one bucket allows every byte of the
+     * window starting at it: the filter reports false positives but never misses a start.
+     * Builds without SSSE3 look up exact 256 entry tables byte by byte instead.
+     */
+    class Prefilter
+    {
+    public:
+        /**
+         * Prepares the masks of a set of patterns
+         *
+         * @param[in] prefixes The bytes allowed at each of the first positions of every pattern, from
+         *                     1 to PREFILTER_WINDOW_SIZE positions (positions past the prefix of a
+         *                     pattern allow any byte); similar prefixes should be adjacent, as
+         *                     neighbours share buckets
+         * @throw std::invalid_argument If there is no prefix or a prefix is empty or too long
+         */
+        explicit Prefilter(std::vector<std::vector<ByteSet>> const &prefixes);
+
+        /**
+         * Finds the first candidate position
+         *
+         * @param[in] data The bytes
+         * @param[in] size Number of bytes
+         * @return Offset of the first position where a pattern may start, positions whose window
+         *         runs past the end are always candidates (size if there is none)
+         */
+        std::size_t find(std::uint8_t const *data, std::size_t const size) const noexcept;
+
+        /**
+         * Number of positions compared at once
+         * @return The length of the longest prefix
+         */
+        std::size_t get_window() const noexcept;
+
+        /**
+         * Share of random positions that would be candidates, the filter only pays off if few are
+         * @return The estimated share of candidate positions (0 to 1)
+         */
+        double get_candidate_rate() const noexcept;
+
+    private:
+        // Buckets allowing a byte at a position of the window (exact)
+        std::uint8_t buckets_[PREFILTER_WINDOW_SIZE][256];
+        std::size_t window_;
+        double candidate_rate_;
+#if defined(__AVX2__)
+        __m256i low_masks_[PREFILTER_WINDOW_SIZE];
+        __m256i high_masks_[PREFILTER_WINDOW_SIZE];
+#elif defined(__SSSE3__)
+        __m128i low_masks_[PREFILTER_WINDOW_SIZE];
+        __m128i high_masks_[PREFILTER_WINDOW_SIZE];
+#endif
+    };
+} // namespace overwatch::rules
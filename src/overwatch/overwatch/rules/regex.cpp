@@ -0,0 +1,788 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+
+#include "regex.hpp"
+
+// Largest count of a repetition ('{n,m}' copies the repeated expression m times)
+#define REGEX_MAX_REPEAT 1000
+// NFA states of all expressions together
+#define REGEX_MAX_NFA_STATES 1000000
+
+namespace
+{
+    using overwatch::rules::ByteSet;
+
+    constexpr std::uint32_t NONE = UINT32_MAX;
+    constexpr std::uint32_t UNBOUNDED = UINT32_MAX;
+
+    /**
+     * Node of the syntax tree of an expression
+     */
+    struct Node
+    {
+        enum class Kind : std::uint8_t
+        {
+            // Matches nothing (the empty string)
+            Empty,
+            // Matches one byte of a set
+            Bytes,
+            Concatenation,
+            Alternation,
+            Repetition
+        };
+
+        Kind kind;
+        ByteSet bytes;
+        std::vector<std::size_t> children;
+        std::uint32_t min = 0;
+        std::uint32_t max = 0;
+    };
+
+    /**
+     * Adds the other case of the ASCII letters of a set
+     *
+     * @param[in,out] bytes The set
+     */
+    void add_cases_(ByteSet &bytes) noexcept
+    {
+        for (std::size_t letter = 'a'; letter <= 'z'; ++letter)
+        {
+            std::size_t const upper = letter - ('a' - 'A');
+            if (bytes.test(letter) || bytes.test(upper))
+            {
+                bytes.set(letter);
+                bytes.set(upper);
+            }
+        }
+    }
+
+    /**
+     * Recursive descent parser of an expression into a syntax tree
+     */
+    class Parser
+    {
+    public:
+        Parser(std::string_view const source, bool const nocase) : source_{source}, nocase_{nocase}, position_{0} {}
+
+        /**
+         * Parses the whole expression
+         *
+         * @param[out] anchored True if the expression starts with '^'
+         * @return The index of the root node
+         * @throw std::invalid_argument If the expression is malformed
+         */
+        std::size_t parse(bool &anchored)
+        {
+            anchored = !source_.empty() && source_[0] == '^';
+            position_ = anchored ? 1 : 0;
+            std::size_t const root = alternation_();
+            if (position_ < source_.size())
+            {
+                fail_("unbalanced ')'");
+            }
+            return root;
+        }
+
+        std::vector<Node> const &get_nodes() const noexcept
+        {
+            return nodes_;
+        }
+
+    private:
+        [[noreturn]] void fail_(std::string const &what) const
+        {
+            throw std::invalid_argument{"'" + std::string{source_} + "' - " + what + " at offset " + std::to_string(position_)};
+        }
+
+        bool at_end_() const noexcept
+        {
+            return position_ >= source_.size();
+        }
+
+        char peek_() const noexcept
+        {
+            return source_[position_];
+        }
+
+        std::size_t add_(Node::Kind const kind)
+        {
+            nodes_.push_back(Node{kind, {}, {}, 0, 0});
+            return nodes_.size() - 1;
+        }
+
+        std::size_t add_bytes_(ByteSet bytes)
+        {
+            if (nocase_)
+            {
+                add_cases_(bytes);
+            }
+            std::size_t const node = add_(Node::Kind::Bytes);
+            nodes_[node].bytes = bytes;
+            return node;
+        }
+
+        std::size_t alternation_()
+        {
+            std::size_t const first = concatenation_();
+            if (at_end_() || peek_() != '|')
+            {
+                return first;
+            }
+            std::vector<std::size_t> children{first};
+            while (!at_end_() && peek_() == '|')
+            {
+                ++position_;
+                children.push_back(concatenation_());
+            }
+            std::size_t const node = add_(Node::Kind::Alternation);
+            nodes_[node].children = std::move(children);
+            return node;
+        }
+
+        std::size_t concatenation_()
+        {
+            std::vector<std::size_t> children;
+            while (!at_end_() && peek_() != '|' && peek_() != ')')
+            {
+                children.push_back(repetition_());
+            }
+            if (children.size() == 1)
+            {
+                return children[0];
+            }
+            std::size_t const node = add_(children.empty() ? Node::Kind::Empty : Node::Kind::Concatenation);
+            nodes_[node].children = std::move(children);
+            return node;
+        }
+
+        std::size_t repetition_()
+        {
+            std::size_t child = atom_();
+            while (!at_end_())
+            {
+                std::uint32_t min = 0;
+                std::uint32_t max = UNBOUNDED;
+                char const quantifier = peek_();
+                if (quantifier == '*')
+                {
+                    ++position_;
+                }
+                else if (quantifier == '+')
+                {
+                    min = 1;
+                    ++position_;
+                }
+                else if (quantifier == '?')
+                {
+                    max = 1;
+                    ++position_;
+                }
+                else if (quantifier == '{')
+                {
+                    ++position_;
+                    min = count_();
+                    max = min;
+                    if (!at_end_() && peek_() == ',')
+                    {
+                        ++position_;
+                        max = !at_end_() && peek_() == '}' ? UNBOUNDED : count_();
+                    }
+                    if (at_end_() || peek_() != '}' || max < min)
+                    {
+                        fail_("invalid repetition");
+                    }
+                    ++position_;
+                }
+                else
+                {
+                    break;
+                }
+                std::size_t const node = add_(Node::Kind::Repetition);
+                nodes_[node].children.push_back(child);
+                nodes_[node].min = min;
+                nodes_[node].max = max;
+                child = node;
+            }
+            return child;
+        }
+
+        std::uint32_t count_()
+        {
+            std::uint32_t count = 0;
+            std::size_t const start = position_;
+            while (!at_end_() && peek_() >= '0' && peek_() <= '9')
+            {
+                count = count * 10 + static_cast<std::uint32_t>(peek_() - '0');
+                if (count > REGEX_MAX_REPEAT)
+                {
+                    fail_("repetition larger than " + std::to_string(REGEX_MAX_REPEAT));
+                }
+                ++position_;
+            }
+            if (position_ == start)
+            {
+                fail_("invalid repetition");
+            }
+            return count;
+        }
+
+        std::size_t atom_()
+        {
+            char const current = peek_();
+            switch (current)
+            {
+            case '(':
+            {
+                ++position_;
+                if (source_.substr(position_, 2) == "?:")
+                {
+                    position_ += 2;
+                }
+                std::size_t const group = alternation_();
+                if (at_end_() || peek_() != ')')
+                {
+                    fail_("missing ')'");
+                }
+                ++position_;
+                return group;
+            }
+            case '[':
+                ++position_;
+                return add_bytes_(class_());
+            case '.':
+                ++position_;
+                return add_bytes_(ByteSet{}.set());
+            case '\\':
+                ++position_;
+                return add_bytes_(escape_());
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                fail_("nothing to repeat");
+            case '^':
+                fail_("'^' only anchors at the start of an expression");
+            case '$':
+                fail_("'$' is not supported, streams have no end");
+            default:
+                ++position_;
+                return add_bytes_(ByteSet{}.set(static_cast<std::uint8_t>(current)));
+            }
+        }
+
+        // Parses the escape following a backslash
+        ByteSet escape_()
+        {
+            if (at_end_())
+            {
+                fail_("trailing '\\'");
+            }
+            char const escaped = source_[position_++];
+            ByteSet bytes;
+            switch (escaped)
+            {
+            case 'x':
+            {
+                int value = 0;
+                for (int digit = 0; digit < 2; ++digit)
+                {
+                    char const hex = at_end_() ? '\0' : source_[position_];
+                    int const nibble = hex >= '0' && hex <= '9'   ? hex - '0'
+                                       : hex >= 'a' && hex <= 'f' ? hex - 'a' + 10
+                                       : hex >= 'A' && hex <= 'F' ? hex - 'A' + 10
+                                                                  : -1;
+                    if (nibble < 0)
+                    {
+                        fail_("'\\x' needs two hex digits");
+                    }
+                    value = value * 16 + nibble;
+                    ++position_;
+                }
+                return bytes.set(static_cast<std::size_t>(value));
+            }
+            case 'n':
+                return bytes.set('\n');
+            case 'r':
+                return bytes.set('\r');
+            case 't':
+                return bytes.set('\t');
+            case 'f':
+                return bytes.set('\f');
+            case 'v':
+                return bytes.set('\v');
+            case '0':
+                return bytes.set(0);
+            case 'd':
+            case 'D':
+                for (std::size_t byte = '0'; byte <= '9'; ++byte)
+                {
+                    bytes.set(byte);
+                }
+                return escaped == 'd' ? bytes : bytes.flip();
+            case 'w':
+            case 'W':
+                for (std::size_t byte = 0; byte < 256; ++byte)
+                {
+                    bytes.set(byte, (byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z') ||
+                                        (byte >= '0' && byte <= '9') || byte == '_');
+                }
+                return escaped == 'w' ? bytes : bytes.flip();
+            case 's':
+            case 'S':
+                for (char const space : {' ', '\t', '\n', '\r', '\f', '\v'})
+                {
+                    bytes.set(static_cast<std::uint8_t>(space));
+                }
+                return escaped == 's' ? bytes : bytes.flip();
+            default:
+                if ((escaped >= 'a' && escaped <= 'z') || (escaped >= 'A' && escaped <= 'Z') || (escaped >= '1' && escaped <= '9'))
+                {
+                    --position_;
+                    fail_(std::string{"unsupported escape '\\"} + escaped + "'");
+                }
+                return bytes.set(static_cast<std::uint8_t>(escaped));
+            }
+        }
+
+        // Parses a class following its '['
+        ByteSet class_()
+        {
+            bool const negated = !at_end_() && peek_() == '^';
+            position_ += negated ? 1 : 0;
+            ByteSet bytes;
+            bool first = true;
+            while (true)
+            {
+                if (at_end_())
+                {
+                    fail_("missing ']'");
+                }
+                if (peek_() == ']' && !first)
+                {
+                    ++position_;
+                    break;
+                }
+                first = false;
+                ByteSet const low = class_item_();
+                if (position_ + 1 < source_.size() && peek_() == '-' && source_[position_ + 1] != ']')
+                {
+                    ++position_;
+                    ByteSet const high = class_item_();
+                    if (low.count() != 1 || high.count() != 1)
+                    {
+                        fail_("invalid class range");
+                    }
+                    std::size_t from = 0;
+                    std::size_t to = 0;
+                    while (!low.test(from))
+                    {
+                        ++from;
+                    }
+                    while (!high.test(to))
+                    {
+                        ++to;
+                    }
+                    if (from > to)
+                    {
+                        fail_("invalid class range");
+                    }
+                    for (std::size_t byte = from; byte <= to; ++byte)
+                    {
+                        bytes.set(byte);
+                    }
+                }
+                else
+                {
+                    bytes |= low;
+                }
+            }
+            if (nocase_)
+            {
+                add_cases_(bytes);
+            }
+            return negated ? bytes.flip() : bytes;
+        }
+
+        ByteSet class_item_()
+        {
+            char const current = source_[position_++];
+            if (current == '\\')
+            {
+                return escape_();
+            }
+            return ByteSet{}.set(static_cast<std::uint8_t>(current));
+        }
+
+        std::string_view const source_;
+        bool const nocase_;
+        std::size_t position_;
+        std::vector<Node> nodes_;
+    };
+
+    /**
+     * Thompson NFA of all expressions
+     */
+    class Nfa
+    {
+    public:
+        enum class Kind : std::uint8_t
+        {
+            // Consumes a byte of the set and goes to out
+            Bytes,
+            // Goes to out and out_alt without consuming
+            Split,
+            // Goes to out without consuming
+            Epsilon,
+            // The rule matched
+            Match
+        };
+
+        struct State
+        {
+            Kind kind;
+            std::uint32_t out = NONE;
+            std::uint32_t out_alt = NONE;
+            std::uint32_t rule = 0;
+            ByteSet bytes;
+        };
+
+        /**
+         * Adds an expression
+         *
+         * @param[in] nodes The syntax tree
+         * @param[in] root Index of the root node
+         * @param[in] rule Index of the rule
+         * @return The start state of the expression
+         * @throw std::invalid_argument If the NFA grows too large
+         */
+        std::uint32_t add(std::vector<Node> const &nodes, std::size_t const root, std::uint32_t const rule)
+        {
+            Fragment const fragment = emit_(nodes, root);
+            std::uint32_t const match = add_state_(Kind::Match);
+            states_[match].rule = rule;
+            states_[fragment.end].out = match;
+            return fragment.start;
+        }
+
+        std::vector<State> const &get_states() const noexcept
+        {
+            return states_;
+        }
+
+        /**
+         * States reachable without consuming a byte, only the ones consuming bytes or matching are kept
+         *
+         * @param[in,out] states The states, replaced by their sorted closure
+         */
+        void close(std::vector<std::uint32_t> &states)
+        {
+            if (marks_.size() < states_.size())
+            {
+                marks_.resize(states_.size(), 0);
+            }
+            ++generation_;
+            stack_.assign(states.begin(), states.end());
+            states.clear();
+            while (!stack_.empty())
+            {
+                std::uint32_t const index = stack_.back();
+                stack_.pop_back();
+                if (index == NONE || marks_[index] == generation_)
+                {
+                    continue;
+                }
+                marks_[index] = generation_;
+                State const &state = states_[index];
+                switch (state.kind)
+                {
+                case Kind::Bytes:
+                case Kind::Match:
+                    states.push_back(index);
+                    break;
+                case Kind::Split:
+                    stack_.push_back(state.out_alt);
+                    stack_.push_back(state.out);
+                    break;
+                case Kind::Epsilon:
+                    stack_.push_back(state.out);
+                    break;
+                }
+            }
+            std::sort(states.begin(), states.end());
+        }
+
+    private:
+        struct Fragment
+        {
+            std::uint32_t start;
+            // Epsilon state whose out is left to connect
+            std::uint32_t end;
+        };
+
+        std::uint32_t add_state_(Kind const kind)
+        {
+            if (states_.size() >= REGEX_MAX_NFA_STATES)
+            {
+                throw std::invalid_argument{"Expressions are too large (more than " + std::to_string(REGEX_MAX_NFA_STATES) +
+                                            " NFA states)"};
+            }
+            states_.push_back(State{kind, NONE, NONE, 0, {}});
+            return static_cast<std::uint32_t>(states_.size() - 1);
+        }
+
+        Fragment emit_(std::vector<Node> const &nodes, std::size_t const index)
+        {
+            Node const &node = nodes[index];
+            switch (node.kind)
+            {
+            case Node::Kind::Empty:
+            {
+                std::uint32_t const end = add_state_(Kind::Epsilon);
+                return Fragment{end, end};
+            }
+            case Node::Kind::Bytes:
+            {
+                std::uint32_t const start = add_state_(Kind::Bytes);
+                std::uint32_t const end = add_state_(Kind::Epsilon);
+                states_[start].bytes = node.bytes;
+                states_[start].out = end;
+                return Fragment{start, end};
+            }
+            case Node::Kind::Concatenation:
+            {
+                Fragment result = emit_(nodes, node.children[0]);
+                for (std::size_t i = 1; i < node.children.size(); ++i)
+                {
+                    Fragment const next = emit_(nodes, node.children[i]);
+                    states_[result.end].out = next.start;
+                    result.end = next.end;
+                }
+                return result;
+            }
+            case Node::Kind::Alternation:
+            {
+                std::uint32_t const end = add_state_(Kind::Epsilon);
+                std::vector<std::uint32_t> starts;
+                for (std::size_t const child : node.children)
+                {
+                    Fragment const branch = emit_(nodes, child);
+                    states_[branch.end].out = end;
+                    starts.push_back(branch.start);
+                }
+                std::uint32_t start = starts.back();
+                for (std::size_t i = starts.size() - 1; i-- > 0;)
+                {
+                    std::uint32_t const split = add_state_(Kind::Split);
+                    states_[split].out = starts[i];
+                    states_[split].out_alt = start;
+                    start = split;
+                }
+                return Fragment{start, end};
+            }
+            case Node::Kind::Repetition:
+                break;
+            }
+
+            // Required copies, then optional ones or a loop
+            std::uint32_t const start = add_state_(Kind::Epsilon);
+            Fragment result{start, start};
+            for (std::uint32_t i = 0; i < node.min; ++i)
+            {
+                Fragment const copy = emit_(nodes, node.children[0]);
+                states_[result.end].out = copy.start;
+                result.end = copy.end;
+            }
+            std::uint32_t const optional_copies = node.max == UNBOUNDED ? 1 : node.max - node.min;
+            for (std::uint32_t i = 0; i < optional_copies; ++i)
+            {
+                Fragment const copy = emit_(nodes, node.children[0]);
+                std::uint32_t const split = add_state_(Kind::Split);
+                std::uint32_t const end = add_state_(Kind::Epsilon);
+                states_[result.end].out = split;
+                states_[split].out = copy.start;
+                states_[split].out_alt = end;
+                states_[copy.end].out = node.max == UNBOUNDED ? split : end;
+                result.end = end;
+            }
+            return result;
+        }
+
+        std::vector<State> states_;
+        // Visited states of the current closure
+        std::vector<std::uint32_t> marks_;
+        std::uint32_t generation_ = 0;
+        std::vector<std::uint32_t> stack_;
+    };
+} // namespace
+
+namespace overwatch::rules
+{
+    DfaDefinition build_regex_dfa(std::vector<Regex> const &regexes, std::size_t const max_states)
+    {
+        Nfa nfa;
+        std::vector<std::uint32_t> all_starts;
+        std::vector<std::uint32_t> unanchored_starts;
+        for (Regex const &regex : regexes)
+        {
+            Parser parser{regex.source, regex.nocase};
+            bool anchored = false;
+            std::size_t const root = parser.parse(anchored);
+            std::uint32_t const start = nfa.add(parser.get_nodes(), root, regex.rule);
+            std::vector<std::uint32_t> closure{start};
+            nfa.close(closure);
+            for (std::uint32_t const state : closure)
+            {
+                if (nfa.get_states()[state].kind == Nfa::Kind::Match)
+                {
+                    throw std::invalid_argument{"'" + regex.source + "' - matches the empty string"};
+                }
+            }
+            all_starts.push_back(start);
+            if (!anchored)
+            {
+                unanchored_starts.push_back(start);
+            }
+        }
+        std::vector<Nfa::State> const &states = nfa.get_states();
+
+        // Bytes are split into the classes no set of the NFA tells apart
+        DfaDefinition dfa;
+        std::unordered_set<ByteSet> sets;
+        for (Nfa::State const &state : states)
+        {
+            if (state.kind == Nfa::Kind::Bytes)
+            {
+                sets.insert(state.bytes);
+            }
+        }
+        std::array<std::size_t, 256> classes{};
+        std::size_t class_count = 1;
+        for (ByteSet const &set : sets)
+        {
+            // Splits every class into its bytes in and out of the set
+            std::vector<std::size_t> renumbered(class_count * 2, SIZE_MAX);
+            std::size_t renumbered_count = 0;
+            for (std::size_t byte = 0; byte < 256; ++byte)
+            {
+                std::size_t &target = renumbered[classes[byte] * 2 + (set.test(byte) ? 1 : 0)];
+                if (target == SIZE_MAX)
+                {
+                    target = renumbered_count++;
+                }
+                classes[byte] = target;
+            }
+            class_count = renumbered_count;
+        }
+        std::vector<std::size_t> representatives(class_count, SIZE_MAX);
+        for (std::size_t byte = 0; byte < 256; ++byte)
+        {
+            dfa.classes[byte] = static_cast<std::uint8_t>(classes[byte]);
+            if (representatives[classes[byte]] == SIZE_MAX)
+            {
+                representatives[classes[byte]] = byte;
+            }
+        }
+        dfa.class_count = class_count;
+
+        // Subset construction, the unanchored expressions restart at every byte
+        std::vector<std::uint32_t> idle = unanchored_starts;
+        nfa.close(idle);
+        std::vector<std::uint32_t> start = all_starts;
+        nfa.close(start);
+        std::map<std::vector<std::uint32_t>, std::uint32_t> ids;
+        std::vector<std::vector<std::uint32_t>> pending;
+        auto const find_or_add = [&](std::vector<std::uint32_t> &&subset) {
+            auto const found = ids.find(subset);
+            if (found != ids.end())
+            {
+                return found->second;
+            }
+            if (ids.size() >= max_states)
+            {
+                throw std::invalid_argument{"Expressions are too complex (more than " + std::to_string(max_states) +
+                                            " DFA states)"};
+            }
+            std::uint32_t const id = static_cast<std::uint32_t>(ids.size());
+            std::vector<std::uint32_t> &matches = dfa.matches.emplace_back();
+            for (std::uint32_t const index : subset)
+            {
+                if (states[index].kind == Nfa::Kind::Match)
+                {
+                    matches.push_back(states[index].rule);
+                }
+            }
+            std::sort(matches.begin(), matches.end());
+            matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+            ids.emplace(subset, id);
+            pending.push_back(std::move(subset));
+            return id;
+        };
+        dfa.start = find_or_add(std::vector<std::uint32_t>(start));
+        dfa.idle = find_or_add(std::vector<std::uint32_t>(idle));
+        std::vector<std::uint32_t> targets;
+        std::vector<std::uint32_t> subset;
+        for (std::size_t id = 0; id < pending.size(); ++id)
+        {
+            dfa.next.resize((id + 1) * class_count);
+            for (std::size_t cls = 0; cls < class_count; ++cls)
+            {
+                targets.clear();
+                for (std::uint32_t const index : pending[id])
+                {
+                    if (states[index].kind == Nfa::Kind::Bytes && states[index].bytes.test(representatives[cls]))
+                    {
+                        targets.push_back(states[index].out);
+                    }
+                }
+                nfa.close(targets);
+                subset.clear();
+                std::set_union(targets.begin(), targets.end(), idle.begin(), idle.end(), std::back_inserter(subset));
+                dfa.next[id * class_count + cls] = find_or_add(std::move(subset));
+            }
+        }
+
+        // The bytes leaving the idle state, grouped by their high nibble so that buckets stay exact
+        ByteSet leaving;
+        for (std::size_t byte = 0; byte < 256; ++byte)
+        {
+            leaving.set(byte, dfa.next[dfa.idle * class_count + classes[byte]] != dfa.idle);
+        }
+        for (std::size_t high = 0; high < 16; ++high)
+        {
+            ByteSet const nibble_bytes = leaving & (ByteSet{0xffff} << (high * 16));
+            if (nibble_bytes.any())
+            {
+                dfa.prefixes.push_back({nibble_bytes});
+            }
+        }
+        if (dfa.prefixes.empty())
+        {
+            // Only anchored expressions, which no byte restarts once they failed
+            dfa.prefixes.push_back({ByteSet{}});
+        }
+        return dfa;
+    }
+} // namespace overwatch::rules
@@ -0,0 +1,60 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "automaton.hpp"
+
+namespace overwatch::rules
+{
+    /**
+     * A regular expression to search for
+     */
+    struct Regex
+    {
+        std::string source;
+        // True if letters match regardless of ASCII case
+        bool nocase;
+        // Index of the rule matching with the expression
+        std::uint32_t rule;
+    };
+
+    /**
+     * Compiles regular expressions into a single DFA finding every match of every expression.
+     *
+     * The expressions work on bytes: literal bytes, '.' (any byte), classes ('[a-z_]', '[^\r\n]'),
+     * the escapes '\xHH', '\n', '\r', '\t', '\f', '\v', '\0', '\d', '\w', '\s' (and their negations
+     * '\D', '\W', '\S'), groups ('(...)', '(?:...)'), alternations ('|') and the repetitions '*',
+     * '+', '?', '{n}', '{n,}' and '{n,m}'. A leading '^' anchors an expression to the start of the
+     * stream. Expressions only say whether they occur, so there are no captures, back references or
+     * lookarounds, and streams have no end to anchor to with '$'.
+     *
+     * @param[in] regexes The expressions (not empty)
+     * @param[in] max_states Most states the DFA may have
+     * @return The DFA
+     * @throw std::invalid_argument If an expression is malformed or matches the empty string, or if
+     *        the DFA needs more than max_states states
+     */
+    DfaDefinition build_regex_dfa(std::vector<Regex> const &regexes, std::size_t const max_states);
+} // namespace overwatch::rules
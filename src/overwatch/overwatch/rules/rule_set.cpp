@@ -0,0 +1,333 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+#include "regex.hpp"
+#include "rule_set.hpp"
+
+// DFA states the regular expressions of a rule set may compile to
+#define RULES_MAX_DFA_STATES 65536
+#define AUTOMATON_LITERALS 0
+#define AUTOMATON_NOCASE_LITERALS 1
+#define AUTOMATON_REGEXES 2
+
+namespace
+{
+    /**
+     * Removes the blanks around a string
+     *
+     * @param[in] text The string
+     * @return The string without leading and trailing blanks
+     */
+    std::string_view trim_(std::string_view const text) noexcept
+    {
+        std::size_t const start = text.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos)
+        {
+            return {};
+        }
+        return text.substr(start, text.find_last_not_of(" \t\r") - start + 1);
+    }
+
+    bool is_name_char_(char const c) noexcept
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' ||
+               c == '.' || c == ':';
+    }
+
+    int hex_value_(char const c) noexcept
+    {
+        return c >= '0' && c <= '9'   ? c - '0'
+               : c >= 'a' && c <= 'f' ? c - 'a' + 10
+               : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                      : -1;
+    }
+
+    /**
+     * Parses a quoted literal
+     *
+     * @param[in] text The text starting with the opening quote
+     * @param[out] bytes The bytes of the literal
+     * @return Length of the literal in the text, quotes included
+     * @throw std::invalid_argument If the literal is malformed
+     */
+    std::size_t parse_literal_(std::string_view const text, std::string &bytes)
+    {
+        for (std::size_t i = 1; i < text.size(); ++i)
+        {
+            if (text[i] == '"')
+            {
+                return i + 1;
+            }
+            if (text[i] != '\\')
+            {
+                bytes.push_back(text[i]);
+                continue;
+            }
+            if (++i == text.size())
+            {
+                break;
+            }
+            switch (text[i])
+            {
+            case 'x':
+            {
+                int const high = i + 1 < text.size() ? hex_value_(text[i + 1]) : -1;
+                int const low = i + 2 < text.size() ? hex_value_(text[i + 2]) : -1;
+                if (high < 0 || low < 0)
+                {
+                    throw std::invalid_argument{"'\\x' needs two hex digits"};
+                }
+                bytes.push_back(static_cast<char>(high * 16 + low));
+                i += 2;
+                break;
+            }
+            case 'n':
+                bytes.push_back('\n');
+                break;
+            case 'r':
+                bytes.push_back('\r');
+                break;
+            case 't':
+                bytes.push_back('\t');
+                break;
+            case '0':
+                bytes.push_back('\0');
+                break;
+            case '\\':
+            case '"':
+                bytes.push_back(text[i]);
+                break;
+            default:
+                throw std::invalid_argument{std::string{"unsupported escape '\\"} + text[i] + "'"};
+            }
+        }
+        throw std::invalid_argument{"missing closing '\"'"};
+    }
+
+    /**
+     * Parses a regular expression between slashes
+     *
+     * @param[in] text The text starting with the opening slash
+     * @param[out] source The expression, with its escaped slashes unescaped
+     * @return Length of the expression in the text, slashes included
+     * @throw std::invalid_argument If the closing slash is missing
+     */
+    std::size_t parse_regex_(std::string_view const text, std::string &source)
+    {
+        for (std::size_t i = 1; i < text.size(); ++i)
+        {
+            if (text[i] == '/')
+            {
+                return i + 1;
+            }
+            if (text[i] == '\\' && i + 1 < text.size())
+            {
+                // Other escapes are left to the expression
+                if (text[i + 1] != '/')
+                {
+                    source.push_back('\\');
+                }
+                source.push_back(text[++i]);
+                continue;
+            }
+            source.push_back(text[i]);
+        }
+        throw std::invalid_argument{"missing closing '/'"};
+    }
+
+    bool has_letters_(std::string const &bytes) noexcept
+    {
+        return std::any_of(bytes.begin(), bytes.end(),
+                           [](char const c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); });
+    }
+} // namespace
+
+namespace overwatch::rules
+{
+    Rule parse_rule(std::string_view const line)
+    {
+        std::string_view const text = trim_(line);
+        std::size_t const name_size = std::min(text.find_first_of(" \t"), text.size());
+        if (name_size == 0)
+        {
+            throw std::invalid_argument{"missing rule name"};
+        }
+        std::string_view const name = text.substr(0, name_size);
+        if (!std::all_of(name.begin(), name.end(), is_name_char_))
+        {
+            throw std::invalid_argument{"'" + std::string{name} + "' is not a valid rule name"};
+        }
+
+        Rule rule{std::string{name}, PatternType::Literal, {}, false};
+        std::string_view const pattern = trim_(text.substr(name_size));
+        std::size_t pattern_size = 0;
+        if (!pattern.empty() && pattern[0] == '"')
+        {
+            pattern_size = parse_literal_(pattern, rule.pattern);
+        }
+        else if (!pattern.empty() && pattern[0] == '/')
+        {
+            rule.type = PatternType::Regex;
+            pattern_size = parse_regex_(pattern, rule.pattern);
+        }
+        else
+        {
+            throw std::invalid_argument{"rule '" + rule.name + "' needs a \"literal\" or a /regular expression/"};
+        }
+        if (rule.pattern.empty())
+        {
+            throw std::invalid_argument{"rule '" + rule.name + "' has an empty pattern"};
+        }
+        std::string_view const flags = pattern.substr(pattern_size);
+        if (flags == "i")
+        {
+            rule.nocase = true;
+        }
+        else if (!flags.empty())
+        {
+            throw std::invalid_argument{"rule '" + rule.name + "' has unexpected '" + std::string{flags} + "' after its pattern"};
+        }
+        return rule;
+    }
+
+    std::vector<Rule> read_rules(std::string const &path)
+    {
+        std::ifstream file{path};
+        if (!file)
+        {
+            throw std::invalid_argument{"'rules' file '" + path + "' cannot be read"};
+        }
+        std::vector<Rule> rules;
+        std::string line;
+        for (std::size_t line_number = 1; std::getline(file, line); ++line_number)
+        {
+            std::string_view const text = trim_(line);
+            if (text.empty() || text[0] == '#')
+            {
+                continue;
+            }
+            try
+            {
+                rules.push_back(parse_rule(text));
+            }
+            catch (std::invalid_argument const &e)
+            {
+                throw std::invalid_argument{"'rules' file '" + path + "' line " + std::to_string(line_number) + " - " + e.what()};
+            }
+        }
+        return rules;
+    }
+
+    RuleSet::RuleSet(std::vector<Rule> rules) : rules_{std::move(rules)}, automata_{}
+    {
+        if (rules_.empty())
+        {
+            throw std::invalid_argument{"A rule set needs at least one rule"};
+        }
+        std::unordered_set<std::string> names;
+        std::vector<Literal> literals;
+        std::vector<Literal> nocase_literals;
+        std::vector<Regex> regexes;
+        for (std::uint32_t index = 0; index < rules_.size(); ++index)
+        {
+            Rule const &rule = rules_[index];
+            if (!names.insert(rule.name).second)
+            {
+                throw std::invalid_argument{"Rule '" + rule.name + "' is defined twice"};
+            }
+            if (rule.type == PatternType::Regex)
+            {
+                regexes.push_back(Regex{rule.pattern, rule.nocase, index});
+            }
+            // Case only matters for letters
+            else if (rule.nocase && has_letters_(rule.pattern))
+            {
+                nocase_literals.push_back(Literal{rule.pattern, index});
+            }
+            else
+            {
+                literals.push_back(Literal{rule.pattern, index});
+            }
+        }
+        if (!literals.empty())
+        {
+            automata_[AUTOMATON_LITERALS].emplace(build_literal_dfa(literals, false));
+        }
+        if (!nocase_literals.empty())
+        {
+            automata_[AUTOMATON_NOCASE_LITERALS].emplace(build_literal_dfa(nocase_literals, true));
+        }
+        if (!regexes.empty())
+        {
+            automata_[AUTOMATON_REGEXES].emplace(build_regex_dfa(regexes, RULES_MAX_DFA_STATES));
+        }
+    }
+
+    std::size_t RuleSet::size() const noexcept
+    {
+        return rules_.size();
+    }
+
+    Rule const &RuleSet::get_rule(std::uint32_t const index) const noexcept
+    {
+        return rules_[index];
+    }
+
+    std::size_t RuleSet::memory_usage() const noexcept
+    {
+        std::size_t usage = 0;
+        for (std::optional<Automaton> const &automaton : automata_)
+        {
+            usage += automaton ? automaton->memory_usage() : 0;
+        }
+        return usage;
+    }
+
+    std::size_t RuleSet::get_states() const noexcept
+    {
+        std::size_t states = 0;
+        for (std::optional<Automaton> const &automaton : automata_)
+        {
+            states += automaton ? automaton->get_states() : 0;
+        }
+        return states;
+    }
+
+    void RuleSet::start(ScanState &state) const noexcept
+    {
+        for (std::size_t i = 0; i < RULE_AUTOMATA; ++i)
+        {
+            state.states[i] = automata_[i] ? automata_[i]->get_start() : 0;
+        }
+    }
+
+    void RuleSet::restart(ScanState &state) const noexcept
+    {
+        for (std::size_t i = 0; i < RULE_AUTOMATA; ++i)
+        {
+            state.states[i] = automata_[i] ? automata_[i]->get_idle() : 0;
+        }
+    }
+} // namespace overwatch::rules
@@ -0,0 +1,186 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "automaton.hpp"
+
+namespace overwatch::rules
+{
+    enum class PatternType : std::uint8_t
+    {
+        Literal,
+        Regex
+    };
+
+    /**
+     * A signature searched for in the targets' traffic
+     */
+    struct Rule
+    {
+        std::string name;
+        PatternType type;
+        // Bytes of a literal (escapes resolved) or source of a regular expression
+        std::string pattern;
+        // True if letters match regardless of ASCII case
+        bool nocase;
+    };
+
+    /**
+     * Parses a rule.
+     *
+     * A rule is a name made of letters, digits, '_', '-', '.' and ':' followed by its pattern:
+     * either a literal in double quotes, where '\xHH', '\n', '\r', '\t', '\0', '\\' and '\"'
+     * escape bytes, or a regular expression between slashes (see build_regex_dfa), where '\/'
+     * stands for a slash. An 'i' after the pattern ignores ASCII case.
+     *
+     *     wp-login "POST /wp-login.php"
+     *     ssh-banner /^SSH-\d\.\d-/
+     *     user-agent-curl "user-agent: curl/"i
+     *
+     * @param[in] line The rule
+     * @return The rule
+     * @throw std::invalid_argument If the rule is malformed
+     */
+    Rule parse_rule(std::string_view const line);
+
+    /**
+     * Reads the rules of a file, one per line (blank lines and lines starting with '#' are skipped)
+     *
+     * @param[in] path The file
+     * @return The rules in the order of the file
+     * @throw std::invalid_argument If the file cannot be read or a rule is malformed
+     */
+    std::vector<Rule> read_rules(std::string const &path);
+
+    // Case sensitive literals, case insensitive literals and regular expressions have their own automaton
+    constexpr std::size_t RULE_AUTOMATA = 3;
+
+    /**
+     * Progress of the scan of a stream, carried from one chunk of the stream to the next
+     */
+    struct ScanState
+    {
+        std::uint32_t states[RULE_AUTOMATA];
+    };
+
+    /**
+     * Rules compiled once into automata shared by every worker.
+     *
+     * Literals are searched with Aho-Corasick automata and regular expressions with a single
+     * DFA, all of them table driven with a SIMD prefilter skipping the bytes that start no
+     * pattern. Scanning only updates a ScanState, so a stream is scanned chunk by chunk as it
+     * arrives and patterns match across packet boundaries.
+     */
+    class RuleSet
+    {
+    public:
+        /**
+         * Compiles rules
+         *
+         * @param[in] rules The rules, indexed in this order
+         * @throw std::invalid_argument If there is no rule, two rules share a name, a pattern is invalid or the
+         *        regular expressions are too complex
+         */
+        explicit RuleSet(std::vector<Rule> rules);
+
+        /**
+         * Number of rules
+         * @return The number of rules
+         */
+        std::size_t size() const noexcept;
+
+        /**
+         * A rule
+         *
+         * @param[in] index Index of the rule (below size())
+         * @return The rule
+         */
+        Rule const &get_rule(std::uint32_t const index) const noexcept;
+
+        /**
+         * Memory held by the automata
+         * @return The number of bytes
+         */
+        std::size_t memory_usage() const noexcept;
+
+        /**
+         * Number of states of the automata
+         * @return The number of states
+         */
+        std::size_t get_states() const noexcept;
+
+        /**
+         * Starts the scan of a stream
+         *
+         * @param[out] state The state before the first byte of the stream
+         */
+        void start(ScanState &state) const noexcept;
+
+        /**
+         * Restarts the scan of a stream after bytes of it were missed, the patterns in progress are
+         * dropped and the anchored ones can no longer match
+         *
+         * @param[out] state The state before the bytes following the missing ones
+         */
+        void restart(ScanState &state) const noexcept;
+
+        /**
+         * Scans the next bytes of a stream
+         *
+         * @param[in,out] state The state of the stream
+         * @param[in] data The bytes
+         * @param[in] size Number of bytes
+         * @param[in] on_match Called with the index of the rule and the offset (in data) of the byte following
+         *            the match for every occurrence, the matches of each automaton in order
+         */
+        template <typename OnMatch>
+        void scan(ScanState &state, std::uint8_t const *data, std::size_t const size, OnMatch &&on_match) const
+        {
+            for (std::size_t i = 0; i < RULE_AUTOMATA; ++i)
+            {
+                if (!automata_[i])
+                {
+                    continue;
+                }
+                std::size_t offset = 0;
+                while (automata_[i]->scan(state.states[i], data, size, offset))
+                {
+                    std::size_t count = 0;
+                    std::uint32_t const *const matches = automata_[i]->get_matches(state.states[i], count);
+                    for (std::size_t match = 0; match < count; ++match)
+                    {
+                        on_match(matches[match], offset);
+                    }
+                }
+            }
+        }
+
+    private:
+        std::vector<Rule> const rules_;
+        std::optional<Automaton> automata_[RULE_AUTOMATA];
+    };
+} // namespace overwatch::rules
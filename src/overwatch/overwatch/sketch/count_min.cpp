@@ -0,0 +1,137 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "count_min.hpp"
+
+namespace
+{
+    /**
+     * Adds an array of counters to another
+     *
+     * @param[in,out] counters The counters to add to
+     * @param[in] other The counters to add
+     * @param[in] size Number of counters
+     */
+    void add_counters_(std::uint64_t *const counters, std::uint64_t const *const other, std::size_t const size) noexcept
+    {
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= size; i += 4)
+        {
+            __m256i *const target = reinterpret_cast<__m256i *>(counters + i);
+            __m256i const sum = _mm256_add_epi64(_mm256_loadu_si256(target),
+                                                 _mm256_loadu_si256(reinterpret_cast<__m256i const *>(other + i)));
+            _mm256_storeu_si256(target, sum);
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        for (; i + 2 <= size; i += 2)
+        {
+            __m128i *const target = reinterpret_cast<__m128i *>(counters + i);
+            __m128i const sum = _mm_add_epi64(_mm_loadu_si128(target), _mm_loadu_si128(reinterpret_cast<__m128i const *>(other + i)));
+            _mm_storeu_si128(target, sum);
+        }
+#endif
+        for (; i < size; ++i)
+        {
+            counters[i] += other[i];
+        }
+    }
+} // namespace
+
+namespace overwatch::sketch
+{
+    CountMinSketch::CountMinSketch(std::size_t const width, std::size_t const depth)
+        : width_{width}, depth_{depth}, total_{0}, counters_{}
+    {
+        if (width_ == 0 || (width_ & (width_ - 1)) != 0 || width_ > (std::size_t{1} << 31))
+        {
+            throw std::invalid_argument{"Count-Min sketch width " + std::to_string(width_) + " is not a power of two"};
+        }
+        if (depth_ == 0 || depth_ > COUNT_MIN_MAX_DEPTH)
+        {
+            throw std::invalid_argument{"Count-Min sketch depth must be 1 to " + std::to_string(COUNT_MIN_MAX_DEPTH)};
+        }
+        counters_.resize(width_ * depth_, 0);
+    }
+
+    void CountMinSketch::add(std::uint64_t const hash, std::uint64_t const weight) noexcept
+    {
+        for (std::size_t row = 0; row < depth_; ++row)
+        {
+            counters_[index_(hash, row)] += weight;
+        }
+        total_ += weight;
+    }
+
+    std::uint64_t CountMinSketch::estimate(std::uint64_t const hash) const noexcept
+    {
+        std::uint64_t estimate = std::numeric_limits<std::uint64_t>::max();
+        for (std::size_t row = 0; row < depth_; ++row)
+        {
+            estimate = std::min(estimate, counters_[index_(hash, row)]);
+        }
+        return estimate;
+    }
+
+    void CountMinSketch::merge(CountMinSketch const &other)
+    {
+        if (other.width_ != width_ || other.depth_ != depth_)
+        {
+            throw std::invalid_argument{"Count-Min sketches of different shapes cannot be merged"};
+        }
+        add_counters_(counters_.data(), other.counters_.data(), counters_.size());
+        total_ += other.total_;
+    }
+
+    void CountMinSketch::reset() noexcept
+    {
+        std::fill(counters_.begin(), counters_.end(), 0);
+        total_ = 0;
+    }
+
+    std::uint64_t CountMinSketch::get_total() const noexcept
+    {
+        return total_;
+    }
+
+    std::size_t CountMinSketch::get_width() const noexcept
+    {
+        return width_;
+    }
+
+    std::size_t CountMinSketch::get_depth() const noexcept
+    {
+        return depth_;
+    }
+
+    std::size_t CountMinSketch::memory_usage() const noexcept
+    {
+        return counters_.size() * sizeof(std::uint64_t);
+    }
+} // namespace overwatch::sketch
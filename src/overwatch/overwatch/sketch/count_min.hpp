@@ -0,0 +1,116 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace overwatch::sketch
+{
+    // Deepest sketch supported (every row costs one counter update per item)
+    constexpr std::size_t COUNT_MIN_MAX_DEPTH = 8;
+
+    /**
+     * Count-Min sketch of the weights of items.
+     *
+     * Every item adds its weight to one counter in each row, picked by the item's hash, and
+     * its weight is estimated by the smallest of its counters. Estimates never fall below the
+     * true weight and exceed it by at most e / width of the total weight with probability
+     * 1 - e^-depth, whatever the number of distinct items.
+     *
+     * Sketches of the same shape merge exactly by adding their counters.
+     */
+    class CountMinSketch
+    {
+    public:
+        /**
+         * Creates an empty sketch
+         *
+         * @param[in] width Counters per row (a power of two)
+         * @param[in] depth Number of rows (1 to COUNT_MIN_MAX_DEPTH)
+         * @throw std::invalid_argument If the shape is not supported
+         */
+        CountMinSketch(std::size_t const width, std::size_t const depth);
+
+        /**
+         * Adds the weight of an item
+         *
+         * @param[in] hash 64 bit hash of the item
+         * @param[in] weight Weight to add
+         */
+        void add(std::uint64_t const hash, std::uint64_t const weight) noexcept;
+        /**
+         * Estimates the total weight of an item
+         *
+         * @param[in] hash 64 bit hash of the item
+         * @return An upper bound of the weight added for the item
+         */
+        std::uint64_t estimate(std::uint64_t const hash) const noexcept;
+        /**
+         * Adds the counters of another sketch, as if its items had been added to this one
+         *
+         * @param[in] other A sketch of the same shape
+         * @throw std::invalid_argument If the shapes differ
+         */
+        void merge(CountMinSketch const &other);
+        /**
+         * Clears every counter
+         */
+        void reset() noexcept;
+
+        /**
+         * Total weight added
+         * @return The total weight
+         */
+        std::uint64_t get_total() const noexcept;
+        /**
+         * Counters per row
+         * @return The width
+         */
+        std::size_t get_width() const noexcept;
+        /**
+         * Number of rows
+         * @return The depth
+         */
+        std::size_t get_depth() const noexcept;
+        /**
+         * Memory held by the counters
+         * @return The size in bytes
+         */
+        std::size_t memory_usage() const noexcept;
+
+    private:
+        // Counter of an item in a row
+        std::size_t index_(std::uint64_t const hash, std::size_t const row) const noexcept
+        {
+            // Rows use independent enough hashes derived from the two halves of the item's hash
+            std::uint32_t const first = static_cast<std::uint32_t>(hash);
+            std::uint32_t const second = static_cast<std::uint32_t>(hash >> 32) | 1;
+            return row * width_ + ((first + static_cast<std::uint32_t>(row) * second) & (width_ - 1));
+        }
+
+        std::size_t width_;
+        std::size_t depth_;
+        std::uint64_t total_;
+        // Rows stored one after the other
+        std::vector<std::uint64_t> counters_;
+    };
+} // namespace overwatch::sketch
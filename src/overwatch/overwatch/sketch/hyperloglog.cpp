@@ -0,0 +1,166 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "hyperloglog.hpp"
+
+namespace
+{
+    /**
+     * Number of leading zero bits
+     *
+     * @param[in] value A non-zero value
+     * @return The number of leading zero bits
+     */
+    unsigned int leading_zeros_(std::uint64_t const value) noexcept
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return 63 - static_cast<unsigned int>(index);
+#else
+        return static_cast<unsigned int>(__builtin_clzll(value));
+#endif
+    }
+
+    /**
+     * Keeps the largest of every pair of registers
+     *
+     * @param[in,out] registers The registers to update
+     * @param[in] other The registers to merge
+     * @param[in] size Number of registers
+     */
+    void max_registers_(std::uint8_t *const registers, std::uint8_t const *const other, std::size_t const size) noexcept
+    {
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 32 <= size; i += 32)
+        {
+            __m256i *const target = reinterpret_cast<__m256i *>(registers + i);
+            __m256i const max = _mm256_max_epu8(_mm256_loadu_si256(target),
+                                                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(other + i)));
+            _mm256_storeu_si256(target, max);
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i *const target = reinterpret_cast<__m128i *>(registers + i);
+            __m128i const max = _mm_max_epu8(_mm_loadu_si128(target), _mm_loadu_si128(reinterpret_cast<__m128i const *>(other + i)));
+            _mm_storeu_si128(target, max);
+        }
+#endif
+        for (; i < size; ++i)
+        {
+            registers[i] = std::max(registers[i], other[i]);
+        }
+    }
+} // namespace
+
+namespace overwatch::sketch
+{
+    HyperLogLog::HyperLogLog(unsigned int const precision) : precision_{precision}, registers_{}
+    {
+        if (precision_ < HYPERLOGLOG_MIN_PRECISION || precision_ > HYPERLOGLOG_MAX_PRECISION)
+        {
+            throw std::invalid_argument{"HyperLogLog precision must be " + std::to_string(HYPERLOGLOG_MIN_PRECISION) + " to " +
+                                        std::to_string(HYPERLOGLOG_MAX_PRECISION)};
+        }
+        registers_.resize(std::size_t{1} << precision_, 0);
+    }
+
+    void HyperLogLog::add(std::uint64_t const hash) noexcept
+    {
+        std::size_t const index = static_cast<std::size_t>(hash >> (64 - precision_));
+        // The marker bit bounds the rank when the remaining bits are all zero
+        std::uint64_t const remaining = (hash << precision_) | (std::uint64_t{1} << (precision_ - 1));
+        std::uint8_t const rank = static_cast<std::uint8_t>(leading_zeros_(remaining) + 1);
+        registers_[index] = std::max(registers_[index], rank);
+    }
+
+    std::uint64_t HyperLogLog::estimate() const noexcept
+    {
+        double const registers = static_cast<double>(registers_.size());
+        double sum = 0;
+        std::size_t empty = 0;
+        for (std::uint8_t const value : registers_)
+        {
+            sum += std::ldexp(1.0, -static_cast<int>(value));
+            empty += value == 0;
+        }
+        double alpha;
+        switch (registers_.size())
+        {
+        case 16:
+            alpha = 0.673;
+            break;
+        case 32:
+            alpha = 0.697;
+            break;
+        case 64:
+            alpha = 0.709;
+            break;
+        default:
+            alpha = 0.7213 / (1 + 1.079 / registers);
+            break;
+        }
+        double estimate = alpha * registers * registers / sum;
+        // The raw estimate is biased for small counts, linear counting is not
+        if (estimate <= 2.5 * registers && empty > 0)
+        {
+            estimate = registers * std::log(registers / static_cast<double>(empty));
+        }
+        return static_cast<std::uint64_t>(std::llround(estimate));
+    }
+
+    void HyperLogLog::merge(HyperLogLog const &other)
+    {
+        if (other.precision_ != precision_)
+        {
+            throw std::invalid_argument{"HyperLogLog sketches of different precisions cannot be merged"};
+        }
+        max_registers_(registers_.data(), other.registers_.data(), registers_.size());
+    }
+
+    void HyperLogLog::reset() noexcept
+    {
+        std::fill(registers_.begin(), registers_.end(), 0);
+    }
+
+    unsigned int HyperLogLog::get_precision() const noexcept
+    {
+        return precision_;
+    }
+
+    std::size_t HyperLogLog::memory_usage() const noexcept
+    {
+        return registers_.size();
+    }
+} // namespace overwatch::sketch
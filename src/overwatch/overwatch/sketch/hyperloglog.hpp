@@ -0,0 +1,90 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace overwatch::sketch
+{
+    // Supported precisions (2^precision registers, a standard error of about 1.04 / sqrt(2^precision))
+    constexpr unsigned int HYPERLOGLOG_MIN_PRECISION = 4;
+    constexpr unsigned int HYPERLOGLOG_MAX_PRECISION = 16;
+
+    /**
+     * HyperLogLog estimator of the number of distinct items.
+     *
+     * The first bits of an item's hash pick one of the registers, which keeps the longest run
+     * of leading zeros seen in the remaining bits. The registers take one byte each however
+     * many items are added, and sketches of the same precision merge exactly by keeping the
+     * largest of every pair of registers.
+     */
+    class HyperLogLog
+    {
+    public:
+        /**
+         * Creates an empty sketch
+         *
+         * @param[in] precision Bits of the hash picking the register
+         * @throw std::invalid_argument If the precision is not supported
+         */
+        explicit HyperLogLog(unsigned int const precision);
+
+        /**
+         * Adds an item
+         *
+         * @param[in] hash 64 bit hash of the item
+         */
+        void add(std::uint64_t const hash) noexcept;
+        /**
+         * Estimates the number of distinct items added
+         *
+         * @return The estimate (small counts are estimated from the number of empty registers)
+         */
+        std::uint64_t estimate() const noexcept;
+        /**
+         * Merges another sketch, as if its items had been added to this one
+         *
+         * @param[in] other A sketch of the same precision
+         * @throw std::invalid_argument If the precisions differ
+         */
+        void merge(HyperLogLog const &other);
+        /**
+         * Clears every register
+         */
+        void reset() noexcept;
+
+        /**
+         * Bits of the hash picking the register
+         * @return The precision
+         */
+        unsigned int get_precision() const noexcept;
+        /**
+         * Memory held by the registers
+         * @return The size in bytes
+         */
+        std::size_t memory_usage() const noexcept;
+
+    private:
+        unsigned int precision_;
+        std::vector<std::uint8_t> registers_;
+    };
+} // namespace overwatch::sketch
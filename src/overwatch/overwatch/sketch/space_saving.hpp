@@ -0,0 +1,189 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace overwatch::sketch
+{
+    /**
+     * Space-Saving summary of the heaviest items of a stream.
+     *
+     * A fixed number of items are monitored with the weight counted for them. An item that is
+     * not monitored once every slot is taken replaces the lightest monitored item and inherits
+     * its weight, which becomes the item's error. Counts never fall below the true weight and
+     * every item heavier than total / capacity is monitored.
+     *
+     * Summaries merge into a summary with the same guarantees for the combined stream
+     * (Agarwal et al., Mergeable Summaries).
+     *
+     * Slots are scanned linearly, summaries are meant to stay small (tens of items).
+     */
+    template <typename Key>
+    class SpaceSaving
+    {
+    public:
+        /**
+         * A monitored item
+         */
+        struct Item
+        {
+            Key key;
+            std::uint64_t hash;
+            // Upper bound of the item's weight and the part of it that may belong to other items
+            std::uint64_t count;
+            std::uint64_t error;
+        };
+
+        /**
+         * Creates an empty summary
+         *
+         * @param[in] capacity Number of items monitored
+         * @throw std::invalid_argument If capacity is 0
+         */
+        explicit SpaceSaving(std::size_t const capacity) : capacity_{capacity}, items_{}
+        {
+            if (capacity_ == 0)
+            {
+                throw std::invalid_argument{"A Space-Saving summary must monitor at least one item"};
+            }
+            items_.reserve(capacity_);
+        }
+
+        /**
+         * Adds the weight of an item
+         *
+         * @param[in] key The item
+         * @param[in] hash 64 bit hash of the item (compared before the keys)
+         * @param[in] weight Weight to add
+         */
+        void add(Key const &key, std::uint64_t const hash, std::uint64_t const weight) noexcept
+        {
+            for (Item &item : items_)
+            {
+                if (item.hash == hash && item.key == key)
+                {
+                    item.count += weight;
+                    return;
+                }
+            }
+            if (items_.size() < capacity_)
+            {
+                items_.push_back(Item{key, hash, weight, 0});
+                return;
+            }
+            Item &lightest = *std::min_element(items_.begin(), items_.end(), lighter_);
+            lightest = Item{key, hash, lightest.count + weight, lightest.count};
+        }
+
+        /**
+         * Merges another summary, as if its stream had been added to this one
+         *
+         * An item monitored by a single summary may have been counted by the other as part of
+         * its lightest item, that weight is added to its count and its error.
+         *
+         * @param[in] other The other summary
+         */
+        void merge(SpaceSaving const &other)
+        {
+            std::uint64_t const own_floor = floor_();
+            std::uint64_t const other_floor = other.floor_();
+            std::vector<Item> merged;
+            merged.reserve(items_.size() + other.items_.size());
+            for (Item const &item : items_)
+            {
+                Item const *const match = other.find_(item.key, item.hash);
+                merged.push_back(match ? Item{item.key, item.hash, item.count + match->count, item.error + match->error}
+                                       : Item{item.key, item.hash, item.count + other_floor, item.error + other_floor});
+            }
+            for (Item const &item : other.items_)
+            {
+                if (!find_(item.key, item.hash))
+                {
+                    merged.push_back(Item{item.key, item.hash, item.count + own_floor, item.error + own_floor});
+                }
+            }
+            if (merged.size() > capacity_)
+            {
+                std::nth_element(merged.begin(), merged.begin() + static_cast<std::ptrdiff_t>(capacity_), merged.end(),
+                                 [](Item const &first, Item const &second) { return lighter_(second, first); });
+                merged.resize(capacity_);
+            }
+            items_ = std::move(merged);
+        }
+
+        /**
+         * Forgets every item
+         */
+        void reset() noexcept
+        {
+            items_.clear();
+        }
+
+        /**
+         * Monitored items, in no particular order
+         * @return The items
+         */
+        std::vector<Item> const &get_items() const noexcept
+        {
+            return items_;
+        }
+        /**
+         * Number of items monitored once the summary is full
+         * @return The capacity
+         */
+        std::size_t get_capacity() const noexcept
+        {
+            return capacity_;
+        }
+
+    private:
+        static bool lighter_(Item const &first, Item const &second) noexcept
+        {
+            return first.count < second.count;
+        }
+
+        // Weight an item that is not monitored may have (only a full summary replaced items)
+        std::uint64_t floor_() const noexcept
+        {
+            return items_.size() < capacity_ ? 0 : std::min_element(items_.begin(), items_.end(), lighter_)->count;
+        }
+
+        Item const *find_(Key const &key, std::uint64_t const hash) const noexcept
+        {
+            for (Item const &item : items_)
+            {
+                if (item.hash == hash && item.key == key)
+                {
+                    return &item;
+                }
+            }
+            return nullptr;
+        }
+
+        std::size_t capacity_;
+        std::vector<Item> items_;
+    };
+} // namespace overwatch::sketch
@@ -0,0 +1,377 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "decoder.hpp"
+#include "lpm_table.hpp"
+#include "target_summary.hpp"
+
+// Shape of the Count-Min sketches (estimates exceed the true bytes by at most e / width of the
+// total with probability 1 - e^-depth)
+#define SKETCH_WIDTH 256
+#define SKETCH_DEPTH 4
+// Peers and ports monitored as candidates for the heaviest ones
+#define SKETCH_CANDIDATES 32
+// Registers of the distinct counters, 2^precision (a standard error of about 3%)
+#define SKETCH_PRECISION 10
+// Peers and ports reported in a summary
+#define SUMMARY_TOP 10
+
+namespace
+{
+    /**
+     * Finalizes a 64 bit hash (splitmix64)
+     *
+     * @param[in] value The value to mix
+     * @return The mixed value
+     */
+    std::uint64_t mix_(std::uint64_t value) noexcept
+    {
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    /**
+     * Estimated weights of the monitored items of a summary, heaviest first
+     *
+     * @param[in] candidates The summary monitoring the items
+     * @param[in] weights Sketch of the items' weights
+     * @param[in] top Number of items kept at most
+     * @return The items and their weights
+     */
+    template <typename Key>
+    std::vector<std::pair<Key, std::uint64_t>> heaviest_(overwatch::sketch::SpaceSaving<Key> const &candidates,
+                                                         overwatch::sketch::CountMinSketch const &weights, std::size_t const top)
+    {
+        std::vector<std::pair<Key, std::uint64_t>> items;
+        for (auto const &item : candidates.get_items())
+        {
+            // Both overestimate the weight, the tighter bound wins
+            items.emplace_back(item.key, std::min(item.count, weights.estimate(item.hash)));
+        }
+        std::sort(items.begin(), items.end(), [](auto const &first, auto const &second) {
+            return std::tie(second.second, first.first) < std::tie(first.second, second.first);
+        });
+        items.resize(std::min(items.size(), top));
+        return items;
+    }
+} // namespace
+
+namespace overwatch::sketch
+{
+    std::uint64_t hash_peer(PeerAddress const &address) noexcept
+    {
+        std::uint64_t words[2];
+        std::memcpy(words, address.data(), sizeof(words));
+        return mix_(words[0] ^ mix_(words[1]));
+    }
+
+    std::uint64_t hash_port(std::uint32_t const port) noexcept
+    {
+        return mix_(port);
+    }
+
+    TargetSketch::TargetSketch()
+        : packets_{0}, bytes_{0}, peer_bytes_{SKETCH_WIDTH, SKETCH_DEPTH}, top_peers_{SKETCH_CANDIDATES},
+          peers_{SKETCH_PRECISION}, port_bytes_{SKETCH_WIDTH, SKETCH_DEPTH}, top_ports_{SKETCH_CANDIDATES},
+          ports_{SKETCH_PRECISION}
+    {
+    }
+
+    void TargetSketch::add(PeerAddress const &peer, std::uint64_t const peer_hash, std::uint32_t const port,
+                           std::uint64_t const port_hash, std::uint64_t const bytes) noexcept
+    {
+        ++packets_;
+        bytes_ += bytes;
+        peer_bytes_.add(peer_hash, bytes);
+        top_peers_.add(peer, peer_hash, bytes);
+        peers_.add(peer_hash);
+        if (port != 0)
+        {
+            port_bytes_.add(port_hash, bytes);
+            top_ports_.add(port, port_hash, bytes);
+            ports_.add(port_hash);
+        }
+    }
+
+    void TargetSketch::merge(TargetSketch const &other)
+    {
+        packets_ += other.packets_;
+        bytes_ += other.bytes_;
+        peer_bytes_.merge(other.peer_bytes_);
+        top_peers_.merge(other.top_peers_);
+        peers_.merge(other.peers_);
+        port_bytes_.merge(other.port_bytes_);
+        top_ports_.merge(other.top_ports_);
+        ports_.merge(other.ports_);
+    }
+
+    void TargetSketch::reset() noexcept
+    {
+        packets_ = 0;
+        bytes_ = 0;
+        peer_bytes_.reset();
+        top_peers_.reset();
+        peers_.reset();
+        port_bytes_.reset();
+        top_ports_.reset();
+        ports_.reset();
+    }
+
+    bool TargetSketch::empty() const noexcept
+    {
+        return packets_ == 0;
+    }
+
+    TargetSummary TargetSketch::summarize(std::size_t const top) const
+    {
+        TargetSummary summary;
+        summary.packets = packets_;
+        summary.bytes = bytes_;
+        summary.peers = peers_.estimate();
+        summary.ports = ports_.estimate();
+        for (auto const &[address, bytes] : heaviest_(top_peers_, peer_bytes_, top))
+        {
+            summary.top_peers.push_back(PeerBytes{address, bytes});
+        }
+        for (auto const &[port, bytes] : heaviest_(top_ports_, port_bytes_, top))
+        {
+            summary.top_ports.push_back(PortBytes{static_cast<std::uint8_t>(port >> 16), static_cast<std::uint16_t>(port), bytes});
+        }
+        return summary;
+    }
+
+    std::size_t TargetSketch::memory_usage() const noexcept
+    {
+        return sizeof(*this) + peer_bytes_.memory_usage() + peers_.memory_usage() + port_bytes_.memory_usage() +
+               ports_.memory_usage() + top_peers_.get_capacity() * sizeof(SpaceSaving<PeerAddress>::Item) +
+               top_ports_.get_capacity() * sizeof(SpaceSaving<std::uint32_t>::Item);
+    }
+
+    Summarizer::Summarizer(std::size_t const targets, std::uint64_t const interval_ns, std::size_t const windows, SummarySink sink)
+        : targets_{targets}, interval_ns_{interval_ns}, windows_{windows}, sink_{std::move(sink)}, mutex_{}, slots_(targets),
+          latest_{0}, started_{false}, summarized_{false}, merged_{}, summaries_{}, late_{}
+    {
+        if (interval_ns_ == 0 || windows_ == 0)
+        {
+            throw std::invalid_argument{"Traffic summaries need an interval and at least one interval per window"};
+        }
+    }
+
+    void Summarizer::submit(std::uint64_t const interval, std::uint32_t const target, TargetSketch const &sketch)
+    {
+        std::lock_guard<std::mutex> const lock{mutex_};
+        if (!started_)
+        {
+            started_ = true;
+            latest_ = interval;
+        }
+        else if (interval > latest_)
+        {
+            if (!summarized_)
+            {
+                summarize_(latest_);
+            }
+            latest_ = interval;
+            summarized_ = false;
+        }
+        if (interval + windows_ <= latest_)
+        {
+            late_.add(1);
+            return;
+        }
+        std::vector<Slot> &slots = slots_.at(target);
+        if (slots.empty())
+        {
+            slots.resize(windows_);
+        }
+        Slot &slot = slots[interval % windows_];
+        if (!slot.sketch)
+        {
+            slot.sketch = std::make_unique<TargetSketch>();
+            slot.interval = interval;
+        }
+        else if (slot.interval != interval)
+        {
+            // The slot still holds an interval that left the window
+            slot.sketch->reset();
+            slot.interval = interval;
+        }
+        slot.sketch->merge(sketch);
+    }
+
+    void Summarizer::finish()
+    {
+        std::lock_guard<std::mutex> const lock{mutex_};
+        if (started_ && !summarized_)
+        {
+            summarize_(latest_);
+            summarized_ = true;
+        }
+    }
+
+    std::size_t Summarizer::get_targets() const noexcept
+    {
+        return targets_;
+    }
+
+    std::uint64_t Summarizer::get_interval() const noexcept
+    {
+        return interval_ns_;
+    }
+
+    std::uint64_t Summarizer::get_summaries() const noexcept
+    {
+        return summaries_.load();
+    }
+
+    std::uint64_t Summarizer::get_late() const noexcept
+    {
+        return late_.load();
+    }
+
+    void Summarizer::summarize_(std::uint64_t const last)
+    {
+        std::uint64_t const first = last + 1 - std::min<std::uint64_t>(windows_, last + 1);
+        for (std::size_t target = 0; target < targets_; ++target)
+        {
+            merged_.reset();
+            for (Slot const &slot : slots_[target])
+            {
+                if (slot.sketch && slot.interval >= first && slot.interval <= last)
+                {
+                    merged_.merge(*slot.sketch);
+                }
+            }
+            if (merged_.empty())
+            {
+                continue;
+            }
+            TargetSummary summary = merged_.summarize(SUMMARY_TOP);
+            summary.target = static_cast<std::uint32_t>(target);
+            summary.start_ns = first * interval_ns_;
+            summary.end_ns = (last + 1) * interval_ns_;
+            sink_(summary);
+            summaries_.add(1);
+        }
+    }
+
+    SummaryStage::SummaryStage(Summarizer &summarizer)
+        : summarizer_{summarizer}, sketches_(summarizer.get_targets()), active_{}, interval_{0}, packets_{}
+    {
+    }
+
+    char const *SummaryStage::name() const noexcept
+    {
+        return "summary";
+    }
+
+    void SummaryStage::process(core::PacketBurst &burst)
+    {
+        std::uint64_t const interval = burst.now_ns / summarizer_.get_interval();
+        if (interval != interval_)
+        {
+            submit_();
+            interval_ = interval;
+        }
+        for (std::size_t i = 0; i < burst.size; ++i)
+        {
+            std::uint32_t const src_target = burst.src_targets[i];
+            std::uint32_t const dst_target = burst.dst_targets[i];
+            if (!burst.has_flow[i] || (src_target == core::LpmTable::NO_MATCH && dst_target == core::LpmTable::NO_MATCH))
+            {
+                continue;
+            }
+            // Canonical keys are oriented by address, not by the packet's direction
+            core::FlowKey const &key = burst.flow_keys[i];
+            bool const forward = burst.flow_directions[i] == 0;
+            std::uint64_t const bytes = burst.packets[i].wire_len;
+            if (src_target != core::LpmTable::NO_MATCH)
+            {
+                add_(src_target, forward ? key.dst_addr : key.src_addr, key.protocol, forward ? key.dst_port : key.src_port, bytes);
+            }
+            if (dst_target != core::LpmTable::NO_MATCH)
+            {
+                add_(dst_target, forward ? key.src_addr : key.dst_addr, key.protocol, forward ? key.src_port : key.dst_port, bytes);
+            }
+        }
+    }
+
+    void SummaryStage::flush(core::PacketBurst &)
+    {
+        submit_();
+    }
+
+    void SummaryStage::publish(stats::Registry &registry, stats::Labels const &labels,
+                               std::vector<stats::Registration> &registrations) const
+    {
+        registrations.push_back(registry.add_counter("overwatch_sketched_packets_total",
+                                                     "Packets accounted to the traffic summaries of the targets", labels, packets_));
+    }
+
+    std::uint64_t SummaryStage::get_packets() const noexcept
+    {
+        return packets_.load();
+    }
+
+    std::size_t SummaryStage::memory_usage() const noexcept
+    {
+        std::size_t usage = 0;
+        for (std::unique_ptr<TargetSketch> const &sketch : sketches_)
+        {
+            usage += sketch ? sketch->memory_usage() : 0;
+        }
+        return usage;
+    }
+
+    void SummaryStage::add_(std::uint32_t const target, PeerAddress const &peer, std::uint8_t const protocol,
+                            std::uint16_t const port, std::uint64_t const bytes)
+    {
+        std::unique_ptr<TargetSketch> &sketch = sketches_[target];
+        if (!sketch)
+        {
+            sketch = std::make_unique<TargetSketch>();
+        }
+        if (sketch->empty())
+        {
+            active_.push_back(target);
+        }
+        bool const has_ports = protocol == decode::PROTOCOL_TCP || protocol == decode::PROTOCOL_UDP;
+        std::uint32_t const port_key = has_ports ? make_port_key(protocol, port) : 0;
+        sketch->add(peer, hash_peer(peer), port_key, has_ports ? hash_port(port_key) : 0, bytes);
+        packets_.add(1);
+    }
+
+    void SummaryStage::submit_()
+    {
+        for (std::uint32_t const target : active_)
+        {
+            summarizer_.submit(interval_, target, *sketches_[target]);
+            sketches_[target]->reset();
+        }
+        active_.clear();
+    }
+} // namespace overwatch::sketch
@@ -0,0 +1,312 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "count_min.hpp"
+#include "hyperloglog.hpp"
+#include "pipeline.hpp"
+#include "space_saving.hpp"
+#include "stats_registry.hpp"
+
+namespace overwatch::sketch
+{
+    // Address of a peer (IPv4 addresses are IPv4-mapped, see core::FlowKey)
+    using PeerAddress = std::array<std::uint8_t, 16>;
+
+    /**
+     * Traffic exchanged with a peer or on a port, as estimated by the sketches
+     */
+    struct PeerBytes
+    {
+        PeerAddress address;
+        std::uint64_t bytes;
+    };
+
+    struct PortBytes
+    {
+        std::uint8_t protocol;
+        std::uint16_t port;
+        std::uint64_t bytes;
+    };
+
+    /**
+     * Traffic of a target over a window
+     */
+    struct TargetSummary
+    {
+        // Index of the target in the lookup table
+        std::uint32_t target = 0;
+        // Capture time covered by the window
+        std::uint64_t start_ns = 0;
+        std::uint64_t end_ns = 0;
+        // Exact totals
+        std::uint64_t packets = 0;
+        std::uint64_t bytes = 0;
+        // Estimated number of distinct peers and of distinct remote TCP and UDP ports
+        std::uint64_t peers = 0;
+        std::uint64_t ports = 0;
+        // Heaviest peers and remote ports, heaviest first
+        std::vector<PeerBytes> top_peers;
+        std::vector<PortBytes> top_ports;
+    };
+
+    using SummarySink = std::function<void(TargetSummary const &)>;
+
+    /**
+     * Fixed size sketches of the traffic of a target: the bytes exchanged with every peer and
+     * remote port (Count-Min), the heaviest of them (Space-Saving) and how many distinct peers
+     * and ports there are (HyperLogLog).
+     *
+     * Its size does not depend on the traffic, a scan of the whole address space costs no
+     * more memory than a single peer.
+     */
+    class TargetSketch
+    {
+    public:
+        /**
+         * Creates empty sketches
+         */
+        TargetSketch();
+
+        /**
+         * Accounts a packet exchanged with a peer
+         *
+         * @param[in] peer Address of the peer
+         * @param[in] peer_hash Hash of the address (see hash_peer)
+         * @param[in] port Protocol and remote port (see make_port_key) or 0 if the packet has no ports
+         * @param[in] port_hash Hash of the port key (see hash_port)
+         * @param[in] bytes Size of the packet
+         */
+        void add(PeerAddress const &peer, std::uint64_t const peer_hash, std::uint32_t const port, std::uint64_t const port_hash,
+                 std::uint64_t const bytes) noexcept;
+        /**
+         * Merges the sketches of the same target on another worker or in another window
+         *
+         * @param[in] other The other sketches
+         */
+        void merge(TargetSketch const &other);
+        /**
+         * Clears the sketches
+         */
+        void reset() noexcept;
+        /**
+         * Whether no packet was accounted since the last reset
+         * @return True if the sketches are empty
+         */
+        bool empty() const noexcept;
+        /**
+         * Summarizes the traffic (leaves the target and the window unset)
+         *
+         * @param[in] top Number of peers and ports reported at most
+         * @return The summary
+         */
+        TargetSummary summarize(std::size_t const top) const;
+        /**
+         * Memory held by the sketches
+         * @return The size in bytes
+         */
+        std::size_t memory_usage() const noexcept;
+
+    private:
+        std::uint64_t packets_;
+        std::uint64_t bytes_;
+        CountMinSketch peer_bytes_;
+        SpaceSaving<PeerAddress> top_peers_;
+        HyperLogLog peers_;
+        CountMinSketch port_bytes_;
+        SpaceSaving<std::uint32_t> top_ports_;
+        HyperLogLog ports_;
+    };
+
+    /**
+     * Key of a remote port
+     *
+     * @param[in] protocol IP protocol number
+     * @param[in] port The port
+     * @return The key
+     */
+    inline std::uint32_t make_port_key(std::uint8_t const protocol, std::uint16_t const port) noexcept
+    {
+        return static_cast<std::uint32_t>(protocol) << 16 | port;
+    }
+
+    /**
+     * Hashes the address of a peer
+     *
+     * @param[in] address The address
+     * @return The 64 bit hash of the address
+     */
+    std::uint64_t hash_peer(PeerAddress const &address) noexcept;
+    /**
+     * Hashes the key of a port
+     *
+     * @param[in] port The key (see make_port_key)
+     * @return The 64 bit hash of the key
+     */
+    std::uint64_t hash_port(std::uint32_t const port) noexcept;
+
+    /**
+     * Combines the sketches of every worker into summaries of every target over sliding windows.
+     *
+     * Capture time is divided in intervals. Workers hand the sketches of the targets they saw
+     * over once an interval ends for them, and the summarizer merges them into the interval's
+     * slot of the target. Once the first sketches of a later interval arrive, every target is
+     * summarized over the last intervals, merged from their slots. Memory is bounded by the
+     * number of targets and intervals, not by the traffic.
+     *
+     * Sketches handed over after their interval was summarized still count for the following
+     * summaries, unless their interval left the window.
+     */
+    class Summarizer
+    {
+    public:
+        /**
+         * Creates the summarizer
+         *
+         * @param[in] targets Number of targets in the lookup table
+         * @param[in] interval_ns Length of an interval (time between two summaries)
+         * @param[in] windows Number of intervals covered by a summary
+         * @param[in] sink Called with the summary of every target that had traffic in the window
+         * @throw std::invalid_argument If the interval or the number of intervals is 0
+         */
+        Summarizer(std::size_t const targets, std::uint64_t const interval_ns, std::size_t const windows, SummarySink sink);
+
+        /**
+         * Hands the sketches of a target over (thread safe)
+         *
+         * Summarizes the previous intervals first if the interval is the first one of its kind,
+         * so the calling worker runs the sink.
+         *
+         * @param[in] interval Index of the interval (capture time / interval length)
+         * @param[in] target Index of the target
+         * @param[in] sketch Sketches of the target during the interval on one worker
+         */
+        void submit(std::uint64_t const interval, std::uint32_t const target, TargetSketch const &sketch);
+        /**
+         * Summarizes the last interval, once the workers handed their last sketches over
+         */
+        void finish();
+
+        /**
+         * Number of targets
+         * @return The number of targets
+         */
+        std::size_t get_targets() const noexcept;
+        /**
+         * Length of an interval
+         * @return The length in nanoseconds
+         */
+        std::uint64_t get_interval() const noexcept;
+        /**
+         * Number of summaries handed to the sink
+         * @return The number of summaries
+         */
+        std::uint64_t get_summaries() const noexcept;
+        /**
+         * Number of sketches handed over after their interval left the window
+         * @return The number of dropped sketches
+         */
+        std::uint64_t get_late() const noexcept;
+
+    private:
+        // Sketches of a target merged for an interval
+        struct Slot
+        {
+            std::uint64_t interval = 0;
+            std::unique_ptr<TargetSketch> sketch;
+        };
+
+        // Summarizes every target over the window ending with an interval, the mutex must be held
+        void summarize_(std::uint64_t const last);
+
+        std::size_t const targets_;
+        std::uint64_t const interval_ns_;
+        std::size_t const windows_;
+        SummarySink const sink_;
+        std::mutex mutex_;
+        // Slots of every target, indexed by interval modulo windows
+        std::vector<std::vector<Slot>> slots_;
+        // Latest interval handed over and whether it was summarized
+        std::uint64_t latest_;
+        bool started_;
+        bool summarized_;
+        TargetSketch merged_;
+        stats::Counter summaries_;
+        stats::Counter late_;
+    };
+
+    /**
+     * Sketches the traffic every target of the worker exchanges with its peers and hands the
+     * sketches over to the summarizer at the end of every interval (capture time).
+     *
+     * Sketches are only allocated for targets with traffic and reused across intervals.
+     * Updates touch nothing but the worker's own sketches, no locking is involved.
+     */
+    class SummaryStage : public core::Stage
+    {
+    public:
+        /**
+         * Creates the stage
+         *
+         * @param[in] summarizer The summarizer (must outlive the stage)
+         */
+        explicit SummaryStage(Summarizer &summarizer);
+
+        char const *name() const noexcept override;
+        void process(core::PacketBurst &burst) override;
+        void flush(core::PacketBurst &burst) override;
+        void publish(stats::Registry &registry, stats::Labels const &labels,
+                     std::vector<stats::Registration> &registrations) const override;
+
+        /**
+         * Number of packets sketched (twice if both endpoints are targets)
+         * @return The number of packets
+         */
+        std::uint64_t get_packets() const noexcept;
+        /**
+         * Memory held by the sketches of the worker
+         * @return The size in bytes
+         */
+        std::size_t memory_usage() const noexcept;
+
+    private:
+        // Accounts a packet to a target
+        void add_(std::uint32_t const target, PeerAddress const &peer, std::uint8_t const protocol, std::uint16_t const port,
+                  std::uint64_t const bytes);
+        // Hands the sketches of the current interval over
+        void submit_();
+
+        Summarizer &summarizer_;
+        // Indexed by target (null until the target has traffic)
+        std::vector<std::unique_ptr<TargetSketch>> sketches_;
+        // Targets with traffic in the current interval
+        std::vector<std::uint32_t> active_;
+        std::uint64_t interval_;
+        stats::Counter packets_;
+    };
+} // namespace overwatch::sketch
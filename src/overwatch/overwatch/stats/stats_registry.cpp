@@ -0,0 +1,219 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "stats_registry.hpp"
+
+namespace overwatch::stats
+{
+    namespace
+    {
+        /**
+         * Determines if a string is a valid Prometheus metric or label name
+         *
+         * @param[in] name The name to check
+         * @param[in] allow_colon Metric names may contain colons, label names may not
+         * @return True if the name is valid
+         */
+        bool valid_name_(std::string const &name, bool const allow_colon) noexcept
+        {
+            if (name.empty() || (name[0] >= '0' && name[0] <= '9'))
+            {
+                return false;
+            }
+            return std::all_of(name.begin(), name.end(), [allow_colon](char const c) {
+                return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' ||
+                       (allow_colon && c == ':');
+            });
+        }
+
+        /**
+         * Escapes a string for the Prometheus text format
+         *
+         * @param[in] value The string to escape
+         * @param[in] quote Also escape double quotes (label values)
+         * @return The escaped string
+         */
+        std::string escape_(std::string const &value, bool const quote)
+        {
+            std::string escaped;
+            escaped.reserve(value.size());
+            for (char const c : value)
+            {
+                if (c == '\\')
+                {
+                    escaped += "\\\\";
+                }
+                else if (c == '\n')
+                {
+                    escaped += "\\n";
+                }
+                else if (quote && c == '"')
+                {
+                    escaped += "\\\"";
+                }
+                else
+                {
+                    escaped += c;
+                }
+            }
+            return escaped;
+        }
+    } // namespace
+
+    Registration::Registration() noexcept : registry_{nullptr}, id_{0}
+    {
+    }
+
+    Registration::Registration(Registry *registry, std::uint64_t const id) noexcept : registry_{registry}, id_{id}
+    {
+    }
+
+    Registration::~Registration()
+    {
+        reset();
+    }
+
+    Registration::Registration(Registration &&other) noexcept : registry_{other.registry_}, id_{other.id_}
+    {
+        other.registry_ = nullptr;
+    }
+
+    Registration &Registration::operator=(Registration &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            registry_ = other.registry_;
+            id_ = other.id_;
+            other.registry_ = nullptr;
+        }
+        return *this;
+    }
+
+    void Registration::reset() noexcept
+    {
+        if (registry_)
+        {
+            registry_->remove_(id_);
+            registry_ = nullptr;
+        }
+    }
+
+    Registration Registry::add(std::string name, std::string help, MetricType const type, Labels labels, SampleFunction sample)
+    {
+        if (!valid_name_(name, true))
+        {
+            throw std::invalid_argument{"Invalid metric name '" + name + "'"};
+        }
+        for (std::pair<std::string, std::string> const &label : labels)
+        {
+            if (!valid_name_(label.first, false))
+            {
+                throw std::invalid_argument{"Invalid label name '" + label.first + "' of metric '" + name + "'"};
+            }
+        }
+        if (!sample)
+        {
+            throw std::invalid_argument{"Metric '" + name + "' has no sample function"};
+        }
+
+        std::lock_guard<std::mutex> const lock{mutex_};
+        for (Metric const &metric : metrics_)
+        {
+            if (metric.name == name && metric.type != type)
+            {
+                throw std::invalid_argument{"Metric '" + name + "' is already published with another type"};
+            }
+        }
+        std::uint64_t const id = next_id_++;
+        metrics_.push_back(Metric{id, std::move(name), std::move(help), type, std::move(labels), std::move(sample)});
+        return Registration{this, id};
+    }
+
+    Registration Registry::add_counter(std::string name, std::string help, Labels labels, Counter const &counter)
+    {
+        return add(std::move(name), std::move(help), MetricType::Counter, std::move(labels),
+                   [&counter]() { return counter.load(); });
+    }
+
+    std::vector<Sample> Registry::collect() const
+    {
+        std::vector<Sample> samples;
+        {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            samples.reserve(metrics_.size());
+            for (Metric const &metric : metrics_)
+            {
+                samples.push_back(Sample{metric.name, metric.help, metric.type, metric.labels, metric.sample()});
+            }
+        }
+        // Registration order within a name is kept (e.g. worker 0 before worker 1)
+        std::stable_sort(samples.begin(), samples.end(), [](Sample const &a, Sample const &b) { return a.name < b.name; });
+        return samples;
+    }
+
+    std::size_t Registry::size() const
+    {
+        std::lock_guard<std::mutex> const lock{mutex_};
+        return metrics_.size();
+    }
+
+    void Registry::remove_(std::uint64_t const id) noexcept
+    {
+        std::lock_guard<std::mutex> const lock{mutex_};
+        metrics_.erase(std::remove_if(metrics_.begin(), metrics_.end(), [id](Metric const &metric) { return metric.id == id; }),
+                       metrics_.end());
+    }
+
+    Registry &default_registry() noexcept
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    std::string to_prometheus(std::vector<Sample> const &samples)
+    {
+        std::string text;
+        for (std::size_t i = 0; i < samples.size(); ++i)
+        {
+            Sample const &sample = samples[i];
+            if (i == 0 || samples[i - 1].name != sample.name)
+            {
+                text += "# HELP " + sample.name + " " + escape_(sample.help, false) + "\n";
+                text += "# TYPE " + sample.name + (sample.type == MetricType::Counter ? " counter\n" : " gauge\n");
+            }
+            text += sample.name;
+            if (!sample.labels.empty())
+            {
+                text += "{";
+                for (std::size_t j = 0; j < sample.labels.size(); ++j)
+                {
+                    text += (j == 0 ? "" : ",") + sample.labels[j].first + "=\"" + escape_(sample.labels[j].second, true) + "\"";
+                }
+                text += "}";
+            }
+            text += " " + std::to_string(sample.value) + "\n";
+        }
+        return text;
+    }
+} // namespace overwatch::stats
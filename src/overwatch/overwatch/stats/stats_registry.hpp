@@ -0,0 +1,216 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace overwatch::stats
+{
+    /**
+     * Counter with a single writer and any number of concurrent readers.
+     *
+     * The owning thread updates it with a plain load and store (no locked instruction),
+     * readers always see whole values. Group the counters of a thread in a struct aligned
+     * to a cache line so that they never share a line with the counters of another thread.
+     */
+    class Counter
+    {
+    public:
+        /**
+         * Adds to the counter (owning thread only)
+         * @param[in] value The amount to add
+         */
+        void add(std::uint64_t const value = 1) noexcept
+        {
+            value_.store(value_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+        /**
+         * Sets the counter, e.g. when it is used as a gauge (owning thread only)
+         * @param[in] value The new value
+         */
+        void set(std::uint64_t const value) noexcept
+        {
+            value_.store(value, std::memory_order_relaxed);
+        }
+        /**
+         * Reads the counter (any thread)
+         * @return The current value
+         */
+        std::uint64_t load() const noexcept
+        {
+            return value_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<std::uint64_t> value_{0};
+    };
+
+    /**
+     * Kind of a metric (Prometheus semantics)
+     */
+    enum class MetricType
+    {
+        // Only ever goes up
+        Counter,
+        // Goes up and down
+        Gauge
+    };
+
+    // Name and value of every label of a metric
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+    // Reads the current value of a metric (must be cheap and safe to call from any thread)
+    using SampleFunction = std::function<std::uint64_t()>;
+
+    /**
+     * Value of a metric at collection time
+     */
+    struct Sample
+    {
+        std::string name;
+        std::string help;
+        MetricType type = MetricType::Counter;
+        Labels labels;
+        std::uint64_t value = 0;
+    };
+
+    class Registry;
+
+    /**
+     * Keeps a metric registered for as long as it lives
+     */
+    class Registration
+    {
+    public:
+        Registration() noexcept;
+        ~Registration();
+        Registration(Registration &&other) noexcept;
+        Registration &operator=(Registration &&other) noexcept;
+
+        Registration(Registration const &) = delete;
+        Registration &operator=(Registration const &) = delete;
+
+        /**
+         * Removes the metric from its registry
+         */
+        void reset() noexcept;
+
+    private:
+        friend class Registry;
+        Registration(Registry *registry, std::uint64_t const id) noexcept;
+
+        // Registry of the metric (null once reset)
+        Registry *registry_;
+        // Identifier of the metric within the registry
+        std::uint64_t id_;
+    };
+
+    /**
+     * Set of metrics published by the subsystems of the instance.
+     *
+     * Metrics are read through sample functions at collection time only, so publishing a
+     * metric costs the hot path nothing: the registry lock is taken when metrics come and
+     * go and when the reporter collects, never when a counter is updated.
+     */
+    class Registry
+    {
+    public:
+        Registry() = default;
+        Registry(Registry const &) = delete;
+        Registry &operator=(Registry const &) = delete;
+
+        /**
+         * Publishes a metric
+         *
+         * @param[in] name Metric name (Prometheus syntax, metrics sharing a name must share the type)
+         * @param[in] help Description of the metric
+         * @param[in] type Kind of the metric
+         * @param[in] labels Labels telling metrics of the same name apart (e.g. the worker)
+         * @param[in] sample Reads the value of the metric
+         * @return The registration keeping the metric published
+         * @throw std::invalid_argument If a name is invalid or the type conflicts with an existing metric
+         */
+        Registration add(std::string name, std::string help, MetricType const type, Labels labels, SampleFunction sample);
+        /**
+         * Publishes a counter
+         *
+         * @param[in] name Metric name (Prometheus syntax, should end in '_total')
+         * @param[in] help Description of the metric
+         * @param[in] labels Labels telling metrics of the same name apart (e.g. the worker)
+         * @param[in] counter The counter (must outlive the registration)
+         * @return The registration keeping the metric published
+         * @throw std::invalid_argument If a name is invalid or the type conflicts with an existing metric
+         */
+        Registration add_counter(std::string name, std::string help, Labels labels, Counter const &counter);
+
+        /**
+         * Reads every published metric
+         * @return The samples ordered by name
+         */
+        std::vector<Sample> collect() const;
+        /**
+         * Number of published metrics
+         * @return The number of metrics
+         */
+        std::size_t size() const;
+
+    private:
+        friend class Registration;
+
+        struct Metric
+        {
+            std::uint64_t id;
+            std::string name;
+            std::string help;
+            MetricType type;
+            Labels labels;
+            SampleFunction sample;
+        };
+
+        // Withdraws a metric
+        void remove_(std::uint64_t const id) noexcept;
+
+        // Guards the metric list (never taken by the writers of the counters)
+        mutable std::mutex mutex_;
+        std::vector<Metric> metrics_;
+        std::uint64_t next_id_ = 0;
+    };
+
+    /**
+     * Registry shared by every subsystem of the instance
+     * @return The registry
+     */
+    Registry &default_registry() noexcept;
+
+    /**
+     * Formats samples in the Prometheus text exposition format
+     *
+     * @param[in] samples Samples ordered by name
+     * @return The metrics, one line per sample
+     */
+    std::string to_prometheus(std::vector<Sample> const &samples);
+} // namespace overwatch::stats
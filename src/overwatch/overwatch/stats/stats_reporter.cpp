@@ -0,0 +1,288 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+#include "logging.hpp"
+#include "stats_reporter.hpp"
+#include "timing.hpp"
+
+// Connections waiting to be answered by the reporter thread
+#define STATS_SOCKET_BACKLOG 16
+#define NANOSECONDS_PER_MILLISECOND 1000000ULL
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+namespace overwatch::stats
+{
+#ifdef __linux__
+    namespace
+    {
+        /**
+         * Removes a socket left behind at a path, never any other kind of file
+         *
+         * @param[in] path The socket path
+         * @return False if something other than a socket exists at the path
+         */
+        bool remove_socket_(std::string const &path) noexcept
+        {
+            struct stat path_stat{};
+            if (lstat(path.c_str(), &path_stat) < 0)
+            {
+                return errno == ENOENT;
+            }
+            if (!S_ISSOCK(path_stat.st_mode))
+            {
+                return false;
+            }
+            unlink(path.c_str());
+            return true;
+        }
+    } // namespace
+#endif
+
+    Reporter::Reporter(Registry const &registry, std::uint32_t const interval_ms, std::optional<std::string> output)
+        : registry_{registry}, interval_ms_{interval_ms}, file_path_{}, socket_path_{}, listen_fd_{-1}, stop_{}, thread_{},
+          previous_totals_{}, previous_ns_{common::timing::monotonic_ns()}
+    {
+        if (interval_ms_ == 0)
+        {
+            throw std::invalid_argument{"Stats interval must not be 0"};
+        }
+        if (output && output->rfind(STATS_SOCKET_PREFIX, 0) == 0)
+        {
+            socket_path_ = output->substr(std::strlen(STATS_SOCKET_PREFIX));
+            open_socket_();
+        }
+        else if (output)
+        {
+            file_path_ = *output;
+        }
+    }
+
+    Reporter::~Reporter()
+    {
+        stop();
+        close_();
+    }
+
+    void Reporter::start()
+    {
+        if (!thread_.joinable())
+        {
+            stop_.reset();
+            thread_ = std::thread{&Reporter::run_, this};
+        }
+    }
+
+    void Reporter::stop() noexcept
+    {
+        stop_.trigger();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+    std::string Reporter::report()
+    {
+        std::vector<Sample> const samples = registry_.collect();
+        std::string const text = to_prometheus(samples);
+        log_(samples);
+        if (!file_path_.empty())
+        {
+            write_file_(text);
+        }
+        return text;
+    }
+
+    void Reporter::run_() noexcept
+    {
+        std::uint64_t const interval_ns = interval_ms_ * NANOSECONDS_PER_MILLISECOND;
+        std::uint64_t next_report_ns = common::timing::monotonic_ns() + interval_ns;
+        while (!stop_.triggered())
+        {
+            try
+            {
+                std::uint64_t const now = common::timing::monotonic_ns();
+                if (now >= next_report_ns)
+                {
+                    report();
+                    // Skip the reports missed while the host was stalled rather than catching up
+                    next_report_ns = std::max(next_report_ns + interval_ns, now + 1);
+                    continue;
+                }
+                int const timeout_ms = static_cast<int>((next_report_ns - now + NANOSECONDS_PER_MILLISECOND - 1) / NANOSECONDS_PER_MILLISECOND);
+#ifdef __linux__
+                if (listen_fd_ >= 0)
+                {
+                    pollfd pfds[2] = {{stop_.get_fd(), POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+                    if (poll(pfds, 2, timeout_ms) > 0 && (pfds[1].revents & POLLIN))
+                    {
+                        serve_();
+                    }
+                    continue;
+                }
+#endif
+                stop_.wait(timeout_ms);
+            }
+            catch (std::exception const &e)
+            {
+                LOG_ERROR << "Failed to report stats: " << e.what();
+                next_report_ns = common::timing::monotonic_ns() + interval_ns;
+            }
+        }
+    }
+
+    void Reporter::log_(std::vector<Sample> const &samples)
+    {
+        std::uint64_t const now = common::timing::monotonic_ns();
+        double const elapsed_s = static_cast<double>(now - previous_ns_) / NANOSECONDS_PER_SECOND;
+        previous_ns_ = now;
+
+        // Every label of a metric adds up to its total
+        std::map<std::string, std::pair<MetricType, std::uint64_t>> totals;
+        for (Sample const &sample : samples)
+        {
+            auto &total = totals.emplace(sample.name, std::make_pair(sample.type, 0)).first->second;
+            total.second += sample.value;
+        }
+
+        std::string line;
+        for (auto const &[name, total] : totals)
+        {
+            line += (line.empty() ? "" : ", ") + name + "=" + std::to_string(total.second);
+            auto const previous = previous_totals_.find(name);
+            if (total.first == MetricType::Counter && previous != previous_totals_.end() && elapsed_s > 0 &&
+                total.second >= previous->second)
+            {
+                char rate[32];
+                std::snprintf(rate, sizeof(rate), " (%.1f/s)", static_cast<double>(total.second - previous->second) / elapsed_s);
+                line += rate;
+            }
+            previous_totals_[name] = total.second;
+        }
+        LOG_INFO << "Stats: " << (line.empty() ? std::string{"no metrics"} : line);
+    }
+
+    void Reporter::write_file_(std::string const &text)
+    {
+        std::string const temp_path = file_path_ + ".tmp";
+        {
+            std::ofstream file{temp_path, std::ios::trunc};
+            if (!(file << text) || !file.flush())
+            {
+                throw std::runtime_error{"Failed to write stats file '" + temp_path + "'"};
+            }
+        }
+        if (std::rename(temp_path.c_str(), file_path_.c_str()) != 0)
+        {
+            throw std::runtime_error{"Failed to replace stats file '" + file_path_ + "' - " + std::strerror(errno)};
+        }
+    }
+
+#ifdef __linux__
+    void Reporter::open_socket_()
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (socket_path_.empty() || socket_path_.size() >= sizeof(addr.sun_path))
+        {
+            throw std::invalid_argument{"Invalid stats socket path '" + socket_path_ + "'"};
+        }
+        std::memcpy(addr.sun_path, socket_path_.c_str(), socket_path_.size());
+
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0)
+        {
+            throw std::runtime_error{std::string{"Failed to open the stats socket - "} + std::strerror(errno)};
+        }
+        // A socket left behind by a previous instance would make bind fail
+        if (!remove_socket_(socket_path_))
+        {
+            close(listen_fd_);
+            listen_fd_ = -1;
+            throw std::runtime_error{"Stats socket path '" + socket_path_ + "' is taken by something other than a socket"};
+        }
+        if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(listen_fd_, STATS_SOCKET_BACKLOG) < 0)
+        {
+            int const error = errno;
+            close_();
+            throw std::runtime_error{"Failed to listen on stats socket '" + socket_path_ + "' - " + std::strerror(error)};
+        }
+        LOG_DEBUG << "Serving stats on '" << socket_path_ << "'";
+    }
+
+    void Reporter::close_() noexcept
+    {
+        if (listen_fd_ >= 0)
+        {
+            close(listen_fd_);
+            remove_socket_(socket_path_);
+            listen_fd_ = -1;
+        }
+    }
+
+    void Reporter::serve_()
+    {
+        int client = -1;
+        while ((client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC)) >= 0)
+        {
+            std::string const text = to_prometheus(registry_.collect());
+            std::size_t sent = 0;
+            // Clients that do not read their snapshot lose it rather than stall the reporter
+            while (sent < text.size())
+            {
+                ssize_t const written = send(client, text.data() + sent, text.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (written <= 0)
+                {
+                    break;
+                }
+                sent += static_cast<std::size_t>(written);
+            }
+            close(client);
+        }
+    }
+#else
+    void Reporter::open_socket_()
+    {
+        throw std::runtime_error{"Serving stats on a UNIX socket is only supported on Linux"};
+    }
+
+    void Reporter::close_() noexcept
+    {
+    }
+
+    void Reporter::serve_()
+    {
+    }
+#endif
+} // namespace overwatch::stats
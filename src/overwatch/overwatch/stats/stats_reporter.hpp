@@ -0,0 +1,110 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "config.hpp"
+#include "event.hpp"
+#include "stats_registry.hpp"
+
+namespace overwatch::stats
+{
+    /**
+     * Background thread reporting the metrics of a registry on an interval.
+     *
+     * Every report logs the totals of every metric (with the rate of the counters) and
+     * rewrites the output file in the Prometheus text format. The file is replaced
+     * atomically so that a scraper (e.g. the node exporter's textfile collector) never
+     * reads half a report. A UNIX socket output instead answers every connection with a
+     * fresh snapshot and closes it.
+     */
+    class Reporter
+    {
+    public:
+        /**
+         * Creates the reporter and opens its output
+         *
+         * @param[in] registry The metrics to report (must outlive the reporter)
+         * @param[in] interval_ms Time between two reports
+         * @param[in] output File to write or STATS_SOCKET_PREFIX followed by the path of the socket to serve (optional)
+         * @throw std::invalid_argument If the interval is 0
+         * @throw std::runtime_error If the socket could not be set up
+         */
+        Reporter(Registry const &registry, std::uint32_t const interval_ms, std::optional<std::string> output = std::nullopt);
+        ~Reporter();
+
+        Reporter(Reporter const &) = delete;
+        Reporter &operator=(Reporter const &) = delete;
+
+        /**
+         * Starts reporting on a background thread
+         */
+        void start();
+        /**
+         * Stops the background thread
+         */
+        void stop() noexcept;
+        /**
+         * Collects, logs and writes a report right away
+         *
+         * @return The report in the Prometheus text format
+         * @throw std::runtime_error If the output file could not be written
+         */
+        std::string report();
+
+    private:
+        // Main loop of the reporter thread
+        void run_() noexcept;
+        // Creates, binds and listens on the UNIX socket
+        void open_socket_();
+        // Closes and removes the UNIX socket
+        void close_() noexcept;
+        // Answers the pending connections of the UNIX socket
+        void serve_();
+        // Logs the totals and rates of a report
+        void log_(std::vector<Sample> const &samples);
+        // Atomically replaces the output file
+        void write_file_(std::string const &text);
+
+        // Metrics to report
+        Registry const &registry_;
+        // Time between two reports
+        std::uint32_t const interval_ms_;
+        // Output file (empty if none or served on a socket)
+        std::string file_path_;
+        // Path of the UNIX socket (empty if none)
+        std::string socket_path_;
+        // Listening UNIX socket (-1 if none)
+        int listen_fd_;
+        // Stops the background thread
+        core::Event stop_;
+        std::thread thread_;
+        // Totals of the previous report, to derive the rates of the counters
+        std::unordered_map<std::string, std::uint64_t> previous_totals_;
+        std::uint64_t previous_ns_;
+    };
+} // namespace overwatch::stats
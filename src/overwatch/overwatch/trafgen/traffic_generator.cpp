@@ -0,0 +1,489 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "traffic_generator.hpp"
+
+#define ETHERNET_HEADER_SIZE 14
+#define IPV4_HEADER_SIZE 20
+#define IPV6_HEADER_SIZE 40
+#define TCP_HEADER_SIZE 20
+#define UDP_HEADER_SIZE 8
+#define ICMP_HEADER_SIZE 8
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86DD
+#define PROTOCOL_ICMP 1
+#define PROTOCOL_TCP 6
+#define PROTOCOL_UDP 17
+#define PROTOCOL_ICMPV6 58
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_PSH 0x08
+#define TCP_FLAG_ACK 0x10
+// IP packet sizes of the simple IMIX and their weights
+#define IMIX_SIZES {40U, 576U, 1500U}
+#define IMIX_WEIGHTS {7U, 4U, 1U}
+// Addresses of the flows without a target endpoint (RFC 2544 benchmarking and RFC 3849 documentation ranges)
+#define BACKGROUND_IPV4_NETWORK 0xC6120000U
+#define BACKGROUND_IPV4_HOST_BITS 17
+#define BACKGROUND_IPV6_HIGH 0x20010DB800000000ULL
+// Draws of a background address that may fall into a target before giving up
+#define BACKGROUND_ADDRESS_ATTEMPTS 16
+#define EPHEMERAL_PORT_MIN 32768
+#define EPHEMERAL_PORT_COUNT 28232
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+namespace overwatch::trafgen
+{
+    namespace
+    {
+        // Well-known server ports of the generated flows
+        constexpr std::uint16_t TCP_SERVER_PORTS[] = {443, 443, 443, 80, 80, 22, 25, 8080};
+        constexpr std::uint16_t UDP_SERVER_PORTS[] = {53, 53, 443, 123, 5353};
+        constexpr std::uint8_t CLIENT_MAC[] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+        constexpr std::uint8_t SERVER_MAC[] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+
+        void put16_(std::uint8_t *ptr, std::uint16_t const value) noexcept
+        {
+            ptr[0] = static_cast<std::uint8_t>(value >> 8);
+            ptr[1] = static_cast<std::uint8_t>(value);
+        }
+
+        void put32_(std::uint8_t *ptr, std::uint32_t const value) noexcept
+        {
+            put16_(ptr, static_cast<std::uint16_t>(value >> 16));
+            put16_(ptr + 2, static_cast<std::uint16_t>(value));
+        }
+
+        // Internet checksum of an IPv4 header
+        std::uint16_t ipv4_checksum_(std::uint8_t const *header) noexcept
+        {
+            std::uint32_t sum = 0;
+            for (std::size_t i = 0; i < IPV4_HEADER_SIZE; i += 2)
+            {
+                sum += static_cast<std::uint32_t>(header[i] << 8 | header[i + 1]);
+            }
+            while (sum >> 16)
+            {
+                sum = (sum & 0xFFFF) + (sum >> 16);
+            }
+            return static_cast<std::uint16_t>(~sum);
+        }
+
+        // Parses a whole string as an unsigned number
+        std::uint32_t parse_number_(std::string const &str, std::string const &what)
+        {
+            if (str.empty() || str.size() > 9 || !std::all_of(str.begin(), str.end(), [](char const c) { return c >= '0' && c <= '9'; }))
+            {
+                throw std::invalid_argument{"Invalid " + what + " '" + str + "'"};
+            }
+            return static_cast<std::uint32_t>(std::stoul(str));
+        }
+    } // namespace
+
+    SizeDistribution parse_size_distribution(std::string const &str)
+    {
+        SizeDistribution sizes;
+        std::size_t const colon = str.find(':');
+        std::string const model = str.substr(0, colon);
+        std::string const value = colon == std::string::npos ? "" : str.substr(colon + 1);
+        if (model == "imix" && colon == std::string::npos)
+        {
+            return sizes;
+        }
+        else if (model == "fixed")
+        {
+            sizes.model = SizeModel::Fixed;
+            sizes.min = sizes.max = parse_number_(value, "frame size");
+        }
+        else if (model == "uniform" && value.find('-') != std::string::npos)
+        {
+            sizes.model = SizeModel::Uniform;
+            sizes.min = parse_number_(value.substr(0, value.find('-')), "frame size");
+            sizes.max = parse_number_(value.substr(value.find('-') + 1), "frame size");
+        }
+        else
+        {
+            throw std::invalid_argument{"Invalid size distribution '" + str + "' (fmt: 'imix', 'fixed:<size>' or 'uniform:<min>-<max>')"};
+        }
+        if (sizes.min > sizes.max || sizes.max > MAX_FRAME_SIZE)
+        {
+            throw std::invalid_argument{"Frame sizes must be ordered and at most " + std::to_string(MAX_FRAME_SIZE) + " bytes"};
+        }
+        return sizes;
+    }
+
+    ProtocolMix parse_protocol_mix(std::string const &str)
+    {
+        ProtocolMix mix{0, 0, 0};
+        std::size_t start = 0;
+        while (start <= str.size())
+        {
+            std::size_t const end = std::min(str.find(',', start), str.size());
+            std::string const item = str.substr(start, end - start);
+            std::size_t const equals = item.find('=');
+            std::string const name = item.substr(0, equals);
+            std::uint32_t const weight = parse_number_(equals == std::string::npos ? "" : item.substr(equals + 1), "protocol weight");
+            if (name == "tcp")
+            {
+                mix.tcp = weight;
+            }
+            else if (name == "udp")
+            {
+                mix.udp = weight;
+            }
+            else if (name == "icmp")
+            {
+                mix.icmp = weight;
+            }
+            else
+            {
+                throw std::invalid_argument{"Unknown protocol '" + name + "' (expected 'tcp', 'udp' or 'icmp')"};
+            }
+            start = end + 1;
+        }
+        if (mix.tcp + mix.udp + mix.icmp == 0)
+        {
+            throw std::invalid_argument{"Protocol mix '" + str + "' has no weight"};
+        }
+        return mix;
+    }
+
+    TrafficGenerator::TrafficGenerator(TrafficProfile profile)
+        : profile_{std::move(profile)}, flows_{}, target_flows_{0}, random_state_{profile_.seed}, generated_{0},
+          interval_ns_{profile_.rate_pps ? std::max<std::uint64_t>(1, NANOSECONDS_PER_SECOND / profile_.rate_pps) : 0}
+    {
+        if (profile_.flows == 0)
+        {
+            throw std::invalid_argument{"Traffic needs at least one flow"};
+        }
+        else if (profile_.rate_pps == 0)
+        {
+            throw std::invalid_argument{"Packet rate must not be 0"};
+        }
+        else if (!(profile_.ipv6_ratio >= 0 && profile_.ipv6_ratio <= 1) || !(profile_.target_ratio >= 0 && profile_.target_ratio <= 1))
+        {
+            throw std::invalid_argument{"Ratios must be between 0 and 1"};
+        }
+        else if (!(profile_.skew >= 1))
+        {
+            throw std::invalid_argument{"Flow skew must be at least 1"};
+        }
+        else if (profile_.mix.tcp + profile_.mix.udp + profile_.mix.icmp == 0)
+        {
+            throw std::invalid_argument{"Protocol mix has no weight"};
+        }
+        else if (profile_.sizes.min > profile_.sizes.max || profile_.sizes.max > MAX_FRAME_SIZE)
+        {
+            throw std::invalid_argument{"Frame sizes must be ordered and at most " + std::to_string(MAX_FRAME_SIZE) + " bytes"};
+        }
+        create_flows_();
+    }
+
+    bool TrafficGenerator::next(std::uint8_t *buffer, capture::PacketView &packet) noexcept
+    {
+        if (generated_ >= profile_.packets)
+        {
+            return false;
+        }
+
+        // Raising a uniform draw to the skew favors the first flows
+        std::size_t index = profile_.skew == 1.0
+                                ? random_below_(flows_.size())
+                                : static_cast<std::size_t>(static_cast<double>(flows_.size()) * std::pow(random_unit_(), profile_.skew));
+        Flow &flow = flows_[std::min(index, flows_.size() - 1)];
+
+        // The client opens every flow, TCP flows with a handshake
+        std::uint8_t tcp_flags = TCP_FLAG_ACK;
+        bool handshake = false;
+        std::size_t direction;
+        if (flow.protocol == PROTOCOL_TCP && flow.packets < 3)
+        {
+            static constexpr std::uint8_t HANDSHAKE_FLAGS[] = {TCP_FLAG_SYN, TCP_FLAG_SYN | TCP_FLAG_ACK, TCP_FLAG_ACK};
+            tcp_flags = HANDSHAKE_FLAGS[flow.packets];
+            direction = flow.packets == 1;
+            handshake = true;
+        }
+        else
+        {
+            direction = flow.packets == 0 ? 0 : random_() & 1;
+        }
+        ++flow.packets;
+
+        std::size_t const l3_size = flow.ipv6 ? IPV6_HEADER_SIZE : IPV4_HEADER_SIZE;
+        std::size_t const l4_size = flow.protocol == PROTOCOL_TCP ? TCP_HEADER_SIZE : flow.protocol == PROTOCOL_UDP ? UDP_HEADER_SIZE : ICMP_HEADER_SIZE;
+        std::size_t const headers = ETHERNET_HEADER_SIZE + l3_size + l4_size;
+        std::size_t const frame_size = handshake ? headers : std::clamp<std::size_t>(random_frame_size_(), headers, MAX_FRAME_SIZE);
+        std::size_t const payload = frame_size - headers;
+        std::size_t const wire_size = std::max<std::size_t>(frame_size, MIN_FRAME_SIZE);
+
+        std::uint8_t const *const src = direction ? flow.server.data() : flow.client.data();
+        std::uint8_t const *const dst = direction ? flow.client.data() : flow.server.data();
+        std::uint16_t const src_port = direction ? flow.server_port : flow.client_port;
+        std::uint16_t const dst_port = direction ? flow.client_port : flow.server_port;
+
+        std::uint8_t *ptr = buffer;
+        std::memcpy(ptr, direction ? CLIENT_MAC : SERVER_MAC, 6);
+        std::memcpy(ptr + 6, direction ? SERVER_MAC : CLIENT_MAC, 6);
+        put16_(ptr + 12, flow.ipv6 ? ETHERTYPE_IPV6 : ETHERTYPE_IPV4);
+        ptr += ETHERNET_HEADER_SIZE;
+        std::uint8_t const protocol = flow.ipv6 && flow.protocol == PROTOCOL_ICMP ? PROTOCOL_ICMPV6 : flow.protocol;
+        if (flow.ipv6)
+        {
+            put32_(ptr, 0x60000000U);
+            put16_(ptr + 4, static_cast<std::uint16_t>(l4_size + payload));
+            ptr[6] = protocol;
+            ptr[7] = 64;
+            std::memcpy(ptr + 8, src, 16);
+            std::memcpy(ptr + 24, dst, 16);
+        }
+        else
+        {
+            ptr[0] = 0x45;
+            ptr[1] = 0;
+            put16_(ptr + 2, static_cast<std::uint16_t>(IPV4_HEADER_SIZE + l4_size + payload));
+            put16_(ptr + 4, static_cast<std::uint16_t>(generated_));
+            // Don't fragment
+            put16_(ptr + 6, 0x4000);
+            ptr[8] = 64;
+            ptr[9] = protocol;
+            put16_(ptr + 10, 0);
+            std::memcpy(ptr + 12, src + 12, 4);
+            std::memcpy(ptr + 16, dst + 12, 4);
+            put16_(ptr + 10, ipv4_checksum_(ptr));
+        }
+        ptr += l3_size;
+
+        if (flow.protocol == PROTOCOL_TCP)
+        {
+            put16_(ptr, src_port);
+            put16_(ptr + 2, dst_port);
+            put32_(ptr + 4, flow.seq[direction]);
+            put32_(ptr + 8, tcp_flags & TCP_FLAG_ACK ? flow.seq[direction ^ 1] : 0);
+            ptr[12] = 0x50;
+            ptr[13] = static_cast<std::uint8_t>(tcp_flags | (payload ? TCP_FLAG_PSH : 0));
+            put16_(ptr + 14, 0xFFFF);
+            put32_(ptr + 16, 0);
+            flow.seq[direction] += static_cast<std::uint32_t>(payload) + ((tcp_flags & TCP_FLAG_SYN) ? 1 : 0);
+        }
+        else if (flow.protocol == PROTOCOL_UDP)
+        {
+            put16_(ptr, src_port);
+            put16_(ptr + 2, dst_port);
+            put16_(ptr + 4, static_cast<std::uint16_t>(UDP_HEADER_SIZE + payload));
+            put16_(ptr + 6, 0);
+        }
+        else
+        {
+            // Echo requests from the client, replies from the server
+            ptr[0] = flow.ipv6 ? (direction ? 129 : 128) : (direction ? 0 : 8);
+            ptr[1] = 0;
+            put16_(ptr + 2, 0);
+            put16_(ptr + 4, flow.client_port);
+            put16_(ptr + 6, static_cast<std::uint16_t>(flow.packets));
+        }
+        ptr += l4_size;
+        // Payload and Ethernet padding
+        std::memset(ptr, 0, wire_size - headers);
+
+        packet = capture::PacketView{buffer, static_cast<std::uint32_t>(wire_size), static_cast<std::uint32_t>(wire_size),
+                                     profile_.start_ns + generated_ * interval_ns_};
+        ++generated_;
+        return true;
+    }
+
+    std::uint64_t TrafficGenerator::get_generated() const noexcept
+    {
+        return generated_;
+    }
+
+    std::size_t TrafficGenerator::get_target_flows() const noexcept
+    {
+        return target_flows_;
+    }
+
+    TrafficProfile const &TrafficGenerator::get_profile() const noexcept
+    {
+        return profile_;
+    }
+
+    std::uint64_t TrafficGenerator::random_() noexcept
+    {
+        std::uint64_t z = (random_state_ += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    std::uint64_t TrafficGenerator::random_below_(std::uint64_t const bound) noexcept
+    {
+        return random_() % bound;
+    }
+
+    double TrafficGenerator::random_unit_() noexcept
+    {
+        return static_cast<double>(random_() >> 11) * 0x1.0p-53;
+    }
+
+    common::utils::IpAddress TrafficGenerator::random_address_in_(common::utils::IpPrefix const &prefix) noexcept
+    {
+        common::utils::IpAddress addr = prefix.address;
+        if (addr.is_ipv4())
+        {
+            unsigned int const host_bits = 32U - std::min(prefix.length, std::uint8_t{32});
+            std::uint64_t const host = host_bits == 0 ? 0 : random_() & ((1ULL << host_bits) - 1);
+            return common::utils::IpAddress::from_ipv4(addr.to_ipv4() | static_cast<std::uint32_t>(host));
+        }
+        unsigned int const host_bits = 128U - prefix.length;
+        if (host_bits >= 64)
+        {
+            addr.low |= random_();
+            addr.high |= host_bits == 128 ? random_() : random_() & ((1ULL << (host_bits - 64)) - 1);
+        }
+        else if (host_bits > 0)
+        {
+            addr.low |= random_() & ((1ULL << host_bits) - 1);
+        }
+        return addr;
+    }
+
+    common::utils::IpAddress TrafficGenerator::random_background_address_(bool const ipv6) noexcept
+    {
+        common::utils::IpAddress addr;
+        for (int attempt = 0; attempt < BACKGROUND_ADDRESS_ATTEMPTS; ++attempt)
+        {
+            addr = ipv6 ? common::utils::IpAddress{BACKGROUND_IPV6_HIGH | (random_() & 0xFFFFFFFFULL), random_()}
+                        : common::utils::IpAddress::from_ipv4(BACKGROUND_IPV4_NETWORK |
+                                                              static_cast<std::uint32_t>(random_below_(1ULL << BACKGROUND_IPV4_HOST_BITS)));
+            if (std::none_of(profile_.targets.begin(), profile_.targets.end(),
+                             [&addr](common::utils::IpPrefix const &target) { return target.contains(addr); }))
+            {
+                break;
+            }
+        }
+        return addr;
+    }
+
+    std::uint32_t TrafficGenerator::random_frame_size_() noexcept
+    {
+        switch (profile_.sizes.model)
+        {
+        case SizeModel::Fixed:
+            return profile_.sizes.min;
+        case SizeModel::Uniform:
+            return profile_.sizes.min + static_cast<std::uint32_t>(random_below_(profile_.sizes.max - profile_.sizes.min + 1ULL));
+        case SizeModel::Imix:
+        default:
+        {
+            static constexpr std::uint32_t sizes[] = IMIX_SIZES;
+            static constexpr std::uint32_t weights[] = IMIX_WEIGHTS;
+            std::uint64_t pick = random_below_(weights[0] + weights[1] + weights[2]);
+            std::size_t i = 0;
+            for (; pick >= weights[i]; ++i)
+            {
+                pick -= weights[i];
+            }
+            return sizes[i] + ETHERNET_HEADER_SIZE;
+        }
+        }
+    }
+
+    void TrafficGenerator::create_flows_()
+    {
+        ProtocolMix const &mix = profile_.mix;
+        flows_.resize(profile_.flows);
+        for (Flow &flow : flows_)
+        {
+            std::uint64_t const protocol = random_below_(mix.tcp + mix.udp + mix.icmp);
+            flow.protocol = protocol < mix.tcp ? PROTOCOL_TCP : protocol < mix.tcp + mix.udp ? PROTOCOL_UDP : PROTOCOL_ICMP;
+
+            common::utils::IpAddress client;
+            common::utils::IpAddress server;
+            if (!profile_.targets.empty() && random_unit_() < profile_.target_ratio)
+            {
+                // Watched hosts both open flows and serve them
+                common::utils::IpPrefix const &target = profile_.targets[random_below_(profile_.targets.size())];
+                flow.ipv6 = !target.address.is_ipv4();
+                server = random_address_in_(target);
+                client = random_background_address_(flow.ipv6);
+                if (random_() & 1)
+                {
+                    std::swap(client, server);
+                }
+                ++target_flows_;
+            }
+            else
+            {
+                flow.ipv6 = random_unit_() < profile_.ipv6_ratio;
+                client = random_background_address_(flow.ipv6);
+                server = random_background_address_(flow.ipv6);
+            }
+            flow.client = client.to_bytes();
+            flow.server = server.to_bytes();
+
+            flow.client_port = static_cast<std::uint16_t>(EPHEMERAL_PORT_MIN + random_below_(EPHEMERAL_PORT_COUNT));
+            if (flow.protocol == PROTOCOL_TCP)
+            {
+                flow.server_port = TCP_SERVER_PORTS[random_below_(std::size(TCP_SERVER_PORTS))];
+            }
+            else if (flow.protocol == PROTOCOL_UDP)
+            {
+                flow.server_port = UDP_SERVER_PORTS[random_below_(std::size(UDP_SERVER_PORTS))];
+            }
+            else
+            {
+                flow.server_port = 0;
+            }
+            flow.seq[0] = static_cast<std::uint32_t>(random_());
+            flow.seq[1] = static_cast<std::uint32_t>(random_());
+            flow.packets = 0;
+        }
+    }
+
+    GeneratorSource::GeneratorSource(TrafficProfile profile)
+        : generator_{std::move(profile)}, frames_(capture::MAX_BATCH_SIZE * MAX_FRAME_SIZE), exhausted_{false}
+    {
+    }
+
+    bool GeneratorSource::next_batch(capture::PacketBatch &batch, int const)
+    {
+        batch.clear();
+        capture::PacketView packet;
+        while (!batch.full() && generator_.next(frames_.data() + batch.size * MAX_FRAME_SIZE, packet))
+        {
+            batch.push_back(packet);
+        }
+        exhausted_ = generator_.get_generated() >= generator_.get_profile().packets;
+        return !batch.empty();
+    }
+
+    bool GeneratorSource::exhausted() const noexcept
+    {
+        return exhausted_;
+    }
+
+    TrafficGenerator const &GeneratorSource::get_generator() const noexcept
+    {
+        return generator_;
+    }
+} // namespace overwatch::trafgen
@@ -0,0 +1,228 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ip_address.hpp"
+#include "packet.hpp"
+#include "packet_source.hpp"
+
+namespace overwatch::trafgen
+{
+    // Largest frame generated (Ethernet without FCS)
+    constexpr std::uint32_t MAX_FRAME_SIZE = 1514;
+    // Smallest frame put on the wire (Ethernet without FCS, shorter frames are padded)
+    constexpr std::uint32_t MIN_FRAME_SIZE = 60;
+
+    /**
+     * Shape of the frame size distribution
+     */
+    enum class SizeModel
+    {
+        // Every frame has the same size
+        Fixed,
+        // Sizes spread evenly between a minimum and a maximum
+        Uniform,
+        // Simple IMIX: 40, 576 and 1500 byte IP packets in a 7:4:1 ratio
+        Imix
+    };
+
+    /**
+     * Distribution of the frame sizes (Ethernet without FCS, never below the headers of a frame)
+     */
+    struct SizeDistribution
+    {
+        SizeModel model = SizeModel::Imix;
+        std::uint32_t min = MIN_FRAME_SIZE;
+        std::uint32_t max = MAX_FRAME_SIZE;
+    };
+
+    /**
+     * Relative weights of the transports of the generated flows
+     */
+    struct ProtocolMix
+    {
+        std::uint32_t tcp = 80;
+        std::uint32_t udp = 18;
+        std::uint32_t icmp = 2;
+    };
+
+    /**
+     * Everything that shapes the generated traffic
+     */
+    struct TrafficProfile
+    {
+        // Distinct flows (bidirectional 5-tuples)
+        std::size_t flows = 10000;
+        // Frames to generate
+        std::uint64_t packets = 1000000;
+        SizeDistribution sizes;
+        ProtocolMix mix;
+        // Fraction of the non-target flows that use IPv6
+        double ipv6_ratio = 0.0;
+        // Watched networks, target flows have one endpoint inside one of them
+        std::vector<common::utils::IpPrefix> targets;
+        // Fraction of the flows with a target endpoint (ignored without targets)
+        double target_ratio = 0.1;
+        // Popularity skew of the flows (1: every flow equally likely, higher: a few heavy flows carry most packets)
+        double skew = 1.0;
+        // Packet rate the timestamps are spaced for (the generator itself never sleeps)
+        std::uint64_t rate_pps = 1000000;
+        // Timestamp of the first frame
+        std::uint64_t start_ns = 1000000000ULL;
+        // Same seed, same traffic
+        std::uint64_t seed = 1;
+    };
+
+    /**
+     * Parses a frame size distribution
+     *
+     * @param[in] str 'imix', 'fixed:<size>' or 'uniform:<min>-<max>'
+     * @return The distribution
+     * @throw std::invalid_argument If the string is not a valid distribution
+     */
+    SizeDistribution parse_size_distribution(std::string const &str);
+    /**
+     * Parses a protocol mix
+     *
+     * @param[in] str Comma separated weights (e.g. 'tcp=80,udp=18,icmp=2'), unlisted transports get no flows
+     * @return The mix
+     * @throw std::invalid_argument If the string is not a valid mix
+     */
+    ProtocolMix parse_protocol_mix(std::string const &str);
+
+    /**
+     * Deterministic generator of Ethernet frames following a traffic profile.
+     *
+     * Flows are set up front: their endpoints, transport and family. Every frame then
+     * belongs to a flow picked according to the popularity skew and travels in either
+     * direction. TCP flows open with a handshake and carry consistent sequence numbers.
+     * IPv4 header checksums are valid, transport checksums are left at zero.
+     */
+    class TrafficGenerator
+    {
+    public:
+        /**
+         * Sets up the flows of the profile
+         *
+         * @param[in] profile The traffic to generate
+         * @throw std::invalid_argument If the profile is inconsistent
+         */
+        explicit TrafficGenerator(TrafficProfile profile);
+
+        /**
+         * Builds the next frame
+         *
+         * @param[out] buffer Receives the frame (at least MAX_FRAME_SIZE bytes)
+         * @param[out] packet View of the frame in the buffer
+         * @return False once every frame of the profile has been generated
+         */
+        bool next(std::uint8_t *buffer, capture::PacketView &packet) noexcept;
+        /**
+         * Number of frames generated so far
+         * @return The number of frames
+         */
+        std::uint64_t get_generated() const noexcept;
+        /**
+         * Number of flows with a target endpoint
+         * @return The number of target flows
+         */
+        std::size_t get_target_flows() const noexcept;
+        /**
+         * The traffic profile
+         * @return The profile
+         */
+        TrafficProfile const &get_profile() const noexcept;
+
+    private:
+        struct Flow
+        {
+            std::array<std::uint8_t, 16> client;
+            std::array<std::uint8_t, 16> server;
+            std::uint32_t seq[2];
+            std::uint16_t client_port;
+            std::uint16_t server_port;
+            std::uint8_t protocol;
+            bool ipv6;
+            // Frames sent so far (drives the TCP handshake)
+            std::uint32_t packets;
+        };
+
+        // Next pseudo-random number (splitmix64, identical output on every platform)
+        std::uint64_t random_() noexcept;
+        // Uniform pseudo-random number in [0, bound)
+        std::uint64_t random_below_(std::uint64_t const bound) noexcept;
+        // Uniform pseudo-random number in [0, 1)
+        double random_unit_() noexcept;
+        // Draws an address of the prefix
+        common::utils::IpAddress random_address_in_(common::utils::IpPrefix const &prefix) noexcept;
+        // Draws an address outside every target
+        common::utils::IpAddress random_background_address_(bool const ipv6) noexcept;
+        // Draws the size of the next frame
+        std::uint32_t random_frame_size_() noexcept;
+        // Creates the flows of the profile
+        void create_flows_();
+
+        TrafficProfile const profile_;
+        std::vector<Flow> flows_;
+        std::size_t target_flows_;
+        std::uint64_t random_state_;
+        std::uint64_t generated_;
+        // Gap between two timestamps
+        std::uint64_t interval_ns_;
+    };
+
+    /**
+     * Packet source handing out generated traffic, so that the pipeline can be loaded
+     * in-process without a network or a capture file
+     */
+    class GeneratorSource : public capture::PacketSource
+    {
+    public:
+        /**
+         * Creates the source
+         *
+         * @param[in] profile The traffic to generate
+         * @throw std::invalid_argument If the profile is inconsistent
+         */
+        explicit GeneratorSource(TrafficProfile profile);
+
+        bool next_batch(capture::PacketBatch &batch, int const timeout_ms) override;
+        bool exhausted() const noexcept override;
+
+        /**
+         * Underlying generator
+         * @return The generator
+         */
+        TrafficGenerator const &get_generator() const noexcept;
+
+    private:
+        TrafficGenerator generator_;
+        // Frames of the current batch
+        std::vector<std::uint8_t> frames_;
+        bool exhausted_;
+    };
+} // namespace overwatch::trafgen
@@ -0,0 +1,311 @@
+/* 
+ * Overwatch - Remote Network Traffic Identifier 
+ * Copyright (C) 2020 xander-io
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <signal.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <argparse/argparse.hpp>
+
+#include "config.hpp"
+#include "event.hpp"
+#include "logging.hpp"
+#include "lpm_table.hpp"
+#include "pcap_writer.hpp"
+#include "pipeline.hpp"
+#include "stats_registry.hpp"
+#include "traffic_generator.hpp"
+#include "worker.hpp"
+
+#define ARG_FLOWS "--flows"
+#define ARG_FLOWS_ABRV "-f"
+#define ARG_INJECT "--inject"
+#define ARG_IPV6 "--ipv6"
+#define ARG_MIX "--mix"
+#define ARG_OUTPUT "--output"
+#define ARG_OUTPUT_ABRV "-o"
+#define ARG_PACKETS "--packets"
+#define ARG_PACKETS_ABRV "-n"
+#define ARG_RATE "--rate"
+#define ARG_SEED "--seed"
+#define ARG_SIZES "--sizes"
+#define ARG_SKEW "--skew"
+#define ARG_TARGET_RATIO "--target-ratio"
+#define ARG_TARGETS "--targets"
+#define ARG_TARGETS_ABRV "-t"
+#define ARG_WORKERS "--workers"
+#define ARG_WORKERS_ABRV "-w"
+// Flows tracked per worker on top of the flows the worker is handed
+#define FLOW_TABLE_HEADROOM 2
+#define FLOW_IDLE_TIMEOUT_NS (60ULL * 1000 * 1000 * 1000)
+#define BITS_PER_BYTE 8
+
+namespace
+{
+    /**
+     * Stops the injected workers once a signal is fired
+     *
+     * @param[in] The signal
+     */
+    void cleanup_(int const) noexcept
+    {
+        overwatch::core::g_config.signal_shutdown();
+    }
+
+    void init_parser_args_(argparse::ArgumentParser &parser)
+    {
+        parser.add_argument(ARG_OUTPUT_ABRV, ARG_OUTPUT)
+            .help("Pcap file to write the traffic to");
+        parser.add_argument(ARG_INJECT)
+            .help("Run the traffic through the analysis pipeline in-process instead of writing it")
+            .default_value(false)
+            .implicit_value(true);
+        parser.add_argument(ARG_WORKERS_ABRV, ARG_WORKERS)
+            .help("Workers the traffic is spread over when injecting, each with its own flows")
+            .default_value(std::size_t{ 1 })
+            .scan<'u', std::size_t>();
+        parser.add_argument(ARG_FLOWS_ABRV, ARG_FLOWS)
+            .help("Number of distinct flows")
+            .default_value(std::size_t{ 10000 })
+            .scan<'u', std::size_t>();
+        parser.add_argument(ARG_PACKETS_ABRV, ARG_PACKETS)
+            .help("Number of packets")
+            .default_value(std::size_t{ 1000000 })
+            .scan<'u', std::size_t>();
+        parser.add_argument(ARG_SIZES)
+            .help("Frame size distribution (fmt: 'imix', 'fixed:<size>' or 'uniform:<min>-<max>')")
+            .default_value(std::string{ "imix" });
+        parser.add_argument(ARG_MIX)
+            .help("Weights of the transports of the flows (fmt: 'tcp=<weight>,udp=<weight>,icmp=<weight>')")
+            .default_value(std::string{ "tcp=80,udp=18,icmp=2" });
+        parser.add_argument(ARG_IPV6)
+            .help("Fraction of the flows without a target endpoint that use IPv6")
+            .default_value(0.0)
+            .scan<'g', double>();
+        parser.add_argument(ARG_TARGETS_ABRV, ARG_TARGETS)
+            .help("Comma separated watched addresses and CIDR ranges target flows talk to");
+        parser.add_argument(ARG_TARGET_RATIO)
+            .help("Fraction of the flows with a target endpoint")
+            .default_value(0.1)
+            .scan<'g', double>();
+        parser.add_argument(ARG_SKEW)
+            .help("Flow popularity skew (1: every flow equally likely, higher: a few heavy flows carry most packets)")
+            .default_value(1.0)
+            .scan<'g', double>();
+        parser.add_argument(ARG_RATE)
+            .help("Packet rate the timestamps are spaced for (packets per second)")
+            .default_value(std::size_t{ 1000000 })
+            .scan<'u', std::size_t>();
+        parser.add_argument(ARG_SEED)
+            .help("Seed of the traffic, the same seed always generates the same traffic")
+            .default_value(std::size_t{ 1 })
+            .scan<'u', std::size_t>();
+    }
+
+    overwatch::trafgen::TrafficProfile make_profile_(argparse::ArgumentParser &parser)
+    {
+        overwatch::trafgen::TrafficProfile profile;
+        profile.flows = parser.get<std::size_t>(ARG_FLOWS);
+        profile.packets = parser.get<std::size_t>(ARG_PACKETS);
+        profile.sizes = overwatch::trafgen::parse_size_distribution(parser.get<std::string>(ARG_SIZES));
+        profile.mix = overwatch::trafgen::parse_protocol_mix(parser.get<std::string>(ARG_MIX));
+        profile.ipv6_ratio = parser.get<double>(ARG_IPV6);
+        if (auto const targets = parser.present<std::string>(ARG_TARGETS))
+        {
+            profile.targets = common::utils::parse_ip_prefix_list(*targets);
+        }
+        profile.target_ratio = parser.get<double>(ARG_TARGET_RATIO);
+        profile.skew = parser.get<double>(ARG_SKEW);
+        profile.rate_pps = parser.get<std::size_t>(ARG_RATE);
+        profile.seed = parser.get<std::size_t>(ARG_SEED);
+        return profile;
+    }
+
+    /**
+     * Writes the traffic to a pcap file
+     *
+     * @param[in] profile The traffic
+     * @param[in] path The pcap file
+     */
+    void write_pcap_(overwatch::trafgen::TrafficProfile const &profile, std::string const &path)
+    {
+        overwatch::trafgen::TrafficGenerator generator{profile};
+        overwatch::capture::PcapWriter writer{path};
+        std::vector<std::uint8_t> frame(overwatch::trafgen::MAX_FRAME_SIZE);
+        overwatch::capture::PacketView packet;
+        std::uint64_t bytes = 0;
+        auto const start = std::chrono::steady_clock::now();
+        while (generator.next(frame.data(), packet))
+        {
+            writer.write(packet);
+            bytes += packet.wire_len;
+        }
+        writer.flush();
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+        LOG_INFO << "Wrote " << writer.get_packets() << " packets (" << bytes << " bytes, " << profile.flows << " flows, "
+                 << generator.get_target_flows() << " with a target) to '" << path << "' in " << elapsed.count() << "s";
+    }
+
+    /**
+     * Sums a metric over every worker
+     *
+     * @param[in] name The metric
+     * @return The total
+     */
+    std::uint64_t total_(std::string const &name)
+    {
+        std::uint64_t total = 0;
+        for (overwatch::stats::Sample const &sample : overwatch::stats::default_registry().collect())
+        {
+            total += sample.name == name ? sample.value : 0;
+        }
+        return total;
+    }
+
+    /**
+     * Runs the traffic through one analysis pipeline per worker and reports the throughput
+     *
+     * @param[in] profile The traffic, split evenly between the workers
+     * @param[in] workers Number of workers
+     */
+    void inject_(overwatch::trafgen::TrafficProfile const &profile, std::size_t const workers)
+    {
+        if (workers == 0)
+        {
+            throw std::invalid_argument{"At least one worker is needed"};
+        }
+        // Every worker gets its own flows, like a fanout group hashing flows to sockets
+        std::vector<std::unique_ptr<overwatch::capture::PacketSource>> sources;
+        std::size_t target_flows = 0;
+        for (std::size_t i = 0; i < workers; ++i)
+        {
+            overwatch::trafgen::TrafficProfile share = profile;
+            share.flows = std::max<std::size_t>(1, profile.flows / workers);
+            share.packets = profile.packets / workers + (i < profile.packets % workers);
+            share.seed = profile.seed + i;
+            auto source = std::make_unique<overwatch::trafgen::GeneratorSource>(share);
+            target_flows += source->get_generator().get_target_flows();
+            sources.push_back(std::move(source));
+        }
+
+        auto const targets = std::make_shared<overwatch::core::LpmTable const>(profile.targets);
+        std::size_t const max_flows = std::max<std::size_t>(1024, profile.flows / workers * FLOW_TABLE_HEADROOM);
+        std::atomic<std::uint64_t> exported{0};
+        overwatch::core::WorkerPool pool{std::move(sources), true, [&](std::size_t const) {
+                                             auto pipeline = std::make_unique<overwatch::core::Pipeline>();
+                                             pipeline->add_stage(std::make_unique<overwatch::core::DecodeStage>());
+                                             pipeline->add_stage(std::make_unique<overwatch::core::ClassifyStage>(targets));
+                                             pipeline->add_stage(std::make_unique<overwatch::core::FlowStage>(max_flows, FLOW_IDLE_TIMEOUT_NS));
+                                             pipeline->add_stage(std::make_unique<overwatch::core::ExportStage>(
+                                                 [&exported](overwatch::core::ExpiredFlow const &) {
+                                                     exported.fetch_add(1, std::memory_order_relaxed);
+                                                 }));
+                                             return pipeline;
+                                         }};
+        LOG_INFO << "Injecting " << profile.packets << " packets of " << profile.flows << " flows (" << target_flows
+                 << " with a target) into " << workers << " workers...";
+
+        auto const start = std::chrono::steady_clock::now();
+        pool.start();
+        overwatch::core::Event::wait_any({&overwatch::core::g_config.get_shutdown_event(), &pool.get_finished_event()}, -1);
+        overwatch::core::g_config.signal_shutdown();
+        pool.join();
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+        overwatch::core::WorkerCounters const counters = pool.get_counters();
+        std::uint64_t target_packets = 0;
+        for (overwatch::core::TargetCounters const &target : pool.get_target_counters())
+        {
+            target_packets += target.packets;
+        }
+        LOG_INFO << "Processed " << counters.packets << " packets (" << counters.bytes << " bytes) in " << elapsed.count()
+                 << "s: " << counters.packets / elapsed.count() / 1e6 << " Mpps, "
+                 << counters.bytes * BITS_PER_BYTE / elapsed.count() / 1e9 << " Gbps";
+        LOG_INFO << "Matched " << target_packets << " target packets, exported " << exported.load() << " flows, "
+                 << total_("overwatch_flow_table_drops_total") << " packets found the flow table full, "
+                 << total_("overwatch_decode_errors_total") << " decode errors";
+    }
+
+    /**
+     * Entry point for the traffic generator
+     *
+     * @param[in] argc Number of arguments
+     * @param[in] argv Argument values
+     * @return If the exe succeeds or fails
+     */
+    int trafgen_(int const argc, char const *const *const argv) noexcept
+    {
+        argparse::ArgumentParser parser{"overwatch_trafgen"};
+        try
+        {
+            init_parser_args_(parser);
+            parser.parse_args(argc, argv);
+            overwatch::trafgen::TrafficProfile const profile = make_profile_(parser);
+            common::logging::set_logger(":info");
+
+            if (auto const output = parser.present<std::string>(ARG_OUTPUT))
+            {
+                write_pcap_(profile, *output);
+            }
+            else if (parser.get<bool>(ARG_INJECT))
+            {
+                signal(SIGINT, cleanup_);
+                signal(SIGTERM, cleanup_);
+                inject_(profile, parser.get<std::size_t>(ARG_WORKERS));
+            }
+            else
+            {
+                throw std::invalid_argument{"Either " ARG_OUTPUT " or " ARG_INJECT " is required"};
+            }
+        }
+        catch (std::exception const &e)
+        {
+            if (common::logging::logger_initialized())
+            {
+                LOG_ERROR << e.what();
+            }
+            else
+            {
+                std::cout << e.what() << std::endl
+                          << std::endl
+                          << parser << std::endl;
+            }
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+} // namespace
+
+/**
+ * Generates synthetic traffic to load test the analyzer without a network
+ *
+ * @param[in] argc Number of arguments
+ * @param[in] argv Argument values
+ * @return If the exe succeeds or fails
+ */
+int main(int const argc, char const *const *const argv)
+{
+    return trafgen_(argc, argv);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Defines a benchmark function and registers it with the benchmarks executable
+#define BENCHMARK(name)                                                                                      \
+    static void name##_benchmark_();                                                                         \
+    [[maybe_unused]] static bool const name##_registered_ = benchmarks::register_benchmark(#name, name##_benchmark_); \
+    static void name##_benchmark_()
+
+namespace benchmarks
+{
+    using BenchmarkFunction = void (*)();
+
+    /**
+     * Adds a benchmark to the ones run by the benchmarks executable
+     *
+     * @param[in] name Name used to select the benchmark on the command line
+     * @param[in] function Runs the benchmark and reports its results
+     * @return Always true (used to register at static initialization)
+     */
+    bool register_benchmark(char const *name, BenchmarkFunction function);
+
+    /**
+     * Spread of the timed repetitions of a measurement
+     */
+    struct Measurement
+    {
+        double median = 0;
+        double min = 0;
+        double max = 0;
+        std::size_t repetitions = 0;
+    };
+
+    /**
+     * Number of timed repetitions of every measurement (--repetitions)
+     * @return The number of repetitions
+     */
+    std::size_t repetitions() noexcept;
+
+    /**
+     * Summarizes the values of the repetitions of a measurement
+     *
+     * @param[in] values One value per repetition
+     * @return The median, min and max of the values
+     */
+    Measurement summarize(std::vector<double> values);
+
+    /**
+     * Keeps the compiler from optimizing away the computation of a value
+     *
+     * @param[in] value The value
+     */
+    template <typename T>
+    inline void do_not_optimize(T const &value) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "g"(&value) : "memory");
+#else
+        static volatile char const *sink;
+        sink = reinterpret_cast<char const volatile *>(&value);
+#endif
+    }
+
+    /**
+     * Times a function, once untimed to warm the caches up and then for every repetition
+     *
+     * @param[in] operations Number of operations done by a single run of the function
+     * @param[in] fn Runs the operations and returns a value derived from them
+     * @return Nanoseconds per operation
+     */
+    template <typename Fn>
+    Measurement measure(std::size_t const operations, Fn &&fn)
+    {
+        do_not_optimize(fn());
+        std::vector<double> values;
+        for (std::size_t i = 0; i < repetitions(); ++i)
+        {
+            auto const start = std::chrono::steady_clock::now();
+            auto const result = fn();
+            std::chrono::duration<double, std::nano> const elapsed = std::chrono::steady_clock::now() - start;
+            do_not_optimize(result);
+            values.push_back(elapsed.count() / static_cast<double>(std::max<std::size_t>(operations, 1)));
+        }
+        return summarize(std::move(values));
+    }
+
+    /**
+     * Records a result of the running benchmark (printed right away and written to the JSON output)
+     *
+     * @param[in] name Name of the result, unique within the benchmark
+     * @param[in] measurement The measurement
+     * @param[in] unit Unit of the measurement
+     */
+    void report(std::string const &name, Measurement const &measurement, std::string const &unit = "ns/op");
+    /**
+     * Records a single value of the running benchmark (e.g. a cycle count or the size of a corpus)
+     *
+     * @param[in] name Name of the result, unique within the benchmark
+     * @param[in] value The value
+     * @param[in] unit Unit of the value
+     */
+    void report(std::string const &name, double const value, std::string const &unit);
+} // namespace benchmarks
@@ -0,0 +1,40 @@
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#include "benchmark.hpp"
+#include "config.hpp"
+
+// Configurations built per measurement
+#define CONFIGS 20000
+
+BENCHMARK(config)
+{
+    std::string const targets = "10.0.0.0/8, 192.168.1.7, 2001:db8::/32, 172.16.4.20";
+    benchmarks::report("Config construction", benchmarks::measure(CONFIGS, [&] {
+        std::size_t parsed = 0;
+        for (std::size_t i = 0; i < CONFIGS; ++i)
+        {
+            overwatch::core::Config config{targets, "eth0", ":info", std::string{"192.168.1.1"}};
+            parsed += config.get_targets().size();
+        }
+        return parsed;
+    }), "ns/config");
+
+    overwatch::core::Config config{targets, "eth0", ":info", std::string{"192.168.1.1"}};
+    benchmarks::report("Config::validate", benchmarks::measure(CONFIGS, [&] {
+        for (std::size_t i = 0; i < CONFIGS; ++i)
+        {
+            config.validate();
+        }
+        return CONFIGS;
+    }), "ns/config");
+    benchmarks::report("Config::to_string", benchmarks::measure(CONFIGS, [&] {
+        std::size_t length = 0;
+        for (std::size_t i = 0; i < CONFIGS; ++i)
+        {
+            length += config.to_string().size();
+        }
+        return length;
+    }), "ns/config");
+}
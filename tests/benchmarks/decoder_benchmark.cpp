@@ -0,0 +1,125 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "decoder.hpp"
+#include "pcap_fixture.hpp"
+#include "pcap_reader.hpp"
+#include "timing.hpp"
+
+// Capture file to decode instead of the synthetic corpus
+#define CORPUS_ENV "OVERWATCH_BENCH_PCAP"
+// Packets decoded per measurement (the corpus is decoded repeatedly)
+#define DECODED_PACKETS (1 << 24)
+// Frames in the synthetic corpus
+#define SYNTHETIC_FRAMES 4096
+
+namespace
+{
+    // Mix of the layer stacks the decoder handles, with payloads of typical sizes
+    std::filesystem::path write_synthetic_corpus_()
+    {
+        std::vector<std::uint8_t> const ipv6_extensions{17, 0, 0, 0, 0, 0, 0, 0, 0x04, 0xD2, 0x00, 0x35, 0, 8, 0, 0};
+        std::vector<fixtures::Frame> frames;
+        for (std::size_t i = 0; i < SYNTHETIC_FRAMES; ++i)
+        {
+            std::string const payload(i % 7 * 200, 'x');
+            std::vector<std::uint8_t> bytes;
+            switch (i % 6)
+            {
+            case 0:
+            case 1:
+                bytes = fixtures::tcp_frame("10.0.0.1", "10.0.0.2", 40000, 443, static_cast<std::uint32_t>(i), 0x18, payload);
+                break;
+            case 2:
+                bytes = fixtures::udp_frame("10.0.0.1", "8.8.8.8", 5353, 53, payload, {42});
+                break;
+            case 3:
+                bytes = fixtures::udp6_frame("2001:db8::1", "2001:db8::2", 5353, 53, payload);
+                break;
+            case 4:
+                bytes = fixtures::udp6_frame("2001:db8::1", "2001:db8::2", 5353, 53, payload, {100, 200});
+                break;
+            default:
+                // Hop-by-hop options in front of UDP
+                bytes = fixtures::ipv6_frame("fe80::1", "fe80::2", 0, ipv6_extensions);
+                break;
+            }
+            frames.push_back(fixtures::Frame{bytes, i * 1000});
+        }
+        std::filesystem::path const path = fixtures::temp_path("decoder_corpus.pcap");
+        fixtures::write_pcap(path, frames);
+        return path;
+    }
+
+    // Copies every frame of a capture file so that the views stay valid while decoding
+    std::vector<std::vector<std::uint8_t>> read_corpus_(std::filesystem::path const &path)
+    {
+        std::vector<std::vector<std::uint8_t>> frames;
+        overwatch::capture::PcapReader reader{path};
+        overwatch::capture::PacketBatch batch;
+        while (!reader.exhausted())
+        {
+            if (reader.next_batch(batch, 0))
+            {
+                for (overwatch::capture::PacketView const &packet : batch)
+                {
+                    frames.emplace_back(packet.data, packet.data + packet.caplen);
+                }
+            }
+        }
+        return frames;
+    }
+} // namespace
+
+BENCHMARK(decoder)
+{
+    char const *const corpus_env = std::getenv(CORPUS_ENV);
+    std::filesystem::path const path = corpus_env ? std::filesystem::path{corpus_env} : write_synthetic_corpus_();
+    std::vector<std::vector<std::uint8_t>> const frames = read_corpus_(path);
+    if (!corpus_env)
+    {
+        std::filesystem::remove(path);
+    }
+    if (frames.empty())
+    {
+        std::printf("No packets in %s\n", path.c_str());
+        return;
+    }
+    std::vector<overwatch::capture::PacketView> packets;
+    for (std::vector<std::uint8_t> const &frame : frames)
+    {
+        packets.push_back(overwatch::capture::PacketView{frame.data(), static_cast<std::uint32_t>(frame.size()),
+                                                         static_cast<std::uint32_t>(frame.size()), 0});
+    }
+
+    std::uint64_t decoded_ip = 0;
+    for (overwatch::capture::PacketView const &packet : packets)
+    {
+        decoded_ip += overwatch::decode::decode(packet).is_ip();
+    }
+    std::printf("corpus: %zu packets (%s), %.1f%% IP\n", packets.size(), corpus_env ? corpus_env : "synthetic",
+                100.0 * static_cast<double>(decoded_ip) / static_cast<double>(packets.size()));
+
+    auto const decode_all = [&packets] {
+        std::uint64_t layers = 0;
+        for (std::size_t i = 0; i < DECODED_PACKETS; ++i)
+        {
+            layers += overwatch::decode::decode(packets[i % packets.size()]).layers;
+        }
+        return layers;
+    };
+    benchmarks::report("decode", benchmarks::measure(DECODED_PACKETS, decode_all), "ns/packet");
+    std::vector<double> cycles;
+    for (std::size_t i = 0; i < benchmarks::repetitions(); ++i)
+    {
+        std::uint64_t const start_cycles = common::timing::cycles();
+        benchmarks::do_not_optimize(decode_all());
+        cycles.push_back(static_cast<double>(common::timing::cycles() - start_cycles) / DECODED_PACKETS);
+    }
+    benchmarks::report("decode (cycles)", benchmarks::summarize(cycles), "cycles/packet");
+}
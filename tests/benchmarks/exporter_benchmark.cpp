@@ -0,0 +1,65 @@
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "ip_address.hpp"
+#include "ipfix.hpp"
+
+// Flow records encoded per measurement
+#define RECORDS 100000
+
+namespace
+{
+    std::vector<overwatch::core::ExpiredFlow> make_flows_()
+    {
+        std::vector<overwatch::core::ExpiredFlow> flows(RECORDS);
+        for (std::uint32_t i = 0; i < RECORDS; ++i)
+        {
+            flows[i].key = overwatch::core::make_ipv4_flow_key(0x0A000000 + i, 0xC0A80001, static_cast<std::uint16_t>(1024 + i), 443, 6);
+            flows[i].record.first_seen_ns = 1700000000000000000ULL + i;
+            flows[i].record.last_seen_ns = flows[i].record.first_seen_ns + 1000000;
+            flows[i].record.packets[0] = i % 100;
+            flows[i].record.bytes[0] = i % 100 * 800;
+        }
+        return flows;
+    }
+} // namespace
+
+BENCHMARK(exporter)
+{
+    std::vector<overwatch::core::ExpiredFlow> const flows = make_flows_();
+
+    std::vector<std::uint8_t> buffer;
+    buffer.reserve(RECORDS * overwatch::exporter::IPFIX_RECORD_SIZE_IPV6 * 2);
+    benchmarks::report("IPFIX record encoding", benchmarks::measure(RECORDS, [&] {
+        overwatch::exporter::IpfixEncoder encoder{0};
+        buffer.clear();
+        for (overwatch::core::ExpiredFlow const &flow : flows)
+        {
+            encoder.add(buffer, flow);
+        }
+        encoder.finish(buffer);
+        benchmarks::do_not_optimize(buffer.data());
+        return RECORDS;
+    }), "ns/record");
+    benchmarks::report("IPFIX record size", static_cast<double>(buffer.size()) / RECORDS, "bytes/record");
+
+    // The text line the flows were logged as before they were exported
+    std::ostringstream stream;
+    benchmarks::report("text record formatting", benchmarks::measure(RECORDS, [&] {
+        stream.str("");
+        for (overwatch::core::ExpiredFlow const &flow : flows)
+        {
+            stream << "Flow " << common::utils::to_string(common::utils::IpAddress::from_bytes(flow.key.src_addr)) << ":"
+                   << flow.key.src_port << " <-> "
+                   << common::utils::to_string(common::utils::IpAddress::from_bytes(flow.key.dst_addr)) << ":"
+                   << flow.key.dst_port << " (protocol " << static_cast<unsigned>(flow.key.protocol) << ") - "
+                   << flow.record.packets[0] + flow.record.packets[1] << " packets, "
+                   << flow.record.bytes[0] + flow.record.bytes[1] << " bytes\n";
+        }
+        return RECORDS;
+    }), "ns/record");
+    benchmarks::report("text record size", static_cast<double>(stream.tellp()) / RECORDS, "bytes/record");
+}
@@ -0,0 +1,131 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "flow.hpp"
+#include "flow_table.hpp"
+
+// Number of lookups measured per configuration
+#define LOOKUPS (1 << 23)
+// Lookups hashed and prefetched ahead of being resolved
+#define PREFETCH_BATCH 16
+
+using overwatch::core::FlowKey;
+using overwatch::core::FlowRecord;
+using overwatch::core::FlowTable;
+
+namespace
+{
+    struct KeyHash
+    {
+        std::size_t operator()(FlowKey const &key) const noexcept
+        {
+            return overwatch::core::hash_flow_key(key);
+        }
+    };
+
+    FlowKey key_for_(std::uint64_t const i)
+    {
+        return overwatch::core::make_ipv4_flow_key(static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(i >> 32) ^ 0xC0A80001,
+                                                   static_cast<std::uint16_t>(i * 7), 443, 6);
+    }
+
+    // Random sample of the inserted flows so that lookups miss the caches like real traffic
+    std::vector<FlowKey> lookup_keys_(std::size_t const flows)
+    {
+        std::mt19937_64 rng{42};
+        std::uniform_int_distribution<std::uint64_t> dist{0, flows - 1};
+        std::vector<FlowKey> keys(LOOKUPS);
+        for (FlowKey &key : keys)
+        {
+            key = key_for_(dist(rng));
+        }
+        return keys;
+    }
+
+    // Times the lookups of every key, which must all find their flow
+    template <typename Fn>
+    void report_lookups_(std::string const &name, std::size_t const flows, Fn &&fn)
+    {
+        benchmarks::Measurement const measurement = benchmarks::measure(LOOKUPS, [&fn] {
+            std::size_t const found = fn();
+            if (found != LOOKUPS)
+            {
+                std::fprintf(stderr, "Only %zu of %d lookups found their flow\n", found, LOOKUPS);
+                std::exit(EXIT_FAILURE);
+            }
+            return found;
+        });
+        benchmarks::report(name + "/" + std::to_string(flows) + " flows", measurement, "ns/lookup");
+    }
+
+    void bench_flow_table_(std::size_t const flows)
+    {
+        FlowTable<FlowRecord> table{flows};
+        for (std::size_t i = 0; i < flows; ++i)
+        {
+            table.insert(key_for_(i))->last_seen_ns = i;
+        }
+        std::vector<FlowKey> const keys = lookup_keys_(flows);
+
+        report_lookups_("FlowTable::find", flows, [&] {
+            std::size_t found = 0;
+            for (FlowKey const &key : keys)
+            {
+                found += table.find(key) != nullptr;
+            }
+            return found;
+        });
+        report_lookups_("FlowTable::find (batched prefetch)", flows, [&] {
+            std::size_t found = 0;
+            std::uint64_t hashes[PREFETCH_BATCH];
+            for (std::size_t base = 0; base < keys.size(); base += PREFETCH_BATCH)
+            {
+                for (std::size_t i = 0; i < PREFETCH_BATCH; ++i)
+                {
+                    hashes[i] = overwatch::core::hash_flow_key(keys[base + i]);
+                    table.prefetch(hashes[i]);
+                }
+                for (std::size_t i = 0; i < PREFETCH_BATCH; ++i)
+                {
+                    found += table.find(keys[base + i], hashes[i]) != nullptr;
+                }
+            }
+            return found;
+        });
+    }
+
+    void bench_unordered_map_(std::size_t const flows)
+    {
+        std::unordered_map<FlowKey, FlowRecord, KeyHash> table;
+        table.reserve(flows);
+        for (std::size_t i = 0; i < flows; ++i)
+        {
+            table[key_for_(i)].last_seen_ns = i;
+        }
+        std::vector<FlowKey> const keys = lookup_keys_(flows);
+
+        report_lookups_("std::unordered_map::find", flows, [&] {
+            std::size_t found = 0;
+            for (FlowKey const &key : keys)
+            {
+                found += table.find(key) != table.end();
+            }
+            return found;
+        });
+    }
+} // namespace
+
+BENCHMARK(flow_table)
+{
+    for (std::size_t const flows : {1000000, 10000000})
+    {
+        bench_flow_table_(flows);
+        bench_unordered_map_(flows);
+    }
+}
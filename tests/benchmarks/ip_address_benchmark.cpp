@@ -0,0 +1,103 @@
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "ip_address.hpp"
+#include "utils.hpp"
+
+// Number of times every input is processed
+#define ROUNDS 20000
+
+namespace
+{
+    // The regex based check is_valid_ip_addr used before the hand written parser
+    bool regex_is_valid_ip_addr_(std::string const &ip_addr) noexcept
+    {
+        std::regex ip_regex{"^(?:[0-9]{1,3}\\.){3}[0-9]{1,3}$"};
+        return std::regex_match(ip_addr, ip_regex);
+    }
+
+    std::vector<std::string> const inputs_{"192.168.0.42", "10.0.0.1", "255.255.255.255", "999.999.999.999",
+                                           "1.2.3", "2001:db8::1", "fe80::1:2:3:4", "not an address"};
+} // namespace
+
+BENCHMARK(ip_address)
+{
+    // The regex version is orders of magnitude slower, run it for fewer rounds
+    std::size_t const regex_rounds = ROUNDS / 100;
+    benchmarks::report("regex is_valid_ip_addr", benchmarks::measure(regex_rounds * inputs_.size(), [&] {
+        std::size_t valid = 0;
+        for (std::size_t round = 0; round < regex_rounds; ++round)
+        {
+            for (std::string const &input : inputs_)
+            {
+                valid += regex_is_valid_ip_addr_(input);
+            }
+        }
+        return valid;
+    }));
+    benchmarks::report("is_valid_ip_addr", benchmarks::measure(ROUNDS * inputs_.size(), [&] {
+        std::size_t valid = 0;
+        for (std::size_t round = 0; round < ROUNDS; ++round)
+        {
+            for (std::string const &input : inputs_)
+            {
+                valid += common::utils::is_valid_ip_addr(input);
+            }
+        }
+        return valid;
+    }));
+    benchmarks::report("parse_ip_prefix", benchmarks::measure(ROUNDS * inputs_.size(), [&] {
+        std::size_t valid = 0;
+        for (std::size_t round = 0; round < ROUNDS; ++round)
+        {
+            for (std::string const &input : inputs_)
+            {
+                valid += common::utils::parse_ip_prefix(input).has_value();
+            }
+        }
+        return valid;
+    }));
+
+    // Matching packet addresses against the targets, as strings and as packed prefixes
+    std::vector<common::utils::IpPrefix> const targets = common::utils::parse_ip_prefix_list("10.0.0.0/8, 192.168.1.7");
+    std::vector<std::string> const target_strings{"10.0.0.0", "192.168.1.7"};
+    std::vector<common::utils::IpAddress> addrs;
+    std::vector<std::string> addr_strings;
+    for (std::uint32_t i = 0; i < 4096; ++i)
+    {
+        addrs.push_back(common::utils::IpAddress::from_ipv4(0xC0A80100 + (i & 0xFF) + (i << 20)));
+        addr_strings.push_back(common::utils::to_string(addrs.back()));
+    }
+    std::size_t const match_rounds = ROUNDS / 10;
+    benchmarks::report("string compare (hosts only)", benchmarks::measure(match_rounds * addrs.size(), [&] {
+        std::size_t matches = 0;
+        for (std::size_t round = 0; round < match_rounds; ++round)
+        {
+            for (std::string const &addr : addr_strings)
+            {
+                for (std::string const &target : target_strings)
+                {
+                    matches += addr == target;
+                }
+            }
+        }
+        return matches;
+    }));
+    benchmarks::report("IpPrefix::contains", benchmarks::measure(match_rounds * addrs.size(), [&] {
+        std::size_t matches = 0;
+        for (std::size_t round = 0; round < match_rounds; ++round)
+        {
+            for (common::utils::IpAddress const &addr : addrs)
+            {
+                for (common::utils::IpPrefix const &target : targets)
+                {
+                    matches += target.contains(addr);
+                }
+            }
+        }
+        return matches;
+    }));
+}
@@ -0,0 +1,78 @@
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "benchmark.hpp"
+#include "logging.hpp"
+
+// Entries logged per measurement
+#define ENTRIES 200000
+
+namespace
+{
+    // Logs a typical entry: a message with a few numbers and a string
+    void log_entry_(std::uint64_t const i, std::string const &iface)
+    {
+        LOG_INFO << "Captured " << i << " packets (" << i * 64 << " bytes) on " << iface;
+    }
+
+    std::filesystem::path log_path_()
+    {
+        return std::filesystem::temp_directory_path() / "overwatch-benchmark.log";
+    }
+} // namespace
+
+BENCHMARK(logging)
+{
+    std::string const iface = "eth0";
+
+    // Entries below the threshold are dropped before their arguments are evaluated
+    common::logging::set_logger(":error");
+    benchmarks::report("filtered LOG_INFO", benchmarks::measure(ENTRIES, [&] {
+        for (std::uint64_t i = 0; i < ENTRIES; ++i)
+        {
+            log_entry_(i, iface);
+        }
+        return ENTRIES;
+    }), "ns/entry");
+
+    // Building the entry without writing it (the entry is below the threshold of the logger)
+    benchmarks::report("LogEntry formatting", benchmarks::measure(ENTRIES, [&] {
+        std::size_t entries = 0;
+        for (std::uint64_t i = 0; i < ENTRIES; ++i)
+        {
+#ifdef NDEBUG
+            common::logging::LogEntry entry{common::logging::LogSeverity::Info};
+#else
+            common::logging::LogEntry entry{common::logging::LogSeverity::Info, __LINE__, __func__};
+#endif
+            entry << "Captured " << i << " packets (" << i * 64 << " bytes) on " << iface;
+            ++entries;
+        }
+        return entries;
+    }), "ns/entry");
+
+    std::filesystem::path const path = log_path_();
+    common::logging::set_logger(path.u8string() + ":info:sync");
+    benchmarks::report("LogEntry to file (sync)", benchmarks::measure(ENTRIES, [&] {
+        for (std::uint64_t i = 0; i < ENTRIES; ++i)
+        {
+            log_entry_(i, iface);
+        }
+        return ENTRIES;
+    }), "ns/entry");
+
+    // Only the logging thread's share, the background writer drains on its own
+    common::logging::set_logger(path.u8string() + ":info:async");
+    benchmarks::report("LogEntry to file (async)", benchmarks::measure(ENTRIES, [&] {
+        for (std::uint64_t i = 0; i < ENTRIES; ++i)
+        {
+            log_entry_(i, iface);
+        }
+        return ENTRIES;
+    }), "ns/entry");
+
+    // Switching back waits for the background writer
+    common::logging::set_logger(":error");
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,70 @@
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+
+// Number of addresses looked up per run
+#define LOOKUPS 4000000
+// Sizes of the target lists
+#define TARGET_COUNTS {16, 256, 4096, 65536}
+
+BENCHMARK(lpm_table)
+{
+    std::mt19937_64 random{7};
+    for (std::size_t const count : TARGET_COUNTS)
+    {
+        // Hosts and /24 ranges of a /8 network plus a few IPv6 networks
+        std::vector<common::utils::IpPrefix> targets;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            common::utils::IpAddress const addr = common::utils::IpAddress::from_ipv4(0x0A000000 | (random() & 0x00FFFFFF));
+            targets.push_back(common::utils::IpPrefix::create(addr, i % 4 == 0 ? 24 : 32).value());
+            if (i % 16 == 0)
+            {
+                targets.push_back(common::utils::IpPrefix::create(common::utils::IpAddress{0x20010DB800000000ULL | (random() & 0xFFFF), 0}, 64).value());
+            }
+        }
+        std::vector<common::utils::IpAddress> addrs;
+        for (std::size_t i = 0; i < 1024; ++i)
+        {
+            addrs.push_back(i % 2 ? targets[random() % targets.size()].address
+                                  : common::utils::IpAddress::from_ipv4(0x0A000000 | (random() & 0x00FFFFFF)));
+        }
+
+        overwatch::core::LpmTable const table{targets};
+        std::string const suffix = "/" + std::to_string(targets.size()) + " targets";
+        benchmarks::report("LpmTable::lookup" + suffix, benchmarks::measure(LOOKUPS, [&] {
+            std::uint64_t matched = 0;
+            for (std::size_t i = 0; i < LOOKUPS; ++i)
+            {
+                matched += table.lookup(addrs[i % addrs.size()]) != overwatch::core::LpmTable::NO_MATCH;
+            }
+            return matched;
+        }), "ns/lookup");
+        // The linear scan only gets a fraction of the lookups at large sizes
+        std::size_t const linear_lookups = LOOKUPS / count;
+        benchmarks::report("linear contains" + suffix, benchmarks::measure(linear_lookups, [&] {
+            std::uint64_t matched = 0;
+            for (std::size_t i = 0; i < linear_lookups; ++i)
+            {
+                common::utils::IpAddress const &addr = addrs[i % addrs.size()];
+                std::uint8_t best = 0;
+                bool found = false;
+                for (common::utils::IpPrefix const &target : targets)
+                {
+                    if (target.contains(addr) && (!found || target.length > best))
+                    {
+                        best = target.length;
+                        found = true;
+                    }
+                }
+                matched += found;
+            }
+            return matched;
+        }), "ns/lookup");
+    }
+}
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+
+// Timed repetitions of every measurement unless --repetitions says otherwise
+#define DEFAULT_REPETITIONS 5
+
+namespace
+{
+    struct Result
+    {
+        std::string benchmark;
+        std::string name;
+        std::string unit;
+        benchmarks::Measurement measurement;
+    };
+
+    std::vector<std::pair<std::string, benchmarks::BenchmarkFunction>> &registry_()
+    {
+        static std::vector<std::pair<std::string, benchmarks::BenchmarkFunction>> registry;
+        return registry;
+    }
+
+    std::size_t repetitions_ = DEFAULT_REPETITIONS;
+    // Benchmark being run and the results reported so far
+    std::string running_;
+    std::vector<Result> results_;
+
+    std::string escape_(std::string const &str)
+    {
+        std::string escaped;
+        for (char const c : str)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    /**
+     * Writes the results as JSON, one result per line and no timestamps so that the
+     * files of two commits diff cleanly
+     */
+    void write_json_(std::string const &path)
+    {
+        std::ofstream file{path, std::ios::trunc};
+        if (!file)
+        {
+            throw std::runtime_error{"Failed to open '" + path + "'"};
+        }
+#ifdef NDEBUG
+        char const *const build = "release";
+#else
+        char const *const build = "debug";
+#endif
+#if defined(__clang__)
+        std::string const compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+        std::string const compiler = "gcc " __VERSION__;
+#else
+        std::string const compiler = "unknown";
+#endif
+        file << "{\n  \"context\": {\"build\": \"" << build << "\", \"compiler\": \"" << escape_(compiler)
+             << "\", \"cpus\": " << std::thread::hardware_concurrency() << ", \"repetitions\": " << repetitions_ << "},\n";
+        file << "  \"results\": [";
+        char line[512];
+        for (std::size_t i = 0; i < results_.size(); ++i)
+        {
+            Result const &result = results_[i];
+            std::snprintf(line, sizeof(line),
+                          "%s\n    {\"benchmark\": \"%s\", \"name\": \"%s\", \"unit\": \"%s\", \"median\": %.3f, \"min\": %.3f, "
+                          "\"max\": %.3f, \"repetitions\": %zu}",
+                          i == 0 ? "" : ",", escape_(result.benchmark).c_str(), escape_(result.name).c_str(),
+                          escape_(result.unit).c_str(), result.measurement.median, result.measurement.min,
+                          result.measurement.max, result.measurement.repetitions);
+            file << line;
+        }
+        file << "\n  ]\n}\n";
+        if (!file.flush())
+        {
+            throw std::runtime_error{"Failed to write '" + path + "'"};
+        }
+    }
+} // namespace
+
+namespace benchmarks
+{
+    bool register_benchmark(char const *name, BenchmarkFunction function)
+    {
+        registry_().emplace_back(name, function);
+        return true;
+    }
+
+    std::size_t repetitions() noexcept
+    {
+        return repetitions_;
+    }
+
+    Measurement summarize(std::vector<double> values)
+    {
+        Measurement measurement;
+        if (values.empty())
+        {
+            return measurement;
+        }
+        std::sort(values.begin(), values.end());
+        std::size_t const middle = values.size() / 2;
+        measurement.median = values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+        measurement.min = values.front();
+        measurement.max = values.back();
+        measurement.repetitions = values.size();
+        return measurement;
+    }
+
+    void report(std::string const &name, Measurement const &measurement, std::string const &unit)
+    {
+        if (measurement.repetitions > 1)
+        {
+            std::printf("%-36s %12.2f %-14s (min %.2f, max %.2f)\n", name.c_str(), measurement.median, unit.c_str(),
+                        measurement.min, measurement.max);
+        }
+        else
+        {
+            std::printf("%-36s %12.2f %s\n", name.c_str(), measurement.median, unit.c_str());
+        }
+        std::fflush(stdout);
+        results_.push_back(Result{running_, name, unit, measurement});
+    }
+
+    void report(std::string const &name, double const value, std::string const &unit)
+    {
+        report(name, Measurement{value, value, value, 1}, unit);
+    }
+} // namespace benchmarks
+
+/**
+ * Runs every benchmark, or only those whose name contains one of the filters
+ *
+ * Usage: benchmarks [--json <file>] [--repetitions <count>] [filter...]
+ */
+int main(int argc, char *argv[])
+{
+#ifndef NDEBUG
+    std::printf("Warning: benchmarks built without NDEBUG, configure with -DCMAKE_BUILD_TYPE=Release\n");
+#endif
+    std::string json_path;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        if ((arg == "--json" || arg == "--repetitions") && i + 1 < argc)
+        {
+            std::string const value = argv[++i];
+            if (arg == "--json")
+            {
+                json_path = value;
+            }
+            else if ((repetitions_ = std::strtoul(value.c_str(), nullptr, 10)) == 0)
+            {
+                std::fprintf(stderr, "Invalid repetition count '%s'\n", value.c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            filters.push_back(arg);
+        }
+    }
+
+    // Registration order depends on the link order, results are listed by name to diff cleanly
+    std::sort(registry_().begin(), registry_().end());
+    for (auto const &[name, function] : registry_())
+    {
+        bool const selected = filters.empty() || std::any_of(filters.begin(), filters.end(), [&name = name](std::string const &filter) {
+                                  return name.find(filter) != std::string::npos;
+                              });
+        if (selected)
+        {
+            std::printf("== %s\n", name.c_str());
+            running_ = name;
+            function();
+        }
+    }
+
+    if (!json_path.empty())
+    {
+        try
+        {
+            write_json_(json_path);
+        }
+        catch (std::exception const &e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
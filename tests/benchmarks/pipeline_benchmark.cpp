@@ -0,0 +1,76 @@
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+#include "pcap_fixture.hpp"
+#include "pipeline.hpp"
+
+// Distinct flows in the synthetic traffic
+#define FLOWS (1 << 18)
+// Packets run through the pipeline per measurement
+#define PACKETS (1 << 22)
+// Burst sizes compared (1 is per-packet processing)
+#define BURST_SIZES {1, 32, 256}
+
+namespace
+{
+    std::unique_ptr<overwatch::core::Pipeline> make_pipeline_(std::shared_ptr<overwatch::core::LpmTable const> const &targets,
+                                                              std::uint64_t &exported)
+    {
+        auto pipeline = std::make_unique<overwatch::core::Pipeline>();
+        pipeline->add_stage(std::make_unique<overwatch::core::DecodeStage>());
+        pipeline->add_stage(std::make_unique<overwatch::core::ClassifyStage>(targets));
+        pipeline->add_stage(std::make_unique<overwatch::core::FlowStage>(FLOWS * 2, 60ULL * 1000 * 1000 * 1000));
+        pipeline->add_stage(std::make_unique<overwatch::core::ExportStage>(
+            [&exported](overwatch::core::ExpiredFlow const &) { ++exported; }));
+        return pipeline;
+    }
+} // namespace
+
+BENCHMARK(pipeline)
+{
+    // One frame per flow, replayed in random order so that flow lookups miss the caches
+    std::mt19937_64 random{3};
+    std::vector<std::vector<std::uint8_t>> frames;
+    for (std::uint32_t i = 0; i < FLOWS; ++i)
+    {
+        std::string const src = "10." + std::to_string(i >> 16) + "." + std::to_string((i >> 8) & 0xFF) + "." + std::to_string(i & 0xFF);
+        frames.push_back(fixtures::tcp_frame(src, "192.168.1.7", static_cast<std::uint16_t>(random()), 443, 1, 0x10, std::string(64, 'x')));
+    }
+    std::vector<overwatch::capture::PacketView> packets;
+    for (std::size_t i = 0; i < PACKETS; ++i)
+    {
+        std::vector<std::uint8_t> const &frame = frames[random() % frames.size()];
+        packets.push_back(overwatch::capture::PacketView{frame.data(), static_cast<std::uint32_t>(frame.size()),
+                                                         static_cast<std::uint32_t>(frame.size()), i});
+    }
+    auto const targets = std::make_shared<overwatch::core::LpmTable const>(
+        common::utils::parse_ip_prefix_list("10.0.0.0/8, 192.168.1.7"));
+
+    for (std::size_t const burst_size : BURST_SIZES)
+    {
+        std::uint64_t exported = 0;
+        std::unique_ptr<overwatch::core::Pipeline> const pipeline = make_pipeline_(targets, exported);
+        overwatch::capture::PacketBatch batch;
+        // Flows created by the warm-up run stay in the table, the repetitions measure the steady state
+        benchmarks::Measurement const measurement = benchmarks::measure(PACKETS, [&] {
+            for (std::size_t i = 0; i < PACKETS; i += burst_size)
+            {
+                batch.clear();
+                for (std::size_t j = i; j < i + burst_size && j < PACKETS; ++j)
+                {
+                    batch.push_back(packets[j]);
+                }
+                pipeline->process(batch);
+            }
+            return exported;
+        });
+        pipeline->flush();
+        benchmarks::report("burst of " + std::to_string(burst_size), measurement, "ns/packet");
+    }
+}
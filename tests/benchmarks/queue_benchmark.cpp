@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "queue.hpp"
+
+// Items handed over per measurement
+#define ITEMS 1000000
+// Round trips per latency measurement
+#define ROUND_TRIPS 100000
+#define QUEUE_CAPACITY 4096
+#define BATCH_SIZE 32
+
+namespace
+{
+    /**
+     * What the handoff between two threads looked like before the queues: a mutex around a std::queue
+     */
+    template <typename T>
+    class MutexQueue
+    {
+    public:
+        explicit MutexQueue(std::size_t const capacity) : capacity_{capacity}
+        {
+        }
+
+        bool try_push(T const &item)
+        {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            if (queue_.size() == capacity_)
+            {
+                return false;
+            }
+            queue_.push(item);
+            return true;
+        }
+
+        template <typename InputIt>
+        std::size_t push_batch(InputIt first, std::size_t const count)
+        {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            std::size_t const pushed = std::min(count, capacity_ - queue_.size());
+            for (std::size_t i = 0; i < pushed; ++i, ++first)
+            {
+                queue_.push(*first);
+            }
+            return pushed;
+        }
+
+        template <typename OutputIt>
+        std::size_t pop_batch(OutputIt out, std::size_t const max)
+        {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            std::size_t const popped = std::min(max, queue_.size());
+            for (std::size_t i = 0; i < popped; ++i, ++out)
+            {
+                *out = queue_.front();
+                queue_.pop();
+            }
+            return popped;
+        }
+
+    private:
+        std::size_t const capacity_;
+        std::mutex mutex_;
+        std::queue<T> queue_;
+    };
+
+    /**
+     * Hands ITEMS items from producer threads over to the calling thread
+     *
+     * @param[in] queue The queue
+     * @param[in] producers Number of producer threads (only one for single producer queues)
+     * @param[in] batch Items pushed and popped at once (1 pushes them one by one)
+     * @return The sum of the items received
+     */
+    template <typename Queue>
+    std::uint64_t handoff_(Queue &queue, std::size_t const producers, std::size_t const batch)
+    {
+        std::vector<std::thread> threads;
+        for (std::size_t producer = 0; producer < producers; ++producer)
+        {
+            threads.emplace_back([&queue, producers, batch]() {
+                std::array<std::uint64_t, BATCH_SIZE> items{};
+                std::uint64_t const count = ITEMS / producers;
+                for (std::uint64_t next = 0; next < count;)
+                {
+                    std::size_t const size = std::min<std::uint64_t>(batch, count - next);
+                    for (std::size_t i = 0; i < size; ++i)
+                    {
+                        items[i] = next + i;
+                    }
+                    std::size_t const pushed = size == 1 ? (queue.try_push(items[0]) ? 1 : 0) : queue.push_batch(items.begin(), size);
+                    if (pushed == 0)
+                    {
+                        // Full - let the consumer run when both share a core
+                        std::this_thread::yield();
+                    }
+                    next += pushed;
+                }
+            });
+        }
+
+        std::array<std::uint64_t, BATCH_SIZE> items{};
+        std::uint64_t sum = 0;
+        for (std::uint64_t received = 0; received < ITEMS / producers * producers;)
+        {
+            std::size_t const popped = queue.pop_batch(items.begin(), batch);
+            if (popped == 0)
+            {
+                std::this_thread::yield();
+            }
+            for (std::size_t i = 0; i < popped; ++i)
+            {
+                sum += items[i];
+            }
+            received += popped;
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        return sum;
+    }
+
+    /**
+     * Measures a handoff and reports it
+     */
+    template <typename Queue>
+    void report_handoff_(std::string const &name, std::size_t const producers, std::size_t const batch)
+    {
+        benchmarks::report(name, benchmarks::measure(ITEMS, [&] {
+            Queue queue{QUEUE_CAPACITY};
+            return handoff_(queue, producers, batch);
+        }), "ns/item");
+    }
+} // namespace
+
+BENCHMARK(queue)
+{
+    // Both sides on one thread: the cost of the operations alone
+    common::queue::SpscQueue<std::uint64_t> local{QUEUE_CAPACITY};
+    benchmarks::report("SpscQueue push+pop, one thread", benchmarks::measure(ITEMS, [&] {
+        std::uint64_t sum = 0;
+        std::uint64_t item = 0;
+        for (std::uint64_t i = 0; i < ITEMS; ++i)
+        {
+            local.try_push(i);
+            local.try_pop(item);
+            sum += item;
+        }
+        return sum;
+    }), "ns/item");
+
+    report_handoff_<common::queue::SpscQueue<std::uint64_t>>("SpscQueue handoff", 1, 1);
+    report_handoff_<common::queue::SpscQueue<std::uint64_t>>("SpscQueue handoff, batches", 1, BATCH_SIZE);
+    report_handoff_<common::queue::MpscQueue<std::uint64_t>>("MpscQueue handoff, 1 producer", 1, 1);
+    report_handoff_<common::queue::MpscQueue<std::uint64_t>>("MpscQueue handoff, 4 producers", 4, 1);
+    report_handoff_<common::queue::MpscQueue<std::uint64_t>>("MpscQueue handoff, 4 prod., batches", 4, BATCH_SIZE);
+    report_handoff_<MutexQueue<std::uint64_t>>("mutex+std::queue handoff", 1, 1);
+    report_handoff_<MutexQueue<std::uint64_t>>("mutex+std::queue handoff, 4 prod.", 4, 1);
+
+    // Latency: an item bounced between two threads through a pair of queues
+    benchmarks::report("SpscQueue round trip", benchmarks::measure(ROUND_TRIPS, [&] {
+        common::queue::SpscQueue<std::uint64_t> ping{16};
+        common::queue::SpscQueue<std::uint64_t> pong{16};
+        std::thread echo{[&ping, &pong]() {
+            std::uint64_t item = 0;
+            for (std::uint64_t i = 0; i < ROUND_TRIPS; ++i)
+            {
+                while (!ping.try_pop(item))
+                {
+                    std::this_thread::yield();
+                }
+                while (!pong.try_push(item + 1))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }};
+        std::uint64_t item = 0;
+        for (std::uint64_t i = 0; i < ROUND_TRIPS; ++i)
+        {
+            ping.try_push(item);
+            while (!pong.try_pop(item))
+            {
+                std::this_thread::yield();
+            }
+        }
+        echo.join();
+        return item;
+    }), "ns/round trip");
+}
@@ -0,0 +1,275 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "async_log_writer.hpp"
+#include "logging.hpp"
+#include "test_utils.hpp"
+
+#define TEST_NAME_PREFIX "Logging::"
+
+namespace
+{
+    std::vector<std::string> read_lines(std::filesystem::path const &path)
+    {
+        std::vector<std::string> lines;
+        std::ifstream in{path};
+        for (std::string line; std::getline(in, line);)
+        {
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    // Captures what is written to std::cout for its lifetime
+    class CoutCapture
+    {
+    public:
+        CoutCapture() : previous_{std::cout.rdbuf(captured_.rdbuf())}
+        {
+        }
+        ~CoutCapture()
+        {
+            std::cout.rdbuf(previous_);
+        }
+
+        std::string str() const
+        {
+            return captured_.str();
+        }
+
+    private:
+        std::ostringstream captured_;
+        std::streambuf *previous_;
+    };
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Asynchronous writer keeps the records of every thread in order")
+{
+    std::filesystem::path const path = fixtures::temp_path("async.log");
+    int const num_threads = 4;
+    int const records_per_thread = 20000;
+    try
+    {
+        common::logging::AsyncLogWriter writer{path, 1 << 16};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back([&writer, t] {
+                for (int i = 0; i < records_per_thread; ++i)
+                {
+                    std::string const record = std::to_string(t) + " " + std::to_string(i) + "\n";
+                    // Retry so that the test does not depend on the writer keeping up
+                    while (!writer.push(record))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+    }
+    catch (std::runtime_error const &e)
+    {
+        WARN("Skipping asynchronous logging test: " << e.what());
+        return;
+    }
+
+    std::vector<std::string> const lines = read_lines(path);
+    REQUIRE(lines.size() == num_threads * records_per_thread);
+    std::map<int, int> next;
+    for (std::string const &line : lines)
+    {
+        std::size_t const space = line.find(' ');
+        REQUIRE(space != std::string::npos);
+        int const thread = std::stoi(line.substr(0, space));
+        REQUIRE(std::stoi(line.substr(space + 1)) == next[thread]++);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Rings of exited threads are freed once drained")
+{
+    std::filesystem::path const path = fixtures::temp_path("rings.log");
+    int const num_threads = 8;
+    try
+    {
+        common::logging::AsyncLogWriter writer{path, 1 << 12};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back([&writer, t] { writer.push(std::to_string(t) + "\n"); });
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        for (int i = 0; i < 1000 && writer.get_rings() > 0; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        REQUIRE(writer.get_rings() == 0);
+        REQUIRE(writer.get_dropped() == 0);
+    }
+    catch (std::runtime_error const &e)
+    {
+        WARN("Skipping asynchronous logging test: " << e.what());
+        return;
+    }
+    REQUIRE(read_lines(path).size() == num_threads);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "The logger can be switched while other threads log")
+{
+    std::filesystem::path const async_path = fixtures::temp_path("switch_async.log");
+    std::filesystem::path const sync_path = fixtures::temp_path("switch_sync.log");
+    try
+    {
+        common::logging::set_logger(async_path.u8string() + ":error:async");
+    }
+    catch (std::runtime_error const &e)
+    {
+        WARN("Skipping asynchronous logging test: " << e.what());
+        return;
+    }
+    std::string console;
+    {
+        // Every line goes to one of the files, none to the console
+        CoutCapture const capture;
+        std::atomic_bool stop{false};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&stop, t] {
+                while (!stop)
+                {
+                    LOG_ERROR << "thread " << t;
+                }
+            });
+        }
+        for (int i = 0; i < 50; ++i)
+        {
+            common::logging::set_logger((i % 2 == 0 ? sync_path : async_path).u8string() + ":error" + (i % 2 == 0 ? "" : ":async"));
+        }
+        stop = true;
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        // The last switch was to the asynchronous logger
+        LOG_ERROR << "last entry";
+        common::logging::set_logger(sync_path.u8string() + ":error");
+        console = capture.str();
+    }
+    common::logging::set_logger(":error");
+    REQUIRE(console.empty());
+    std::vector<std::string> const lines = read_lines(async_path);
+    REQUIRE_FALSE(lines.empty());
+    REQUIRE(lines.back().find("ERROR - last entry") != std::string::npos);
+    for (std::string const &line : lines)
+    {
+        REQUIRE(line.find("ERROR - ") != std::string::npos);
+    }
+    std::filesystem::remove(async_path);
+    std::filesystem::remove(sync_path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Records that do not fit are dropped and counted")
+{
+    std::filesystem::path const path = fixtures::temp_path("dropped.log");
+    try
+    {
+        common::logging::AsyncLogWriter writer{path, 64};
+        REQUIRE(writer.push("fits\n"));
+        REQUIRE_FALSE(writer.push(std::string(100, 'x') + "\n"));
+        REQUIRE(writer.get_dropped() == 1);
+    }
+    catch (std::runtime_error const &e)
+    {
+        WARN("Skipping asynchronous logging test: " << e.what());
+        return;
+    }
+    REQUIRE(read_lines(path) == std::vector<std::string>{"fits"});
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Logging mode is selected by the logging string")
+{
+    if (LOG_MIN_SEVERITY > static_cast<int>(common::logging::LogSeverity::Info))
+    {
+        WARN("Skipping logging test: info entries are compiled out");
+        return;
+    }
+    std::filesystem::path const path = fixtures::temp_path("mode.log");
+    REQUIRE_THROWS_AS(common::logging::set_logger(path.u8string() + ":info:later"), std::invalid_argument);
+    try
+    {
+        common::logging::set_logger(path.u8string() + ":info:async");
+    }
+    catch (std::runtime_error const &e)
+    {
+        WARN("Skipping asynchronous logging test: " << e.what());
+        return;
+    }
+    LOG_INFO << "queued entry";
+    LOG_DEBUG << "filtered entry";
+    REQUIRE(common::logging::dropped_log_entries() == 0);
+    // Switching back to the console writes the pending entries
+    common::logging::set_logger(":error");
+
+    std::vector<std::string> const lines = read_lines(path);
+    REQUIRE(lines.size() == 1);
+    REQUIRE(lines[0].find("INFO - queued entry") != std::string::npos);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Discarded entries do not evaluate their arguments")
+{
+    common::logging::set_logger(":error");
+    int evaluations = 0;
+    auto const expensive = [&evaluations] {
+        ++evaluations;
+        return std::string{"expensive"};
+    };
+    LOG_DEBUG << expensive();
+    LOG_WARNING << expensive();
+    REQUIRE(evaluations == 0);
+    REQUIRE_FALSE(common::logging::should_log(common::logging::LogSeverity::Info));
+    REQUIRE(common::logging::should_log(common::logging::LogSeverity::Error));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Numbers of every type are formatted")
+{
+    if (LOG_MIN_SEVERITY > static_cast<int>(common::logging::LogSeverity::Info))
+    {
+        WARN("Skipping logging test: info entries are compiled out");
+        return;
+    }
+    std::filesystem::path const path = fixtures::temp_path("numbers.log");
+    common::logging::set_logger(path.u8string() + ":info");
+    std::uint64_t const large = UINT64_MAX;
+    std::size_t const size = 42;
+    std::int8_t const small = -3;
+    LOG_INFO << large << " " << size << " " << small << " " << 1.5 << " " << true << " " << 'c' << " " << "text";
+    // Closes the file
+    common::logging::set_logger(":error");
+
+    std::vector<std::string> const lines = read_lines(path);
+    REQUIRE(lines.size() == 1);
+    REQUIRE(lines[0].find("INFO - 18446744073709551615 42 -3 1.500000 true c text") != std::string::npos);
+    std::filesystem::remove(path);
+}
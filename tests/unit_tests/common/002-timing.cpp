@@ -0,0 +1,53 @@
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <catch2/catch.hpp>
+
+#include "timing.hpp"
+
+#define TEST_NAME_PREFIX "Timing::"
+
+TEST_CASE(TEST_NAME_PREFIX "Monotonic clock never goes backwards")
+{
+    std::uint64_t previous = common::timing::monotonic_ns();
+    for (int i = 0; i < 100000; ++i)
+    {
+        std::uint64_t const now = common::timing::monotonic_ns();
+        REQUIRE(now >= previous);
+        previous = now;
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Monotonic clock follows the steady clock")
+{
+    auto const steady_start = std::chrono::steady_clock::now();
+    std::uint64_t const start = common::timing::monotonic_ns();
+    std::uint64_t const cycles_start = common::timing::cycles();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::uint64_t const elapsed = common::timing::monotonic_ns() - start;
+    std::uint64_t const steady_elapsed = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - steady_start).count());
+
+    INFO("TSC clock: " << common::timing::tsc_clock());
+    // Within 2% of the steady clock
+    REQUIRE(elapsed > steady_elapsed / 100 * 98);
+    REQUIRE(elapsed < steady_elapsed / 100 * 102);
+    REQUIRE(common::timing::cycles() > cycles_start);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Timestamps are formatted like ctime")
+{
+    std::string const timestamp{common::timing::local_timestamp()};
+    // "Sat Oct 17 01:59:47 2026"
+    REQUIRE(timestamp.size() == 24);
+    REQUIRE(timestamp[3] == ' ');
+    REQUIRE(timestamp[13] == ':');
+    REQUIRE(timestamp[16] == ':');
+
+    std::time_t const now = std::time(nullptr);
+    char year[8];
+    std::strftime(year, sizeof(year), "%Y", std::localtime(&now));
+    REQUIRE(timestamp.substr(20) == year);
+}
@@ -0,0 +1,134 @@
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <catch2/catch.hpp>
+
+#include "ip_address.hpp"
+#include "utils.hpp"
+
+#define TEST_NAME_PREFIX "IpAddress::"
+
+using common::utils::IpAddress;
+using common::utils::IpPrefix;
+using common::utils::parse_ip_addr;
+using common::utils::parse_ip_prefix;
+
+TEST_CASE(TEST_NAME_PREFIX "IPv4 addresses are parsed strictly")
+{
+    std::optional<IpAddress> const addr = parse_ip_addr("192.168.0.42");
+    REQUIRE(addr);
+    REQUIRE(addr->is_ipv4());
+    REQUIRE(addr->to_ipv4() == 0xC0A8002A);
+    REQUIRE(*addr == IpAddress::from_ipv4(0xC0A8002A));
+    REQUIRE(parse_ip_addr("0.0.0.0"));
+    REQUIRE(parse_ip_addr("255.255.255.255"));
+
+    auto const invalid = GENERATE(as<std::string>{}, "", "999.999.999.999", "256.0.0.1", "1.2.3", "1.2.3.4.5", "1.2.3.4.",
+                                  ".1.2.3", "1..2.3", "01.2.3.4", "1.2.3.-4", "1.2.3.4 ", "a.b.c.d", "1.2.3.4/24");
+    INFO("Address: '" << invalid << "'");
+    REQUIRE_FALSE(parse_ip_addr(invalid));
+    REQUIRE_FALSE(common::utils::is_valid_ip_addr(invalid));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "IPv6 addresses are parsed and formatted")
+{
+    struct Case
+    {
+        std::string text;
+        std::string canonical;
+    };
+    auto const valid = GENERATE(values<Case>({
+        {"2001:db8::1", "2001:db8::1"},
+        {"2001:0DB8:0000:0000:0000:0000:0000:0001", "2001:db8::1"},
+        {"::", "::"},
+        {"::1", "::1"},
+        {"fe80::", "fe80::"},
+        {"1:0:0:2:0:0:0:3", "1:0:0:2::3"},
+        {"1:2:3:4:5:6:7:8", "1:2:3:4:5:6:7:8"},
+        {"1::2:0:0:3", "1::2:0:0:3"},
+        {"64:ff9b::192.0.2.33", "64:ff9b::c000:221"},
+        {"::ffff:10.0.0.1", "10.0.0.1"},
+    }));
+    INFO("Address: '" << valid.text << "'");
+    std::optional<IpAddress> const addr = parse_ip_addr(valid.text);
+    REQUIRE(addr);
+    REQUIRE(common::utils::to_string(*addr) == valid.canonical);
+    REQUIRE(parse_ip_addr(valid.canonical) == addr);
+    REQUIRE(IpAddress::from_bytes(addr->to_bytes()) == *addr);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid IPv6 addresses are rejected")
+{
+    auto const invalid = GENERATE(as<std::string>{}, ":", ":::", "1:::2", "1::2::3", "1:2:3:4:5:6:7", "1:2:3:4:5:6:7:8:9",
+                                  "1:2:3:4:5:6:7:8::", "12345::", "g::1", "1:", ":1", "::1.2.3", "::1.2.3.4:5",
+                                  "1:2:3:4:5:6:7:1.2.3.4", "fe80::1%eth0");
+    INFO("Address: '" << invalid << "'");
+    REQUIRE_FALSE(parse_ip_addr(invalid));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Prefixes match the addresses of their network")
+{
+    std::optional<IpPrefix> const ipv4 = parse_ip_prefix("10.1.2.3/16");
+    REQUIRE(ipv4);
+    REQUIRE(ipv4->length == 16);
+    REQUIRE(common::utils::to_string(*ipv4) == "10.1.0.0/16");
+    REQUIRE(ipv4->contains(*parse_ip_addr("10.1.255.255")));
+    REQUIRE_FALSE(ipv4->contains(*parse_ip_addr("10.2.0.0")));
+    REQUIRE_FALSE(ipv4->contains(*parse_ip_addr("::a01:0")));
+
+    std::optional<IpPrefix> const ipv6 = parse_ip_prefix("2001:db8::/33");
+    REQUIRE(ipv6);
+    REQUIRE(ipv6->contains(*parse_ip_addr("2001:db8:7fff::1")));
+    REQUIRE_FALSE(ipv6->contains(*parse_ip_addr("2001:db8:8000::")));
+
+    std::optional<IpPrefix> const any_ipv4 = parse_ip_prefix("0.0.0.0/0");
+    REQUIRE(any_ipv4->contains(*parse_ip_addr("8.8.8.8")));
+    REQUIRE_FALSE(any_ipv4->contains(*parse_ip_addr("2001:db8::1")));
+
+    std::optional<IpPrefix> const host = parse_ip_prefix("fe80::1");
+    REQUIRE(host->length == 128);
+    REQUIRE(common::utils::to_string(*host) == "fe80::1");
+    REQUIRE(host->contains(*parse_ip_addr("fe80::1")));
+    REQUIRE_FALSE(host->contains(*parse_ip_addr("fe80::2")));
+
+    auto const invalid = GENERATE(as<std::string>{}, "10.0.0.0/33", "::/129", "10.0.0.0/", "10.0.0.0/08", "10.0.0.0/a", "/8");
+    INFO("Prefix: '" << invalid << "'");
+    REQUIRE_FALSE(parse_ip_prefix(invalid));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "IPv4-mapped prefixes take IPv6 lengths")
+{
+    std::optional<IpPrefix> const mapped = parse_ip_prefix("::ffff:0:0/96");
+    REQUIRE(mapped);
+    REQUIRE(*mapped == *parse_ip_prefix("0.0.0.0/0"));
+    REQUIRE(mapped->contains(*parse_ip_addr("8.8.8.8")));
+    REQUIRE_FALSE(mapped->contains(*parse_ip_addr("2001:db8::1")));
+
+    REQUIRE(*parse_ip_prefix("::ffff:10.1.2.3/104") == *parse_ip_prefix("10.0.0.0/8"));
+    REQUIRE(*parse_ip_prefix("::ffff:10.1.2.3/128") == *parse_ip_prefix("10.1.2.3"));
+    REQUIRE(IpPrefix::create(*parse_ip_addr("10.1.2.3"), 104) == parse_ip_prefix("10.0.0.0/8"));
+
+    // Shorter lengths reach into the mapping marker and cover IPv6 addresses too
+    std::optional<IpPrefix> const wider = parse_ip_prefix("::ffff:10.0.0.0/80");
+    REQUIRE(wider);
+    REQUIRE(wider->length == 80);
+    REQUIRE(wider->contains(*parse_ip_addr("10.0.0.1")));
+    REQUIRE(wider->contains(*parse_ip_addr("::1")));
+    REQUIRE(parse_ip_prefix("::ffff:10.0.0.0/8")->contains(*parse_ip_addr("::1")));
+
+    REQUIRE_FALSE(parse_ip_prefix("10.0.0.0/96"));
+    REQUIRE_FALSE(IpPrefix::create(*parse_ip_addr("10.0.0.0"), 64));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Prefix lists are parsed in order")
+{
+    std::vector<IpPrefix> const prefixes = common::utils::parse_ip_prefix_list("10.0.0.1, 192.168.0.0/24,2001:db8::/32");
+    REQUIRE(prefixes.size() == 3);
+    REQUIRE(prefixes[0] == IpPrefix::host(IpAddress::from_ipv4(0x0A000001)));
+    REQUIRE(common::utils::to_string(prefixes[1]) == "192.168.0.0/24");
+    REQUIRE(common::utils::to_string(prefixes[2]) == "2001:db8::/32");
+
+    REQUIRE_THROWS_AS(common::utils::parse_ip_prefix_list(""), std::invalid_argument);
+    REQUIRE_THROWS_AS(common::utils::parse_ip_prefix_list("10.0.0.1,"), std::invalid_argument);
+    REQUIRE_THROWS_AS(common::utils::parse_ip_prefix_list("10.0.0.1,bad"), std::invalid_argument);
+}
@@ -0,0 +1,71 @@
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "timer_wheel.hpp"
+
+#define TEST_NAME_PREFIX "TimerWheel::"
+#define TICK_NS 1000
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid wheels are rejected")
+{
+    REQUIRE_THROWS_AS(common::timing::TimerWheel<int>(0, TICK_NS, 0), std::invalid_argument);
+    REQUIRE_THROWS_AS(common::timing::TimerWheel<int>(8, 0, 0), std::invalid_argument);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Timers fire once their deadline passed")
+{
+    common::timing::TimerWheel<int> wheel{8, TICK_NS, 0};
+    wheel.schedule(3 * TICK_NS, 3);
+    wheel.schedule(1, 1);
+    wheel.schedule(0, 0);
+    REQUIRE(wheel.size() == 3);
+
+    std::vector<int> fired;
+    auto const collect = [&fired](int const value) { fired.push_back(value); };
+    REQUIRE(wheel.advance(TICK_NS / 2, collect) == 0);
+    REQUIRE(wheel.advance(TICK_NS, collect) == 2);
+    REQUIRE(fired == std::vector<int>{1, 0});
+    REQUIRE(wheel.advance(2 * TICK_NS, collect) == 0);
+    REQUIRE(wheel.advance(3 * TICK_NS, collect) == 1);
+    REQUIRE(fired.back() == 3);
+    REQUIRE(wheel.empty());
+    REQUIRE(wheel.next_tick_ns() == 4 * TICK_NS);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Timers further than a lap wait for their deadline")
+{
+    common::timing::TimerWheel<int> wheel{4, TICK_NS, 0};
+    wheel.schedule(10 * TICK_NS, 10);
+    wheel.schedule(2 * TICK_NS, 2);
+
+    std::vector<int> fired;
+    auto const collect = [&fired](int const value) { fired.push_back(value); };
+    REQUIRE(wheel.advance(9 * TICK_NS, collect) == 1);
+    REQUIRE(fired == std::vector<int>{2});
+    // A late advance fires everything that expired in between
+    REQUIRE(wheel.advance(100 * TICK_NS, collect) == 1);
+    REQUIRE(fired == std::vector<int>{2, 10});
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Callbacks can reschedule their timer")
+{
+    common::timing::TimerWheel<int> wheel{16, TICK_NS, 0};
+    for (int i = 0; i < 4; ++i)
+    {
+        wheel.schedule(static_cast<std::uint64_t>(i) * TICK_NS, i);
+    }
+
+    std::vector<int> counts(4, 0);
+    for (std::uint64_t now = 0; now <= 100 * TICK_NS; now += TICK_NS)
+    {
+        wheel.advance(now, [&](int const value) {
+            ++counts[static_cast<std::size_t>(value)];
+            wheel.schedule(10 * TICK_NS, value);
+        });
+    }
+    // Every timer fires every 10 ticks, staggered by its initial delay
+    REQUIRE(counts == std::vector<int>{10, 10, 10, 10});
+    REQUIRE(wheel.size() == 4);
+}
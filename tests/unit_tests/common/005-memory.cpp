@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "memory.hpp"
+
+#define TEST_NAME_PREFIX "Memory::"
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+using common::memory::Arena;
+using common::memory::ArenaAllocator;
+using common::memory::ObjectPool;
+using common::memory::Region;
+using common::memory::SlabPool;
+
+namespace
+{
+    bool aligned_(void const *const pointer, std::size_t const alignment)
+    {
+        return reinterpret_cast<std::uintptr_t>(pointer) % alignment == 0;
+    }
+
+    struct Tracked
+    {
+        explicit Tracked(int &alive, bool const fail = false) : alive_{alive}
+        {
+            if (fail)
+            {
+                throw std::runtime_error{"Construction failed"};
+            }
+            ++alive_;
+        }
+
+        ~Tracked()
+        {
+            --alive_;
+        }
+
+        int &alive_;
+    };
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Regions are mapped zeroed and whole pages")
+{
+    REQUIRE_THROWS_AS(Region(0), std::invalid_argument);
+
+    Region region{1000, false};
+    REQUIRE_FALSE(region.huge_pages());
+    REQUIRE(region.size() >= 4096);
+    REQUIRE(aligned_(region.data(), 4096));
+    REQUIRE(std::all_of(region.data(), region.data() + region.size(), [](std::uint8_t const byte) { return byte == 0; }));
+    std::memset(region.data(), 0xAB, region.size());
+
+    // Huge pages when the system reserved some, regular pages otherwise
+    Region huge{HUGE_PAGE_SIZE + 1};
+    REQUIRE(huge.size() >= HUGE_PAGE_SIZE + 1);
+    REQUIRE(huge.size() % (huge.huge_pages() ? HUGE_PAGE_SIZE : 4096) == 0);
+    huge.data()[huge.size() - 1] = 1;
+
+    std::uint8_t *const data = region.data();
+    Region moved{std::move(region)};
+    REQUIRE(moved.data() == data);
+    REQUIRE(region.data() == nullptr);
+    REQUIRE(region.size() == 0);
+    huge = std::move(moved);
+    REQUIRE(huge.data() == data);
+    REQUIRE(huge.data()[0] == 0xAB);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Arenas bump allocate from their blocks")
+{
+    REQUIRE_THROWS_AS(Arena(0), std::invalid_argument);
+
+    Arena arena{4096};
+    REQUIRE(arena.get_blocks() == 0);
+    REQUIRE_THROWS_AS(arena.allocate(8, 3), std::invalid_argument);
+    REQUIRE_THROWS_AS(arena.allocate(8, 8192), std::invalid_argument);
+
+    auto *const first = static_cast<std::uint8_t *>(arena.allocate(10, 1));
+    auto *const second = static_cast<std::uint8_t *>(arena.allocate(10, 1));
+    REQUIRE(second == first + 10);
+    void *const aligned = arena.allocate(1, 64);
+    REQUIRE(aligned_(aligned, 64));
+    REQUIRE(arena.get_usage().used == 65);
+    REQUIRE(arena.get_usage().reserved == 4096);
+
+    // Full block: the next block opens, larger allocations get one of their own
+    arena.allocate(4090);
+    REQUIRE(arena.get_blocks() == 2);
+    void *const large = arena.allocate(10000);
+    REQUIRE(arena.get_blocks() == 3);
+    std::memset(large, 1, 10000);
+    common::memory::Usage const usage = arena.get_usage();
+    REQUIRE(usage.used == 65 + 4090 + 10000);
+    REQUIRE(usage.high_water == usage.used);
+    REQUIRE(usage.reserved >= 2 * 4096 + 10000);
+
+    // Reset keeps the blocks and hands out the same memory again
+    arena.reset();
+    REQUIRE(arena.get_usage().used == 0);
+    REQUIRE(arena.get_usage().high_water == usage.high_water);
+    REQUIRE(arena.allocate(10, 1) == first);
+    arena.allocate(4090);
+    REQUIRE(arena.allocate(10000) == large);
+    REQUIRE(arena.get_blocks() == 3);
+
+    struct Point
+    {
+        int x;
+        int y;
+    };
+    Point *const point = arena.create<Point>(Point{1, 2});
+    REQUIRE(aligned_(point, alignof(Point)));
+    REQUIRE(point->y == 2);
+
+    arena.release();
+    REQUIRE(arena.get_blocks() == 0);
+    REQUIRE(arena.get_usage().reserved == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Containers can live in an arena")
+{
+    Arena arena{4096};
+    using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+    std::vector<ArenaString, ArenaAllocator<ArenaString>> strings{ArenaAllocator<ArenaString>{arena}};
+    for (int i = 0; i < 100; ++i)
+    {
+        strings.emplace_back("flow number " + std::to_string(i) + " of a rather long list", ArenaAllocator<char>{arena});
+    }
+    REQUIRE(strings[42] == ArenaString{"flow number 42 of a rather long list", ArenaAllocator<char>{arena}});
+    REQUIRE(arena.get_usage().used > 100 * 36);
+    REQUIRE(ArenaAllocator<int>{arena} == ArenaAllocator<char>{arena});
+    Arena other{4096};
+    REQUIRE(ArenaAllocator<int>{arena} != ArenaAllocator<int>{other});
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Every thread has its own arena")
+{
+    Arena *const main_arena = &common::memory::thread_arena();
+    REQUIRE(&common::memory::thread_arena() == main_arena);
+    Arena *thread_arena = nullptr;
+    std::thread thread{[&thread_arena]() {
+        thread_arena = &common::memory::thread_arena();
+        thread_arena->allocate(100);
+    }};
+    thread.join();
+    REQUIRE(thread_arena != main_arena);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Slab pools recycle their slots")
+{
+    REQUIRE_THROWS_AS(SlabPool(0, 16), std::invalid_argument);
+    REQUIRE_THROWS_AS(SlabPool(64, 0), std::invalid_argument);
+
+    SlabPool pool{24, 16};
+    REQUIRE(pool.get_slot_size() == 32);
+    std::vector<void *> slots;
+    // More than a slab of a page
+    for (int i = 0; i < 200; ++i)
+    {
+        void *const slot = pool.allocate();
+        REQUIRE(aligned_(slot, common::memory::DEFAULT_ALIGNMENT));
+        slots.push_back(slot);
+    }
+    REQUIRE(std::set<void *>(slots.begin(), slots.end()).size() == 200);
+    REQUIRE(pool.get_slots() == 200);
+    std::size_t const reserved = pool.get_usage().reserved;
+    REQUIRE(reserved >= 200 * 32);
+
+    pool.deallocate(slots[10]);
+    pool.deallocate(slots[20]);
+    pool.deallocate(nullptr);
+    REQUIRE(pool.allocate() == slots[20]);
+    REQUIRE(pool.allocate() == slots[10]);
+    for (void *const slot : slots)
+    {
+        pool.deallocate(slot);
+    }
+    common::memory::Usage const usage = pool.get_usage();
+    REQUIRE(usage.used == 0);
+    REQUIRE(usage.high_water == 200 * 32);
+    REQUIRE(usage.reserved == reserved);
+
+    // Capped pools refuse allocations instead of growing
+    SlabPool capped{64, 4, 6};
+    std::vector<void *> taken;
+    for (int i = 0; i < 6; ++i)
+    {
+        taken.push_back(capped.allocate());
+        REQUIRE(taken.back() != nullptr);
+    }
+    REQUIRE(capped.allocate() == nullptr);
+    REQUIRE(capped.get_exhausted() == 1);
+    capped.deallocate(taken.back());
+    REQUIRE(capped.allocate() == taken.back());
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Slab pools never hand out a slot twice")
+{
+    SlabPool pool{48, 64, 1000};
+    std::mt19937 random{3};
+    std::vector<std::pair<std::uint8_t *, std::uint8_t>> live;
+    for (int i = 0; i < 100000; ++i)
+    {
+        if (!live.empty() && (random() % 2 == 0 || live.size() == 1000))
+        {
+            std::size_t const index = random() % live.size();
+            auto const [slot, tag] = live[index];
+            // The slot still holds what was written when it was allocated
+            REQUIRE(std::all_of(slot, slot + 48, [tag = tag](std::uint8_t const byte) { return byte == tag; }));
+            pool.deallocate(slot);
+            live[index] = live.back();
+            live.pop_back();
+        }
+        else
+        {
+            auto *const slot = static_cast<std::uint8_t *>(pool.allocate());
+            REQUIRE(slot != nullptr);
+            std::uint8_t const tag = static_cast<std::uint8_t>(random());
+            std::memset(slot, tag, 48);
+            live.emplace_back(slot, tag);
+        }
+    }
+    REQUIRE(pool.get_slots() == live.size());
+    REQUIRE(pool.get_usage().high_water <= 1000 * pool.get_slot_size());
+    REQUIRE(pool.get_exhausted() == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Object pools construct and destroy their objects")
+{
+    int alive = 0;
+    ObjectPool<Tracked> pool{8, 2};
+    Tracked *const first = pool.create(alive);
+    Tracked *const second = pool.create(alive);
+    REQUIRE(alive == 2);
+    REQUIRE(pool.create(alive) == nullptr);
+    pool.destroy(first);
+    REQUIRE(alive == 1);
+
+    // A throwing constructor gives its slot back
+    REQUIRE_THROWS_AS(pool.create(alive, true), std::runtime_error);
+    REQUIRE(pool.get_pool().get_slots() == 1);
+    Tracked *const third = pool.create(alive);
+    REQUIRE(third == first);
+    pool.destroy(second);
+    pool.destroy(third);
+    pool.destroy(nullptr);
+    REQUIRE(alive == 0);
+    REQUIRE(pool.get_pool().get_usage().used == 0);
+}
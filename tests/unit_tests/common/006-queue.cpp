@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "queue.hpp"
+
+#define TEST_NAME_PREFIX "Queue::"
+#define STRESS_ITEMS 1000000
+#define STRESS_PRODUCERS 4
+
+using common::queue::MpscQueue;
+using common::queue::SpscQueue;
+
+namespace
+{
+    /**
+     * Checks the single threaded behavior shared by both queues
+     */
+    template <typename Queue>
+    void check_fifo_()
+    {
+        REQUIRE_THROWS_AS(Queue(0), std::invalid_argument);
+
+        Queue queue{6};
+        REQUIRE(queue.capacity() == 8);
+        REQUIRE(queue.empty());
+        int item = 0;
+        REQUIRE_FALSE(queue.try_pop(item));
+
+        for (int i = 0; i < 8; ++i)
+        {
+            REQUIRE(queue.try_push(i));
+        }
+        REQUIRE_FALSE(queue.try_push(8));
+        REQUIRE(queue.size() == 8);
+        REQUIRE(queue.try_pop(item));
+        REQUIRE(item == 0);
+        REQUIRE(queue.try_emplace(8));
+
+        // Batches stop at the end of the items or of the room
+        std::array<int, 16> out{};
+        REQUIRE(queue.pop_batch(out.begin(), 3) == 3);
+        REQUIRE(out[0] == 1);
+        REQUIRE(out[2] == 3);
+        std::array<int, 5> in{9, 10, 11, 12, 13};
+        REQUIRE(queue.push_batch(in.begin(), in.size()) == 3);
+        REQUIRE(queue.push_batch(in.begin() + 3, 2) == 0);
+        REQUIRE(queue.pop_batch(out.begin(), out.size()) == 8);
+        for (int i = 0; i < 8; ++i)
+        {
+            REQUIRE(out[i] == i + 4);
+        }
+        REQUIRE(queue.pop_batch(out.begin(), out.size()) == 0);
+        REQUIRE(queue.empty());
+    }
+
+    /**
+     * Checks that the queue destroys the items it still holds
+     */
+    template <typename Queue>
+    void check_ownership_()
+    {
+        auto const shared = std::make_shared<int>(1);
+        {
+            Queue queue{4};
+            REQUIRE(queue.try_push(shared));
+            REQUIRE(queue.try_emplace(shared));
+            std::vector<std::shared_ptr<int>> batch{shared, shared};
+            REQUIRE(queue.push_batch(batch.begin(), batch.size()) == 2);
+            // Moved from
+            REQUIRE(batch[0] == nullptr);
+            REQUIRE(shared.use_count() == 5);
+            std::shared_ptr<int> item;
+            REQUIRE(queue.try_pop(item));
+            item.reset();
+            REQUIRE(shared.use_count() == 4);
+        }
+        REQUIRE(shared.use_count() == 1);
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Items come out in the order they went in")
+{
+    check_fifo_<SpscQueue<int>>();
+    check_fifo_<MpscQueue<int>>();
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Queues own the items they hold")
+{
+    check_ownership_<SpscQueue<std::shared_ptr<int>>>();
+    check_ownership_<MpscQueue<std::shared_ptr<int>>>();
+}
+
+TEST_CASE(TEST_NAME_PREFIX "A producer and a consumer exchange items in order")
+{
+    SpscQueue<std::uint64_t> queue{1024};
+    std::thread producer{[&queue]() {
+        std::array<std::uint64_t, 37> batch{};
+        std::uint64_t next = 0;
+        while (next < STRESS_ITEMS)
+        {
+            // Alternate single items and batches of various sizes
+            if (next % 3 == 0)
+            {
+                next += queue.try_push(next) ? 1 : 0;
+                continue;
+            }
+            std::size_t const count = std::min<std::uint64_t>(1 + next % batch.size(), STRESS_ITEMS - next);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                batch[i] = next + i;
+            }
+            next += queue.push_batch(batch.begin(), count);
+        }
+    }};
+
+    std::vector<std::uint64_t> batch(64);
+    std::uint64_t expected = 0;
+    bool ordered = true;
+    while (expected < STRESS_ITEMS)
+    {
+        std::uint64_t item = 0;
+        if (expected % 2 == 0 && queue.try_pop(item))
+        {
+            ordered = ordered && item == expected;
+            ++expected;
+            continue;
+        }
+        std::size_t const popped = queue.pop_batch(batch.begin(), 1 + expected % batch.size());
+        for (std::size_t i = 0; i < popped; ++i)
+        {
+            ordered = ordered && batch[i] == expected;
+            ++expected;
+        }
+    }
+    producer.join();
+    REQUIRE(ordered);
+    REQUIRE(expected == STRESS_ITEMS);
+    REQUIRE(queue.empty());
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Producers share a queue without losing or reordering their items")
+{
+    struct Item
+    {
+        std::uint32_t producer;
+        std::uint32_t sequence;
+    };
+    std::uint32_t const per_producer = STRESS_ITEMS / STRESS_PRODUCERS;
+    MpscQueue<Item> queue{256};
+    std::vector<std::thread> producers;
+    for (std::uint32_t producer = 0; producer < STRESS_PRODUCERS; ++producer)
+    {
+        producers.emplace_back([&queue, producer, per_producer]() {
+            std::array<Item, 16> batch{};
+            std::uint32_t next = 0;
+            while (next < per_producer)
+            {
+                if (producer % 2 == 0)
+                {
+                    next += queue.try_push(Item{producer, next}) ? 1 : 0;
+                    continue;
+                }
+                std::size_t const count = std::min<std::uint32_t>(1 + next % batch.size(), per_producer - next);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    batch[i] = Item{producer, static_cast<std::uint32_t>(next + i)};
+                }
+                next += static_cast<std::uint32_t>(queue.push_batch(batch.begin(), count));
+            }
+        });
+    }
+
+    std::array<std::uint32_t, STRESS_PRODUCERS> expected{};
+    std::vector<Item> batch(32);
+    std::uint64_t received = 0;
+    bool ordered = true;
+    while (received < std::uint64_t{per_producer} * STRESS_PRODUCERS)
+    {
+        std::size_t const popped = queue.pop_batch(batch.begin(), batch.size());
+        for (std::size_t i = 0; i < popped; ++i)
+        {
+            // Every producer's items stay in its order
+            ordered = ordered && batch[i].producer < STRESS_PRODUCERS && batch[i].sequence == expected[batch[i].producer];
+            ++expected[batch[i].producer % STRESS_PRODUCERS];
+        }
+        received += popped;
+    }
+    for (std::thread &producer : producers)
+    {
+        producer.join();
+    }
+    REQUIRE(ordered);
+    for (std::uint32_t const count : expected)
+    {
+        REQUIRE(count == per_producer);
+    }
+    REQUIRE(queue.empty());
+}
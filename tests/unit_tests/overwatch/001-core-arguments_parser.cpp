@@ -58,8 +58,13 @@ TEST_CASE(TEST_NAME_PREFIX "Argument values are available after parsing")
         REQUIRE(parser.get<std::string>(ARG_LOGGING) == ":info");
         REQUIRE(parser.get<std::string>(ARG_INTERFACE) == "eth0");
 
+        REQUIRE(parser.get<std::string>(ARG_REPLAY) == "fast");
+        REQUIRE(parser.get<std::size_t>(ARG_WORKERS) == 1);
+        REQUIRE(parser.get<std::string>(ARG_FANOUT) == "hash");
+
         // Check optional isn't displayed
         REQUIRE(parser.present<std::string>(ARG_ARPSPOOF_HOST) == std::nullopt);
+        REQUIRE(parser.present<std::string>(ARG_READ) == std::nullopt);
     }
 
     SECTION("All arguments are retrievable")
@@ -107,3 +112,219 @@ TEST_CASE(TEST_NAME_PREFIX "Argument values are available after parsing")
         REQUIRE(parser.get<std::string>(ARG_LOGGING) == "/home/user/test.txt:debug");
     }
 }
+
+TEST_CASE(TEST_NAME_PREFIX "Capture files can be read instead of an interface")
+{
+    overwatch::core::ArgumentParser parser;
+    int const argc = 6;
+    char const *argv[argc] = {};
+    argv[0] = "overwatch";
+    argv[1] = "-r";
+    argv[2] = "/tmp/capture.pcapng";
+    argv[3] = "--replay";
+    argv[4] = "original";
+    argv[5] = "192.168.0.40";
+
+    parser.parse_args(argc, argv);
+    REQUIRE(parser.get<std::string>(ARG_TARGET) == "192.168.0.40");
+    REQUIRE(*parser.present<std::string>(ARG_READ) == "/tmp/capture.pcapng");
+    REQUIRE(parser.get<std::string>(ARG_REPLAY) == "original");
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Worker pool can be sized")
+{
+    overwatch::core::ArgumentParser parser;
+    int const argc = 6;
+    char const *argv[argc] = {};
+    argv[0] = "overwatch";
+    argv[1] = "-w";
+    argv[2] = "8";
+    argv[3] = "--fanout";
+    argv[4] = "cpu";
+    argv[5] = "192.168.0.40";
+
+    parser.parse_args(argc, argv);
+    REQUIRE(parser.get<std::size_t>(ARG_WORKERS) == 8);
+    REQUIRE(parser.get<std::string>(ARG_FANOUT) == "cpu");
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Stats can be reported")
+{
+    SECTION("Reports are disabled by default")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 2;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(parser.get<std::size_t>(ARG_STATS_INTERVAL) == 0);
+        REQUIRE_FALSE(parser.present<std::string>(ARG_STATS_OUTPUT));
+    }
+    SECTION("Reports can be published to a socket")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 6;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "--stats-interval";
+        argv[2] = "10";
+        argv[3] = "--stats-output";
+        argv[4] = "unix:/run/overwatch.sock";
+        argv[5] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(parser.get<std::size_t>(ARG_STATS_INTERVAL) == 10);
+        REQUIRE(*parser.present<std::string>(ARG_STATS_OUTPUT) == "unix:/run/overwatch.sock");
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Flow records can be exported")
+{
+    overwatch::core::ArgumentParser parser;
+    int const argc = 4;
+    char const *argv[argc] = {};
+    argv[0] = "overwatch";
+    argv[1] = "--export";
+    argv[2] = "udp:[::1]:4739";
+    argv[3] = "192.168.0.40";
+
+    parser.parse_args(argc, argv);
+    REQUIRE(*parser.present<std::string>(ARG_EXPORT) == "udp:[::1]:4739");
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Packets can be recorded")
+{
+    SECTION("Default rotation")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 4;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "--write";
+        argv[2] = "/var/lib/overwatch";
+        argv[3] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(*parser.present<std::string>(ARG_WRITE) == "/var/lib/overwatch");
+        REQUIRE(parser.get<std::size_t>(ARG_WRITE_SIZE) == 128);
+        REQUIRE(parser.get<std::size_t>(ARG_WRITE_INTERVAL) == 300);
+    }
+    SECTION("Custom rotation")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 8;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "--write";
+        argv[2] = "/var/lib/overwatch";
+        argv[3] = "--write-size";
+        argv[4] = "16";
+        argv[5] = "--write-interval";
+        argv[6] = "60";
+        argv[7] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(parser.get<std::size_t>(ARG_WRITE_SIZE) == 16);
+        REQUIRE(parser.get<std::size_t>(ARG_WRITE_INTERVAL) == 60);
+    }
+    SECTION("Nothing is recorded by default")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 2;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(!parser.present<std::string>(ARG_WRITE));
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Rules can be matched")
+{
+    SECTION("Rules file")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 4;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "--rules";
+        argv[2] = "/etc/overwatch/rules.txt";
+        argv[3] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(*parser.present<std::string>(ARG_RULES) == "/etc/overwatch/rules.txt");
+    }
+    SECTION("Nothing is matched by default")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 2;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(!parser.present<std::string>(ARG_RULES));
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Traffic can be summarized")
+{
+    SECTION("Summary interval")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 4;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "--summary-interval";
+        argv[2] = "10";
+        argv[3] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(parser.get<std::size_t>(ARG_SUMMARY_INTERVAL) == 10);
+    }
+    SECTION("Nothing is summarized by default")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 2;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(parser.get<std::size_t>(ARG_SUMMARY_INTERVAL) == 0);
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Targets can be listed in a file")
+{
+    SECTION("The file replaces the target")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 3;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "-t";
+        argv[2] = "/etc/overwatch/targets.txt";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(parser.get<std::string>(ARG_TARGET).empty());
+        REQUIRE(*parser.present<std::string>(ARG_TARGETS) == "/etc/overwatch/targets.txt");
+    }
+    SECTION("The file adds to the target")
+    {
+        overwatch::core::ArgumentParser parser;
+        int const argc = 4;
+        char const *argv[argc] = {};
+        argv[0] = "overwatch";
+        argv[1] = "--targets";
+        argv[2] = "/etc/overwatch/targets.txt";
+        argv[3] = "192.168.0.40";
+
+        parser.parse_args(argc, argv);
+        REQUIRE(parser.get<std::string>(ARG_TARGET) == "192.168.0.40");
+        REQUIRE(*parser.present<std::string>(ARG_TARGETS) == "/etc/overwatch/targets.txt");
+    }
+}
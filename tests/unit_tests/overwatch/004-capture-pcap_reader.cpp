@@ -0,0 +1,186 @@
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "pcap_fixture.hpp"
+#include "pcap_reader.hpp"
+
+#define TEST_NAME_PREFIX "PcapReader::"
+#define TEST_EPOCH_NS 1600000000123456000ULL
+
+namespace
+{
+    std::vector<fixtures::Frame> make_frames_(std::size_t const count, std::uint64_t const spacing_ns)
+    {
+        std::vector<fixtures::Frame> frames;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            // Odd sizes exercise the pcapng padding
+            std::vector<std::uint8_t> bytes(60 + i % 7, static_cast<std::uint8_t>(i));
+            frames.push_back(fixtures::Frame{bytes, TEST_EPOCH_NS + i * spacing_ns});
+        }
+        return frames;
+    }
+
+    /**
+     * Writes an enhanced packet block of a single byte
+     */
+    void write_pcapng_packet_(std::ofstream &out, std::uint32_t const interface_id, std::uint64_t const timestamp)
+    {
+        fixtures::write_raw<std::uint32_t>(out, 6);
+        fixtures::write_raw<std::uint32_t>(out, 36);
+        fixtures::write_raw<std::uint32_t>(out, interface_id);
+        fixtures::write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(timestamp >> 32));
+        fixtures::write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(timestamp));
+        fixtures::write_raw<std::uint32_t>(out, 1);
+        fixtures::write_raw<std::uint32_t>(out, 1);
+        fixtures::write_raw<std::uint32_t>(out, interface_id);
+        fixtures::write_raw<std::uint32_t>(out, 36);
+    }
+
+    /**
+     * Writes an Ethernet interface description block with an if_tsresol option
+     */
+    void write_pcapng_interface_(std::ofstream &out, std::uint8_t const resolution)
+    {
+        fixtures::write_raw<std::uint32_t>(out, 1);
+        fixtures::write_raw<std::uint32_t>(out, 32);
+        fixtures::write_raw<std::uint16_t>(out, 1);
+        fixtures::write_raw<std::uint16_t>(out, 0);
+        fixtures::write_raw<std::uint32_t>(out, 65535);
+        fixtures::write_raw<std::uint16_t>(out, 9);
+        fixtures::write_raw<std::uint16_t>(out, 1);
+        fixtures::write_raw<std::uint32_t>(out, resolution);
+        fixtures::write_raw<std::uint32_t>(out, 0);
+        fixtures::write_raw<std::uint32_t>(out, 32);
+    }
+
+    std::vector<overwatch::capture::PacketView> read_all_(overwatch::capture::PcapReader &reader)
+    {
+        std::vector<overwatch::capture::PacketView> packets;
+        overwatch::capture::PacketBatch batch;
+        while (!reader.exhausted())
+        {
+            if (reader.next_batch(batch, 1000))
+            {
+                packets.insert(packets.end(), batch.begin(), batch.end());
+            }
+        }
+        return packets;
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid files are rejected")
+{
+    SECTION("Missing files fail")
+    {
+        REQUIRE_THROWS_AS(overwatch::capture::PcapReader{fixtures::temp_path("missing.pcap")}, std::runtime_error);
+    }
+    SECTION("Files that are not captures fail")
+    {
+        std::filesystem::path const path = fixtures::temp_path("garbage.pcap");
+        std::ofstream{path} << "definitely not a capture file";
+        REQUIRE_THROWS_AS(overwatch::capture::PcapReader{path}, std::runtime_error);
+        std::filesystem::remove(path);
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Packets are replayed from pcap and pcapng files")
+{
+    std::size_t const num_frames = overwatch::capture::MAX_BATCH_SIZE + 17;
+    std::vector<fixtures::Frame> const frames = make_frames_(num_frames, 1000);
+    std::filesystem::path const path = fixtures::temp_path("replay");
+    bool const pcapng = GENERATE(false, true);
+    if (pcapng)
+    {
+        fixtures::write_pcapng(path, frames);
+    }
+    else
+    {
+        fixtures::write_pcap(path, frames);
+    }
+
+    {
+        overwatch::capture::PcapReader reader{path};
+        REQUIRE(reader.get_link_type() == 1);
+        std::vector<overwatch::capture::PacketView> const packets = read_all_(reader);
+        REQUIRE(packets.size() == num_frames);
+        for (std::size_t i = 0; i < num_frames; ++i)
+        {
+            REQUIRE(packets[i].caplen == frames[i].bytes.size());
+            REQUIRE(packets[i].wire_len == frames[i].bytes.size());
+            REQUIRE(packets[i].timestamp_ns == frames[i].timestamp_ns);
+            REQUIRE(std::vector<std::uint8_t>(packets[i].data, packets[i].data + packets[i].caplen) == frames[i].bytes);
+        }
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Malformed interfaces are skipped and sub-nanosecond resolutions converted")
+{
+    std::filesystem::path const path = fixtures::temp_path("interfaces.pcapng");
+    {
+        std::ofstream out{path, std::ios::binary};
+        fixtures::write_raw<std::uint32_t>(out, 0x0A0D0D0AU);
+        fixtures::write_raw<std::uint32_t>(out, 28);
+        fixtures::write_raw<std::uint32_t>(out, 0x1A2B3C4DU);
+        fixtures::write_raw<std::uint16_t>(out, 1);
+        fixtures::write_raw<std::uint16_t>(out, 0);
+        fixtures::write_raw<std::int64_t>(out, -1);
+        fixtures::write_raw<std::uint32_t>(out, 28);
+        // Interface 0: too short to hold a link type and a snap length
+        fixtures::write_raw<std::uint32_t>(out, 1);
+        fixtures::write_raw<std::uint32_t>(out, 16);
+        fixtures::write_raw<std::uint32_t>(out, 1);
+        fixtures::write_raw<std::uint32_t>(out, 16);
+        // Interfaces 1 and 2: 2^-32 and 2^-40 seconds
+        write_pcapng_interface_(out, 0x80 | 32);
+        write_pcapng_interface_(out, 0x80 | 40);
+        write_pcapng_packet_(out, 0, 1000);
+        write_pcapng_packet_(out, 1, (5ULL << 32) + (1ULL << 31));
+        write_pcapng_packet_(out, 2, (3ULL << 40) + (1ULL << 38));
+    }
+    {
+        overwatch::capture::PcapReader reader{path};
+        REQUIRE(reader.get_link_type() == 1);
+        std::vector<overwatch::capture::PacketView> const packets = read_all_(reader);
+        REQUIRE(packets.size() == 2);
+        REQUIRE(packets[0].data[0] == 1);
+        REQUIRE(packets[0].timestamp_ns == 5500000000ULL);
+        REQUIRE(packets[1].data[0] == 2);
+        REQUIRE(packets[1].timestamp_ns == 3250000000ULL);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Truncated files stop at the last complete record")
+{
+    std::vector<fixtures::Frame> const frames = make_frames_(3, 1000);
+    std::filesystem::path const path = fixtures::temp_path("truncated.pcap");
+    fixtures::write_pcap(path, frames);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 10);
+    {
+        overwatch::capture::PcapReader reader{path};
+        REQUIRE(read_all_(reader).size() == 2);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Original timestamps pace the replay")
+{
+    // 5 packets 50ms apart take at least 200ms to replay
+    std::vector<fixtures::Frame> const frames = make_frames_(5, 50000000);
+    std::filesystem::path const path = fixtures::temp_path("paced.pcap");
+    fixtures::write_pcap(path, frames, true);
+    {
+        overwatch::capture::PcapReader reader{path, overwatch::capture::ReplayMode::OriginalTimestamps};
+        auto const start = std::chrono::steady_clock::now();
+        REQUIRE(read_all_(reader).size() == frames.size());
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(200));
+    }
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,269 @@
+#ifdef __linux__
+#include <poll.h>
+#endif
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "config.hpp"
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+#include "pcap_fixture.hpp"
+#include "pcap_reader.hpp"
+#include "pipeline.hpp"
+#include "stats_registry.hpp"
+#include "worker.hpp"
+
+#define TEST_NAME_PREFIX "WorkerPool::"
+#define SECOND_NS 1000000000ULL
+
+#ifdef __linux__
+namespace
+{
+    /**
+     * Live-like source that never has packets until the shutdown, then hands out a last
+     * batch to the drain
+     */
+    class IdleSource : public overwatch::capture::PacketSource
+    {
+    public:
+        explicit IdleSource(std::size_t const tail) : frame_(100, 0), tail_{tail}, wakeup_fd_{-1}, woken_{false}
+        {
+        }
+
+        bool next_batch(overwatch::capture::PacketBatch &batch, int const timeout_ms) override
+        {
+            batch.clear();
+            if (woken_ && wakeup_fd_ < 0 && tail_ > 0)
+            {
+                for (; tail_ > 0 && !batch.full(); --tail_)
+                {
+                    batch.push_back(overwatch::capture::PacketView{frame_.data(), 100, 100, 1});
+                }
+                return true;
+            }
+            pollfd pfd{wakeup_fd_, POLLIN, 0};
+            poll(&pfd, wakeup_fd_ >= 0 ? 1 : 0, timeout_ms);
+            return false;
+        }
+
+        void set_wakeup_fd(int const fd) noexcept override
+        {
+            woken_ = woken_ || fd >= 0;
+            wakeup_fd_ = fd;
+        }
+
+    private:
+        std::vector<std::uint8_t> const frame_;
+        std::size_t tail_;
+        int wakeup_fd_;
+        bool woken_;
+    };
+
+    /**
+     * Live-like source handing out a single packet, after which its clock advances a second
+     * on every empty wait
+     */
+    class QuietSource : public overwatch::capture::PacketSource
+    {
+    public:
+        QuietSource() : frame_{fixtures::udp_frame("10.0.0.1", "10.0.0.2", 1000, 53)}, now_ns_{SECOND_NS}, sent_{false}
+        {
+        }
+
+        bool next_batch(overwatch::capture::PacketBatch &batch, int const) override
+        {
+            batch.clear();
+            if (!sent_)
+            {
+                sent_ = true;
+                batch.push_back(overwatch::capture::PacketView{frame_.data(), static_cast<std::uint32_t>(frame_.size()),
+                                                               static_cast<std::uint32_t>(frame_.size()), now_ns_});
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            now_ns_ += SECOND_NS;
+            return false;
+        }
+
+        std::optional<std::uint64_t> now_ns() const noexcept override
+        {
+            return now_ns_;
+        }
+
+    private:
+        std::vector<std::uint8_t> const frame_;
+        std::uint64_t now_ns_;
+        bool sent_;
+    };
+} // namespace
+#endif
+
+TEST_CASE(TEST_NAME_PREFIX "Every worker drains its own source")
+{
+    std::size_t const num_workers = 3;
+    std::size_t const frames_per_worker = 1000;
+    std::vector<std::filesystem::path> paths;
+    std::vector<std::unique_ptr<overwatch::capture::PacketSource>> sources;
+    for (std::size_t i = 0; i < num_workers; ++i)
+    {
+        std::vector<fixtures::Frame> frames(frames_per_worker, fixtures::Frame{std::vector<std::uint8_t>(100), 0});
+        paths.push_back(fixtures::temp_path("worker.pcap"));
+        fixtures::write_pcap(paths.back(), frames);
+        sources.push_back(std::make_unique<overwatch::capture::PcapReader>(paths.back()));
+    }
+
+    overwatch::core::WorkerPool pool{std::move(sources)};
+    REQUIRE(pool.size() == num_workers);
+    pool.start();
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!pool.finished() && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(pool.finished());
+    REQUIRE_NOTHROW(pool.join());
+
+    overwatch::core::WorkerCounters const counters = pool.get_counters();
+    REQUIRE(counters.packets == num_workers * frames_per_worker);
+    REQUIRE(counters.bytes == num_workers * frames_per_worker * 100);
+    REQUIRE(counters.drops == 0);
+
+    // Every worker publishes its counters
+    std::uint64_t published = 0;
+    std::size_t published_workers = 0;
+    for (overwatch::stats::Sample const &sample : overwatch::stats::default_registry().collect())
+    {
+        if (sample.name == "overwatch_rx_packets_total")
+        {
+            published += sample.value;
+            ++published_workers;
+        }
+    }
+    REQUIRE(published_workers == num_workers);
+    REQUIRE(published == num_workers * frames_per_worker);
+    for (std::filesystem::path const &path : paths)
+    {
+        std::filesystem::remove(path);
+    }
+}
+
+#ifdef __linux__
+TEST_CASE(TEST_NAME_PREFIX "Shutdown wakes idle workers and drains their sources")
+{
+    std::size_t const num_workers = 2;
+    std::size_t const tail = 10;
+    std::vector<std::unique_ptr<overwatch::capture::PacketSource>> sources;
+    for (std::size_t i = 0; i < num_workers; ++i)
+    {
+        sources.push_back(std::make_unique<IdleSource>(tail));
+    }
+
+    overwatch::core::WorkerPool pool{std::move(sources), false};
+    pool.start();
+    REQUIRE_FALSE(pool.get_finished_event().wait(50));
+
+    auto const start = std::chrono::steady_clock::now();
+    overwatch::core::g_config.signal_shutdown();
+    bool const finished = pool.get_finished_event().wait(5000);
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    overwatch::core::g_config.reset_shutdown();
+
+    REQUIRE(finished);
+    REQUIRE(pool.finished());
+    // Woken right away rather than after the idle timeout of the workers
+    REQUIRE(elapsed < std::chrono::milliseconds(500));
+    REQUIRE_NOTHROW(pool.join());
+    REQUIRE(pool.get_counters().packets == num_workers * tail);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Idle flows expire while no packet arrives")
+{
+    std::mutex mutex;
+    std::vector<overwatch::core::ExpiredFlow> exported;
+    std::vector<std::unique_ptr<overwatch::capture::PacketSource>> sources;
+    sources.push_back(std::make_unique<QuietSource>());
+    auto const table = std::make_shared<overwatch::core::LpmTable const>(common::utils::parse_ip_prefix_list("10.0.0.0/24"));
+    overwatch::core::WorkerPool pool{std::move(sources), false, [&](std::size_t const) {
+                                         auto pipeline = std::make_unique<overwatch::core::Pipeline>();
+                                         pipeline->add_stage(std::make_unique<overwatch::core::DecodeStage>());
+                                         pipeline->add_stage(std::make_unique<overwatch::core::ClassifyStage>(table));
+                                         pipeline->add_stage(std::make_unique<overwatch::core::FlowStage>(1024, 5 * SECOND_NS));
+                                         pipeline->add_stage(std::make_unique<overwatch::core::ExportStage>(
+                                             [&](overwatch::core::ExpiredFlow const &flow) {
+                                                 std::lock_guard<std::mutex> const lock{mutex};
+                                                 exported.push_back(flow);
+                                             }));
+                                         return pipeline;
+                                     }};
+    pool.start();
+    bool expired = false;
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!expired && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::lock_guard<std::mutex> const lock{mutex};
+        expired = !exported.empty();
+    }
+    overwatch::core::g_config.signal_shutdown();
+    REQUIRE(pool.get_finished_event().wait(5000));
+    overwatch::core::g_config.reset_shutdown();
+    REQUIRE_NOTHROW(pool.join());
+
+    // Expired by the clock of the source rather than flushed on shutdown
+    REQUIRE(exported.size() == 1);
+    REQUIRE(exported[0].reason == overwatch::core::FlowEndReason::IdleTimeout);
+    REQUIRE(exported[0].record.first_seen_ns == SECOND_NS);
+}
+#endif
+
+TEST_CASE(TEST_NAME_PREFIX "Traffic is attributed to the longest matching target")
+{
+    std::vector<fixtures::Frame> const frames{
+        fixtures::Frame{fixtures::udp_frame("10.0.0.42", "8.8.8.8", 1234, 53), 0},
+        fixtures::Frame{fixtures::udp_frame("8.8.8.8", "10.0.0.42", 53, 1234, "", {100}), 0},
+        fixtures::Frame{fixtures::udp_frame("10.0.0.7", "10.0.0.42", 1234, 80), 0},
+        fixtures::Frame{fixtures::udp6_frame("2001:db8::1", "2001:db8:1::1", 1234, 53), 0},
+        fixtures::Frame{fixtures::udp_frame("192.168.0.1", "192.168.0.2", 1234, 53), 0},
+        fixtures::Frame{fixtures::arp_frame("10.0.0.42", "10.0.0.1"), 0}};
+    std::filesystem::path const path = fixtures::temp_path("worker_targets.pcap");
+    fixtures::write_pcap(path, frames);
+
+    std::vector<common::utils::IpPrefix> const targets = common::utils::parse_ip_prefix_list("10.0.0.0/24, 10.0.0.42, 2001:db8::/32");
+    std::vector<std::unique_ptr<overwatch::capture::PacketSource>> sources;
+    sources.push_back(std::make_unique<overwatch::capture::PcapReader>(path));
+    auto const table = std::make_shared<overwatch::core::LpmTable const>(targets);
+    overwatch::core::WorkerPool pool{std::move(sources), false, [&table](std::size_t const) {
+                                         auto pipeline = std::make_unique<overwatch::core::Pipeline>();
+                                         pipeline->add_stage(std::make_unique<overwatch::core::DecodeStage>());
+                                         pipeline->add_stage(std::make_unique<overwatch::core::ClassifyStage>(table));
+                                         return pipeline;
+                                     }};
+    pool.start();
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!pool.finished() && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE_NOTHROW(pool.join());
+
+    std::vector<overwatch::core::TargetCounters> const counters = pool.get_target_counters();
+    REQUIRE(counters.size() == targets.size());
+    REQUIRE(counters[0].packets == 1);
+    REQUIRE(counters[0].bytes == frames[2].bytes.size());
+    REQUIRE(counters[1].packets == 3);
+    REQUIRE(counters[1].bytes == frames[0].bytes.size() + frames[1].bytes.size() + frames[2].bytes.size());
+    // Both addresses belong to the same target
+    REQUIRE(counters[2].packets == 1);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Available CPUs are listed")
+{
+    REQUIRE_FALSE(overwatch::core::available_cpus().empty());
+}
@@ -0,0 +1,199 @@
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "bpf_filter.hpp"
+#include "ip_address.hpp"
+#include "pcap_fixture.hpp"
+#include "pcap_reader.hpp"
+#include "ring_capture.hpp"
+
+#define TEST_NAME_PREFIX "BpfFilter::"
+#define TEST_TARGET "10.0.0.42"
+#define TEST_GATEWAY "10.0.0.1"
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid hosts are rejected")
+{
+    REQUIRE_THROWS_AS(overwatch::capture::BpfFilter{std::vector<std::string>{}}, std::invalid_argument);
+    REQUIRE_THROWS_AS(overwatch::capture::BpfFilter{std::vector<std::string>{"10.0.0.256"}}, std::invalid_argument);
+    REQUIRE_THROWS_AS(overwatch::capture::BpfFilter{std::vector<std::string>{"10.0.0"}}, std::invalid_argument);
+    REQUIRE_THROWS_AS(overwatch::capture::BpfFilter{std::vector<std::string>{"10.0.0.1."}}, std::invalid_argument);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid programs are rejected")
+{
+    using Program = std::vector<overwatch::capture::BpfInstruction>;
+    // Jump past the end of the program
+    Program const out_of_bounds{{0x15, 0, 5, 0}, {0x06, 0, 0, 0}};
+    REQUIRE_THROWS_AS(overwatch::capture::BpfFilter{out_of_bounds}, std::invalid_argument);
+    // No return at the end
+    Program const no_return{{0x20, 0, 0, 0}};
+    REQUIRE_THROWS_AS(overwatch::capture::BpfFilter{no_return}, std::invalid_argument);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Only frames of the watched hosts are kept from a capture file")
+{
+    struct Case
+    {
+        std::vector<std::uint8_t> frame;
+        bool keep;
+    };
+    std::vector<std::uint8_t> truncated = fixtures::udp_frame(TEST_TARGET, "8.8.8.8", 1, 2);
+    truncated.resize(20);
+    // Two 802.1Q tags, as stacked by older switches
+    std::vector<std::uint8_t> double_tagged = fixtures::udp_frame(TEST_TARGET, "8.8.8.8", 1, 2, "", {100, 200});
+    double_tagged[12] = 0x81;
+    double_tagged[13] = 0x00;
+    std::vector<Case> const cases{
+        {fixtures::udp_frame(TEST_TARGET, "8.8.8.8", 5353, 53), true},
+        {fixtures::udp_frame("8.8.8.8", TEST_TARGET, 53, 5353), true},
+        {fixtures::udp_frame(TEST_GATEWAY, "10.0.0.7", 67, 68), true},
+        {fixtures::udp_frame("10.0.0.7", "10.0.0.8", 1000, 2000), false},
+        {fixtures::udp_frame("10.0.0.43", "10.0.0.41", 1000, 2000), false},
+        {fixtures::tcp_frame("192.168.1.1", TEST_TARGET, 443, 50000, 1, 0x10), true},
+        {fixtures::udp_frame(TEST_TARGET, "8.8.8.8", 5353, 53, "", {100}), true},
+        {fixtures::udp_frame("10.0.0.7", "8.8.8.8", 5353, 53, "", {100}), false},
+        // Stacked 802.1ad and 802.1Q tags
+        {fixtures::udp_frame("8.8.8.8", TEST_TARGET, 53, 5353, "", {100, 200}), true},
+        {fixtures::udp_frame("10.0.0.7", "8.8.8.8", 5353, 53, "", {100, 200}), false},
+        {double_tagged, true},
+        // Deeper than the decoder goes
+        {fixtures::udp_frame(TEST_TARGET, "8.8.8.8", 5353, 53, "", {100, 200, 300}), false},
+        {fixtures::arp_frame(TEST_GATEWAY, TEST_TARGET), true},
+        {fixtures::arp_frame("10.0.0.7", "10.0.0.8"), false},
+        {fixtures::ethernet(0x86DD), false},
+        // Truncated before the addresses
+        {truncated, false},
+    };
+
+    overwatch::capture::BpfFilter const filter{std::vector<std::string>{TEST_TARGET, TEST_GATEWAY}};
+    std::vector<fixtures::Frame> frames;
+    std::size_t expected = 0;
+    for (std::size_t i = 0; i < cases.size(); ++i)
+    {
+        INFO("Frame " << i);
+        REQUIRE(filter.matches(cases[i].frame.data(), static_cast<std::uint32_t>(cases[i].frame.size())) == cases[i].keep);
+        // Tag the frames with their index to identify them after the replay
+        frames.push_back(fixtures::Frame{cases[i].frame, i * 1000});
+        expected += cases[i].keep ? 1 : 0;
+    }
+
+    std::filesystem::path const path = fixtures::temp_path("filter.pcap");
+    fixtures::write_pcap(path, frames);
+    {
+        overwatch::capture::PcapReader reader{path, overwatch::capture::ReplayMode::Fast, filter};
+        overwatch::capture::PacketBatch batch;
+        std::size_t kept = 0;
+        while (reader.next_batch(batch, 0))
+        {
+            for (overwatch::capture::PacketView const &packet : batch)
+            {
+                REQUIRE(cases[packet.timestamp_ns / 1000].keep);
+                ++kept;
+            }
+        }
+        REQUIRE(kept == expected);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "CIDR ranges and IPv6 hosts are matched")
+{
+    std::vector<common::utils::IpPrefix> const hosts =
+        common::utils::parse_ip_prefix_list("192.168.4.0/22, 10.1.2.3, 2001:db8:aa::/45, fe80::1, ::/0");
+    overwatch::capture::BpfFilter const filter{std::vector<common::utils::IpPrefix>{hosts.begin(), hosts.end() - 1}};
+    struct Case
+    {
+        std::vector<std::uint8_t> frame;
+        bool keep;
+    };
+    std::vector<Case> const cases{
+        {fixtures::udp_frame("192.168.4.1", "8.8.8.8", 1, 2), true},
+        {fixtures::udp_frame("8.8.8.8", "192.168.7.255", 1, 2), true},
+        {fixtures::udp_frame("192.168.8.0", "8.8.8.8", 1, 2), false},
+        {fixtures::udp_frame("192.168.3.255", "10.1.2.3", 1, 2, "", {7}), true},
+        {fixtures::arp_frame("192.168.5.5", "192.168.9.9"), true},
+        {fixtures::udp6_frame("2001:db8:aa::1", "2001:4860::8888", 1, 2), true},
+        {fixtures::udp6_frame("2001:4860::8888", "2001:db8:af:ffff::1", 1, 2), true},
+        {fixtures::udp6_frame("2001:db8:b0::1", "2001:4860::8888", 1, 2), false},
+        {fixtures::udp6_frame("2001:4860::8888", "fe80::1", 1, 2, "", {7}), true},
+        {fixtures::udp6_frame("fe80::2", "fe80::3", 1, 2), false},
+        {fixtures::udp6_frame("fe80::1", "fe80::3", 1, 2, "", {10, 20}), true},
+        {fixtures::udp6_frame("fe80::2", "fe80::3", 1, 2, "", {10, 20}), false},
+    };
+    for (std::size_t i = 0; i < cases.size(); ++i)
+    {
+        INFO("Frame " << i);
+        REQUIRE(filter.matches(cases[i].frame.data(), static_cast<std::uint32_t>(cases[i].frame.size())) == cases[i].keep);
+    }
+
+    // A zero length prefix keeps all traffic of its family
+    overwatch::capture::BpfFilter const any_ipv6{std::vector<common::utils::IpPrefix>{hosts.back()}};
+    std::vector<std::uint8_t> const ipv6 = fixtures::udp6_frame("fe80::2", "fe80::3", 1, 2);
+    std::vector<std::uint8_t> const ipv4 = fixtures::udp_frame("10.0.0.1", "10.0.0.2", 1, 2);
+    REQUIRE(any_ipv6.matches(ipv6.data(), static_cast<std::uint32_t>(ipv6.size())));
+    REQUIRE_FALSE(any_ipv6.matches(ipv4.data(), static_cast<std::uint32_t>(ipv4.size())));
+}
+
+#ifdef __linux__
+TEST_CASE(TEST_NAME_PREFIX "The kernel drops frames of other hosts before the ring")
+{
+    overwatch::capture::RingOptions options;
+    options.block_size = 1U << 16;
+    options.block_count = 4;
+    options.promiscuous = false;
+    options.filter = overwatch::capture::BpfFilter{std::vector<std::string>{"127.0.0.2"}};
+
+    std::unique_ptr<overwatch::capture::RingCapture> ring;
+    try
+    {
+        ring = std::make_unique<overwatch::capture::RingCapture>("lo", options);
+    }
+    catch (std::runtime_error const &e)
+    {
+        WARN("Skipping live capture test: " << e.what());
+        return;
+    }
+
+    int const sock = socket(AF_INET, SOCK_DGRAM, 0);
+    REQUIRE(sock >= 0);
+    for (char const *dst : {"127.0.0.3", "127.0.0.2"})
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(9);
+        inet_pton(AF_INET, dst, &addr.sin_addr);
+        REQUIRE(sendto(sock, dst, std::strlen(dst), 0, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) > 0);
+    }
+    close(sock);
+
+    std::size_t target_frames = 0;
+    overwatch::capture::PacketBatch batch;
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        if (!ring->next_batch(batch, 50))
+        {
+            continue;
+        }
+        for (overwatch::capture::PacketView const &packet : batch)
+        {
+            std::string const frame{reinterpret_cast<char const *>(packet.data), packet.caplen};
+            REQUIRE(frame.find("127.0.0.3") == std::string::npos);
+            target_frames += frame.find("127.0.0.2") != std::string::npos ? 1 : 0;
+        }
+    }
+    REQUIRE(target_frames > 0);
+}
+#endif
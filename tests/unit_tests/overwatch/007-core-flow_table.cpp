@@ -0,0 +1,160 @@
+#include <cstdint>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+#include <catch2/catch.hpp>
+
+#include "flow.hpp"
+#include "flow_table.hpp"
+
+#define TEST_NAME_PREFIX "FlowTable::"
+
+using overwatch::core::FlowKey;
+using overwatch::core::FlowRecord;
+using overwatch::core::FlowTable;
+using overwatch::core::make_ipv4_flow_key;
+
+namespace
+{
+    FlowKey key_for(std::uint32_t const i)
+    {
+        return make_ipv4_flow_key(0x0A000000 | i, 0xC0A80001, static_cast<std::uint16_t>(i), 443, 6);
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid capacity")
+{
+    REQUIRE_THROWS_AS(FlowTable<FlowRecord>{0}, std::invalid_argument);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Both directions share a canonical key")
+{
+    FlowKey forward = make_ipv4_flow_key(0x0A000001, 0x0A000002, 1234, 80, 6);
+    FlowKey reverse = make_ipv4_flow_key(0x0A000002, 0x0A000001, 80, 1234, 6);
+    REQUIRE(forward != reverse);
+    bool const forward_swapped = overwatch::core::canonicalize(forward);
+    bool const reverse_swapped = overwatch::core::canonicalize(reverse);
+    REQUIRE(forward == reverse);
+    REQUIRE(forward_swapped != reverse_swapped);
+    REQUIRE(overwatch::core::hash_flow_key(forward) == overwatch::core::hash_flow_key(reverse));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Insert, find and erase")
+{
+    FlowTable<FlowRecord> table{1000};
+    REQUIRE(table.max_size() >= 1000);
+    REQUIRE(table.find(key_for(1)) == nullptr);
+
+    bool inserted = false;
+    FlowRecord *record = table.insert(key_for(1), &inserted);
+    REQUIRE(record != nullptr);
+    REQUIRE(inserted);
+    REQUIRE(record->packets[0] == 0);
+    record->packets[0] = 42;
+
+    REQUIRE(table.insert(key_for(1), &inserted) == record);
+    REQUIRE_FALSE(inserted);
+    REQUIRE(table.find(key_for(1))->packets[0] == 42);
+    REQUIRE(table.size() == 1);
+
+    REQUIRE(table.erase(key_for(1)));
+    REQUIRE_FALSE(table.erase(key_for(1)));
+    REQUIRE(table.find(key_for(1)) == nullptr);
+    REQUIRE(table.size() == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Inserts fail once the table is full")
+{
+    FlowTable<FlowRecord> table{100};
+    std::uint32_t i = 0;
+    for (; i < table.max_size(); ++i)
+    {
+        REQUIRE(table.insert(key_for(i)) != nullptr);
+    }
+    REQUIRE(table.insert(key_for(i)) == nullptr);
+    // Existing flows can still be looked up through insert
+    REQUIRE(table.insert(key_for(0)) != nullptr);
+    REQUIRE(table.erase(key_for(0)));
+    REQUIRE(table.insert(key_for(i)) != nullptr);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Random operations match a reference map")
+{
+    FlowTable<FlowRecord> table{512};
+    std::map<std::uint32_t, std::uint64_t> reference;
+    std::mt19937 rng{1234};
+    // Few distinct keys and many erases so that deleted slots pile up and get reclaimed
+    std::uniform_int_distribution<std::uint32_t> key_dist{0, 700};
+    for (std::uint64_t op = 0; op < 200000; ++op)
+    {
+        std::uint32_t const i = key_dist(rng);
+        switch (rng() % 3)
+        {
+        case 0:
+        {
+            FlowRecord *record = table.insert(key_for(i));
+            if (reference.size() < table.max_size() || reference.count(i))
+            {
+                REQUIRE(record != nullptr);
+                record->bytes[0] = op;
+                reference[i] = op;
+            }
+            else
+            {
+                REQUIRE(record == nullptr);
+            }
+            break;
+        }
+        case 1:
+            REQUIRE(table.erase(key_for(i)) == (reference.erase(i) == 1));
+            break;
+        default:
+        {
+            FlowRecord const *record = table.find(key_for(i));
+            auto const it = reference.find(i);
+            REQUIRE((record != nullptr) == (it != reference.end()));
+            if (record)
+            {
+                REQUIRE(record->bytes[0] == it->second);
+            }
+        }
+        }
+        REQUIRE(table.size() == reference.size());
+    }
+
+    std::size_t visited = 0;
+    table.for_each([&](FlowKey const &, FlowRecord const &record) {
+        ++visited;
+        REQUIRE(record.bytes[0] <= 200000);
+    });
+    REQUIRE(visited == reference.size());
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Idle flows expire")
+{
+    std::uint64_t const timeout = 1000;
+    FlowTable<FlowRecord> table{1000};
+    for (std::uint32_t i = 0; i < 1000; ++i)
+    {
+        // Even flows are idle
+        table.insert(key_for(i))->last_seen_ns = i % 2 ? 5000 : 100;
+    }
+
+    std::size_t expired = 0;
+    auto const on_expire = [&](FlowKey const &, FlowRecord const &record) {
+        REQUIRE(record.last_seen_ns == 100);
+        ++expired;
+    };
+    // Bounded scans pick up where the previous one stopped
+    std::size_t const step = table.capacity() / 4;
+    for (int i = 0; i < 4; ++i)
+    {
+        REQUIRE(table.expire(2000, timeout, step, on_expire) > 0);
+    }
+    REQUIRE(expired == 500);
+    REQUIRE(table.size() == 500);
+    REQUIRE(table.expire(2000, timeout, table.capacity(), on_expire) == 0);
+    REQUIRE(table.find(key_for(0)) == nullptr);
+    REQUIRE(table.find(key_for(1)) != nullptr);
+}
@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+
+#define TEST_NAME_PREFIX "LpmTable::"
+
+using common::utils::IpAddress;
+using common::utils::IpPrefix;
+using overwatch::core::LpmTable;
+
+namespace
+{
+    IpPrefix prefix(std::string const &str)
+    {
+        return common::utils::parse_ip_prefix(str).value();
+    }
+
+    IpAddress address(std::string const &str)
+    {
+        return common::utils::parse_ip_addr(str).value();
+    }
+
+    // Reference lookup scanning every prefix
+    std::uint32_t linear_lookup(std::vector<IpPrefix> const &prefixes, IpAddress const &addr)
+    {
+        std::uint32_t best = LpmTable::NO_MATCH;
+        for (std::uint32_t i = 0; i < prefixes.size(); ++i)
+        {
+            if (prefixes[i].address.is_ipv4() == addr.is_ipv4() && prefixes[i].contains(addr) &&
+                (best == LpmTable::NO_MATCH || prefixes[i].length > prefixes[best].length))
+            {
+                best = i;
+            }
+        }
+        return best;
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Empty table matches nothing")
+{
+    LpmTable const table{{}};
+    REQUIRE(table.size() == 0);
+    REQUIRE(table.lookup(address("10.0.0.1")) == LpmTable::NO_MATCH);
+    REQUIRE(table.lookup(address("2001:db8::1")) == LpmTable::NO_MATCH);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Longest prefix wins")
+{
+    std::vector<IpPrefix> const prefixes{prefix("10.0.0.0/8"), prefix("10.1.0.0/16"), prefix("10.1.2.3"),
+                                         prefix("10.1.2.128/25"), prefix("2001:db8::/32"), prefix("2001:db8:1::/48"),
+                                         prefix("2001:db8:1::42")};
+    LpmTable const table{prefixes};
+    REQUIRE(table.size() == prefixes.size());
+
+    REQUIRE(table.lookup(address("10.200.0.1")) == 0);
+    REQUIRE(table.lookup(address("10.1.9.9")) == 1);
+    REQUIRE(table.lookup(address("10.1.2.3")) == 2);
+    REQUIRE(table.lookup(address("10.1.2.4")) == 1);
+    REQUIRE(table.lookup(address("10.1.2.200")) == 3);
+    REQUIRE(table.lookup(address("11.0.0.1")) == LpmTable::NO_MATCH);
+
+    REQUIRE(table.lookup(address("2001:db8:ffff::1")) == 4);
+    REQUIRE(table.lookup(address("2001:db8:1:2::1")) == 5);
+    REQUIRE(table.lookup(address("2001:db8:1::42")) == 6);
+    REQUIRE(table.lookup(address("2001:db8:1::43")) == 5);
+    REQUIRE(table.lookup(address("2001:db9::1")) == LpmTable::NO_MATCH);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Address families are kept apart")
+{
+    LpmTable const ipv4_table{{prefix("0.0.0.0/0")}};
+    REQUIRE(ipv4_table.lookup(address("192.168.1.1")) == 0);
+    REQUIRE(ipv4_table.lookup(address("::1")) == LpmTable::NO_MATCH);
+
+    LpmTable const ipv6_table{{prefix("::/0")}};
+    REQUIRE(ipv6_table.lookup(address("2001:db8::1")) == 0);
+    REQUIRE(ipv6_table.lookup(address("192.168.1.1")) == LpmTable::NO_MATCH);
+
+    // IPv4-mapped prefixes are IPv4 keys
+    LpmTable const mapped_table{{prefix("::ffff:0:0/96"), prefix("::ffff:10.0.0.0/104")}};
+    REQUIRE(mapped_table.lookup(address("192.168.1.1")) == 0);
+    REQUIRE(mapped_table.lookup(address("10.1.2.3")) == 1);
+    REQUIRE(mapped_table.lookup(address("::ffff:10.1.2.3")) == 1);
+    REQUIRE(mapped_table.lookup(address("2001:db8::1")) == LpmTable::NO_MATCH);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Duplicate prefixes keep the first index")
+{
+    LpmTable const table{{prefix("10.0.0.0/24"), prefix("10.0.0.5"), prefix("10.0.0.0/24"), prefix("10.0.0.5")}};
+    REQUIRE(table.lookup(address("10.0.0.1")) == 0);
+    REQUIRE(table.lookup(address("10.0.0.5")) == 1);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Random prefixes match a linear scan")
+{
+    std::mt19937_64 random{42};
+    std::vector<IpPrefix> prefixes;
+    // Prefixes are drawn from a few networks so that they nest and overlap
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::uint32_t const ipv4 = 0x0A000000 | static_cast<std::uint32_t>(random() & 0x0003FFFF);
+        prefixes.push_back(IpPrefix::create(IpAddress::from_ipv4(ipv4), 8 + random() % 25).value());
+        IpAddress const ipv6{0x20010DB800000000ULL | (random() & 0x3FFFF), random() & 0xFFFF};
+        prefixes.push_back(IpPrefix::create(ipv6, 16 + random() % 113).value());
+    }
+    LpmTable const table{prefixes};
+    for (int i = 0; i < 20000; ++i)
+    {
+        IpAddress const ipv4 = IpAddress::from_ipv4(0x0A000000 | static_cast<std::uint32_t>(random() & 0x0003FFFF));
+        REQUIRE(table.lookup(ipv4) == linear_lookup(prefixes, ipv4));
+        IpAddress const ipv6{0x20010DB800000000ULL | (random() & 0x3FFFF), random() & 0xFFFF};
+        REQUIRE(table.lookup(ipv6) == linear_lookup(prefixes, ipv6));
+    }
+}
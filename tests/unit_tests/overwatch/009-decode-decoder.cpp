@@ -0,0 +1,220 @@
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "decoder.hpp"
+#include "ip_address.hpp"
+#include "pcap_fixture.hpp"
+
+#define TEST_NAME_PREFIX "Decoder::"
+
+using overwatch::decode::DecodedPacket;
+
+namespace
+{
+    overwatch::capture::PacketView view(std::vector<std::uint8_t> const &frame)
+    {
+        return overwatch::capture::PacketView{frame.data(), static_cast<std::uint32_t>(frame.size()),
+                                              static_cast<std::uint32_t>(frame.size()), 0};
+    }
+
+    // UDP header followed by a payload
+    std::vector<std::uint8_t> udp(std::uint16_t const src_port, std::uint16_t const dst_port, std::string const &payload)
+    {
+        std::vector<std::uint8_t> bytes;
+        fixtures::put16(bytes, src_port);
+        fixtures::put16(bytes, dst_port);
+        fixtures::put16(bytes, static_cast<std::uint16_t>(8 + payload.size()));
+        fixtures::put16(bytes, 0);
+        bytes.insert(bytes.end(), payload.begin(), payload.end());
+        return bytes;
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "TCP over IPv4")
+{
+    std::vector<std::uint8_t> const frame = fixtures::tcp_frame("10.0.0.1", "10.0.0.2", 40000, 443, 1, 0x18, "hello");
+    DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+    REQUIRE(decoded.layers == (overwatch::decode::LAYER_ETHERNET | overwatch::decode::LAYER_IPV4 | overwatch::decode::LAYER_TCP));
+    REQUIRE(decoded.flags == 0);
+    REQUIRE(decoded.ether_type == 0x0800);
+    REQUIRE(decoded.l3_offset == 14);
+    REQUIRE(decoded.l4_offset == 34);
+    REQUIRE(decoded.payload_offset == 54);
+    REQUIRE(decoded.payload_length == 5);
+    REQUIRE(decoded.protocol == overwatch::decode::PROTOCOL_TCP);
+    REQUIRE(decoded.src_port == 40000);
+    REQUIRE(decoded.dst_port == 443);
+    REQUIRE(decoded.tcp_flags == 0x18);
+    REQUIRE(overwatch::decode::src_address(view(frame), decoded) == common::utils::parse_ip_addr("10.0.0.1"));
+    REQUIRE(overwatch::decode::dst_address(view(frame), decoded) == common::utils::parse_ip_addr("10.0.0.2"));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "VLAN and QinQ tags are skipped")
+{
+    SECTION("802.1Q")
+    {
+        std::vector<std::uint8_t> const frame = fixtures::udp_frame("10.0.0.1", "10.0.0.2", 53, 5353, "abc", {42});
+        DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+        REQUIRE(decoded.has(overwatch::decode::LAYER_VLAN));
+        REQUIRE(decoded.has(overwatch::decode::LAYER_UDP));
+        REQUIRE(decoded.vlan_count == 1);
+        REQUIRE(decoded.vlan_ids[0] == 42);
+        REQUIRE(decoded.l3_offset == 18);
+        REQUIRE(decoded.payload_offset == 18 + 20 + 8);
+        REQUIRE(decoded.payload_length == 3);
+    }
+    SECTION("QinQ")
+    {
+        std::vector<std::uint8_t> const frame = fixtures::udp6_frame("2001:db8::1", "2001:db8::2", 53, 5353, "abc", {100, 200});
+        DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+        REQUIRE(decoded.has(overwatch::decode::LAYER_IPV6));
+        REQUIRE(decoded.has(overwatch::decode::LAYER_UDP));
+        REQUIRE(decoded.vlan_count == 2);
+        REQUIRE(decoded.vlan_ids[0] == 100);
+        REQUIRE(decoded.vlan_ids[1] == 200);
+        REQUIRE(decoded.l3_offset == 22);
+        REQUIRE(decoded.l4_offset == 22 + 40);
+        REQUIRE(overwatch::decode::src_address(view(frame), decoded) == common::utils::parse_ip_addr("2001:db8::1"));
+        REQUIRE(overwatch::decode::dst_address(view(frame), decoded) == common::utils::parse_ip_addr("2001:db8::2"));
+    }
+    SECTION("Too many tags")
+    {
+        std::vector<std::uint8_t> frame = fixtures::ethernet(0x8100, {1, 2});
+        fixtures::put16(frame, 3);
+        fixtures::put16(frame, 0x0800);
+        DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+        REQUIRE_FALSE(decoded.is_ip());
+        REQUIRE(decoded.flags == overwatch::decode::FLAG_UNSUPPORTED);
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "IPv6 extension headers are walked")
+{
+    // Hop-by-hop (8 bytes) -> destination options (16 bytes) -> first fragment -> UDP
+    std::vector<std::uint8_t> extensions{60, 0, 0, 0, 0, 0, 0, 0};
+    std::vector<std::uint8_t> const destination_options{44, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    extensions.insert(extensions.end(), destination_options.begin(), destination_options.end());
+    std::vector<std::uint8_t> const first_fragment{17, 0, 0x00, 0x01, 0, 0, 0, 1};
+    std::vector<std::uint8_t> payload = extensions;
+    payload.insert(payload.end(), first_fragment.begin(), first_fragment.end());
+    std::vector<std::uint8_t> const transport = udp(1000, 2000, "data");
+    payload.insert(payload.end(), transport.begin(), transport.end());
+
+    std::vector<std::uint8_t> const frame = fixtures::ipv6_frame("fe80::1", "fe80::2", 0, payload);
+    DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+    REQUIRE(decoded.has(overwatch::decode::LAYER_UDP));
+    REQUIRE(decoded.flags == overwatch::decode::FLAG_FRAGMENT);
+    REQUIRE(decoded.protocol == overwatch::decode::PROTOCOL_UDP);
+    REQUIRE(decoded.l4_offset == 14 + 40 + 8 + 16 + 8);
+    REQUIRE(decoded.src_port == 1000);
+    REQUIRE(decoded.dst_port == 2000);
+    REQUIRE(decoded.payload_length == 4);
+
+    SECTION("Later fragments have no transport header")
+    {
+        std::vector<std::uint8_t> later{17, 0, 0x05, 0xA8, 0, 0, 0, 1};
+        later.insert(later.end(), transport.begin(), transport.end());
+        DecodedPacket const fragment = overwatch::decode::decode(view(fixtures::ipv6_frame("fe80::1", "fe80::2", 44, later)));
+        REQUIRE(fragment.has(overwatch::decode::LAYER_IPV6));
+        REQUIRE_FALSE(fragment.has(overwatch::decode::LAYER_UDP));
+        REQUIRE(fragment.flags == overwatch::decode::FLAG_FRAGMENT);
+        REQUIRE(fragment.protocol == overwatch::decode::PROTOCOL_UDP);
+    }
+    SECTION("Encrypted payloads stop the walk")
+    {
+        DecodedPacket const esp = overwatch::decode::decode(view(fixtures::ipv6_frame("fe80::1", "fe80::2", 50, transport)));
+        REQUIRE(esp.has(overwatch::decode::LAYER_IPV6));
+        REQUIRE(esp.flags == overwatch::decode::FLAG_UNSUPPORTED);
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "IPv4 fragments and options")
+{
+    std::vector<std::uint8_t> frame = fixtures::udp_frame("10.0.0.1", "10.0.0.2", 53, 53, "payload");
+    SECTION("Later fragments have no transport header")
+    {
+        frame[14 + 6] = 0x00;
+        frame[14 + 7] = 0x10;
+        DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+        REQUIRE(decoded.has(overwatch::decode::LAYER_IPV4));
+        REQUIRE_FALSE(decoded.has(overwatch::decode::LAYER_UDP));
+        REQUIRE(decoded.flags == overwatch::decode::FLAG_FRAGMENT);
+    }
+    SECTION("Options move the transport header")
+    {
+        // Grow the header to 24 bytes with a NOP option
+        frame.insert(frame.begin() + 14 + 20, {1, 1, 1, 0});
+        frame[14] = 0x46;
+        frame[14 + 3] = static_cast<std::uint8_t>(frame[14 + 3] + 4);
+        DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+        REQUIRE(decoded.has(overwatch::decode::LAYER_UDP));
+        REQUIRE(decoded.l4_offset == 14 + 24);
+        REQUIRE(decoded.payload_length == 7);
+    }
+    SECTION("Ethernet padding is not payload")
+    {
+        frame.resize(frame.size() + 10, 0);
+        DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+        REQUIRE(decoded.payload_length == 7);
+    }
+    SECTION("Inconsistent lengths are malformed")
+    {
+        frame[14 + 2] = 0;
+        frame[14 + 3] = 24;
+        DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+        REQUIRE_FALSE(decoded.has(overwatch::decode::LAYER_UDP));
+        REQUIRE(decoded.flags == overwatch::decode::FLAG_MALFORMED);
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Non IP frames keep their link layer")
+{
+    std::vector<std::uint8_t> const frame = fixtures::arp_frame("10.0.0.1", "10.0.0.2");
+    DecodedPacket const decoded = overwatch::decode::decode(view(frame));
+    REQUIRE(decoded.layers == overwatch::decode::LAYER_ETHERNET);
+    REQUIRE(decoded.ether_type == 0x0806);
+    REQUIRE(decoded.flags == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Truncated frames never read past the capture")
+{
+    std::vector<std::vector<std::uint8_t>> const frames{
+        fixtures::tcp_frame("10.0.0.1", "10.0.0.2", 1, 2, 3, 0x02, "abc"),
+        fixtures::udp6_frame("2001:db8::1", "2001:db8::2", 53, 53, "abc", {7, 8}),
+        fixtures::udp_frame("10.0.0.1", "10.0.0.2", 53, 53, "abc", {7})};
+    for (std::vector<std::uint8_t> const &frame : frames)
+    {
+        DecodedPacket const full = overwatch::decode::decode(view(frame));
+        REQUIRE(full.flags == 0);
+        for (std::size_t caplen = 0; caplen < full.payload_offset; ++caplen)
+        {
+            // Copy the prefix so that sanitizers catch reads past the capture
+            std::vector<std::uint8_t> const truncated(frame.begin(), frame.begin() + static_cast<std::ptrdiff_t>(caplen));
+            overwatch::capture::PacketView const packet{truncated.data(), static_cast<std::uint32_t>(caplen),
+                                                         static_cast<std::uint32_t>(frame.size()), 0};
+            DecodedPacket const decoded = overwatch::decode::decode(packet);
+            REQUIRE((decoded.flags & overwatch::decode::FLAG_TRUNCATED) != 0);
+            REQUIRE((decoded.layers & ~full.layers) == 0);
+        }
+    }
+
+    // Random bytes must never crash the decoder
+    std::mt19937 random{1};
+    std::vector<std::uint8_t> noise(128);
+    for (int i = 0; i < 10000; ++i)
+    {
+        for (std::uint8_t &byte : noise)
+        {
+            byte = static_cast<std::uint8_t>(random());
+        }
+        // Bias towards IP ethertypes so that the deeper layers are exercised
+        noise[12] = i % 2 ? 0x08 : 0x86;
+        noise[13] = i % 2 ? 0x00 : 0xDD;
+        std::uint32_t const caplen = random() % noise.size();
+        DecodedPacket const decoded = overwatch::decode::decode(overwatch::capture::PacketView{noise.data(), caplen, caplen, 0});
+        REQUIRE(decoded.payload_offset <= caplen);
+    }
+}
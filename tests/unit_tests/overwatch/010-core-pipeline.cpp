@@ -0,0 +1,200 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+#include "pcap_fixture.hpp"
+#include "pipeline.hpp"
+
+#define TEST_NAME_PREFIX "Pipeline::"
+#define SECOND_NS 1000000000ULL
+
+using overwatch::core::ExpiredFlow;
+using overwatch::core::PacketBurst;
+
+namespace
+{
+    // Analyzer recording what the stages in front of it produced
+    class RecordingStage : public overwatch::core::Stage
+    {
+    public:
+        char const *name() const noexcept override { return "recording"; }
+        void process(PacketBurst &burst) override
+        {
+            bursts.push_back(burst.size);
+            for (std::size_t i = 0; i < burst.size; ++i)
+            {
+                ip_packets += burst.decoded[i].is_ip();
+                flow_packets += burst.has_flow[i];
+            }
+        }
+        void flush(PacketBurst &) override { ++flushes; }
+
+        std::vector<std::size_t> bursts;
+        std::size_t ip_packets = 0;
+        std::size_t flow_packets = 0;
+        std::size_t flushes = 0;
+    };
+
+    // Owns the frames of a batch so that the views stay valid
+    struct Batch
+    {
+        std::vector<std::vector<std::uint8_t>> frames;
+        overwatch::capture::PacketBatch batch;
+
+        void add(std::vector<std::uint8_t> frame, std::uint64_t const timestamp_ns)
+        {
+            frames.push_back(std::move(frame));
+            std::vector<std::uint8_t> const &bytes = frames.back();
+            batch.push_back(overwatch::capture::PacketView{bytes.data(), static_cast<std::uint32_t>(bytes.size()),
+                                                           static_cast<std::uint32_t>(bytes.size()), timestamp_ns});
+        }
+    };
+
+    struct TestPipeline
+    {
+        overwatch::core::Pipeline pipeline;
+        RecordingStage *recorder;
+        std::vector<ExpiredFlow> exported;
+
+        TestPipeline(std::string const &targets, std::uint64_t const idle_timeout_ns, std::uint64_t const active_timeout_ns = 0)
+        {
+            auto const table = std::make_shared<overwatch::core::LpmTable const>(common::utils::parse_ip_prefix_list(targets));
+            pipeline.add_stage(std::make_unique<overwatch::core::DecodeStage>());
+            pipeline.add_stage(std::make_unique<overwatch::core::ClassifyStage>(table));
+            pipeline.add_stage(std::make_unique<overwatch::core::FlowStage>(1024, idle_timeout_ns, active_timeout_ns));
+            auto recording = std::make_unique<RecordingStage>();
+            recorder = recording.get();
+            pipeline.add_stage(std::move(recording));
+            pipeline.add_stage(std::make_unique<overwatch::core::ExportStage>([this](ExpiredFlow const &flow) {
+                exported.push_back(flow);
+            }));
+        }
+    };
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Stages run over whole bursts")
+{
+    TestPipeline test{"10.0.0.0/24", 60 * SECOND_NS};
+    Batch batch;
+    // Vectors reallocating would invalidate the views
+    batch.frames.reserve(overwatch::capture::MAX_BATCH_SIZE);
+    for (std::uint16_t i = 0; i < 100; ++i)
+    {
+        batch.add(fixtures::udp_frame("10.0.0.1", "10.0.0.2", static_cast<std::uint16_t>(1000 + i % 10), 53), SECOND_NS);
+    }
+    batch.add(fixtures::arp_frame("10.0.0.1", "10.0.0.2"), SECOND_NS);
+    test.pipeline.process(batch.batch);
+
+    REQUIRE(test.recorder->bursts == std::vector<std::size_t>{101});
+    REQUIRE(test.recorder->ip_packets == 100);
+    REQUIRE(test.recorder->flow_packets == 100);
+    overwatch::core::FlowStage const *const flows = test.pipeline.find_stage<overwatch::core::FlowStage>();
+    REQUIRE(flows != nullptr);
+    REQUIRE(flows->get_flows().size() == 10);
+    overwatch::core::ClassifyStage const *const classify = test.pipeline.find_stage<overwatch::core::ClassifyStage>();
+    REQUIRE(classify->get_counters()[0].packets == 100);
+    REQUIRE(test.pipeline.find_stage<overwatch::core::DecodeStage>()->get_errors() == 0);
+    REQUIRE(test.exported.empty());
+
+    test.pipeline.flush();
+    REQUIRE(test.recorder->flushes == 1);
+    REQUIRE(test.exported.size() == 10);
+    for (ExpiredFlow const &flow : test.exported)
+    {
+        REQUIRE(flow.record.packets[0] + flow.record.packets[1] == 10);
+    }
+    REQUIRE(flows->get_flows().size() == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Both directions of a flow share a record")
+{
+    TestPipeline test{"10.0.0.0/24", 60 * SECOND_NS};
+    Batch batch;
+    batch.frames.reserve(3);
+    batch.add(fixtures::tcp_frame("10.0.0.1", "10.0.0.2", 40000, 80, 1, 0x02), 1 * SECOND_NS);
+    batch.add(fixtures::tcp_frame("10.0.0.2", "10.0.0.1", 80, 40000, 1, 0x12, "ok"), 2 * SECOND_NS);
+    batch.add(fixtures::tcp_frame("10.0.0.1", "10.0.0.2", 40000, 80, 2, 0x10), 3 * SECOND_NS);
+    test.pipeline.process(batch.batch);
+    test.pipeline.flush();
+
+    REQUIRE(test.exported.size() == 1);
+    overwatch::core::FlowRecord const &record = test.exported[0].record;
+    REQUIRE(record.first_seen_ns == 1 * SECOND_NS);
+    REQUIRE(record.last_seen_ns == 3 * SECOND_NS);
+    REQUIRE(record.packets[0] + record.packets[1] == 3);
+    REQUIRE(record.packets[0] != record.packets[1]);
+    REQUIRE(record.tcp_flags == (0x02 | 0x12 | 0x10));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Idle flows are exported while packets flow")
+{
+    TestPipeline test{"2001:db8::/32", 5 * SECOND_NS};
+    Batch first;
+    first.frames.reserve(1);
+    first.add(fixtures::udp6_frame("2001:db8::1", "2001:db8::2", 1000, 53), 1 * SECOND_NS);
+    test.pipeline.process(first.batch);
+
+    // The idle flow is found by the bounded scans of later bursts
+    Batch later;
+    later.frames.reserve(1);
+    later.add(fixtures::udp6_frame("2001:db8::1", "2001:db8::3", 1000, 53), 10 * SECOND_NS);
+    for (int i = 0; i < 64 && test.exported.empty(); ++i)
+    {
+        test.pipeline.process(later.batch);
+    }
+    REQUIRE(test.exported.size() == 1);
+    REQUIRE(common::utils::IpAddress::from_bytes(test.exported[0].key.dst_addr) == common::utils::parse_ip_addr("2001:db8::2"));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Idle flows are exported by clock ticks")
+{
+    TestPipeline test{"2001:db8::/32", 5 * SECOND_NS};
+    Batch batch;
+    batch.frames.reserve(1);
+    batch.add(fixtures::udp6_frame("2001:db8::1", "2001:db8::2", 1000, 53), 1 * SECOND_NS);
+    test.pipeline.process(batch.batch);
+
+    test.pipeline.tick(5 * SECOND_NS);
+    REQUIRE(test.exported.empty());
+    // A single tick finds the idle flow anywhere in the table
+    test.pipeline.tick(6 * SECOND_NS);
+    REQUIRE(test.exported.size() == 1);
+    REQUIRE(test.exported[0].reason == overwatch::core::FlowEndReason::IdleTimeout);
+    REQUIRE(test.pipeline.find_stage<overwatch::core::FlowStage>()->get_flows().size() == 0);
+    // Ticks run every stage over an empty burst
+    REQUIRE(test.recorder->bursts == std::vector<std::size_t>{1, 0, 0});
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Long lived flows are checkpointed")
+{
+    TestPipeline test{"10.0.0.0/24", 60 * SECOND_NS, 10 * SECOND_NS};
+    Batch batch;
+    batch.frames.reserve(30);
+    for (std::uint64_t second = 1; second <= 30; ++second)
+    {
+        batch.add(fixtures::udp_frame("10.0.0.1", "10.0.0.2", 1000, 53), second * SECOND_NS);
+    }
+    test.pipeline.process(batch.batch);
+    test.pipeline.flush();
+
+    // Checkpoints at 11s and 21s, the rest when the worker shuts down
+    REQUIRE(test.exported.size() == 3);
+    REQUIRE(test.exported[0].reason == overwatch::core::FlowEndReason::ActiveTimeout);
+    REQUIRE(test.exported[0].record.first_seen_ns == 1 * SECOND_NS);
+    REQUIRE(test.exported[0].record.last_seen_ns == 10 * SECOND_NS);
+    REQUIRE(test.exported[1].reason == overwatch::core::FlowEndReason::ActiveTimeout);
+    REQUIRE(test.exported[1].record.first_seen_ns == 11 * SECOND_NS);
+    REQUIRE(test.exported[2].reason == overwatch::core::FlowEndReason::ForcedEnd);
+    REQUIRE(test.exported[2].record.last_seen_ns == 30 * SECOND_NS);
+    std::uint64_t packets = 0;
+    for (ExpiredFlow const &flow : test.exported)
+    {
+        REQUIRE(flow.record.packets[0] + flow.record.packets[1] == 10);
+        packets += flow.record.packets[0] + flow.record.packets[1];
+    }
+    REQUIRE(packets == 30);
+}
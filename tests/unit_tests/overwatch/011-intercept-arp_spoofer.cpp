@@ -0,0 +1,365 @@
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "arp_frame.hpp"
+#include "arp_spoofer.hpp"
+#include "ip_address.hpp"
+#include "pcap_fixture.hpp"
+
+#define TEST_NAME_PREFIX "ArpSpoofer::"
+#define SPOOF_INTERFACE "ow-spoof0"
+#define PEER_INTERFACE "ow-spoof1"
+#define TARGET_IP "10.77.0.2"
+#define GATEWAY_IP "10.77.0.3"
+#define SILENT_IP "10.77.0.9"
+#define REMOTE_IP "192.0.2.10"
+
+namespace
+{
+    constexpr overwatch::intercept::MacAddress TARGET_MAC{0x02, 0, 0, 0, 0x77, 0x02};
+    constexpr overwatch::intercept::MacAddress GATEWAY_MAC{0x02, 0, 0, 0, 0x77, 0x03};
+
+    common::utils::IpAddress address_(std::string const &addr)
+    {
+        return *common::utils::parse_ip_addr(addr);
+    }
+
+#ifdef __linux__
+    /**
+     * Moves the calling thread to a fresh network namespace for its lifetime
+     */
+    class NetnsScope
+    {
+    public:
+        NetnsScope()
+            : saved_{open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC)},
+              entered_{saved_ >= 0 && unshare(CLONE_NEWNET) == 0}
+        {
+        }
+        ~NetnsScope()
+        {
+            if (entered_)
+            {
+                setns(saved_, CLONE_NEWNET);
+            }
+            if (saved_ >= 0)
+            {
+                close(saved_);
+            }
+        }
+
+        bool entered() const noexcept
+        {
+            return entered_;
+        }
+
+    private:
+        int const saved_;
+        bool const entered_;
+    };
+
+    /**
+     * The target and the gateway at the far end of a veth pair - answers ARP requests for
+     * them and records every frame received
+     */
+    class FakeHosts
+    {
+    public:
+        explicit FakeHosts(std::string const &iface) : fd_{socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))}, running_{true}
+        {
+            REQUIRE(fd_ >= 0);
+            sockaddr_ll addr{};
+            addr.sll_family = AF_PACKET;
+            addr.sll_protocol = htons(ETH_P_ALL);
+            addr.sll_ifindex = static_cast<int>(if_nametoindex(iface.c_str()));
+            REQUIRE(bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+            thread_ = std::thread{&FakeHosts::run_, this};
+        }
+        ~FakeHosts()
+        {
+            running_ = false;
+            thread_.join();
+            close(fd_);
+        }
+
+        void inject(std::vector<std::uint8_t> const &frame)
+        {
+            REQUIRE(send(fd_, frame.data(), frame.size(), 0) == static_cast<ssize_t>(frame.size()));
+        }
+
+        std::size_t count(std::function<bool(std::vector<std::uint8_t> const &)> const &match)
+        {
+            std::lock_guard<std::mutex> const lock{mutex_};
+            std::size_t matches = 0;
+            for (std::vector<std::uint8_t> const &frame : frames_)
+            {
+                matches += match(frame) ? 1 : 0;
+            }
+            return matches;
+        }
+
+        bool wait_for(std::size_t const expected, std::function<bool(std::vector<std::uint8_t> const &)> const &match)
+        {
+            auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while (count(match) < expected && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            return count(match) >= expected;
+        }
+
+    private:
+        void run_()
+        {
+            std::uint8_t buffer[ETH_FRAME_LEN];
+            while (running_)
+            {
+                pollfd pfd{fd_, POLLIN, 0};
+                if (poll(&pfd, 1, 10) <= 0)
+                {
+                    continue;
+                }
+                sockaddr_ll from{};
+                socklen_t from_length = sizeof(from);
+                ssize_t const length = recvfrom(fd_, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr *>(&from), &from_length);
+                if (length <= 0 || from.sll_pkttype == PACKET_OUTGOING)
+                {
+                    continue;
+                }
+                std::optional<overwatch::intercept::ArpMessage> const request =
+                    overwatch::intercept::parse_arp_frame(buffer, static_cast<std::size_t>(length));
+                if (request && request->operation == overwatch::intercept::ARP_REQUEST)
+                {
+                    answer_(*request);
+                }
+                std::lock_guard<std::mutex> const lock{mutex_};
+                frames_.emplace_back(buffer, buffer + length);
+            }
+        }
+
+        void answer_(overwatch::intercept::ArpMessage const &request)
+        {
+            overwatch::intercept::ArpMessage reply;
+            reply.operation = overwatch::intercept::ARP_REPLY;
+            reply.sender_ip = request.target_ip;
+            reply.target_mac = request.sender_mac;
+            reply.target_ip = request.sender_ip;
+            if (request.target_ip == fixtures::ipv4(TARGET_IP))
+            {
+                reply.sender_mac = TARGET_MAC;
+            }
+            else if (request.target_ip == fixtures::ipv4(GATEWAY_IP))
+            {
+                reply.sender_mac = GATEWAY_MAC;
+            }
+            else
+            {
+                return;
+            }
+            std::uint8_t frame[overwatch::intercept::ARP_FRAME_SIZE];
+            overwatch::intercept::build_arp_frame(reply, request.sender_mac, reply.sender_mac, frame);
+            send(fd_, frame, sizeof(frame), 0);
+        }
+
+        int const fd_;
+        std::atomic<bool> running_;
+        std::mutex mutex_;
+        std::vector<std::vector<std::uint8_t>> frames_;
+        std::thread thread_;
+    };
+
+    /**
+     * Matches the ARP replies sent to a host
+     */
+    std::function<bool(std::vector<std::uint8_t> const &)> arp_reply_(overwatch::intercept::MacAddress const &to,
+                                                                      std::string const &sender_ip,
+                                                                      overwatch::intercept::MacAddress const &sender_mac)
+    {
+        return [=](std::vector<std::uint8_t> const &frame) {
+            std::optional<overwatch::intercept::ArpMessage> const reply = overwatch::intercept::parse_arp_frame(frame.data(), frame.size());
+            return reply && reply->operation == overwatch::intercept::ARP_REPLY &&
+                   std::memcmp(frame.data(), to.data(), to.size()) == 0 && reply->sender_ip == fixtures::ipv4(sender_ip) &&
+                   reply->sender_mac == sender_mac;
+        };
+    }
+
+    /**
+     * Matches the frames carrying a payload sent from one hardware address to another
+     */
+    std::function<bool(std::vector<std::uint8_t> const &)> frame_(overwatch::intercept::MacAddress const &to,
+                                                                  overwatch::intercept::MacAddress const &from,
+                                                                  std::string const &payload)
+    {
+        return [=](std::vector<std::uint8_t> const &frame) {
+            std::string const bytes{frame.begin(), frame.end()};
+            return frame.size() > 12 && std::memcmp(frame.data(), to.data(), to.size()) == 0 &&
+                   std::memcmp(frame.data() + 6, from.data(), from.size()) == 0 && bytes.find(payload) != std::string::npos;
+        };
+    }
+
+    /**
+     * Builds a UDP frame between two hardware addresses
+     */
+    std::vector<std::uint8_t> udp_frame_(overwatch::intercept::MacAddress const &to, overwatch::intercept::MacAddress const &from,
+                                         std::string const &src, std::string const &dst, std::string const &payload)
+    {
+        std::vector<std::uint8_t> frame = fixtures::udp_frame(src, dst, 4000, 53, payload);
+        std::memcpy(frame.data(), to.data(), to.size());
+        std::memcpy(frame.data() + 6, from.data(), from.size());
+        return frame;
+    }
+#endif
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "ARP frames survive a round trip")
+{
+    overwatch::intercept::ArpMessage message;
+    message.operation = overwatch::intercept::ARP_REPLY;
+    message.sender_mac = GATEWAY_MAC;
+    message.sender_ip = fixtures::ipv4(GATEWAY_IP);
+    message.target_mac = TARGET_MAC;
+    message.target_ip = fixtures::ipv4(TARGET_IP);
+
+    std::uint8_t frame[overwatch::intercept::ARP_FRAME_SIZE];
+    REQUIRE(overwatch::intercept::build_arp_frame(message, TARGET_MAC, GATEWAY_MAC, frame) == overwatch::intercept::ARP_FRAME_SIZE);
+    REQUIRE(std::memcmp(frame, TARGET_MAC.data(), TARGET_MAC.size()) == 0);
+    REQUIRE(std::memcmp(frame + 6, GATEWAY_MAC.data(), GATEWAY_MAC.size()) == 0);
+
+    std::optional<overwatch::intercept::ArpMessage> const parsed = overwatch::intercept::parse_arp_frame(frame, sizeof(frame));
+    REQUIRE(parsed);
+    REQUIRE(parsed->operation == message.operation);
+    REQUIRE(parsed->sender_mac == message.sender_mac);
+    REQUIRE(parsed->sender_ip == message.sender_ip);
+    REQUIRE(parsed->target_mac == message.target_mac);
+    REQUIRE(parsed->target_ip == message.target_ip);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Only Ethernet/IPv4 ARP frames are parsed")
+{
+    std::vector<std::uint8_t> const request = fixtures::arp_frame("10.0.0.1", "10.0.0.2");
+    std::optional<overwatch::intercept::ArpMessage> const parsed = overwatch::intercept::parse_arp_frame(request.data(), request.size());
+    REQUIRE(parsed);
+    REQUIRE(parsed->operation == overwatch::intercept::ARP_REQUEST);
+    REQUIRE(overwatch::intercept::to_string(parsed->sender_mac) == "02:00:00:00:00:01");
+    REQUIRE(parsed->sender_ip == fixtures::ipv4("10.0.0.1"));
+    REQUIRE(parsed->target_ip == fixtures::ipv4("10.0.0.2"));
+
+    REQUIRE_FALSE(overwatch::intercept::parse_arp_frame(request.data(), request.size() - 1));
+    std::vector<std::uint8_t> const udp = fixtures::udp_frame("10.0.0.1", "10.0.0.2", 1, 2, "not an ARP frame, not an ARP frame");
+    REQUIRE_FALSE(overwatch::intercept::parse_arp_frame(udp.data(), udp.size()));
+    std::vector<std::uint8_t> ipv6_arp{request};
+    ipv6_arp[16] = 0x86;
+    ipv6_arp[17] = 0xDD;
+    REQUIRE_FALSE(overwatch::intercept::parse_arp_frame(ipv6_arp.data(), ipv6_arp.size()));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid hosts are rejected")
+{
+    REQUIRE_THROWS_AS(overwatch::intercept::ArpSpoofer("lo", {address_(TARGET_IP)}, address_("fe80::1")), std::invalid_argument);
+    REQUIRE_THROWS_AS(overwatch::intercept::ArpSpoofer("lo", {address_("fe80::1")}, address_(GATEWAY_IP)), std::invalid_argument);
+    REQUIRE_THROWS_AS(overwatch::intercept::ArpSpoofer("lo", {address_(GATEWAY_IP)}, address_(GATEWAY_IP)), std::invalid_argument);
+    REQUIRE_THROWS_AS(overwatch::intercept::ArpSpoofer("overwatch-does-not-exist", {address_(TARGET_IP)}, address_(GATEWAY_IP)),
+                      std::runtime_error);
+}
+
+#ifdef __linux__
+TEST_CASE(TEST_NAME_PREFIX "Targets are intercepted and restored over a veth pair")
+{
+    NetnsScope const netns;
+    if (!netns.entered())
+    {
+        WARN("Skipping ARP spoofing test: network namespaces require CAP_SYS_ADMIN");
+        return;
+    }
+    if (std::system("ip link add name " SPOOF_INTERFACE " type veth peer name " PEER_INTERFACE " >/dev/null 2>&1 && "
+                    "ip link set " SPOOF_INTERFACE " up && ip link set " PEER_INTERFACE " up && "
+                    "ip addr add 10.77.0.1/24 dev " SPOOF_INTERFACE) != 0)
+    {
+        WARN("Skipping ARP spoofing test: failed to set up the veth pair");
+        return;
+    }
+
+    FakeHosts hosts{PEER_INTERFACE};
+    overwatch::intercept::SpoofOptions options;
+    // Only the first round is scheduled within the test - later replies are reactions to requests
+    options.poison_interval_ms = 60000;
+    options.resolve_timeout_ms = 100;
+    options.resolve_attempts = 2;
+    options.restore_rounds = 2;
+    overwatch::intercept::ArpSpoofer spoofer{SPOOF_INTERFACE, {address_(TARGET_IP), address_(SILENT_IP)}, address_(GATEWAY_IP), options};
+
+    // Hosts that never answer are left alone
+    REQUIRE(spoofer.get_targets() == std::vector<common::utils::IpAddress>{address_(TARGET_IP)});
+    REQUIRE(spoofer.get_mac(address_(TARGET_IP)) == TARGET_MAC);
+    REQUIRE(spoofer.get_mac(address_(GATEWAY_IP)) == GATEWAY_MAC);
+    REQUIRE_FALSE(spoofer.get_mac(address_(SILENT_IP)));
+    overwatch::intercept::MacAddress const local = spoofer.get_local_mac();
+
+    SECTION("Both ends are poisoned")
+    {
+        spoofer.start();
+        REQUIRE(hosts.wait_for(1, arp_reply_(TARGET_MAC, GATEWAY_IP, local)));
+        REQUIRE(hosts.wait_for(1, arp_reply_(GATEWAY_MAC, TARGET_IP, local)));
+
+        // A request of the gateway for the target gets a poisoned answer right away
+        overwatch::intercept::ArpMessage request;
+        request.sender_mac = GATEWAY_MAC;
+        request.sender_ip = fixtures::ipv4(GATEWAY_IP);
+        request.target_ip = fixtures::ipv4(TARGET_IP);
+        std::vector<std::uint8_t> frame(overwatch::intercept::ARP_FRAME_SIZE);
+        overwatch::intercept::build_arp_frame(request, overwatch::intercept::BROADCAST_MAC, GATEWAY_MAC, frame.data());
+        hosts.inject(frame);
+        REQUIRE(hosts.wait_for(2, arp_reply_(GATEWAY_MAC, TARGET_IP, local)));
+    }
+
+    SECTION("Intercepted frames are forwarded to their real destination")
+    {
+        spoofer.start();
+        hosts.inject(udp_frame_(local, TARGET_MAC, TARGET_IP, REMOTE_IP, "overwatch-upstream"));
+        hosts.inject(udp_frame_(local, GATEWAY_MAC, REMOTE_IP, TARGET_IP, "overwatch-downstream"));
+        // Frames not intercepted from a host are not forwarded
+        hosts.inject(udp_frame_(local, GATEWAY_MAC, REMOTE_IP, "192.0.2.11", "overwatch-unrelated"));
+
+        REQUIRE(hosts.wait_for(1, frame_(GATEWAY_MAC, local, "overwatch-upstream")));
+        REQUIRE(hosts.wait_for(1, frame_(TARGET_MAC, local, "overwatch-downstream")));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        REQUIRE(hosts.count(frame_(GATEWAY_MAC, local, "overwatch-unrelated")) == 0);
+        REQUIRE(spoofer.get_counters().forwarded_frames == 2);
+        REQUIRE(spoofer.get_counters().forward_failures == 0);
+    }
+
+    SECTION("Stopping restores the real addresses")
+    {
+        spoofer.start();
+        REQUIRE(hosts.wait_for(1, arp_reply_(TARGET_MAC, GATEWAY_IP, local)));
+        spoofer.stop();
+        REQUIRE(hosts.wait_for(options.restore_rounds, arp_reply_(TARGET_MAC, GATEWAY_IP, GATEWAY_MAC)));
+        REQUIRE(hosts.wait_for(options.restore_rounds, arp_reply_(GATEWAY_MAC, TARGET_IP, TARGET_MAC)));
+        REQUIRE(spoofer.get_counters().poison_replies >= 2);
+        REQUIRE(spoofer.get_counters().send_failures == 0);
+    }
+}
+#endif
@@ -0,0 +1,65 @@
+#ifdef __linux__
+#include <poll.h>
+#endif
+#include <chrono>
+#include <thread>
+#include <catch2/catch.hpp>
+
+#include "event.hpp"
+
+#define TEST_NAME_PREFIX "Event::"
+
+TEST_CASE(TEST_NAME_PREFIX "Events can be triggered and re-armed")
+{
+    overwatch::core::Event event;
+    REQUIRE_FALSE(event.triggered());
+    REQUIRE_FALSE(event.wait(0));
+    REQUIRE_FALSE(event.wait(20));
+
+    event.trigger();
+    event.trigger();
+    REQUIRE(event.triggered());
+    REQUIRE(event.wait(0));
+    REQUIRE(event.wait(-1));
+
+    event.reset();
+    REQUIRE_FALSE(event.triggered());
+    REQUIRE_FALSE(event.wait(0));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Waiters are woken as soon as an event is triggered")
+{
+    overwatch::core::Event first;
+    overwatch::core::Event second;
+    std::thread trigger{[&second]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        second.trigger();
+    }};
+
+    auto const start = std::chrono::steady_clock::now();
+    bool const woken = overwatch::core::Event::wait_any({&first, &second}, 5000);
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    trigger.join();
+
+    REQUIRE(woken);
+    REQUIRE_FALSE(first.triggered());
+    REQUIRE(elapsed < std::chrono::seconds(1));
+}
+
+#ifdef __linux__
+TEST_CASE(TEST_NAME_PREFIX "The descriptor is readable while the event is triggered")
+{
+    overwatch::core::Event event;
+    REQUIRE(event.get_fd() >= 0);
+    pollfd pfd{event.get_fd(), POLLIN, 0};
+    REQUIRE(poll(&pfd, 1, 0) == 0);
+
+    event.trigger();
+    // Stays readable for every poller until reset
+    REQUIRE(poll(&pfd, 1, 0) == 1);
+    REQUIRE(poll(&pfd, 1, 0) == 1);
+
+    event.reset();
+    REQUIRE(poll(&pfd, 1, 0) == 0);
+}
+#endif
@@ -0,0 +1,161 @@
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <catch2/catch.hpp>
+
+#include "pcap_fixture.hpp"
+#include "stats_registry.hpp"
+#include "stats_reporter.hpp"
+
+#define TEST_NAME_PREFIX "Stats::"
+
+TEST_CASE(TEST_NAME_PREFIX "Metrics are published for as long as they are registered")
+{
+    overwatch::stats::Registry registry;
+    overwatch::stats::Counter packets;
+    packets.add(41);
+    packets.add();
+    {
+        overwatch::stats::Registration const registration =
+            registry.add_counter("test_packets_total", "Packets", {{"worker", "0"}}, packets);
+        REQUIRE(registry.size() == 1);
+        std::vector<overwatch::stats::Sample> const samples = registry.collect();
+        REQUIRE(samples.size() == 1);
+        REQUIRE(samples[0].name == "test_packets_total");
+        REQUIRE(samples[0].type == overwatch::stats::MetricType::Counter);
+        REQUIRE(samples[0].value == 42);
+    }
+    REQUIRE(registry.size() == 0);
+
+    overwatch::stats::Registration registration =
+        registry.add("test_flows", "Flows", overwatch::stats::MetricType::Gauge, {}, []() { return 7; });
+    overwatch::stats::Registration moved = std::move(registration);
+    REQUIRE(registry.size() == 1);
+    registration.reset();
+    REQUIRE(registry.size() == 1);
+    moved.reset();
+    REQUIRE(registry.size() == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid metrics are rejected")
+{
+    overwatch::stats::Registry registry;
+    overwatch::stats::Counter counter;
+    REQUIRE_THROWS_AS(registry.add_counter("", "Empty", {}, counter), std::invalid_argument);
+    REQUIRE_THROWS_AS(registry.add_counter("1st_total", "Leading digit", {}, counter), std::invalid_argument);
+    REQUIRE_THROWS_AS(registry.add_counter("bad-name", "Dash", {}, counter), std::invalid_argument);
+    REQUIRE_THROWS_AS(registry.add_counter("test_total", "Bad label", {{"bad label", "x"}}, counter), std::invalid_argument);
+
+    overwatch::stats::Registration const registration = registry.add_counter("test_total", "Counter", {}, counter);
+    REQUIRE_THROWS_AS(registry.add("test_total", "Gauge", overwatch::stats::MetricType::Gauge, {}, []() { return 0; }),
+                      std::invalid_argument);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Metrics are formatted in the Prometheus text format")
+{
+    overwatch::stats::Registry registry;
+    overwatch::stats::Counter first;
+    overwatch::stats::Counter second;
+    first.add(10);
+    second.add(20);
+    auto const a = registry.add_counter("test_rx_total", "Received packets", {{"worker", "1"}}, second);
+    auto const b = registry.add("test_active", "Active \"flows\"", overwatch::stats::MetricType::Gauge,
+                                {{"iface", "eth\"0\"\\"}}, []() { return 3; });
+    auto const c = registry.add_counter("test_rx_total", "Received packets", {{"worker", "0"}}, first);
+
+    REQUIRE(overwatch::stats::to_prometheus(registry.collect()) ==
+            "# HELP test_active Active \"flows\"\n"
+            "# TYPE test_active gauge\n"
+            "test_active{iface=\"eth\\\"0\\\"\\\\\"} 3\n"
+            "# HELP test_rx_total Received packets\n"
+            "# TYPE test_rx_total counter\n"
+            "test_rx_total{worker=\"1\"} 20\n"
+            "test_rx_total{worker=\"0\"} 10\n");
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Reports are written to a file")
+{
+    overwatch::stats::Registry registry;
+    overwatch::stats::Counter counter;
+    counter.add(5);
+    auto const registration = registry.add_counter("test_rx_total", "Received packets", {}, counter);
+    std::filesystem::path const path = fixtures::temp_path("stats.prom");
+
+    overwatch::stats::Reporter reporter{registry, 10, path.string()};
+    REQUIRE_THROWS_AS(overwatch::stats::Reporter(registry, 0), std::invalid_argument);
+    REQUIRE(reporter.report() == "# HELP test_rx_total Received packets\n# TYPE test_rx_total counter\ntest_rx_total 5\n");
+
+    counter.add(5);
+    reporter.start();
+    // The background thread rewrites the file on every interval
+    std::string contents;
+    for (int i = 0; i < 500 && contents.find("test_rx_total 10") == std::string::npos; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::ifstream file{path};
+        std::stringstream stream;
+        stream << file.rdbuf();
+        contents = stream.str();
+    }
+    reporter.stop();
+    REQUIRE(contents.find("test_rx_total 10\n") != std::string::npos);
+    REQUIRE_FALSE(std::filesystem::exists(path.string() + ".tmp"));
+    std::filesystem::remove(path);
+}
+
+#ifdef __linux__
+TEST_CASE(TEST_NAME_PREFIX "Reports are served on a UNIX socket")
+{
+    overwatch::stats::Registry registry;
+    overwatch::stats::Counter counter;
+    counter.add(3);
+    auto const registration = registry.add_counter("test_rx_total", "Received packets", {}, counter);
+    std::filesystem::path const path = fixtures::temp_path("stats.sock");
+
+    {
+        overwatch::stats::Reporter reporter{registry, 60000, STATS_SOCKET_PREFIX + path.string()};
+        reporter.start();
+        REQUIRE(std::filesystem::is_socket(path));
+
+        // Every connection gets a fresh snapshot, no matter the interval
+        for (std::uint64_t expected : {3, 7})
+        {
+            int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            REQUIRE(fd >= 0);
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            REQUIRE(connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+            std::string contents;
+            char buffer[256];
+            ssize_t received;
+            while ((received = read(fd, buffer, sizeof(buffer))) > 0)
+            {
+                contents.append(buffer, static_cast<std::size_t>(received));
+            }
+            close(fd);
+            REQUIRE(contents.find("test_rx_total " + std::to_string(expected) + "\n") != std::string::npos);
+            counter.add(4);
+        }
+    }
+    // The socket goes away with the reporter
+    REQUIRE_FALSE(std::filesystem::exists(path));
+    REQUIRE_THROWS_AS(overwatch::stats::Reporter(registry, 1000, STATS_SOCKET_PREFIX), std::invalid_argument);
+
+    // A mistyped path never deletes a regular file
+    std::ofstream{path} << "precious";
+    REQUIRE_THROWS_AS(overwatch::stats::Reporter(registry, 60000, STATS_SOCKET_PREFIX + path.string()), std::runtime_error);
+    REQUIRE(std::filesystem::is_regular_file(path));
+    std::filesystem::remove(path);
+}
+#endif
@@ -0,0 +1,184 @@
+#include <cstdint>
+#include <filesystem>
+#include <set>
+#include <stdexcept>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "decoder.hpp"
+#include "ip_address.hpp"
+#include "pcap_fixture.hpp"
+#include "pcap_reader.hpp"
+#include "pcap_writer.hpp"
+#include "traffic_generator.hpp"
+
+#define TEST_NAME_PREFIX "TrafficGenerator::"
+
+namespace
+{
+    std::vector<std::vector<std::uint8_t>> generate_(overwatch::trafgen::TrafficProfile const &profile)
+    {
+        overwatch::trafgen::TrafficGenerator generator{profile};
+        std::vector<std::uint8_t> buffer(overwatch::trafgen::MAX_FRAME_SIZE);
+        std::vector<std::vector<std::uint8_t>> frames;
+        overwatch::capture::PacketView packet;
+        while (generator.next(buffer.data(), packet))
+        {
+            frames.emplace_back(packet.data, packet.data + packet.caplen);
+        }
+        return frames;
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Profiles are parsed and validated")
+{
+    using overwatch::trafgen::SizeModel;
+    REQUIRE(overwatch::trafgen::parse_size_distribution("imix").model == SizeModel::Imix);
+    overwatch::trafgen::SizeDistribution const fixed = overwatch::trafgen::parse_size_distribution("fixed:128");
+    REQUIRE((fixed.model == SizeModel::Fixed && fixed.min == 128 && fixed.max == 128));
+    overwatch::trafgen::SizeDistribution const uniform = overwatch::trafgen::parse_size_distribution("uniform:64-1500");
+    REQUIRE((uniform.model == SizeModel::Uniform && uniform.min == 64 && uniform.max == 1500));
+    for (char const *const invalid : {"", "imix:1", "fixed:", "fixed:9000", "uniform:1500-64", "uniform:64", "gaussian:100"})
+    {
+        REQUIRE_THROWS_AS(overwatch::trafgen::parse_size_distribution(invalid), std::invalid_argument);
+    }
+
+    overwatch::trafgen::ProtocolMix const mix = overwatch::trafgen::parse_protocol_mix("udp=3,tcp=1");
+    REQUIRE((mix.tcp == 1 && mix.udp == 3 && mix.icmp == 0));
+    for (char const *const invalid : {"", "tcp", "tcp=", "tcp=0", "sctp=1", "tcp=1,"})
+    {
+        REQUIRE_THROWS_AS(overwatch::trafgen::parse_protocol_mix(invalid), std::invalid_argument);
+    }
+
+    overwatch::trafgen::TrafficProfile profile;
+    profile.flows = 0;
+    REQUIRE_THROWS_AS(overwatch::trafgen::TrafficGenerator{profile}, std::invalid_argument);
+    profile.flows = 1;
+    profile.target_ratio = 1.5;
+    REQUIRE_THROWS_AS(overwatch::trafgen::TrafficGenerator{profile}, std::invalid_argument);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "The same seed generates the same traffic")
+{
+    overwatch::trafgen::TrafficProfile profile;
+    profile.flows = 100;
+    profile.packets = 2000;
+    profile.ipv6_ratio = 0.5;
+    REQUIRE(generate_(profile) == generate_(profile));
+    std::vector<std::vector<std::uint8_t>> const first = generate_(profile);
+    profile.seed = 2;
+    REQUIRE(generate_(profile) != first);
+    REQUIRE(first.size() == 2000);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Frames follow the profile and decode cleanly")
+{
+    overwatch::trafgen::TrafficProfile profile;
+    profile.flows = 500;
+    profile.packets = 20000;
+    profile.sizes = overwatch::trafgen::parse_size_distribution("uniform:60-1514");
+    profile.mix = overwatch::trafgen::parse_protocol_mix("tcp=2,udp=1,icmp=1");
+    profile.ipv6_ratio = 0.5;
+    profile.targets = common::utils::parse_ip_prefix_list("10.7.0.0/16, 2001:db8:1::/48");
+    profile.target_ratio = 0.25;
+    profile.skew = 2.0;
+
+    overwatch::trafgen::TrafficGenerator generator{profile};
+    REQUIRE(generator.get_target_flows() > 60);
+    REQUIRE(generator.get_target_flows() < 190);
+
+    std::vector<std::uint8_t> buffer(overwatch::trafgen::MAX_FRAME_SIZE);
+    overwatch::capture::PacketView packet;
+    std::uint64_t previous_ns = 0;
+    std::size_t counts[4] = {};
+    std::size_t ipv6 = 0;
+    std::size_t syns = 0;
+    std::size_t target_packets = 0;
+    std::set<std::uint16_t> sizes;
+    while (generator.next(buffer.data(), packet))
+    {
+        REQUIRE(packet.caplen == packet.wire_len);
+        REQUIRE(packet.wire_len >= overwatch::trafgen::MIN_FRAME_SIZE);
+        REQUIRE(packet.wire_len <= overwatch::trafgen::MAX_FRAME_SIZE);
+        REQUIRE(packet.timestamp_ns > previous_ns);
+        previous_ns = packet.timestamp_ns;
+
+        overwatch::decode::DecodedPacket const decoded = overwatch::decode::decode(packet);
+        REQUIRE(decoded.flags == 0);
+        REQUIRE(decoded.is_ip());
+        counts[decoded.has(overwatch::decode::LAYER_TCP) ? 0 : decoded.has(overwatch::decode::LAYER_UDP) ? 1 : decoded.has(overwatch::decode::LAYER_ICMP) ? 2 : 3]++;
+        ipv6 += decoded.has(overwatch::decode::LAYER_IPV6);
+        syns += decoded.tcp_flags == 0x02;
+        sizes.insert(static_cast<std::uint16_t>(packet.wire_len));
+        for (common::utils::IpPrefix const &target : profile.targets)
+        {
+            if (target.contains(overwatch::decode::src_address(packet, decoded)) || target.contains(overwatch::decode::dst_address(packet, decoded)))
+            {
+                ++target_packets;
+                break;
+            }
+        }
+    }
+    REQUIRE(generator.get_generated() == profile.packets);
+    // Every packet is IP with a decoded transport
+    REQUIRE(counts[3] == 0);
+    REQUIRE(counts[0] > counts[1]);
+    REQUIRE(counts[1] > 0);
+    REQUIRE(counts[2] > 0);
+    REQUIRE(ipv6 > 0);
+    REQUIRE(target_packets > 0);
+    REQUIRE(target_packets < profile.packets);
+    REQUIRE(sizes.size() > 100);
+    // Every TCP flow that carried traffic opened with exactly one SYN
+    REQUIRE(syns > 0);
+    REQUIRE(syns <= profile.flows);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Generated traffic is written to pcap files and fed to the pipeline")
+{
+    overwatch::trafgen::TrafficProfile profile;
+    profile.flows = 50;
+    profile.packets = 1000;
+    std::vector<std::vector<std::uint8_t>> const frames = generate_(profile);
+
+    std::filesystem::path const path = fixtures::temp_path("trafgen.pcap");
+    {
+        overwatch::trafgen::TrafficGenerator generator{profile};
+        overwatch::capture::PcapWriter writer{path};
+        std::vector<std::uint8_t> buffer(overwatch::trafgen::MAX_FRAME_SIZE);
+        overwatch::capture::PacketView packet;
+        while (generator.next(buffer.data(), packet))
+        {
+            writer.write(packet);
+        }
+        REQUIRE(writer.get_packets() == profile.packets);
+    }
+
+    overwatch::capture::PcapReader reader{path};
+    overwatch::trafgen::GeneratorSource source{profile};
+    overwatch::capture::PacketBatch read_batch;
+    overwatch::capture::PacketBatch generated_batch;
+    std::size_t index = 0;
+    std::uint64_t timestamp_ns = profile.start_ns;
+    while (!source.exhausted())
+    {
+        REQUIRE(source.next_batch(generated_batch, 0));
+        for (overwatch::capture::PacketView const &packet : generated_batch)
+        {
+            REQUIRE(std::vector<std::uint8_t>(packet.data, packet.data + packet.caplen) == frames[index++]);
+        }
+        for (std::size_t read = 0; read < generated_batch.size; read += read_batch.size)
+        {
+            REQUIRE(reader.next_batch(read_batch, 0));
+            for (overwatch::capture::PacketView const &packet : read_batch)
+            {
+                REQUIRE(packet.timestamp_ns == timestamp_ns);
+                timestamp_ns += 1000;
+            }
+        }
+    }
+    REQUIRE(index == profile.packets);
+    REQUIRE_FALSE(source.next_batch(generated_batch, 0));
+    REQUIRE(reader.exhausted());
+    std::filesystem::remove(path);
+}
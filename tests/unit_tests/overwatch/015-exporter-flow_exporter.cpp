@@ -0,0 +1,315 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "collector.hpp"
+#include "flow_exporter.hpp"
+#include "ip_address.hpp"
+#include "ipfix.hpp"
+#include "lpm_table.hpp"
+#include "pcap_fixture.hpp"
+
+#define TEST_NAME_PREFIX "FlowExporter::"
+#define SECOND_NS 1000000000ULL
+
+using overwatch::core::ExpiredFlow;
+using overwatch::exporter::ExportedFlow;
+
+namespace
+{
+    // Flow i of a test, every fourth one IPv6
+    ExpiredFlow make_flow_(std::uint32_t const i)
+    {
+        ExpiredFlow flow;
+        if (i % 4 == 3)
+        {
+            flow.key.src_addr = common::utils::parse_ip_addr("2001:db8::" + std::to_string(i % 65536))->to_bytes();
+            flow.key.dst_addr = common::utils::parse_ip_addr("2001:db8:1::1")->to_bytes();
+            flow.key.protocol = 17;
+        }
+        else
+        {
+            flow.key = overwatch::core::make_ipv4_flow_key(0x0A000000 + i, 0xC0A80001, 40000, 443, 6);
+        }
+        flow.key.src_port = static_cast<std::uint16_t>(1024 + i);
+        flow.record.first_seen_ns = 1700000000 * SECOND_NS + i * 1234567ULL + 1;
+        flow.record.last_seen_ns = flow.record.first_seen_ns + i * 999ULL + 999999999ULL;
+        flow.record.packets[0] = i + 1;
+        flow.record.packets[1] = i * 2;
+        flow.record.bytes[0] = (i + 1) * 1500ULL;
+        flow.record.bytes[1] = i * 40ULL + (1ULL << 40);
+        flow.record.tcp_flags = static_cast<std::uint8_t>(i);
+        flow.reason = i % 2 ? overwatch::core::FlowEndReason::ActiveTimeout : overwatch::core::FlowEndReason::IdleTimeout;
+        return flow;
+    }
+
+    void require_flow_(ExportedFlow const &exported, ExpiredFlow const &flow)
+    {
+        REQUIRE(exported.key == flow.key);
+        REQUIRE(exported.record.first_seen_ns == flow.record.first_seen_ns);
+        REQUIRE(exported.record.last_seen_ns == flow.record.last_seen_ns);
+        REQUIRE(exported.record.packets[0] == flow.record.packets[0]);
+        REQUIRE(exported.record.packets[1] == flow.record.packets[1]);
+        REQUIRE(exported.record.bytes[0] == flow.record.bytes[0]);
+        REQUIRE(exported.record.bytes[1] == flow.record.bytes[1]);
+        REQUIRE(exported.record.tcp_flags == flow.record.tcp_flags);
+        REQUIRE(exported.reason == flow.reason);
+    }
+
+    std::vector<std::uint8_t> read_file_(std::filesystem::path const &path)
+    {
+        std::ifstream file{path, std::ios::binary};
+        return std::vector<std::uint8_t>{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Flow records survive the IPFIX encoding")
+{
+    overwatch::exporter::IpfixEncoder encoder{7, 1400};
+    std::vector<std::uint8_t> buffer;
+    std::vector<ExpiredFlow> flows;
+    for (std::uint32_t i = 0; i < 1000; ++i)
+    {
+        flows.push_back(make_flow_(i));
+        encoder.add(buffer, flows.back());
+    }
+    encoder.finish(buffer);
+    REQUIRE(encoder.get_records() == 1000);
+    // Far below a text line per flow
+    REQUIRE(buffer.size() < 1000 * 100);
+
+    // Messages respect the size limit
+    std::vector<std::size_t> message_sizes;
+    for (std::size_t offset = 0; offset < buffer.size(); offset += message_sizes.back())
+    {
+        message_sizes.push_back((static_cast<std::size_t>(buffer[offset + 2]) << 8) | buffer[offset + 3]);
+        REQUIRE(message_sizes.back() <= 1400);
+    }
+    REQUIRE(message_sizes.size() > 1);
+
+    overwatch::exporter::IpfixDecoder decoder;
+    std::vector<ExportedFlow> decoded;
+    REQUIRE(decoder.decode(buffer.data(), buffer.size(), decoded) == buffer.size());
+    REQUIRE(decoded.size() == flows.size());
+    for (std::size_t i = 0; i < flows.size(); ++i)
+    {
+        REQUIRE(decoded[i].observation_domain == 7);
+        require_flow_(decoded[i], flows[i]);
+    }
+    REQUIRE(decoder.get_lost_records() == 0);
+    REQUIRE(decoder.get_unknown_sets() == 0);
+
+    SECTION("Partial messages are left over")
+    {
+        overwatch::exporter::IpfixDecoder partial;
+        std::vector<ExportedFlow> first;
+        REQUIRE(partial.decode(buffer.data(), message_sizes[0] + 10, first) == message_sizes[0]);
+        REQUIRE(!first.empty());
+    }
+    SECTION("Lost messages are detected from the sequence numbers")
+    {
+        // The templates only travel in the first message
+        overwatch::exporter::IpfixDecoder lossy;
+        std::vector<ExportedFlow> received;
+        std::size_t const second = message_sizes[0];
+        std::size_t const third = second + message_sizes[1];
+        lossy.decode(buffer.data(), second, received);
+        std::size_t const first_records = received.size();
+        lossy.decode(buffer.data() + third, buffer.size() - third, received);
+        REQUIRE(lossy.get_lost_records() == flows.size() - received.size());
+        REQUIRE(received.size() > first_records);
+    }
+    SECTION("Malformed messages are rejected")
+    {
+        std::vector<std::uint8_t> malformed = buffer;
+        malformed[1] = 9;
+        REQUIRE_THROWS_AS(overwatch::exporter::IpfixDecoder{}.decode(malformed.data(), malformed.size(), decoded), std::invalid_argument);
+        malformed = buffer;
+        // Length of the template set beyond the message
+        malformed[18] = 0xFF;
+        REQUIRE_THROWS_AS(overwatch::exporter::IpfixDecoder{}.decode(malformed.data(), malformed.size(), decoded), std::invalid_argument);
+    }
+    REQUIRE_THROWS_AS((overwatch::exporter::IpfixEncoder{0, 100}), std::invalid_argument);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Workers stream their records to a file")
+{
+    std::filesystem::path const path = fixtures::temp_path("flows.ipfix");
+    std::uint64_t bytes;
+    std::vector<std::unique_ptr<overwatch::exporter::ExportChannel>> channels;
+    {
+        // Small buffers so that the channels swap them many times
+        overwatch::exporter::FlowExporter exporter{overwatch::exporter::open_collector(path.string()), 4096};
+        channels.push_back(exporter.open_channel(0));
+        channels.push_back(exporter.open_channel(1));
+        for (std::uint32_t i = 0; i < 20000; ++i)
+        {
+            channels[i % 2]->add(make_flow_(i));
+        }
+        REQUIRE(channels[0]->pending());
+        for (std::unique_ptr<overwatch::exporter::ExportChannel> const &channel : channels)
+        {
+            channel->flush();
+            REQUIRE_FALSE(channel->pending());
+            REQUIRE(channel->get_records() == 10000);
+        }
+        exporter.stop();
+        overwatch::exporter::ExporterCounters const counters = exporter.get_counters();
+        REQUIRE(counters.errors == 0);
+        REQUIRE(counters.buffers > 2);
+        bytes = counters.bytes;
+        channels.clear();
+    }
+
+    std::vector<std::uint8_t> const data = read_file_(path);
+    REQUIRE(data.size() == bytes);
+    overwatch::exporter::IpfixDecoder decoder;
+    std::vector<ExportedFlow> decoded;
+    REQUIRE(decoder.decode(data.data(), data.size(), decoded) == data.size());
+    REQUIRE(decoded.size() == 20000);
+    REQUIRE(decoder.get_lost_records() == 0);
+    std::map<std::uint32_t, std::size_t> per_domain;
+    for (ExportedFlow const &flow : decoded)
+    {
+        ++per_domain[flow.observation_domain];
+        std::uint32_t const i = flow.key.src_port - 1024U;
+        REQUIRE(i % 2 == flow.observation_domain);
+    }
+    REQUIRE(per_domain[0] == 10000);
+    REQUIRE(per_domain[1] == 10000);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Records are sent to a UDP collector")
+{
+    int const fd = socket(AF_INET, SOCK_DGRAM, 0);
+    REQUIRE(fd >= 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+    socklen_t length = sizeof(address);
+    REQUIRE(getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) == 0);
+    int const receive_buffer = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+
+    {
+        overwatch::exporter::FlowExporter exporter{
+            overwatch::exporter::open_collector("udp:127.0.0.1:" + std::to_string(ntohs(address.sin_port)))};
+        std::unique_ptr<overwatch::exporter::ExportChannel> channel = exporter.open_channel(3);
+        for (std::uint32_t i = 0; i < 500; ++i)
+        {
+            channel->add(make_flow_(i));
+        }
+        channel->flush();
+        exporter.stop();
+        REQUIRE(exporter.get_counters().errors == 0);
+    }
+
+    overwatch::exporter::IpfixDecoder decoder;
+    std::vector<ExportedFlow> decoded;
+    std::vector<std::uint8_t> datagram(65536);
+    ssize_t received;
+    while ((received = recv(fd, datagram.data(), datagram.size(), MSG_DONTWAIT)) > 0)
+    {
+        REQUIRE(received <= 1400);
+        REQUIRE(decoder.decode(datagram.data(), static_cast<std::size_t>(received), decoded) == static_cast<std::size_t>(received));
+    }
+    close(fd);
+    REQUIRE(decoded.size() == 500);
+    REQUIRE(decoder.get_lost_records() == 0);
+    for (std::uint32_t i = 0; i < 500; ++i)
+    {
+        REQUIRE(decoded[i].observation_domain == 3);
+        require_flow_(decoded[i], make_flow_(i));
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Collector destinations are validated")
+{
+    for (char const *const invalid : {"udp:", "udp:10.0.0.1:0", "udp:10.0.0.1:70000", "udp:[::1", "udp:[::1]4739", "udp:collector:4739"})
+    {
+        REQUIRE_THROWS_AS(overwatch::exporter::open_collector(invalid), std::invalid_argument);
+    }
+    REQUIRE_THROWS_AS(overwatch::exporter::open_collector("/nonexistent/flows.ipfix"), std::runtime_error);
+    REQUIRE(overwatch::exporter::open_collector("udp:[::1]")->max_message_size() == 1400);
+    REQUIRE(overwatch::exporter::open_collector("udp:127.0.0.1")->max_message_size() == 1400);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Records are held back at most the flush interval")
+{
+    std::filesystem::path const path = fixtures::temp_path("stage.ipfix");
+    overwatch::exporter::FlowExporter exporter{overwatch::exporter::open_collector(path.string())};
+    overwatch::exporter::FlowExportStage stage{exporter.open_channel(0), 5 * SECOND_NS};
+    auto burst = std::make_unique<overwatch::core::PacketBurst>();
+
+    burst->now_ns = 10 * SECOND_NS;
+    burst->expired.push_back(make_flow_(1));
+    stage.process(*burst);
+    REQUIRE(stage.get_channel().pending());
+
+    burst->expired.clear();
+    burst->now_ns = 12 * SECOND_NS;
+    stage.process(*burst);
+    REQUIRE(stage.get_channel().pending());
+
+    burst->now_ns = 15 * SECOND_NS;
+    stage.process(*burst);
+    REQUIRE_FALSE(stage.get_channel().pending());
+
+    burst->expired.push_back(make_flow_(2));
+    stage.flush(*burst);
+    REQUIRE_FALSE(stage.get_channel().pending());
+    REQUIRE(stage.get_channel().get_records() == 2);
+    exporter.stop();
+    REQUIRE(exporter.get_counters().buffers == 2);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Idle ticks expire and export flows without further packets")
+{
+    std::filesystem::path const path = fixtures::temp_path("tick.ipfix");
+    overwatch::exporter::FlowExporter exporter{overwatch::exporter::open_collector(path.string())};
+    auto const table = std::make_shared<overwatch::core::LpmTable const>(common::utils::parse_ip_prefix_list("10.0.0.0/24"));
+    overwatch::core::Pipeline pipeline;
+    pipeline.add_stage(std::make_unique<overwatch::core::DecodeStage>());
+    pipeline.add_stage(std::make_unique<overwatch::core::ClassifyStage>(table));
+    // Small enough for the bounded expiry scan of a single tick to cover the table
+    pipeline.add_stage(std::make_unique<overwatch::core::FlowStage>(32, 5 * SECOND_NS));
+    pipeline.add_stage(std::make_unique<overwatch::exporter::FlowExportStage>(exporter.open_channel(0), 5 * SECOND_NS));
+    overwatch::exporter::FlowExportStage const *const stage = pipeline.find_stage<overwatch::exporter::FlowExportStage>();
+
+    std::vector<std::uint8_t> const frame = fixtures::udp_frame("10.0.0.1", "10.0.0.2", 1000, 53);
+    overwatch::capture::PacketBatch batch;
+    batch.push_back(overwatch::capture::PacketView{frame.data(), static_cast<std::uint32_t>(frame.size()),
+                                                   static_cast<std::uint32_t>(frame.size()), 1 * SECOND_NS});
+    pipeline.process(batch);
+    pipeline.tick(4 * SECOND_NS);
+    REQUIRE(stage->get_channel().get_records() == 0);
+
+    // The flow goes idle, then its record is flushed, with no packet in between
+    pipeline.tick(7 * SECOND_NS);
+    REQUIRE(stage->get_channel().get_records() == 1);
+    REQUIRE(stage->get_channel().pending());
+    pipeline.tick(12 * SECOND_NS);
+    REQUIRE_FALSE(stage->get_channel().pending());
+    exporter.stop();
+
+    std::vector<std::uint8_t> const data = read_file_(path);
+    overwatch::exporter::IpfixDecoder decoder;
+    std::vector<ExportedFlow> decoded;
+    REQUIRE(decoder.decode(data.data(), data.size(), decoded) == data.size());
+    REQUIRE(decoded.size() == 1);
+    REQUIRE(decoded[0].reason == overwatch::core::FlowEndReason::IdleTimeout);
+    std::filesystem::remove(path);
+}
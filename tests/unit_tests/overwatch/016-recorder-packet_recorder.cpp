@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+#include "packet_recorder.hpp"
+#include "pcap_fixture.hpp"
+#include "pcap_reader.hpp"
+
+#define TEST_NAME_PREFIX "PacketRecorder::"
+#define TEST_EPOCH_NS 1600000000123456789ULL
+#define SECOND_NS 1000000000ULL
+
+using overwatch::recorder::PacketRecorder;
+using overwatch::recorder::RecorderOptions;
+
+namespace
+{
+    // Small buffers so that frames often span two of them
+    RecorderOptions small_options_()
+    {
+        RecorderOptions options;
+        options.buffer_size = RECORD_ALIGNMENT * 2;
+        options.buffers = 4;
+        options.snaplen = 2048;
+        return options;
+    }
+
+    std::vector<fixtures::Frame> make_frames_(std::size_t const count, std::uint64_t const spacing_ns)
+    {
+        std::vector<fixtures::Frame> frames;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            std::string const payload(i * 37 % 1400, static_cast<char>('a' + i % 26));
+            frames.push_back(fixtures::Frame{
+                fixtures::udp_frame("10.0.0.1", "10.0.0." + std::to_string(2 + i % 200), 1000, 53, payload),
+                TEST_EPOCH_NS + i * spacing_ns});
+        }
+        return frames;
+    }
+
+    overwatch::capture::PacketView view_(fixtures::Frame const &frame)
+    {
+        return overwatch::capture::PacketView{frame.bytes.data(), static_cast<std::uint32_t>(frame.bytes.size()),
+                                              static_cast<std::uint32_t>(frame.bytes.size()), frame.timestamp_ns};
+    }
+
+    // Capture files of the directory in the order they were written
+    std::vector<std::filesystem::path> list_files_(std::filesystem::path const &directory)
+    {
+        std::vector<std::filesystem::path> files;
+        for (std::filesystem::directory_entry const &entry : std::filesystem::directory_iterator{directory})
+        {
+            files.push_back(entry.path());
+        }
+        auto const sequence = [](std::filesystem::path const &path) {
+            std::string const stem = path.stem().string();
+            return std::stoull(stem.substr(stem.rfind('-') + 1));
+        };
+        std::sort(files.begin(), files.end(), [&sequence](auto const &lhs, auto const &rhs) {
+            return sequence(lhs) < sequence(rhs);
+        });
+        return files;
+    }
+
+    std::vector<fixtures::Frame> read_file_(std::filesystem::path const &path)
+    {
+        overwatch::capture::PcapReader reader{path};
+        REQUIRE(reader.get_link_type() == 1);
+        std::vector<fixtures::Frame> frames;
+        overwatch::capture::PacketBatch batch;
+        while (!reader.exhausted())
+        {
+            if (reader.next_batch(batch, 1000))
+            {
+                for (overwatch::capture::PacketView const &packet : batch)
+                {
+                    REQUIRE(packet.caplen == packet.wire_len);
+                    frames.push_back(fixtures::Frame{std::vector<std::uint8_t>{packet.data, packet.data + packet.caplen},
+                                                     packet.timestamp_ns});
+                }
+            }
+        }
+        return frames;
+    }
+
+    void require_frames_(std::vector<fixtures::Frame> const &read, std::vector<fixtures::Frame> const &frames)
+    {
+        REQUIRE(read.size() == frames.size());
+        for (std::size_t i = 0; i < frames.size(); ++i)
+        {
+            REQUIRE(read[i].bytes == frames[i].bytes);
+            REQUIRE(read[i].timestamp_ns == frames[i].timestamp_ns);
+        }
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid options are rejected")
+{
+    std::filesystem::path const directory = fixtures::temp_path("record");
+    SECTION("Unaligned buffers")
+    {
+        RecorderOptions options = small_options_();
+        options.buffer_size += 512;
+        REQUIRE_THROWS_AS(PacketRecorder(directory, options), std::invalid_argument);
+    }
+    SECTION("Buffers smaller than a frame")
+    {
+        RecorderOptions options = small_options_();
+        options.snaplen = 65535;
+        REQUIRE_THROWS_AS(PacketRecorder(directory, options), std::invalid_argument);
+    }
+    SECTION("A single buffer")
+    {
+        RecorderOptions options = small_options_();
+        options.buffers = 1;
+        REQUIRE_THROWS_AS(PacketRecorder(directory, options), std::invalid_argument);
+    }
+    SECTION("Files that never rotate")
+    {
+        RecorderOptions options = small_options_();
+        options.max_file_age_ns = 0;
+        REQUIRE_THROWS_AS(PacketRecorder(directory, options), std::invalid_argument);
+    }
+    SECTION("A file instead of a directory")
+    {
+        std::ofstream{directory} << "not a directory";
+        REQUIRE_THROWS_AS(PacketRecorder(directory, small_options_()), std::invalid_argument);
+        std::filesystem::remove(directory);
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Recorded frames can be read back")
+{
+    std::filesystem::path const directory = fixtures::temp_path("record");
+    std::vector<fixtures::Frame> const frames = make_frames_(2000, 1000);
+    {
+        PacketRecorder recorder{directory, small_options_()};
+        {
+            std::unique_ptr<overwatch::recorder::RecordChannel> const channel = recorder.open_channel(3);
+            for (fixtures::Frame const &frame : frames)
+            {
+                // The writer never falls that far behind when it gets the time to catch up
+                while (!channel->record(view_(frame)))
+                {
+                    std::this_thread::yield();
+                }
+            }
+            channel->flush();
+            REQUIRE(channel->get_packets() == frames.size());
+        }
+        recorder.stop();
+        REQUIRE(recorder.get_counters().files == 1);
+        REQUIRE(recorder.get_counters().errors == 0);
+    }
+
+    std::vector<std::filesystem::path> const files = list_files_(directory);
+    REQUIRE(files.size() == 1);
+    REQUIRE(files[0].filename().string().rfind("overwatch-3-20200913T", 0) == 0);
+    require_frames_(read_file_(files[0]), frames);
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Frames are cut to the snapshot length")
+{
+    std::filesystem::path const directory = fixtures::temp_path("record");
+    RecorderOptions options = small_options_();
+    options.snaplen = 100;
+    fixtures::Frame const frame{fixtures::udp_frame("10.0.0.1", "10.0.0.2", 1000, 53, std::string(500, 'x')), TEST_EPOCH_NS};
+    {
+        PacketRecorder recorder{directory, options};
+        std::unique_ptr<overwatch::recorder::RecordChannel> const channel = recorder.open_channel(0);
+        REQUIRE(channel->record(view_(frame)));
+        channel->flush();
+    }
+
+    std::vector<std::filesystem::path> const files = list_files_(directory);
+    REQUIRE(files.size() == 1);
+    overwatch::capture::PcapReader reader{files[0]};
+    overwatch::capture::PacketBatch batch;
+    REQUIRE(reader.next_batch(batch, 1000));
+    REQUIRE(batch.size == 1);
+    REQUIRE(batch.packets[0].caplen == 100);
+    REQUIRE(batch.packets[0].wire_len == frame.bytes.size());
+    REQUIRE(std::equal(batch.packets[0].data, batch.packets[0].data + 100, frame.bytes.begin()));
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Files are rotated")
+{
+    std::filesystem::path const directory = fixtures::temp_path("record");
+    RecorderOptions options = small_options_();
+    std::vector<fixtures::Frame> frames;
+    std::size_t expected_files = 0;
+    SECTION("By size")
+    {
+        options.max_file_size = 20000;
+        frames = make_frames_(500, 1000);
+    }
+    SECTION("By age")
+    {
+        options.max_file_age_ns = 10 * SECOND_NS;
+        frames = make_frames_(95, SECOND_NS);
+        expected_files = 10;
+    }
+    {
+        PacketRecorder recorder{directory, options};
+        {
+            std::unique_ptr<overwatch::recorder::RecordChannel> const channel = recorder.open_channel(1);
+            for (fixtures::Frame const &frame : frames)
+            {
+                while (!channel->record(view_(frame)))
+                {
+                    std::this_thread::yield();
+                }
+            }
+            channel->flush();
+        }
+        recorder.stop();
+        REQUIRE(recorder.get_counters().errors == 0);
+    }
+
+    std::vector<std::filesystem::path> const files = list_files_(directory);
+    REQUIRE(files.size() > 1);
+    if (expected_files > 0)
+    {
+        REQUIRE(files.size() == expected_files);
+    }
+    std::vector<fixtures::Frame> read;
+    for (std::filesystem::path const &file : files)
+    {
+        REQUIRE(std::filesystem::file_size(file) <= options.max_file_size);
+        std::vector<fixtures::Frame> const file_frames = read_file_(file);
+        REQUIRE(!file_frames.empty());
+        REQUIRE(file_frames.back().timestamp_ns - file_frames.front().timestamp_ns < options.max_file_age_ns);
+        read.insert(read.end(), file_frames.begin(), file_frames.end());
+    }
+    require_frames_(read, frames);
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Idle files are closed")
+{
+    std::filesystem::path const directory = fixtures::temp_path("record");
+    RecorderOptions options = small_options_();
+    options.max_file_age_ns = 10 * SECOND_NS;
+    std::vector<fixtures::Frame> const frames = make_frames_(2, 100 * SECOND_NS);
+    PacketRecorder recorder{directory, options};
+    std::unique_ptr<overwatch::recorder::RecordChannel> const channel = recorder.open_channel(0);
+
+    REQUIRE(channel->record(view_(frames[0])));
+    channel->poll(frames[0].timestamp_ns + 9 * SECOND_NS);
+    REQUIRE(recorder.get_counters().files == 0);
+    channel->poll(frames[0].timestamp_ns + 10 * SECOND_NS);
+    REQUIRE(channel->record(view_(frames[1])));
+    channel->flush();
+    recorder.stop();
+
+    std::vector<std::filesystem::path> const files = list_files_(directory);
+    REQUIRE(files.size() == 2);
+    require_frames_(read_file_(files[0]), {frames[0]});
+    require_frames_(read_file_(files[1]), {frames[1]});
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Files are closed by idle ticks")
+{
+    std::filesystem::path const directory = fixtures::temp_path("record");
+    RecorderOptions options = small_options_();
+    options.max_file_age_ns = 10 * SECOND_NS;
+    std::vector<fixtures::Frame> const frames = make_frames_(2, 11 * SECOND_NS);
+    PacketRecorder recorder{directory, options};
+    auto const table = std::make_shared<overwatch::core::LpmTable const>(common::utils::parse_ip_prefix_list("10.0.0.1"));
+    overwatch::core::Pipeline pipeline;
+    pipeline.add_stage(std::make_unique<overwatch::core::DecodeStage>());
+    pipeline.add_stage(std::make_unique<overwatch::core::ClassifyStage>(table));
+    pipeline.add_stage(std::make_unique<overwatch::recorder::RecordStage>(recorder.open_channel(0)));
+
+    overwatch::capture::PacketBatch batch;
+    batch.push_back(view_(frames[0]));
+    pipeline.process(batch);
+    pipeline.tick(frames[0].timestamp_ns + 9 * SECOND_NS);
+    REQUIRE(recorder.get_counters().files == 0);
+    // The file ages out with no packet arriving, the next frame starts a new one
+    pipeline.tick(frames[0].timestamp_ns + 10 * SECOND_NS);
+    batch.clear();
+    batch.push_back(view_(frames[1]));
+    pipeline.process(batch);
+    pipeline.flush();
+    recorder.stop();
+
+    std::vector<std::filesystem::path> const files = list_files_(directory);
+    REQUIRE(files.size() == 2);
+    require_frames_(read_file_(files[0]), {frames[0]});
+    require_frames_(read_file_(files[1]), {frames[1]});
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Frames are dropped rather than waiting for the disk")
+{
+    std::filesystem::path const directory = fixtures::temp_path("record");
+    RecorderOptions options = small_options_();
+    options.buffers = 2;
+    std::vector<fixtures::Frame> const frames = make_frames_(20000, 1000);
+    std::vector<fixtures::Frame> recorded;
+    {
+        PacketRecorder recorder{directory, options};
+        std::unique_ptr<overwatch::recorder::RecordChannel> const channel = recorder.open_channel(0);
+        for (fixtures::Frame const &frame : frames)
+        {
+            if (channel->record(view_(frame)))
+            {
+                recorded.push_back(frame);
+            }
+        }
+        channel->flush();
+        REQUIRE(channel->get_packets() == recorded.size());
+        REQUIRE(channel->get_drops() == frames.size() - recorded.size());
+        REQUIRE(channel->get_drops() > 0);
+    }
+
+    // The frames that made it are intact
+    std::vector<std::filesystem::path> const files = list_files_(directory);
+    REQUIRE(files.size() == 1);
+    require_frames_(read_file_(files[0]), recorded);
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Only the targets' packets are recorded")
+{
+    std::filesystem::path const directory = fixtures::temp_path("record");
+    std::vector<fixtures::Frame> const frames = make_frames_(100, 1000);
+    std::vector<fixtures::Frame> targeted;
+    {
+        PacketRecorder recorder{directory, small_options_()};
+        overwatch::recorder::RecordStage stage{recorder.open_channel(0)};
+        std::vector<overwatch::capture::PacketView> views;
+        auto burst = std::make_unique<overwatch::core::PacketBurst>();
+        for (std::size_t i = 0; i < frames.size(); ++i)
+        {
+            views.push_back(view_(frames[i]));
+            bool const source = i % 3 == 0;
+            bool const destination = i % 5 == 0;
+            burst->src_targets[i] = source ? 0 : overwatch::core::LpmTable::NO_MATCH;
+            burst->dst_targets[i] = destination ? 1 : overwatch::core::LpmTable::NO_MATCH;
+            if (source || destination)
+            {
+                targeted.push_back(frames[i]);
+            }
+        }
+        burst->packets = views.data();
+        burst->size = views.size();
+        burst->now_ns = frames.back().timestamp_ns;
+        stage.process(*burst);
+        stage.flush(*burst);
+        REQUIRE(stage.get_channel().get_packets() == targeted.size());
+    }
+
+    std::vector<std::filesystem::path> const files = list_files_(directory);
+    REQUIRE(files.size() == 1);
+    require_frames_(read_file_(files[0]), targeted);
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,710 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+#include "pcap_fixture.hpp"
+#include "pcap_reader.hpp"
+#include "pipeline.hpp"
+#include "tcp_reassembler.hpp"
+
+#define TEST_NAME_PREFIX "TcpReassembler::"
+#define SECOND_NS 1000000000ULL
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+
+using overwatch::reassembly::ReassemblerOptions;
+using overwatch::reassembly::StreamEnd;
+using overwatch::reassembly::StreamInfo;
+
+namespace
+{
+    struct Direction
+    {
+        // Gaps are filled with '?'
+        std::string bytes;
+        std::vector<std::pair<std::size_t, std::size_t>> gaps;
+    };
+
+    struct Result
+    {
+        overwatch::core::FlowKey key;
+        std::uint8_t initiator = 0;
+        Direction directions[2];
+        std::optional<StreamEnd> end;
+    };
+
+    class CollectingAnalyzer : public overwatch::reassembly::StreamAnalyzer
+    {
+    public:
+        bool on_data(StreamInfo const &stream, std::uint8_t const direction, std::uint8_t const *data,
+                     std::size_t const size) override
+        {
+            Direction &bytes = get_(stream).directions[direction];
+            REQUIRE(stream.offsets[direction] == bytes.bytes.size());
+            bytes.bytes.append(data, data + size);
+            chunks.emplace_back(data, size);
+            return chunks.size() < stop_after;
+        }
+
+        void on_gap(StreamInfo const &stream, std::uint8_t const direction, std::size_t const size) override
+        {
+            Direction &bytes = get_(stream).directions[direction];
+            REQUIRE(stream.offsets[direction] == bytes.bytes.size());
+            bytes.gaps.emplace_back(bytes.bytes.size(), size);
+            bytes.bytes.append(size, '?');
+        }
+
+        void on_end(StreamInfo const &stream, StreamEnd const reason) override
+        {
+            Result result = get_(stream);
+            result.end = reason;
+            ended.push_back(result);
+            open.erase(stream.id);
+        }
+
+        std::map<std::uint32_t, Result> open;
+        std::vector<Result> ended;
+        std::vector<std::pair<std::uint8_t const *, std::size_t>> chunks;
+        // Number of chunks after which the analyzer is done with a stream
+        std::size_t stop_after = SIZE_MAX;
+
+    private:
+        Result &get_(StreamInfo const &stream)
+        {
+            auto const inserted = open.emplace(stream.id, Result{});
+            if (inserted.second)
+            {
+                inserted.first->second.key = stream.key;
+                inserted.first->second.initiator = stream.initiator;
+            }
+            REQUIRE(inserted.first->second.key == stream.key);
+            return inserted.first->second;
+        }
+    };
+
+    struct TestReassembly
+    {
+        overwatch::core::Pipeline pipeline;
+        CollectingAnalyzer *analyzer;
+        overwatch::reassembly::ReassemblyStage const *stage;
+
+        explicit TestReassembly(ReassemblerOptions const &options = ReassemblerOptions{})
+        {
+            auto const table =
+                std::make_shared<overwatch::core::LpmTable const>(common::utils::parse_ip_prefix_list("192.168.1.0/24"));
+            pipeline.add_stage(std::make_unique<overwatch::core::DecodeStage>());
+            pipeline.add_stage(std::make_unique<overwatch::core::ClassifyStage>(table));
+            pipeline.add_stage(std::make_unique<overwatch::core::FlowStage>(1024, 600 * SECOND_NS));
+            auto collecting = std::make_unique<CollectingAnalyzer>();
+            analyzer = collecting.get();
+            pipeline.add_stage(std::make_unique<overwatch::reassembly::ReassemblyStage>(std::move(collecting), options));
+            stage = pipeline.find_stage<overwatch::reassembly::ReassemblyStage>();
+        }
+
+        void replay(std::filesystem::path const &path, bool const flush = true)
+        {
+            overwatch::capture::PcapReader reader{path};
+            overwatch::capture::PacketBatch batch;
+            while (!reader.exhausted())
+            {
+                if (reader.next_batch(batch, 1000))
+                {
+                    pipeline.process(batch);
+                }
+            }
+            if (flush)
+            {
+                pipeline.flush();
+            }
+        }
+
+        // Processes a frame on its own (the frame must stay alive while the reassembler may deliver it)
+        void feed(fixtures::Frame const &frame, std::uint32_t const cut = 0)
+        {
+            overwatch::capture::PacketBatch batch;
+            batch.push_back(overwatch::capture::PacketView{frame.bytes.data(),
+                                                           static_cast<std::uint32_t>(frame.bytes.size()) - cut,
+                                                           static_cast<std::uint32_t>(frame.bytes.size()), frame.timestamp_ns});
+            pipeline.process(batch);
+        }
+
+        overwatch::reassembly::ReassemblyCounters counters() const
+        {
+            return stage->get_reassembler().get_counters();
+        }
+    };
+
+    std::string text_(std::size_t const size, std::uint32_t const seed)
+    {
+        std::string text;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            text.push_back(static_cast<char>('a' + (i * 7 + seed) % 26));
+        }
+        return text;
+    }
+
+    // TCP segment with a SACK option carrying one block
+    std::vector<std::uint8_t> sack_frame_(std::string const &src, std::string const &dst, std::uint16_t const src_port,
+                                          std::uint16_t const dst_port, std::uint32_t const seq, std::uint32_t const ack,
+                                          std::uint32_t const left, std::uint32_t const right)
+    {
+        std::vector<std::uint8_t> tcp;
+        fixtures::put16(tcp, src_port);
+        fixtures::put16(tcp, dst_port);
+        fixtures::put32(tcp, seq);
+        fixtures::put32(tcp, ack);
+        tcp.push_back(0x80);
+        tcp.push_back(TCP_ACK);
+        fixtures::put16(tcp, 65535);
+        fixtures::put32(tcp, 0);
+        tcp.insert(tcp.end(), {1, 1, 5, 10});
+        fixtures::put32(tcp, left);
+        fixtures::put32(tcp, right);
+        return fixtures::ipv4_frame(src, dst, 6, tcp);
+    }
+
+    /**
+     * Frames of a connection between a client (10.0.0.1:40000) and a target (192.168.1.10:80)
+     *
+     * The client is the source of the canonical key, its bytes travel in direction 0.
+     */
+    class Conversation
+    {
+    public:
+        Conversation(std::uint32_t const client_isn, std::uint32_t const server_isn)
+            : client_seq_{client_isn}, server_seq_{server_isn}
+        {
+        }
+
+        void handshake()
+        {
+            add_(fixtures::tcp_frame("10.0.0.1", "192.168.1.10", 40000, 80, client_seq_, TCP_SYN));
+            ++client_seq_;
+            add_(fixtures::tcp_frame("192.168.1.10", "10.0.0.1", 80, 40000, server_seq_, TCP_SYN | TCP_ACK, "", client_seq_));
+            ++server_seq_;
+            add_(fixtures::tcp_frame("10.0.0.1", "192.168.1.10", 40000, 80, client_seq_, TCP_ACK, "", server_seq_));
+        }
+
+        // Sends a client segment, acknowledged by the server if ack is set, returns the index of the segment's frame
+        std::size_t client_send(std::string const &payload, bool const ack = true)
+        {
+            std::size_t const index = add_(fixtures::tcp_frame("10.0.0.1", "192.168.1.10", 40000, 80, client_seq_,
+                                                               TCP_PSH | TCP_ACK, payload, server_seq_));
+            client_seq_ += static_cast<std::uint32_t>(payload.size());
+            client_data += payload;
+            if (ack)
+            {
+                server_ack();
+            }
+            return index;
+        }
+
+        std::size_t server_send(std::string const &payload)
+        {
+            std::size_t const index = add_(fixtures::tcp_frame("192.168.1.10", "10.0.0.1", 80, 40000, server_seq_,
+                                                               TCP_PSH | TCP_ACK, payload, client_seq_));
+            server_seq_ += static_cast<std::uint32_t>(payload.size());
+            server_data += payload;
+            add_(fixtures::tcp_frame("10.0.0.1", "192.168.1.10", 40000, 80, client_seq_, TCP_ACK, "", server_seq_));
+            return index;
+        }
+
+        void server_ack()
+        {
+            add_(fixtures::tcp_frame("192.168.1.10", "10.0.0.1", 80, 40000, server_seq_, TCP_ACK, "", client_seq_));
+        }
+
+        void close()
+        {
+            add_(fixtures::tcp_frame("10.0.0.1", "192.168.1.10", 40000, 80, client_seq_, TCP_FIN | TCP_ACK, "", server_seq_));
+            ++client_seq_;
+            add_(fixtures::tcp_frame("192.168.1.10", "10.0.0.1", 80, 40000, server_seq_, TCP_FIN | TCP_ACK, "", client_seq_));
+            ++server_seq_;
+            add_(fixtures::tcp_frame("10.0.0.1", "192.168.1.10", 40000, 80, client_seq_, TCP_ACK, "", server_seq_));
+        }
+
+        std::size_t add_frame(std::vector<std::uint8_t> bytes)
+        {
+            return add_(std::move(bytes));
+        }
+
+        std::uint32_t client_seq() const noexcept
+        {
+            return client_seq_;
+        }
+        std::uint32_t server_seq() const noexcept
+        {
+            return server_seq_;
+        }
+
+        std::vector<fixtures::Frame> frames;
+        std::string client_data;
+        std::string server_data;
+
+    private:
+        std::size_t add_(std::vector<std::uint8_t> bytes)
+        {
+            frames.push_back(fixtures::Frame{std::move(bytes), SECOND_NS + frames.size() * 1000});
+            return frames.size() - 1;
+        }
+
+        std::uint32_t client_seq_;
+        std::uint32_t server_seq_;
+    };
+
+    std::filesystem::path write_(std::vector<fixtures::Frame> frames)
+    {
+        // Capture order, not timestamp order, is what the test reorders
+        for (std::size_t i = 0; i < frames.size(); ++i)
+        {
+            frames[i].timestamp_ns = SECOND_NS + i * 1000;
+        }
+        std::filesystem::path const path = fixtures::temp_path("reassembly.pcap");
+        fixtures::write_pcap(path, frames, true);
+        return path;
+    }
+
+    // The bytes a direction should deliver with the given ranges replaced by gaps
+    std::string with_gaps_(std::string bytes, std::vector<std::pair<std::size_t, std::size_t>> const &gaps)
+    {
+        for (auto const &gap : gaps)
+        {
+            bytes.replace(gap.first, gap.second, gap.second, '?');
+        }
+        return bytes;
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid options are rejected")
+{
+    CollectingAnalyzer analyzer;
+    ReassemblerOptions options;
+    SECTION("Memory below a slab")
+    {
+        options.max_memory = SEGMENT_SIZE;
+    }
+    SECTION("No stream")
+    {
+        options.max_streams = 0;
+    }
+    SECTION("No window")
+    {
+        options.max_window = 0;
+    }
+    REQUIRE_THROWS_AS(overwatch::reassembly::TcpReassembler(analyzer, options), std::invalid_argument);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "In order streams are delivered whole")
+{
+    // The client's sequence numbers wrap around during the transfer
+    Conversation conversation{0xFFFFF000, 1000};
+    conversation.handshake();
+    for (std::uint32_t i = 0; i < 20; ++i)
+    {
+        conversation.client_send(text_(100 + i * 37, i));
+        conversation.server_send(text_(1400, i + 100));
+    }
+    conversation.close();
+    std::filesystem::path const path = write_(conversation.frames);
+
+    TestReassembly test;
+    test.replay(path);
+    REQUIRE(test.analyzer->open.empty());
+    REQUIRE(test.analyzer->ended.size() == 1);
+    Result const &result = test.analyzer->ended[0];
+    REQUIRE(result.end == StreamEnd::Closed);
+    REQUIRE(result.initiator == 0);
+    REQUIRE(result.directions[0].bytes == conversation.client_data);
+    REQUIRE(result.directions[1].bytes == conversation.server_data);
+    REQUIRE(result.directions[0].gaps.empty());
+    REQUIRE(result.directions[1].gaps.empty());
+
+    overwatch::reassembly::ReassemblyCounters const counters = test.counters();
+    REQUIRE(counters.streams == 1);
+    REQUIRE(counters.out_of_order == 0);
+    REQUIRE(counters.gaps == 0);
+    // The final acknowledgement does not start a new stream
+    REQUIRE(test.stage->get_reassembler().get_streams() == 0);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "In order bytes are delivered without copies")
+{
+    Conversation conversation{1, 1};
+    conversation.handshake();
+    for (std::uint32_t i = 0; i < 10; ++i)
+    {
+        conversation.client_send(text_(500, i));
+    }
+    TestReassembly test;
+    for (fixtures::Frame const &frame : conversation.frames)
+    {
+        test.feed(frame);
+    }
+
+    REQUIRE(test.analyzer->chunks.size() == 10);
+    for (auto const &chunk : test.analyzer->chunks)
+    {
+        bool const in_frame = std::any_of(conversation.frames.begin(), conversation.frames.end(), [&chunk](auto const &frame) {
+            return chunk.first >= frame.bytes.data() && chunk.first + chunk.second <= frame.bytes.data() + frame.bytes.size();
+        });
+        REQUIRE(in_frame);
+    }
+    REQUIRE(test.analyzer->open.begin()->second.directions[0].bytes == conversation.client_data);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Out of order and retransmitted segments are reordered")
+{
+    Conversation conversation{0xFFFFA000, 5000};
+    conversation.handshake();
+    std::vector<std::size_t> segments;
+    for (std::uint32_t i = 0; i < 40; ++i)
+    {
+        // Large segments are split over several pooled segments
+        segments.push_back(conversation.client_send(text_(i % 5 == 0 ? 5000 : 300 + i * 11, i), false));
+    }
+    conversation.server_ack();
+    conversation.close();
+
+    std::vector<fixtures::Frame> frames = conversation.frames;
+    std::vector<fixtures::Frame> data;
+    for (std::size_t const index : segments)
+    {
+        data.push_back(frames[index]);
+    }
+    std::mt19937 random{7};
+    std::shuffle(data.begin(), data.end(), random);
+    // Some segments are captured twice
+    for (std::size_t i = 0; i < data.size(); i += 6)
+    {
+        data.insert(data.begin() + static_cast<std::ptrdiff_t>(i + 3), data[i]);
+    }
+    frames.erase(frames.begin() + static_cast<std::ptrdiff_t>(segments.front()),
+                 frames.begin() + static_cast<std::ptrdiff_t>(segments.back() + 1));
+    frames.insert(frames.begin() + static_cast<std::ptrdiff_t>(segments.front()), data.begin(), data.end());
+    std::filesystem::path const path = write_(frames);
+
+    TestReassembly test;
+    test.replay(path);
+    REQUIRE(test.analyzer->ended.size() == 1);
+    Result const &result = test.analyzer->ended[0];
+    REQUIRE(result.end == StreamEnd::Closed);
+    REQUIRE(result.directions[0].bytes == conversation.client_data);
+    REQUIRE(result.directions[0].gaps.empty());
+
+    overwatch::reassembly::ReassemblyCounters const counters = test.counters();
+    REQUIRE(counters.out_of_order > 0);
+    REQUIRE(counters.retransmitted + counters.overlapping > 0);
+    REQUIRE(counters.gaps == 0);
+    REQUIRE(test.stage->get_reassembler().get_buffered_bytes() == 0);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Segments the capture lost become gaps once acknowledged")
+{
+    Conversation conversation{100, 200};
+    conversation.handshake();
+    std::vector<std::size_t> segments;
+    std::vector<std::size_t> offsets;
+    for (std::uint32_t i = 0; i < 10; ++i)
+    {
+        offsets.push_back(conversation.client_data.size());
+        segments.push_back(conversation.client_send(text_(400 + i, i)));
+    }
+    conversation.server_send("HTTP/1.1 200 OK\r\n\r\n");
+    conversation.close();
+
+    std::size_t lost = 0;
+    SECTION("In the middle")
+    {
+        lost = 4;
+    }
+    SECTION("Right before the FIN")
+    {
+        lost = 9;
+    }
+    std::vector<fixtures::Frame> frames = conversation.frames;
+    frames.erase(frames.begin() + static_cast<std::ptrdiff_t>(segments[lost]));
+    std::filesystem::path const path = write_(frames);
+
+    TestReassembly test;
+    test.replay(path);
+    REQUIRE(test.analyzer->ended.size() == 1);
+    Result const &result = test.analyzer->ended[0];
+    REQUIRE(result.end == StreamEnd::Closed);
+    std::size_t const size = 400 + lost;
+    REQUIRE(result.directions[0].gaps == std::vector<std::pair<std::size_t, std::size_t>>{{offsets[lost], size}});
+    REQUIRE(result.directions[0].bytes == with_gaps_(conversation.client_data, {{offsets[lost], size}}));
+    REQUIRE(result.directions[1].bytes == conversation.server_data);
+    REQUIRE(test.counters().gaps == size);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "SACK holes wait for the retransmission")
+{
+    // The network loses segment 2, the capture misses segment 4 that the receiver did get
+    Conversation conversation{1000, 2000};
+    conversation.handshake();
+    std::vector<std::uint32_t> starts;
+    std::vector<std::string> payloads;
+    for (std::uint32_t i = 0; i < 6; ++i)
+    {
+        payloads.push_back(text_(300, i));
+    }
+    std::vector<fixtures::Frame> frames = conversation.frames;
+    std::vector<fixtures::Frame> segments;
+    for (std::uint32_t i = 0; i < 6; ++i)
+    {
+        starts.push_back(conversation.client_seq());
+        segments.push_back(conversation.frames[conversation.client_send(payloads[i], false)]);
+    }
+    std::uint32_t const hole = starts[2];
+    bool sack = false;
+    SECTION("With SACK")
+    {
+        sack = true;
+    }
+    SECTION("Without SACK")
+    {
+    }
+    auto const acknowledge = [&](std::uint32_t const ack, std::uint32_t const right) {
+        std::vector<std::uint8_t> bytes =
+            sack ? sack_frame_("192.168.1.10", "10.0.0.1", 80, 40000, conversation.server_seq(), ack, starts[3], right)
+                 : fixtures::tcp_frame("192.168.1.10", "10.0.0.1", 80, 40000, conversation.server_seq(), TCP_ACK, "", ack);
+        frames.push_back(fixtures::Frame{bytes, 0});
+    };
+    frames.push_back(segments[0]);
+    acknowledge(starts[1], starts[1]);
+    frames.push_back(segments[1]);
+    acknowledge(hole, hole);
+    frames.push_back(segments[3]);
+    acknowledge(hole, starts[4]);
+    acknowledge(hole, starts[5]);
+    frames.push_back(segments[5]);
+    acknowledge(hole, conversation.client_seq());
+    // The retransmission fills the hole the receiver is waiting for
+    frames.push_back(segments[2]);
+    std::filesystem::path const path = write_(frames);
+
+    TestReassembly test;
+    test.replay(path, false);
+    REQUIRE(test.analyzer->open.size() == 1);
+    Direction const &client = test.analyzer->open.begin()->second.directions[0];
+    std::string const expected = payloads[0] + payloads[1] + payloads[2] + payloads[3];
+    if (sack)
+    {
+        // The receiver selectively acknowledged the missed segment, it is skipped right away
+        REQUIRE(client.bytes == expected + std::string(300, '?') + payloads[5]);
+        REQUIRE(client.gaps == std::vector<std::pair<std::size_t, std::size_t>>{{1200, 300}});
+    }
+    else
+    {
+        // Nothing tells the missed segment from one still in flight
+        REQUIRE(client.bytes == expected);
+        REQUIRE(client.gaps.empty());
+        test.pipeline.flush();
+        REQUIRE(test.analyzer->ended[0].directions[0].bytes == expected + std::string(300, '?') + payloads[5]);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Overlapping segments follow the overlap policy")
+{
+    ReassemblerOptions options;
+    std::string expected;
+    SECTION("The first bytes win")
+    {
+        options.overlap = overwatch::reassembly::OverlapPolicy::First;
+        expected = "CCCCCBBBBBAAAAAAAAAA";
+    }
+    SECTION("The last bytes win")
+    {
+        options.overlap = overwatch::reassembly::OverlapPolicy::Last;
+        expected = "CCCCCCCCCCBBBBBAAAAA";
+    }
+    Conversation conversation{5000, 9000};
+    conversation.handshake();
+    std::uint32_t const start = conversation.client_seq();
+    auto const segment = [&conversation](std::uint32_t const seq, std::string const &payload) {
+        conversation.add_frame(fixtures::tcp_frame("10.0.0.1", "192.168.1.10", 40000, 80, seq, TCP_ACK, payload, 9001));
+    };
+    segment(start + 10, std::string(10, 'A'));
+    segment(start + 5, std::string(10, 'B'));
+    segment(start, std::string(10, 'C'));
+
+    TestReassembly test{options};
+    for (fixtures::Frame const &frame : conversation.frames)
+    {
+        test.feed(frame);
+    }
+    REQUIRE(test.analyzer->open.begin()->second.directions[0].bytes == expected);
+    REQUIRE(test.counters().overlapping == 10);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Buffered bytes stay under the memory cap")
+{
+    ReassemblerOptions options;
+    options.max_memory = SEGMENTS_PER_SLAB * SEGMENT_SIZE;
+    TestReassembly test{options};
+    std::vector<fixtures::Frame> frames;
+    frames.reserve(40 * 9);
+    std::map<std::uint16_t, std::string> sent;
+    for (std::uint16_t stream = 0; stream < 40; ++stream)
+    {
+        std::uint16_t const port = static_cast<std::uint16_t>(10000 + stream);
+        std::string const data = text_(10000, stream);
+        sent[port] = data;
+        // The first segment starts the stream, the second one is never captured
+        frames.push_back(fixtures::Frame{
+            fixtures::tcp_frame("10.0.0.1", "192.168.1.10", port, 80, 0, TCP_ACK, data.substr(0, 1000)), stream * SECOND_NS});
+        for (std::uint32_t i = 2; i < 10; ++i)
+        {
+            frames.push_back(fixtures::Frame{
+                fixtures::tcp_frame("10.0.0.1", "192.168.1.10", port, 80, i * 1000, TCP_ACK, data.substr(i * 1000, 1000)),
+                stream * SECOND_NS + i});
+        }
+    }
+    for (fixtures::Frame const &frame : frames)
+    {
+        test.feed(frame);
+        REQUIRE(test.stage->get_reassembler().get_buffered_bytes() <= options.max_memory);
+    }
+    test.pipeline.flush();
+
+    REQUIRE(test.counters().evictions > 0);
+    REQUIRE(test.analyzer->ended.size() == 40);
+    for (Result const &result : test.analyzer->ended)
+    {
+        std::uint16_t const port = result.key.src_port;
+        REQUIRE(result.directions[0].gaps == std::vector<std::pair<std::size_t, std::size_t>>{{1000, 1000}});
+        REQUIRE(result.directions[0].bytes == with_gaps_(sent[port], {{1000, 1000}}));
+    }
+    REQUIRE(test.stage->get_reassembler().get_buffered_bytes() == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Streams end")
+{
+    ReassemblerOptions options;
+    options.max_streams = 4;
+    options.idle_timeout_ns = 10 * SECOND_NS;
+    TestReassembly test{options};
+    std::vector<fixtures::Frame> frames;
+    frames.reserve(16);
+    auto const send = [&frames, &test](std::uint16_t const port, std::uint8_t const flags, std::uint64_t const timestamp_ns) {
+        frames.push_back(fixtures::Frame{
+            fixtures::tcp_frame("10.0.0.1", "192.168.1.10", port, 80, 1, flags, flags & TCP_RST ? "" : "data"),
+            timestamp_ns});
+        test.feed(frames.back());
+    };
+
+    SECTION("The least recently used streams make room")
+    {
+        for (std::uint16_t port = 1; port <= 6; ++port)
+        {
+            send(port, TCP_ACK, port * SECOND_NS);
+        }
+        REQUIRE(test.analyzer->ended.size() == 2);
+        REQUIRE(test.analyzer->ended[0].key.src_port == 1);
+        REQUIRE(test.analyzer->ended[1].key.src_port == 2);
+        REQUIRE(test.analyzer->ended[0].end == StreamEnd::Evicted);
+        REQUIRE(test.stage->get_reassembler().get_streams() == 4);
+        test.pipeline.flush();
+        REQUIRE(test.analyzer->ended.size() == 6);
+        REQUIRE(test.analyzer->ended[5].end == StreamEnd::Flushed);
+    }
+    SECTION("Idle streams time out")
+    {
+        send(1, TCP_ACK, SECOND_NS);
+        send(2, TCP_ACK, 5 * SECOND_NS);
+        send(3, TCP_ACK, 11 * SECOND_NS);
+        REQUIRE(test.analyzer->ended.size() == 1);
+        REQUIRE(test.analyzer->ended[0].key.src_port == 1);
+        REQUIRE(test.analyzer->ended[0].end == StreamEnd::IdleTimeout);
+    }
+    SECTION("Resets end the stream")
+    {
+        send(1, TCP_ACK, SECOND_NS);
+        send(1, TCP_RST, 2 * SECOND_NS);
+        REQUIRE(test.analyzer->ended.size() == 1);
+        REQUIRE(test.analyzer->ended[0].end == StreamEnd::Reset);
+        REQUIRE(test.analyzer->ended[0].directions[0].bytes == "data");
+        // Resets of unknown streams start nothing
+        send(1, TCP_RST, 3 * SECOND_NS);
+        REQUIRE(test.stage->get_reassembler().get_streams() == 0);
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Bytes cut by the snapshot length become gaps")
+{
+    Conversation conversation{1, 1};
+    conversation.handshake();
+    conversation.client_send(text_(500, 0), false);
+    conversation.client_send(text_(500, 1), false);
+    TestReassembly test;
+    for (std::size_t i = 0; i < conversation.frames.size(); ++i)
+    {
+        test.feed(conversation.frames[i], i == 3 ? 100 : 0);
+    }
+    Direction const &client = test.analyzer->open.begin()->second.directions[0];
+    REQUIRE(client.gaps == std::vector<std::pair<std::size_t, std::size_t>>{{400, 100}});
+    REQUIRE(client.bytes == with_gaps_(conversation.client_data, {{400, 100}}));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Only the targets' streams are reassembled")
+{
+    std::vector<fixtures::Frame> const frames{
+        fixtures::Frame{fixtures::tcp_frame("10.0.0.1", "10.0.0.2", 40000, 80, 1, TCP_ACK, "not a target"), SECOND_NS},
+        fixtures::Frame{fixtures::tcp_frame("10.0.0.1", "192.168.1.10", 40000, 80, 1, TCP_ACK, "target"), SECOND_NS}};
+    TestReassembly test;
+    for (fixtures::Frame const &frame : frames)
+    {
+        test.feed(frame);
+    }
+    REQUIRE(test.analyzer->open.size() == 1);
+    REQUIRE(test.analyzer->open.begin()->second.directions[0].bytes == "target");
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Streams the analyzer is done with are no longer reassembled")
+{
+    Conversation conversation{1, 1};
+    conversation.handshake();
+    conversation.client_send(text_(500, 0));
+    std::size_t const late = conversation.client_send(text_(500, 1), false);
+    conversation.client_send(text_(500, 2), false);
+    conversation.server_send("response");
+    conversation.close();
+    // The second segment arrives last, the third one is buffered when the analyzer stops
+    std::vector<fixtures::Frame> frames = conversation.frames;
+    std::rotate(frames.begin() + static_cast<std::ptrdiff_t>(late), frames.begin() + static_cast<std::ptrdiff_t>(late + 1),
+                frames.begin() + static_cast<std::ptrdiff_t>(late + 2));
+
+    TestReassembly test;
+    test.analyzer->stop_after = 2;
+    for (fixtures::Frame const &frame : frames)
+    {
+        test.feed(frame);
+    }
+    REQUIRE(test.analyzer->chunks.size() == 2);
+    REQUIRE(test.stage->get_reassembler().get_buffered_bytes() == 0);
+    // The stream still ends with its FINs
+    REQUIRE(test.analyzer->ended.size() == 1);
+    REQUIRE(test.analyzer->ended[0].end == StreamEnd::Closed);
+    REQUIRE(test.analyzer->ended[0].directions[0].bytes == conversation.client_data.substr(0, 1000));
+    REQUIRE(test.stage->get_reassembler().get_streams() == 0);
+}
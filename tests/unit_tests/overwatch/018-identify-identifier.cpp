@@ -0,0 +1,687 @@
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "crypto.hpp"
+#include "dns.hpp"
+#include "http.hpp"
+#include "identifier.hpp"
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+#include "pcap_fixture.hpp"
+#include "pipeline.hpp"
+#include "quic.hpp"
+#include "tcp_reassembler.hpp"
+#include "tls.hpp"
+
+#define TEST_NAME_PREFIX "Identify::"
+#define SECOND_NS 1000000000ULL
+
+#define TCP_SYN 0x02
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+
+using overwatch::identify::HttpRequestParser;
+using overwatch::identify::Identification;
+using overwatch::identify::ParseResult;
+using overwatch::identify::Protocol;
+
+namespace
+{
+    std::string hex_(std::uint8_t const *const data, std::size_t const size)
+    {
+        std::string text;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            char digits[3];
+            std::snprintf(digits, sizeof(digits), "%02x", data[i]);
+            text += digits;
+        }
+        return text;
+    }
+
+    std::vector<std::uint8_t> bytes_(std::string const &hex)
+    {
+        std::vector<std::uint8_t> bytes;
+        for (std::size_t i = 0; i + 1 < hex.size(); i += 2)
+        {
+            bytes.push_back(static_cast<std::uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+        }
+        return bytes;
+    }
+
+    std::uint8_t const *data_(std::string const &text)
+    {
+        return reinterpret_cast<std::uint8_t const *>(text.data());
+    }
+
+    void put8_(std::string &out, std::uint8_t const value)
+    {
+        out.push_back(static_cast<char>(value));
+    }
+
+    void put16_(std::string &out, std::uint16_t const value)
+    {
+        put8_(out, static_cast<std::uint8_t>(value >> 8));
+        put8_(out, static_cast<std::uint8_t>(value));
+    }
+
+    void put24_(std::string &out, std::uint32_t const value)
+    {
+        put8_(out, static_cast<std::uint8_t>(value >> 16));
+        put16_(out, static_cast<std::uint16_t>(value));
+    }
+
+    void extension_(std::string &out, std::uint16_t const type, std::string const &data)
+    {
+        put16_(out, type);
+        put16_(out, static_cast<std::uint16_t>(data.size()));
+        out += data;
+    }
+
+    std::string list16_(std::vector<std::uint16_t> const &values, bool const prefix = true)
+    {
+        std::string out;
+        if (prefix)
+        {
+            put16_(out, static_cast<std::uint16_t>(values.size() * 2));
+        }
+        for (std::uint16_t const value : values)
+        {
+            put16_(out, value);
+        }
+        return out;
+    }
+
+    /**
+     * ClientHello handshake message with GREASE values
+     *
+     * JA3: 771,4865-4866-4867-49195-49199,0-11-10-16-13-43-21,29-23,0
+     */
+    std::string client_hello_(std::string const &server_name, std::size_t const padding = 16)
+    {
+        std::string body;
+        put16_(body, 0x0303);
+        body.append(32, '\x11');
+        put8_(body, 32);
+        body.append(32, '\x22');
+        body += list16_({0x0A0A, 0x1301, 0x1302, 0x1303, 0xC02B, 0xC02F});
+        put8_(body, 1);
+        put8_(body, 0);
+
+        std::string extensions;
+        extension_(extensions, 0x1A1A, "");
+        std::string sni;
+        put16_(sni, static_cast<std::uint16_t>(server_name.size() + 3));
+        put8_(sni, 0);
+        put16_(sni, static_cast<std::uint16_t>(server_name.size()));
+        sni += server_name;
+        extension_(extensions, 0x0000, sni);
+        extension_(extensions, 0x000B, std::string{"\x01\x00", 2});
+        extension_(extensions, 0x000A, list16_({0x2A2A, 0x001D, 0x0017}));
+        extension_(extensions, 0x0010, std::string{"\x00\x0c\x02h2\x08http/1.1", 14});
+        extension_(extensions, 0x000D, list16_({0x0403, 0x0804, 0x0401}));
+        std::string versions = list16_({0x3A3A, 0x0304, 0x0303}, false);
+        extension_(extensions, 0x002B, std::string(1, static_cast<char>(versions.size())) + versions);
+        extension_(extensions, 0x0015, std::string(padding, '\0'));
+        put16_(body, static_cast<std::uint16_t>(extensions.size()));
+        body += extensions;
+
+        std::string message;
+        put8_(message, 1);
+        put24_(message, static_cast<std::uint32_t>(body.size()));
+        return message + body;
+    }
+
+    // Handshake message split into TLS records of at most record_size bytes
+    std::string tls_records_(std::string const &message, std::size_t const record_size)
+    {
+        std::string records;
+        for (std::size_t offset = 0; offset < message.size(); offset += record_size)
+        {
+            std::string const fragment = message.substr(offset, record_size);
+            put8_(records, 22);
+            put16_(records, 0x0301);
+            put16_(records, static_cast<std::uint16_t>(fragment.size()));
+            records += fragment;
+        }
+        return records;
+    }
+
+    void varint_(std::string &out, std::size_t const value)
+    {
+        if (value < 64)
+        {
+            put8_(out, static_cast<std::uint8_t>(value));
+        }
+        else
+        {
+            put16_(out, static_cast<std::uint16_t>(0x4000 | value));
+        }
+    }
+
+    /**
+     * A client's QUIC version 1 Initial packet carrying CRYPTO frames, padded and protected like a client would
+     *
+     * @param[in] dcid Destination connection ID chosen by the client
+     * @param[in] frames Offsets and bytes of the CRYPTO frames
+     * @param[in] packet_number Packet number (sent in a single byte)
+     * @return The UDP payload
+     */
+    std::string quic_initial_(std::vector<std::uint8_t> const &dcid, std::vector<std::pair<std::size_t, std::string>> const &frames,
+                              std::uint8_t const packet_number)
+    {
+        std::string header;
+        put8_(header, 0xC0);
+        put16_(header, 0);
+        put16_(header, 1);
+        put8_(header, static_cast<std::uint8_t>(dcid.size()));
+        header.append(dcid.begin(), dcid.end());
+        put8_(header, 0);
+        varint_(header, 0);
+
+        std::string plaintext;
+        for (auto const &frame : frames)
+        {
+            put8_(plaintext, 0x06);
+            varint_(plaintext, frame.first);
+            varint_(plaintext, frame.second.size());
+            plaintext += frame.second;
+        }
+        // PADDING frames up to the minimum datagram size (2 bytes of length, 1 of packet number, 16 of tag)
+        std::size_t const minimum = overwatch::identify::QUIC_MIN_INITIAL_SIZE - header.size() - 2 - 1 - 16;
+        if (plaintext.size() < minimum)
+        {
+            plaintext.append(minimum - plaintext.size(), '\0');
+        }
+        put16_(header, static_cast<std::uint16_t>(0x4000 | (1 + plaintext.size() + 16)));
+        std::size_t const packet_number_offset = header.size();
+        put8_(header, packet_number);
+
+        overwatch::identify::QuicInitialKeys keys;
+        overwatch::identify::derive_initial_keys(dcid.data(), dcid.size(), keys);
+        overwatch::identify::Aes128 const cipher{keys.key};
+        std::uint8_t counter[16] = {};
+        std::memcpy(counter, keys.iv, 12);
+        counter[11] ^= packet_number;
+        std::string packet = header;
+        for (std::size_t offset = 0; offset < plaintext.size(); offset += 16)
+        {
+            std::uint32_t const block = static_cast<std::uint32_t>(offset / 16 + 2);
+            counter[14] = static_cast<std::uint8_t>(block >> 8);
+            counter[15] = static_cast<std::uint8_t>(block);
+            std::uint8_t keystream[16];
+            cipher.encrypt(counter, keystream);
+            for (std::size_t i = offset; i < std::min(offset + 16, plaintext.size()); ++i)
+            {
+                packet.push_back(static_cast<char>(plaintext[i] ^ keystream[i - offset]));
+            }
+        }
+        // The tag is not checked
+        packet.append(16, '\0');
+
+        std::uint8_t mask[16];
+        overwatch::identify::Aes128{keys.hp}.encrypt(data_(packet) + packet_number_offset + 4, mask);
+        packet[0] = static_cast<char>(packet[0] ^ (mask[0] & 0x0F));
+        packet[packet_number_offset] = static_cast<char>(packet[packet_number_offset] ^ mask[1]);
+        return packet;
+    }
+
+    std::string dns_name_(std::string const &name)
+    {
+        std::string out;
+        std::size_t start = 0;
+        while (start < name.size())
+        {
+            std::size_t end = name.find('.', start);
+            end = end == std::string::npos ? name.size() : end;
+            put8_(out, static_cast<std::uint8_t>(end - start));
+            out += name.substr(start, end - start);
+            start = end + 1;
+        }
+        put8_(out, 0);
+        return out;
+    }
+
+    std::string dns_query_(std::string const &name, std::uint16_t const type)
+    {
+        std::string message;
+        put16_(message, 0x1234);
+        put16_(message, 0x0100);
+        put16_(message, 1);
+        put16_(message, 0);
+        put16_(message, 0);
+        put16_(message, 0);
+        message += dns_name_(name);
+        put16_(message, type);
+        put16_(message, 1);
+        return message;
+    }
+
+    // Response with a CNAME, then an A and an AAAA record of the name it points to
+    std::string dns_response_(std::string const &name)
+    {
+        std::string message = dns_query_(name, overwatch::identify::DNS_TYPE_A);
+        message[2] = '\x81';
+        message[3] = '\x80';
+        message[7] = 3;
+        auto const record = [&message](std::uint16_t const pointer, std::uint16_t const type, std::string const &data) {
+            put16_(message, static_cast<std::uint16_t>(0xC000 | pointer));
+            put16_(message, type);
+            put16_(message, 1);
+            put16_(message, 0);
+            put16_(message, 300);
+            put16_(message, static_cast<std::uint16_t>(data.size()));
+            message += data;
+        };
+        std::size_t const cname = message.size() + 12;
+        record(12, 5, dns_name_("edge.example.net"));
+        std::vector<std::uint8_t> const ipv6 = bytes_("20010db8000000000000000000000042");
+        record(static_cast<std::uint16_t>(cname), overwatch::identify::DNS_TYPE_A, std::string{"\x5d\xb8\xd8\x22", 4});
+        record(static_cast<std::uint16_t>(cname), overwatch::identify::DNS_TYPE_AAAA, std::string(ipv6.begin(), ipv6.end()));
+        return message;
+    }
+
+    struct TestIdentify
+    {
+        overwatch::core::Pipeline pipeline;
+        std::vector<Identification> identified;
+        overwatch::identify::StreamIdentifier const *analyzer;
+        overwatch::identify::IdentifyStage const *stage;
+
+        TestIdentify()
+        {
+            auto const table =
+                std::make_shared<overwatch::core::LpmTable const>(common::utils::parse_ip_prefix_list("192.168.1.0/24"));
+            auto const sink = [this](Identification const &identification) { identified.push_back(identification); };
+            pipeline.add_stage(std::make_unique<overwatch::core::DecodeStage>());
+            pipeline.add_stage(std::make_unique<overwatch::core::ClassifyStage>(table));
+            pipeline.add_stage(std::make_unique<overwatch::core::FlowStage>(1024, 600 * SECOND_NS));
+            pipeline.add_stage(std::make_unique<overwatch::identify::IdentifyStage>(sink));
+            pipeline.add_stage(std::make_unique<overwatch::reassembly::ReassemblyStage>(
+                std::make_unique<overwatch::identify::StreamIdentifier>(sink)));
+            stage = pipeline.find_stage<overwatch::identify::IdentifyStage>();
+            analyzer = static_cast<overwatch::identify::StreamIdentifier const *>(
+                &pipeline.find_stage<overwatch::reassembly::ReassemblyStage>()->get_analyzer());
+        }
+
+        // Processes frames one at a time (they must stay alive while the reassembler may deliver them)
+        void feed(std::vector<fixtures::Frame> const &frames)
+        {
+            for (fixtures::Frame const &frame : frames)
+            {
+                overwatch::capture::PacketBatch batch;
+                batch.push_back(overwatch::capture::PacketView{frame.bytes.data(), static_cast<std::uint32_t>(frame.bytes.size()),
+                                                               static_cast<std::uint32_t>(frame.bytes.size()), frame.timestamp_ns});
+                pipeline.process(batch);
+            }
+        }
+    };
+
+    /**
+     * Frames of a TCP connection from a target (192.168.1.10) to a server (203.0.113.5)
+     */
+    class Connection
+    {
+    public:
+        Connection(std::uint16_t const client_port, std::uint16_t const server_port)
+            : client_port_{client_port}, server_port_{server_port}, client_seq_{1000}, server_seq_{5000}
+        {
+            add_(true, TCP_SYN, "");
+            ++client_seq_;
+            add_(false, TCP_SYN | TCP_ACK, "");
+            ++server_seq_;
+        }
+
+        void client(std::string const &payload)
+        {
+            add_(true, TCP_PSH | TCP_ACK, payload);
+            client_seq_ += static_cast<std::uint32_t>(payload.size());
+        }
+
+        void server(std::string const &payload)
+        {
+            add_(false, TCP_PSH | TCP_ACK, payload);
+            server_seq_ += static_cast<std::uint32_t>(payload.size());
+        }
+
+        std::vector<fixtures::Frame> frames;
+
+    private:
+        void add_(bool const from_client, std::uint8_t const flags, std::string const &payload)
+        {
+            std::vector<std::uint8_t> bytes =
+                from_client ? fixtures::tcp_frame("192.168.1.10", "203.0.113.5", client_port_, server_port_, client_seq_, flags,
+                                                  payload, server_seq_)
+                            : fixtures::tcp_frame("203.0.113.5", "192.168.1.10", server_port_, client_port_, server_seq_, flags,
+                                                  payload, client_seq_);
+            frames.push_back(fixtures::Frame{std::move(bytes), SECOND_NS + frames.size() * 1000});
+        }
+
+        std::uint16_t const client_port_;
+        std::uint16_t const server_port_;
+        std::uint32_t client_seq_;
+        std::uint32_t server_seq_;
+    };
+
+    void require_client_(Identification const &identification, std::uint16_t const client_port, std::uint16_t const server_port)
+    {
+        REQUIRE(common::utils::IpAddress::from_bytes(identification.key.src_addr) == common::utils::parse_ip_addr("192.168.1.10"));
+        REQUIRE(identification.key.src_port == client_port);
+        REQUIRE(identification.key.dst_port == server_port);
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Crypto primitives match their test vectors")
+{
+    std::uint8_t md5[overwatch::identify::MD5_SIZE];
+    overwatch::identify::md5(data_("abc"), 3, md5);
+    REQUIRE(hex_(md5, sizeof(md5)) == "900150983cd24fb0d6963f7d28e17f72");
+    std::string const long_text(1000, 'a');
+    overwatch::identify::md5(data_(long_text), long_text.size(), md5);
+    REQUIRE(hex_(md5, sizeof(md5)) == "cabe45dcc9ae5b66ba86600cca6b8ba8");
+
+    std::uint8_t sha256[overwatch::identify::SHA256_SIZE];
+    overwatch::identify::sha256(data_("abc"), 3, sha256);
+    REQUIRE(hex_(sha256, sizeof(sha256)) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    // Updates of any size hash like a single one
+    overwatch::identify::Sha256 hash;
+    for (std::size_t offset = 0; offset < long_text.size(); offset += 37)
+    {
+        hash.update(data_(long_text) + offset, std::min<std::size_t>(37, long_text.size() - offset));
+    }
+    hash.finish(sha256);
+    REQUIRE(hex_(sha256, sizeof(sha256)) == "41edece42d63e8d9bf515a9ba6932e1c20cbc9f5a5d134645adb5db1b9737ea3");
+
+    // RFC 4231 test case 2
+    overwatch::identify::hmac_sha256(data_("Jefe"), 4, data_("what do ya want for nothing?"), 28, sha256);
+    REQUIRE(hex_(sha256, sizeof(sha256)) == "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+    // FIPS 197 appendix C.1
+    std::vector<std::uint8_t> const key = bytes_("000102030405060708090a0b0c0d0e0f");
+    std::vector<std::uint8_t> const plaintext = bytes_("00112233445566778899aabbccddeeff");
+    std::uint8_t block[16];
+    overwatch::identify::Aes128{key.data()}.encrypt(plaintext.data(), block);
+    REQUIRE(hex_(block, sizeof(block)) == "69c4e0d86a7b0430d8cdb78070b4c55a");
+
+    // RFC 9001 appendix A.1 and A.2
+    std::vector<std::uint8_t> const dcid = bytes_("8394c8f03e515708");
+    overwatch::identify::QuicInitialKeys keys;
+    overwatch::identify::derive_initial_keys(dcid.data(), dcid.size(), keys);
+    REQUIRE(hex_(keys.key, sizeof(keys.key)) == "1f369613dd76d5467730efcbe3b1a22d");
+    REQUIRE(hex_(keys.iv, sizeof(keys.iv)) == "fa044b2f42a3fd3b46fb255c");
+    REQUIRE(hex_(keys.hp, sizeof(keys.hp)) == "9f50449e04a0e810283a1e9933adedd2");
+    std::vector<std::uint8_t> const sample = bytes_("d1b1c98dd7689fb8ec11d242b123dc9b");
+    overwatch::identify::Aes128{keys.hp}.encrypt(sample.data(), block);
+    REQUIRE(hex_(block, 5) == "437b9aec36");
+}
+
+TEST_CASE(TEST_NAME_PREFIX "DNS messages are parsed")
+{
+    overwatch::identify::DnsMessage message;
+    SECTION("Query")
+    {
+        std::string const query = dns_query_("www.example.com", overwatch::identify::DNS_TYPE_AAAA);
+        REQUIRE(overwatch::identify::parse_dns(data_(query), query.size(), message));
+        REQUIRE(std::string{message.name} == "www.example.com");
+        REQUIRE(message.type == overwatch::identify::DNS_TYPE_AAAA);
+        REQUIRE_FALSE(message.response);
+        REQUIRE(message.answer_count == 0);
+    }
+    SECTION("Response with compressed names")
+    {
+        std::string const response = dns_response_("www.example.com");
+        REQUIRE(overwatch::identify::parse_dns(data_(response), response.size(), message));
+        REQUIRE(std::string{message.name} == "www.example.com");
+        REQUIRE(message.response);
+        REQUIRE(message.rcode == 0);
+        REQUIRE(message.answer_count == 2);
+        REQUIRE(message.answers[0] == common::utils::parse_ip_addr("93.184.216.34"));
+        REQUIRE(message.answers[1] == common::utils::parse_ip_addr("2001:db8::42"));
+        // A truncated response keeps the answers before the cut
+        REQUIRE(overwatch::identify::parse_dns(data_(response), response.size() - 4, message));
+        REQUIRE(message.answer_count == 1);
+    }
+    SECTION("Not DNS")
+    {
+        std::string looping = dns_query_("a", 1);
+        // The name points at itself
+        looping.replace(12, 3, std::string{"\xC0\x0C", 2});
+        REQUIRE_FALSE(overwatch::identify::parse_dns(data_(looping), looping.size(), message));
+        std::string const text = "GET / HTTP/1.1\r\nHost: example.com\r\n\r\n";
+        REQUIRE_FALSE(overwatch::identify::parse_dns(data_(text), text.size(), message));
+        REQUIRE_FALSE(overwatch::identify::parse_dns(data_(text), 8, message));
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "ClientHellos are fingerprinted")
+{
+    std::string const message = client_hello_("www.example.com");
+    overwatch::identify::ClientHello hello;
+    REQUIRE(overwatch::identify::parse_client_hello(data_(message), message.size(), hello) == ParseResult::Complete);
+    REQUIRE(std::string{hello.server_name} == "www.example.com");
+    REQUIRE(std::string{hello.alpn} == "h2");
+    REQUIRE(hello.supported_version == 0x0304);
+
+    char ja3_text[overwatch::identify::JA3_MAX_SIZE + 1];
+    overwatch::identify::format_ja3(hello, ja3_text, sizeof(ja3_text));
+    REQUIRE(std::string{ja3_text} == "771,4865-4866-4867-49195-49199,0-11-10-16-13-43-21,29-23,0");
+    char ja3[overwatch::identify::JA3_HASH_SIZE + 1];
+    overwatch::identify::ja3(hello, ja3);
+    REQUIRE(std::string{ja3} == "ec070e6d8157ba55d09a769c5942e4b8");
+    char ja4[overwatch::identify::JA4_SIZE + 1];
+    overwatch::identify::ja4(hello, 't', ja4);
+    REQUIRE(std::string{ja4} == "t13d0507h2_e133e205ac38_80b502bd4a54");
+
+    // The server name is known before the end of the message
+    std::size_t const cut = message.find("www.example.com") + 15;
+    REQUIRE(overwatch::identify::parse_client_hello(data_(message), cut, hello) == ParseResult::Incomplete);
+    REQUIRE(std::string{hello.server_name} == "www.example.com");
+    REQUIRE(overwatch::identify::parse_client_hello(data_(message), cut - 1, hello) == ParseResult::Incomplete);
+    REQUIRE(std::string{hello.server_name}.empty());
+
+    std::string server_hello = message;
+    server_hello[0] = 2;
+    REQUIRE(overwatch::identify::parse_client_hello(data_(server_hello), server_hello.size(), hello) == ParseResult::Invalid);
+    // Extensions running past the end of the message
+    std::string corrupted = message;
+    corrupted[corrupted.size() - 17] = '\x7f';
+    REQUIRE(overwatch::identify::parse_client_hello(data_(corrupted), corrupted.size(), hello) == ParseResult::Invalid);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "HTTP request heads are parsed in any pieces")
+{
+    std::string const request = "POST /upload?x=1 HTTP/1.1\r\nContent-Length: 5\r\nHOST:  files.example.com \r\n"
+                                "User-Agent: curl/8.0\r\nAccept: */*\r\n\r\nhello";
+    HttpRequestParser parser;
+    std::size_t piece = 0;
+    SECTION("Whole")
+    {
+        piece = request.size();
+    }
+    SECTION("Byte by byte")
+    {
+        piece = 1;
+    }
+    SECTION("In uneven pieces")
+    {
+        piece = 7;
+    }
+    HttpRequestParser::Result result = HttpRequestParser::Result::NeedMore;
+    for (std::size_t offset = 0; offset < request.size() && result == HttpRequestParser::Result::NeedMore; offset += piece)
+    {
+        result = parser.feed(data_(request) + offset, std::min(piece, request.size() - offset));
+    }
+    REQUIRE(result == HttpRequestParser::Result::Done);
+    REQUIRE(std::string{parser.get_host()} == "files.example.com");
+    REQUIRE(std::string{parser.get_user_agent()} == "curl/8.0");
+
+    for (std::string const other : {"SSH-2.0-OpenSSH_9.0\r\n", "GETS / HTTP/1.1\r\n", "GET / SIP/2.0\r\n", "\x16\x03\x01"})
+    {
+        parser.reset();
+        REQUIRE(parser.feed(data_(other), other.size()) == HttpRequestParser::Result::NotHttp);
+    }
+    // Endless headers stop at the limit with what was found
+    parser.reset();
+    std::string const head = "GET / HTTP/1.0\r\nHost: example.com\r\nX: " + std::string(10000, 'x');
+    REQUIRE(parser.feed(data_(head), head.size()) == HttpRequestParser::Result::Done);
+    REQUIRE(std::string{parser.get_host()} == "example.com");
+}
+
+TEST_CASE(TEST_NAME_PREFIX "The targets' TLS and HTTP clients are identified")
+{
+    std::string const message = client_hello_("www.example.com", 1500);
+    std::vector<Connection> connections;
+    // ClientHello in a single segment
+    connections.emplace_back(40001, 443);
+    connections.back().client(tls_records_(message, 16384));
+    connections.back().server(std::string{"\x16\x03\x03\x00\x10", 5} + std::string(16, 'S'));
+    // Over two records and three segments
+    connections.emplace_back(40002, 8443);
+    std::string const records = tls_records_(message, 600);
+    connections.back().client(records.substr(0, 3));
+    connections.back().client(records.substr(3, 700));
+    connections.back().client(records.substr(703));
+    // Request split in the middle of the Host header
+    connections.emplace_back(40003, 80);
+    connections.back().client("GET /index.html HTTP/1.1\r\nHo");
+    connections.back().client("st: www.example.org\r\nUser-Agent: Mozilla/5.0\r\n\r\n");
+    // Neither TLS nor HTTP
+    connections.emplace_back(40004, 22);
+    connections.back().server("SSH-2.0-OpenSSH_9.0\r\n");
+    connections.back().client("GET / HTTP/1.1\r\nHost: not.identified\r\n\r\n");
+    connections.emplace_back(40005, 25);
+    connections.back().client(std::string(100, '\x16'));
+
+    TestIdentify test;
+    for (Connection const &connection : connections)
+    {
+        test.feed(connection.frames);
+    }
+    REQUIRE(test.identified.size() == 3);
+    Identification const &single = test.identified[0];
+    REQUIRE(single.protocol == Protocol::Tls);
+    REQUIRE(single.complete);
+    require_client_(single, 40001, 443);
+    REQUIRE(std::string{single.name} == "www.example.com");
+    REQUIRE(std::string{single.alpn} == "h2");
+    REQUIRE(std::string{single.ja3} == "ec070e6d8157ba55d09a769c5942e4b8");
+    REQUIRE(std::string{single.ja4} == "t13d0507h2_e133e205ac38_80b502bd4a54");
+    Identification const &split = test.identified[1];
+    require_client_(split, 40002, 8443);
+    REQUIRE(split.complete);
+    REQUIRE(std::string{split.ja4} == single.ja4);
+    Identification const &http = test.identified[2];
+    REQUIRE(http.protocol == Protocol::Http);
+    require_client_(http, 40003, 80);
+    REQUIRE(std::string{http.name} == "www.example.org");
+    REQUIRE(std::string{http.user_agent} == "Mozilla/5.0");
+
+    REQUIRE(test.analyzer->get_identified(Protocol::Tls) == 2);
+    REQUIRE(test.analyzer->get_identified(Protocol::Http) == 1);
+    // Identified streams are no longer reassembled
+    REQUIRE(test.pipeline.find_stage<overwatch::reassembly::ReassemblyStage>()->get_reassembler().get_buffered_bytes() == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Sessions are bounded")
+{
+    // Every stream stops in the middle of its ClientHello, after the server name
+    std::string const records = tls_records_(client_hello_("bounded.example.com", 2000), 16384);
+    std::vector<Connection> connections;
+    connections.reserve(257);
+    for (std::uint16_t i = 0; i < 257; ++i)
+    {
+        connections.emplace_back(static_cast<std::uint16_t>(20000 + i), 443);
+        connections.back().client(records.substr(0, 400));
+    }
+    TestIdentify test;
+    for (Connection const &connection : connections)
+    {
+        test.feed(connection.frames);
+    }
+    // The stream without a session is reported right away from its first bytes
+    REQUIRE(test.analyzer->get_session_drops() == 1);
+    REQUIRE(test.identified.size() == 1);
+    REQUIRE(test.identified[0].key.src_port == 20256);
+    REQUIRE_FALSE(test.identified[0].complete);
+    REQUIRE(std::string{test.identified[0].name} == "bounded.example.com");
+
+    // The others once their streams end
+    test.pipeline.flush();
+    REQUIRE(test.identified.size() == 257);
+    for (Identification const &identification : test.identified)
+    {
+        REQUIRE_FALSE(identification.complete);
+        REQUIRE(std::string{identification.name} == "bounded.example.com");
+        REQUIRE(std::string{identification.ja4}.substr(0, 4) == "t13d");
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "DNS messages and QUIC Initial packets are identified")
+{
+    std::vector<fixtures::Frame> frames;
+    auto const udp = [&frames](bool const from_target, std::uint16_t const target_port, std::uint16_t const server_port,
+                               std::string const &payload) {
+        std::vector<std::uint8_t> bytes = from_target
+                                              ? fixtures::udp_frame("192.168.1.10", "203.0.113.5", target_port, server_port, payload)
+                                              : fixtures::udp_frame("203.0.113.5", "192.168.1.10", server_port, target_port, payload);
+        frames.push_back(fixtures::Frame{std::move(bytes), SECOND_NS + frames.size() * 1000});
+    };
+    udp(true, 50000, 53, dns_query_("www.example.com", overwatch::identify::DNS_TYPE_A));
+    udp(false, 50000, 53, dns_response_("www.example.com"));
+
+    std::vector<std::uint8_t> const dcid = bytes_("0011223344556677");
+    std::string const message = client_hello_("quic.example.com", 1200);
+    // A ClientHello spanning two Initial packets, the second one captured first
+    udp(true, 50001, 443, quic_initial_(dcid, {{1000, message.substr(1000)}}, 1));
+    udp(true, 50001, 443, quic_initial_(dcid, {{0, message.substr(0, 1000)}}, 0));
+    // A retransmission of the first packet identifies nothing more
+    udp(true, 50001, 443, quic_initial_(dcid, {{0, message.substr(0, 1000)}}, 2));
+    // A server protects its Initial packets with its own keys, they decrypt into garbage
+    std::string server_initial = quic_initial_(bytes_("8899aabbccddeeff"), {{0, message.substr(0, 500)}}, 0);
+    server_initial.replace(6, 8, "\x01\x02\x03\x04\x05\x06\x07\x08");
+    udp(false, 50002, 443, server_initial);
+    // Not a target
+    frames.push_back(fixtures::Frame{
+        fixtures::udp_frame("10.0.0.1", "10.0.0.2", 50003, 53, dns_query_("other.example.com", 1)), 2 * SECOND_NS});
+
+    TestIdentify test;
+    test.feed(frames);
+    REQUIRE(test.identified.size() == 3);
+    Identification const &query = test.identified[0];
+    REQUIRE(query.protocol == Protocol::Dns);
+    require_client_(query, 50000, 53);
+    REQUIRE(std::string{query.name} == "www.example.com");
+    REQUIRE_FALSE(query.dns_response);
+    Identification const &response = test.identified[1];
+    require_client_(response, 50000, 53);
+    REQUIRE(response.dns_response);
+    REQUIRE(response.answer_count == 2);
+    REQUIRE(response.answers[0] == common::utils::parse_ip_addr("93.184.216.34"));
+
+    Identification const &quic = test.identified[2];
+    REQUIRE(quic.protocol == Protocol::Quic);
+    REQUIRE(quic.complete);
+    require_client_(quic, 50001, 443);
+    REQUIRE(std::string{quic.name} == "quic.example.com");
+    REQUIRE(std::string{quic.ja4}.substr(0, 11) == "q13d0507h2_");
+    REQUIRE(std::string{quic.ja4}.substr(10) == "_e133e205ac38_80b502bd4a54");
+    REQUIRE(test.stage->get_identified(Protocol::Dns) == 2);
+    REQUIRE(test.stage->get_identified(Protocol::Quic) == 1);
+
+    // A ClientHello whose second packet never comes is reported when the stage flushes
+    std::vector<fixtures::Frame> const partial{
+        fixtures::Frame{fixtures::udp_frame("192.168.1.10", "203.0.113.5", 50004, 443,
+                                            quic_initial_(dcid, {{0, message.substr(0, 1000)}}, 0)),
+                        2 * SECOND_NS}};
+    test.feed(partial);
+    REQUIRE(test.identified.size() == 3);
+    test.pipeline.flush();
+    REQUIRE(test.identified.size() == 4);
+    REQUIRE_FALSE(test.identified[3].complete);
+    REQUIRE(std::string{test.identified[3].name} == "quic.example.com");
+}
@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <regex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "automaton.hpp"
+#include "identifier.hpp"
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+#include "matcher.hpp"
+#include "pcap_fixture.hpp"
+#include "pipeline.hpp"
+#include "prefilter.hpp"
+#include "rule_set.hpp"
+#include "tcp_reassembler.hpp"
+
+#define TEST_NAME_PREFIX "Rules::"
+#define SECOND_NS 1000000000ULL
+
+#define TCP_SYN 0x02
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+
+using overwatch::rules::Match;
+using overwatch::rules::PatternType;
+using overwatch::rules::Rule;
+using overwatch::rules::RuleSet;
+
+namespace
+{
+    // Rule index and offset following the match
+    using Matches = std::set<std::pair<std::uint32_t, std::uint64_t>>;
+
+    std::uint8_t const *data_(std::string const &text)
+    {
+        return reinterpret_cast<std::uint8_t const *>(text.data());
+    }
+
+    std::vector<Rule> parse_rules_(std::vector<std::string> const &lines)
+    {
+        std::vector<Rule> rules;
+        for (std::string const &line : lines)
+        {
+            rules.push_back(overwatch::rules::parse_rule(line));
+        }
+        return rules;
+    }
+
+    // Scans a text in chunks of the given sizes (the last one repeated until the end)
+    Matches scan_(RuleSet const &rules, std::string const &text, std::vector<std::size_t> const &chunks = {SIZE_MAX})
+    {
+        Matches matches;
+        overwatch::rules::ScanState state;
+        rules.start(state);
+        std::size_t offset = 0;
+        for (std::size_t chunk = 0; offset < text.size(); ++chunk)
+        {
+            std::size_t const size = std::min(chunks[std::min(chunk, chunks.size() - 1)], text.size() - offset);
+            rules.scan(state, data_(text) + offset, size, [&](std::uint32_t const rule, std::size_t const end) {
+                matches.emplace(rule, offset + end);
+            });
+            offset += size;
+        }
+        return matches;
+    }
+
+    bool matches_rule_(RuleSet const &rules, std::string const &text, std::string const &name)
+    {
+        for (auto const &match : scan_(rules, text))
+        {
+            if (rules.get_rule(match.first).name == name)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    char fold_(char const c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+
+    // Every occurrence of every rule, searched naively
+    Matches reference_(std::vector<Rule> const &rules, std::string const &text)
+    {
+        Matches matches;
+        for (std::uint32_t index = 0; index < rules.size(); ++index)
+        {
+            Rule const &rule = rules[index];
+            if (rule.type == PatternType::Literal)
+            {
+                for (std::size_t start = 0; start + rule.pattern.size() <= text.size(); ++start)
+                {
+                    bool found = true;
+                    for (std::size_t i = 0; i < rule.pattern.size() && found; ++i)
+                    {
+                        found = rule.nocase ? fold_(text[start + i]) == fold_(rule.pattern[i]) : text[start + i] == rule.pattern[i];
+                    }
+                    if (found)
+                    {
+                        matches.emplace(index, start + rule.pattern.size());
+                    }
+                }
+                continue;
+            }
+            // An occurrence ends where the expression matches a suffix of the text read so far
+            bool const anchored = rule.pattern[0] == '^';
+            std::regex const regex{(anchored ? "^(?:" + rule.pattern.substr(1) : "(?:" + rule.pattern) + ")$",
+                                   rule.nocase ? std::regex::ECMAScript | std::regex::icase : std::regex::ECMAScript};
+            for (std::size_t end = 1; end <= text.size(); ++end)
+            {
+                if (std::regex_search(text.begin(), text.begin() + end, regex))
+                {
+                    matches.emplace(index, end);
+                }
+            }
+        }
+        return matches;
+    }
+
+    // Groups are not repeated without bound, std::regex would backtrack for ages on (.*c*)+
+    std::string random_regex_(std::mt19937 &random, bool const nested = false)
+    {
+        static char const *const atoms[] = {"a", "b", "c", "B", ".", "[ab]", "[^a]", "\\x63", "[b-d]"};
+        static char const *const quantifiers[] = {"", "", "", "?", "{2}", "{1,3}", "*", "+"};
+        std::string regex;
+        int const length = std::uniform_int_distribution<int>{1, 3}(random);
+        for (int i = 0; i < length; ++i)
+        {
+            if (!nested && random() % 5 == 0)
+            {
+                regex += "(" + random_regex_(random, true) + "|" + random_regex_(random, true) + ")";
+                regex += quantifiers[random() % 6];
+            }
+            else
+            {
+                regex += atoms[random() % (sizeof(atoms) / sizeof(atoms[0]))];
+                regex += quantifiers[random() % (sizeof(quantifiers) / sizeof(quantifiers[0]))];
+            }
+        }
+        return regex;
+    }
+
+    std::string random_text_(std::mt19937 &random, std::size_t const size, std::string const &alphabet)
+    {
+        std::string text;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            text.push_back(alphabet[random() % alphabet.size()]);
+        }
+        return text;
+    }
+
+    /**
+     * Pipeline matching the rules against the traffic of 192.168.1.0/24 and identifying it
+     */
+    struct TestMatch
+    {
+        overwatch::core::Pipeline pipeline;
+        std::vector<Match> matches;
+        std::vector<overwatch::identify::Identification> identified;
+        overwatch::rules::StreamMatcher const *matcher;
+        overwatch::rules::MatchStage const *stage;
+
+        explicit TestMatch(std::shared_ptr<RuleSet const> const &rules)
+        {
+            auto const table =
+                std::make_shared<overwatch::core::LpmTable const>(common::utils::parse_ip_prefix_list("192.168.1.0/24"));
+            auto const sink = [this](Match const &match) { matches.push_back(match); };
+            auto const identify = [this](overwatch::identify::Identification const &identification) {
+                identified.push_back(identification);
+            };
+            pipeline.add_stage(std::make_unique<overwatch::core::DecodeStage>());
+            pipeline.add_stage(std::make_unique<overwatch::core::ClassifyStage>(table));
+            pipeline.add_stage(std::make_unique<overwatch::core::FlowStage>(1024, 600 * SECOND_NS));
+            pipeline.add_stage(std::make_unique<overwatch::rules::MatchStage>(rules, sink));
+            std::vector<std::unique_ptr<overwatch::reassembly::StreamAnalyzer>> analyzers;
+            analyzers.push_back(std::make_unique<overwatch::identify::StreamIdentifier>(identify));
+            analyzers.push_back(std::make_unique<overwatch::rules::StreamMatcher>(rules, sink));
+            pipeline.add_stage(std::make_unique<overwatch::reassembly::ReassemblyStage>(
+                std::make_unique<overwatch::reassembly::AnalyzerChain>(std::move(analyzers))));
+            stage = pipeline.find_stage<overwatch::rules::MatchStage>();
+            auto const &chain = static_cast<overwatch::reassembly::AnalyzerChain const &>(
+                pipeline.find_stage<overwatch::reassembly::ReassemblyStage>()->get_analyzer());
+            matcher = static_cast<overwatch::rules::StreamMatcher const *>(chain.get_analyzers()[1].get());
+        }
+
+        // Processes frames one at a time (they must stay alive while the reassembler may deliver them)
+        void feed(std::vector<fixtures::Frame> const &frames)
+        {
+            for (fixtures::Frame const &frame : frames)
+            {
+                overwatch::capture::PacketBatch batch;
+                batch.push_back(overwatch::capture::PacketView{frame.bytes.data(), static_cast<std::uint32_t>(frame.bytes.size()),
+                                                               static_cast<std::uint32_t>(frame.bytes.size()), frame.timestamp_ns});
+                pipeline.process(batch);
+            }
+        }
+    };
+
+    /**
+     * Frames of a TCP connection from a target (192.168.1.10) to a server (203.0.113.5)
+     */
+    class Connection
+    {
+    public:
+        explicit Connection(std::uint16_t const client_port)
+            : client_port_{client_port}, client_seq_{1000}, server_seq_{5000}
+        {
+            add_(true, TCP_SYN, "");
+            ++client_seq_;
+            add_(false, TCP_SYN | TCP_ACK, "");
+            ++server_seq_;
+        }
+
+        void client(std::string const &payload)
+        {
+            add_(true, TCP_PSH | TCP_ACK, payload);
+            client_seq_ += static_cast<std::uint32_t>(payload.size());
+        }
+
+        void server(std::string const &payload)
+        {
+            add_(false, TCP_PSH | TCP_ACK, payload);
+            server_seq_ += static_cast<std::uint32_t>(payload.size());
+        }
+
+        // Bytes of the client the capture missed but the server acknowledges
+        void lose_client(std::size_t const size)
+        {
+            client_seq_ += static_cast<std::uint32_t>(size);
+            add_(false, TCP_ACK, "");
+        }
+
+        std::vector<fixtures::Frame> frames;
+
+    private:
+        void add_(bool const from_client, std::uint8_t const flags, std::string const &payload)
+        {
+            std::vector<std::uint8_t> bytes =
+                from_client ? fixtures::tcp_frame("192.168.1.10", "203.0.113.5", client_port_, 80, client_seq_, flags, payload,
+                                                  server_seq_)
+                            : fixtures::tcp_frame("203.0.113.5", "192.168.1.10", 80, client_port_, server_seq_, flags, payload,
+                                                  client_seq_);
+            frames.push_back(fixtures::Frame{std::move(bytes), SECOND_NS + frames.size() * 1000});
+        }
+
+        std::uint16_t const client_port_;
+        std::uint32_t client_seq_;
+        std::uint32_t server_seq_;
+    };
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Rules are parsed")
+{
+    Rule const literal = overwatch::rules::parse_rule("  eicar:1 \"X5O!\\x50%@\\\"\\\\\\r\\n\\0\"  ");
+    REQUIRE(literal.name == "eicar:1");
+    REQUIRE(literal.type == PatternType::Literal);
+    REQUIRE(literal.pattern == std::string{"X5O!P%@\"\\\r\n\0", 12});
+    REQUIRE_FALSE(literal.nocase);
+
+    Rule const regex = overwatch::rules::parse_rule("wp-login.regex\t/^POST \\/wp-login\\.php/i");
+    REQUIRE(regex.type == PatternType::Regex);
+    REQUIRE(regex.pattern == "^POST /wp-login\\.php");
+    REQUIRE(regex.nocase);
+
+    for (char const *const invalid : {"", "no-pattern", "bad!name \"x\"", "empty \"\"", "open \"abc", "escape \"\\q\"",
+                                      "hex \"\\x4\"", "open /abc", "flags \"abc\"x", "unquoted abc"})
+    {
+        INFO(invalid);
+        REQUIRE_THROWS_AS(overwatch::rules::parse_rule(invalid), std::invalid_argument);
+    }
+
+    std::filesystem::path const path = fixtures::temp_path("rules.txt");
+    std::ofstream{path} << "# Signatures\n\nfirst \"abc\"\n   # indented comment\nsecond /a+b/i\n";
+    std::vector<Rule> const rules = overwatch::rules::read_rules(path.string());
+    REQUIRE(rules.size() == 2);
+    REQUIRE(rules[1].name == "second");
+
+    std::ofstream{path} << "first \"abc\"\nsecond abc\n";
+    REQUIRE_THROWS_WITH(overwatch::rules::read_rules(path.string()), Catch::Contains("line 2"));
+    std::filesystem::remove(path);
+    REQUIRE_THROWS_AS(overwatch::rules::read_rules(path.string()), std::invalid_argument);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Invalid rule sets are rejected")
+{
+    REQUIRE_THROWS_AS(RuleSet{{}}, std::invalid_argument);
+    REQUIRE_THROWS_AS(RuleSet{parse_rules_({"same \"a\"", "same \"b\""})}, std::invalid_argument);
+    for (char const *const invalid : {"/(ab/", "/ab)/", "/*a/", "/a{2,1}/", "/a{1001}/", "/[b-a]/", "/[ab/", "/a$/",
+                                      "/a^b/", "/\\q/", "/a*/", "/(a|)/", "/a|b?/"})
+    {
+        INFO(invalid);
+        REQUIRE_THROWS_AS(RuleSet{parse_rules_({std::string{"rule "} + invalid})}, std::invalid_argument);
+    }
+    // The DFA has to remember the last 21 bytes
+    REQUIRE_THROWS_WITH(RuleSet{parse_rules_({"explosive /a[ab]{20}/"})}, Catch::Contains("too complex"));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Regular expressions follow their syntax")
+{
+    RuleSet const rules{parse_rules_({
+        "class /x[a-c_]y/",
+        "negated /n[^0-9]n/",
+        "digits /\\d{3}-\\d{4}/",
+        "word /\\w+@\\w+\\.com/",
+        "space /k\\sv/",
+        "bounded /zz(ab){2,3}zz/",
+        "alternation /(?:GET|POST) \\//",
+        "anchored /^SSH-/",
+        "nocase /hello world/i",
+        "binary /\\x00\\xff\\x80/",
+        "escaped /a\\.b\\*c/",
+    })};
+    REQUIRE(matches_rule_(rules, "..xby..", "class"));
+    REQUIRE(matches_rule_(rules, "x_y", "class"));
+    REQUIRE_FALSE(matches_rule_(rules, "xdy", "class"));
+    REQUIRE(matches_rule_(rules, "nan", "negated"));
+    REQUIRE_FALSE(matches_rule_(rules, "n5n", "negated"));
+    REQUIRE(matches_rule_(rules, "call 555-0100 now", "digits"));
+    REQUIRE_FALSE(matches_rule_(rules, "55-0100", "digits"));
+    REQUIRE(matches_rule_(rules, "mail bob@example.com", "word"));
+    REQUIRE(matches_rule_(rules, "k\tv", "space"));
+    REQUIRE_FALSE(matches_rule_(rules, "k_v", "space"));
+    REQUIRE(matches_rule_(rules, "zzababzz", "bounded"));
+    REQUIRE(matches_rule_(rules, "zzabababzz", "bounded"));
+    REQUIRE_FALSE(matches_rule_(rules, "zzabzz", "bounded"));
+    REQUIRE_FALSE(matches_rule_(rules, "zzababababzz", "bounded"));
+    REQUIRE(matches_rule_(rules, "POST /login", "alternation"));
+    REQUIRE(matches_rule_(rules, "SSH-2.0-OpenSSH", "anchored"));
+    REQUIRE_FALSE(matches_rule_(rules, " SSH-2.0-OpenSSH", "anchored"));
+    REQUIRE(matches_rule_(rules, "say HeLLo WORLD", "nocase"));
+    REQUIRE(matches_rule_(rules, std::string{"\x01\x00\xff\x80", 4}, "binary"));
+    REQUIRE(matches_rule_(rules, "a.b*c", "escaped"));
+    REQUIRE_FALSE(matches_rule_(rules, "axb*c", "escaped"));
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Every occurrence is found in whole or in chunks")
+{
+    std::mt19937 random{42};
+    for (int round = 0; round < 40; ++round)
+    {
+        std::vector<Rule> rules;
+        for (int i = 0; i < 12; ++i)
+        {
+            std::string const name = "rule" + std::to_string(i);
+            bool const nocase = random() % 3 == 0;
+            if (i % 3 == 2)
+            {
+                std::string source = random_regex_(random);
+                if (random() % 4 == 0)
+                {
+                    source = "^" + source;
+                }
+                rules.push_back(Rule{name, PatternType::Regex, source, nocase});
+                // Expressions matching the empty string are rejected, replace them
+                try
+                {
+                    RuleSet{{rules.back()}};
+                }
+                catch (std::invalid_argument const &)
+                {
+                    rules.back() = Rule{name, PatternType::Regex, "cab", nocase};
+                }
+            }
+            else
+            {
+                std::size_t const size = 1 + random() % 5;
+                rules.push_back(Rule{name, PatternType::Literal, random_text_(random, size, "abcdB"), nocase});
+            }
+        }
+        RuleSet const rule_set{rules};
+        std::string const text = random_text_(random, 48, "abcdAB");
+        Matches const expected = reference_(rules, text);
+        INFO("round " << round << " text " << text);
+        REQUIRE(scan_(rule_set, text) == expected);
+        REQUIRE(scan_(rule_set, text, {1}) == expected);
+        REQUIRE(scan_(rule_set, text, {3, 7, 1, 13}) == expected);
+    }
+}
+
+TEST_CASE(TEST_NAME_PREFIX "The prefilter skips bytes without missing a literal")
+{
+    std::mt19937 random{7};
+    std::vector<Rule> rules;
+    for (int i = 0; i < 300; ++i)
+    {
+        std::size_t const size = 2 + random() % 8;
+        rules.push_back(Rule{"literal" + std::to_string(i), PatternType::Literal,
+                             random_text_(random, size, "abcdefghijklmnopqrstuvwxyz0123456789"), i % 5 == 0});
+    }
+    RuleSet const rule_set{rules};
+    std::vector<overwatch::rules::Literal> literals;
+    for (std::uint32_t i = 0; i < rules.size(); ++i)
+    {
+        literals.push_back(overwatch::rules::Literal{rules[i].pattern, i});
+    }
+    REQUIRE(overwatch::rules::Automaton{overwatch::rules::build_literal_dfa(literals, false)}.has_prefilter());
+    for (int round = 0; round < 20; ++round)
+    {
+        // Mostly bytes no literal contains, so the prefilter has long runs to skip
+        std::string text = random_text_(random, 4096, "!\"#$%&'()*+,-./:;<=>?@[]^_`{|}~ \t\r\n");
+        for (int i = 0; i < 40; ++i)
+        {
+            Rule const &rule = rules[random() % rules.size()];
+            text.replace(random() % (text.size() - rule.pattern.size()), rule.pattern.size(), rule.pattern);
+        }
+        Matches const expected = reference_(rules, text);
+        REQUIRE(expected.size() >= 30);
+        REQUIRE(scan_(rule_set, text) == expected);
+        REQUIRE(scan_(rule_set, text, {61, 1, 200}) == expected);
+    }
+
+    // Candidates are the positions where the leading bytes of a pattern could start
+    overwatch::rules::ByteSet a;
+    a.set('a');
+    overwatch::rules::ByteSet b;
+    b.set('b');
+    overwatch::rules::Prefilter const prefilter{{{a, b}, {b}}};
+    REQUIRE(prefilter.get_window() == 2);
+    std::string const text = std::string(100, 'x') + "ab" + std::string(100, 'x');
+    REQUIRE(prefilter.find(data_(text), text.size()) == 100);
+    REQUIRE(prefilter.find(data_(text) + 102, 98) == 97);
+    REQUIRE(prefilter.find(data_(text), 0) == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "The targets' streams and datagrams are matched")
+{
+    auto const rules = std::make_shared<RuleSet const>(parse_rules_({
+        "passwd \"/etc/passwd\"",
+        "admin /user=admin&pass(word)?=/i",
+        "banner /^HTTP\\/1\\.[01] 500/",
+        "dns-tunnel \"tunnel\"",
+    }));
+    TestMatch test{rules};
+
+    // The patterns straddle segments
+    Connection split{40001};
+    split.client("GET /../../etc/pas");
+    split.client("swd HTTP/1.1\r\nHost: www.example.org\r\n\r\n");
+    split.client("POST /login HTTP/1.1\r\n\r\nUSER=Admin&Pass");
+    split.client("word=secret /etc/passwd");
+    split.server("HTTP/1.1 500 Internal Server Error\r\n\r\n");
+    test.feed(split.frames);
+    // Bytes lost before an anchored pattern or in the middle of one do not match
+    Connection lossy{40002};
+    lossy.client("GET /etc/pa");
+    lossy.lose_client(10);
+    lossy.client("sswd");
+    test.feed(lossy.frames);
+    // Datagrams are matched on their own
+    std::vector<fixtures::Frame> datagrams;
+    datagrams.push_back(fixtures::Frame{fixtures::udp_frame("192.168.1.10", "203.0.113.5", 50000, 53, "xx.tunnel.tunnel.example"),
+                                        2 * SECOND_NS});
+    datagrams.push_back(fixtures::Frame{fixtures::udp_frame("192.168.1.10", "203.0.113.5", 50000, 53, "tun"), 2 * SECOND_NS});
+    datagrams.push_back(fixtures::Frame{fixtures::udp_frame("192.168.1.10", "203.0.113.5", 50000, 53, "nel"), 2 * SECOND_NS});
+    datagrams.push_back(fixtures::Frame{fixtures::udp_frame("10.0.0.1", "10.0.0.2", 50000, 53, "tunnel"), 2 * SECOND_NS});
+    test.feed(datagrams);
+
+    REQUIRE(test.matches.size() == 4);
+    std::string const request = "GET /../../etc/passwd";
+    REQUIRE(rules->get_rule(test.matches[0].rule).name == "passwd");
+    REQUIRE(test.matches[0].offset == request.size());
+    REQUIRE(common::utils::IpAddress::from_bytes(test.matches[0].key.src_addr) == common::utils::parse_ip_addr("192.168.1.10"));
+    REQUIRE(test.matches[0].key.src_port == 40001);
+    // A rule is reported once per stream
+    REQUIRE(rules->get_rule(test.matches[1].rule).name == "admin");
+    Match const &banner = test.matches[2];
+    REQUIRE(rules->get_rule(banner.rule).name == "banner");
+    REQUIRE(banner.key.src_port == 80);
+    REQUIRE(banner.key.dst_port == 40001);
+    REQUIRE(banner.offset == 12);
+    REQUIRE(rules->get_rule(test.matches[3].rule).name == "dns-tunnel");
+    REQUIRE(test.matches[3].offset == 9);
+
+    REQUIRE(test.matcher->get_matches() == 3);
+    REQUIRE(test.stage->get_matches() == 1);
+    REQUIRE(test.stage->get_scanned_bytes() == 24 + 3 + 3);
+    // The identifier still sees the streams it shares with the matcher
+    REQUIRE_FALSE(test.identified.empty());
+    REQUIRE(std::string{test.identified[0].name} == "www.example.org");
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Streams matching many rules are dropped")
+{
+    std::vector<std::string> lines;
+    std::string payload;
+    for (std::size_t i = 0; i < overwatch::rules::MAX_STREAM_MATCHES + 2; ++i)
+    {
+        lines.push_back("rule" + std::to_string(i) + " \"<" + std::to_string(i) + ">\"");
+        payload += "<" + std::to_string(i) + ">";
+    }
+    auto const rules = std::make_shared<RuleSet const>(parse_rules_(lines));
+    TestMatch test{rules};
+    Connection connection{40003};
+    connection.server("SSH-2.0-server\r\n");
+    connection.client(payload);
+    connection.client(payload);
+    test.feed(connection.frames);
+    REQUIRE(test.matches.size() == overwatch::rules::MAX_STREAM_MATCHES);
+    // The identifier gave up on the stream at its first bytes, the matcher after its last match
+    REQUIRE(test.matcher->get_scanned_bytes() == 16 + payload.size());
+}
@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+
+#include "count_min.hpp"
+#include "hyperloglog.hpp"
+#include "ip_address.hpp"
+#include "lpm_table.hpp"
+#include "pcap_fixture.hpp"
+#include "pipeline.hpp"
+#include "space_saving.hpp"
+#include "target_summary.hpp"
+
+#define TEST_NAME_PREFIX "Sketch::"
+#define SECOND_NS 1000000000ULL
+
+using overwatch::sketch::CountMinSketch;
+using overwatch::sketch::HyperLogLog;
+using overwatch::sketch::SpaceSaving;
+using overwatch::sketch::Summarizer;
+using overwatch::sketch::TargetSketch;
+using overwatch::sketch::TargetSummary;
+
+namespace
+{
+    /**
+     * Pipeline of a worker sketching the traffic of two targets, 192.168.1.10 and 192.168.1.20
+     */
+    class TestWorker
+    {
+    public:
+        explicit TestWorker(Summarizer &summarizer)
+        {
+            auto const table =
+                std::make_shared<overwatch::core::LpmTable const>(common::utils::parse_ip_prefix_list("192.168.1.10,192.168.1.20"));
+            pipeline_.add_stage(std::make_unique<overwatch::core::DecodeStage>());
+            pipeline_.add_stage(std::make_unique<overwatch::core::ClassifyStage>(table));
+            pipeline_.add_stage(std::make_unique<overwatch::core::FlowStage>(1024, 600 * SECOND_NS));
+            pipeline_.add_stage(std::make_unique<overwatch::sketch::SummaryStage>(summarizer));
+        }
+
+        // Sends a UDP datagram of 100 bytes of payload (142 bytes on the wire)
+        void udp(std::string const &src, std::string const &dst, std::uint16_t const src_port, std::uint16_t const dst_port,
+                 std::uint64_t const timestamp_ns)
+        {
+            std::vector<std::uint8_t> const frame = fixtures::udp_frame(src, dst, src_port, dst_port, std::string(100, 'x'));
+            overwatch::capture::PacketBatch batch;
+            batch.push_back(overwatch::capture::PacketView{frame.data(), static_cast<std::uint32_t>(frame.size()),
+                                                           static_cast<std::uint32_t>(frame.size()), timestamp_ns});
+            pipeline_.process(batch);
+        }
+
+        void flush()
+        {
+            pipeline_.flush();
+        }
+
+        overwatch::sketch::SummaryStage const &get_stage() const
+        {
+            return *pipeline_.find_stage<overwatch::sketch::SummaryStage>();
+        }
+
+    private:
+        overwatch::core::Pipeline pipeline_;
+    };
+
+    std::string peer_(overwatch::sketch::PeerBytes const &peer)
+    {
+        return common::utils::to_string(common::utils::IpAddress::from_bytes(peer.address));
+    }
+
+    overwatch::sketch::PeerAddress address_(std::uint32_t const value)
+    {
+        overwatch::sketch::PeerAddress address{};
+        for (int i = 0; i < 4; ++i)
+        {
+            address[12 + i] = static_cast<std::uint8_t>(value >> (24 - 8 * i));
+        }
+        return address;
+    }
+} // namespace
+
+TEST_CASE(TEST_NAME_PREFIX "Count-Min sketches bound the weight of every item")
+{
+    REQUIRE_THROWS_AS(CountMinSketch(300, 4), std::invalid_argument);
+    REQUIRE_THROWS_AS(CountMinSketch(256, 0), std::invalid_argument);
+    REQUIRE_THROWS_AS(CountMinSketch(256, overwatch::sketch::COUNT_MIN_MAX_DEPTH + 1), std::invalid_argument);
+
+    // Skewed weights: item i weighs about 10000 / (i + 1)
+    std::mt19937 random{1};
+    std::map<std::uint32_t, std::uint64_t> weights;
+    CountMinSketch all{256, 4};
+    CountMinSketch first{256, 4};
+    CountMinSketch second{256, 4};
+    for (int i = 0; i < 50000; ++i)
+    {
+        double const rank = 1 / std::uniform_real_distribution<double>{0.0002, 1}(random);
+        std::uint32_t const item = static_cast<std::uint32_t>(std::min(5000.0, rank - 1));
+        std::uint64_t const weight = 1 + random() % 1500;
+        weights[item] += weight;
+        std::uint64_t const hash = overwatch::sketch::hash_port(item);
+        all.add(hash, weight);
+        (i % 3 == 0 ? first : second).add(hash, weight);
+    }
+    first.merge(second);
+    REQUIRE(first.get_total() == all.get_total());
+
+    std::size_t within_bound = 0;
+    for (auto const &[item, weight] : weights)
+    {
+        std::uint64_t const hash = overwatch::sketch::hash_port(item);
+        std::uint64_t const estimate = all.estimate(hash);
+        REQUIRE(estimate >= weight);
+        // Merging is exact
+        REQUIRE(first.estimate(hash) == estimate);
+        within_bound += static_cast<double>(estimate - weight) <= 2.72 / 256 * static_cast<double>(all.get_total());
+    }
+    // The bound holds with probability 1 - e^-4 (98%)
+    REQUIRE(within_bound >= weights.size() * 95 / 100);
+
+    REQUIRE_THROWS_AS(all.merge(CountMinSketch{512, 4}), std::invalid_argument);
+    all.reset();
+    REQUIRE(all.get_total() == 0);
+    REQUIRE(all.estimate(overwatch::sketch::hash_port(0)) == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "HyperLogLog sketches count distinct items")
+{
+    REQUIRE_THROWS_AS(HyperLogLog(overwatch::sketch::HYPERLOGLOG_MIN_PRECISION - 1), std::invalid_argument);
+    REQUIRE_THROWS_AS(HyperLogLog(overwatch::sketch::HYPERLOGLOG_MAX_PRECISION + 1), std::invalid_argument);
+
+    HyperLogLog empty{10};
+    REQUIRE(empty.estimate() == 0);
+    REQUIRE(empty.memory_usage() == 1024);
+
+    for (std::uint32_t const count : {1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U})
+    {
+        HyperLogLog sketch{10};
+        for (std::uint32_t i = 0; i < count; ++i)
+        {
+            // Every item added twice
+            sketch.add(overwatch::sketch::hash_peer(address_(i)));
+            sketch.add(overwatch::sketch::hash_peer(address_(i)));
+        }
+        INFO(count << " distinct items, estimated " << sketch.estimate());
+        // 3 standard errors
+        REQUIRE(static_cast<double>(sketch.estimate()) == Approx(count).epsilon(0.1));
+    }
+
+    // Merging gives the sketch of the union
+    HyperLogLog first{12};
+    HyperLogLog second{12};
+    HyperLogLog both{12};
+    for (std::uint32_t i = 0; i < 30000; ++i)
+    {
+        std::uint64_t const hash = overwatch::sketch::hash_peer(address_(i));
+        both.add(hash);
+        if (i < 20000)
+        {
+            first.add(hash);
+        }
+        if (i >= 10000)
+        {
+            second.add(hash);
+        }
+    }
+    first.merge(second);
+    REQUIRE(first.estimate() == both.estimate());
+    REQUIRE(static_cast<double>(first.estimate()) == Approx(30000).epsilon(0.05));
+    REQUIRE_THROWS_AS(first.merge(HyperLogLog{10}), std::invalid_argument);
+    first.reset();
+    REQUIRE(first.estimate() == 0);
+}
+
+TEST_CASE(TEST_NAME_PREFIX "Space-Saving summaries keep the heaviest items")
+{
+    REQUIRE_THROWS_AS(SpaceSaving<std::uint32_t>{0}, std::invalid_argument);
+
+    // 5 heavy items among many light ones, spread over two summaries
+    std::mt19937 random{2};
+    std::vector<std::uint32_t> stream;
+    for (std::uint32_t heavy = 0; heavy < 5; ++heavy)
+    {
+        stream.insert(stream.end(), 400 + 100 * heavy, heavy);
+    }
+    for (std::uint32_t light = 100; light < 3100; ++light)
+    {
+        stream.push_back(light);
+    }
+    std::shuffle(stream.begin(), stream.end(), random);
+
+    SpaceSaving<std::uint32_t> all{16};
+    SpaceSaving<std::uint32_t> first{16};
+    SpaceSaving<std::uint32_t> second{16};
+    for (std::size_t i = 0; i < stream.size(); ++i)
+    {
+        all.add(stream[i], overwatch::sketch::hash_port(stream[i]), 1);
+        (i % 2 == 0 ? first : second).add(stream[i], overwatch::sketch::hash_port(stream[i]), 1);
+    }
+    first.merge(second);
+    for (SpaceSaving<std::uint32_t> const *const summary : {&all, &first})
+    {
+        REQUIRE(summary->get_items().size() == 16);
+        for (std::uint32_t heavy = 0; heavy < 5; ++heavy)
+        {
+            auto const &items = summary->get_items();
+            auto const item = std::find_if(items.begin(), items.end(), [heavy](auto const &item) { return item.key == heavy; });
+            REQUIRE(item != items.end());
+            REQUIRE(item->count >= 400 + 100 * heavy);
+            REQUIRE(item->count - item->error <= 400 + 100 * heavy);
+        }
+    }
+
+    // Summaries that never replaced an item count exactly
+    SpaceSaving<std::uint32_t> exact{16};
+    SpaceSaving<std::uint32_t> other{16};
+    exact.add(1, overwatch::sketch::hash_port(1), 10);
+    other.add(1, overwatch::sketch::hash_port(1), 5);
+    other.add(2, overwatch::sketch::hash_port(2), 7);
+    exact.merge(other);
+    REQUIRE(exact.get_items().size() == 2);
+    for (auto const &item : exact.get_items())
+    {
+        REQUIRE(item.count == (item.key == 1 ? 15 : 7));
+        REQUIRE(item.error == 0);
+    }
+    exact.reset();
+    REQUIRE(exact.get_items().empty());
+}
+
+TEST_CASE(TEST_NAME_PREFIX "The targets' traffic is summarized across workers")
+{
+    REQUIRE_THROWS_AS(Summarizer(1, 0, 3, [](TargetSummary const &) {}), std::invalid_argument);
+    REQUIRE_THROWS_AS(Summarizer(1, SECOND_NS, 0, [](TargetSummary const &) {}), std::invalid_argument);
+
+    std::vector<TargetSummary> summaries;
+    Summarizer summarizer{256, SECOND_NS, 3, [&summaries](TargetSummary const &summary) { summaries.push_back(summary); }};
+    TestWorker first{summarizer};
+    TestWorker second{summarizer};
+
+    // A download on the first worker, a scan of hosts and ports on the second during second 1
+    for (std::uint64_t i = 0; i < 150; ++i)
+    {
+        first.udp("192.168.1.10", "203.0.113.5", 50000, 443, SECOND_NS + i * 1000);
+        first.udp("203.0.113.5", "192.168.1.10", 443, 50000, SECOND_NS + i * 1000 + 500);
+    }
+    for (std::uint32_t i = 0; i < 300; ++i)
+    {
+        second.udp("192.168.1.10", "10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256), 40000, 80,
+                   SECOND_NS + i * 1000);
+    }
+    for (std::uint16_t port = 1; port <= 200; ++port)
+    {
+        second.udp("192.168.1.10", "198.51.100.1", 40000, port, SECOND_NS + 500000 + port * 1000);
+    }
+    // Between two targets, accounted to both
+    first.udp("192.168.1.20", "192.168.1.10", 5353, 5353, SECOND_NS + 900000);
+    REQUIRE(first.get_stage().get_packets() == 302);
+    REQUIRE(second.get_stage().get_packets() == 500);
+    REQUIRE(first.get_stage().memory_usage() > 0);
+
+    // Second 1 is summarized once second 2 is over for a worker
+    first.udp("192.168.1.10", "203.0.113.5", 50000, 443, 2 * SECOND_NS + 100);
+    second.udp("192.168.1.10", "203.0.113.5", 50001, 443, 2 * SECOND_NS + 200);
+    REQUIRE(summaries.empty());
+    first.udp("192.168.1.10", "203.0.113.5", 50000, 443, 3 * SECOND_NS + 100);
+    REQUIRE(summaries.size() == 2);
+    REQUIRE(summarizer.get_summaries() == 2);
+
+    TargetSummary const &target = summaries[0];
+    REQUIRE(target.target == 0);
+    REQUIRE(target.start_ns == 0);
+    REQUIRE(target.end_ns == 2 * SECOND_NS);
+    REQUIRE(target.packets == 801);
+    REQUIRE(target.bytes == 801 * 142);
+    REQUIRE(static_cast<double>(target.peers) == Approx(303).epsilon(0.1));
+    REQUIRE(static_cast<double>(target.ports) == Approx(202).epsilon(0.1));
+    REQUIRE(target.top_peers.size() == 10);
+    REQUIRE(peer_(target.top_peers[0]) == "203.0.113.5");
+    REQUIRE(target.top_peers[0].bytes >= 300 * 142);
+    REQUIRE(target.top_peers[0].bytes <= 300 * 142 + target.bytes / 50);
+    REQUIRE(peer_(target.top_peers[1]) == "198.51.100.1");
+    REQUIRE(target.top_ports[0].protocol == overwatch::decode::PROTOCOL_UDP);
+    REQUIRE(target.top_ports[0].port == 80);
+    REQUIRE(target.top_ports[0].bytes >= 300 * 142);
+    REQUIRE(target.top_ports[1].port == 443);
+    for (std::size_t i = 1; i < target.top_peers.size(); ++i)
+    {
+        REQUIRE(target.top_peers[i - 1].bytes >= target.top_peers[i].bytes);
+    }
+    TargetSummary const &neighbour = summaries[1];
+    REQUIRE(neighbour.packets == 1);
+    REQUIRE(neighbour.peers == 1);
+    REQUIRE(peer_(neighbour.top_peers[0]) == "192.168.1.10");
+    REQUIRE(neighbour.top_ports[0].port == 5353);
+
+    // Second 2 once the first worker moves on, then the last window, seconds 1 to 3, once the workers are done
+    first.flush();
+    REQUIRE(summaries.size() == 4);
+    REQUIRE(summaries[2].end_ns == 3 * SECOND_NS);
+    REQUIRE(summaries[2].packets == 801 + 1);
+    second.flush();
+    summarizer.finish();
+    REQUIRE(summaries.size() == 6);
+    REQUIRE(summaries[4].start_ns == SECOND_NS);
+    REQUIRE(summaries[4].end_ns == 4 * SECOND_NS);
+    REQUIRE(summaries[4].packets == 801 + 2 + 1);
+    summarizer.finish();
+    REQUIRE(summaries.size() == 6);
+
+    // Second 1 left the window of the summary of second 4
+    TargetSketch sketch;
+    sketch.add(address_(1), overwatch::sketch::hash_peer(address_(1)), 0, 0, 100);
+    summarizer.submit(4, 0, sketch);
+    summarizer.submit(1, 0, sketch);
+    REQUIRE(summarizer.get_late() == 1);
+    // Second 2 still does, second 3 was already summarized
+    summarizer.submit(2, 0, sketch);
+    summarizer.submit(5, 0, sketch);
+    REQUIRE(summaries.size() == 7);
+    REQUIRE(summaries[6].start_ns == 2 * SECOND_NS);
+    REQUIRE(summaries[6].packets == (2 + 1) + 1 + 1);
+    summarizer.finish();
+    REQUIRE(summaries.size() == 8);
+    REQUIRE(summaries[7].start_ns == 3 * SECOND_NS);
+    REQUIRE(summaries[7].packets == 1 + 1 + 1);
+}
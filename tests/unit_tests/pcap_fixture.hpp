@@ -0,0 +1,278 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ip_address.hpp"
+#include "test_utils.hpp"
+
+namespace fixtures
+{
+    // A frame to write into a capture file
+    struct Frame
+    {
+        std::vector<std::uint8_t> bytes;
+        std::uint64_t timestamp_ns;
+    };
+
+    /**
+     * Parses a dotted IPv4 address into host byte order
+     *
+     * @param[in] addr The IPv4 address
+     * @return The address as an integer
+     */
+    inline std::uint32_t ipv4(std::string const &addr)
+    {
+        std::uint32_t value = 0;
+        std::size_t start = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            std::size_t const end = addr.find('.', start);
+            value = (value << 8) | static_cast<std::uint32_t>(std::stoul(addr.substr(start, end - start)));
+            start = end + 1;
+        }
+        return value;
+    }
+
+    inline void put16(std::vector<std::uint8_t> &bytes, std::uint16_t const value)
+    {
+        bytes.push_back(static_cast<std::uint8_t>(value >> 8));
+        bytes.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    inline void put32(std::vector<std::uint8_t> &bytes, std::uint32_t const value)
+    {
+        put16(bytes, static_cast<std::uint16_t>(value >> 16));
+        put16(bytes, static_cast<std::uint16_t>(value));
+    }
+
+    /**
+     * Builds an Ethernet header, optionally with 802.1Q tags
+     *
+     * @param[in] ether_type Ethertype of the payload
+     * @param[in] vlans VLAN ids, outermost first
+     * @return The header bytes
+     */
+    inline std::vector<std::uint8_t> ethernet(std::uint16_t const ether_type, std::vector<std::uint16_t> const &vlans = {})
+    {
+        std::vector<std::uint8_t> bytes{0x02, 0, 0, 0, 0, 0x02, 0x02, 0, 0, 0, 0, 0x01};
+        for (std::size_t i = 0; i < vlans.size(); ++i)
+        {
+            put16(bytes, i == 0 && vlans.size() > 1 ? 0x88A8 : 0x8100);
+            put16(bytes, vlans[i]);
+        }
+        put16(bytes, ether_type);
+        return bytes;
+    }
+
+    /**
+     * Builds an Ethernet/IPv4 frame carrying a transport payload
+     *
+     * @param[in] src Source IPv4 address
+     * @param[in] dst Destination IPv4 address
+     * @param[in] protocol IP protocol number of the payload
+     * @param[in] transport Transport header and payload
+     * @param[in] vlans VLAN ids, outermost first
+     * @return The frame bytes
+     */
+    inline std::vector<std::uint8_t> ipv4_frame(std::string const &src, std::string const &dst, std::uint8_t const protocol,
+                                                std::vector<std::uint8_t> const &transport,
+                                                std::vector<std::uint16_t> const &vlans = {})
+    {
+        std::vector<std::uint8_t> bytes = ethernet(0x0800, vlans);
+        std::size_t const ip_start = bytes.size();
+        bytes.push_back(0x45);
+        bytes.push_back(0);
+        put16(bytes, static_cast<std::uint16_t>(20 + transport.size()));
+        put32(bytes, 0x00004000);
+        bytes.push_back(64);
+        bytes.push_back(protocol);
+        put16(bytes, 0);
+        put32(bytes, ipv4(src));
+        put32(bytes, ipv4(dst));
+        std::uint32_t sum = 0;
+        for (std::size_t i = ip_start; i < ip_start + 20; i += 2)
+        {
+            sum += static_cast<std::uint32_t>(bytes[i] << 8 | bytes[i + 1]);
+        }
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        sum = ~((sum & 0xFFFF) + (sum >> 16)) & 0xFFFF;
+        bytes[ip_start + 10] = static_cast<std::uint8_t>(sum >> 8);
+        bytes[ip_start + 11] = static_cast<std::uint8_t>(sum);
+        bytes.insert(bytes.end(), transport.begin(), transport.end());
+        return bytes;
+    }
+
+    /**
+     * Builds an Ethernet/IPv4/UDP frame
+     */
+    inline std::vector<std::uint8_t> udp_frame(std::string const &src, std::string const &dst, std::uint16_t const src_port,
+                                               std::uint16_t const dst_port, std::string const &payload = "",
+                                               std::vector<std::uint16_t> const &vlans = {})
+    {
+        std::vector<std::uint8_t> udp;
+        put16(udp, src_port);
+        put16(udp, dst_port);
+        put16(udp, static_cast<std::uint16_t>(8 + payload.size()));
+        put16(udp, 0);
+        udp.insert(udp.end(), payload.begin(), payload.end());
+        return ipv4_frame(src, dst, 17, udp, vlans);
+    }
+
+    /**
+     * Builds an Ethernet/IPv6 frame carrying a payload
+     *
+     * @param[in] src Source IPv6 address
+     * @param[in] dst Destination IPv6 address
+     * @param[in] next_header Next header of the payload
+     * @param[in] payload Extension headers, transport header and payload
+     * @param[in] vlans VLAN ids, outermost first
+     * @return The frame bytes
+     */
+    inline std::vector<std::uint8_t> ipv6_frame(std::string const &src, std::string const &dst, std::uint8_t const next_header,
+                                                std::vector<std::uint8_t> const &payload,
+                                                std::vector<std::uint16_t> const &vlans = {})
+    {
+        std::vector<std::uint8_t> bytes = ethernet(0x86DD, vlans);
+        put32(bytes, 0x60000000);
+        put16(bytes, static_cast<std::uint16_t>(payload.size()));
+        bytes.push_back(next_header);
+        bytes.push_back(64);
+        for (std::string const &addr : {src, dst})
+        {
+            std::array<std::uint8_t, 16> const addr_bytes = common::utils::parse_ip_addr(addr).value().to_bytes();
+            bytes.insert(bytes.end(), addr_bytes.begin(), addr_bytes.end());
+        }
+        bytes.insert(bytes.end(), payload.begin(), payload.end());
+        return bytes;
+    }
+
+    /**
+     * Builds an Ethernet/IPv6/UDP frame
+     */
+    inline std::vector<std::uint8_t> udp6_frame(std::string const &src, std::string const &dst, std::uint16_t const src_port,
+                                                std::uint16_t const dst_port, std::string const &payload = "",
+                                                std::vector<std::uint16_t> const &vlans = {})
+    {
+        std::vector<std::uint8_t> udp;
+        put16(udp, src_port);
+        put16(udp, dst_port);
+        put16(udp, static_cast<std::uint16_t>(8 + payload.size()));
+        put16(udp, 0);
+        udp.insert(udp.end(), payload.begin(), payload.end());
+        return ipv6_frame(src, dst, 17, udp, vlans);
+    }
+
+    /**
+     * Builds an Ethernet/IPv4/TCP frame
+     */
+    inline std::vector<std::uint8_t> tcp_frame(std::string const &src, std::string const &dst, std::uint16_t const src_port,
+                                               std::uint16_t const dst_port, std::uint32_t const seq, std::uint8_t const flags,
+                                               std::string const &payload = "", std::uint32_t const ack = 0)
+    {
+        std::vector<std::uint8_t> tcp;
+        put16(tcp, src_port);
+        put16(tcp, dst_port);
+        put32(tcp, seq);
+        put32(tcp, ack);
+        tcp.push_back(0x50);
+        tcp.push_back(flags);
+        put16(tcp, 65535);
+        put32(tcp, 0);
+        tcp.insert(tcp.end(), payload.begin(), payload.end());
+        return ipv4_frame(src, dst, 6, tcp);
+    }
+
+    /**
+     * Builds an Ethernet ARP request
+     */
+    inline std::vector<std::uint8_t> arp_frame(std::string const &sender, std::string const &target)
+    {
+        std::vector<std::uint8_t> bytes = ethernet(0x0806);
+        std::vector<std::uint8_t> const arp{0, 1, 0x08, 0, 6, 4, 0, 1, 0x02, 0, 0, 0, 0, 0x01};
+        bytes.insert(bytes.end(), arp.begin(), arp.end());
+        put32(bytes, ipv4(sender));
+        bytes.insert(bytes.end(), 6, 0);
+        put32(bytes, ipv4(target));
+        return bytes;
+    }
+
+    template <typename T>
+    void write_raw(std::ofstream &out, T const value)
+    {
+        out.write(reinterpret_cast<char const *>(&value), sizeof(value));
+    }
+
+    /**
+     * Writes frames as a classic pcap file in host byte order
+     *
+     * @param[in] path Output file
+     * @param[in] frames Frames to write
+     * @param[in] nanosecond Use the nanosecond timestamp magic
+     */
+    inline void write_pcap(std::filesystem::path const &path, std::vector<Frame> const &frames, bool const nanosecond = false)
+    {
+        std::ofstream out{path, std::ios::binary};
+        write_raw<std::uint32_t>(out, nanosecond ? 0xA1B23C4DU : 0xA1B2C3D4U);
+        write_raw<std::uint16_t>(out, 2);
+        write_raw<std::uint16_t>(out, 4);
+        write_raw<std::int32_t>(out, 0);
+        write_raw<std::uint32_t>(out, 0);
+        write_raw<std::uint32_t>(out, 65535);
+        write_raw<std::uint32_t>(out, 1);
+        for (Frame const &frame : frames)
+        {
+            write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(frame.timestamp_ns / 1000000000ULL));
+            write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(frame.timestamp_ns % 1000000000ULL / (nanosecond ? 1 : 1000)));
+            write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(frame.bytes.size()));
+            write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(frame.bytes.size()));
+            out.write(reinterpret_cast<char const *>(frame.bytes.data()), static_cast<std::streamsize>(frame.bytes.size()));
+        }
+    }
+
+    /**
+     * Writes frames as a pcapng file with a single Ethernet interface (microsecond resolution)
+     *
+     * @param[in] path Output file
+     * @param[in] frames Frames to write
+     */
+    inline void write_pcapng(std::filesystem::path const &path, std::vector<Frame> const &frames)
+    {
+        std::ofstream out{path, std::ios::binary};
+        // Section header block
+        write_raw<std::uint32_t>(out, 0x0A0D0D0AU);
+        write_raw<std::uint32_t>(out, 28);
+        write_raw<std::uint32_t>(out, 0x1A2B3C4DU);
+        write_raw<std::uint16_t>(out, 1);
+        write_raw<std::uint16_t>(out, 0);
+        write_raw<std::int64_t>(out, -1);
+        write_raw<std::uint32_t>(out, 28);
+        // Interface description block
+        write_raw<std::uint32_t>(out, 1);
+        write_raw<std::uint32_t>(out, 20);
+        write_raw<std::uint16_t>(out, 1);
+        write_raw<std::uint16_t>(out, 0);
+        write_raw<std::uint32_t>(out, 65535);
+        write_raw<std::uint32_t>(out, 20);
+        for (Frame const &frame : frames)
+        {
+            std::uint32_t const padded = static_cast<std::uint32_t>((frame.bytes.size() + 3) & ~std::size_t{3});
+            std::uint64_t const timestamp = frame.timestamp_ns / 1000;
+            // Enhanced packet block
+            write_raw<std::uint32_t>(out, 6);
+            write_raw<std::uint32_t>(out, 32 + padded);
+            write_raw<std::uint32_t>(out, 0);
+            write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(timestamp >> 32));
+            write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(timestamp));
+            write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(frame.bytes.size()));
+            write_raw<std::uint32_t>(out, static_cast<std::uint32_t>(frame.bytes.size()));
+            out.write(reinterpret_cast<char const *>(frame.bytes.data()), static_cast<std::streamsize>(frame.bytes.size()));
+            out.write("\0\0\0", padded - frame.bytes.size());
+            write_raw<std::uint32_t>(out, 32 + padded);
+        }
+    }
+} // namespace fixtures
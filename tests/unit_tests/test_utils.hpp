@@ -0,0 +1,19 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace fixtures
+{
+    /**
+     * Builds a unique path in the temporary directory
+     *
+     * @param[in] name File name suffix
+     * @return The temporary file path
+     */
+    inline std::filesystem::path temp_path(std::string const &name)
+    {
+        static int counter = 0;
+        return std::filesystem::temp_directory_path() / ("overwatch-" + std::to_string(++counter) + "-" + name);
+    }
+} // namespace fixtures